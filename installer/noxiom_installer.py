@@ -3,7 +3,8 @@
 noxiom_installer.py — NOXIOM OS GUI Installer
 
 Single-file installer using stdlib only (tkinter, urllib, subprocess,
-threading, tempfile, os, platform, ctypes, logging).
+threading, queue, hashlib, lzma, tempfile, os, platform, ctypes, logging;
+mmap and fcntl for direct I/O on Linux/macOS).
 
 Usage:
   Windows : python noxiom_installer.py   (must run as Administrator)
@@ -11,13 +12,25 @@ Usage:
   macOS   : sudo python3 noxiom_installer.py
 
 Robustness features:
-  - Download retried up to 3 times with exponential back-off
-  - Cancel button available throughout download + write
+  - Image streamed straight from the network to the drive: a download
+    thread (decompressing .img.xz, or .img.zst on Python 3.14+) feeds a
+    bounded queue that the writer drains, so nothing is staged on disk
+  - Download retried up to 3 times with exponential back-off, resuming
+    with an HTTP Range request where the server allows it
+  - SHA-256 of the image checked against the release's SHA256SUMS (or
+    GitHub's asset digest), then the drive read back and hashed again
+  - Cancel button available throughout download + write + verify
   - Drive size checked against image size before writing
+  - All-zero 64 KB blocks of the image are not written when the drive
+    already reads zero there (Linux: one BLKZEROOUT pass on drives that
+    offload it; elsewhere each such block is read back first)
+  - Linux/macOS writes bypass the page cache (O_DIRECT / F_NOCACHE on
+    the raw /dev/rdiskN) with page-aligned buffers
   - Windows volumes locked/dismounted via FindFirstVolumeW (catches
     drives with no drive letter assigned)
   - Common Windows error codes translated to plain-English messages
-  - MB/s speed and ETA shown during download and write
+  - MB/s speed and ETA shown per stage (network, drive, read-back), and
+    how long each stage waited on the other logged at the end
   - Drive auto-ejected on Windows after a successful write
   - Safe close: prompts if user closes window mid-install
   - Full debug log written to the system temp directory
@@ -27,8 +40,12 @@ Robustness features:
 import os
 import sys
 import json
+import errno
+import hashlib
+import http.client
 import logging
 import platform
+import queue
 import subprocess
 import tempfile
 import threading
@@ -46,9 +63,14 @@ API_URL = (
 )
 ASSET_X86   = "noxiom-x86_64.img"
 ASSET_ARM64 = "noxiom-arm64.img"
+ASSET_SUMS  = "SHA256SUMS"          # sha256sum(1) output for every image
 
 # ── Tuning ────────────────────────────────────────────────────────────────────
 CHUNK            = 4 * 1024 * 1024   # 4 MB I/O chunk
+SPARSE_BLOCK     = 64 * 1024         # zero-skip granularity within a chunk
+IO_ALIGN         = 4096              # direct I/O buffer / offset / length
+PIPELINE_DEPTH   = 8                 # CHUNKs queued between download and write
+DOWNLOAD_READ    = 64 * 1024         # bytes per network read
 DOWNLOAD_RETRIES = 3                 # max download attempts
 DOWNLOAD_TIMEOUT = 60                # seconds per HTTP request
 SPEED_WINDOW     = 3.0               # seconds of history for speed average
@@ -318,10 +340,11 @@ def _macos_disk_name(dev_id):
 
 # ── GitHub release info ───────────────────────────────────────────────────────
 class ReleaseInfo:
-    def __init__(self, tag, assets, is_prerelease):
+    def __init__(self, tag, assets, is_prerelease, sums=None):
         self.tag           = tag
-        self.assets        = assets      # { name: {"url": …, "size": int} }
+        self.assets        = assets      # { name: {"url": …, "size": int, "sha256": …} }
         self.is_prerelease = is_prerelease
+        self.sums          = sums or {}  # { name: sha256 hex } from ASSET_SUMS
 
     def asset_url(self, name):
         return self.assets.get(name, {}).get("url")
@@ -329,11 +352,46 @@ class ReleaseInfo:
     def asset_size(self, name):
         return self.assets.get(name, {}).get("size", 0)
 
+    def sha256(self, name):
+        """
+        Published SHA-256 of `name`: the release's SHA256SUMS, else the digest
+        GitHub records for the asset.  None if neither has one.
+        """
+        return self.sums.get(name) or self.assets.get(name, {}).get("sha256")
+
+    def pick_asset(self, image):
+        """
+        Asset name to download for `image`: `image`.zst if the release has
+        it and it can be decoded here, else `image`.xz on the same terms,
+        else the raw `image`.  None if none of those is in the release.
+        """
+        for ext in (".zst", ".xz"):
+            if image + ext in self.assets:
+                try:
+                    _decompressor(image + ext)
+                    return image + ext
+                except ValueError as exc:
+                    log.debug(f"Skipping {image + ext}: {exc}")
+        return image if image in self.assets else None
+
+
+def _parse_sums(text):
+    """sha256sum(1) output → { file name: hex digest }."""
+    sums = {}
+    for line in text.splitlines():
+        parts = line.split()
+        if len(parts) == 2 and len(parts[0]) == 64:
+            name = parts[1].lstrip("*").rsplit("/", 1)[-1]
+            sums[name] = parts[0].lower()
+    return sums
+
 
 def fetch_release():
     """
     Return the most recent pre-release.  Falls back to the most recent
-    release of any kind if no pre-release exists.
+    release of any kind if no pre-release exists.  Checksums come from the
+    release's SHA256SUMS asset if it has one; not being able to fetch it is
+    logged, not fatal.
     """
     req = urllib.request.Request(API_URL, headers={"User-Agent": "noxiom-installer/1.0"})
     with urllib.request.urlopen(req, timeout=DOWNLOAD_TIMEOUT) as resp:
@@ -349,23 +407,51 @@ def fetch_release():
         raise RuntimeError("No releases found on GitHub. Check the releases page.")
 
     tag    = data.get("tag_name", "unknown")
-    assets = {
-        a["name"]: {"url": a["browser_download_url"], "size": int(a.get("size", 0))}
-        for a in data.get("assets", [])
-    }
+    assets = {}
+    for a in data.get("assets", []):
+        digest = a.get("digest") or ""          # "sha256:<hex>", newer uploads only
+        assets[a["name"]] = {
+            "url":    a["browser_download_url"],
+            "size":   int(a.get("size", 0)),
+            "sha256": digest[7:].lower() if digest.startswith("sha256:") else None,
+        }
     log.info(f"Release: {tag}  prerelease={data.get('prerelease')}  assets={list(assets)}")
-    return ReleaseInfo(tag, assets, bool(data.get("prerelease")))
+
+    sums = {}
+    if ASSET_SUMS in assets:
+        try:
+            req = urllib.request.Request(assets[ASSET_SUMS]["url"],
+                                         headers={"User-Agent": "noxiom-installer/1.0"})
+            with urllib.request.urlopen(req, timeout=DOWNLOAD_TIMEOUT) as resp:
+                sums = _parse_sums(resp.read(64 * 1024).decode("utf-8", "replace"))
+            log.info(f"{ASSET_SUMS}: {sums}")
+        except OSError as exc:
+            log.warning(f"Could not fetch {ASSET_SUMS}: {exc}")
+    return ReleaseInfo(tag, assets, bool(data.get("prerelease")), sums)
 
 
 # ── Speed / ETA tracker ───────────────────────────────────────────────────────
 class SpeedTracker:
-    """Rolling-window bytes-per-second tracker."""
+    """
+    Rolling-window bytes-per-second tracker for one stage of the install
+    (download, write, verify).  It also keeps totals for summary(): bytes,
+    time since the first update, and `waited`, the seconds the stage sat
+    blocked on its neighbour — the download on a full queue, the write on an
+    empty one.  The stage that waits is the faster one.
+    """
 
-    def __init__(self):
-        self._hist = []   # [(monotonic_time, total_bytes)]
+    def __init__(self, name=""):
+        self.name   = name
+        self.total  = 0
+        self.waited = 0.0
+        self._start = None
+        self._hist  = []   # [(monotonic_time, total_bytes)]
 
     def update(self, total_bytes):
         now = time.monotonic()
+        if self._start is None:
+            self._start = now
+        self.total = total_bytes
         self._hist.append((now, total_bytes))
         cutoff = now - SPEED_WINDOW
         self._hist = [(t, b) for t, b in self._hist if t >= cutoff]
@@ -384,6 +470,15 @@ class SpeedTracker:
         secs = int(remaining / speed)
         return f"{secs // 60}m {secs % 60}s" if secs >= 60 else f"{secs}s"
 
+    def summary(self):
+        """One log line: how much, how fast on average, how long it waited."""
+        if self._start is None:
+            return f"{self.name}: no data"
+        secs = max(self._hist[-1][0] - self._start, 1e-3)
+        spd  = self.fmt_speed(self.total / secs).strip() or "0 KB/s"
+        return (f"{self.name}: {self.total / 1024**2:.1f} MB in {secs:.1f}s "
+                f"({spd}), {self.waited:.1f}s waiting")
+
     @staticmethod
     def fmt_speed(bps):
         if bps <= 0:
@@ -394,35 +489,47 @@ class SpeedTracker:
 
 
 # ── Download with retry ───────────────────────────────────────────────────────
-def download_asset(url, dest_path, progress_cb, cancel_event):
+def download_stream(url, sink, progress_cb, cancel_event):
     """
-    Stream url → dest_path, retrying up to DOWNLOAD_RETRIES times.
+    Stream url into sink(bytes), DOWNLOAD_READ at a time, retrying up to
+    DOWNLOAD_RETRIES times.  A retry asks for the rest with a Range request
+    so sink sees every byte exactly once; a server that ignores the Range
+    sends it all again and the part already seen is dropped.  progress_cb
+    gets the bytes received so far.  Errors raised by sink are not retried.
     Raises InterruptedError if cancel_event fires.
     """
     last_exc = None
+    received = 0
     for attempt in range(1, DOWNLOAD_RETRIES + 1):
         if cancel_event.is_set():
             raise InterruptedError("Cancelled.")
         try:
-            log.info(f"Download attempt {attempt}: {url}")
-            req = urllib.request.Request(url, headers={"User-Agent": "noxiom-installer/1.0"})
-            downloaded = 0
-            with urllib.request.urlopen(req, timeout=DOWNLOAD_TIMEOUT) as resp, \
-                 open(dest_path, "wb") as f:
+            log.info(f"Download attempt {attempt}: {url} from byte {received}")
+            headers = {"User-Agent": "noxiom-installer/1.0"}
+            if received:
+                headers["Range"] = f"bytes={received}-"
+            req = urllib.request.Request(url, headers=headers)
+            with urllib.request.urlopen(req, timeout=DOWNLOAD_TIMEOUT) as resp:
+                skip = received if resp.status != 206 else 0
                 while True:
                     if cancel_event.is_set():
                         raise InterruptedError("Cancelled.")
-                    chunk = resp.read(64 * 1024)
-                    if not chunk:
+                    data = resp.read(DOWNLOAD_READ)
+                    if not data:
                         break
-                    f.write(chunk)
-                    downloaded += len(chunk)
-                    progress_cb(downloaded)
-            log.info(f"Download complete: {downloaded} bytes")
-            return
+                    if skip:
+                        n = min(skip, len(data))
+                        data, skip = data[n:], skip - n
+                        if not data:
+                            continue
+                    sink(data)
+                    received += len(data)
+                    progress_cb(received)
+            log.info(f"Download complete: {received} bytes")
+            return received
         except InterruptedError:
             raise
-        except Exception as exc:
+        except (OSError, http.client.HTTPException) as exc:
             last_exc = exc
             log.warning(f"Download attempt {attempt} failed: {exc}")
             if attempt < DOWNLOAD_RETRIES:
@@ -432,13 +539,85 @@ def download_asset(url, dest_path, progress_cb, cancel_event):
     raise OSError(f"Download failed after {DOWNLOAD_RETRIES} attempts: {last_exc}")
 
 
+def _decompressor(name):
+    """
+    A fresh streaming decompressor for asset `name` by its suffix, or None
+    for a raw image.  Raises ValueError if this Python cannot decode it
+    (.zst needs Python 3.14's compression.zstd; lzma can be left out of a
+    build).
+    """
+    if name.endswith(".xz"):
+        try:
+            import lzma
+        except ImportError:
+            raise ValueError("this Python was built without lzma")
+        return lzma.LZMADecompressor(lzma.FORMAT_XZ)
+    if name.endswith(".zst"):
+        try:
+            from compression import zstd
+        except ImportError:
+            raise ValueError("zstd needs Python 3.14 or newer")
+        return zstd.ZstdDecompressor()
+    return None
+
+
+def _inflate(decomp, data):
+    """
+    Decompress data in pieces of at most CHUNK bytes: a megabyte of zeros
+    compresses to a few bytes, and the image is mostly zeros.
+    """
+    piece = decomp.decompress(data, CHUNK)
+    while True:
+        yield piece
+        if decomp.eof or decomp.needs_input:
+            return
+        piece = decomp.decompress(b"", CHUNK)
+
+
 # ── Write image to device ─────────────────────────────────────────────────────
-def write_image(image_path, device_path, progress_cb, cancel_event):
-    log.info(f"Writing {image_path} → {device_path}")
+def write_image(chunks, device_path, progress_cb, cancel_event, image_size=0):
+    """
+    Write the image onto device_path from `chunks`, an iterable of bytes that
+    are CHUNK long except perhaps the last (stream_image()'s queue).
+    progress_cb gets the number of image bytes done so far; the total is
+    returned.
+
+    Release images are mostly zeros (a 2 MB x86 disk with a few hundred KB of
+    boot code and kernel at the front; a 128 MB arm64 SD image that is one
+    near-empty FAT32 partition), so each chunk is split into SPARSE_BLOCK
+    runs and a run of zeros is only written if the drive does not already
+    read back zero there.  Where the drive can zero a range itself (Linux,
+    write-zeroes offload) and image_size is known, that is done for the
+    whole image up front and the zero runs are skipped outright.
+    """
+    log.info(f"Writing → {device_path}  (image size {image_size or 'unknown'})")
     if platform.system() == "Windows":
-        _write_windows(image_path, device_path, progress_cb, cancel_event)
-    else:
-        _write_unix(image_path, device_path, progress_cb, cancel_event)
+        return _write_windows(chunks, device_path, progress_cb, cancel_event)
+    return _write_unix(chunks, device_path, progress_cb, cancel_event, image_size)
+
+
+_ZERO_BLOCK = bytes(SPARSE_BLOCK)
+
+
+def _align_up(n):
+    return (n + IO_ALIGN - 1) // IO_ALIGN * IO_ALIGN
+
+
+def _runs(chunk):
+    """
+    Split chunk into [(offset, length, is_zero)], SPARSE_BLOCK at a time, with
+    neighbouring blocks of the same kind merged so each data run is one write.
+    Offsets are SPARSE_BLOCK multiples; only the last length can be ragged.
+    """
+    runs = []
+    for off in range(0, len(chunk), SPARSE_BLOCK):
+        blk  = chunk[off:off + SPARSE_BLOCK]
+        zero = blk == _ZERO_BLOCK[:len(blk)]
+        if runs and runs[-1][2] == zero:
+            runs[-1] = (runs[-1][0], runs[-1][1] + len(blk), zero)
+        else:
+            runs.append((off, len(blk), zero))
+    return runs
 
 
 def _setup_k32():
@@ -492,6 +671,23 @@ def _setup_k32():
         H,               # lpOverlapped
     ]
 
+    k.ReadFile.restype  = ctypes.c_bool
+    k.ReadFile.argtypes = [
+        H,               # hFile
+        H,               # lpBuffer
+        wintypes.DWORD,  # nNumberOfBytesToRead
+        H,               # lpNumberOfBytesRead
+        H,               # lpOverlapped
+    ]
+
+    k.SetFilePointerEx.restype  = ctypes.c_bool
+    k.SetFilePointerEx.argtypes = [
+        H,                  # hFile
+        ctypes.c_longlong,  # liDistanceToMove (LARGE_INTEGER, by value)
+        H,                  # lpNewFilePointer (NULL)
+        wintypes.DWORD,     # dwMoveMethod
+    ]
+
     k.FindFirstVolumeW.restype  = H
     k.FindFirstVolumeW.argtypes = [ctypes.c_wchar_p, wintypes.DWORD]
 
@@ -545,7 +741,7 @@ def _ps_disk_online(disk_num):
         log.debug(f"PowerShell Set-Disk online failed (non-fatal): {exc}")
 
 
-def _write_windows(image_path, device_path, progress_cb, cancel_event):
+def _write_windows(chunks, device_path, progress_cb, cancel_event):
     import ctypes
     from ctypes import wintypes
 
@@ -619,9 +815,9 @@ def _write_windows(image_path, device_path, progress_cb, cancel_event):
                 log.debug(f"  {part_path}: lock={ok_l} dismount={ok_d}")
                 k32.CloseHandle(h)   # ← close immediately; lock auto-releases on close
 
-    # Open physical drive for direct raw write.
+    # Open physical drive for direct raw write (and read-back of zero runs).
     handle = k32.CreateFileW(
-        device_path, GENERIC_WRITE,
+        device_path, GENERIC_READ | GENERIC_WRITE,
         FILE_SHARE_READ | FILE_SHARE_WRITE,
         None, OPEN_EXISTING,
         FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH,
@@ -634,61 +830,355 @@ def _write_windows(image_path, device_path, progress_cb, cancel_event):
         log.error(f"CreateFileW({device_path}) failed: error {err}")
         raise OSError(_win_err(err))
 
-    written_total = 0
+    FILE_BEGIN = 0
+
+    def _seek(offset):
+        if not k32.SetFilePointerEx(handle, offset, None, FILE_BEGIN):
+            err = ctypes.get_last_error()
+            log.error(f"SetFilePointerEx({offset}) failed: error {err}")
+            raise OSError(_win_err(err))
+
+    def _reads_zero(offset, addr, length):
+        # Short reads (the end of the drive) and errors just mean "write it"
+        _seek(offset)
+        got = wintypes.DWORD(0)
+        ok  = k32.ReadFile(handle, addr, length, ctypes.byref(got), None)
+        return (ok and got.value == length and
+                ctypes.string_at(addr, length).count(0) == length)
+
+    done = skipped = 0
     try:
         # FILE_FLAG_NO_BUFFERING requires the buffer to be aligned to the disk's
         # sector size.  Over-allocate by 4095 bytes so we can find a 4096-byte-
         # aligned start address inside the allocation (works for both 512-byte
         # and 4096-byte / "Advanced Format" native-sector drives).
-        _io_raw = (ctypes.c_char * (CHUNK + 4095))()
-        _io_off = (4096 - ctypes.addressof(_io_raw) % 4096) % 4096
-        io_buf  = (ctypes.c_char * CHUNK).from_address(
-            ctypes.addressof(_io_raw) + _io_off
-        )
-        with open(image_path, "rb") as f:
-            while True:
-                if cancel_event.is_set():
-                    raise InterruptedError("Cancelled.")
-                chunk = f.read(CHUNK)
-                if not chunk:
-                    break
+        _io_raw = (ctypes.c_char * (CHUNK + IO_ALIGN - 1))()
+        _io_off = (IO_ALIGN - ctypes.addressof(_io_raw) % IO_ALIGN) % IO_ALIGN
+        io_base = ctypes.addressof(_io_raw) + _io_off
+        for chunk in chunks:
+            if cancel_event.is_set():
+                raise InterruptedError("Cancelled.")
+            for off, n, zero in _runs(chunk):
                 # Write size must be a multiple of the sector size.
                 # 4096 covers both 512-byte and 4K-native drives.
-                if len(chunk) % 4096 != 0:
-                    chunk = chunk + b"\x00" * (4096 - len(chunk) % 4096)
-                ctypes.memmove(io_buf, chunk, len(chunk))
+                size = _align_up(n)
+                addr = io_base + off
+                if zero and _reads_zero(done + off, addr, size):
+                    skipped += n
+                    continue
+                ctypes.memmove(addr, chunk[off:off + n], n)
+                ctypes.memset(addr + n, 0, size - n)
+                _seek(done + off)
                 written = wintypes.DWORD(0)
-                ok = k32.WriteFile(handle, io_buf, len(chunk),
+                ok = k32.WriteFile(handle, addr, size,
                                     ctypes.byref(written), None)
                 if not ok:
                     err = ctypes.get_last_error()
                     log.error(f"WriteFile failed: error {err}")
                     raise OSError(_win_err(err))
-                written_total += written.value
-                progress_cb(written_total)
-        log.info(f"Write complete: {written_total} bytes")
+            done += len(chunk)
+            progress_cb(done)
+        log.info(f"Write complete: {done} bytes, {skipped} already zero")
+        return done
     finally:
         k32.CloseHandle(handle)
         if ps_offline:
             _ps_disk_online(disk_num)
 
 
-def _write_unix(image_path, device_path, progress_cb, cancel_event):
-    written_total = 0
-    with open(image_path, "rb") as src, \
-         open(device_path, "wb", buffering=0) as dst:
-        while True:
+def _open_direct_unix(device_path, access=os.O_RDWR):
+    """
+    Open device_path (read/write by default), past the page cache where the
+    OS allows:
+    O_DIRECT on Linux (falls back to buffered I/O where the device or file
+    system refuses it), F_NOCACHE on macOS.  Returns the fd.
+    """
+    o_direct = getattr(os, "O_DIRECT", 0)
+    if o_direct:
+        try:
+            return os.open(device_path, access | o_direct)
+        except OSError as exc:
+            if exc.errno != errno.EINVAL:
+                raise
+            log.debug(f"O_DIRECT refused for {device_path}; using buffered I/O")
+    fd = os.open(device_path, access)
+    if platform.system() == "Darwin":
+        import fcntl
+        F_NOCACHE = 48
+        try:
+            fcntl.fcntl(fd, F_NOCACHE, 1)
+        except OSError as exc:
+            log.debug(f"F_NOCACHE failed (non-fatal): {exc}")
+    return fd
+
+
+def _zero_range_linux(fd, length):
+    """
+    Have the drive zero its first `length` bytes (BLKZEROOUT), but only if it
+    offloads that (queue/write_zeroes_max_bytes > 0): otherwise the kernel
+    writes the zeros itself, which is slower than reading them back.
+    True if the whole range now reads zero.
+    """
+    import fcntl
+    import stat
+    import struct
+    BLKZEROOUT   = 0x127F
+    BLKGETSIZE64 = 0x80081272
+    try:
+        st = os.fstat(fd)
+        if not stat.S_ISBLK(st.st_mode):
+            return False
+        sysfs = (f"/sys/dev/block/{os.major(st.st_rdev)}:{os.minor(st.st_rdev)}"
+                 "/queue/write_zeroes_max_bytes")
+        with open(sysfs) as q:
+            if int(q.read().strip() or 0) == 0:
+                return False
+        size = struct.unpack("Q", fcntl.ioctl(fd, BLKGETSIZE64, bytes(8)))[0]
+        fcntl.ioctl(fd, BLKZEROOUT, struct.pack("QQ", 0, min(length, size)))
+        log.debug(f"BLKZEROOUT: {min(length, size)} bytes")
+        return True
+    except (OSError, ValueError) as exc:
+        log.debug(f"BLKZEROOUT unavailable: {exc}")
+        return False
+
+
+def _pread_into(fd, view, offset):
+    if hasattr(os, "preadv"):
+        return os.preadv(fd, [view], offset)
+    data = os.pread(fd, len(view), offset)   # macOS: no alignment needed
+    view[:len(data)] = data
+    return len(data)
+
+
+def _pwrite_all(fd, view, offset):
+    while len(view):
+        n = os.pwrite(fd, view, offset)
+        view, offset = view[n:], offset + n
+
+
+def _raw_device_unix(device_path):
+    if platform.system() == "Darwin" and device_path.startswith("/dev/disk"):
+        # The raw node skips the buffer cache; /dev/diskN is many times slower
+        return "/dev/r" + device_path[len("/dev/"):]
+    return device_path
+
+
+def _write_unix(chunks, device_path, progress_cb, cancel_event, image_size):
+    import mmap
+    device_path = _raw_device_unix(device_path)
+
+    done = skipped = 0
+    fd   = _open_direct_unix(device_path)
+    view = memoryview(mmap.mmap(-1, CHUNK))   # page-aligned, for O_DIRECT
+    try:
+        # Bytes known to read zero; a short size hint only costs writes
+        zeroed = _align_up(image_size) if (
+            image_size and platform.system() == "Linux" and
+            _zero_range_linux(fd, _align_up(image_size))) else 0
+        for chunk in chunks:
+            if cancel_event.is_set():
+                raise InterruptedError("Cancelled.")
+            for off, n, zero in _runs(chunk):
+                size = _align_up(n)
+                if zero:
+                    if done + off + size <= zeroed:
+                        skipped += n
+                        continue
+                    with view[off:off + size] as blk:
+                        blank = (_pread_into(fd, blk, done + off) == size
+                                 and blk.tobytes().count(0) == size)
+                    if blank:
+                        skipped += n
+                        continue
+                view[off:off + n] = chunk[off:off + n]
+                view[off + n:off + size] = bytes(size - n)
+                _pwrite_all(fd, view[off:off + size], done + off)
+            done += len(chunk)
+            progress_cb(done)
+        os.fsync(fd)
+    finally:
+        os.close(fd)
+    log.info(f"Write complete: {done} bytes, {skipped} already zero")
+    return done
+
+
+# ── Read-back verify ──────────────────────────────────────────────────────────
+def verify_image(device_path, length, progress_cb, cancel_event):
+    """
+    SHA-256 of the first `length` bytes of device_path.  Read past the OS
+    cache like the writes were, so it is what the media holds and not what
+    was just handed to it.  progress_cb gets the bytes read so far.
+    """
+    log.info(f"Verifying {length} bytes on {device_path}")
+    if platform.system() == "Windows":
+        return _read_windows(device_path, length, progress_cb, cancel_event)
+    return _read_unix(device_path, length, progress_cb, cancel_event)
+
+
+def _read_windows(device_path, length, progress_cb, cancel_event):
+    import ctypes
+    from ctypes import wintypes
+    k32 = _setup_k32()
+    GENERIC_READ           = 0x80000000
+    FILE_SHARE_READ        = 0x1
+    FILE_SHARE_WRITE       = 0x2
+    OPEN_EXISTING          = 3
+    FILE_FLAG_NO_BUFFERING = 0x20000000
+    INVALID_HANDLE         = ctypes.c_void_p(-1).value
+
+    handle = k32.CreateFileW(device_path, GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              None, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, None)
+    if handle in (None, INVALID_HANDLE):
+        err = ctypes.get_last_error()
+        log.error(f"CreateFileW({device_path}) for verify failed: error {err}")
+        raise OSError(_win_err(err))
+
+    digest = hashlib.sha256()
+    done   = 0
+    try:
+        _io_raw = (ctypes.c_char * (CHUNK + IO_ALIGN - 1))()
+        _io_off = (IO_ALIGN - ctypes.addressof(_io_raw) % IO_ALIGN) % IO_ALIGN
+        io_base = ctypes.addressof(_io_raw) + _io_off
+        while done < length:
             if cancel_event.is_set():
                 raise InterruptedError("Cancelled.")
-            chunk = src.read(CHUNK)
-            if not chunk:
+            n   = min(CHUNK, length - done)
+            got = wintypes.DWORD(0)
+            if not k32.ReadFile(handle, io_base, _align_up(n),
+                                 ctypes.byref(got), None):
+                err = ctypes.get_last_error()
+                log.error(f"ReadFile at {done} failed: error {err}")
+                raise OSError(_win_err(err))
+            if got.value < n:
+                raise OSError(f"Read-back stopped at byte {done + got.value}.")
+            digest.update(ctypes.string_at(io_base, n))
+            done += n
+            progress_cb(done)
+    finally:
+        k32.CloseHandle(handle)
+    return digest.hexdigest()
+
+
+def _read_unix(device_path, length, progress_cb, cancel_event):
+    import mmap
+    device_path = _raw_device_unix(device_path)
+
+    digest = hashlib.sha256()
+    done   = 0
+    fd     = _open_direct_unix(device_path, os.O_RDONLY)
+    view   = memoryview(mmap.mmap(-1, CHUNK))
+    try:
+        if hasattr(os, "posix_fadvise"):
+            # Where O_DIRECT was refused, drop what the writes left cached
+            os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+        while done < length:
+            if cancel_event.is_set():
+                raise InterruptedError("Cancelled.")
+            n = min(CHUNK, length - done)
+            with view[:_align_up(n)] as blk:
+                got = _pread_into(fd, blk, done)
+                if got < n:
+                    raise OSError(f"Read-back stopped at byte {done + got}.")
+                digest.update(blk[:n])
+            done += n
+            progress_cb(done)
+    finally:
+        os.close(fd)
+    return digest.hexdigest()
+
+
+# ── Download → write pipeline ─────────────────────────────────────────────────
+def stream_image(url, asset_name, device_path, image_size, dl, wr,
+                 on_progress, cancel_event):
+    """
+    Download `url` and write the image it holds onto device_path as it
+    arrives.  A download thread decompresses the stream by asset_name's
+    suffix and cuts it into CHUNKs on a queue at most PIPELINE_DEPTH deep;
+    the calling thread writes them with write_image() and hashes them on
+    the way.  A slow drive holds the download back (and the other way
+    round) with no more than the queue in memory.
+
+    dl and wr are the two stages' trackers, fed with network bytes received
+    and image bytes written, and their `waited` with the time spent on a
+    full / empty queue.  on_progress() runs after either moves.
+
+    Returns (sha256 hex, length) of the image as written.
+    """
+    decomp = _decompressor(asset_name)
+    chunks = queue.Queue(PIPELINE_DEPTH)
+    stop   = threading.Event()          # writer finished, failed or cancelled
+    digest = hashlib.sha256()
+
+    def _put(item):
+        t0 = time.monotonic()
+        while not stop.is_set():
+            try:
+                chunks.put(item, timeout=0.2)
                 break
-            dst.write(chunk)
-            written_total += len(chunk)
-            progress_cb(written_total)
-        dst.flush()
-        os.fsync(dst.fileno())
-    log.info(f"Write complete: {written_total} bytes")
+            except queue.Full:
+                pass
+        dl.waited += time.monotonic() - t0
+
+    def _download():
+        pending = bytearray()
+
+        def sink(data):
+            try:
+                for piece in ([data] if decomp is None else _inflate(decomp, data)):
+                    pending.extend(piece)
+                    while len(pending) >= CHUNK:
+                        _put(bytes(pending[:CHUNK]))
+                        del pending[:CHUNK]
+            except Exception as exc:    # LZMAError, ZstdError: not retried
+                raise ValueError(f"The download is corrupt ({exc}). "
+                                 "Please try again.") from exc
+
+        def dl_cb(received):
+            dl.update(received)
+            on_progress()
+
+        try:
+            download_stream(url, sink, dl_cb, stop)
+            if decomp is not None and not decomp.eof:
+                raise OSError("The download ended partway through the compressed image.")
+            if pending:
+                _put(bytes(pending))
+            _put(None)
+        except Exception as exc:
+            _put(exc)
+
+    def _chunks():
+        while True:
+            t0 = time.monotonic()
+            while True:
+                if cancel_event.is_set():
+                    raise InterruptedError("Cancelled.")
+                try:
+                    item = chunks.get(timeout=0.2)
+                    break
+                except queue.Empty:
+                    pass
+            wr.waited += time.monotonic() - t0
+            if item is None:
+                return
+            if isinstance(item, Exception):
+                raise item
+            digest.update(item)
+            yield item
+
+    def wr_cb(done):
+        wr.update(done)
+        on_progress()
+
+    dl.update(0)
+    wr.update(0)
+    threading.Thread(target=_download, name="download", daemon=True).start()
+    try:
+        length = write_image(_chunks(), device_path, wr_cb, cancel_event, image_size)
+    finally:
+        stop.set()
+    return digest.hexdigest(), length
 
 
 def _eject_windows(device_path):
@@ -921,21 +1411,21 @@ class App(tk.Tk):
 
         drive      = self._drives[sel[0]]
         arch       = self._arch.get()
-        asset_name = ASSET_ARM64 if arch == "arm64" else ASSET_X86
-        asset_url  = self._release.asset_url(asset_name)
-        asset_size = self._release.asset_size(asset_name)
+        image      = ASSET_ARM64 if arch == "arm64" else ASSET_X86
+        asset_name = self._release.pick_asset(image)
+        image_size = self._release.asset_size(image)   # 0: only compressed
 
-        if not asset_url:
+        if not asset_name:
             messagebox.showerror("Asset not found",
-                f"'{asset_name}' not found in release '{self._release.tag}'.\n"
+                f"'{image}' not found in release '{self._release.tag}'.\n"
                 "Check the GitHub releases page.")
             return
 
         # Refuse if the drive is definitely too small.
-        if drive.size_bytes > 0 and asset_size > 0 and drive.size_bytes < asset_size:
+        if drive.size_bytes > 0 and image_size > 0 and drive.size_bytes < image_size:
             messagebox.showerror("Drive too small",
                 f"The selected drive ({drive.size_str()}) is smaller than the image "
-                f"({asset_size / (1024**3):.1f} GB).\n"
+                f"({image_size / (1024**3):.1f} GB).\n"
                 "Please use a larger drive.")
             return
 
@@ -958,7 +1448,7 @@ class App(tk.Tk):
 
         threading.Thread(
             target=self._install_worker,
-            args=(drive, asset_url, asset_size),
+            args=(drive, image, asset_name),
             daemon=True,
         ).start()
 
@@ -968,48 +1458,68 @@ class App(tk.Tk):
         self._status.set("Cancelling…")
 
     # ── Install worker (background thread) ────────────────────────────────────
-    def _install_worker(self, drive, url, total_size):
-        tmp_fd, tmp_path = tempfile.mkstemp(suffix=".img")
-        os.close(tmp_fd)
-        log.info(f"Install started: drive={drive.path}  url={url}")
-
+    def _install_worker(self, drive, image, asset):
+        release    = self._release
+        url        = release.asset_url(asset)
+        asset_size = release.asset_size(asset)
+        image_size = release.asset_size(image)
+        expected   = release.sha256(image)
+        log.info(f"Install started: drive={drive.path}  url={url}  sha256={expected}")
+
+        dl = SpeedTracker("download")
+        wr = SpeedTracker("write")
+        rb = SpeedTracker("verify")
         try:
-            # Phase 1 — Download (0 → 50 %)
-            speed = SpeedTracker()
-
-            def dl_cb(downloaded):
-                speed.update(downloaded)
-                pct  = (downloaded / total_size * 50) if total_size else 0
-                now  = downloaded / (1024 ** 2)
-                tot  = total_size / (1024 ** 2)
-                spd  = SpeedTracker.fmt_speed(speed.bps())
-                eta  = speed.eta_str(total_size - downloaded)
+            # Phase 1 — Download and write, overlapped (0 → 80 %).  With the
+            # image size known the bar follows the drive, else the network.
+            if image_size:
+                lead, total = wr, image_size
+            else:
+                lead, total = dl, asset_size
+
+            def pipe_cb():
+                pct  = (lead.total / total * 80) if total else 0
+                now  = lead.total / (1024 ** 2)
+                tot  = total / (1024 ** 2)
+                net  = SpeedTracker.fmt_speed(dl.bps()) or "  …"
+                dev  = SpeedTracker.fmt_speed(wr.bps()) or "  …"
+                eta  = lead.eta_str(total - lead.total)
                 info = f"  ETA {eta}" if eta else ""
                 self.after(0, lambda p=pct, n=now, t=tot:
                     (self._progress.configure(value=p),
-                     self._status.set(f"Downloading…  {n:.1f} / {t:.1f} MB{spd}{info}")))
+                     self._status.set(f"{n:.1f} / {t:.1f} MB   net{net}   "
+                                      f"drive{dev}{info}")))
 
             self.after(0, lambda: self._status.set("Starting download…"))
-            download_asset(url, tmp_path, dl_cb, self._cancel)
-
-            # Phase 2 — Write (50 → 100 %)
-            img_size = os.path.getsize(tmp_path)
-            speed2   = SpeedTracker()
-
-            def wr_cb(written):
-                speed2.update(written)
-                pct  = 50 + (written / img_size * 50) if img_size else 50
-                now  = written  / (1024 ** 2)
-                tot  = img_size / (1024 ** 2)
-                spd  = SpeedTracker.fmt_speed(speed2.bps())
-                eta  = speed2.eta_str(img_size - written)
+            sha, length = stream_image(url, asset, drive.path, image_size,
+                                       dl, wr, pipe_cb, self._cancel)
+            log.info(f"Image written: {length} bytes  sha256={sha}")
+            if expected and sha != expected:
+                raise OSError("The downloaded image does not match the release "
+                              "checksum. Please try again.")
+            if not expected:
+                log.warning(f"No published checksum for {image}; verifying "
+                            "against the hash of what was written.")
+
+            # Phase 2 — Read back and hash (80 → 100 %)
+            def rb_cb(read):
+                rb.update(read)
+                pct  = 80 + (read / length * 20) if length else 80
+                now  = read   / (1024 ** 2)
+                tot  = length / (1024 ** 2)
+                spd  = SpeedTracker.fmt_speed(rb.bps())
+                eta  = rb.eta_str(length - read)
                 info = f"  ETA {eta}" if eta else ""
                 self.after(0, lambda p=pct, n=now, t=tot:
                     (self._progress.configure(value=p),
-                     self._status.set(f"Writing…  {n:.1f} / {t:.1f} MB{spd}{info}")))
+                     self._status.set(f"Verifying…  {n:.1f} / {t:.1f} MB{spd}{info}")))
 
-            self.after(0, lambda: self._status.set("Writing to drive…"))
-            write_image(tmp_path, drive.path, wr_cb, self._cancel)
+            self.after(0, lambda: self._status.set("Verifying drive…"))
+            rb.update(0)
+            if verify_image(drive.path, length, rb_cb, self._cancel) != sha:
+                raise OSError("Verification failed: the drive does not read back "
+                              "what was written. Try another drive or card reader.")
+            log.info("Verify OK.")
 
             # Eject (Windows only)
             if platform.system() == "Windows":
@@ -1027,10 +1537,8 @@ class App(tk.Tk):
             self.after(0, lambda m=msg: self._on_error(m))
         finally:
             self._busy = False
-            try:
-                os.unlink(tmp_path)
-            except OSError:
-                pass
+            for t in (dl, wr, rb):
+                log.info(t.summary())
 
     # ── Outcome handlers ──────────────────────────────────────────────────────
     def _on_done(self):
@@ -1040,7 +1548,7 @@ class App(tk.Tk):
         self._install_btn.config(state="normal")
         self._cancel_btn.config(state="disabled")
         messagebox.showinfo("Done",
-            "Noxiom OS has been written to the drive.\n\n"
+            "Noxiom OS has been written to the drive and verified.\n\n"
             "The drive has been safely ejected.\n"
             "Insert it into your target device and power on.")
 
@@ -0,0 +1,24 @@
+/* arch/arm64/bench_arm64.c — AArch64-only benchmarks (bench/bench.h)
+ *
+ *   dtb_parse   a full walk of the firmware's device tree, as done once
+ *               at boot
+ */
+#include "bench/bench.h"  /* -Ikernel/src  */
+#include "dtb.h"          /* -Iarch/arm64  */
+#include <stdint.h>
+
+extern volatile uint64_t g_dtb_addr;
+
+static dtb_result_t s_result;
+
+static int dtb_setup(void)
+{
+    return g_dtb_addr ? 0 : -1;
+}
+
+static void dtb_run(void)
+{
+    dtb_parse((uint64_t)g_dtb_addr, &s_result);
+}
+
+BENCH(dtb_parse, .setup = dtb_setup, .run = dtb_run, .iters = 200);
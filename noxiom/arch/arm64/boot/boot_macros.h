@@ -0,0 +1,62 @@
+/* arch/arm64/boot/boot_macros.h — CPU set-up shared by the boot stubs
+ *
+ * Included by entry.S and by lz4_stub.S, which runs first when
+ * kernel8.img is compressed.  drop_to_el1 is a no-op at EL1, so the
+ * kernel repeating it after the stub is harmless.
+ */
+
+/* Drop EL2 → EL1 if necessary.  Clobbers x0. */
+.macro drop_to_el1
+    mrs     x0, CurrentEL
+    lsr     x0, x0, #2
+    and     x0, x0, #3
+    cmp     x0, #2
+    bne     1f                      /* already at EL1                */
+
+    /* RW=1: EL1/EL0 run AArch64 */
+    mov     x0, #(1 << 31)
+    msr     hcr_el2, x0
+
+    /* Generic timer: EL1 may use the physical counter and timer, and
+     * the virtual counter equals the physical one */
+    mrs     x0, cnthctl_el2
+    orr     x0, x0, #3              /* EL1PCTEN | EL1PCEN            */
+    msr     cnthctl_el2, x0
+    msr     cntvoff_el2, xzr
+    isb
+
+    /* GICv3 CPU interface (ID_AA64PFR0_EL1.GIC != 0): let EL1 use the
+     * ICC_* system registers, SRE | Enable in ICC_SRE_EL2; otherwise
+     * its ICC_SRE_EL1 accesses trap to EL2 */
+    mrs     x0, id_aa64pfr0_el1
+    ubfx    x0, x0, #24, #4
+    cbz     x0, 2f
+    mrs     x0, S3_4_C12_C9_5       /* ICC_SRE_EL2                   */
+    orr     x0, x0, #0x9
+    msr     S3_4_C12_C9_5, x0
+    isb
+    msr     S3_4_C12_C11_0, xzr     /* ICH_HCR_EL2: no virtual GIC   */
+2:
+
+    /* Jump target after eret */
+    adr     x0, 1f
+    msr     elr_el2, x0
+
+    /* SPSR_EL2: M[3:0]=0101 (EL1h), all DAIF masked */
+    mov     x0, #0x3C5
+    msr     spsr_el2, x0
+    isb
+
+    eret                            /* drops to EL1 at 1:            */
+1:
+.endm
+
+/* Disable MMU, D-cache, I-cache.  Clobbers x0. */
+.macro mmu_caches_off
+    mrs     x0, sctlr_el1
+    bic     x0, x0, #(1 << 0)      /* M: MMU off                    */
+    bic     x0, x0, #(1 << 2)      /* C: D-cache off                */
+    bic     x0, x0, #(1 << 12)     /* I: I-cache off                */
+    msr     sctlr_el1, x0
+    isb
+.endm
@@ -0,0 +1,176 @@
+/* arch/arm64/dispatch_arm64.c — CPU-specific variants, picked at boot
+ *
+ * One table of function pointers, filled in once from MIDR_EL1 and the
+ * ID registers; kmemcpy() and the other entry points are plain calls
+ * through it.  Its static initializer is the baseline, which is also
+ * what has to run with the MMU off (string.S), so every faster variant
+ * needs the MMU on — and the whole table stays at the baseline when
+ * there is no map.  The choice is the boot CPU's; on a big.LITTLE part
+ * the other cluster runs the same code.
+ *
+ *   memcpy   ldp-strict  string_arm64_memcpy (baseline)
+ *            ldp         unaligned source loads, SCTLR_EL1.A clear
+ *            ldp-prfm    the same with a prefetch, for the in-order
+ *                        cores: Cortex-A35, A53, A55, A510, A520
+ *   memzero  stp         string_arm64_memset (baseline)
+ *            dc-zva      DC ZVA for the whole blocks, when DCZID_EL0
+ *                        allows it and reports a block of 16..2048 bytes
+ *   sum32    neon        fpu_arm64_sum32(), the only one
+ *   spin     yield       poll with yield in between (baseline)
+ *            wfe         load-acquire exclusive on the lock word, then
+ *                        wfe: the write that changes it clears the
+ *                        exclusive monitor, which is a wake-up event
+ */
+#include "dispatch_arm64.h"
+#include "fpu_arm64.h"
+#include "midr.h"
+#include "mmu.h"
+#include "hal.h"
+#include "string.h"
+#include "log/klog.h"
+
+#define SCTLR_A         (1ULL << 1)
+#define DCZID_DZP       (1u << 4)
+#define DCZID_BS_MASK   0xFu            /* log2 of the block in words    */
+#define ZVA_MIN         16
+#define ZVA_MAX         2048
+
+static const uint32_t s_in_order[] = {
+    MIDR_CPU(0x41, 0xD03),              /* Cortex-A53                    */
+    MIDR_CPU(0x41, 0xD04),              /* Cortex-A35                    */
+    MIDR_CPU(0x41, 0xD05),              /* Cortex-A55                    */
+    MIDR_CPU(0x41, 0xD46),              /* Cortex-A510                   */
+    MIDR_CPU(0x41, 0xD80),              /* Cortex-A520                   */
+};
+
+static uint64_t s_zva;                  /* DC ZVA block, bytes           */
+
+/* Edges with stores, whole blocks with DC ZVA; a buffer of less than a
+ * few blocks is not worth the split */
+static void *zero_zva(void *dst, size_t n)
+{
+    uintptr_t p = (uintptr_t)dst, end = p + n;
+    uintptr_t lo = (p + s_zva - 1) & ~(s_zva - 1);
+    uintptr_t hi = end & ~(s_zva - 1);
+
+    if (n < 4 * s_zva)
+        return string_arm64_memset(dst, 0, n);
+    string_arm64_memset(dst, 0, lo - p);
+    for (uintptr_t b = lo; b < hi; b += s_zva)
+        __asm__ volatile("dc zva, %0" :: "r"(b) : "memory");
+    string_arm64_memset((void *)hi, 0, end - hi);
+    return dst;
+}
+
+static void *zero_stp(void *dst, size_t n)
+{
+    return string_arm64_memset(dst, 0, n);
+}
+
+static void spin_wait_yield(const uint16_t *p, uint16_t v)
+{
+    while (__atomic_load_n(p, __ATOMIC_ACQUIRE) != v)
+        __asm__ volatile("yield");
+}
+
+/* SEVL makes the first WFE fall straight through to the load that arms
+ * the monitor */
+static void spin_wait_wfe(const uint16_t *p, uint16_t v)
+{
+    uint32_t cur;
+    __asm__ volatile("sevl");
+    do {
+        __asm__ volatile("wfe\n\t"
+                         "ldaxrh %w0, [%1]"
+                         : "=&r"(cur) : "r"(p) : "memory");
+    } while ((uint16_t)cur != v);
+}
+
+static struct {
+    void    *(*memcpy)(void *dst, const void *src, size_t n);
+    void    *(*memzero)(void *dst, size_t n);
+    void     (*spin_wait)(const uint16_t *p, uint16_t v);
+    const char *name[HAL_VAR_COUNT];
+} s_ops = {
+    string_arm64_memcpy,
+    zero_stp,
+    spin_wait_yield,
+    { "ldp-strict", "stp", "neon", "yield" },
+};
+
+static int s_picked;
+
+void dispatch_arm64_init(void)
+{
+    if (s_picked)
+        return;
+    s_picked = 1;
+    if (!mmu_enabled()) {
+        klog("[cpu] MMU off, baseline string and lock routines");
+        return;
+    }
+
+    uint64_t sctlr, dczid;
+    __asm__ volatile("mrs %0, sctlr_el1" : "=r"(sctlr));
+    __asm__ volatile("mrs %0, dczid_el0" : "=r"(dczid));
+
+    if (!(sctlr & SCTLR_A)) {
+        uint32_t cpu = midr_cpu();
+        s_ops.memcpy = string_arm64_memcpy_ldp;
+        s_ops.name[HAL_VAR_MEMCPY] = "ldp";
+        for (uint32_t i = 0; i < sizeof(s_in_order) / sizeof(s_in_order[0]);
+             i++) {
+            if (cpu == s_in_order[i]) {
+                s_ops.memcpy = string_arm64_memcpy_prfm;
+                s_ops.name[HAL_VAR_MEMCPY] = "ldp-prfm";
+                break;
+            }
+        }
+    }
+
+    uint64_t zva = 4ULL << (dczid & DCZID_BS_MASK);
+    if (!(dczid & DCZID_DZP) && zva >= ZVA_MIN && zva <= ZVA_MAX) {
+        s_zva = zva;
+        s_ops.memzero = zero_zva;
+        s_ops.name[HAL_VAR_MEMZERO] = "dc-zva";
+    }
+
+    s_ops.spin_wait = spin_wait_wfe;
+    s_ops.name[HAL_VAR_SPIN] = "wfe";
+
+    klog("[cpu] variants: memcpy %s, memzero %s, sum32 %s, spin %s",
+         s_ops.name[HAL_VAR_MEMCPY], s_ops.name[HAL_VAR_MEMZERO],
+         s_ops.name[HAL_VAR_SUM32], s_ops.name[HAL_VAR_SPIN]);
+}
+
+/* ── Entry points (string.h, hal.h) ─────────────────────────────────────── */
+
+void *kmemcpy(void *dst, const void *src, size_t n)
+{
+    return s_ops.memcpy(dst, src, n);
+}
+
+void *kmemset(void *dst, int val, size_t n)
+{
+    return string_arm64_memset(dst, val, n);
+}
+
+void *kmemzero(void *dst, size_t n)
+{
+    return s_ops.memzero(dst, n);
+}
+
+uint64_t hal_simd_sum32(const void *p, uint64_t n)
+{
+    return fpu_arm64_sum32(p, n);
+}
+
+void hal_spin_wait(const uint16_t *p, uint16_t v)
+{
+    s_ops.spin_wait(p, v);
+}
+
+const char *hal_variant(hal_var_t v)
+{
+    return (uint32_t)v < HAL_VAR_COUNT ? s_ops.name[v] : "?";
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <stddef.h>
+
+/* Fill in the variant table (hal.h, CPU-specific variants) from
+ * MIDR_EL1, SCTLR_EL1 and DCZID_EL0.  The first call does the work, on
+ * the boot CPU with the MMU already on (entry.S); later calls return at
+ * once. */
+void dispatch_arm64_init(void);
+
+/* string.S */
+void *string_arm64_memcpy(void *dst, const void *src, size_t n);
+void *string_arm64_memcpy_ldp(void *dst, const void *src, size_t n);
+void *string_arm64_memcpy_prfm(void *dst, const void *src, size_t n);
+void *string_arm64_memset(void *dst, int val, size_t n);
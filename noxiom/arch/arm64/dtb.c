@@ -1,20 +1,35 @@
-/* arch/arm64/dtb.c — Minimal Flattened Device Tree (FDT) parser
+/* arch/arm64/dtb.c — Flattened Device Tree (FDT) index and boot parser
  *
  * The DTB is produced by the Pi GPU firmware (or QEMU) at boot.
  * It uses big-endian byte order; our AArch64 CPU runs little-endian,
  * so every field must be byte-swapped before comparison.
  *
- * We walk the structure block looking for three kinds of nodes:
- *   /memory          → reg property gives RAM base + size
- *   /cpus/cpu@*      → count these to get cpu_count
+ * dtb_index_build() walks the structure block once and records every
+ * node: its name, where its properties start, its parent, first child
+ * and next sibling, its phandle and the #address-cells / #size-cells it
+ * gives its children.  Each compatible string is hashed into one table
+ * and each phandle into another, so drivers find their nodes without
+ * walking the tree again.  Properties stay in the blob and are found by
+ * scanning only their own node's property list.
+ *
+ * dtb_parse() then answers the boot questions from the index:
+ *   /memory          → reg property gives RAM ranges (base + size pairs)
+ *   /reserved-memory → children's reg ranges must not be allocated
+ *   /cpus/cpu@*      → cpu_count, plus MPIDR / enable-method per CPU
+ *   /psci            → conduit (smc/hvc) used to power on secondaries
  *   uart-compatible  → "arm,pl011" or "brcm,bcm2835-aux-uart"
- *   gic-compatible   → "arm,gic-400" etc.
+ *   gic-compatible   → "arm,gic-v3" (GIC-500/600), else "arm,gic-400" etc.
+ *   pmu-compatible   → "arm,armv8-pmuv3" or a "arm,cortex-aNN-pmu"
  *
  * KEY DESIGN RULE:
  *   We match on IP-block compatible strings (defined by ARM or Broadcom),
  *   NOT on board-specific model strings ("raspberrypi,4-model-b" etc.).
  *   This means the same binary works on Pi 3/4/5 and any future hardware
  *   that uses the same IP blocks.
+ *
+ * This runs before the MMU is on, where every access is Device memory
+ * and must be aligned: multi-byte fields of the blob are read with
+ * kmemcpy(), as before.
  */
 #include "dtb.h"
 #include "string.h"
@@ -84,84 +99,99 @@ static int compat_match(const char *prop_data, uint32_t len,
     return 0;
 }
 
-/* Parse a reg property: returns base address from first <address, size> pair.
- * addr_cells and size_cells say how many 32-bit words each component uses. */
-static uint64_t parse_reg_base(const uint8_t *data, uint32_t len,
-                                uint32_t addr_cells, uint32_t size_cells)
+/* Read a 1- or 2-cell big-endian number */
+static uint64_t read_cells(const uint8_t *data, uint32_t cells)
 {
-    (void)len;
-    (void)size_cells;
-    if (addr_cells == 2 && len >= 8) {
-        uint32_t hi, lo;
-        kmemcpy(&hi, data,     4);
-        kmemcpy(&lo, data + 4, 4);
-        return ((uint64_t)be32(hi) << 32) | be32(lo);
-    }
-    if (addr_cells == 1 && len >= 4) {
-        uint32_t v;
-        kmemcpy(&v, data, 4);
-        return be32(v);
+    uint32_t hi = 0, lo;
+    if (cells == 2) {
+        kmemcpy(&hi, data, 4);
+        data += 4;
     }
-    return 0;
+    kmemcpy(&lo, data, 4);
+    return ((uint64_t)be32(hi) << 32) | be32(lo);
+}
+
+/* ── Index ───────────────────────────────────────────────────────────── */
+
+typedef struct {
+    uint32_t name;              /* offsets into the structure block      */
+    uint32_t props;             /* first token after the name            */
+    uint32_t phandle;           /* 0 = none                              */
+    int16_t  parent;
+    int16_t  child;             /* first child, DTB_NO_NODE if none      */
+    int16_t  sibling;           /* next child of the same parent         */
+    uint8_t  addr_cells;        /* #address-cells for the children       */
+    uint8_t  size_cells;        /* #size-cells for the children          */
+} dtb_node_rec_t;
+
+typedef struct {
+    uint32_t key;               /* compatible hash / phandle, 0 = empty  */
+    int32_t  node;
+} dtb_slot_t;
+
+static dtb_node_rec_t s_nodes[DTB_MAX_NODES];
+static uint32_t       s_node_count;
+static dtb_slot_t     s_compat[DTB_COMPAT_SLOTS];
+static dtb_slot_t     s_phandle[DTB_PHANDLE_SLOTS];
+static const uint8_t *s_struct;
+static const char    *s_strings;
+
+/* FNV-1a; never 0, which marks an empty slot */
+static uint32_t hash_str(const char *s, uint32_t len)
+{
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < len; i++)
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return h ? h : 1;
 }
 
-static uint64_t parse_reg_size(const uint8_t *data, uint32_t len,
-                                uint32_t addr_cells, uint32_t size_cells)
+/* Open addressing, linear probing; a full table drops the entry */
+static void slot_insert(dtb_slot_t *table, uint32_t slots, uint32_t key,
+                        int32_t node)
 {
-    uint32_t offset = addr_cells * 4;
-    if (offset + size_cells * 4 > len) return 0;
-    data += offset;
-    if (size_cells == 2) {
-        uint32_t hi, lo;
-        kmemcpy(&hi, data,     4);
-        kmemcpy(&lo, data + 4, 4);
-        return ((uint64_t)be32(hi) << 32) | be32(lo);
+    for (uint32_t i = 0; i < slots; i++) {
+        dtb_slot_t *s = &table[(key + i) & (slots - 1)];
+        if (s->key == 0) {
+            s->key  = key;
+            s->node = node;
+            return;
+        }
     }
-    if (size_cells == 1) {
-        uint32_t v;
-        kmemcpy(&v, data, 4);
-        return be32(v);
+}
+
+/* Add each string of a compatible list to the table */
+static void index_compatible(const char *data, uint32_t len, int32_t node)
+{
+    const char *end = data + len;
+    while (data < end) {
+        uint32_t n = (uint32_t)kstrlen(data);
+        if (n)
+            slot_insert(s_compat, DTB_COMPAT_SLOTS, hash_str(data, n), node);
+        data += n + 1;
     }
-    return 0;
 }
 
-int dtb_parse(uint64_t dtb_phys_addr, dtb_result_t *out)
+int dtb_index_build(uint64_t dtb_phys_addr)
 {
-    kmemset(out, 0, sizeof(*out));
+    s_node_count = 0;
+    kmemset(s_compat, 0, sizeof(s_compat));
+    kmemset(s_phandle, 0, sizeof(s_phandle));
 
     if (!dtb_phys_addr)
         return -1;
-
-    const uint8_t *base = (const uint8_t *)dtb_phys_addr;
-    const fdt_header_t *hdr = (const fdt_header_t *)base;
-
-    /* Validate magic */
+    const uint8_t      *base = (const uint8_t *)dtb_phys_addr;
+    const fdt_header_t *hdr  = (const fdt_header_t *)base;
     if (be32(hdr->magic) != FDT_MAGIC)
         return -1;
 
-    const uint8_t *struct_block  = base + be32(hdr->off_dt_struct);
-    const char    *strings_block = (const char *)(base + be32(hdr->off_dt_strings));
-
-    /* Root-level #address-cells and #size-cells (default = 1) */
-    uint32_t root_addr_cells = 1;
-    uint32_t root_size_cells = 1;
-
-    /* Walk state */
-    const uint8_t *p = struct_block;
-    int depth = 0;
-    char cur_node[64] = "";
-
-    /* Flags to track what we found at the current node */
-    int    in_memory   = 0;
-    int    in_cpus     = 0;
-    int    in_cpu      = 0;
-    int    in_uart     = 0;
-    int    in_gic      = 0;
-    char   cur_compat[256] = "";
-    uint32_t cur_compat_len = 0;
-    uint8_t  cur_reg_data[64];
-    uint32_t cur_reg_len = 0;
-    int    has_reg = 0;
+    s_struct  = base + be32(hdr->off_dt_struct);
+    s_strings = (const char *)(base + be32(hdr->off_dt_strings));
+
+    /* Open nodes, innermost last, and the last child seen of each */
+    int32_t  stack[DTB_MAX_DEPTH];
+    int32_t  last_child[DTB_MAX_DEPTH];
+    int      depth = 0;
+    const uint8_t *p = s_struct;
 
     for (;;) {
         /* Align to 4 bytes */
@@ -176,99 +206,63 @@ int dtb_parse(uint64_t dtb_phys_addr, dtb_result_t *out)
             continue;
 
         if (token == FDT_BEGIN_NODE) {
-            /* Node name is a NUL-terminated string */
             const char *name = (const char *)p;
             p += kstrlen(name) + 1;
-
-            /* Detect node types */
-            in_memory = (depth == 1 && kstrncmp(name, "memory", 6) == 0);
-            in_cpus   = (depth == 1 && kstrncmp(name, "cpus",   4) == 0);
-            in_cpu    = (in_cpus && depth == 2 && kstrncmp(name, "cpu@", 4) == 0);
-
-            if (in_cpu)
-                out->cpu_count++;
-
-            kstrncpy(cur_node, name, sizeof(cur_node) - 1);
-            cur_compat_len = 0;
-            cur_reg_len    = 0;
-            has_reg        = 0;
-            in_uart        = 0;
-            in_gic         = 0;
+            while (((uintptr_t)p & 3) != 0) p++;
+            if (depth >= DTB_MAX_DEPTH || s_node_count >= DTB_MAX_NODES)
+                break;                  /* keep what is indexed so far */
+
+            int32_t         id = (int32_t)s_node_count++;
+            dtb_node_rec_t *n  = &s_nodes[id];
+            n->name       = (uint32_t)((const uint8_t *)name - s_struct);
+            n->props      = (uint32_t)(p - s_struct);
+            n->phandle    = 0;
+            n->parent     = (int16_t)(depth ? stack[depth - 1] : DTB_NO_NODE);
+            n->child      = DTB_NO_NODE;
+            n->sibling    = DTB_NO_NODE;
+            n->addr_cells = 2;          /* defaults from the DT spec   */
+            n->size_cells = 1;
+            if (depth) {
+                if (last_child[depth - 1] == DTB_NO_NODE)
+                    s_nodes[stack[depth - 1]].child = (int16_t)id;
+                else
+                    s_nodes[last_child[depth - 1]].sibling = (int16_t)id;
+                last_child[depth - 1] = id;
+            }
+            stack[depth]      = id;
+            last_child[depth] = DTB_NO_NODE;
             depth++;
             continue;
         }
 
         if (token == FDT_END_NODE) {
-            /* Process accumulated properties for this node */
-            if (in_memory && has_reg) {
-                out->ram_base = parse_reg_base(cur_reg_data, cur_reg_len,
-                                               root_addr_cells, root_size_cells);
-                out->ram_size = parse_reg_size(cur_reg_data, cur_reg_len,
-                                               root_addr_cells, root_size_cells);
-            }
-            if (in_uart && has_reg && !out->uart_base) {
-                out->uart_base = parse_reg_base(cur_reg_data, cur_reg_len,
-                                                root_addr_cells, root_size_cells);
-                kstrncpy(out->uart_compat, cur_compat,
-                         sizeof(out->uart_compat) - 1);
-            }
-            if (in_gic && has_reg && !out->gic_dist_base) {
-                out->gic_dist_base = parse_reg_base(cur_reg_data, cur_reg_len,
-                                                    root_addr_cells, root_size_cells);
-                /* GIC CPU interface is second region: skip addr+size of first */
-                uint32_t skip = (root_addr_cells + root_size_cells) * 4;
-                if (cur_reg_len >= skip * 2) {
-                    out->gic_cpu_base = parse_reg_base(
-                        cur_reg_data + skip, cur_reg_len - skip,
-                        root_addr_cells, root_size_cells);
-                }
-            }
-
-            in_memory = 0;
-            in_cpus   = (depth > 2) ? in_cpus : 0;
-            in_cpu    = 0;
-            in_uart   = 0;
-            in_gic    = 0;
+            if (depth == 0)
+                break;
             depth--;
             continue;
         }
 
         if (token == FDT_PROP) {
-            uint32_t prop_len     = read_u32(&p);
-            uint32_t name_offset  = read_u32(&p);
-            const char *prop_name = strings_block + name_offset;
-            const uint8_t *prop_data = p;
-            p += prop_len;
-
-            /* Process interesting properties */
-            if (kstrcmp(prop_name, "compatible") == 0) {
-                cur_compat_len = prop_len < sizeof(cur_compat) ?
-                                 prop_len : (uint32_t)sizeof(cur_compat) - 1;
-                kmemcpy(cur_compat, prop_data, cur_compat_len);
-
-                /* Check for UART compatible strings (ARM IP block names) */
-                if (compat_match((const char *)prop_data, prop_len, "arm,pl011") ||
-                    compat_match((const char *)prop_data, prop_len, "brcm,bcm2835-aux-uart"))
-                    in_uart = 1;
-
-                /* Check for GIC compatible strings */
-                if (compat_match((const char *)prop_data, prop_len, "arm,cortex-a15-gic") ||
-                    compat_match((const char *)prop_data, prop_len, "arm,gic-400") ||
-                    compat_match((const char *)prop_data, prop_len, "arm,gic-v3"))
-                    in_gic = 1;
-
-                /* Root node address/size cells from compatible check */
-            } else if (kstrcmp(prop_name, "#address-cells") == 0 && depth == 1) {
-                uint32_t v; kmemcpy(&v, prop_data, 4);
-                root_addr_cells = be32(v);
-            } else if (kstrcmp(prop_name, "#size-cells") == 0 && depth == 1) {
-                uint32_t v; kmemcpy(&v, prop_data, 4);
-                root_size_cells = be32(v);
-            } else if (kstrcmp(prop_name, "reg") == 0) {
-                has_reg = 1;
-                cur_reg_len = prop_len < sizeof(cur_reg_data) ?
-                              prop_len : (uint32_t)sizeof(cur_reg_data);
-                kmemcpy(cur_reg_data, prop_data, cur_reg_len);
+            uint32_t       len  = read_u32(&p);
+            const char    *name = s_strings + read_u32(&p);
+            const uint8_t *data = p;
+            p += len;
+            if (depth == 0)
+                continue;
+
+            int32_t         id = stack[depth - 1];
+            dtb_node_rec_t *n  = &s_nodes[id];
+            if (kstrcmp(name, "compatible") == 0) {
+                index_compatible((const char *)data, len, id);
+            } else if (kstrcmp(name, "#address-cells") == 0 && len >= 4) {
+                n->addr_cells = (uint8_t)read_cells(data, 1);
+            } else if (kstrcmp(name, "#size-cells") == 0 && len >= 4) {
+                n->size_cells = (uint8_t)read_cells(data, 1);
+            } else if ((kstrcmp(name, "phandle") == 0 ||
+                        kstrcmp(name, "linux,phandle") == 0) && len >= 4) {
+                n->phandle = (uint32_t)read_cells(data, 1);
+                if (n->phandle)
+                    slot_insert(s_phandle, DTB_PHANDLE_SLOTS, n->phandle, id);
             }
             continue;
         }
@@ -277,5 +271,397 @@ int dtb_parse(uint64_t dtb_phys_addr, dtb_result_t *out)
         break;
     }
 
+    return s_node_count ? 0 : -1;
+}
+
+static int valid(int node)
+{
+    return node >= 0 && (uint32_t)node < s_node_count;
+}
+
+uint32_t dtb_node_count(void)
+{
+    return s_node_count;
+}
+
+const char *dtb_node_name(int node)
+{
+    return valid(node) ? (const char *)(s_struct + s_nodes[node].name) : "";
+}
+
+int dtb_node_parent(int node)
+{
+    return valid(node) ? s_nodes[node].parent : DTB_NO_NODE;
+}
+
+int dtb_first_child(int node)
+{
+    return valid(node) ? s_nodes[node].child : DTB_NO_NODE;
+}
+
+int dtb_next_sibling(int node)
+{
+    return valid(node) ? s_nodes[node].sibling : DTB_NO_NODE;
+}
+
+/* "name" matches the node names "name" and "name@unit" */
+static int name_matches(const char *node_name, const char *name)
+{
+    size_t n = kstrlen(name);
+    return kstrncmp(node_name, name, n) == 0 &&
+           (node_name[n] == '\0' || node_name[n] == '@');
+}
+
+int dtb_find_child(int parent, const char *name)
+{
+    for (int c = dtb_first_child(parent); c != DTB_NO_NODE;
+         c = dtb_next_sibling(c))
+        if (name_matches(dtb_node_name(c), name))
+            return c;
+    return DTB_NO_NODE;
+}
+
+const void *dtb_prop(int node, const char *name, uint32_t *len)
+{
+    if (!valid(node))
+        return 0;
+    const uint8_t *p = s_struct + s_nodes[node].props;
+    for (;;) {
+        while (((uintptr_t)p & 3) != 0) p++;
+        uint32_t token = read_u32(&p);
+        if (token == FDT_NOP)
+            continue;
+        if (token != FDT_PROP)
+            return 0;                   /* a child node or the end     */
+        uint32_t    plen  = read_u32(&p);
+        const char *pname = s_strings + read_u32(&p);
+        if (kstrcmp(pname, name) == 0) {
+            if (len)
+                *len = plen;
+            return p;
+        }
+        p += plen;
+    }
+}
+
+uint32_t dtb_prop_u32(int node, const char *name, uint32_t def)
+{
+    uint32_t       len;
+    const uint8_t *data = dtb_prop(node, name, &len);
+    return data && len >= 4 ? (uint32_t)read_cells(data, 1) : def;
+}
+
+int dtb_is_compatible(int node, const char *compat)
+{
+    uint32_t    len;
+    const char *data = dtb_prop(node, "compatible", &len);
+    return data && compat_match(data, len, compat);
+}
+
+int dtb_find_compatible(const char *compat, int after)
+{
+    uint32_t key  = hash_str(compat, (uint32_t)kstrlen(compat));
+    int      best = DTB_NO_NODE;
+
+    /* Entries of equal hash sit in one probe run; take the first node
+     * in tree order after `after` */
+    for (uint32_t i = 0; i < DTB_COMPAT_SLOTS; i++) {
+        const dtb_slot_t *s = &s_compat[(key + i) & (DTB_COMPAT_SLOTS - 1)];
+        if (s->key == 0)
+            break;
+        if (s->key == key && s->node > after &&
+            (best == DTB_NO_NODE || s->node < best) &&
+            dtb_is_compatible(s->node, compat))
+            best = s->node;
+    }
+    return best;
+}
+
+int dtb_find_phandle(uint32_t phandle)
+{
+    if (phandle == 0)
+        return DTB_NO_NODE;
+    for (uint32_t i = 0; i < DTB_PHANDLE_SLOTS; i++) {
+        const dtb_slot_t *s =
+            &s_phandle[(phandle + i) & (DTB_PHANDLE_SLOTS - 1)];
+        if (s->key == 0)
+            break;
+        if (s->key == phandle)
+            return s->node;
+    }
+    return DTB_NO_NODE;
+}
+
+void dtb_reg_cells(int node, uint32_t *addr_cells, uint32_t *size_cells)
+{
+    int parent = dtb_node_parent(node);
+    *addr_cells = valid(parent) ? s_nodes[parent].addr_cells : 2;
+    *size_cells = valid(parent) ? s_nodes[parent].size_cells : 1;
+}
+
+/* Map a bus address of bus_node's children to the CPU's view, through
+ * the "ranges" of bus_node and every bus above it (the Pi's 0x7E...
+ * peripheral addresses become 0xFE... on a Pi 4).  Absent or empty
+ * ranges, or no matching entry, leave the address as it is. */
+static uint64_t translate(int bus_node, uint64_t addr)
+{
+    for (int bus = bus_node; valid(bus) && bus != 0;
+         bus = dtb_node_parent(bus)) {
+        uint32_t       len;
+        const uint8_t *r = dtb_prop(bus, "ranges", &len);
+        if (!r || len == 0)
+            continue;
+
+        uint32_t ca = s_nodes[bus].addr_cells;     /* child address  */
+        uint32_t cs = s_nodes[bus].size_cells;
+        uint32_t pa, ps;                            /* parent address */
+        dtb_reg_cells(bus, &pa, &ps);
+        if (ca < 1 || ca > 2 || pa < 1 || pa > 2 || cs < 1 || cs > 2)
+            return addr;
+
+        uint32_t stride = (ca + pa + cs) * 4;
+        for (uint32_t off = 0; off + stride <= len; off += stride) {
+            uint64_t child  = read_cells(r + off, ca);
+            uint64_t parent = read_cells(r + off + ca * 4, pa);
+            uint64_t size   = read_cells(r + off + (ca + pa) * 4, cs);
+            if (addr >= child && addr - child < size) {
+                addr = addr - child + parent;
+                break;
+            }
+        }
+    }
+    return addr;
+}
+
+int dtb_reg(int node, uint32_t i, uint64_t *base, uint64_t *size)
+{
+    uint32_t       ac, sc, len;
+    const uint8_t *data = dtb_prop(node, "reg", &len);
+    dtb_reg_cells(node, &ac, &sc);
+    if (!data || ac < 1 || ac > 2 || sc > 2)
+        return -1;
+
+    uint32_t stride = (ac + sc) * 4;
+    if ((uint64_t)(i + 1) * stride > len)
+        return -1;
+    data += i * stride;
+    *base = translate(dtb_node_parent(node), read_cells(data, ac));
+    if (size)
+        *size = sc ? read_cells(data + ac * 4, sc) : 0;
+    return 0;
+}
+
+/* ── Boot parse ──────────────────────────────────────────────────────── */
+
+static void add_region(dtb_region_t *arr, uint32_t *count, uint32_t max,
+                       uint64_t base, uint64_t size)
+{
+    if (size == 0 || *count >= max)
+        return;
+    arr[*count].base = base;
+    arr[*count].size = size;
+    (*count)++;
+}
+
+/* Append every <address, size> pair of node's reg property to arr[] */
+static void add_reg_regions(int node, dtb_region_t *arr, uint32_t *count,
+                            uint32_t max)
+{
+    uint64_t base, size;
+    for (uint32_t i = 0; dtb_reg(node, i, &base, &size) == 0; i++)
+        add_region(arr, count, max, base, size);
+}
+
+/* PSCI 0.2+ CPU_ON (SMC64 calling convention) */
+#define PSCI_0_2_CPU_ON_64  0xC4000003
+
+/* FDT memory reservation block: be64 <address, size> pairs ending in 0,0 */
+static void parse_rsvmap(const uint8_t *base, const fdt_header_t *hdr,
+                         dtb_result_t *out)
+{
+    const uint8_t *p = base + be32(hdr->off_mem_rsvmap);
+    for (;;) {
+        uint64_t addr, size;
+        kmemcpy(&addr, p,     8);
+        kmemcpy(&size, p + 8, 8);
+        p += 16;
+        addr = be64(addr);
+        size = be64(size);
+        if (addr == 0 && size == 0)
+            break;
+        add_region(out->rsv, &out->rsv_count, DTB_MAX_RSV_REGIONS, addr, size);
+    }
+}
+
+/* First node after `after`, in tree order, compatible with any of
+ * list[] (0-ended) */
+static int find_any(const char *const *list, int after)
+{
+    int best = DTB_NO_NODE;
+    for (; *list; list++) {
+        int n = dtb_find_compatible(*list, after);
+        if (n != DTB_NO_NODE && (best == DTB_NO_NODE || n < best))
+            best = n;
+    }
+    return best;
+}
+
+/* GIC binding: <type number flags>; type 0 = SPI (INTID 32+n), 1 = PPI
+ * (16+n).  Other controllers (the Pi 3 legacy one) use different cell
+ * counts and are ignored.  `multi` accepts a list and keeps the first. */
+static uint32_t gic_irq(int node, int multi)
+{
+    uint32_t len;
+    if (!dtb_prop(node, "interrupts", &len) ||
+        !(len == 12 || (multi && len > 12 && len % 12 == 0)))
+        return 0;
+    return dtb_gic_irq(node, 0);
+}
+
+uint32_t dtb_gic_irq(int node, uint32_t i)
+{
+    uint32_t       len;
+    const uint8_t *data = dtb_prop(node, "interrupts", &len);
+    if (!data || len % 12 != 0 || i >= len / 12)
+        return 0;
+    data += i * 12;
+    uint32_t type = (uint32_t)read_cells(data, 1);
+    uint32_t num  = (uint32_t)read_cells(data + 4, 1);
+    return type == 0 ? num + 32 : type == 1 ? num + 16 : 0;
+}
+
+static const char *const uart_compat[] = {
+    "arm,pl011", "brcm,bcm2835-aux-uart", 0
+};
+static const char *const gic_v2_compat[] = {
+    "arm,cortex-a15-gic", "arm,gic-400", 0
+};
+/* PMU: the architectural name or a core-specific one */
+static const char *const pmu_compat[] = {
+    "arm,armv8-pmuv3", "arm,cortex-a53-pmu", "arm,cortex-a72-pmu",
+    "arm,cortex-a76-pmu", 0
+};
+
+static void parse_memory(dtb_result_t *out)
+{
+    for (int n = dtb_first_child(0); n != DTB_NO_NODE;
+         n = dtb_next_sibling(n)) {
+        if (kstrncmp(dtb_node_name(n), "memory", 6) != 0)
+            continue;
+        uint32_t first = out->mem_count;
+        add_reg_regions(n, out->mem, &out->mem_count, DTB_MAX_MEM_REGIONS);
+        if (first == 0 && out->mem_count > 0)
+            out->ram_base = out->mem[0].base;
+        for (uint32_t i = first; i < out->mem_count; i++)
+            out->ram_size += out->mem[i].size;
+    }
+
+    int rsv = dtb_find_child(0, "reserved-memory");
+    for (int n = dtb_first_child(rsv); n != DTB_NO_NODE;
+         n = dtb_next_sibling(n))
+        add_reg_regions(n, out->rsv, &out->rsv_count, DTB_MAX_RSV_REGIONS);
+}
+
+static void parse_cpus(dtb_result_t *out)
+{
+    int cpus = dtb_find_child(0, "cpus");
+    for (int n = dtb_first_child(cpus); n != DTB_NO_NODE;
+         n = dtb_next_sibling(n)) {
+        if (kstrncmp(dtb_node_name(n), "cpu@", 4) != 0)
+            continue;
+
+        dtb_cpu_t   cpu = { .node = n };
+        uint32_t    ac, sc, len;
+        const void *data;
+        dtb_reg_cells(n, &ac, &sc);
+        if ((data = dtb_prop(n, "reg", &len)) && ac >= 1 && ac <= 2 &&
+            len >= ac * 4)
+            cpu.mpidr = read_cells(data, ac);
+        if ((data = dtb_prop(n, "enable-method", &len))) {
+            if (compat_match(data, len, "psci"))
+                cpu.enable_method = DTB_CPU_ENABLE_PSCI;
+            else if (compat_match(data, len, "spin-table"))
+                cpu.enable_method = DTB_CPU_ENABLE_SPIN_TABLE;
+        }
+        if ((data = dtb_prop(n, "cpu-release-addr", &len)))
+            cpu.release_addr = len >= 8 ? read_cells(data, 2) :
+                               len >= 4 ? read_cells(data, 1) : 0;
+        if (out->cpu_count < DTB_MAX_CPUS)
+            out->cpus[out->cpu_count] = cpu;
+        out->cpu_count++;
+    }
+
+    int psci = dtb_find_child(0, "psci");
+    if (psci != DTB_NO_NODE && kstrcmp(dtb_node_name(psci), "psci") == 0) {
+        uint32_t    len;
+        const void *method = dtb_prop(psci, "method", &len);
+        out->psci_method = DTB_PSCI_NONE;
+        if (method && compat_match(method, len, "hvc"))
+            out->psci_method = DTB_PSCI_HVC;
+        else if (method && compat_match(method, len, "smc"))
+            out->psci_method = DTB_PSCI_SMC;
+        out->psci_cpu_on = dtb_prop_u32(psci, "cpu_on", PSCI_0_2_CPU_ON_64);
+    }
+}
+
+static void parse_devices(dtb_result_t *out)
+{
+    /* The first one with a reg property */
+    int uart = find_any(uart_compat, DTB_NO_NODE);
+    while (uart != DTB_NO_NODE && dtb_reg(uart, 0, &out->uart_base, 0) != 0)
+        uart = find_any(uart_compat, uart);
+    if (uart != DTB_NO_NODE) {
+        /* First string of its compatible list */
+        kstrncpy(out->uart_compat, dtb_prop(uart, "compatible", 0),
+                 sizeof(out->uart_compat) - 1);
+        out->uart_irq = gic_irq(uart, 0);
+    }
+
+    /* GICv3: distributor, then the first redistributor region (any
+     * further "#redistributor-regions" and the legacy GICC/GICH/GICV
+     * regions after them are not used).  GICv2: distributor, then the
+     * CPU interface. */
+    int gic = dtb_find_compatible("arm,gic-v3", DTB_NO_NODE);
+    if (gic != DTB_NO_NODE && dtb_reg(gic, 0, &out->gic_dist_base, 0) == 0 &&
+        dtb_reg(gic, 1, &out->gic_redist_base, 0) == 0) {
+        out->gic_version       = 3;
+        out->gic_redist_stride = dtb_prop_u32(gic, "redistributor-stride", 0);
+    } else {
+        out->gic_dist_base   = 0;
+        out->gic_redist_base = 0;
+        gic = find_any(gic_v2_compat, DTB_NO_NODE);
+        if (gic != DTB_NO_NODE &&
+            dtb_reg(gic, 0, &out->gic_dist_base, 0) == 0 &&
+            dtb_reg(gic, 1, &out->gic_cpu_base, 0) == 0)
+            out->gic_version = 2;
+        else
+            out->gic_dist_base = out->gic_cpu_base = 0;
+    }
+
+    /* Only a PPI is usable: the Pi 4 lists one SPI per core instead,
+     * which would need routing to each core in turn */
+    uint32_t pmu_irq = gic_irq(find_any(pmu_compat, DTB_NO_NODE), 1);
+    if (pmu_irq >= 16 && pmu_irq < 32)
+        out->pmu_irq = pmu_irq;
+}
+
+int dtb_parse(uint64_t dtb_phys_addr, dtb_result_t *out)
+{
+    kmemset(out, 0, sizeof(*out));
+
+    if (dtb_index_build(dtb_phys_addr) != 0)
+        return -1;
+
+    const uint8_t *base = (const uint8_t *)dtb_phys_addr;
+    const fdt_header_t *hdr = (const fdt_header_t *)base;
+
+    /* The blob itself, then everything firmware asked us to keep */
+    add_region(out->rsv, &out->rsv_count, DTB_MAX_RSV_REGIONS,
+               dtb_phys_addr, be32(hdr->totalsize));
+    parse_rsvmap(base, hdr, out);
+
+    parse_memory(out);
+    parse_cpus(out);
+    parse_devices(out);
     return 0;
 }
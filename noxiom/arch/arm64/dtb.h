@@ -1,29 +1,88 @@
 #pragma once
 #include <stdint.h>
 
-/* Minimal FDT (Flattened Device Tree) parser.
+/* FDT (Flattened Device Tree) index and boot parser.
  *
- * Finds ONLY what the kernel needs to boot:
+ * dtb_index_build() indexes every node once (see dtb.c); drivers then
+ * look nodes up by compatible string or phandle in O(1) and read their
+ * properties with dtb_prop() / dtb_reg().  Nodes are small integers in
+ * tree order, 0 = the root, DTB_NO_NODE = none.
+ *
+ * dtb_parse() builds the index and extracts what the kernel needs to
+ * boot:
  *   - UART base address (matched by compatible string, NOT board name)
+ *     and its GIC interrupt
  *   - GIC base addresses (matched by compatible string)
- *   - RAM size (from /memory node)
- *   - CPU count (from /cpus node)
+ *   - RAM ranges (from /memory reg) and reserved ranges (FDT memory
+ *     reservation block, /reserved-memory children, the DTB blob itself)
+ *   - CPUs (from /cpus/cpu@*: MPIDR, enable-method, cpu-release-addr,
+ *     and the node, for cpu-map and cache lookups)
+ *   - PSCI conduit (from /psci: "method" and the CPU_ON function ID)
+ *   - PMU overflow interrupt (the "arm,*-pmu*" node's PPI)
  *
  * Compatible strings matched (ARM IP block names, not board names):
  *   UART:  "arm,pl011"  or  "brcm,bcm2835-aux-uart"
- *   GIC:   "arm,cortex-a15-gic"  or  "arm,gic-400"  or  "arm,gic-v3"
+ *   GIC:   "arm,gic-v3" (GIC-500/600), else
+ *          "arm,cortex-a15-gic"  or  "arm,gic-400" (GICv2)
+ *   PMU:   "arm,armv8-pmuv3"  or  "arm,cortex-a53-pmu" / -a72- / -a76-
  *
  * If the DTB address is 0 or the magic is wrong, returns -1 and all
  * fields in dtb_result_t remain zero.  The kernel boots in FALLBACK mode.
  */
 
+#define DTB_MAX_MEM_REGIONS  8
+#define DTB_MAX_RSV_REGIONS  16
+#define DTB_MAX_CPUS         16     /* = HAL_MAX_CPUS */
+
+/* Index capacity; nodes past DTB_MAX_NODES are not indexed */
+#define DTB_MAX_NODES        2048
+#define DTB_MAX_DEPTH        16
+#define DTB_COMPAT_SLOTS     4096   /* power of two */
+#define DTB_PHANDLE_SLOTS    2048   /* power of two */
+#define DTB_NO_NODE          (-1)
+
+/* cpu enable-method */
+#define DTB_CPU_ENABLE_NONE       0
+#define DTB_CPU_ENABLE_SPIN_TABLE 1 /* "spin-table": write cpu-release-addr */
+#define DTB_CPU_ENABLE_PSCI       2 /* "psci": firmware CPU_ON call        */
+
+/* /psci method */
+#define DTB_PSCI_NONE  0
+#define DTB_PSCI_SMC   1
+#define DTB_PSCI_HVC   2
+
+typedef struct {
+    uint64_t base;
+    uint64_t size;
+} dtb_region_t;
+
+typedef struct {
+    uint64_t mpidr;             /* reg: MPIDR_EL1 affinity bits          */
+    uint64_t release_addr;      /* cpu-release-addr (spin-table only)    */
+    uint32_t enable_method;     /* DTB_CPU_ENABLE_*                      */
+    int      node;              /* its index node (topo_arm64.c)         */
+} dtb_cpu_t;
+
 typedef struct {
     uint64_t uart_base;         /* MMIO base of first matching UART      */
+    uint32_t uart_irq;          /* its GIC INTID, 0 if not a GIC SPI/PPI */
+    uint32_t gic_version;       /* 2 or 3, 0 = no usable GIC found       */
     uint64_t gic_dist_base;     /* GIC distributor MMIO base             */
-    uint64_t gic_cpu_base;      /* GIC CPU interface MMIO base           */
+    uint64_t gic_cpu_base;      /* GICv2: CPU interface MMIO base        */
+    uint64_t gic_redist_base;   /* GICv3: first redistributor region     */
+    uint64_t gic_redist_stride; /* GICv3: "redistributor-stride", 0 =
+                                   as GICR_TYPER says (128 or 256 KB)    */
     uint64_t ram_base;          /* RAM physical base (usually 0)         */
-    uint64_t ram_size;          /* Total RAM bytes                       */
+    uint64_t ram_size;          /* Total RAM bytes (sum of mem[])        */
+    dtb_region_t mem[DTB_MAX_MEM_REGIONS];  /* /memory reg ranges        */
+    uint32_t mem_count;
+    dtb_region_t rsv[DTB_MAX_RSV_REGIONS];  /* must never be allocated   */
+    uint32_t rsv_count;
     uint32_t cpu_count;         /* Number of CPU nodes in /cpus          */
+    dtb_cpu_t cpus[DTB_MAX_CPUS];           /* first DTB_MAX_CPUS of them */
+    uint32_t psci_method;       /* DTB_PSCI_*                            */
+    uint32_t psci_cpu_on;       /* CPU_ON function ID                    */
+    uint32_t pmu_irq;           /* PMU overflow GIC INTID, 0 = none      */
     char     uart_compat[64];   /* Compatible string of matched UART     */
 } dtb_result_t;
 
@@ -31,3 +90,37 @@ typedef struct {
  * Returns 0 on success, -1 on failure (bad magic or addr is 0).
  * On failure, *out is zeroed. */
 int dtb_parse(uint64_t dtb_phys_addr, dtb_result_t *out);
+
+/* ── Index ───────────────────────────────────────────────────────────── */
+
+/* Returns 0 on success, -1 on a bad magic, addr 0 or an empty tree */
+int         dtb_index_build(uint64_t dtb_phys_addr);
+uint32_t    dtb_node_count(void);
+
+const char *dtb_node_name(int node);        /* "uart@7e201000", "" = / */
+int         dtb_node_parent(int node);
+int         dtb_first_child(int node);
+int         dtb_next_sibling(int node);
+/* Child named `name` or `name@<unit>` */
+int         dtb_find_child(int parent, const char *name);
+
+/* First node after `after` (DTB_NO_NODE: from the start), in tree
+ * order, whose compatible list contains `compat` */
+int         dtb_find_compatible(const char *compat, int after);
+int         dtb_is_compatible(int node, const char *compat);
+int         dtb_find_phandle(uint32_t phandle);
+
+/* Raw (big-endian) property value, 0 if absent; *len (may be 0) gets
+ * its size */
+const void *dtb_prop(int node, const char *name, uint32_t *len);
+uint32_t    dtb_prop_u32(int node, const char *name, uint32_t def);
+/* The parent's #address-cells / #size-cells, which decode node's reg */
+void        dtb_reg_cells(int node, uint32_t *addr_cells,
+                          uint32_t *size_cells);
+/* Region i of node's reg property, the base translated through the
+ * parent buses' "ranges" to a CPU address; -1 if there is none.  size
+ * may be 0. */
+int         dtb_reg(int node, uint32_t i, uint64_t *base, uint64_t *size);
+/* INTID of interrupt i of node (GIC three-cell binding), 0 if there is
+ * none or it is not a GIC SPI/PPI */
+uint32_t    dtb_gic_irq(int node, uint32_t i);
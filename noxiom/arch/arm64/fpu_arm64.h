@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+/* AArch64 FP/SIMD — the arm64 side of hal_fpu_*().
+ *
+ * CPACR_EL1.FPEN 0b11 lets EL1 and EL0 use the unit; 0b00 traps both
+ * (ESR class 0x07), so a stray FP instruction in the kernel is caught as
+ * well.  fpu_arm64_off() is also how every CPU starts, before it runs
+ * user code: the reset value of CPACR_EL1 is not architecturally known.
+ */
+#define CPACR_FPEN_MASK      (3ULL << 20)
+#define CPACR_FPEN_ON        (3ULL << 20)
+
+static inline void fpu_arm64_set(uint64_t fpen)
+{
+    uint64_t v;
+    __asm__ volatile("mrs %0, cpacr_el1" : "=r"(v));
+    __asm__ volatile("msr cpacr_el1, %0\n\t"
+                     "isb" :: "r"((v & ~CPACR_FPEN_MASK) | fpen) : "memory");
+}
+
+static inline void fpu_arm64_on(void)  { fpu_arm64_set(CPACR_FPEN_ON); }
+static inline void fpu_arm64_off(void) { fpu_arm64_set(0); }
+
+/* fpu.S: q0-q31, FPSR, FPCR */
+#define FPU_ARM64_STATE_SIZE 528
+
+void     fpu_arm64_save(void *buf);
+void     fpu_arm64_restore(const void *buf);
+uint64_t fpu_arm64_sum32(const void *p, uint64_t n);
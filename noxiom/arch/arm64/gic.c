@@ -1,104 +1,133 @@
 /* arch/arm64/gic.c — ARM Generic Interrupt Controller (GIC) driver
  *
- * Uses the GIC Architecture specification v2 CPU interface, which is
- * supported by GIC-400 (Cortex-A53/A72 platforms) and GIC-600 (A76).
- * Base addresses are supplied at runtime from the DTB.
+ * Picks the backend the DTB describes (gic_v2.c or gic_v3.c) and keeps
+ * what is common to both: which CPUs have their interface up, and where
+ * each SPI is routed.
  *
- * GICD (Distributor) registers:
- *   GICD_CTLR       +0x000  Distributor control
- *   GICD_ISENABLER  +0x100  Interrupt Set-Enable registers (32 IRQs each)
- *   GICD_ICENABLER  +0x180  Interrupt Clear-Enable registers
- *   GICD_IPRIORITYR +0x400  Interrupt Priority registers
- *   GICD_ITARGETSR  +0x800  Interrupt Processor Targets (which CPU gets it)
- *   GICD_ICFGR      +0xC00  Interrupt Configuration (edge/level)
- *
- * GICC (CPU Interface) registers:
- *   GICC_CTLR       +0x000  CPU interface control
- *   GICC_PMR        +0x004  Priority mask (0xFF = accept all priorities)
- *   GICC_IAR        +0x00C  Interrupt Acknowledge Register
- *   GICC_EOIR       +0x010  End of Interrupt Register
+ * An SPI that nobody pinned with gic_set_affinity() is routed when it is
+ * first enabled, to the next online CPU in turn, so device interrupts
+ * spread over the cores instead of all landing on CPU 0.  Interrupts
+ * enabled before smp_init() can only go to CPU 0; pin those explicitly
+ * to move them later.
  */
 #include "gic.h"
+#include "gic_backend.h"
+#include "hal.h"              /* -Ikernel/src */
+#include "log/klog.h"         /* -Ikernel/src */
+#include "sync/spinlock.h"    /* -Ikernel/src */
 #include <stdint.h>
 
-/* GICD register offsets */
-#define GICD_CTLR       0x000
-#define GICD_ISENABLER  0x100
-#define GICD_ICENABLER  0x180
-#define GICD_IPRIORITYR 0x400
-#define GICD_ITARGETSR  0x800
-#define GICD_ICFGR      0xC00
+static const gic_ops_t *s_ops;
+static uint32_t         s_irqs;             /* implemented INTIDs        */
 
-/* GICC register offsets */
-#define GICC_CTLR       0x000
-#define GICC_PMR        0x004
-#define GICC_IAR        0x00C
-#define GICC_EOIR       0x010
+static volatile uint32_t s_online;          /* CPUs through init_cpu     */
+static spinlock_t        s_route_lock = SPINLOCK_INIT;
+static uint8_t           s_route[GIC_MAX_IRQS];  /* SPI: CPU + 1, 0 = not
+                                                    routed yet          */
+static uint32_t          s_next_cpu;        /* round-robin cursor        */
 
-static volatile uint8_t *gicd = 0;
-static volatile uint8_t *gicc = 0;
+void gic_init(const dtb_result_t *dtb)
+{
+    const gic_ops_t *ops = dtb->gic_version == 3 ? &gic_v3_ops :
+                           dtb->gic_version == 2 ? &gic_v2_ops : 0;
+    if (!ops)
+        return;
 
-static void gicd_w32(uint32_t off, uint32_t val) {
-    *((volatile uint32_t *)(gicd + off)) = val;
-}
-static void gicc_w32(uint32_t off, uint32_t val) {
-    *((volatile uint32_t *)(gicc + off)) = val;
-}
-static uint32_t gicc_r32(uint32_t off) {
-    return *((volatile uint32_t *)(gicc + off));
+    uint32_t n = ops->init(dtb);
+    if (!n) {
+        klog("[gic] %s: no usable CPU interface", ops->name);
+        return;
+    }
+    s_irqs = n;
+    s_ops  = ops;
+    gic_init_cpu(0);
+    klog("[gic] %s, %u interrupt IDs", ops->name, n);
 }
 
-void gic_init(uint64_t dist_base, uint64_t cpu_base)
+void gic_init_cpu(uint32_t cpu)
 {
-    gicd = (volatile uint8_t *)dist_base;
-    gicc = (volatile uint8_t *)cpu_base;
-
-    /* Enable distributor */
-    gicd_w32(GICD_CTLR, 1);
-
-    /* Set all interrupt priorities to 0xA0 (middle priority) */
-    for (uint32_t i = 0; i < 256; i += 4)
-        gicd_w32(GICD_IPRIORITYR + i, 0xA0A0A0A0);
-
-    /* Route all SPIs to CPU 0 */
-    for (uint32_t i = 32; i < 256; i += 4)
-        gicd_w32(GICD_ITARGETSR + i, 0x01010101);
+    if (!s_ops || cpu >= HAL_MAX_CPUS) return;
+    if (s_ops->init_cpu(cpu) != 0) {
+        klog("[gic] cpu %u: no %s interface, it takes no interrupts",
+             cpu, s_ops->name);
+        return;
+    }
+    __atomic_or_fetch(&s_online, 1u << cpu, __ATOMIC_RELEASE);
+}
 
-    /* Disable all interrupts initially */
-    for (uint32_t i = 0; i < 256; i += 32)
-        gicd_w32(GICD_ICENABLER + (i / 8), 0xFFFFFFFF);
+int gic_present(void)
+{
+    return s_ops != 0;
+}
 
-    /* Accept all priority levels (0xFF = lowest threshold = accept all) */
-    gicc_w32(GICC_PMR, 0xFF);
+const char *gic_name(void)
+{
+    return s_ops ? s_ops->name : "none";
+}
 
-    /* Enable CPU interface */
-    gicc_w32(GICC_CTLR, 1);
+/* s_route_lock held */
+static uint32_t next_online_cpu(void)
+{
+    uint32_t online = __atomic_load_n(&s_online, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < HAL_MAX_CPUS; i++) {
+        uint32_t cpu = (s_next_cpu + i) % HAL_MAX_CPUS;
+        if (online & (1u << cpu)) {
+            s_next_cpu = cpu + 1;
+            return cpu;
+        }
+    }
+    return 0;
 }
 
 void gic_enable_irq(uint32_t irq)
 {
-    if (!gicd) return;
-    uint32_t reg = irq / 32;
-    uint32_t bit = irq % 32;
-    gicd_w32(GICD_ISENABLER + reg * 4, (1u << bit));
+    if (!s_ops || irq >= s_irqs) return;
+    if (irq >= GIC_SPI_BASE) {
+        uint64_t flags = spin_lock_irqsave(&s_route_lock);
+        if (!s_route[irq]) {
+            uint32_t cpu = next_online_cpu();
+            s_ops->route(irq, cpu);
+            s_route[irq] = (uint8_t)(cpu + 1);
+        }
+        spin_unlock_irqrestore(&s_route_lock, flags);
+    }
+    s_ops->enable(irq);
 }
 
 void gic_disable_irq(uint32_t irq)
 {
-    if (!gicd) return;
-    uint32_t reg = irq / 32;
-    uint32_t bit = irq % 32;
-    gicd_w32(GICD_ICENABLER + reg * 4, (1u << bit));
+    if (!s_ops || irq >= s_irqs) return;
+    s_ops->disable(irq);
+}
+
+int gic_set_affinity(uint32_t irq, uint32_t cpu)
+{
+    if (!s_ops || irq < GIC_SPI_BASE || irq >= s_irqs ||
+        cpu >= HAL_MAX_CPUS ||
+        !(__atomic_load_n(&s_online, __ATOMIC_ACQUIRE) & (1u << cpu)))
+        return -1;
+
+    uint64_t flags = spin_lock_irqsave(&s_route_lock);
+    s_ops->route(irq, cpu);
+    s_route[irq] = (uint8_t)(cpu + 1);
+    spin_unlock_irqrestore(&s_route_lock, flags);
+    return 0;
 }
 
 uint32_t gic_ack(void)
 {
-    if (!gicc) return 1023;     /* 1023 = spurious IRQ */
-    return gicc_r32(GICC_IAR) & 0x3FF;
+    if (!s_ops) return 1023;    /* 1023 = spurious IRQ */
+    return s_ops->ack();
+}
+
+void gic_eoi(uint32_t iar)
+{
+    if (!s_ops) return;
+    s_ops->eoi(iar);
 }
 
-void gic_eoi(uint32_t irq)
+void gic_send_sgi(uint32_t cpu, uint32_t sgi)
 {
-    if (!gicc) return;
-    gicc_w32(GICC_EOIR, irq);
+    if (!s_ops) return;
+    s_ops->send_sgi(cpu, sgi);
 }
@@ -1,19 +1,46 @@
 #pragma once
 #include <stdint.h>
+#include "dtb.h"
 
-/* GIC (Generic Interrupt Controller) driver — minimal subset.
- * Supports GIC-400 (Pi 3/4) and GIC-600 (Pi 5) at the basic interface.
- * Base addresses come from the DTB at runtime.
+/* GIC (Generic Interrupt Controller) driver.
+ * Two backends, picked from the DTB at runtime:
+ *   GICv2 — GIC-400 (Pi 4): memory-mapped distributor and CPU interface
+ *   GICv3 — GIC-500/600 (server parts, QEMU virt gic-version=3):
+ *           distributor, one redistributor per core, and the CPU
+ *           interface in system registers (ICC_*_EL1)
  *
- * Registers used:
- *   GICD (Distributor) — controls which IRQs are forwarded to CPUs
- *   GICC (CPU Interface) — per-CPU acknowledge / EOI
+ * Interrupt IDs: 0-15 SGI (IPIs), 16-31 PPI (per-CPU, e.g. the generic
+ * timer), 32+ SPI (shared peripherals).  SGIs and PPIs are banked:
+ * enabling one only affects the calling CPU.  An SPI is routed to one
+ * CPU when it is first enabled, round-robin over the CPUs whose GIC
+ * interface is up, unless gic_set_affinity() pinned it first.  LPIs
+ * (GICv3 ITS) are not used.
  */
 
-void gic_init(uint64_t dist_base, uint64_t cpu_base);
+#define GIC_SGI_KICK     0      /* wake a CPU out of wfi                */
+#define GIC_PPI_VTIMER   27     /* EL1 virtual generic timer            */
+#define GIC_MAX_IRQS     1020   /* 1020-1023 are special INTIDs         */
+
+void gic_init(const dtb_result_t *dtb);
+/* Per-CPU part of gic_init() for secondary CPUs (CPU interface, SGI/PPI
+ * banks, GICv3 redistributor).  SPIs are only routed to CPUs that have
+ * been through it. */
+void gic_init_cpu(uint32_t cpu);
+int  gic_present(void);
+/* "GICv2", "GICv3", or "none" */
+const char *gic_name(void);
 void gic_enable_irq(uint32_t irq);
 void gic_disable_irq(uint32_t irq);
-/* Acknowledge an interrupt — returns the IRQ number */
+/* Deliver SPI `irq` to kernel CPU index `cpu` from now on.  Returns -1
+ * for an SGI/PPI, an INTID the GIC does not implement, or a CPU whose
+ * interface is not up. */
+int  gic_set_affinity(uint32_t irq, uint32_t cpu);
+/* Acknowledge an interrupt — returns the value to hand to gic_eoi():
+ * the IRQ ID in bits 9:0 (GIC_IAR_ID() extracts it), and on GICv2 the
+ * source CPU of an SGI in bits 12:10 */
 uint32_t gic_ack(void);
-/* Signal end-of-interrupt for the given IRQ number */
-void gic_eoi(uint32_t irq);
+#define GIC_IAR_ID(iar)  ((iar) & 0x3FF)
+/* Signal end-of-interrupt; pass the value gic_ack() returned unchanged */
+void gic_eoi(uint32_t iar);
+/* Software-generated interrupt `sgi` (0-15) to kernel CPU index `cpu` */
+void gic_send_sgi(uint32_t cpu, uint32_t sgi);
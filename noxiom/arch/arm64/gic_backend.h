@@ -0,0 +1,36 @@
+#pragma once
+/* arch/arm64/gic_backend.h — GICv2 / GICv3 hooks behind gic.c.  Not for
+ * use outside the gic*.c files.
+ */
+#include "gic.h"
+
+typedef struct {
+    const char *name;
+    /* Map and reset the distributor; returns the number of INTIDs it
+     * implements (at most GIC_MAX_IRQS), 0 if it cannot be used */
+    uint32_t (*init)(const dtb_result_t *dtb);
+    /* Bring up the calling CPU's interface; `cpu` is its kernel index.
+     * -1 if this CPU cannot take interrupts. */
+    int      (*init_cpu)(uint32_t cpu);
+    void     (*enable)(uint32_t irq);
+    void     (*disable)(uint32_t irq);
+    /* SPI irq to `cpu`, which has been through init_cpu */
+    void     (*route)(uint32_t irq, uint32_t cpu);
+    uint32_t (*ack)(void);
+    void     (*eoi)(uint32_t iar);
+    /* Ignored for a CPU that has not been through init_cpu */
+    void     (*send_sgi)(uint32_t cpu, uint32_t sgi);
+} gic_ops_t;
+
+extern const gic_ops_t gic_v2_ops;
+extern const gic_ops_t gic_v3_ops;
+
+/* The first 32 INTIDs of every bank are SGIs and PPIs */
+#define GIC_SPI_BASE  32
+
+/* Implemented INTIDs from GICD_TYPER.ITLinesNumber: 32 * (N + 1) */
+static inline uint32_t gic_typer_irqs(uint32_t typer)
+{
+    uint32_t n = 32 * ((typer & 0x1F) + 1);
+    return n < GIC_MAX_IRQS ? n : GIC_MAX_IRQS;
+}
@@ -0,0 +1,157 @@
+/* arch/arm64/gic_v2.c — GICv2 backend (GIC-400)
+ *
+ * Uses the GIC Architecture specification v2 CPU interface, memory-
+ * mapped like the distributor.  Base addresses are supplied at runtime
+ * from the DTB.
+ *
+ * GICD (Distributor) registers:
+ *   GICD_CTLR       +0x000  Distributor control
+ *   GICD_TYPER      +0x004  Number of implemented interrupt lines
+ *   GICD_ISENABLER  +0x100  Interrupt Set-Enable registers (32 IRQs each)
+ *   GICD_ICENABLER  +0x180  Interrupt Clear-Enable registers
+ *   GICD_IPRIORITYR +0x400  Interrupt Priority registers
+ *   GICD_ITARGETSR  +0x800  Interrupt Processor Targets (which CPU gets it)
+ *   GICD_ICFGR      +0xC00  Interrupt Configuration (edge/level)
+ *   GICD_SGIR       +0xF00  Software Generated Interrupt (IPI) trigger
+ *
+ * GICC (CPU Interface) registers:
+ *   GICC_CTLR       +0x000  CPU interface control
+ *   GICC_PMR        +0x004  Priority mask (0xFF = accept all priorities)
+ *   GICC_IAR        +0x00C  Interrupt Acknowledge Register
+ *   GICC_EOIR       +0x010  End of Interrupt Register
+ */
+#include "gic_backend.h"
+#include <stdint.h>
+
+/* GICD register offsets */
+#define GICD_CTLR       0x000
+#define GICD_TYPER      0x004
+#define GICD_ISENABLER  0x100
+#define GICD_ICENABLER  0x180
+#define GICD_IPRIORITYR 0x400
+#define GICD_ITARGETSR  0x800
+#define GICD_ICFGR      0xC00
+#define GICD_SGIR       0xF00
+
+/* GICC register offsets */
+#define GICC_CTLR       0x000
+#define GICC_PMR        0x004
+#define GICC_IAR        0x00C
+#define GICC_EOIR       0x010
+
+static volatile uint8_t *gicd = 0;
+static volatile uint8_t *gicc = 0;
+static uint32_t          nr_irqs;
+
+/* GIC CPU interface bit for each kernel CPU index (ITARGETSR encoding) */
+static uint8_t cpu_target[32];
+
+static void gicd_w32(uint32_t off, uint32_t val) {
+    *((volatile uint32_t *)(gicd + off)) = val;
+}
+static uint32_t gicd_r32(uint32_t off) {
+    return *((volatile uint32_t *)(gicd + off));
+}
+static void gicd_w8(uint32_t off, uint8_t val) {
+    *(gicd + off) = val;
+}
+static uint8_t gicd_r8(uint32_t off) {
+    return *(gicd + off);
+}
+static void gicc_w32(uint32_t off, uint32_t val) {
+    *((volatile uint32_t *)(gicc + off)) = val;
+}
+static uint32_t gicc_r32(uint32_t off) {
+    return *((volatile uint32_t *)(gicc + off));
+}
+
+static uint32_t v2_init(const dtb_result_t *dtb)
+{
+    gicd = (volatile uint8_t *)dtb->gic_dist_base;
+    gicc = (volatile uint8_t *)dtb->gic_cpu_base;
+    nr_irqs = gic_typer_irqs(gicd_r32(GICD_TYPER));
+
+    /* Enable distributor */
+    gicd_w32(GICD_CTLR, 1);
+
+    /* Set all interrupt priorities to 0xA0 (middle priority) */
+    for (uint32_t i = 0; i < nr_irqs; i += 4)
+        gicd_w32(GICD_IPRIORITYR + i, 0xA0A0A0A0);
+
+    /* SPIs to CPU 0 until gic.c routes them */
+    for (uint32_t i = GIC_SPI_BASE; i < nr_irqs; i += 4)
+        gicd_w32(GICD_ITARGETSR + i, 0x01010101);
+
+    /* Disable all interrupts initially */
+    for (uint32_t i = 0; i < nr_irqs; i += 32)
+        gicd_w32(GICD_ICENABLER + (i / 8), 0xFFFFFFFF);
+
+    return nr_irqs;
+}
+
+static int v2_init_cpu(uint32_t cpu)
+{
+    /* ITARGETSR0-7 are banked and read back this CPU's own target bit */
+    if (cpu >= sizeof(cpu_target))
+        return -1;
+    cpu_target[cpu] = gicd_r8(GICD_ITARGETSR);
+
+    /* SGI/PPI priorities (IRQs 0-31) are banked per CPU */
+    for (uint32_t i = 0; i < GIC_SPI_BASE; i += 4)
+        gicd_w32(GICD_IPRIORITYR + i, 0xA0A0A0A0);
+
+    /* Wake-up IPI (many GICs hard-wire SGIs as enabled anyway) */
+    gicd_w32(GICD_ISENABLER, 1u << GIC_SGI_KICK);
+
+    /* Accept all priority levels (0xFF = lowest threshold = accept all) */
+    gicc_w32(GICC_PMR, 0xFF);
+
+    /* Enable CPU interface */
+    gicc_w32(GICC_CTLR, 1);
+    return 0;
+}
+
+static void v2_enable(uint32_t irq)
+{
+    gicd_w32(GICD_ISENABLER + (irq / 32) * 4, 1u << (irq % 32));
+}
+
+static void v2_disable(uint32_t irq)
+{
+    gicd_w32(GICD_ICENABLER + (irq / 32) * 4, 1u << (irq % 32));
+}
+
+static void v2_route(uint32_t irq, uint32_t cpu)
+{
+    /* Byte-accessible: one SPI's target mask, nobody else's */
+    if (cpu < sizeof(cpu_target) && cpu_target[cpu])
+        gicd_w8(GICD_ITARGETSR + irq, cpu_target[cpu]);
+}
+
+static uint32_t v2_ack(void)
+{
+    return gicc_r32(GICC_IAR) & 0x1FFF;
+}
+
+static void v2_eoi(uint32_t iar)
+{
+    gicc_w32(GICC_EOIR, iar);
+}
+
+static void v2_send_sgi(uint32_t cpu, uint32_t sgi)
+{
+    if (cpu >= sizeof(cpu_target) || !cpu_target[cpu]) return;
+    gicd_w32(GICD_SGIR, ((uint32_t)cpu_target[cpu] << 16) | (sgi & 0xF));
+}
+
+const gic_ops_t gic_v2_ops = {
+    .name     = "GICv2",
+    .init     = v2_init,
+    .init_cpu = v2_init_cpu,
+    .enable   = v2_enable,
+    .disable  = v2_disable,
+    .route    = v2_route,
+    .ack      = v2_ack,
+    .eoi      = v2_eoi,
+    .send_sgi = v2_send_sgi,
+};
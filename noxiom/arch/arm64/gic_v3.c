@@ -0,0 +1,309 @@
+/* arch/arm64/gic_v3.c — GICv3 backend (GIC-500, GIC-600)
+ *
+ * With affinity routing (ARE) on, the distributor only handles SPIs;
+ * SGIs and PPIs live in each core's redistributor, and the CPU interface
+ * is a set of system registers instead of an MMIO page.  Everything is
+ * put in Group 1 Non-secure, the group EL1 takes as IRQ.
+ *
+ * GICD (Distributor) registers:
+ *   GICD_CTLR       +0x0000  ARE_NS, group enables, RWP (write pending)
+ *   GICD_TYPER      +0x0004  Number of implemented interrupt lines
+ *   GICD_IGROUPR    +0x0080  Group (1 = Group 1 Non-secure)
+ *   GICD_ISENABLER  +0x0100  Set-Enable   } SPIs only: the SGI/PPI words
+ *   GICD_ICENABLER  +0x0180  Clear-Enable } are the redistributors' now
+ *   GICD_IPRIORITYR +0x0400  Priority, one byte per INTID
+ *   GICD_IROUTER    +0x6000  64-bit per SPI: target CPU's affinity
+ *
+ * GICR (Redistributor), one per core, found by matching GICR_TYPER's
+ * affinity against MPIDR_EL1.  Each is an RD_base frame followed by an
+ * SGI_base frame, 64 KB apiece (two more for GICv4 virtual LPIs):
+ *   RD_base  GICR_CTLR  +0x0000   RWP
+ *            GICR_TYPER +0x0008   affinity in 63:32, Last, VLPIS
+ *            GICR_WAKER +0x0014   ProcessorSleep / ChildrenAsleep
+ *   SGI_base GICR_IGROUPR0, ISENABLER0, ICENABLER0, IPRIORITYR0-7 at the
+ *            distributor's offsets, for INTIDs 0-31 of that core
+ *
+ * CPU interface: ICC_IAR1_EL1 / ICC_EOIR1_EL1 acknowledge and end Group 1
+ * interrupts, ICC_SGI1R_EL1 sends SGIs by affinity.  Written as raw
+ * S3_* encodings so no assembler GIC extension is needed; boot_macros.h
+ * opens ICC_SRE_EL2 for EL1 before leaving EL2.
+ */
+#include "gic_backend.h"
+#include "hal.h"            /* -Ikernel/src  */
+#include <stdint.h>
+
+/* GICD register offsets */
+#define GICD_CTLR        0x0000
+#define GICD_TYPER       0x0004
+#define GICD_IGROUPR     0x0080
+#define GICD_ISENABLER   0x0100
+#define GICD_ICENABLER   0x0180
+#define GICD_IPRIORITYR  0x0400
+#define GICD_IROUTER     0x6000
+
+#define GICD_CTLR_G1     (1u << 0)      /* EnableGrp1 (NS) / Grp0 (DS=1)  */
+#define GICD_CTLR_G1A    (1u << 1)      /* EnableGrp1A (NS) / Grp1 (DS=1) */
+#define GICD_CTLR_ARE_NS (1u << 4)
+#define GICD_CTLR_RWP    (1u << 31)
+
+/* GICR register offsets */
+#define GICR_CTLR        0x0000
+#define GICR_TYPER       0x0008
+#define GICR_WAKER       0x0014
+#define GICR_SGI_BASE    0x10000
+#define GICR_IGROUPR0    (GICR_SGI_BASE + 0x0080)
+#define GICR_ISENABLER0  (GICR_SGI_BASE + 0x0100)
+#define GICR_ICENABLER0  (GICR_SGI_BASE + 0x0180)
+#define GICR_IPRIORITYR0 (GICR_SGI_BASE + 0x0400)
+
+#define GICR_CTLR_RWP          (1u << 3)
+#define GICR_TYPER_VLPIS       (1ull << 1)
+#define GICR_TYPER_LAST        (1ull << 4)
+#define GICR_WAKER_SLEEP       (1u << 1)    /* ProcessorSleep            */
+#define GICR_WAKER_ASLEEP      (1u << 2)    /* ChildrenAsleep            */
+#define GICR_FRAMES_STRIDE     0x20000      /* RD_base + SGI_base        */
+#define GICR_VLPI_STRIDE       0x40000      /* + VLPI_base + reserved    */
+
+/* CPU interface system registers */
+#define ICC_PMR_EL1      "S3_0_C4_C6_0"
+#define ICC_IAR1_EL1     "S3_0_C12_C12_0"
+#define ICC_EOIR1_EL1    "S3_0_C12_C12_1"
+#define ICC_BPR1_EL1     "S3_0_C12_C12_3"
+#define ICC_CTLR_EL1     "S3_0_C12_C12_4"
+#define ICC_SRE_EL1      "S3_0_C12_C12_5"
+#define ICC_IGRPEN1_EL1  "S3_0_C12_C12_7"
+#define ICC_SGI1R_EL1    "S3_0_C12_C11_5"
+
+#define ICC_SRE_SRE      (1u << 0)
+
+#define RWP_SPINS        1000000
+
+static volatile uint8_t *gicd = 0;
+static volatile uint8_t *gicr_region = 0;
+static uint64_t          gicr_stride;
+static uint32_t          nr_irqs;
+
+/* Per kernel CPU index: its redistributor (0 = interface not up) and
+ * its MPIDR_EL1 affinity fields, Aff3 in 39:32 */
+static volatile uint8_t *cpu_rd[HAL_MAX_CPUS];
+static uint64_t          cpu_mpidr[HAL_MAX_CPUS];
+
+#define MPIDR_AFF_MASK  0xFF00FFFFFFULL
+#define MPIDR_AFF(m, n) (((n) == 3 ? (m) >> 32 : (m) >> (8 * (n))) & 0xFF)
+
+static void w32(volatile uint8_t *b, uint32_t off, uint32_t v) {
+    *((volatile uint32_t *)(b + off)) = v;
+}
+static uint32_t r32(volatile uint8_t *b, uint32_t off) {
+    return *((volatile uint32_t *)(b + off));
+}
+static void w64(volatile uint8_t *b, uint32_t off, uint64_t v) {
+    *((volatile uint64_t *)(b + off)) = v;
+}
+static uint64_t r64(volatile uint8_t *b, uint32_t off) {
+    return *((volatile uint64_t *)(b + off));
+}
+
+/* Wait for a CTLR write to take effect (bounded: a stuck bit is not
+ * worth hanging the boot over) */
+static void wait_rwp(volatile uint8_t *b, uint32_t bit)
+{
+    for (uint32_t i = 0; i < RWP_SPINS && (r32(b, 0) & bit); i++)
+        hal_cpu_relax();
+}
+
+static uint32_t v3_init(const dtb_result_t *dtb)
+{
+    /* The CPU interface must be usable through system registers; with
+     * SRE stuck at 0 only the legacy MMIO interface is, and we have no
+     * address for it */
+    uint64_t sre;
+    __asm__ volatile("mrs %0, " ICC_SRE_EL1 : "=r"(sre));
+    __asm__ volatile("msr " ICC_SRE_EL1 ", %0\n\tisb"
+                     :: "r"(sre | ICC_SRE_SRE));
+    __asm__ volatile("mrs %0, " ICC_SRE_EL1 : "=r"(sre));
+    if (!(sre & ICC_SRE_SRE))
+        return 0;
+
+    gicd        = (volatile uint8_t *)dtb->gic_dist_base;
+    gicr_region = (volatile uint8_t *)dtb->gic_redist_base;
+    gicr_stride = dtb->gic_redist_stride;
+    nr_irqs     = gic_typer_irqs(r32(gicd, GICD_TYPER));
+
+    w32(gicd, GICD_CTLR, 0);
+    wait_rwp(gicd, GICD_CTLR_RWP);
+
+    for (uint32_t i = GIC_SPI_BASE; i < nr_irqs; i += 32) {
+        w32(gicd, GICD_ICENABLER + i / 8, 0xFFFFFFFF);
+        w32(gicd, GICD_IGROUPR + i / 8, 0xFFFFFFFF);
+    }
+    for (uint32_t i = GIC_SPI_BASE; i < nr_irqs; i += 4)
+        w32(gicd, GICD_IPRIORITYR + i, 0xA0A0A0A0);
+    wait_rwp(gicd, GICD_CTLR_RWP);
+
+    /* ARE must be set before, or together with, the group enables */
+    w32(gicd, GICD_CTLR, GICD_CTLR_ARE_NS);
+    wait_rwp(gicd, GICD_CTLR_RWP);
+    w32(gicd, GICD_CTLR, GICD_CTLR_ARE_NS | GICD_CTLR_G1A | GICD_CTLR_G1);
+    wait_rwp(gicd, GICD_CTLR_RWP);
+
+    /* SPIs to the boot CPU until gic.c routes them */
+    uint64_t self;
+    __asm__ volatile("mrs %0, mpidr_el1" : "=r"(self));
+    for (uint32_t i = GIC_SPI_BASE; i < nr_irqs; i++)
+        w64(gicd, GICD_IROUTER + i * 8, self & MPIDR_AFF_MASK);
+
+    return nr_irqs;
+}
+
+/* The redistributor whose GICR_TYPER affinity is `mpidr`'s, or 0 */
+static volatile uint8_t *find_rd(uint64_t mpidr)
+{
+    uint32_t want = (uint32_t)(MPIDR_AFF(mpidr, 3) << 24 |
+                               MPIDR_AFF(mpidr, 2) << 16 |
+                               MPIDR_AFF(mpidr, 1) << 8  |
+                               MPIDR_AFF(mpidr, 0));
+    volatile uint8_t *rd = gicr_region;
+    for (uint32_t i = 0; i < HAL_MAX_CPUS * 4; i++) {
+        uint64_t typer = r64(rd, GICR_TYPER);
+        if ((uint32_t)(typer >> 32) == want)
+            return rd;
+        if (typer & GICR_TYPER_LAST)
+            break;
+        rd += gicr_stride ? gicr_stride :
+              (typer & GICR_TYPER_VLPIS) ? GICR_VLPI_STRIDE
+                                         : GICR_FRAMES_STRIDE;
+    }
+    return 0;
+}
+
+static int v3_init_cpu(uint32_t cpu)
+{
+    if (cpu >= HAL_MAX_CPUS)
+        return -1;
+
+    uint64_t mpidr;
+    __asm__ volatile("mrs %0, mpidr_el1" : "=r"(mpidr));
+    mpidr &= MPIDR_AFF_MASK;
+    volatile uint8_t *rd = find_rd(mpidr);
+    if (!rd)
+        return -1;                      /* no IRQs, SGIs or PPIs here */
+
+    /* Wake the redistributor */
+    w32(rd, GICR_WAKER, r32(rd, GICR_WAKER) & ~GICR_WAKER_SLEEP);
+    for (uint32_t i = 0; i < RWP_SPINS &&
+                         (r32(rd, GICR_WAKER) & GICR_WAKER_ASLEEP); i++)
+        hal_cpu_relax();
+
+    /* SGIs and PPIs: all off but the wake-up IPI, Group 1, priority
+     * 0xA0 */
+    w32(rd, GICR_ICENABLER0, 0xFFFFFFFF);
+    wait_rwp(rd, GICR_CTLR_RWP);
+    w32(rd, GICR_IGROUPR0, 0xFFFFFFFF);
+    for (uint32_t i = 0; i < GIC_SPI_BASE; i += 4)
+        w32(rd, GICR_IPRIORITYR0 + i, 0xA0A0A0A0);
+    w32(rd, GICR_ISENABLER0, 1u << GIC_SGI_KICK);
+
+    /* The boot CPU did this in v3_init() already */
+    uint64_t sre;
+    __asm__ volatile("mrs %0, " ICC_SRE_EL1 : "=r"(sre));
+    __asm__ volatile("msr " ICC_SRE_EL1 ", %0\n\tisb"
+                     :: "r"(sre | ICC_SRE_SRE));
+
+    /* EOImode 0 (EOIR drops priority and deactivates), accept every
+     * priority, no preemption groups, Group 1 on */
+    __asm__ volatile("msr " ICC_CTLR_EL1 ", xzr\n\t"
+                     "msr " ICC_PMR_EL1 ", %0\n\t"
+                     "msr " ICC_BPR1_EL1 ", xzr\n\t"
+                     "msr " ICC_IGRPEN1_EL1 ", %1\n\t"
+                     "isb" :: "r"(0xFFull), "r"(1ull));
+
+    cpu_mpidr[cpu] = mpidr;
+    __atomic_store_n(&cpu_rd[cpu], rd, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* The calling CPU's redistributor, for banked SGI/PPI enables */
+static volatile uint8_t *self_rd(void)
+{
+    uint32_t cpu = hal_cpu_id();
+    return cpu < HAL_MAX_CPUS ? cpu_rd[cpu] : 0;
+}
+
+static void v3_enable(uint32_t irq)
+{
+    if (irq >= GIC_SPI_BASE) {
+        w32(gicd, GICD_ISENABLER + (irq / 32) * 4, 1u << (irq % 32));
+        return;
+    }
+    volatile uint8_t *rd = self_rd();
+    if (rd)
+        w32(rd, GICR_ISENABLER0, 1u << irq);
+}
+
+static void v3_disable(uint32_t irq)
+{
+    if (irq >= GIC_SPI_BASE) {
+        w32(gicd, GICD_ICENABLER + (irq / 32) * 4, 1u << (irq % 32));
+        wait_rwp(gicd, GICD_CTLR_RWP);
+        return;
+    }
+    volatile uint8_t *rd = self_rd();
+    if (rd) {
+        w32(rd, GICR_ICENABLER0, 1u << irq);
+        wait_rwp(rd, GICR_CTLR_RWP);
+    }
+}
+
+static void v3_route(uint32_t irq, uint32_t cpu)
+{
+    /* IRM = 0: this one CPU */
+    if (cpu < HAL_MAX_CPUS && cpu_rd[cpu])
+        w64(gicd, GICD_IROUTER + irq * 8, cpu_mpidr[cpu]);
+}
+
+static uint32_t v3_ack(void)
+{
+    uint64_t iar;
+    __asm__ volatile("mrs %0, " ICC_IAR1_EL1 : "=r"(iar));
+    /* Order the acknowledge before the handler's device accesses */
+    __asm__ volatile("dsb sy" ::: "memory");
+    return (uint32_t)iar & 0xFFFFFF;
+}
+
+static void v3_eoi(uint32_t iar)
+{
+    __asm__ volatile("msr " ICC_EOIR1_EL1 ", %0\n\tisb"
+                     :: "r"((uint64_t)iar) : "memory");
+}
+
+static void v3_send_sgi(uint32_t cpu, uint32_t sgi)
+{
+    if (cpu >= HAL_MAX_CPUS || !cpu_rd[cpu])
+        return;
+    uint64_t m    = cpu_mpidr[cpu];
+    uint64_t aff0 = MPIDR_AFF(m, 0);
+    uint64_t v    = MPIDR_AFF(m, 3) << 48 |
+                    (aff0 / 16) << 44 |         /* RS: Aff0 range     */
+                    MPIDR_AFF(m, 2) << 32 |
+                    (uint64_t)(sgi & 0xF) << 24 |
+                    MPIDR_AFF(m, 1) << 16 |
+                    1ull << (aff0 % 16);        /* target list        */
+    /* The write is not ordered with memory by itself: whatever the
+     * target is being woken for must be visible first */
+    __asm__ volatile("dsb ishst\n\t"
+                     "msr " ICC_SGI1R_EL1 ", %0\n\t"
+                     "isb" :: "r"(v) : "memory");
+}
+
+const gic_ops_t gic_v3_ops = {
+    .name     = "GICv3",
+    .init     = v3_init,
+    .init_cpu = v3_init_cpu,
+    .enable   = v3_enable,
+    .disable  = v3_disable,
+    .route    = v3_route,
+    .ack      = v3_ack,
+    .eoi      = v3_eoi,
+    .send_sgi = v3_send_sgi,
+};
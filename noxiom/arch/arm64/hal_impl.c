@@ -2,7 +2,7 @@
  *
  * Implements every hal_*() function declared in kernel/src/hal.h.
  * Portable kernel code calls only hal_*() — this file routes those calls
- * to the ARM-specific drivers (PL011 UART, GIC, DTB parser, MIDR).
+ * to the ARM-specific drivers (PL011 UART, GIC, DTB parser, MIDR, SMP).
  *
  * On AArch64: serial == display.  Both map to the PL011 UART whose
  * MMIO base is discovered from the DTB at first use — never hard-coded.
@@ -18,12 +18,27 @@
 #include "uart_pl011.h"   /* -Iarch/arm64  */
 #include "gic.h"          /* -Iarch/arm64  */
 #include "midr.h"         /* -Iarch/arm64  */
+#include "smp_arm64.h"    /* -Iarch/arm64  */
+#include "mmu.h"          /* -Iarch/arm64  */
+#include "pmu_arm64.h"    /* -Iarch/arm64  */
+#include "user_arm64.h"   /* -Iarch/arm64  */
+#include "fpu_arm64.h"    /* -Iarch/arm64  */
+#include "topo_arm64.h"   /* -Iarch/arm64  */
+#include "dispatch_arm64.h" /* -Iarch/arm64 */
+#include "time/clock.h"   /* -Ikernel/src  */
+#include "sched/sched.h"  /* -Ikernel/src  */
+#include "log/klog.h"     /* -Ikernel/src  */
 #include <stdint.h>
 
 /* DTB address written into .data by arch/arm64/boot/entry.S
  * before bl kmain — so it is valid before any C code runs. */
 extern volatile uint64_t g_dtb_addr;
 
+/* CNTVCT ticks boot/lz4_stub.S spent unpacking kernel8.img, stored by
+ * entry.S; 0 when the image was not compressed. */
+extern uint64_t g_boot_unpack_ticks;
+extern uint64_t g_boot_start_ticks;
+
 /* ── Lazy DTB parse — called once, result cached ────────────────────────── */
 static dtb_result_t s_dtb;
 static int          s_dtb_done = 0;
@@ -36,6 +51,19 @@ static void dtb_init(void)
     dtb_parse((uint64_t)g_dtb_addr, &s_dtb);
 }
 
+/* Called from entry.S before kmain(), MMU and caches still off: the
+ * translation tables need the memory map, so the DTB is parsed here */
+static uint64_t s_boot_dtb_ticks;
+static uint64_t s_boot_mmu_ticks;
+
+void arm64_early_init(void)
+{
+    dtb_init();
+    s_boot_dtb_ticks = hal_boot_ticks();
+    mmu_init(&s_dtb);
+    s_boot_mmu_ticks = hal_boot_ticks();
+}
+
 /* ── Serial (early debug UART) ──────────────────────────────────────────── */
 void hal_serial_init(void)
 {
@@ -85,22 +113,52 @@ void hal_display_set_color(uint8_t c)
 }
 
 /* ── Input (UART RX, blocking) ──────────────────────────────────────────── */
+static int                s_input_irq;
+static thread_t *volatile s_input_waiter;   /* the one blocked reader    */
+
+static void input_notify(void)
+{
+    thread_t *t = s_input_waiter;
+    if (t)
+        thread_wake(t);
+}
+
 void hal_input_init(void)
 {
-    /* PL011 RX already enabled by pl011_init() inside hal_serial_init(). */
+    /* Only a real PL011 on the GIC can run interrupt driven; anything
+     * else (mini UART, Pi 3 legacy controller) stays polled. */
+    if (gic_present() && s_dtb.uart_irq &&
+        kstrncmp(s_dtb.uart_compat, "arm,pl011", 9) == 0)
+        s_input_irq = pl011_enable_irq(s_dtb.uart_irq, input_notify) == 0;
 }
 
 char hal_input_getchar(void)
 {
-    return pl011_getchar();
+    char c;
+    for (;;) {
+        if (pl011_trygetchar(&c))
+            return c;
+        if (!s_input_irq) {
+            thread_yield();             /* polled: let others run */
+            continue;
+        }
+        /* Publish, re-check, sleep: a byte landing in between wakes us
+         * (thread_block() remembers early wakes) */
+        s_input_waiter = thread_current();
+        if (pl011_trygetchar(&c)) {
+            s_input_waiter = 0;
+            return c;
+        }
+        thread_block();
+        s_input_waiter = 0;
+    }
 }
 
-/* ── Interrupt controller (ARM GIC) ─────────────────────────────────────── */
+/* ── Interrupt controller (ARM GICv2 / GICv3) ───────────────────────────── */
 void hal_intc_init(void)
 {
     dtb_init();
-    if (s_dtb.gic_dist_base && s_dtb.gic_cpu_base)
-        gic_init(s_dtb.gic_dist_base, s_dtb.gic_cpu_base);
+    gic_init(&s_dtb);
 }
 
 void hal_intc_unmask(uint32_t irq)
@@ -108,14 +166,419 @@ void hal_intc_unmask(uint32_t irq)
     gic_enable_irq(irq);
 }
 
+int hal_intc_set_affinity(uint32_t irq, uint32_t cpu)
+{
+    return gic_set_affinity(irq, cpu);
+}
+
 void hal_intc_send_eoi(uint32_t irq)
 {
     gic_eoi(irq);
 }
 
-/* ── CPU init: VBAR_EL1 set in entry.S before kmain() — no-op here ─────── */
+/* No GICv3 ITS or GICv2m frame support yet: devices use wired SPIs */
+int hal_msi_alloc(uint32_t cpu, hal_msi_write_t write, void *ctx)
+{
+    (void)cpu; (void)write; (void)ctx;
+    return -1;
+}
+
+void hal_msi_free(uint32_t irq)
+{
+    (void)irq;
+}
+
+/* ── Platform devices: DTB nodes by compatible string ───────────────────── */
+int hal_platform_dev(const char *compat, uint32_t index,
+                     hal_platform_dev_t *out)
+{
+    int node = DTB_NO_NODE;
+    do {
+        node = dtb_find_compatible(compat, node);
+    } while (node != DTB_NO_NODE && index-- > 0);
+    if (node == DTB_NO_NODE || dtb_reg(node, 0, &out->base, &out->size) != 0)
+        return -1;
+    out->irq = dtb_gic_irq(node, 0);
+    return 0;
+}
+
+/* ── PCI configuration space: no host bridge driver yet ─────────────────── */
+uint32_t hal_pci_cfg_read(uint32_t bdf, uint32_t off, uint32_t size)
+{
+    (void)bdf; (void)off;
+    return size >= 4 ? 0xFFFFFFFFu : (1u << (size * 8)) - 1;
+}
+
+void hal_pci_cfg_write(uint32_t bdf, uint32_t off, uint32_t size,
+                       uint32_t val)
+{
+    (void)bdf; (void)off; (void)size; (void)val;
+}
+
+/* ── CPU init: VBAR_EL1 set in entry.S before kmain(); EL0 access ──────── */
 void hal_cpu_init(void)
 {
+    user_arm64_cpu_init(hal_cpu_id());
+    fpu_arm64_off();
+    dispatch_arm64_init();
+}
+
+/* ── CPU identity / interrupt state ─────────────────────────────────────── */
+void hal_percpu_set(hal_percpu_hdr_t *area)
+{
+    __asm__ volatile("msr tpidr_el1, %0" :: "r"(area) : "memory");
+}
+
+hal_percpu_hdr_t *hal_percpu(void)
+{
+    /* entry.S points TPIDR_EL1 at the area on every CPU */
+    hal_percpu_hdr_t *p;
+    __asm__ volatile("mrs %0, tpidr_el1" : "=r"(p));
+    return p;
+}
+
+uint32_t hal_cpu_id(void)
+{
+    return hal_percpu()->cpu;
+}
+
+uint64_t hal_irq_save(void)
+{
+    uint64_t daif;
+    __asm__ volatile("mrs %0, daif\n\tmsr daifset, #2" : "=r"(daif) :: "memory");
+    return daif;
+}
+
+void hal_irq_restore(uint64_t flags)
+{
+    __asm__ volatile("msr daif, %0" :: "r"(flags) : "memory");
+}
+
+void hal_irq_enable(void)
+{
+    __asm__ volatile("msr daifclr, #2" ::: "memory");
+}
+
+void hal_irq_disable(void)
+{
+    __asm__ volatile("msr daifset, #2" ::: "memory");
+}
+
+void hal_cpu_relax(void)
+{
+    __asm__ volatile("yield");
+}
+
+/* ── Secondary CPUs (PSCI / spin-table, see smp_arm64.c) ────────────────── */
+int hal_cpu_start_secondary(uint32_t cpu, void *stack_top,
+                            hal_cpu_entry_t entry)
+{
+    return smp_arm64_start_cpu(cpu, stack_top, entry);
+}
+
+void hal_cpu_idle(void)
+{
+    /* A pending IRQ still wakes wfi; it is taken once unmasked */
+    __asm__ volatile("wfi\n\tmsr daifclr, #2" ::: "memory");
+}
+
+void hal_cpu_kick(uint32_t cpu)
+{
+    gic_send_sgi(cpu, GIC_SGI_KICK);
+}
+
+/* ── Thread context (exceptions.S: context_switch, thread_trampoline) ───── */
+extern void context_switch(void **save_sp, void *new_sp);
+extern char thread_trampoline[];
+
+void *hal_context_init(void *stack_top, void (*entry)(void *), void *arg)
+{
+    /* Frame popped by context_switch: x19..x30, 96 bytes */
+    uint64_t *sp = (uint64_t *)(((uintptr_t)stack_top & ~(uintptr_t)15) - 96);
+    kmemset(sp, 0, 96);
+    sp[0]  = (uint64_t)(uintptr_t)entry;                /* x19 */
+    sp[1]  = (uint64_t)(uintptr_t)arg;                  /* x20 */
+    sp[11] = (uint64_t)(uintptr_t)thread_trampoline;    /* x30 */
+    return sp;
+}
+
+void hal_context_switch(void **save_sp, void *new_sp)
+{
+    context_switch(save_sp, new_sp);
+}
+
+/* ── User mode (EL0, exceptions.S user_enter / el0_sync) ────────────────── */
+/* hal_uspace_t is mmu.c's space; SP_EL1 alone says where an exception
+ * from EL0 lands, so the kernel stack top is only kept for entering EL0
+ * and finding an SVC's frame */
+void hal_user_range(uint64_t *base, uint64_t *end)
+{
+    *base = MMU_USER_BASE;
+    *end  = MMU_USER_END;
+}
+
+hal_uspace_t *hal_uspace_create(void)
+{
+    return (hal_uspace_t *)mmu_user_create();
+}
+
+void hal_uspace_destroy(hal_uspace_t *as)
+{
+    mmu_user_destroy((mmu_uspace_t *)as);
+}
+
+int hal_uspace_map(hal_uspace_t *as, uint64_t va, uint64_t pa,
+                   uint32_t flags)
+{
+    return mmu_user_map((mmu_uspace_t *)as, va, pa,
+                        (flags & HAL_UMAP_W) != 0, (flags & HAL_UMAP_X) != 0);
+}
+
+uint64_t hal_uspace_lookup(hal_uspace_t *as, uint64_t va, int write)
+{
+    return mmu_user_lookup((mmu_uspace_t *)as, va, write);
+}
+
+void hal_uspace_switch(hal_uspace_t *as, uint64_t kstack_top)
+{
+    hal_percpu()->kernel_sp = kstack_top;
+    mmu_user_activate((mmu_uspace_t *)as);
+}
+
+void hal_user_enter(uint64_t entry, uint64_t sp, uint64_t arg0,
+                    uint64_t arg1)
+{
+    hal_irq_disable();
+    user_enter(entry, sp, arg0, arg1, hal_percpu()->kernel_sp);
+}
+
+/* An SVC's frame is the first one on the kernel stack: el0_sync starts
+ * at its top.  IRQs masked so kernel_sp is still this thread's. */
+_Static_assert(USER_FRAME_WORDS <= HAL_USER_REGS,
+               "hal_user_regs_t too small for an exception frame");
+
+void hal_user_save(hal_user_regs_t *regs)
+{
+    uint64_t flags = hal_irq_save();
+    const uint64_t *f = (const uint64_t *)(uintptr_t)
+        (hal_percpu()->kernel_sp - USER_FRAME_WORDS * 8);
+    for (uint32_t i = 0; i < USER_FRAME_WORDS; i++)
+        regs->r[i] = f[i];
+    hal_irq_restore(flags);
+}
+
+void hal_user_resume(const hal_user_regs_t *regs, uint64_t ret)
+{
+    hal_irq_disable();
+    user_resume(regs->r, ret, hal_percpu()->kernel_sp);
+}
+
+uint32_t hal_user_machine(void)
+{
+    return 183;                         /* EM_AARCH64 */
+}
+
+/* ── FP/SIMD (CPACR_EL1.FPEN, fpu.S) ────────────────────────────────────── */
+uint32_t hal_fpu_state_size(void)
+{
+    return FPU_ARM64_STATE_SIZE;
+}
+
+/* All zero: round to nearest, no exceptions trapped, flags clear */
+void hal_fpu_init_state(void *buf)
+{
+    kmemset(buf, 0, FPU_ARM64_STATE_SIZE);
+}
+
+void hal_fpu_enable(void)
+{
+    fpu_arm64_on();
+}
+
+void hal_fpu_disable(void)
+{
+    fpu_arm64_off();
+}
+
+void hal_fpu_save(void *buf)
+{
+    fpu_arm64_save(buf);
+}
+
+void hal_fpu_restore(const void *buf)
+{
+    fpu_arm64_restore(buf);
+}
+
+/* ── Timer (generic virtual timer) ──────────────────────────────────────── */
+
+/* CNTVCT_EL0 counts at CNTFRQ_EL0 on every CPU; entry.S zeroes the
+ * virtual offset, so virtual and physical counts agree.  The compare
+ * value is absolute, which makes one-shot deadlines exact. */
+static hal_timer_fn_t s_timer_fn;
+static clock_ref_t    s_cnt_ref = CLOCK_REF_INIT;   /* 0 ns = first use */
+
+static inline uint64_t read_cntvct(void)
+{
+    uint64_t v;
+    __asm__ volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(v) :: "memory");
+    return v;
+}
+
+static void timer_clock_init(void)
+{
+    uint64_t freq;
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    if (freq == 0)
+        return;                 /* hal_timer_now_ns() stays at 0 */
+    clock_ref_set(&s_cnt_ref, read_cntvct(), freq);
+}
+
+uint64_t hal_timer_now_ns(void)
+{
+    return clock_ref_to_ns(&s_cnt_ref, read_cntvct());
+}
+
+void hal_timer_set_deadline(uint64_t ns)
+{
+    if (ns == HAL_TIMER_NEVER) {
+        __asm__ volatile("msr cntv_ctl_el0, xzr\n\tisb" ::: "memory");
+        return;
+    }
+    uint64_t cval = clock_ref_from_ns(&s_cnt_ref, ns);
+    __asm__ volatile("msr cntv_cval_el0, %0\n\t"
+                     "msr cntv_ctl_el0, %1\n\t"
+                     "isb" :: "r"(cval), "r"(1ULL) : "memory");
+}
+
+void hal_user_clock(hal_user_clock_t *out)
+{
+    clock_conv_t c;
+    clock_ref_get(&s_cnt_ref, &out->base, &c);
+    out->mult    = c.mult;
+    out->shift   = c.shift;
+    out->counter = c.mult ? HAL_UCLOCK_CNTVCT : HAL_UCLOCK_NONE;
+}
+
+int hal_timer_cpu_init(hal_timer_fn_t fn)
+{
+    if (!gic_present() || !clock_ref_valid(&s_cnt_ref))
+        return -1;
+
+    s_timer_fn = fn;
+    hal_timer_set_deadline(HAL_TIMER_NEVER);
+    gic_enable_irq(GIC_PPI_VTIMER);         /* banked: this CPU only */
+    return 0;
+}
+
+/* ── Boot timestamps (CNTVCT, stamps from entry.S and the LZ4 stub) ─────── */
+uint64_t hal_boot_ticks(void)
+{
+    return read_cntvct();
+}
+
+uint64_t hal_boot_ticks_hz(void)
+{
+    uint64_t freq;
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    return freq;
+}
+
+uint32_t hal_boot_early_marks(hal_boot_mark_t *out, uint32_t max)
+{
+    hal_boot_mark_t m[4];
+    uint32_t        n = 0;
+    uint64_t        start = g_boot_start_ticks;
+
+    /* The stub's own set-up before its first count is not included */
+    if (g_boot_unpack_ticks) {
+        m[n++] = (hal_boot_mark_t){ "stub", start - g_boot_unpack_ticks };
+        m[n++] = (hal_boot_mark_t){ "unpack", start };
+    } else {
+        m[n++] = (hal_boot_mark_t){ "start", start };
+    }
+    m[n++] = (hal_boot_mark_t){ "dtb", s_boot_dtb_ticks };
+    m[n++] = (hal_boot_mark_t){ "mmu", s_boot_mmu_ticks };
+
+    if (n > max)
+        n = max;
+    for (uint32_t i = 0; i < n; i++)
+        out[i] = m[i];
+    return n;
+}
+
+/* ── Cycle counter (PMU PMCCNTR_EL0) ────────────────────────────────────── */
+
+/* Enabled on each CPU's first read; ID_AA64DFR0_EL1.PMUVer says whether
+ * there is a PMU at all (0 = none, 0xF = IMPLEMENTATION DEFINED). */
+static uint8_t s_pmu_on[HAL_MAX_CPUS];
+static int     s_pmu_absent = -1;
+
+uint64_t hal_cycles(void)
+{
+    if (s_pmu_absent < 0) {
+        uint64_t dfr0;
+        __asm__ volatile("mrs %0, id_aa64dfr0_el1" : "=r"(dfr0));
+        uint32_t ver = (uint32_t)(dfr0 >> 8) & 0xF;
+        s_pmu_absent = ver == 0 || ver == 0xF;
+    }
+    if (s_pmu_absent)
+        return read_cntvct();
+
+    uint32_t cpu = hal_cpu_id();
+    if (!s_pmu_on[cpu]) {
+        uint64_t pmcr;
+        __asm__ volatile("mrs %0, pmcr_el0" : "=r"(pmcr));
+        /* PMCCFILTR 0: count at EL0 and EL1; PMCR.E enables counting */
+        __asm__ volatile("msr pmccfiltr_el0, xzr\n\t"
+                         "msr pmcntenset_el0, %0\n\t"
+                         "msr pmcr_el0, %1\n\t"
+                         "isb" :: "r"(1ULL << 31), "r"(pmcr | 1) : "memory");
+        s_pmu_on[cpu] = 1;
+    }
+    uint64_t v;
+    __asm__ volatile("isb\n\tmrs %0, pmccntr_el0" : "=r"(v) :: "memory");
+    return v;
+}
+
+/* ── Performance counters (PMUv3, see pmu_arm64.c) ──────────────────────── */
+uint32_t hal_pmu_counters(void)           { return pmu_arm64_counters(); }
+int      hal_pmu_has_event(uint32_t ev)   { return pmu_arm64_has_event(ev); }
+void     hal_pmu_stop(void)               { pmu_arm64_stop(); }
+
+int hal_pmu_count_start(const uint32_t *events, uint32_t n)
+{
+    return pmu_arm64_count_start(events, n);
+}
+
+void hal_pmu_count_read(uint64_t *counts, uint32_t n)
+{
+    pmu_arm64_count_read(counts, n);
+}
+
+int hal_pmu_sample_start(uint32_t event, uint64_t period,
+                         hal_pmu_sample_fn_t fn)
+{
+    return pmu_arm64_sample_start(event, period, fn);
+}
+
+/* ── DMA coherence (data-cache maintenance, see mmu.c) ──────────────────── */
+void hal_dma_sync_for_device(const void *p, size_t len)
+{
+    dcache_clean_range(p, len);
+}
+
+void hal_dma_sync_for_cpu(void *p, size_t len)
+{
+    dcache_invalidate_range(p, len);
+}
+
+/* ── Device memory: Device-nGnRE everywhere outside RAM (mmu.c) ─────────── */
+void *hal_mmio_map(uint64_t pa, uint64_t size)
+{
+    if (pa + size > MMU_USER_BASE || pa + size < pa)
+        return 0;           /* beyond the 256 GB identity map */
+    return (void *)(uintptr_t)pa;
 }
 
 /* ── Halt ────────────────────────────────────────────────────────────────── */
@@ -123,21 +586,75 @@ void hal_halt(void)
 {
     /* Mask all interrupts then spin on WFE (saves power vs busy loop) */
     __asm__ volatile("msr daifset, #0xf" ::: "memory");
+    pl011_flush();                  /* the TX interrupt will not come */
     for (;;)
         __asm__ volatile("wfe");
 }
 
+/* ── Physical memory map (DTB /memory + reservations) ───────────────────── */
+
+extern char __kernel_end[];     /* linker.ld */
+
+uint32_t hal_mem_usable(hal_mem_region_t *out, uint32_t max)
+{
+    dtb_init();
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < s_dtb.mem_count && n < max; i++, n++) {
+        out[n].base = s_dtb.mem[i].base;
+        out[n].size = s_dtb.mem[i].size;
+    }
+    return n;
+}
+
+uint32_t hal_mem_reserved(hal_mem_region_t *out, uint32_t max)
+{
+    dtb_init();
+    if (max == 0)
+        return 0;
+
+    /* Firmware stubs / spin tables below 0x80000, then the kernel image */
+    out[0].base = 0;
+    out[0].size = (uint64_t)(uintptr_t)__kernel_end;
+
+    uint32_t n = 1;
+    for (uint32_t i = 0; i < s_dtb.rsv_count && n < max; i++, n++) {
+        out[n].base = s_dtb.rsv[i].base;
+        out[n].size = s_dtb.rsv[i].size;
+    }
+    return n;
+}
+
 /* ── Hardware detection ─────────────────────────────────────────────────── */
+static void report_unpack_time(void)
+{
+    uint64_t freq;
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    if (!g_boot_unpack_ticks || !freq)
+        return;
+
+    klog("[boot] kernel unpacked in %lu us",
+         (unsigned long)(g_boot_unpack_ticks * 1000000 / freq));
+}
+
 void hal_hw_detect(void)
 {
     dtb_init();   /* idempotent; s_dtb already populated by serial_init */
 
     g_hw_info.arch           = ARCH_ARM64;
     g_hw_info.ram_bytes      = s_dtb.ram_size;
-    g_hw_info.cpu_cores      = s_dtb.cpu_count;
+    g_hw_info.cpu_cores      = smp_arm64_init(&s_dtb);
+    if (g_hw_info.cpu_cores == 0) {
+        klog("[smp] boot CPU not in the DTB /cpus node, running on it alone");
+        g_hw_info.cpu_cores = 1;
+    }
+    topo_arm64_detect(&g_hw_info);
+    timer_clock_init();
+    pmu_arm64_init(s_dtb.pmu_irq);
+    report_unpack_time();
     g_hw_info.uart_base      = s_dtb.uart_base;
     g_hw_info.intc_dist_base = s_dtb.gic_dist_base;
-    g_hw_info.intc_base      = s_dtb.gic_cpu_base;
+    g_hw_info.intc_base      = s_dtb.gic_version == 3 ? s_dtb.gic_redist_base
+                                                      : s_dtb.gic_cpu_base;
 
     /* CPU model string from MIDR_EL1 (part number lookup, not board name) */
     midr_detect(g_hw_info.model_str, sizeof(g_hw_info.model_str));
@@ -150,20 +667,49 @@ void hal_hw_detect(void)
 /* ── Exception handlers (called from exceptions.S with sp as arg) ───────── */
 
 /* Synchronous exception (data abort, instruction abort, etc.)
- * These are fatal at this stage — halt the CPU. */
+ * These are fatal at this stage — log the syndrome and halt the CPU. */
 void arm64_sync_handler(void *frame)
 {
     (void)frame;
-    hal_serial_print("\r\n[NOXIOM] FATAL: synchronous exception\r\n");
+    uint64_t esr, elr, far;
+    __asm__ volatile("mrs %0, esr_el1\n\t"
+                     "mrs %1, elr_el1\n\t"
+                     "mrs %2, far_el1" : "=r"(esr), "=r"(elr), "=r"(far));
+    klog_panic("[NOXIOM] FATAL: synchronous exception on cpu %u, "
+               "esr 0x%lx elr 0x%lx far 0x%lx", hal_cpu_id(),
+               (unsigned long)esr, (unsigned long)elr, (unsigned long)far);
     hal_halt();
 }
 
-/* IRQ handler — acknowledge and signal end-of-interrupt to the GIC. */
+/* Saved ELR_EL1 in the exceptions.S frame: after x0-x30 */
+#define FRAME_ELR 31
+
+/* IRQ handler — acknowledge, then the timer, kick and PMU fast paths or
+ * the portable dispatch table. */
 void arm64_irq_handler(void *frame)
 {
-    (void)frame;
-    uint32_t irq = gic_ack();
-    /* No specific IRQ handlers yet; just acknowledge and move on. */
-    if (irq < 1020)   /* 1020-1023 are spurious — don't EOI them */
-        gic_eoi(irq);
+    uint32_t iar = gic_ack();
+    uint32_t irq = GIC_IAR_ID(iar);
+    if (irq >= 1020)  /* 1020-1023 are spurious — don't EOI them */
+        return;
+
+    if (irq == GIC_PPI_VTIMER || irq == GIC_SGI_KICK) {
+        /* The timer line stays asserted while enabled and expired; the
+         * callback sets the next deadline */
+        if (irq == GIC_PPI_VTIMER)
+            hal_timer_set_deadline(HAL_TIMER_NEVER);
+        gic_eoi(iar);
+        if (s_timer_fn)
+            s_timer_fn();           /* may switch threads */
+        return;
+    }
+
+    int pmu_irq = pmu_arm64_irq_id();
+    if (pmu_irq >= 0 && irq == (uint32_t)pmu_irq) {
+        pmu_arm64_irq(((const uint64_t *)frame)[FRAME_ELR]);
+        gic_eoi(iar);
+        return;
+    }
+
+    hal_irq_dispatch(irq);          /* EOIs through hal_intc_send_eoi() */
 }
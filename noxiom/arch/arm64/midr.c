@@ -96,3 +96,10 @@ void midr_detect(char *buf, uint32_t len)
     kstrncpy(buf, tmp, len);
     buf[len - 1] = '\0';
 }
+
+uint32_t midr_cpu(void)
+{
+    uint64_t midr;
+    __asm__ volatile("mrs %0, midr_el1" : "=r"(midr));
+    return MIDR_CPU((midr >> 24) & 0xFF, (midr >> 4) & 0xFFF);
+}
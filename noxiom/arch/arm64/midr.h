@@ -14,3 +14,8 @@
 /* Fill buf with a human-readable CPU model string (e.g. "ARM Cortex-A72").
  * buf must be at least len bytes; always NUL-terminated. */
 void midr_detect(char *buf, uint32_t len);
+
+/* Implementer and part number of the calling CPU as one value, for
+ * matching against MIDR_CPU(0x41, 0xD03) and the like (dispatch_arm64.c) */
+#define MIDR_CPU(impl, part)  ((uint32_t)(impl) << 12 | (uint32_t)(part))
+uint32_t midr_cpu(void);
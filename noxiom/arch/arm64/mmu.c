@@ -0,0 +1,378 @@
+/* arch/arm64/mmu.c — identity-mapped translation tables and cache helpers
+ *
+ * Layout: TTBR0 only (TCR.EPD1 set), T0SZ = 25, so the walk starts at
+ * level 1 with 1 GB entries.  Each range is mapped with the largest
+ * block that is entirely RAM or entirely not RAM.  A block that mixes
+ * the two is split into a next-level table: 2 MB blocks, then 4 KB
+ * pages.  RAM ends and peripheral windows are normally 2 MB aligned, so
+ * a handful of tables covers any Pi or QEMU memory map.  If the pool
+ * runs out, a mixed block is mapped as Device.  That is slow for the
+ * RAM inside it, but never unsafe.
+ *
+ * Everything here runs before the MMU is on, so the tables go straight
+ * to memory.  Any stale cache lines over them are discarded before the
+ * walker (cacheable per TCR) can see them.
+ *
+ * The identity map stops at 256 GB, the lower half of the level-1
+ * table; the upper half is user space.  Each user address space has a
+ * level-1 table of its own, whose lower half is a copy of the kernel's
+ * (never changed after mmu_init()), and an 8-bit ASID, so switching
+ * spaces needs no TLB flush.  User pages are 4 KB, not global (nG),
+ * never executable at EL1, and built from frames once the MMU is on,
+ * when the walker and the caches are coherent.
+ */
+#include "mmu.h"
+#include "mm/pmm.h"             /* -Ikernel/src  */
+#include "sync/spinlock.h"      /* -Ikernel/src  */
+#include <stdint.h>
+
+#define ENTRIES        512
+#define TABLE_POOL     16
+#define VA_BITS        39
+
+#define MAIR_NORMAL    0        /* attribute index: Normal WB RA/WA      */
+#define MAIR_DEVICE    1        /* attribute index: Device-nGnRE         */
+#define MAIR_VALUE     ((0xFFULL << (8 * MAIR_NORMAL)) | \
+                        (0x04ULL << (8 * MAIR_DEVICE)))
+
+#define DESC_BLOCK     0x1ULL   /* level 1/2 block                       */
+#define DESC_TABLE     0x3ULL   /* level 1/2 table, level 3 page         */
+#define DESC_ATTR(i)   ((uint64_t)(i) << 2)
+#define DESC_SH_INNER  (3ULL << 8)
+#define DESC_AP_EL0    (1ULL << 6)  /* AP[1]: EL0 access               */
+#define DESC_AP_RO     (1ULL << 7)  /* AP[2]: read-only                 */
+#define DESC_AF        (1ULL << 10)
+#define DESC_NG        (1ULL << 11)
+#define DESC_PXN       (1ULL << 53)
+#define DESC_UXN       (1ULL << 54)
+#define DESC_ADDR_MASK 0x0000FFFFFFFFF000ULL
+
+#define DESC_NORMAL    (DESC_ATTR(MAIR_NORMAL) | DESC_SH_INNER | DESC_AF | \
+                        DESC_UXN)
+#define DESC_DEVICE    (DESC_ATTR(MAIR_DEVICE) | DESC_AF | DESC_PXN | DESC_UXN)
+#define DESC_USER      (DESC_ATTR(MAIR_NORMAL) | DESC_SH_INNER | DESC_AF | \
+                        DESC_NG | DESC_AP_EL0 | DESC_PXN)
+
+#define USER_L1_FIRST  (ENTRIES / 2)    /* 256 GB up: user space         */
+#define ASID_COUNT     256              /* TCR.AS = 0: 8-bit, 0 = kernel */
+
+/* TCR_EL1: 4 KB granule, walks inner-shareable write-back cacheable */
+#define TCR_T0SZ       (64 - VA_BITS)
+#define TCR_IRGN0_WBWA (1ULL << 8)
+#define TCR_ORGN0_WBWA (1ULL << 10)
+#define TCR_SH0_INNER  (3ULL << 12)
+#define TCR_EPD1       (1ULL << 23)
+#define TCR_IPS_SHIFT  32
+
+#define SCTLR_M        (1ULL << 0)
+#define SCTLR_C        (1ULL << 2)
+#define SCTLR_I        (1ULL << 12)
+
+/* Read by the mmu_on macro in entry.S, on CPUs still running with their
+ * caches off: MAIR, TCR, TTBR0, SCTLR bits to set (0 = leave MMU off).
+ * Padded to a whole cache line so invalidating it touches nothing else. */
+uint64_t mmu_boot_regs[8] __attribute__((aligned(64)));
+
+static uint64_t tables[TABLE_POOL][ENTRIES] __attribute__((aligned(4096)));
+static uint32_t tables_used;
+
+static const dtb_result_t *mem_map;
+
+extern char _start[];            /* linker.ld: first byte of the image  */
+extern char __kernel_end[];
+
+/* ── RAM classification ───────────────────────────────────────────────── */
+
+#define KIND_DEVICE 0
+#define KIND_RAM    1
+#define KIND_MIXED  2
+
+static int classify(uint64_t base, uint64_t size)
+{
+    uint64_t end = base + size;
+    uint64_t k0 = (uint64_t)(uintptr_t)_start;
+    uint64_t k1 = (uint64_t)(uintptr_t)__kernel_end;
+
+    /* The image is RAM whatever the DTB says */
+    if (base >= k0 && end <= k1)
+        return KIND_RAM;
+    int touches = base < k1 && end > k0;
+
+    for (uint32_t i = 0; i < mem_map->mem_count; i++) {
+        uint64_t r0 = mem_map->mem[i].base;
+        uint64_t r1 = r0 + mem_map->mem[i].size;
+        if (base >= r0 && end <= r1)
+            return KIND_RAM;
+        if (base < r1 && end > r0)
+            touches = 1;
+    }
+    return touches ? KIND_MIXED : KIND_DEVICE;
+}
+
+/* ── Table construction ───────────────────────────────────────────────── */
+
+/* Fill the first `count` entries of a level-`level` table covering
+ * [base, base + count * span); the rest stay invalid */
+static void map_level(uint64_t *table, int level, uint64_t base,
+                      uint32_t count)
+{
+    uint64_t span = 1ULL << (12 + 9 * (3 - level));
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t addr = base + i * span;
+        int kind = classify(addr, span);
+
+        if (kind == KIND_MIXED && level < 3 && tables_used < TABLE_POOL) {
+            uint64_t *next = tables[tables_used++];
+            map_level(next, level + 1, addr, ENTRIES);
+            table[i] = ((uint64_t)(uintptr_t)next & DESC_ADDR_MASK) |
+                       DESC_TABLE;
+            continue;
+        }
+        uint64_t type = level == 3 ? DESC_TABLE : DESC_BLOCK;
+        table[i] = addr | type |
+                   (kind == KIND_RAM ? DESC_NORMAL : DESC_DEVICE);
+    }
+}
+
+int mmu_init(const dtb_result_t *dtb)
+{
+    if (!dtb || dtb->mem_count == 0)
+        return -1;              /* no memory map: caches stay off */
+    mem_map = dtb;
+
+    /* Map no further than the CPU can address */
+    static const uint8_t pa_bits[] = { 32, 36, 40, 42, 44, 48 };
+    uint64_t mmfr0;
+    __asm__ volatile("mrs %0, id_aa64mmfr0_el1" : "=r"(mmfr0));
+    uint32_t parange = (uint32_t)mmfr0 & 0xF;
+    if (parange > 5)
+        parange = 5;
+    uint32_t bits = pa_bits[parange] < VA_BITS - 1 ? pa_bits[parange]
+                                                   : VA_BITS - 1;
+
+    uint64_t *l1 = tables[tables_used++];
+    map_level(l1, 1, 0, 1u << (bits - 30));
+
+    mmu_boot_regs[0] = MAIR_VALUE;
+    mmu_boot_regs[1] = TCR_T0SZ | TCR_IRGN0_WBWA | TCR_ORGN0_WBWA |
+                       TCR_SH0_INNER | TCR_EPD1 |
+                       ((uint64_t)parange << TCR_IPS_SHIFT);
+    mmu_boot_regs[2] = (uint64_t)(uintptr_t)l1;
+    mmu_boot_regs[3] = SCTLR_M | SCTLR_C | SCTLR_I;
+
+    /* Everything up to here was written with the caches off: .bss
+     * zeroed by entry.S, g_percpu, s_dtb, these tables and
+     * mmu_boot_regs.  Clean and invalidate the whole image by VA so no
+     * line left from before can hide those writes once SCTLR.C is set. */
+    dcache_flush_range(_start, (size_t)(__kernel_end - _start));
+    return 0;
+}
+
+int mmu_enabled(void)
+{
+    uint64_t sctlr;
+    __asm__ volatile("mrs %0, sctlr_el1" : "=r"(sctlr));
+    return (sctlr & SCTLR_M) != 0;
+}
+
+/* ── User address spaces ──────────────────────────────────────────────── */
+
+struct mmu_uspace {
+    uint64_t *l1;               /* 0 while the slot (its ASID) is free    */
+};
+
+static mmu_uspace_t s_spaces[ASID_COUNT];
+static spinlock_t   s_space_lock = SPINLOCK_INIT;
+
+static uint32_t space_asid(const mmu_uspace_t *as)
+{
+    return (uint32_t)(as - s_spaces);
+}
+
+static uint64_t *table_at(uint64_t desc)
+{
+    return (uint64_t *)phys_to_virt(desc & DESC_ADDR_MASK);
+}
+
+static uint64_t *zeroed_table(void)
+{
+    uint64_t pa = pmm_alloc_page();
+    if (!pa)
+        return 0;
+    uint64_t *t = phys_to_virt(pa);
+    for (uint32_t i = 0; i < ENTRIES; i++)
+        t[i] = 0;
+    return t;
+}
+
+mmu_uspace_t *mmu_user_create(void)
+{
+    if (!mmu_enabled())
+        return 0;
+    uint64_t *l1 = zeroed_table();
+    if (!l1)
+        return 0;
+    const uint64_t *kl1 = (const uint64_t *)(uintptr_t)mmu_boot_regs[2];
+    for (uint32_t i = 0; i < USER_L1_FIRST; i++)
+        l1[i] = kl1[i];
+    __asm__ volatile("dsb ishst" ::: "memory");
+
+    mmu_uspace_t *as = 0;
+    uint64_t flags = spin_lock_irqsave(&s_space_lock);
+    for (uint32_t i = 1; i < ASID_COUNT && !as; i++)
+        if (!s_spaces[i].l1) {
+            as = &s_spaces[i];
+            as->l1 = l1;
+        }
+    spin_unlock_irqrestore(&s_space_lock, flags);
+    if (!as)
+        pmm_free_page(virt_to_phys(l1));
+    return as;
+}
+
+void mmu_user_destroy(mmu_uspace_t *as)
+{
+    for (uint32_t i = USER_L1_FIRST; i < ENTRIES; i++) {
+        if (!(as->l1[i] & DESC_BLOCK))
+            continue;
+        uint64_t *l2 = table_at(as->l1[i]);
+        for (uint32_t j = 0; j < ENTRIES; j++)
+            if (l2[j] & DESC_BLOCK)
+                pmm_free_page(l2[j] & DESC_ADDR_MASK);
+        pmm_free_page(virt_to_phys(l2));
+    }
+    pmm_free_page(virt_to_phys(as->l1));
+
+    /* The ASID's TLB entries go before anyone can reuse it */
+    uint64_t asid = (uint64_t)space_asid(as) << 48;
+    __asm__ volatile("dsb ishst\n\t"
+                     "tlbi aside1is, %0\n\t"
+                     "dsb ish\n\t"
+                     "isb" :: "r"(asid) : "memory");
+    uint64_t flags = spin_lock_irqsave(&s_space_lock);
+    as->l1 = 0;
+    spin_unlock_irqrestore(&s_space_lock, flags);
+}
+
+/* Level-3 entry for va, creating tables on the way if `create`; 0 if one
+ * is missing or out of memory */
+static uint64_t *user_pte(mmu_uspace_t *as, uint64_t va, int create)
+{
+    uint64_t *t = as->l1;
+    for (int level = 1; level < 3; level++) {
+        uint64_t *d = &t[(va >> (39 - 9 * level)) & (ENTRIES - 1)];
+        if (!(*d & DESC_BLOCK)) {
+            uint64_t *next = create ? zeroed_table() : 0;
+            if (!next)
+                return 0;
+            __asm__ volatile("dsb ishst" ::: "memory");
+            *d = virt_to_phys(next) | DESC_TABLE;
+        }
+        t = table_at(*d);
+    }
+    return &t[(va >> 12) & (ENTRIES - 1)];
+}
+
+static void tlb_flush_va(uint64_t op)
+{
+    __asm__ volatile("dsb ishst\n\t"
+                     "tlbi vae1is, %0\n\t"
+                     "dsb ish\n\t"
+                     "isb" :: "r"(op) : "memory");
+}
+
+int mmu_user_map(mmu_uspace_t *as, uint64_t va, uint64_t pa,
+                 int write, int exec)
+{
+    if (va < MMU_USER_BASE || va >= MMU_USER_END || (va & 0xFFF))
+        return -1;
+    uint64_t *pte = user_pte(as, va, 1);
+    if (!pte)
+        return -1;
+
+    /* Code was just written through the D-side: push it out and drop
+     * stale instructions before the page can be fetched from */
+    if (exec) {
+        dcache_clean_range(phys_to_virt(pa), PAGE_SIZE);
+        __asm__ volatile("ic ialluis\n\tdsb ish" ::: "memory");
+    }
+    uint64_t op = (va >> 12) | ((uint64_t)space_asid(as) << 48);
+    /* Break before make: a live entry goes, TLBs included, before the
+     * new one is written (fault-in remaps copy-on-write pages) */
+    if (*pte & DESC_BLOCK) {
+        *pte = 0;
+        tlb_flush_va(op);
+    }
+    *pte = (pa & DESC_ADDR_MASK) | DESC_TABLE | DESC_USER |
+           (write ? 0 : DESC_AP_RO) | (exec ? 0 : DESC_UXN);
+    tlb_flush_va(op);
+    return 0;
+}
+
+uint64_t mmu_user_lookup(mmu_uspace_t *as, uint64_t va, int write)
+{
+    if (va < MMU_USER_BASE || va >= MMU_USER_END)
+        return 0;
+    uint64_t *pte = user_pte(as, va, 0);
+    if (!pte || !(*pte & DESC_BLOCK) || (write && (*pte & DESC_AP_RO)))
+        return 0;
+    return *pte & DESC_ADDR_MASK;
+}
+
+void mmu_user_activate(mmu_uspace_t *as)
+{
+    uint64_t ttbr = as ? virt_to_phys(as->l1) |
+                         ((uint64_t)space_asid(as) << 48)
+                       : mmu_boot_regs[2];
+    __asm__ volatile("msr ttbr0_el1, %0\n\tisb" :: "r"(ttbr) : "memory");
+}
+
+/* ── Data-cache maintenance ───────────────────────────────────────────── */
+
+uint32_t dcache_line_size(void)
+{
+    uint64_t ctr;
+    __asm__ volatile("mrs %0, ctr_el0" : "=r"(ctr));
+    return 4u << ((ctr >> 16) & 0xF);   /* DminLine: log2 of words */
+}
+
+#define DC_RANGE(op, p, len)                                              \
+    do {                                                                  \
+        uint64_t line_ = dcache_line_size();                              \
+        uint64_t a_ = (uint64_t)(uintptr_t)(p) & ~(line_ - 1);            \
+        uint64_t end_ = (uint64_t)(uintptr_t)(p) + (len);                 \
+        for (; a_ < end_; a_ += line_)                                    \
+            __asm__ volatile("dc " op ", %0" :: "r"(a_) : "memory");      \
+        __asm__ volatile("dsb sy" ::: "memory");                          \
+    } while (0)
+
+void dcache_clean_range(const void *p, size_t len)
+{
+    DC_RANGE("cvac", p, len);
+}
+
+void dcache_flush_range(const void *p, size_t len)
+{
+    DC_RANGE("civac", p, len);
+}
+
+void dcache_invalidate_range(void *p, size_t len)
+{
+    uint64_t line  = dcache_line_size();
+    uint64_t start = (uint64_t)(uintptr_t)p;
+    uint64_t end   = start + len;
+
+    if (len == 0)
+        return;
+    if (start & (line - 1)) {
+        DC_RANGE("civac", (void *)(uintptr_t)start, 1);
+        start = (start | (line - 1)) + 1;
+    }
+    if ((end & (line - 1)) && end > start) {
+        DC_RANGE("civac", (void *)(uintptr_t)(end - 1), 1);
+        end &= ~(line - 1);
+    }
+    if (end > start)
+        DC_RANGE("ivac", (void *)(uintptr_t)start, end - start);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "dtb.h"
+
+/* AArch64 MMU bring-up and data-cache maintenance.
+ *
+ * mmu_init() runs on the boot CPU before kmain(), with the MMU still off.
+ * It builds one identity map shared by every CPU (4 KB granule, 39-bit
+ * VA):
+ *   - RAM from the DTB /memory node is Normal memory, inner-shareable
+ *     and write-back cacheable.
+ *   - Everything else, including the UART and GIC, is Device-nGnRE and
+ *     never executable.
+ * It then leaves MAIR/TCR/TTBR0/SCTLR values in mmu_boot_regs, for the
+ * mmu_on macro in entry.S to load on each CPU.  Without a usable
+ * memory map it returns -1, and all CPUs run with the MMU off as
+ * before.
+ *
+ * User address spaces (hal_uspace_*) live in the upper half of the
+ * level-1 table, [MMU_USER_BASE, MMU_USER_END), each with its own ASID;
+ * up to 255 exist at once.  mmu_user_create() returns 0 with the MMU
+ * off, out of memory or out of ASIDs.  mmu_user_map() takes one 4 KB
+ * frame (an executable one must already hold its code), breaking any
+ * entry there before making the new one; -1 outside the range or out
+ * of memory; lookup() returns the frame, 0 if none or it
+ * is read-only and `write`.  activate(0) goes back to the kernel map.
+ *
+ * Cache maintenance works by virtual address, to the point of
+ * coherency.  It serves DMA and anything shared with a CPU or device
+ * that does not snoop the caches. */
+
+int  mmu_init(const dtb_result_t *dtb);
+int  mmu_enabled(void);
+
+#define MMU_USER_BASE  (256ULL << 30)
+#define MMU_USER_END   (512ULL << 30)
+
+typedef struct mmu_uspace mmu_uspace_t;
+
+mmu_uspace_t *mmu_user_create(void);
+void          mmu_user_destroy(mmu_uspace_t *as);
+int           mmu_user_map(mmu_uspace_t *as, uint64_t va, uint64_t pa,
+                           int write, int exec);
+uint64_t      mmu_user_lookup(mmu_uspace_t *as, uint64_t va, int write);
+void          mmu_user_activate(mmu_uspace_t *as);
+
+uint32_t dcache_line_size(void);
+/* Write dirty lines back (CPU writes -> device) */
+void dcache_clean_range(const void *p, size_t len);
+/* Discard lines (device writes -> CPU).  Partial lines at either end are
+ * cleaned first, so neighbouring data is never lost. */
+void dcache_invalidate_range(void *p, size_t len);
+/* Write back and discard */
+void dcache_flush_range(const void *p, size_t len);
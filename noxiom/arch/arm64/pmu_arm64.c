@@ -0,0 +1,217 @@
+/* arch/arm64/pmu_arm64.c — PMUv3 event counters
+ *
+ * PMCR_EL0.N gives the number of event counters; counter n is selected
+ * through PMSELR_EL0, its event set in PMXEVTYPER_EL0 (filter bits 0:
+ * count at EL0 and EL1) and its value in PMXEVCNTR_EL0.
+ * PMCNTENSET/CLR_EL0 start and stop counters, PMINTENSET/CLR_EL1
+ * choose which ones interrupt on overflow, PMOVSCLR_EL0 reports and
+ * clears overflows.  PMCEID0_EL0 says which common events (0x00-0x1F)
+ * are implemented.
+ *
+ * The counters are 32 bits wide.  While counting, each overflow adds
+ * 2^32 to a per-CPU high word if the DTB gave an overflow interrupt;
+ * without one, only a single wrap is accounted for (the overflow flag).
+ * Sampling runs on counter 0, preloaded with 2^32 - period.
+ *
+ * PMCR_EL0.E also gates PMCCNTR_EL0, which hal_cycles() reads, so it is
+ * set here and never cleared.
+ */
+#include "pmu_arm64.h"
+#include "gic.h"
+
+#define PMCR_E          (1u << 0)
+#define PMCR_N(pmcr)    (((pmcr) >> 11) & 0x1F)
+#define COUNTER_MASK    0x7FFFFFFFu     /* event counters; bit 31 = PMCCNTR */
+
+/* Common event number of each HAL_PMU_* (also its PMCEID0_EL0 bit) */
+static const uint8_t pmu_events[HAL_PMU_EVENTS] = {
+    [HAL_PMU_CYCLES]        = 0x11,     /* CPU_CYCLES                     */
+    [HAL_PMU_INSTRUCTIONS]  = 0x08,     /* INST_RETIRED                   */
+    [HAL_PMU_CACHE_MISSES]  = 0x17,     /* L2D_CACHE_REFILL               */
+    [HAL_PMU_BRANCH_MISSES] = 0x10,     /* BR_MIS_PRED                    */
+};
+
+static uint32_t s_counters;
+static uint32_t s_ceid0;
+static int      s_irq = -1;         /* overflow PPI, -1 = none        */
+
+static hal_pmu_sample_fn_t s_sample_fn;
+static uint64_t            s_sample_period;
+
+/* Per CPU: counters in use, sampling or not, wraps seen per counter */
+static uint32_t s_active[HAL_MAX_CPUS];
+static uint8_t  s_sampling[HAL_MAX_CPUS];
+static uint64_t s_high[HAL_MAX_CPUS][HAL_PMU_EVENTS];
+
+void pmu_arm64_init(uint32_t irq)
+{
+    uint64_t dfr0, pmcr, ceid0;
+    __asm__ volatile("mrs %0, id_aa64dfr0_el1" : "=r"(dfr0));
+    uint32_t ver = (uint32_t)(dfr0 >> 8) & 0xF;
+    if (ver == 0 || ver == 0xF)
+        return;                         /* no PMUv3 */
+
+    __asm__ volatile("mrs %0, pmcr_el0\n\t"
+                     "mrs %1, pmceid0_el0" : "=r"(pmcr), "=r"(ceid0));
+    s_counters = PMCR_N(pmcr);
+    s_ceid0    = (uint32_t)ceid0;
+    s_irq      = irq ? (int)irq : -1;
+}
+
+uint32_t pmu_arm64_counters(void)
+{
+    return s_counters;
+}
+
+int pmu_arm64_irq_id(void)
+{
+    return s_irq;
+}
+
+/* The GIC is brought up after hal_hw_detect(), so ask at use */
+static int irq_usable(void)
+{
+    return s_irq >= 0 && gic_present();
+}
+
+int pmu_arm64_has_event(uint32_t event)
+{
+    if (event >= HAL_PMU_EVENTS || s_counters == 0)
+        return 0;
+    return (s_ceid0 >> pmu_events[event]) & 1;
+}
+
+static void select_counter(uint32_t i)
+{
+    __asm__ volatile("msr pmselr_el0, %0\n\tisb" :: "r"((uint64_t)i));
+}
+
+static void write_counter(uint32_t i, uint32_t value)
+{
+    select_counter(i);
+    __asm__ volatile("msr pmxevcntr_el0, %0" :: "r"((uint64_t)value));
+}
+
+static uint32_t read_counter(uint32_t i)
+{
+    uint64_t v;
+    select_counter(i);
+    __asm__ volatile("mrs %0, pmxevcntr_el0" : "=r"(v));
+    return (uint32_t)v;
+}
+
+static void program(uint32_t i, uint32_t event, uint32_t value)
+{
+    select_counter(i);
+    __asm__ volatile("msr pmxevtyper_el0, %0\n\t"
+                     "msr pmxevcntr_el0, %1"
+                     :: "r"((uint64_t)pmu_events[event]),
+                        "r"((uint64_t)value));
+}
+
+/* Enable counters `mask`, interrupting on their overflow if we can */
+static void start(uint32_t mask)
+{
+    uint32_t cpu = hal_cpu_id();
+    uint64_t pmcr;
+    __asm__ volatile("mrs %0, pmcr_el0" : "=r"(pmcr));
+    __asm__ volatile("msr pmovsclr_el0, %0\n\t"
+                     "msr pmcr_el0, %1" :: "r"((uint64_t)mask),
+                                         "r"(pmcr | PMCR_E));
+    if (irq_usable()) {
+        __asm__ volatile("msr pmintenset_el1, %0" :: "r"((uint64_t)mask));
+        gic_enable_irq((uint32_t)s_irq); /* banked: this CPU only */
+    }
+    __asm__ volatile("msr pmcntenset_el0, %0\n\tisb"
+                     :: "r"((uint64_t)mask) : "memory");
+    s_active[cpu] = mask;
+}
+
+void pmu_arm64_stop(void)
+{
+    if (s_counters == 0)
+        return;
+    uint64_t flags = hal_irq_save();
+    uint32_t cpu   = hal_cpu_id();
+    __asm__ volatile("msr pmcntenclr_el0, %0\n\t"
+                     "msr pmintenclr_el1, %0\n\t"
+                     "msr pmovsclr_el0, %0\n\t"
+                     "isb" :: "r"((uint64_t)COUNTER_MASK) : "memory");
+    s_active[cpu]   = 0;
+    s_sampling[cpu] = 0;
+    hal_irq_restore(flags);
+}
+
+int pmu_arm64_count_start(const uint32_t *events, uint32_t n)
+{
+    if (n > s_counters || n > HAL_PMU_EVENTS)
+        return -1;
+    for (uint32_t i = 0; i < n; i++)
+        if (!pmu_arm64_has_event(events[i]))
+            return -1;
+
+    pmu_arm64_stop();
+    uint64_t flags = hal_irq_save();
+    uint32_t cpu   = hal_cpu_id();
+    for (uint32_t i = 0; i < n; i++) {
+        program(i, events[i], 0);
+        s_high[cpu][i] = 0;
+    }
+    start((1u << n) - 1);
+    hal_irq_restore(flags);
+    return 0;
+}
+
+void pmu_arm64_count_read(uint64_t *counts, uint32_t n)
+{
+    uint64_t flags = hal_irq_save();
+    uint32_t cpu   = hal_cpu_id();
+    uint64_t ovs;
+    __asm__ volatile("mrs %0, pmovsclr_el0" : "=r"(ovs));
+    for (uint32_t i = 0; i < n && i < s_counters && i < HAL_PMU_EVENTS; i++) {
+        counts[i] = s_high[cpu][i] + read_counter(i);
+        /* A wrap the interrupt has not been taken for yet */
+        if (ovs & (1u << i))
+            counts[i] += 1ULL << 32;
+    }
+    hal_irq_restore(flags);
+}
+
+int pmu_arm64_sample_start(uint32_t event, uint64_t period,
+                           hal_pmu_sample_fn_t fn)
+{
+    if (!pmu_arm64_has_event(event) || !irq_usable() ||
+        period == 0 || period >= (1ULL << 31))
+        return -1;
+
+    pmu_arm64_stop();
+    uint64_t flags = hal_irq_save();
+    s_sample_fn     = fn;
+    s_sample_period = period;
+    s_sampling[hal_cpu_id()] = 1;
+    program(0, event, (uint32_t)-period);
+    start(1);
+    hal_irq_restore(flags);
+    return 0;
+}
+
+void pmu_arm64_irq(uint64_t elr)
+{
+    uint32_t cpu = hal_cpu_id();
+    uint64_t ovs;
+    __asm__ volatile("mrs %0, pmovsclr_el0" : "=r"(ovs));
+    ovs &= s_active[cpu];
+    __asm__ volatile("msr pmovsclr_el0, %0\n\tisb" :: "r"(ovs));
+
+    if (s_sampling[cpu]) {
+        if (ovs & 1) {
+            if (s_sample_fn)
+                s_sample_fn(elr);
+            write_counter(0, (uint32_t)-s_sample_period);
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < HAL_PMU_EVENTS; i++)
+        if (ovs & (1u << i))
+            s_high[cpu][i] += 1ULL << 32;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+#include "hal.h"
+
+/* PMUv3 event counters — the AArch64 side of hal_pmu_*().
+ *
+ * pmu_arm64_init() checks ID_AA64DFR0_EL1 and PMCEID0_EL0 once on the
+ * boot CPU and is given the overflow interrupt (a PPI) from the DTB;
+ * everything else programs the calling CPU.
+ */
+
+void     pmu_arm64_init(uint32_t irq);
+uint32_t pmu_arm64_counters(void);
+int      pmu_arm64_has_event(uint32_t event);
+int      pmu_arm64_count_start(const uint32_t *events, uint32_t n);
+void     pmu_arm64_count_read(uint64_t *counts, uint32_t n);
+int      pmu_arm64_sample_start(uint32_t event, uint64_t period,
+                                hal_pmu_sample_fn_t fn);
+void     pmu_arm64_stop(void);
+
+/* The overflow PPI, -1 if none; arm64_irq_handler() routes it to
+ * pmu_arm64_irq() with the interrupted ELR_EL1 */
+int      pmu_arm64_irq_id(void);
+void     pmu_arm64_irq(uint64_t elr);
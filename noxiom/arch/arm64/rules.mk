@@ -10,36 +10,120 @@ CC      := aarch64-linux-gnu-gcc
 AS      := aarch64-linux-gnu-as
 LD      := aarch64-linux-gnu-ld
 OBJCOPY := aarch64-linux-gnu-objcopy
+NM      := aarch64-linux-gnu-nm
+LZ4     := lz4
+
+# 1 = kernel8.img is boot/lz4_stub.S plus the LZ4-compressed kernel,
+# unpacked at boot (needs the lz4 tool; run make clean after changing it)
+KERNEL_LZ4 ?= 0
+
+# 1 = run every benchmark (bench/bench.h) before the shell starts and
+# print the results to serial as CSV, for CI runs under QEMU (run make
+# clean after changing it)
+BENCH_AT_BOOT ?= 0
 
 BUILD   := build/arm64
 
 CFLAGS  := -std=c11 -ffreestanding -fno-pie -fno-pic \
            -fno-stack-protector -march=armv8-a -O2    \
+           -mgeneral-regs-only                         \
            -Wall -Wextra                               \
            -Ikernel/src -Iarch/arm64
 
+ifeq ($(BENCH_AT_BOOT),1)
+CFLAGS  += -DBENCH_AT_BOOT
+endif
+
 ASFLAGS := -march=armv8-a
 
 # ── Sources ─────────────────────────────────────────────────────────────────
 KERNEL_SRCS := \
     kernel/src/main.c          \
     kernel/src/hal_hw_detect.c \
+    kernel/src/hal_irq.c       \
     kernel/src/string.c        \
+    kernel/src/mm/pmm.c        \
+    kernel/src/mm/kmalloc.c    \
+    kernel/src/mm/arena.c      \
+    kernel/src/smp/smp.c       \
+    kernel/src/smp/percpu.c    \
+    kernel/src/sync/rcu.c      \
+    kernel/src/sched/sched.c   \
+    kernel/src/sched/rr.c      \
+    kernel/src/sched/fair.c    \
+    kernel/src/sched/fpu.c     \
+    kernel/src/time/timer.c    \
+    kernel/src/time/bootstats.c\
+    kernel/src/log/klog.c      \
+    kernel/src/prof/ksyms.c    \
+    kernel/src/prof/perf.c     \
+    kernel/src/prof/perf_cmd.c \
+    kernel/src/pci/pci.c       \
+    kernel/src/pci/pci_cmd.c   \
+    kernel/src/virtio/virtio.c \
+    kernel/src/virtio/virtqueue.c\
+    kernel/src/virtio/virtio_pci.c\
+    kernel/src/virtio/virtio_mmio.c\
+    kernel/src/net/netbuf.c    \
+    kernel/src/net/netdev.c    \
+    kernel/src/net/virtio_net.c\
+    kernel/src/net/inet.c      \
+    kernel/src/net/netcore.c   \
+    kernel/src/net/iface.c     \
+    kernel/src/net/eth.c       \
+    kernel/src/net/neigh.c     \
+    kernel/src/net/ipv4.c      \
+    kernel/src/net/ipv6.c      \
+    kernel/src/net/icmp.c      \
+    kernel/src/net/udp.c       \
+    kernel/src/net/tcp.c       \
+    kernel/src/net/tcp_input.c \
+    kernel/src/net/tcp_output.c\
+    kernel/src/net/net_cmd.c   \
+    kernel/src/blk/blkdev.c    \
+    kernel/src/blk/virtio_blk.c\
+    kernel/src/blk/ahci.c      \
+    kernel/src/blk/sdhci.c     \
+    kernel/src/blk/blk_cmd.c   \
+    kernel/src/fs/pcache.c     \
+    kernel/src/fs/vfs.c        \
+    kernel/src/fs/fat32.c      \
+    kernel/src/fs/ext2.c       \
+    kernel/src/fs/fs_cmd.c     \
+    kernel/src/user/user.c     \
+    kernel/src/user/vm.c       \
+    kernel/src/user/elf.c      \
+    kernel/src/user/syscall.c  \
+    kernel/src/user/user_cmd.c \
+    kernel/src/bench/bench.c   \
+    kernel/src/bench/benchmarks.c\
+    kernel/src/bench/bench_cmd.c\
     kernel/src/shell/shell.c
 
 ARCH_SRCS := \
     arch/arm64/hal_impl.c      \
     arch/arm64/uart_pl011.c    \
     arch/arm64/gic.c           \
+    arch/arm64/gic_v2.c        \
+    arch/arm64/gic_v3.c        \
     arch/arm64/dtb.c           \
-    arch/arm64/midr.c
+    arch/arm64/midr.c          \
+    arch/arm64/dispatch_arm64.c\
+    arch/arm64/topo_arm64.c    \
+    arch/arm64/smp_arm64.c     \
+    arch/arm64/mmu.c           \
+    arch/arm64/pmu_arm64.c     \
+    arch/arm64/bench_arm64.c   \
+    arch/arm64/user_arm64.c
 
 C_SRCS := $(KERNEL_SRCS) $(ARCH_SRCS)
 C_OBJS := $(patsubst %.c, $(BUILD)/%.o, $(C_SRCS))
 
 S_SRCS := \
     arch/arm64/boot/entry.S    \
-    arch/arm64/exceptions.S
+    arch/arm64/exceptions.S    \
+    arch/arm64/string.S        \
+    arch/arm64/fpu.S
 
 S_OBJS := $(patsubst %.S, $(BUILD)/%.o, $(S_SRCS))
 
@@ -48,6 +132,7 @@ OBJS := $(BUILD)/arch/arm64/boot/entry.o \
         $(filter-out $(BUILD)/arch/arm64/boot/entry.o, $(S_OBJS) $(C_OBJS))
 
 KERNEL_ELF := $(BUILD)/kernel.elf
+KERNEL_BIN := $(BUILD)/kernel.bin
 KERNEL_IMG := $(BUILD)/kernel8.img
 
 .PHONY: all run clean
@@ -55,12 +140,60 @@ KERNEL_IMG := $(BUILD)/kernel8.img
 all: $(KERNEL_IMG)
 
 # ── Final binary: strip ELF → raw binary ────────────────────────────────────
-$(KERNEL_IMG): $(KERNEL_ELF)
+$(KERNEL_BIN): $(KERNEL_ELF)
+	$(OBJCOPY) -O binary $< $@
+
+ifeq ($(KERNEL_LZ4),1)
+# ── Compressed image: unpacking stub + LZ4 payload, linked at 0x80000 ───────
+$(BUILD)/kernel.lz4: $(KERNEL_BIN)
+	$(LZ4) -l -9 -f -q $< $@
+
+$(BUILD)/lz4_stub.o: arch/arm64/boot/lz4_stub.S arch/arm64/boot/boot_macros.h \
+                     $(BUILD)/kernel.lz4
+	$(CC) $(CFLAGS) -x assembler-with-cpp -c $< -o $@ \
+	    -DKERNEL_LOAD=0x$$($(NM) $(KERNEL_ELF) | awk '$$3 == "_start" { print $$1 }') \
+	    -DMEM_END=0x$$($(NM) $(KERNEL_ELF) | awk '$$3 == "__kernel_end" { print $$1 }') \
+	    -DIMAGE_SIZE=$$(stat -c %s $(KERNEL_BIN)) \
+	    '-DPAYLOAD="$(BUILD)/kernel.lz4"'
+
+$(BUILD)/lz4_stub.elf: $(BUILD)/lz4_stub.o
+	$(LD) -Ttext=0x80000 -e _stub_start -o $@ $<
+
+$(KERNEL_IMG): $(BUILD)/lz4_stub.elf
 	$(OBJCOPY) -O binary $< $@
+else
+$(KERNEL_IMG): $(KERNEL_BIN)
+	cp $< $@
+endif
+
+# ── Kernel symbol table (prof/ksyms.h) ──────────────────────────────────────
+# $(call gen_ksyms,<nm output command>,<out.c>): the .text symbols, sorted
+# by address, as ksym_table.  The kernel is linked once with an empty
+# table (ksyms0.o), then again with the real one last; since it holds no
+# code nothing in .text moves, which the second pass checks.
+KSYMS_AWK := '$$2 ~ /^[tTW]$$/ && $$3 !~ /^\$$/ { printf "    { 0x%s, \"%s\" },\n", $$1, $$3 }'
+
+define gen_ksyms
+{ echo '#include "prof/ksyms.h"';                             \
+  echo 'const ksym_t ksym_table[] = {';                       \
+  $(1) | awk $(KSYMS_AWK);                                    \
+  echo '    { ~0ULL, "" }';                                   \
+  echo '};'; } > $(2)
+endef
+
+$(BUILD)/ksyms0.o: | $(BUILD)
+	$(call gen_ksyms,true,$(BUILD)/ksyms0.c)
+	$(CC) $(CFLAGS) -c $(BUILD)/ksyms0.c -o $@
 
 # ── Link ────────────────────────────────────────────────────────────────────
-$(KERNEL_ELF): $(OBJS)
-	$(LD) -T arch/arm64/linker.ld -o $@ $^
+$(KERNEL_ELF): $(OBJS) $(BUILD)/ksyms0.o
+	$(LD) -T arch/arm64/linker.ld -o $(BUILD)/kernel.1.elf $^
+	$(call gen_ksyms,$(NM) -n $(BUILD)/kernel.1.elf,$(BUILD)/ksyms.c)
+	$(CC) $(CFLAGS) -c $(BUILD)/ksyms.c -o $(BUILD)/ksyms.o
+	$(LD) -T arch/arm64/linker.ld -o $@ $(OBJS) $(BUILD)/ksyms.o
+	$(call gen_ksyms,$(NM) -n $@,$(BUILD)/ksyms.check.c)
+	cmp -s $(BUILD)/ksyms.c $(BUILD)/ksyms.check.c || \
+	    { rm -f $@; echo "ksyms: .text moved in the second link" >&2; exit 1; }
 
 # ── Compile C ───────────────────────────────────────────────────────────────
 $(BUILD)/%.o: %.c | $(BUILD)
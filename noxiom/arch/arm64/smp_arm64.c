@@ -0,0 +1,163 @@
+/* arch/arm64/smp_arm64.c — secondary CPU start-up
+ *
+ * Two enable methods are defined by the Linux arm64 boot protocol and
+ * used by Raspberry Pi firmware and QEMU:
+ *   spin-table — the CPU sits in a firmware WFE loop polling a 64-bit
+ *                release address; write the entry point there and SEV
+ *   psci       — ask firmware through SMC/HVC: CPU_ON(mpidr, entry, ctx)
+ * Either way the CPU arrives at secondary_entry (boot/entry.S) at EL2 or
+ * EL1 with the MMU off, and picks up ap_boot_slot.  CPUs are started one
+ * at a time so the single slot is never shared.
+ */
+#include "smp_arm64.h"
+#include "mmu.h"
+#include "gic.h"
+#include "user_arm64.h"
+#include "fpu_arm64.h"
+#include "mm/pmm.h"
+#include "smp/percpu.h"
+#include <stdint.h>
+
+#define MPIDR_AFF_MASK  0xFF00FFFFFFULL     /* Aff3 | Aff2 | Aff1 | Aff0 */
+#define AP_TIMEOUT_MS   100
+
+/* boot/entry.S */
+extern char secondary_entry[];
+extern volatile uint64_t ap_boot_slot[3];   /* stack, percpu, entry */
+
+static const dtb_cpu_t *cpu_desc[HAL_MAX_CPUS];
+static uint32_t cpu_count = 1;
+static uint32_t psci_method;
+static uint32_t psci_cpu_on;
+
+static volatile uint32_t ap_alive;
+static hal_cpu_entry_t   ap_kernel_entry;
+
+uint32_t smp_arm64_init(const dtb_result_t *dtb)
+{
+    uint64_t self;
+    __asm__ volatile("mrs %0, mpidr_el1" : "=r"(self));
+    self &= MPIDR_AFF_MASK;
+
+    uint32_t n = dtb->cpu_count < DTB_MAX_CPUS ? dtb->cpu_count : DTB_MAX_CPUS;
+
+    cpu_desc[0] = 0;
+    cpu_count = 1;
+    for (uint32_t i = 0; i < n; i++) {
+        const dtb_cpu_t *c = &dtb->cpus[i];
+        if ((c->mpidr & MPIDR_AFF_MASK) == self) {
+            cpu_desc[0] = c;
+            continue;
+        }
+        if (cpu_count < HAL_MAX_CPUS)
+            cpu_desc[cpu_count++] = c;
+    }
+
+    psci_method = dtb->psci_method;
+    psci_cpu_on = dtb->psci_cpu_on;
+    if (!cpu_desc[0]) {
+        cpu_count = 1;                  /* cannot tell ourselves apart */
+        return 0;
+    }
+    return cpu_count;
+}
+
+const dtb_cpu_t *smp_arm64_cpu(uint32_t cpu)
+{
+    return cpu < cpu_count ? cpu_desc[cpu] : 0;
+}
+
+/* ── AP side: first C code, running on the AP's own stack ────────────── */
+
+static void ap_main(uint32_t cpu)
+{
+    gic_init_cpu(cpu);
+    user_arm64_cpu_init(cpu);
+    fpu_arm64_off();
+
+    hal_cpu_entry_t entry = ap_kernel_entry;
+    __atomic_store_n(&ap_alive, 1, __ATOMIC_RELEASE);
+
+    entry(cpu);
+    hal_halt();
+}
+
+/* ── BSP side ────────────────────────────────────────────────────────── */
+
+/* Write a line back to the point of coherency so a CPU running with its
+ * caches off (before its mmu_on) sees it. */
+static void clean_dcache_line(volatile void *p)
+{
+    dcache_flush_range((const void *)p, 1);
+}
+
+static int64_t psci_call(uint64_t fn, uint64_t a1, uint64_t a2, uint64_t a3)
+{
+    register uint64_t x0 __asm__("x0") = fn;
+    register uint64_t x1 __asm__("x1") = a1;
+    register uint64_t x2 __asm__("x2") = a2;
+    register uint64_t x3 __asm__("x3") = a3;
+
+    if (psci_method == DTB_PSCI_HVC)
+        __asm__ volatile("hvc #0"
+                         : "+r"(x0), "+r"(x1), "+r"(x2), "+r"(x3) :
+                         : "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11",
+                           "x12", "x13", "x14", "x15", "x16", "x17", "memory");
+    else
+        __asm__ volatile("smc #0"
+                         : "+r"(x0), "+r"(x1), "+r"(x2), "+r"(x3) :
+                         : "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11",
+                           "x12", "x13", "x14", "x15", "x16", "x17", "memory");
+    return (int64_t)x0;
+}
+
+static int release_cpu(const dtb_cpu_t *c, uint64_t entry_pa)
+{
+    if (c->enable_method == DTB_CPU_ENABLE_PSCI && psci_method != DTB_PSCI_NONE)
+        return psci_call(psci_cpu_on, c->mpidr, entry_pa, 0) == 0 ? 0 : -1;
+
+    if (c->enable_method == DTB_CPU_ENABLE_SPIN_TABLE && c->release_addr) {
+        volatile uint64_t *rel = phys_to_virt(c->release_addr);
+        *rel = entry_pa;
+        clean_dcache_line(rel);
+        __asm__ volatile("sev");
+        return 0;
+    }
+    return -1;
+}
+
+static int wait_alive(uint32_t ms)
+{
+    uint64_t freq, start, now;
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    __asm__ volatile("isb; mrs %0, cntpct_el0" : "=r"(start));
+
+    uint64_t ticks = freq / 1000 * ms;
+    do {
+        if (__atomic_load_n(&ap_alive, __ATOMIC_ACQUIRE))
+            return 1;
+        __asm__ volatile("isb; mrs %0, cntpct_el0" : "=r"(now));
+    } while (now - start < ticks);
+
+    return __atomic_load_n(&ap_alive, __ATOMIC_ACQUIRE);
+}
+
+int smp_arm64_start_cpu(uint32_t cpu, void *stack_top, hal_cpu_entry_t entry)
+{
+    if (cpu == 0 || cpu >= cpu_count || !cpu_desc[cpu])
+        return -1;
+
+    ap_boot_slot[0] = (uint64_t)(uintptr_t)stack_top;
+    ap_boot_slot[1] = (uint64_t)(uintptr_t)percpu_area(cpu);
+    ap_boot_slot[2] = (uint64_t)(uintptr_t)ap_main;
+    clean_dcache_line(ap_boot_slot);
+
+    ap_kernel_entry = entry;
+    ap_alive = 0;
+    clean_dcache_line(&ap_alive);
+
+    if (release_cpu(cpu_desc[cpu], virt_to_phys(secondary_entry)) != 0)
+        return -1;
+
+    return wait_alive(AP_TIMEOUT_MS) ? 0 : -1;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+#include "hal.h"
+#include "dtb.h"
+
+/* AArch64 multiprocessor start-up.
+ *
+ * smp_arm64_init() builds the CPU table from the DTB /cpus node — index 0
+ * is always the CPU we booted on, found by its MPIDR_EL1 — and returns
+ * the number of entries.  It returns 0, and leaves only the boot CPU in
+ * the table, when that CPU is not in the DTB.  Each secondary is
+ * started by the method its DTB node names: PSCI CPU_ON or a spin-table
+ * release address.
+ */
+
+uint32_t smp_arm64_init(const dtb_result_t *dtb);
+/* The DTB entry of CPU index `cpu`, 0 past the table */
+const dtb_cpu_t *smp_arm64_cpu(uint32_t cpu);
+int      smp_arm64_start_cpu(uint32_t cpu, void *stack_top,
+                             hal_cpu_entry_t entry);
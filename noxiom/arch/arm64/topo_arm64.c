@@ -0,0 +1,183 @@
+/* arch/arm64/topo_arm64.c — caches and CPU topology
+ *
+ * Caches: CLIDR_EL1 gives the cache type at each level seen by the
+ * calling CPU; CSSELR_EL1 selects one and CCSIDR_EL1 then gives its line
+ * size, ways and sets (in the 64-bit layout when ID_AA64MMFR2_EL1.CCIDX
+ * is set).  None of it says which CPUs share a cache.
+ *
+ * Topology, from the DTB:
+ *   /cpus/cpu-map        socketN / clusterN / coreN / threadN nodes whose
+ *                        "cpu" phandle names a cpu node; every cluster
+ *                        with cores of its own is a package
+ *   next-level-cache     the chain of cache nodes from each cpu node;
+ *                        CPUs whose chains end at the same node share the
+ *                        last level, else it goes by cluster
+ *   capacity-dmips-mhz   relative performance per MHz, scaled so the
+ *                        fastest core is HW_CAPACITY_MAX (clock speeds
+ *                        are not in the DTB and are taken as equal)
+ * A DTB with none of these (QEMU virt) leaves every CPU at 0 and
+ * hal_hw_topo_fixup() makes the machine flat.
+ */
+#include "topo_arm64.h"
+#include "smp_arm64.h"
+#include "dtb.h"
+#include "string.h"
+
+/* CLIDR_EL1.Ctype<n> */
+enum { CTYPE_NONE, CTYPE_INST, CTYPE_DATA, CTYPE_SPLIT, CTYPE_UNIFIED };
+
+#define LLC_NODE      0x8000u       /* raw llc id: a DTB cache node      */
+
+/* ── Caches ──────────────────────────────────────────────────────────── */
+
+static void add_cache(hw_info_t *info, uint32_t level, uint32_t type,
+                      int ccidx)
+{
+    if (info->cache_count >= HW_MAX_CACHES)
+        return;
+
+    uint64_t sel = (uint64_t)(level - 1) << 1 | (type == CACHE_INST);
+    uint64_t r;
+    __asm__ volatile("msr csselr_el1, %1\n\t"
+                     "isb\n\t"
+                     "mrs %0, ccsidr_el1" : "=r"(r) : "r"(sel));
+
+    uint32_t line = 16u << (r & 7);
+    uint32_t ways, sets;
+    if (ccidx) {
+        ways = (uint32_t)((r >> 3) & 0x1FFFFF) + 1;
+        sets = (uint32_t)((r >> 32) & 0xFFFFFF) + 1;
+    } else {
+        ways = (uint32_t)((r >> 3) & 0x3FF) + 1;
+        sets = (uint32_t)((r >> 13) & 0x7FFF) + 1;
+    }
+    info->cache[info->cache_count++] = (hw_cache_t){
+        .level = (uint8_t)level, .type = (uint8_t)type,
+        .line  = (uint16_t)line, .size = line * ways * sets,
+        .ways  = (uint16_t)ways,
+    };
+}
+
+static void detect_caches(hw_info_t *info)
+{
+    uint64_t clidr, mmfr2;
+    __asm__ volatile("mrs %0, clidr_el1" : "=r"(clidr));
+    __asm__ volatile("mrs %0, s3_0_c0_c7_2" : "=r"(mmfr2)); /* MMFR2_EL1 */
+    int ccidx = ((mmfr2 >> 20) & 0xF) == 1;
+
+    info->cache_count = 0;
+    for (uint32_t l = 1; l <= 7; l++) {
+        uint32_t t = (uint32_t)(clidr >> (3 * (l - 1))) & 7;
+        if (t == CTYPE_NONE || t > CTYPE_UNIFIED)
+            break;
+        if (t == CTYPE_UNIFIED)
+            add_cache(info, l, CACHE_UNIFIED, ccidx);
+        if (t == CTYPE_DATA || t == CTYPE_SPLIT)
+            add_cache(info, l, CACHE_DATA, ccidx);
+        if (t == CTYPE_INST || t == CTYPE_SPLIT)
+            add_cache(info, l, CACHE_INST, ccidx);
+    }
+}
+
+/* ── cpu-map ─────────────────────────────────────────────────────────── */
+
+static int name_is(int node, const char *prefix)
+{
+    return kstrncmp(dtb_node_name(node), prefix, kstrlen(prefix)) == 0;
+}
+
+/* CPU index of the cpu node `node`, -1 if it is not one we run */
+static int cpu_of_node(int node, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        const dtb_cpu_t *d = smp_arm64_cpu(i);
+        if (d && d->node == node)
+            return (int)i;
+    }
+    return -1;
+}
+
+/* The CPU a cpu-map core / thread node points at */
+static int cpu_of_map(int node, uint32_t n)
+{
+    int cpu = dtb_find_phandle(dtb_prop_u32(node, "cpu", 0));
+    return cpu == DTB_NO_NODE ? -1 : cpu_of_node(cpu, n);
+}
+
+static void place(hw_info_t *info, int cpu, uint32_t pkg, uint32_t core,
+                  uint32_t thread)
+{
+    if (cpu < 0)
+        return;
+    info->cpu[cpu].package = (uint16_t)pkg;
+    info->cpu[cpu].core    = (uint16_t)core;
+    info->cpu[cpu].thread  = (uint16_t)thread;
+}
+
+static void map_core(hw_info_t *info, int node, uint32_t pkg, uint32_t core,
+                     uint32_t n)
+{
+    place(info, cpu_of_map(node, n), pkg, core, 0);
+    uint32_t thread = 0;
+    for (int c = dtb_first_child(node); c != DTB_NO_NODE;
+         c = dtb_next_sibling(c))
+        if (name_is(c, "thread"))
+            place(info, cpu_of_map(c, n), pkg, core, thread++);
+}
+
+static void map_cluster(hw_info_t *info, int node, uint32_t *pkg, uint32_t n,
+                        uint32_t depth)
+{
+    if (depth > 4)
+        return;
+    uint32_t cores = 0;
+    for (int c = dtb_first_child(node); c != DTB_NO_NODE;
+         c = dtb_next_sibling(c))
+        if (name_is(c, "core"))
+            map_core(info, c, *pkg, cores++, n);
+    if (cores)
+        (*pkg)++;
+    for (int c = dtb_first_child(node); c != DTB_NO_NODE;
+         c = dtb_next_sibling(c))
+        if (name_is(c, "cluster") || name_is(c, "socket"))
+            map_cluster(info, c, pkg, n, depth + 1);
+}
+
+/* Last node of the next-level-cache chain from a cpu node */
+static int last_cache(int node)
+{
+    int last = DTB_NO_NODE;
+    for (uint32_t depth = 0; depth < 4; depth++) {
+        node = dtb_find_phandle(dtb_prop_u32(node, "next-level-cache", 0));
+        if (node == DTB_NO_NODE)
+            break;
+        last = node;
+    }
+    return last;
+}
+
+void topo_arm64_detect(hw_info_t *info)
+{
+    detect_caches(info);
+
+    uint32_t n = info->cpu_cores < HW_MAX_CPUS ? info->cpu_cores : HW_MAX_CPUS;
+    int cpus = dtb_find_child(0, "cpus");
+    int map  = dtb_find_child(cpus, "cpu-map");
+    uint32_t pkg = 0;
+    if (map != DTB_NO_NODE)
+        map_cluster(info, map, &pkg, n, 0);
+
+    uint32_t dmips[HW_MAX_CPUS], best = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        const dtb_cpu_t *d = smp_arm64_cpu(i);
+        int llc  = d ? last_cache(d->node) : DTB_NO_NODE;
+        dmips[i] = d ? dtb_prop_u32(d->node, "capacity-dmips-mhz", 0) : 0;
+        if (dmips[i] > best)
+            best = dmips[i];
+        info->cpu[i].llc = llc != DTB_NO_NODE ? (uint16_t)(LLC_NODE | llc)
+                                              : info->cpu[i].package;
+    }
+    for (uint32_t i = 0; i < n && best; i++)
+        info->cpu[i].capacity = dmips[i] ? dmips[i] * HW_CAPACITY_MAX / best
+                                         : HW_CAPACITY_MAX;
+}
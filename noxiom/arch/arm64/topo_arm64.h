@@ -0,0 +1,9 @@
+#pragma once
+#include "hal.h"
+
+/* Caches and CPU topology for hal_hw_detect(): the boot CPU's caches
+ * from CLIDR_EL1 / CCSIDR_EL1 into info->cache[], then cpu-map
+ * positions, LLC groups and capacities from the DTB into info->cpu[]
+ * for the first info->cpu_cores CPU indices.  After smp_arm64_init(),
+ * which decides the CPU order. */
+void topo_arm64_detect(hw_info_t *info);
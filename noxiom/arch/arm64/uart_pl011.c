@@ -8,8 +8,23 @@
  * Baud rate: 115200 @ 48 MHz UART reference clock (default on Pi).
  *   IBRD = floor(48_000_000 / (16 * 115200)) = 26
  *   FBRD = round((48_000_000 / (16 * 115200) - 26) * 64) = 3
+ *
+ * Polled until pl011_enable_irq(), then interrupt driven:
+ *   TX — bytes go to a ring; whatever fits is written to the FIFO at
+ *        once, the rest is moved by the TX interrupt, up to a FIFO's
+ *        worth per interrupt.  A byte is only left in the ring while the
+ *        FIFO is full, so the FIFO is guaranteed to drain through the
+ *        trigger level and raise the interrupt that empties the ring.
+ *   RX — the RX and receive-timeout interrupts drain the FIFO into a
+ *        ring and call the notify hook; readers sleep instead of
+ *        spinning on the flag register.
+ * A writer that finds the ring full (IRQs masked for a long time, e.g.
+ * early boot or a panic) drains it by polling, so output is never lost.
  */
 #include "uart_pl011.h"
+#include "hal.h"            /* -Ikernel/src */
+#include "ringbuf.h"        /* -Ikernel/src */
+#include "sync/spinlock.h"  /* -Ikernel/src */
 #include <stdint.h>
 
 /* PL011 register offsets */
@@ -19,7 +34,10 @@
 #define UARTFBRD  0x028     /* Fractional baud rate divisor        */
 #define UARTLCRH  0x02C     /* Line control register               */
 #define UARTCR    0x030     /* Control register                    */
+#define UARTIFLS  0x034     /* Interrupt FIFO level select         */
 #define UARTIMSC  0x038     /* Interrupt mask set/clear            */
+#define UARTMIS   0x040     /* Masked interrupt status             */
+#define UARTICR   0x044     /* Interrupt clear                     */
 
 /* UARTFR bits */
 #define FR_TXFF   (1u << 5) /* TX FIFO full  */
@@ -34,8 +52,30 @@
 #define CR_TXE    (1u << 8) /* TX enable   */
 #define CR_RXE    (1u << 9) /* RX enable   */
 
+/* UARTIMSC / UARTMIS / UARTICR bits */
+#define INT_RX    (1u << 4) /* RX FIFO at trigger level  */
+#define INT_TX    (1u << 5) /* TX FIFO at trigger level  */
+#define INT_RT    (1u << 6) /* RX timeout (data idle)    */
+
+/* UARTIFLS: TX interrupt at <= 1/8 full, RX at >= 1/2 full */
+#define IFLS_TX_1_8  (0u << 0)
+#define IFLS_RX_1_2  (2u << 3)
+
+#define FIFO_DEPTH   32     /* r1p5; older parts have 16 (TXFF stops us) */
+#define TX_RING_SIZE 1024
+#define RX_RING_SIZE 256
+
 static volatile uint8_t *uart = 0;
 
+static uint8_t    tx_store[TX_RING_SIZE];
+static uint8_t    rx_store[RX_RING_SIZE];
+static ringbuf_t  tx_ring = RINGBUF_INIT(tx_store);
+static ringbuf_t  rx_ring = RINGBUF_INIT(rx_store);
+static spinlock_t tx_lock = SPINLOCK_INIT;  /* tx_ring writers, imsc    */
+static uint32_t   imsc;                     /* shadow of UARTIMSC       */
+static int        irq_mode;
+static void     (*rx_notify)(void);
+
 static inline void mmio_w32(uint32_t off, uint32_t val) {
     *((volatile uint32_t *)(uart + off)) = val;
 }
@@ -65,16 +105,131 @@ void pl011_init(uint64_t base)
     mmio_w32(UARTCR, CR_UARTEN | CR_TXE | CR_RXE);
 }
 
+/* ── Interrupt mode ─────────────────────────────────────────────────────── */
+
+/* tx_lock held: move queued bytes into the FIFO until it is full */
+static void tx_fill(void)
+{
+    uint8_t c;
+    for (int n = 0; n < FIFO_DEPTH; n++) {
+        if ((mmio_r32(UARTFR) & FR_TXFF) || !ringbuf_get(&tx_ring, &c))
+            break;
+        mmio_w32(UARTDR, c);
+    }
+}
+
+/* tx_lock held */
+static void tx_irq_update(void)
+{
+    uint32_t want = ringbuf_empty(&tx_ring) ? imsc & ~INT_TX
+                                            : imsc | INT_TX;
+    if (want != imsc) {
+        imsc = want;
+        mmio_w32(UARTIMSC, imsc);
+    }
+}
+
+static void pl011_irq(uint32_t irq, void *ctx)
+{
+    (void)irq;
+    (void)ctx;
+    uint32_t mis = mmio_r32(UARTMIS);
+
+    if (mis & (INT_RX | INT_RT)) {
+        /* Clear first: a byte landing after the drain re-raises it */
+        mmio_w32(UARTICR, INT_RX | INT_RT);
+        int got = 0;
+        while (!(mmio_r32(UARTFR) & FR_RXFE)) {
+            /* On overflow the newest bytes are dropped */
+            ringbuf_put(&rx_ring, (uint8_t)mmio_r32(UARTDR));
+            got = 1;
+        }
+        if (got && rx_notify)
+            rx_notify();
+    }
+
+    if (mis & INT_TX) {
+        spin_lock(&tx_lock);
+        tx_fill();
+        tx_irq_update();
+        spin_unlock(&tx_lock);
+    }
+}
+
+int pl011_enable_irq(uint32_t irq, void (*notify)(void))
+{
+    if (!uart || !irq)
+        return -1;
+
+    uint64_t flags = spin_lock_irqsave(&tx_lock);
+    rx_notify = notify;
+    mmio_w32(UARTIFLS, IFLS_TX_1_8 | IFLS_RX_1_2);
+    mmio_w32(UARTICR, INT_RX | INT_TX | INT_RT);
+    imsc = INT_RX | INT_RT;
+    mmio_w32(UARTIMSC, imsc);
+    irq_mode = 1;
+    spin_unlock_irqrestore(&tx_lock, flags);
+
+    if (hal_irq_register(irq, pl011_irq, 0) != 0) {
+        flags = spin_lock_irqsave(&tx_lock);
+        irq_mode = 0;
+        imsc = 0;
+        mmio_w32(UARTIMSC, 0);
+        spin_unlock_irqrestore(&tx_lock, flags);
+        return -1;
+    }
+    return 0;
+}
+
+void pl011_flush(void)
+{
+    if (!uart || !irq_mode)
+        return;
+
+    /* Best effort: used on the way to halt, where the lock holder may
+     * never release it */
+    int locked = 0;
+    for (int i = 0; i < 1000000 && !(locked = spin_trylock(&tx_lock)); i++)
+        ;
+    while (!ringbuf_empty(&tx_ring)) {
+        while (mmio_r32(UARTFR) & FR_TXFF);
+        tx_fill();
+    }
+    if (locked)
+        spin_unlock(&tx_lock);
+}
+
+/* ── Character I/O ──────────────────────────────────────────────────────── */
+
 void pl011_putchar(char c)
 {
     if (!uart) return;
-    while (mmio_r32(UARTFR) & FR_TXFF);    /* wait for TX FIFO space */
-    mmio_w32(UARTDR, (uint32_t)(uint8_t)c);
+
+    if (!irq_mode) {
+        while (mmio_r32(UARTFR) & FR_TXFF);    /* wait for TX FIFO space */
+        mmio_w32(UARTDR, (uint32_t)(uint8_t)c);
+        return;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&tx_lock);
+    while (!ringbuf_put(&tx_ring, (uint8_t)c)) {
+        while (mmio_r32(UARTFR) & FR_TXFF);    /* ring full: drain by hand */
+        tx_fill();
+    }
+    tx_fill();
+    tx_irq_update();
+    spin_unlock_irqrestore(&tx_lock, flags);
 }
 
-char pl011_getchar(void)
+int pl011_trygetchar(char *c)
 {
-    if (!uart) return '\0';
-    while (mmio_r32(UARTFR) & FR_RXFE);    /* wait for RX data       */
-    return (char)(mmio_r32(UARTDR) & 0xFF);
+    if (!uart) return 0;
+
+    if (irq_mode)
+        return ringbuf_get(&rx_ring, (uint8_t *)c);
+
+    if (mmio_r32(UARTFR) & FR_RXFE)
+        return 0;
+    *c = (char)(mmio_r32(UARTDR) & 0xFF);
+    return 1;
 }
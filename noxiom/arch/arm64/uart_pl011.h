@@ -2,8 +2,18 @@
 #include <stdint.h>
 
 /* PL011 UART driver — ARM IP block, same register layout on all Pi models.
- * MMIO base address is supplied at runtime (from DTB), never hard-coded. */
+ * MMIO base address is supplied at runtime (from DTB), never hard-coded.
+ *
+ * Polled until pl011_enable_irq(); then TX and RX go through ring buffers
+ * serviced by the UART interrupt. */
 
 void pl011_init(uint64_t base);
+/* Switch to interrupt mode on GIC INTID `irq`; notify (may be 0) runs in
+ * IRQ context whenever bytes arrive.  Returns -1 and stays polled if the
+ * interrupt cannot be claimed.  Needs the interrupt controller. */
+int  pl011_enable_irq(uint32_t irq, void (*notify)(void));
 void pl011_putchar(char c);
-char pl011_getchar(void);           /* blocks until RX FIFO has data */
+/* Returns 1 and stores a byte if one is available, 0 otherwise */
+int  pl011_trygetchar(char *c);
+/* Push every queued TX byte out by polling (halt / panic paths) */
+void pl011_flush(void);
@@ -0,0 +1,98 @@
+/* arch/arm64/user_arm64.c — EL0 entry and exception dispatch
+ *
+ * The exceptions.S frame is the same for both ELs: x0-x30, ELR, SPSR,
+ * ESR, SP_EL0, TPIDR_EL0.  A system call is SVC #0 with its number in x8
+ * and arguments in x0-x5; the result replaces x0 in the frame.  ELR
+ * already points past the SVC, so eret resumes after it.  An FP/SIMD
+ * access trap (the unit is off, sched/fpu.h) is retried once the
+ * thread's registers are loaded.
+ */
+#include "user_arm64.h"
+#include "hal.h"                /* -Ikernel/src  */
+#include "user/user.h"          /* -Ikernel/src  */
+#include "sched/fpu.h"          /* -Ikernel/src  */
+#include <stdint.h>
+
+#define CNTKCTL_EL0VCTEN  (1ULL << 1)
+
+#define FRAME_ELR   31
+#define FRAME_ESR   33
+
+#define ESR_EC(esr)   ((uint32_t)((esr) >> 26) & 0x3F)
+#define EC_UNKNOWN    0x00
+#define EC_FP         0x07
+#define EC_SVC64      0x15
+#define EC_IABT_LOW   0x20
+#define EC_PC_ALIGN   0x22
+#define EC_DABT_LOW   0x24
+#define EC_SP_ALIGN   0x26
+#define EC_BRK        0x3C
+
+/* Abort ISS: fault status code (any level), write, cache maintenance */
+#define ESR_FSC_MASK     0x3C
+#define FSC_TRANSLATION  0x04
+#define FSC_PERMISSION   0x0C
+#define ESR_WNR          (1ULL << 6)
+#define ESR_CM           (1ULL << 8)
+
+void user_arm64_cpu_init(uint32_t cpu)
+{
+    uint64_t ctl;
+    __asm__ volatile("mrs %0, cntkctl_el1" : "=r"(ctl));
+    __asm__ volatile("msr cntkctl_el1, %0\n\t"
+                     "msr tpidrro_el0, %1\n\t"
+                     "isb" :: "r"(ctl | CNTKCTL_EL0VCTEN),
+                     "r"((uint64_t)cpu) : "memory");
+}
+
+static const char *ec_name(uint32_t ec)
+{
+    switch (ec) {
+    case EC_UNKNOWN:  return "Undefined Instruction";
+    case EC_FP:       return "FP/SIMD Access";
+    case EC_IABT_LOW: return "Instruction Abort";
+    case EC_PC_ALIGN: return "PC Alignment";
+    case EC_DABT_LOW: return "Data Abort";
+    case EC_SP_ALIGN: return "SP Alignment";
+    case EC_BRK:      return "Breakpoint";
+    default:          return "Synchronous Exception";
+    }
+}
+
+/* Translation and permission faults go to the demand pager, IRQs on as
+ * for a system call.  0 if the access can be retried. */
+static int page_in(uint64_t esr, uint64_t far)
+{
+    uint32_t ec = ESR_EC(esr), fsc = (uint32_t)esr & ESR_FSC_MASK;
+    if ((ec != EC_IABT_LOW && ec != EC_DABT_LOW) ||
+        (fsc != FSC_TRANSLATION && fsc != FSC_PERMISSION))
+        return -1;
+    uint32_t access = ec == EC_IABT_LOW ? HAL_UMAP_X
+                    : (esr & ESR_WNR) && !(esr & ESR_CM) ? HAL_UMAP_W : 0;
+    hal_irq_enable();
+    int r = user_page_fault(far, access);
+    hal_irq_disable();
+    return r;
+}
+
+void arm64_el0_sync_handler(uint64_t *frame)
+{
+    uint32_t ec = ESR_EC(frame[FRAME_ESR]);
+    if (ec == EC_SVC64) {
+        hal_irq_enable();
+        int64_t r = syscall_dispatch(frame[8], frame[0], frame[1],
+                                     frame[2], frame[3], frame[4], frame[5]);
+        hal_irq_disable();
+        frame[0] = (uint64_t)r;
+        return;
+    }
+
+    if (ec == EC_FP && fpu_trap() == 0)
+        return;                     /* first FP use since a switch */
+
+    uint64_t far;
+    __asm__ volatile("mrs %0, far_el1" : "=r"(far));
+    if (page_in(frame[FRAME_ESR], far) == 0)
+        return;
+    user_fault(ec_name(ec), frame[FRAME_ELR], far);
+}
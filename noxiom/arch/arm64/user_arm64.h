@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+
+/* AArch64 EL0 support — the arm64 side of hal_user_*().
+ *
+ * user_arm64_cpu_init() lets EL0 read the virtual counter (CNTKCTL_EL1.
+ * EL0VCTEN) and puts the CPU index in TPIDRRO_EL0, which EL0 can read
+ * but not write.  Every CPU, before it runs user code.
+ */
+void user_arm64_cpu_init(uint32_t cpu);
+
+/* Words in an exceptions.S register frame */
+#define USER_FRAME_WORDS  36
+
+/* Synchronous exception from EL0 (exceptions.S el0_sync): SVC is a
+ * system call, a translation or permission fault goes to the demand
+ * pager, anything else (or a fault it cannot resolve) kills the thread.
+ * frame is the saved register frame. */
+void arm64_el0_sync_handler(uint64_t *frame);
+
+/* exceptions.S: ERET to EL0t at entry, SP_EL0 = sp, x0/x1 = arg0/arg1;
+ * kstack_top becomes SP_EL1, the stack the next exception starts on */
+void user_enter(uint64_t entry, uint64_t sp, uint64_t arg0, uint64_t arg1,
+                uint64_t kstack_top) __attribute__((noreturn));
+/* exceptions.S: ERET to EL0 through a copy of frame (USER_FRAME_WORDS,
+ * as saved for an SVC) placed at kstack_top, with x0 = ret */
+void user_resume(const uint64_t *frame, uint64_t ret, uint64_t kstack_top)
+    __attribute__((noreturn));
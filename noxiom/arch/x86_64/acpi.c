@@ -0,0 +1,208 @@
+/* arch/x86_64/acpi.c — RSDP/XSDT/MADT parsing
+ *
+ * Only what the kernel needs to find its CPUs and interrupt controllers
+ * is read here.  Every table is checksum-verified before use; a firmware
+ * without ACPI simply leaves acpi_info_t zeroed, and the kernel stays on
+ * the boot CPU with the 8259 PIC.
+ */
+#include "acpi.h"
+#include "string.h"
+#include "mm/pmm.h"
+#include <stdint.h>
+
+typedef struct __attribute__((packed)) {
+    char     signature[8];              /* "RSD PTR "                    */
+    uint8_t  checksum;
+    char     oem_id[6];
+    uint8_t  revision;                  /* 0 = ACPI 1.0, 2 = ACPI 2.0+   */
+    uint32_t rsdt_addr;
+    uint32_t length;                    /* ACPI 2.0+ fields follow       */
+    uint64_t xsdt_addr;
+    uint8_t  ext_checksum;
+    uint8_t  reserved[3];
+} acpi_rsdp_t;
+
+typedef struct __attribute__((packed)) {
+    char     signature[4];
+    uint32_t length;
+    uint8_t  revision;
+    uint8_t  checksum;
+    char     oem_id[6];
+    char     oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} acpi_sdt_t;
+
+typedef struct __attribute__((packed)) {
+    acpi_sdt_t hdr;
+    uint32_t   lapic_addr;
+    uint32_t   flags;
+    uint8_t    entries[];
+} acpi_madt_t;
+
+/* MADT entry types */
+#define MADT_LAPIC           0
+#define MADT_IOAPIC          1
+#define MADT_ISO             2      /* interrupt source override      */
+#define MADT_LAPIC_OVERRIDE  5
+#define MADT_X2APIC          9
+
+#define MADT_CPU_ENABLED     (1u << 0)
+#define MADT_PCAT_COMPAT     (1u << 0)  /* MADT flags: dual 8259 present */
+
+static acpi_info_t s_info;
+
+static int checksum_ok(const void *p, uint32_t len)
+{
+    const uint8_t *b = p;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++)
+        sum = (uint8_t)(sum + b[i]);
+    return sum == 0;
+}
+
+static const acpi_rsdp_t *scan_rsdp(uint64_t start, uint64_t len)
+{
+    for (uint64_t a = start; a + sizeof(acpi_rsdp_t) <= start + len; a += 16) {
+        const acpi_rsdp_t *r = phys_to_virt(a);
+        if (kstrncmp(r->signature, "RSD PTR ", 8) == 0 && checksum_ok(r, 20))
+            return r;
+    }
+    return 0;
+}
+
+static const acpi_rsdp_t *find_rsdp(void)
+{
+    /* First KB of the EBDA (segment stored at 0x40E), then the BIOS ROM */
+    uint64_t ebda = (uint64_t)(*(const volatile uint16_t *)phys_to_virt(0x40E)) << 4;
+    const acpi_rsdp_t *r = 0;
+    if (ebda >= 0x80000 && ebda < 0xA0000)
+        r = scan_rsdp(ebda, 1024);
+    if (!r)
+        r = scan_rsdp(0xE0000, 0x20000);
+    return r;
+}
+
+static const acpi_sdt_t *map_sdt(uint64_t pa)
+{
+    const acpi_sdt_t *t = phys_to_virt(pa);
+    if (!pa || !checksum_ok(t, t->length))
+        return 0;
+    return t;
+}
+
+static const acpi_sdt_t *find_table(const acpi_rsdp_t *rsdp, const char *sig)
+{
+    const acpi_sdt_t *root;
+    uint32_t          ptr_size;
+
+    if (rsdp->revision >= 2 && rsdp->xsdt_addr &&
+        checksum_ok(rsdp, rsdp->length)) {
+        root     = map_sdt(rsdp->xsdt_addr);
+        ptr_size = 8;
+    } else {
+        root     = map_sdt(rsdp->rsdt_addr);
+        ptr_size = 4;
+    }
+    if (!root)
+        return 0;
+
+    const uint8_t *ptrs = (const uint8_t *)root + sizeof(acpi_sdt_t);
+    uint32_t count = (root->length - (uint32_t)sizeof(acpi_sdt_t)) / ptr_size;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t pa = 0;
+        kmemcpy(&pa, ptrs + i * ptr_size, ptr_size);
+        const acpi_sdt_t *t = map_sdt(pa);
+        if (t && kstrncmp(t->signature, sig, 4) == 0)
+            return t;
+    }
+    return 0;
+}
+
+static void add_cpu(uint32_t apic_id, uint32_t flags)
+{
+    if (!(flags & MADT_CPU_ENABLED) || s_info.cpu_count >= HAL_MAX_CPUS)
+        return;
+    for (uint32_t i = 0; i < s_info.cpu_count; i++)
+        if (s_info.apic_ids[i] == apic_id)
+            return;                     /* listed as both LAPIC and x2APIC */
+    s_info.apic_ids[s_info.cpu_count++] = apic_id;
+}
+
+static void add_ioapic(const uint8_t *p)
+{
+    if (s_info.ioapic_count >= ACPI_MAX_IOAPICS)
+        return;
+    acpi_ioapic_t *io = &s_info.ioapics[s_info.ioapic_count++];
+    io->id = p[2];
+    kmemcpy(&io->addr,     p + 4, 4);
+    kmemcpy(&io->gsi_base, p + 8, 4);
+}
+
+static void add_override(const uint8_t *p)
+{
+    uint8_t  bus = p[2], src = p[3];
+    uint32_t gsi;
+    uint16_t flags;
+    kmemcpy(&gsi,   p + 4, 4);
+    kmemcpy(&flags, p + 8, 2);
+    if (bus != 0 || src >= ACPI_ISA_IRQS)
+        return;                         /* only ISA sources are defined */
+    s_info.isa_gsi[src]   = gsi;
+    s_info.isa_flags[src] = flags;
+}
+
+static void parse_madt(const acpi_madt_t *madt)
+{
+    s_info.lapic_base  = madt->lapic_addr;
+    s_info.pic_present = (madt->flags & MADT_PCAT_COMPAT) != 0;
+    for (uint32_t i = 0; i < ACPI_ISA_IRQS; i++)
+        s_info.isa_gsi[i] = i;
+
+    const uint8_t *p   = madt->entries;
+    const uint8_t *end = (const uint8_t *)madt + madt->hdr.length;
+
+    while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end) {
+        uint8_t type = p[0];
+        if (type == MADT_LAPIC && p[1] >= 8) {
+            uint32_t flags;
+            kmemcpy(&flags, p + 4, 4);
+            add_cpu(p[3], flags);
+        } else if (type == MADT_X2APIC && p[1] >= 16) {
+            uint32_t id, flags;
+            kmemcpy(&id,    p + 4, 4);
+            kmemcpy(&flags, p + 8, 4);
+            add_cpu(id, flags);
+        } else if (type == MADT_IOAPIC && p[1] >= 12) {
+            add_ioapic(p);
+        } else if (type == MADT_ISO && p[1] >= 10) {
+            add_override(p);
+        } else if (type == MADT_LAPIC_OVERRIDE && p[1] >= 12) {
+            kmemcpy(&s_info.lapic_base, p + 4, 8);
+        }
+        p += p[1];
+    }
+}
+
+int acpi_init(void)
+{
+    kmemset(&s_info, 0, sizeof(s_info));
+
+    const acpi_rsdp_t *rsdp = find_rsdp();
+    if (!rsdp)
+        return -1;
+
+    const acpi_madt_t *madt = (const acpi_madt_t *)find_table(rsdp, "APIC");
+    if (!madt)
+        return -1;
+
+    parse_madt(madt);
+    return s_info.cpu_count ? 0 : -1;
+}
+
+const acpi_info_t *acpi_get_info(void)
+{
+    return &s_info;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include "hal.h"
+
+/* Minimal ACPI table reader.
+ *
+ * Locates the RSDP in the EBDA / BIOS ROM area, follows the XSDT (or RSDT
+ * on ACPI 1.0 firmware) and parses the MADT ("APIC" table) for the local
+ * APIC of every enabled CPU, the IOAPICs and the ISA interrupt overrides.
+ * All tables live below 4 GB, inside the identity map.
+ */
+
+#define ACPI_MAX_IOAPICS  8
+#define ACPI_ISA_IRQS     16
+
+/* MPS INTI flags of an interrupt source override */
+#define ACPI_INTI_POLARITY_MASK  0x3
+#define ACPI_INTI_ACTIVE_LOW     0x3
+#define ACPI_INTI_TRIGGER_MASK   0xC
+#define ACPI_INTI_LEVEL          0xC
+
+typedef struct {
+    uint32_t id;
+    uint32_t addr;                      /* MMIO base, below 4 GB           */
+    uint32_t gsi_base;                  /* first GSI of its inputs         */
+} acpi_ioapic_t;
+
+typedef struct {
+    uint64_t lapic_base;                /* from the MADT (or its override) */
+    uint32_t cpu_count;                 /* enabled local APICs             */
+    uint32_t apic_ids[HAL_MAX_CPUS];    /* in MADT order                   */
+    int      pic_present;               /* PCAT_COMPAT: an 8259 is wired   */
+    uint32_t ioapic_count;
+    acpi_ioapic_t ioapics[ACPI_MAX_IOAPICS];
+    /* ISA IRQ n arrives on GSI isa_gsi[n] with isa_flags[n]; identity
+     * and edge/active-high unless the MADT overrides it */
+    uint32_t isa_gsi[ACPI_ISA_IRQS];
+    uint16_t isa_flags[ACPI_ISA_IRQS];
+} acpi_info_t;
+
+/* Parse the ACPI tables.  Returns 0 if a valid MADT listing at least one
+ * CPU was found. */
+int acpi_init(void);
+
+/* Parsed results; cpu_count == 0 if acpi_init() failed */
+const acpi_info_t *acpi_get_info(void);
@@ -0,0 +1,111 @@
+; Noxiom OS - Application Processor start-up trampoline
+; An AP leaves INIT-SIPI in 16-bit real mode at (SIPI vector << 12).
+; smp_x86.c copies this blob to AP_BOOT_ADDR, fills in the data slots at
+; the end, and sends the SIPI.  The AP then:
+;   1. Loads a temporary GDT and enters 32-bit protected mode
+;   2. Enables PAE, loads the BSP's CR3, sets EFER.LME (plus the BSP's
+;      EFER.NXE, which the kernel page tables need), enables paging
+;   3. Far-jumps into 64-bit mode, loads its own stack and calls
+;      ap_entry(cpu_index) — which must never return
+; All addresses are computed relative to AP_BOOT_ADDR, so the blob is
+; never executed where the linker put it.
+
+AP_BOOT_ADDR equ 0x8000                 ; must match smp_x86.c
+
+%define TRAMP(label) ((label) - ap_trampoline_start + AP_BOOT_ADDR)
+
+global ap_trampoline_start
+global ap_trampoline_end
+global ap_slot_cr3
+global ap_slot_stack
+global ap_slot_cpu
+global ap_slot_entry
+global ap_slot_efer
+
+section .rodata
+align 16
+
+[BITS 16]
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [TRAMP(ap_gdt_ptr)]
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+    jmp dword 0x08:TRAMP(ap_pmode32)
+
+[BITS 32]
+ap_pmode32:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    ; PAE
+    mov eax, cr4
+    or eax, (1 << 5)
+    mov cr4, eax
+
+    ; Same page tables as the BSP (must live below 4 GB)
+    mov eax, [TRAMP(ap_slot_cr3)]
+    mov cr3, eax
+
+    ; EFER.LME, and whatever else the BSP runs with (NXE)
+    mov ecx, 0xC0000080
+    rdmsr
+    or eax, (1 << 8)
+    or eax, [TRAMP(ap_slot_efer)]
+    wrmsr
+
+    ; Paging on -> long mode active
+    mov eax, cr0
+    or eax, (1 << 31)
+    mov cr0, eax
+
+    jmp 0x18:TRAMP(ap_lmode64)
+
+[BITS 64]
+ap_lmode64:
+    mov ax, 0x20
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    mov rsp, [TRAMP(ap_slot_stack)]
+    mov rdi, [TRAMP(ap_slot_cpu)]
+    mov rax, [TRAMP(ap_slot_entry)]
+    xor rbp, rbp
+    call rax
+.halt:
+    cli
+    hlt
+    jmp .halt
+
+; Temporary GDT: same layout as stage2 (32-bit code/data, 64-bit code/data)
+align 8
+ap_gdt:
+    dq 0                                    ; 0x00: null
+    dw 0xFFFF, 0x0000, 0x9A00, 0x00CF      ; 0x08: 32-bit code
+    dw 0xFFFF, 0x0000, 0x9200, 0x00CF      ; 0x10: 32-bit data
+    dw 0xFFFF, 0x0000, 0x9A00, 0x00AF      ; 0x18: 64-bit code
+    dw 0xFFFF, 0x0000, 0x9200, 0x00AF      ; 0x20: 64-bit data
+ap_gdt_end:
+
+ap_gdt_ptr:
+    dw ap_gdt_end - ap_gdt - 1
+    dd TRAMP(ap_gdt)
+
+; Data slots, written by the BSP into the copy before each SIPI
+align 8
+ap_slot_cr3:    dq 0
+ap_slot_stack:  dq 0
+ap_slot_cpu:    dq 0
+ap_slot_entry:  dq 0
+ap_slot_efer:   dq 0
+
+ap_trampoline_end:
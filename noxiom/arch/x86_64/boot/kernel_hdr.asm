@@ -0,0 +1,25 @@
+; Noxiom OS - kernel image header
+; Assembled by rules.mk after the kernel is linked, with the values
+; passed on the command line:
+;   -DENTRY=       address of _start
+;   -DMEM_END=     address of __kernel_end (end of .bss)
+;   -DIMAGE_SIZE=  size of the flat kernel.bin
+;   -DPAYLOAD_SIZE= size of what is written to disk after this sector
+;   -DFLAGS=       KH_FLAG_LZ4 if the payload is compressed, else 0
+
+%include "kernel_hdr.inc"
+
+KERNEL_LOAD equ 0x100000            ; must match linker.ld
+
+[ORG 0]
+
+    dd KH_MAGIC_VALUE
+    dd FLAGS
+    dq KERNEL_LOAD
+    dq ENTRY
+    dd PAYLOAD_SIZE
+    dd IMAGE_SIZE
+    dd MEM_END - KERNEL_LOAD
+    dd KHDR_LBA + 1
+
+times 512-($-$$) db 0
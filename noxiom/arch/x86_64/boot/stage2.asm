@@ -1,31 +1,117 @@
 ; Noxiom OS - Stage 2 Bootloader
 ; Executes at 0x7E00 in 16-bit real mode.
-; 1. Loads the kernel (128 sectors = 64KB) to 0x10000
+; 1. Saves the BIOS E820 memory map to 0x500 (passed to the kernel in RDI)
 ; 2. Enables the A20 line
-; 3. Switches to 32-bit protected mode
-; 4. Copies kernel to 0x100000 (1MB)
-; 5. Sets up page tables for 64-bit long mode (identity map, 2MB pages)
+; 3. Reads the kernel header sector (kernel_hdr.inc) and loads the payload
+;    CHUNK_SECTORS at a time through a bounce buffer below 1 MB, copying
+;    each chunk straight to its final address above 1 MB in unreal mode
+; 4. Switches to 32-bit protected mode
+; 5. Sets up page tables for 64-bit long mode (4GB identity map, 2MB pages)
 ; 6. Switches to 64-bit long mode
-; 7. Jumps to kernel entry at 0x100000
+; 7. Decompresses an LZ4 payload into place, zeroes .bss
+; 8. Jumps to the kernel entry point from the header
+;
+; The TSC is read at entry, after the disk load and just before the jump,
+; and left in the header's KH_TSC_* fields (RSI = header) for bootstats.
+;
+; The payload size comes from the header, so the kernel can grow without
+; touching this file.  A compressed payload is loaded above the end of
+; the kernel's .bss (rounded up to 1 MB) and decompressed forward, so the
+; two never overlap.
 
 [BITS 16]
 [ORG 0x7E00]
 
+; E820 map layout (must match arch/x86_64/e820.h):
+;   +0  uint32 entry count
+;   +4  uint32 reserved
+;   +8  entries, 24 bytes each: base(8) length(8) type(4) ext_attr(4)
+E820_MAP     equ 0x0500
+E820_MAX     equ 64
+E820_SMAP    equ 0x534D4150     ; 'SMAP'
+
+%include "kernel_hdr.inc"
+
+KHDR          equ 0x0C00        ; header sector, after the E820 map
+BOUNCE_SEG    equ 0x1000        ; 0x10000: INT 13h target, 32 KB
+BOUNCE        equ 0x10000
+CHUNK_SECTORS equ 64            ; never crosses a 64 KB DMA boundary
+LZ4_LEGACY    equ 0x184C2102    ; lz4 -l frame magic
+
 stage2_start:
+    rdtsc
+    mov [tsc_start], eax
+    mov [tsc_start + 4], edx
     mov [boot_drive], dl
 
     mov si, msg_loading
     call print16
 
-    ; Load kernel to 0x10000 (segment 0x1000, offset 0)
-    mov si, kernel_dap
-    mov ah, 0x42
-    mov dl, [boot_drive]
-    int 0x13
-    jc .disk_error
+    call detect_memory
+    call enable_a20             ; before anything is copied above 1 MB
 
-    call enable_a20
+    ; Kernel header
+    mov word [dap_count], 1
+    mov word [dap_off], KHDR
+    mov word [dap_seg], 0
+    mov dword [dap_lba], KHDR_LBA
+    call read_sectors
+    jc .disk_error
+    cmp dword [KHDR + KH_MAGIC], KH_MAGIC_VALUE
+    jne .bad_header
+
+    ; Raw payloads go straight to the load address, compressed ones
+    ; above the kernel's memory footprint
+    mov eax, [KHDR + KH_LOAD]
+    test dword [KHDR + KH_FLAGS], KH_FLAG_LZ4
+    jz .dest_ok
+    add eax, [KHDR + KH_MEM_SIZE]
+    add eax, 0xFFFFF
+    and eax, 0xFFF00000
+.dest_ok:
+    mov [payload_addr], eax
+    mov [copy_dest], eax
+
+    mov eax, [KHDR + KH_PAYLOAD_SIZE]
+    add eax, 511
+    shr eax, 9
+    mov [sectors_left], eax
+    mov eax, [KHDR + KH_LBA]
+    mov [dap_lba], eax
+
+.next_chunk:
+    mov eax, [sectors_left]
+    test eax, eax
+    jz .loaded
+    cmp eax, CHUNK_SECTORS
+    jbe .chunk_ok
+    mov eax, CHUNK_SECTORS
+.chunk_ok:
+    mov [dap_count], ax
+    mov word [dap_off], 0
+    mov word [dap_seg], BOUNCE_SEG
+    call read_sectors
+    jc .disk_error
 
+    ; Bounce buffer -> final address (32-bit EDI needs unreal mode)
+    call unreal_enter
+    movzx ecx, word [dap_count]
+    shl ecx, 7                  ; sectors -> dwords
+    mov esi, BOUNCE
+    mov edi, [copy_dest]
+    cld
+    a32 rep movsd
+    mov [copy_dest], edi
+
+    movzx eax, word [dap_count]
+    add [dap_lba], eax
+    sub [sectors_left], eax
+    jmp .next_chunk
+
+.loaded:
+    rdtsc
+    mov [tsc_loaded], eax
+    mov [tsc_loaded + 4], edx
     lgdt [gdt32_ptr]
 
     cli
@@ -36,6 +122,10 @@ stage2_start:
 
 .disk_error:
     mov si, msg_disk_err
+    jmp .fail
+.bad_header:
+    mov si, msg_bad_hdr
+.fail:
     call print16
     cli
     hlt
@@ -58,6 +148,83 @@ print16:
     pop ax
     ret
 
+; INT 13h extended read described by the DAP below; CF set on error.
+; Tried three times: USB and floppy emulation often fail the first read.
+read_sectors:
+    pushad
+    mov di, 3
+.retry:
+    mov si, dap
+    mov ah, 0x42
+    mov dl, [boot_drive]
+    int 0x13
+    jnc .ok
+    xor ah, ah                  ; reset the drive and try again
+    mov dl, [boot_drive]
+    int 0x13
+    dec di
+    jnz .retry
+    stc
+.ok:
+    popad
+    ret
+
+; Unreal mode: load DS/ES from a 4 GB flat descriptor, drop back to
+; real mode.  The cached limits survive, so 32-bit offsets work with
+; DS = ES = 0.  Redone before each copy in case a BIOS call reset them.
+unreal_enter:
+    cli
+    push ds
+    push es
+    lgdt [gdt32_ptr]
+    mov eax, cr0
+    or al, 1
+    mov cr0, eax
+    jmp $+2
+    mov bx, 0x10                ; 32-bit data segment
+    mov ds, bx
+    mov es, bx
+    and al, 0xFE
+    mov cr0, eax
+    pop es
+    pop ds
+    sti
+    ret
+
+; Walk INT 15h EAX=E820h and store up to E820_MAX entries at E820_MAP.
+; A BIOS without E820 leaves the count at 0; the kernel then reports
+; the RAM as undetected (TIER_FALLBACK) rather than guessing.
+detect_memory:
+    pushad
+    mov dword [E820_MAP], 0
+    mov dword [E820_MAP + 4], 0
+    mov di, E820_MAP + 8
+    xor ebx, ebx                ; continuation value, 0 = start of list
+    xor bp, bp                  ; entries stored
+.next:
+    mov eax, 0xE820
+    mov edx, E820_SMAP
+    mov ecx, 24
+    mov dword [es:di + 20], 1   ; pre-set ACPI 3.x "valid" bit for 20-byte BIOSes
+    int 0x15
+    jc .done                    ; carry = unsupported, or end of list
+    cmp eax, E820_SMAP
+    jne .done
+    mov eax, [es:di + 8]        ; skip zero-length entries
+    or eax, [es:di + 12]
+    jz .skip
+    inc bp
+    add di, 24
+    cmp bp, E820_MAX
+    jae .done
+.skip:
+    test ebx, ebx
+    jnz .next
+.done:
+    mov [E820_MAP], bp
+    popad
+    ret
+
 enable_a20:
     call .wait_in
     mov al, 0xAD            ; disable keyboard
@@ -95,17 +262,31 @@ enable_a20:
 
 msg_loading  db "Noxiom: loading kernel...", 13, 10, 0
 msg_disk_err db "Stage2: kernel load failed!", 0
+msg_bad_hdr  db "Stage2: no kernel header!", 0
 boot_drive   db 0
 
-; Disk Address Packet: load 128 sectors (64KB) to 0x10000
 align 4
-kernel_dap:
+payload_addr dd 0           ; where the payload was loaded
+copy_dest    dd 0           ; next byte to fill
+sectors_left dd 0
+
+align 8
+tsc_start    dq 0           ; TSC at stage2_start
+tsc_loaded   dq 0           ; TSC once the payload is in memory
+
+; Disk Address Packet, rewritten for each read
+align 4
+dap:
     db 0x10
     db 0x00
-    dw 128              ; sectors (128 * 512 = 64KB)
-    dw 0x0000           ; offset within segment
-    dw 0x1000           ; segment (0x1000 * 16 = 0x10000)
-    dq 17               ; starting LBA (after stage1 + stage2)
+dap_count:
+    dw 0                ; sectors
+dap_off:
+    dw 0                ; offset within segment
+dap_seg:
+    dw 0                ; segment
+dap_lba:
+    dq 0                ; starting LBA
 
 ; Minimal GDT for 32/64-bit mode transition
 align 8
@@ -134,30 +315,27 @@ pmode32_start:
     mov ss, ax
     mov esp, 0x90000        ; temporary 32-bit stack
 
-    ; Copy kernel: 0x10000 -> 0x100000 (64KB = 16384 dwords)
-    mov esi, 0x10000
-    mov edi, 0x100000
-    mov ecx, 0x4000
-    rep movsd
-
-    ; Zero page table area at 0x1000-0x3FFF (3 tables x 4KB)
+    ; Zero page table area at 0x1000-0x6FFF (PML4, PDPT, 4 PDs x 4KB)
     mov edi, 0x1000
     xor eax, eax
-    mov ecx, 3072           ; 3 * 1024 dwords = 12KB
+    mov ecx, 6144           ; 6 * 1024 dwords = 24KB
     rep stosd
 
     ; PML4[0] -> PDPT at 0x2000
     mov dword [0x1000], 0x2003
     mov dword [0x1004], 0
 
-    ; PDPT[0] -> PD at 0x3000
+    ; PDPT[0..3] -> PDs at 0x3000, 0x4000, 0x5000, 0x6000
     mov dword [0x2000], 0x3003
-    mov dword [0x2004], 0
+    mov dword [0x2008], 0x4003
+    mov dword [0x2010], 0x5003
+    mov dword [0x2018], 0x6003
 
-    ; PD: 512 x 2MB identity-mapped pages (covers 1GB)
+    ; PDs: 2048 x 2MB identity-mapped pages (covers 4GB, so the local
+    ; APIC, IOAPIC and ACPI tables below 4GB are reachable from the kernel)
     mov edi, 0x3000
     mov eax, 0x0083         ; present + writable + 2MB (PS bit)
-    mov ecx, 512
+    mov ecx, 2048
 .fill_pd:
     mov [edi], eax
     mov dword [edi + 4], 0
@@ -200,9 +378,106 @@ lmode64_start:
     mov gs, ax
     mov ss, ax
 
-    ; Temporary stack at 2MB (kernel will set up its own)
-    mov rsp, 0x1FF000
-
-    ; Jump to kernel entry
-    mov rax, 0x100000
+    ; Temporary stack below the EBDA (kernel will set up its own); the
+    ; kernel image may reach well past 2 MB
+    mov rsp, 0x90000
+
+    test dword [KHDR + KH_FLAGS], KH_FLAG_LZ4
+    jz .zero_bss
+    mov esi, [payload_addr]
+    mov edx, [KHDR + KH_PAYLOAD_SIZE]
+    add rdx, rsi
+    mov edi, [KHDR + KH_LOAD]
+    call lz4_legacy
+    mov eax, [KHDR + KH_LOAD]
+    add eax, [KHDR + KH_IMAGE_SIZE]
+    cmp rdi, rax
+    jne .lz4_error
+
+.zero_bss:
+    mov edi, [KHDR + KH_LOAD]
+    add edi, [KHDR + KH_IMAGE_SIZE]
+    mov ecx, [KHDR + KH_MEM_SIZE]
+    sub ecx, [KHDR + KH_IMAGE_SIZE]
+    xor eax, eax
+    rep stosb
+
+    ; Timestamps into the header; the sector on disk has zeroes there
+    mov rax, [tsc_start]
+    mov [KHDR + KH_TSC_START], rax
+    mov rax, [tsc_loaded]
+    mov [KHDR + KH_TSC_LOADED], rax
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
+    mov [KHDR + KH_TSC_ENTRY], rax
+
+    ; Jump to kernel entry, RDI = E820 map, RSI = kernel header (both
+    ; saved by _start in entry.asm)
+    mov edi, E820_MAP
+    mov esi, KHDR
+    mov rax, [KHDR + KH_ENTRY]
     jmp rax
+
+.lz4_error:                 ; no BIOS any more: "LZ4!" straight to VGA
+    mov rax, 0x4F214F344F5A4F4C
+    mov [0xB8000], rax
+    cli
+    hlt
+
+; Decompress an LZ4 legacy frame (magic, then blocks of { dd size;
+; sequences }) from [RSI, RDX) to RDI.  Returns RDI past the last byte
+; written, or 0 on a bad magic.  Each sequence is a token (literal
+; length << 4 | match length - 4, 15 = more length bytes follow), the
+; literals, then a 16-bit match offset; the last sequence of a block
+; stops after its literals.  rep movsb copies byte-forward, which is
+; exactly what overlapping matches (offset < length) require.
+; Clobbers RAX, RBX, RCX, RSI, R8-R10.
+lz4_legacy:
+    cmp dword [rsi], LZ4_LEGACY
+    jne .bad
+    add rsi, 4
+.block:
+    cmp rsi, rdx
+    jae .done
+    mov r8d, [rsi]              ; compressed block size
+    add rsi, 4
+    add r8, rsi                 ; block end
+.sequence:
+    movzx ebx, byte [rsi]       ; token
+    inc rsi
+    mov ecx, ebx
+    shr ecx, 4
+    call .length
+    rep movsb                   ; literals
+    cmp rsi, r8
+    jae .block                  ; last sequence: no match part
+    movzx r10d, word [rsi]      ; match offset
+    add rsi, 2
+    mov ecx, ebx
+    and ecx, 15
+    call .length
+    add ecx, 4
+    mov r9, rsi
+    mov rsi, rdi
+    sub rsi, r10
+    rep movsb                   ; match, possibly overlapping
+    mov rsi, r9
+    jmp .sequence
+.bad:
+    xor edi, edi
+.done:
+    ret
+
+; ECX = 4-bit length field; 15 means add bytes until one is not 255
+.length:
+    cmp ecx, 15
+    jne .length_done
+.length_more:
+    movzx eax, byte [rsi]
+    inc rsi
+    add ecx, eax
+    cmp eax, 255
+    je .length_more
+.length_done:
+    ret
@@ -3,25 +3,21 @@
  * Uses CPUID to read:
  *   - CPU core count (topology leaf 0xB, or leaf 1 fallback)
  *   - CPU brand string (leaves 0x80000002-4)
- * Uses CMOS registers to estimate RAM (good enough for tier scoring;
- * a future improvement is to use the E820 map stored by stage2).
+ *   - architectural perfmon capabilities (leaf 0xA), for pmu_x86.c
+ *   - caches: deterministic cache parameters, leaf 4 (Intel) or
+ *     0x8000001D (AMD with TOPOEXT), else AMD's 0x80000005/6 sizes
+ *   - where the SMT, core and package fields of an APIC ID start (leaf
+ *     0xB, or the leaf 1 / leaf 4 / 0x80000008 counts)
+ * RAM size comes from the E820 map stored by stage2 (usable entries only).
+ *
+ * Hybrid parts (leaf 0x1A core type) would need CPUID on each CPU; all
+ * cores are reported at full capacity.
  */
 #include "cpuid.h"
-#include "io.h"
+#include "e820.h"
 #include "string.h"
 #include <stdint.h>
 
-static inline void do_cpuid(uint32_t leaf, uint32_t subleaf,
-                             uint32_t *eax, uint32_t *ebx,
-                             uint32_t *ecx, uint32_t *edx)
-{
-    __asm__ volatile (
-        "cpuid"
-        : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
-        : "a"(leaf), "c"(subleaf)
-    );
-}
-
 static uint32_t get_core_count(void)
 {
     uint32_t eax, ebx, ecx, edx;
@@ -72,40 +68,203 @@ static void get_brand_string(char *out, size_t len)
     }
 }
 
-static uint64_t get_ram_bytes(void)
+void cpuid_perfmon(cpuid_perfmon_t *out)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    kmemset(out, 0, sizeof(*out));
+    do_cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+    if (eax < 0xA)
+        return;
+
+    do_cpuid(0xA, 0, &eax, &ebx, &ecx, &edx);
+    out->version     = eax & 0xFF;
+    out->counters    = (eax >> 8) & 0xFF;
+    out->width       = (eax >> 16) & 0xFF;
+    out->events      = (eax >> 24) & 0xFF;
+    out->unavailable = ebx;
+}
+
+/* ── Caches and topology ─────────────────────────────────────────────── */
+
+/* APIC ID span of each info->cache[] entry (deterministic leaves only) */
+static uint32_t s_cache_span[HW_MAX_CACHES];
+
+static uint32_t order_of(uint32_t n)        /* log2, rounded up */
+{
+    uint32_t s = 0;
+    while (s < 31 && (1u << s) < n)
+        s++;
+    return s;
+}
+
+static void add_cache(hw_info_t *info, uint32_t level, uint32_t type,
+                      uint32_t size, uint32_t line, uint32_t ways,
+                      uint32_t span)
+{
+    if (!size || info->cache_count >= HW_MAX_CACHES)
+        return;
+    s_cache_span[info->cache_count] = span;
+    info->cache[info->cache_count++] = (hw_cache_t){
+        .level = (uint8_t)level, .type = (uint8_t)type,
+        .line  = (uint16_t)line, .size = size, .ways = (uint16_t)ways,
+    };
+}
+
+/* Leaf 4 and 0x8000001D share a layout: one subleaf per cache, type 0
+ * ends the list */
+static void caches_deterministic(hw_info_t *info, uint32_t leaf)
+{
+    for (uint32_t i = 0; i < 16; i++) {
+        uint32_t eax, ebx, ecx, edx;
+        do_cpuid(leaf, i, &eax, &ebx, &ecx, &edx);
+        uint32_t type = eax & 0x1F;
+        if (type == CACHE_NONE)
+            break;
+        if (type > CACHE_UNIFIED)
+            continue;
+        uint32_t line  = (ebx & 0xFFF) + 1;
+        uint32_t parts = ((ebx >> 12) & 0x3FF) + 1;
+        uint32_t ways  = ((ebx >> 22) & 0x3FF) + 1;
+        add_cache(info, (eax >> 5) & 7, type, ways * parts * line * (ecx + 1),
+                  line, eax & (1u << 9) ? 0 : ways,     /* fully assoc. */
+                  ((eax >> 14) & 0xFFF) + 1);
+    }
+}
+
+/* Older AMD: sizes and lines, L1 associativity; L2/L3 ways are encoded
+ * and left 0 */
+static void caches_amd_legacy(hw_info_t *info, uint32_t max_ext)
+{
+    uint32_t eax, ebx, ecx, edx;
+    if (max_ext >= 0x80000005) {
+        do_cpuid(0x80000005, 0, &eax, &ebx, &ecx, &edx);
+        add_cache(info, 1, CACHE_DATA, (ecx >> 24) << 10, ecx & 0xFF,
+                  (ecx >> 16) & 0xFF, 0);
+        add_cache(info, 1, CACHE_INST, (edx >> 24) << 10, edx & 0xFF,
+                  (edx >> 16) & 0xFF, 0);
+    }
+    if (max_ext >= 0x80000006) {
+        do_cpuid(0x80000006, 0, &eax, &ebx, &ecx, &edx);
+        add_cache(info, 2, CACHE_UNIFIED, (ecx >> 16) << 10, ecx & 0xFF, 0, 0);
+        add_cache(info, 3, CACHE_UNIFIED, (edx >> 18) << 19, edx & 0xFF, 0, 0);
+    }
+}
+
+static void get_caches(hw_info_t *info)
+{
+    uint32_t max, max_ext, eax, ebx, ecx, edx;
+    do_cpuid(0, 0, &max, &ebx, &ecx, &edx);
+    do_cpuid(0x80000000, 0, &max_ext, &ebx, &ecx, &edx);
+
+    info->cache_count = 0;
+    if (max >= 4)
+        caches_deterministic(info, 4);      /* all zero on AMD */
+    if (info->cache_count)
+        return;
+    if (max_ext >= 0x8000001D) {
+        do_cpuid(0x80000001, 0, &eax, &ebx, &ecx, &edx);
+        if (ecx & (1u << 22))               /* TOPOEXT */
+            caches_deterministic(info, 0x8000001D);
+    }
+    if (!info->cache_count)
+        caches_amd_legacy(info, max_ext);
+}
+
+/* Bits of an APIC ID below the core field (smt) and below the package
+ * field (pkg) */
+static void apic_shifts(uint32_t *smt, uint32_t *pkg)
 {
-    /* CMOS 0x30/0x31: extended memory above 1 MB in 1 KB units (up to 64 MB) */
-    outb(0x70, 0x30);
-    uint8_t lo = inb(0x71);
-    outb(0x70, 0x31);
-    uint8_t hi = inb(0x71);
-    uint32_t kb_low = ((uint32_t)hi << 8) | lo;
-
-    /* CMOS 0x34/0x35: extended memory above 16 MB in 64 KB units */
-    outb(0x70, 0x34);
-    uint8_t ext_lo = inb(0x71);
-    outb(0x70, 0x35);
-    uint8_t ext_hi = inb(0x71);
-    uint32_t kb_ext = ((uint32_t)ext_hi << 8) | ext_lo;
-
-    uint64_t total = (uint64_t)(1024 + kb_low) * 1024       /* bytes */
-                   + (uint64_t)kb_ext * 64ULL * 1024;
-
-    /* Floor at 128 MB so tier scoring never sees 0 on modern hardware */
-    if (total < (uint64_t)128 * 1024 * 1024)
-        total = (uint64_t)128 * 1024 * 1024;
-
-    return total;
+    uint32_t max, eax, ebx, ecx, edx;
+    do_cpuid(0, 0, &max, &ebx, &ecx, &edx);
+
+    if (max >= 0xB) {
+        uint32_t s = 0, p = 0;
+        for (uint32_t i = 0; i < 8; i++) {
+            do_cpuid(0xB, i, &eax, &ebx, &ecx, &edx);
+            uint32_t type = (ecx >> 8) & 0xFF;  /* 1 = SMT, 2 = core */
+            if (type == 0)
+                break;
+            if (type == 1)
+                s = eax & 0x1F;
+            p = eax & 0x1F;                     /* the last level's */
+        }
+        if (p) {
+            *smt = s;
+            *pkg = p;
+            return;
+        }
+    }
+
+    /* Logical CPUs per package, and cores among them */
+    do_cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    uint32_t logical = edx & (1u << 28) ? (ebx >> 16) & 0xFF : 1;
+    uint32_t cores   = 1;
+    if (max >= 4) {
+        do_cpuid(4, 0, &eax, &ebx, &ecx, &edx);
+        if (eax & 0x1F)
+            cores = (eax >> 26) + 1;
+    }
+    do_cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+    if (cores == 1 && eax >= 0x80000008) {
+        do_cpuid(0x80000008, 0, &eax, &ebx, &ecx, &edx);
+        cores = (ecx & 0xFF) + 1;
+    }
+    if (logical == 0)
+        logical = 1;
+    if (cores > logical)
+        cores = logical;
+    *pkg = order_of(logical);
+    *smt = order_of(logical / cores);
+}
+
+void cpuid_topology(hw_info_t *info, const uint32_t *apic_ids, uint32_t n)
+{
+    uint32_t smt, pkg;
+    apic_shifts(&smt, &pkg);
+    if (n > HW_MAX_CPUS)
+        n = HW_MAX_CPUS;
+
+    /* CPUs share the LLC where their IDs agree above its span; with no
+     * span it is the package's */
+    uint32_t llc = pkg, level = 0;
+    for (uint32_t i = 0; i < info->cache_count; i++) {
+        const hw_cache_t *c = &info->cache[i];
+        if (c->type != CACHE_INST && c->level > level) {
+            level = c->level;
+            llc   = s_cache_span[i] ? order_of(s_cache_span[i]) : pkg;
+        }
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t id = apic_ids[i];
+        info->cpu[i] = (hw_cpu_topo_t){
+            .package = (uint16_t)(id >> pkg),
+            .core    = (uint16_t)((id & ((1u << pkg) - 1)) >> smt),
+            .thread  = (uint16_t)(id & ((1u << smt) - 1)),
+            .llc     = (uint16_t)(id >> llc),
+        };
+    }
+
+    for (uint32_t c = 0; c < info->cache_count; c++) {
+        if (!s_cache_span[c])
+            continue;
+        uint32_t shift = order_of(s_cache_span[c]), shared = 0;
+        for (uint32_t i = 0; i < n; i++)
+            shared += apic_ids[i] >> shift == apic_ids[0] >> shift;
+        info->cache[c].shared = (uint16_t)shared;
+    }
 }
 
 void cpuid_detect(hw_info_t *info)
 {
     info->arch           = ARCH_X86_64;
     info->cpu_cores      = get_core_count();
-    info->ram_bytes      = get_ram_bytes();
+    info->ram_bytes      = e820_usable_bytes();
     info->uart_base      = 0;   /* x86 uses ISA port I/O, not MMIO */
     info->intc_base      = 0;
     info->intc_dist_base = 0;
     info->compat_str[0]  = '\0';
     get_brand_string(info->model_str, sizeof(info->model_str));
+    get_caches(info);
 }
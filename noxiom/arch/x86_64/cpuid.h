@@ -1,7 +1,37 @@
 #pragma once
 #include "hal_hw_info.h"
+#include <stdint.h>
 
-/* Detect x86_64 hardware properties via CPUID and CMOS.
- * Fills: arch, cpu_cores, ram_bytes, model_str.
- * All other hw_info_t fields are zeroed (not applicable on x86). */
+/* Raw CPUID, also used for feature bits outside cpuid.c */
+static inline void do_cpuid(uint32_t leaf, uint32_t subleaf,
+                             uint32_t *eax, uint32_t *ebx,
+                             uint32_t *ecx, uint32_t *edx)
+{
+    __asm__ volatile (
+        "cpuid"
+        : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+        : "a"(leaf), "c"(subleaf)
+    );
+}
+
+/* Architectural performance monitoring, CPUID leaf 0xA.  All zero when
+ * the leaf is missing (AMD, most hypervisors without PMU passthrough). */
+typedef struct {
+    uint32_t version;           /* EAX[7:0]                              */
+    uint32_t counters;          /* general-purpose counters, EAX[15:8]   */
+    uint32_t width;             /* counter bits, EAX[23:16]              */
+    uint32_t events;            /* EAX[31:24] bits of EBX are valid      */
+    uint32_t unavailable;       /* EBX: bit set = event not implemented  */
+} cpuid_perfmon_t;
+
+void cpuid_perfmon(cpuid_perfmon_t *out);
+
+/* Detect x86_64 hardware properties via CPUID and the E820 map.
+ * Fills: arch, cpu_cores, ram_bytes, model_str, the boot CPU's caches.
+ * The MMIO bases and compat_str are zeroed (not applicable on x86). */
 void cpuid_detect(hw_info_t *info);
+
+/* Fill info->cpu[0 .. n-1] from each CPU's APIC ID (index 0 = the boot
+ * CPU) split at the SMT / core / package boundaries CPUID reports, and
+ * how many of those CPUs share each cache.  After cpuid_detect(). */
+void cpuid_topology(hw_info_t *info, const uint32_t *apic_ids, uint32_t n);
@@ -0,0 +1,139 @@
+/* arch/x86_64/dispatch_x86.c — CPU-specific variants, picked at boot
+ *
+ * One table of function pointers, filled in once from CPUID; kmemcpy()
+ * and the other entry points are plain calls through it.  Its static
+ * initializer is the baseline, correct on every x86_64 CPU, so what runs
+ * before dispatch_x86_init() works as well.
+ *
+ *   memcpy   movsq   rep movsq for the bulk, a byte tail (baseline)
+ *            movsb   one rep movsb / stosb: ERMS (CPUID.7:EBX[9]) or
+ *                    FSRM (CPUID.7:EDX[4])
+ *   memzero  the memset variant: rep stos already fills whole lines
+ *   sum32    sse2    fpu_x86_sum32() (baseline)
+ *            avx2    CPUID.7:EBX[5], with the YMM state in XCR0
+ *   spin     pause   poll with pause in between (baseline)
+ *            umwait  WAITPKG (CPUID.7:ECX[5]): arm the monitor on the
+ *                    lock word and wait in C0.1 until it is written or
+ *                    UMWAIT_TSC cycles pass, leaving the core to an SMT
+ *                    sibling meanwhile
+ */
+#include "dispatch_x86.h"
+#include "string_x86.h"
+#include "fpu_x86.h"
+#include "cpuid.h"
+#include "tsc.h"
+#include "hal.h"
+#include "string.h"
+#include "log/klog.h"
+
+#define CPUID7_EBX_AVX2     (1u << 5)
+#define CPUID7_EBX_ERMS     (1u << 9)
+#define CPUID7_ECX_WAITPKG  (1u << 5)
+#define CPUID7_EDX_FSRM     (1u << 4)
+#define XCR0_SSE_AVX        0x06ULL
+
+#define UMWAIT_TSC          65536       /* upper bound on one wait       */
+#define UMWAIT_C01          1           /* ECX: lighter state, fast exit */
+
+static void spin_wait_pause(const uint16_t *p, uint16_t v)
+{
+    while (__atomic_load_n(p, __ATOMIC_ACQUIRE) != v)
+        __asm__ volatile ("pause");
+}
+
+/* The second load closes the window between the first one and UMONITOR:
+ * a write that lands in it would not end the wait */
+static void spin_wait_umwait(const uint16_t *p, uint16_t v)
+{
+    while (__atomic_load_n(p, __ATOMIC_ACQUIRE) != v) {
+        __asm__ volatile ("umonitor %0" :: "r"(p) : "memory");
+        if (__atomic_load_n(p, __ATOMIC_ACQUIRE) == v)
+            break;
+        uint64_t until = rdtsc() + UMWAIT_TSC;
+        __asm__ volatile ("umwait %0"
+                          :: "r"(UMWAIT_C01), "a"((uint32_t)until),
+                             "d"((uint32_t)(until >> 32))
+                          : "memory", "cc");
+    }
+}
+
+static struct {
+    void    *(*memcpy)(void *dst, const void *src, size_t n);
+    void    *(*memset)(void *dst, int val, size_t n);
+    uint64_t (*sum32)(const void *p, uint64_t n);
+    void     (*spin_wait)(const uint16_t *p, uint16_t v);
+    const char *name[HAL_VAR_COUNT];
+} s_ops = {
+    string_x86_memcpy_movsq,
+    string_x86_memset_stosq,
+    fpu_x86_sum32,
+    spin_wait_pause,
+    { "movsq", "stosq", "sse2", "pause" },
+};
+
+static int s_picked;
+
+void dispatch_x86_init(void)
+{
+    if (s_picked)
+        return;
+    s_picked = 1;
+
+    uint32_t max, eax, ebx, ecx, edx;
+    do_cpuid(0, 0, &max, &ebx, &ecx, &edx);
+    ebx = ecx = edx = 0;
+    if (max >= 7)
+        do_cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+
+    if ((ebx & CPUID7_EBX_ERMS) || (edx & CPUID7_EDX_FSRM)) {
+        s_ops.memcpy = string_x86_memcpy_movsb;
+        s_ops.memset = string_x86_memset_stosb;
+        s_ops.name[HAL_VAR_MEMCPY]  = "movsb";
+        s_ops.name[HAL_VAR_MEMZERO] = "stosb";
+    }
+    if ((ebx & CPUID7_EBX_AVX2) &&
+        (fpu_x86_xcr0() & XCR0_SSE_AVX) == XCR0_SSE_AVX) {
+        s_ops.sum32 = fpu_x86_sum32_avx2;
+        s_ops.name[HAL_VAR_SUM32] = "avx2";
+    }
+    if (ecx & CPUID7_ECX_WAITPKG) {
+        s_ops.spin_wait = spin_wait_umwait;
+        s_ops.name[HAL_VAR_SPIN] = "umwait";
+    }
+
+    klog("[cpu] variants: memcpy %s, memzero %s, sum32 %s, spin %s",
+         s_ops.name[HAL_VAR_MEMCPY], s_ops.name[HAL_VAR_MEMZERO],
+         s_ops.name[HAL_VAR_SUM32], s_ops.name[HAL_VAR_SPIN]);
+}
+
+/* ── Entry points (string.h, hal.h) ───────────────────────────────── */
+
+void *kmemcpy(void *dst, const void *src, size_t n)
+{
+    return s_ops.memcpy(dst, src, n);
+}
+
+void *kmemset(void *dst, int val, size_t n)
+{
+    return s_ops.memset(dst, val, n);
+}
+
+void *kmemzero(void *dst, size_t n)
+{
+    return s_ops.memset(dst, 0, n);
+}
+
+uint64_t hal_simd_sum32(const void *p, uint64_t n)
+{
+    return s_ops.sum32(p, n);
+}
+
+void hal_spin_wait(const uint16_t *p, uint16_t v)
+{
+    s_ops.spin_wait(p, v);
+}
+
+const char *hal_variant(hal_var_t v)
+{
+    return (uint32_t)v < HAL_VAR_COUNT ? s_ops.name[v] : "?";
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+/* Fill in the variant table (hal.h, CPU-specific variants) from CPUID.
+ * The first call does the work: on the boot CPU, after
+ * fpu_x86_cpu_init(), whose XCR0 decides whether AVX can be used.
+ * Later calls return at once. */
+void dispatch_x86_init(void);
@@ -0,0 +1,87 @@
+/* arch/x86_64/e820.c — BIOS E820 memory map access
+ *
+ * stage2.asm stores the raw E820 entries in low memory before leaving
+ * real mode.  The map is only read here; overlaps between entries are
+ * resolved by the frame allocator, which frees usable ranges first and
+ * then re-reserves every non-usable range on top of them.
+ */
+#include "e820.h"
+#include <stdint.h>
+
+/* Written by _start in entry.asm from the RDI value stage2 passes */
+extern volatile uint64_t g_e820_addr;
+
+static const e820_map_t *e820_map(void)
+{
+    const e820_map_t *map = (const e820_map_t *)g_e820_addr;
+    if (!map || map->count == 0 || map->count > E820_MAX_ENTRIES)
+        return 0;
+    return map;
+}
+
+static int entry_valid(const e820_entry_t *e)
+{
+    return e->length != 0 && (e->ext_attr & 1);
+}
+
+uint64_t e820_usable_bytes(void)
+{
+    const e820_map_t *map = e820_map();
+    uint64_t total = 0;
+    if (!map)
+        return 0;
+
+    for (uint32_t i = 0; i < map->count; i++) {
+        const e820_entry_t *e = &map->entries[i];
+        if (entry_valid(e) && e->type == E820_USABLE)
+            total += e->length;
+    }
+    return total;
+}
+
+static uint32_t collect(hal_mem_region_t *out, uint32_t max, int usable)
+{
+    const e820_map_t *map = e820_map();
+    uint32_t n = 0;
+    if (!map)
+        return 0;
+
+    for (uint32_t i = 0; i < map->count && n < max; i++) {
+        const e820_entry_t *e = &map->entries[i];
+        if (!entry_valid(e) || (e->type == E820_USABLE) != usable)
+            continue;
+        out[n].base = e->base;
+        out[n].size = e->length;
+        n++;
+    }
+    return n;
+}
+
+uint32_t e820_usable_regions(hal_mem_region_t *out, uint32_t max)
+{
+    return collect(out, max, 1);
+}
+
+uint32_t e820_reserved_regions(hal_mem_region_t *out, uint32_t max)
+{
+    return collect(out, max, 0);
+}
+
+uint32_t e820_ram_regions(hal_mem_region_t *out, uint32_t max)
+{
+    const e820_map_t *map = e820_map();
+    uint32_t n = 0;
+    if (!map)
+        return 0;
+
+    for (uint32_t i = 0; i < map->count && n < max; i++) {
+        const e820_entry_t *e = &map->entries[i];
+        if (!entry_valid(e) || (e->type != E820_USABLE &&
+                                e->type != E820_ACPI && e->type != E820_NVS))
+            continue;
+        out[n].base = e->base;
+        out[n].size = e->length;
+        n++;
+    }
+    return n;
+}
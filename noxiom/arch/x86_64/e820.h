@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+#include "hal.h"
+
+/* BIOS INT 15h E820 memory map, saved by stage2.asm at 0x500 and handed
+ * to the kernel in RDI (stored into g_e820_addr by entry.asm).
+ * The layout must match the E820_MAP block in boot/stage2.asm. */
+
+#define E820_MAX_ENTRIES 64
+
+#define E820_USABLE      1
+#define E820_RESERVED    2
+#define E820_ACPI        3      /* ACPI tables, reclaimable after parsing */
+#define E820_NVS         4
+#define E820_BAD         5
+
+typedef struct __attribute__((packed)) {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t ext_attr;          /* ACPI 3.x: bit 0 clear = ignore entry */
+} e820_entry_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t     count;
+    uint32_t     reserved;
+    e820_entry_t entries[E820_MAX_ENTRIES];
+} e820_map_t;
+
+/* Total bytes of usable (type 1) RAM, 0 if stage2 found no map. */
+uint64_t e820_usable_bytes(void);
+
+/* Copy usable / non-usable ranges into out[], returns the count. */
+uint32_t e820_usable_regions(hal_mem_region_t *out, uint32_t max);
+uint32_t e820_reserved_regions(hal_mem_region_t *out, uint32_t max);
+/* Ranges backed by DRAM whoever owns them (usable, ACPI, NVS): what the
+ * page tables map write-back. */
+uint32_t e820_ram_regions(hal_mem_region_t *out, uint32_t max);
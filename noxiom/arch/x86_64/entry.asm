@@ -1,20 +1,34 @@
 ; Noxiom OS - 64-bit Kernel Entry Point
 ; _start is first in the binary (enforced by linker.ld).
-; Also contains: ISR/IRQ stubs, gdt_flush, idt_load.
+; Also contains: ISR/IRQ stubs, LAPIC vector stubs, gdt_flush, idt_load,
+; context_switch, the SYSCALL entry and user_enter.
 
 [BITS 64]
 
 extern kmain
 extern isr_handler
 extern irq_handler
+extern syscall_dispatch
 
 global _start
 global gdt_flush
 global idt_load
+global context_switch
+global thread_trampoline
+global syscall_entry
+global user_enter
+global user_resume
+global g_e820_addr
+global g_boot_hdr_addr
 
 ; ─── Kernel Entry ──────────────────────────────────────────────────────────────
+; stage2 passes the physical address of the saved E820 map in RDI and
+; of the kernel header (boot/kernel_hdr.inc) in RSI, and has already
+; zeroed .bss (KH_MEM_SIZE).
 
 _start:
+    mov [g_e820_addr], rdi
+    mov [g_boot_hdr_addr], rsi
     mov rsp, stack_top
     xor rbp, rbp
     call kmain
@@ -42,7 +56,8 @@ _start:
         jmp isr_common_stub
 %endmacro
 
-; IRQ stubs (IRQs 0-15 mapped to vectors 32-47 after PIC remapping)
+; IRQ stubs: device IRQ n arrives on vector 32 + n, from the 8259 (0-15),
+; the IOAPIC (GSIs) or MSI (see idt.h)
 %macro IRQ 2
     global irq%1
     irq%1:
@@ -86,7 +101,7 @@ ISR_NOERRCODE 29
 ISR_ERRCODE   30    ; #SX Security Exception
 ISR_NOERRCODE 31
 
-; ─── IRQ Stubs (0–15) ──────────────────────────────────────────────────────────
+; ─── IRQ Stubs (0–191) ─────────────────────────────────────────────────────────
 
 IRQ  0, 32  ; PIT timer
 IRQ  1, 33  ; PS/2 keyboard
@@ -105,12 +120,60 @@ IRQ 13, 45
 IRQ 14, 46
 IRQ 15, 47
 
+; IOAPIC GSIs 16-63 and MSI: no fixed meaning, generated
+IRQ_COUNT equ 192                   ; must match IDT_NR_IRQS in idt.h
+
+%assign i 16
+%rep IRQ_COUNT - 16
+    IRQ %[i], %[i + 32]
+%assign i i + 1
+%endrep
+
+; Stub addresses in IRQ order, for idt.c to fill the gates from
+section .rodata
+align 8
+global irq_stub_table
+irq_stub_table:
+%assign i 0
+%rep IRQ_COUNT
+    dq irq%[i]
+%assign i i + 1
+%endrep
+section .text
+
+; ─── Local APIC vectors ────────────────────────────────────────────────────────
+; Same path as the PIC IRQs; irq_handler() tells them apart by vector
+; (values must match lapic.h).
+
+%macro LAPIC_IRQ 2
+    global %1
+    %1:
+        push qword 0
+        push qword %2
+        jmp irq_common_stub
+%endmacro
+
+LAPIC_IRQ isr_lapic_pmi,   0xEE     ; performance counter overflow
+LAPIC_IRQ isr_lapic_timer, 0xEF     ; LAPIC timer (scheduler tick)
+LAPIC_IRQ isr_lapic_kick,  0xF0     ; wake-up IPI
+
+; Spurious vector (0xFF): must not be EOI'd, nothing to save.
+global isr_spurious
+isr_spurious:
+    iretq
+
 ; ─── Common ISR Stub ───────────────────────────────────────────────────────────
 ; Stack at entry (bottom to top):
 ;   [err_code / 0] [int_no] <-- pushed by macro
 ;   [rip] [cs] [rflags] [rsp] [ss] <-- pushed by CPU
+; Coming from user mode (CS RPL 3), GS still has the user's base: SWAPGS
+; on the way in and again on the way out.
 
 isr_common_stub:
+    test qword [rsp + 24], 3
+    jz .from_kernel
+    swapgs
+.from_kernel:
     push rax
     push rbx
     push rcx
@@ -146,12 +209,20 @@ isr_common_stub:
     pop rbx
     pop rax
 
+    test qword [rsp + 24], 3
+    jz .to_kernel
+    swapgs
+.to_kernel:
     add rsp, 16             ; discard int_no + err_code
     iretq
 
 ; ─── Common IRQ Stub ───────────────────────────────────────────────────────────
 
 irq_common_stub:
+    test qword [rsp + 24], 3
+    jz .from_kernel
+    swapgs
+.from_kernel:
     push rax
     push rbx
     push rcx
@@ -187,20 +258,23 @@ irq_common_stub:
     pop rbx
     pop rax
 
+    test qword [rsp + 24], 3
+    jz .to_kernel
+    swapgs
+.to_kernel:
     add rsp, 16
     iretq
 
 ; ─── GDT Flush ─────────────────────────────────────────────────────────────────
 ; void gdt_flush(uint64_t gdt_ptr_addr);
-; Loads the GDTR, reloads all segment registers.
+; Loads the GDTR, reloads CS, DS, ES and SS.  FS and GS are left alone:
+; loading GS would zero GS_BASE, which holds the per-CPU area pointer.
 
 gdt_flush:
     lgdt [rdi]
     mov ax, 0x10            ; kernel data segment
     mov ds, ax
     mov es, ax
-    mov fs, ax
-    mov gs, ax
     mov ss, ax
     pop rax                 ; grab return address
     push qword 0x08         ; kernel code segment selector
@@ -215,6 +289,231 @@ idt_load:
     sti
     ret
 
+; ─── Context Switch ────────────────────────────────────────────────────────────
+; void context_switch(void **save_sp, void *new_sp);
+; Pushes the SysV callee-saved registers, stores RSP in *save_sp, switches to
+; new_sp and pops the same frame from there.  RFLAGS is not saved: callers
+; switch with IRQs masked and restore their own flags afterwards.
+
+context_switch:
+    push rbp
+    push rbx
+    push r12
+    push r13
+    push r14
+    push r15
+    mov [rdi], rsp
+    mov rsp, rsi
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbx
+    pop rbp
+    ret
+
+; First "return" of a new thread (frame built by hal_context_init()):
+; rbx = entry, r12 = argument.
+thread_trampoline:
+    and rsp, -16            ; SysV: 16-byte aligned at the call
+    mov rdi, r12
+    call rbx
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+; ─── SYSCALL Entry ─────────────────────────────────────────────────────────────
+; From user mode only (LSTAR, see syscall_x86.c).  The CPU has put the user
+; RIP in RCX and RFLAGS in R11 and masked IF; RSP is still the user's.
+; Number in RAX, arguments in RDI RSI RDX R10 R8 R9, result in RAX; all
+; other registers survive.  The callee-saved ones are saved too, though
+; syscall_dispatch keeps them anyway: the frame at the top of the kernel
+; stack then holds every user register, which is what fork copies
+; (syscall_frame_t, syscall_x86.h).  Offsets are those of hal_percpu_hdr_t.
+
+PERCPU_KERNEL_SP equ 16
+PERCPU_USER_SP   equ 24
+SYSCALL_FRAME_SIZE equ 15 * 8
+
+syscall_entry:
+    swapgs
+    mov [gs:PERCPU_USER_SP], rsp
+    mov rsp, [gs:PERCPU_KERNEL_SP]
+    push qword [gs:PERCPU_USER_SP]
+    push r11
+    push rcx
+    push rdi
+    push rsi
+    push rdx
+    push r10
+    push r8
+    push r9
+    push rbx
+    push rbp
+    push r12
+    push r13
+    push r14
+    push r15
+    sti                     ; everything the next syscall may clobber is saved
+
+    ; syscall_dispatch(nr, a0, a1, a2, a3, a4, a5); a5 goes on the stack,
+    ; which also brings RSP back to a multiple of 16
+    push r9
+    mov r9, r8
+    mov r8, r10
+    mov rcx, rdx
+    mov rdx, rsi
+    mov rsi, rdi
+    mov rdi, rax
+    call syscall_dispatch
+    add rsp, 8
+
+    cli
+syscall_exit:
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+    pop r9
+    pop r8
+    pop r10
+    pop rdx
+    pop rsi
+    pop rdi
+    pop rcx
+    pop r11
+    pop rsp
+    swapgs
+    o64 sysret
+
+; void user_resume(const syscall_frame_t *frame, uint64_t ret);
+; Returns to user mode as from a system call, with the registers in
+; *frame (laid out as syscall_entry saves them) and RAX = ret.  The frame
+; is copied to the top of the kernel stack first, off the C stack that
+; is being abandoned; the next entry from user mode starts there again.
+
+user_resume:
+    cli
+    mov rax, rsi
+    mov rsi, rdi
+    mov rsp, [gs:PERCPU_KERNEL_SP]
+    sub rsp, SYSCALL_FRAME_SIZE
+    mov rdi, rsp
+    mov ecx, SYSCALL_FRAME_SIZE / 8
+    cld
+    rep movsq
+    jmp syscall_exit
+
+; ─── User Entry ────────────────────────────────────────────────────────────────
+; void user_enter(uint64_t entry, uint64_t sp, uint64_t arg0, uint64_t arg1);
+; Drops to ring 3 at entry with RDI = arg0, RSI = arg1, IF set and every
+; other register zeroed.  The kernel stack is abandoned: the next entry
+; from user mode starts again at the top set by hal_uspace_switch().
+
+user_enter:
+    cli
+    mov r11, rsi
+    mov rax, rdx
+    mov rsi, rcx
+    mov rcx, rdi
+    mov rdi, rax
+    mov rsp, r11
+    mov r11, 0x202          ; IF, plus the always-one bit 1
+    xor eax, eax
+    xor ebx, ebx
+    xor edx, edx
+    xor ebp, ebp
+    xor r8d, r8d
+    xor r9d, r9d
+    xor r10d, r10d
+    xor r12d, r12d
+    xor r13d, r13d
+    xor r14d, r14d
+    xor r15d, r15d
+    swapgs
+    o64 sysret
+
+; ─── User Demo Program ─────────────────────────────────────────────────────────
+; hal_user_demo (hal.h): position-independent, copied into a user page.
+; SYS_* numbers and vdso_data_t offsets must match user/abi.h.
+
+SYS_EXIT         equ 0
+SYS_WRITE        equ 1
+SYS_GETCPU       equ 3
+SYS_CLOCK        equ 4
+VDSO_SEQ         equ 0
+VDSO_COUNTER     equ 4
+VDSO_SHIFT       equ 8
+VDSO_BASE        equ 16
+VDSO_MULT        equ 24
+VDSO_COUNTER_TSC equ 1
+
+section .rodata
+global hal_user_demo
+global hal_user_demo_end
+hal_user_demo:
+    mov r12, rdi            ; syscalls to make
+    mov r13, rsi            ; vdso_data_t
+    mov eax, SYS_WRITE
+    mov edi, 1
+    lea rsi, [rel .msg]
+    mov edx, .msg_end - .msg
+    syscall
+.loop:
+    test r12, r12
+    jz .clock
+    mov eax, SYS_GETCPU
+    syscall
+    dec r12
+    jmp .loop
+
+    ; Exit with the time, read the way the vDSO page says
+.clock:
+    cmp dword [r13 + VDSO_COUNTER], VDSO_COUNTER_TSC
+    jne .slow
+.retry:
+    mov r14d, [r13 + VDSO_SEQ]
+    test r14d, 1
+    jnz .retry
+    rdtscp                  ; ECX = CPU, from TSC_AUX
+    shl rdx, 32
+    or rax, rdx
+    sub rax, [r13 + VDSO_BASE]
+    mul qword [r13 + VDSO_MULT]
+    mov ecx, [r13 + VDSO_SHIFT]
+    shrd rax, rdx, cl
+    cmp r14d, [r13 + VDSO_SEQ]
+    jne .retry
+    jmp .exit
+.slow:
+    mov eax, SYS_CLOCK
+    syscall
+.exit:
+    mov rdi, rax
+    mov eax, SYS_EXIT
+    syscall
+    ud2
+.msg:
+    db "hello from user mode", 10
+.msg_end:
+hal_user_demo_end:
+section .text
+
+; ─── g_e820_addr — E820 map pointer from stage2, read by hal_hw_detect() ──────
+
+section .data
+align 8
+g_e820_addr:
+    dq 0
+
+; ─── g_boot_hdr_addr — kernel header from stage2, for its KH_TSC_* stamps ─────
+
+g_boot_hdr_addr:
+    dq 0
+
 ; ─── Kernel Stack ──────────────────────────────────────────────────────────────
 
 section .bss
@@ -0,0 +1,258 @@
+/* arch/x86_64/fpu_x86.c — x87/SSE/AVX state, CR0.TS, an SSE2 checksum
+ *
+ * The boot loader leaves CR4.OSFXSR clear, so until this runs every SSE
+ * instruction is #UD.  Here each CPU gets:
+ *
+ *   CR0   EM clear, MP and NE set (x87 errors as #MF, not IRQ 13), TS set
+ *         so the first FP instruction is #NM; sched/fpu.c clears it
+ *   CR4   OSFXSR, OSXMMEXCPT; OSXSAVE with XSAVE (CPUID.1:ECX[26])
+ *   XCR0  x87, SSE, AVX and AVX-512 as CPUID.(0xD,0) offers them; the
+ *         three AVX-512 components only together, AMX and MPX never
+ *
+ * With XSAVE the state is the standard (non-compacted) format, as many
+ * bytes as CPUID.(0xD,0).EBX says for that XCR0, saved with XSAVEOPT
+ * where CPUID.(0xD,1).EAX[0] has it — it skips components still in their
+ * initial state or unchanged since the XRSTOR from the same buffer,
+ * which is what a thread's page always was.  Without XSAVE it is the
+ * 512-byte FXSAVE image.
+ *
+ * The kernel is built -mno-sse: none of the registers XRSTOR loads are
+ * ever in use by compiled code, so the asm does not list them.  The
+ * SSE2 and AVX2 loops are functions of their own with the target
+ * attribute; dispatch_x86.c picks one.
+ */
+#include "fpu_x86.h"
+#include "cpuid.h"
+#include "string.h"
+#include "log/klog.h"
+
+#define CR0_MP              (1ULL << 1)
+#define CR0_EM              (1ULL << 2)
+#define CR0_TS              (1ULL << 3)
+#define CR0_NE              (1ULL << 5)
+#define CR4_OSFXSR          (1ULL << 9)
+#define CR4_OSXMMEXCPT      (1ULL << 10)
+#define CR4_OSXSAVE         (1ULL << 18)
+#define CPUID1_ECX_XSAVE    (1u << 26)
+#define CPUIDD1_EAX_XSAVEOPT (1u << 0)
+
+#define XCR0_X87_SSE_AVX    0x07ULL
+#define XCR0_AVX512         0xE0ULL     /* opmask, ZMM_Hi256, Hi16_ZMM   */
+
+#define FXSAVE_SIZE         512
+#define FXSAVE_FCW          0           /* offsets in the legacy image   */
+#define FXSAVE_MXCSR        24
+#define FCW_INIT            0x037F      /* all x87 exceptions masked     */
+#define MXCSR_INIT          0x1F80      /* all SSE exceptions masked     */
+
+enum { FPU_FXSAVE, FPU_XSAVE, FPU_XSAVEOPT };
+
+static int      s_mode = -1;            /* set by the boot CPU           */
+static uint64_t s_xcr0;
+static uint32_t s_size = FXSAVE_SIZE;
+
+static inline uint64_t read_cr0(void)
+{
+    uint64_t v;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr0(uint64_t v)
+{
+    __asm__ volatile ("mov %0, %%cr0" :: "r"(v) : "memory");
+}
+
+static inline void xsetbv(uint32_t reg, uint64_t v)
+{
+    __asm__ volatile ("xsetbv" :: "c"(reg), "a"((uint32_t)v),
+                      "d"((uint32_t)(v >> 32)));
+}
+
+/* The save format and, with XSAVE, the XCR0 every CPU uses */
+static int pick_mode(void)
+{
+    uint32_t max, eax, ebx, ecx, edx;
+    do_cpuid(0, 0, &max, &ebx, &ecx, &edx);
+    do_cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    if (max < 0xD || !(ecx & CPUID1_ECX_XSAVE))
+        return FPU_FXSAVE;
+
+    do_cpuid(0xD, 0, &eax, &ebx, &ecx, &edx);
+    s_xcr0 = eax & XCR0_X87_SSE_AVX;
+    if ((eax & XCR0_AVX512) == XCR0_AVX512)
+        s_xcr0 |= XCR0_AVX512;
+    do_cpuid(0xD, 1, &eax, &ebx, &ecx, &edx);
+    return eax & CPUIDD1_EAX_XSAVEOPT ? FPU_XSAVEOPT : FPU_XSAVE;
+}
+
+void fpu_x86_cpu_init(void)
+{
+    int boot = s_mode < 0;
+    if (boot)
+        s_mode = pick_mode();
+
+    uint64_t cr4;
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    if (s_mode != FPU_FXSAVE)
+        cr4 |= CR4_OSXSAVE;
+    __asm__ volatile ("mov %0, %%cr4" :: "r"(cr4) : "memory");
+    if (s_mode != FPU_FXSAVE)
+        xsetbv(0, s_xcr0);
+
+    if (boot) {
+        static const char *const names[] = { "fxsave", "xsave",
+                                             "xsaveopt" };
+        if (s_mode != FPU_FXSAVE) {
+            uint32_t eax, ebx, ecx, edx;
+            do_cpuid(0xD, 0, &eax, &ebx, &ecx, &edx);
+            s_size = ebx;           /* for the XCR0 just set             */
+        }
+        klog("[fpu] %s, %u-byte state, xcr0 0x%lx", names[s_mode], s_size,
+             (unsigned long)s_xcr0);
+    }
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+}
+
+uint32_t fpu_x86_state_size(void)
+{
+    return s_size;
+}
+
+/* Zero is the initial state of everything but the two control words;
+ * an all-zero XSAVE header has XRSTOR start every component afresh */
+void fpu_x86_init_state(void *buf)
+{
+    uint8_t *b = buf;
+    kmemset(b, 0, s_size);
+    *(uint16_t *)(b + FXSAVE_FCW)   = FCW_INIT;
+    *(uint32_t *)(b + FXSAVE_MXCSR) = MXCSR_INIT;
+}
+
+uint64_t fpu_x86_xcr0(void)
+{
+    return s_xcr0;
+}
+
+void fpu_x86_on(void)
+{
+    __asm__ volatile ("clts" ::: "memory");
+}
+
+void fpu_x86_off(void)
+{
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+void fpu_x86_save(void *buf)
+{
+    uint32_t lo = (uint32_t)s_xcr0, hi = (uint32_t)(s_xcr0 >> 32);
+    if (s_mode == FPU_XSAVEOPT)
+        __asm__ volatile ("xsaveopt64 (%0)"
+                          :: "r"(buf), "a"(lo), "d"(hi) : "memory");
+    else if (s_mode == FPU_XSAVE)
+        __asm__ volatile ("xsave64 (%0)"
+                          :: "r"(buf), "a"(lo), "d"(hi) : "memory");
+    else
+        __asm__ volatile ("fxsave64 (%0)" :: "r"(buf) : "memory");
+}
+
+void fpu_x86_restore(const void *buf)
+{
+    uint32_t lo = (uint32_t)s_xcr0, hi = (uint32_t)(s_xcr0 >> 32);
+    if (s_mode == FPU_FXSAVE)
+        __asm__ volatile ("fxrstor64 (%0)" :: "r"(buf) : "memory");
+    else
+        __asm__ volatile ("xrstor64 (%0)"
+                          :: "r"(buf), "a"(lo), "d"(hi) : "memory");
+}
+
+/* 64 bytes a round: each 32-bit word is widened against a zero register
+ * and added into one of two pairs of 64-bit lanes */
+__attribute__((target("sse2")))
+uint64_t fpu_x86_sum32(const void *p, uint64_t n)
+{
+    uint64_t lo, hi;
+    if (!n)
+        return 0;
+    __asm__ volatile (
+        "pxor      %%xmm0, %%xmm0\n\t"
+        "pxor      %%xmm1, %%xmm1\n\t"
+        "pxor      %%xmm7, %%xmm7\n"
+        "1:\n\t"
+        "movdqu    (%[p]), %%xmm2\n\t"
+        "movdqu    16(%[p]), %%xmm4\n\t"
+        "movdqa    %%xmm2, %%xmm3\n\t"
+        "movdqa    %%xmm4, %%xmm5\n\t"
+        "punpckldq %%xmm7, %%xmm2\n\t"
+        "punpckhdq %%xmm7, %%xmm3\n\t"
+        "punpckldq %%xmm7, %%xmm4\n\t"
+        "punpckhdq %%xmm7, %%xmm5\n\t"
+        "paddq     %%xmm2, %%xmm0\n\t"
+        "paddq     %%xmm3, %%xmm1\n\t"
+        "paddq     %%xmm4, %%xmm0\n\t"
+        "paddq     %%xmm5, %%xmm1\n\t"
+        "movdqu    32(%[p]), %%xmm2\n\t"
+        "movdqu    48(%[p]), %%xmm4\n\t"
+        "movdqa    %%xmm2, %%xmm3\n\t"
+        "movdqa    %%xmm4, %%xmm5\n\t"
+        "punpckldq %%xmm7, %%xmm2\n\t"
+        "punpckhdq %%xmm7, %%xmm3\n\t"
+        "punpckldq %%xmm7, %%xmm4\n\t"
+        "punpckhdq %%xmm7, %%xmm5\n\t"
+        "paddq     %%xmm2, %%xmm0\n\t"
+        "paddq     %%xmm3, %%xmm1\n\t"
+        "paddq     %%xmm4, %%xmm0\n\t"
+        "paddq     %%xmm5, %%xmm1\n\t"
+        "add       $64, %[p]\n\t"
+        "sub       $64, %[n]\n\t"
+        "jnz       1b\n\t"
+        "paddq     %%xmm1, %%xmm0\n\t"
+        "movq      %%xmm0, %[lo]\n\t"
+        "punpckhqdq %%xmm0, %%xmm0\n\t"
+        "movq      %%xmm0, %[hi]"
+        : [p] "+r"(p), [n] "+r"(n), [lo] "=r"(lo), [hi] "=r"(hi)
+        :
+        : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm7",
+          "memory", "cc");
+    return lo + hi;
+}
+
+/* The same sum, 16 bytes a step: VPMOVZXDQ widens four 32-bit words
+ * straight from memory into 64-bit lanes, so a round is four loads and
+ * four adds.  VZEROUPPER before returning keeps later SSE code (a user
+ * thread's, after the state is restored) off the AVX-SSE transition
+ * penalty. */
+__attribute__((target("avx2")))
+uint64_t fpu_x86_sum32_avx2(const void *p, uint64_t n)
+{
+    uint64_t lo, hi;
+    if (!n)
+        return 0;
+    __asm__ volatile (
+        "vpxor      %%ymm0, %%ymm0, %%ymm0\n\t"
+        "vpxor      %%ymm1, %%ymm1, %%ymm1\n"
+        "1:\n\t"
+        "vpmovzxdq  (%[p]), %%ymm2\n\t"
+        "vpmovzxdq  16(%[p]), %%ymm3\n\t"
+        "vpaddq     %%ymm2, %%ymm0, %%ymm0\n\t"
+        "vpaddq     %%ymm3, %%ymm1, %%ymm1\n\t"
+        "vpmovzxdq  32(%[p]), %%ymm2\n\t"
+        "vpmovzxdq  48(%[p]), %%ymm3\n\t"
+        "vpaddq     %%ymm2, %%ymm0, %%ymm0\n\t"
+        "vpaddq     %%ymm3, %%ymm1, %%ymm1\n\t"
+        "add        $64, %[p]\n\t"
+        "sub        $64, %[n]\n\t"
+        "jnz        1b\n\t"
+        "vpaddq     %%ymm1, %%ymm0, %%ymm0\n\t"
+        "vextracti128 $1, %%ymm0, %%xmm1\n\t"
+        "vpaddq     %%xmm1, %%xmm0, %%xmm0\n\t"
+        "vmovq      %%xmm0, %[lo]\n\t"
+        "vpextrq    $1, %%xmm0, %[hi]\n\t"
+        "vzeroupper"
+        : [p] "+r"(p), [n] "+r"(n), [lo] "=r"(lo), [hi] "=r"(hi)
+        :
+        : "xmm0", "xmm1", "xmm2", "xmm3", "memory", "cc");
+    return lo + hi;
+}
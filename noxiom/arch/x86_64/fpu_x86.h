@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+
+/* FP/SIMD unit for hal.h.  fpu_x86_cpu_init() sets CR0/CR4 (and XCR0
+ * when there is XSAVE) on the calling CPU and leaves the unit off; every
+ * CPU, the boot CPU first, which picks the save format for all of them.
+ * The rest are hal_fpu_*() and the hal_simd_sum32() variants, with the
+ * unit on where hal.h says so; fpu_x86_xcr0() is 0 without XSAVE. */
+void     fpu_x86_cpu_init(void);
+uint32_t fpu_x86_state_size(void);
+void     fpu_x86_init_state(void *buf);
+void     fpu_x86_on(void);
+void     fpu_x86_off(void);
+void     fpu_x86_save(void *buf);
+void     fpu_x86_restore(const void *buf);
+uint64_t fpu_x86_xcr0(void);
+uint64_t fpu_x86_sum32(const void *p, uint64_t n);
+uint64_t fpu_x86_sum32_avx2(const void *p, uint64_t n);
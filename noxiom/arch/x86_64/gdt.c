@@ -1,4 +1,5 @@
 #include "gdt.h"
+#include "hal.h"
 #include <stdint.h>
 
 /* GDT entry (8 bytes) */
@@ -17,9 +18,25 @@ typedef struct __attribute__((packed)) {
     uint64_t base;
 } gdt_ptr_t;
 
-/* Kernel GDT: null, code, data */
-static gdt_entry_t gdt[3];
+/* 64-bit TSS: only RSP0 is used (no IST stacks, no I/O bitmap) */
+typedef struct __attribute__((packed)) {
+    uint32_t reserved0;
+    uint64_t rsp[3];
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} tss_t;
+
+/* null, kernel code, kernel data, user data, user code, then one TSS
+ * descriptor (two entries) per CPU */
+#define GDT_TSS_FIRST  5
+#define GDT_ENTRIES    (GDT_TSS_FIRST + 2 * HAL_MAX_CPUS)
+
+static gdt_entry_t gdt[GDT_ENTRIES];
 static gdt_ptr_t   gdt_ptr;
+static tss_t       tss[HAL_MAX_CPUS];
 
 extern void gdt_flush(uint64_t ptr);
 
@@ -33,6 +50,20 @@ static void gdt_set(int i, uint32_t base, uint32_t limit,
     gdt[i].access      = access;
 }
 
+/* A system descriptor takes two entries; the second holds base 63:32 */
+static void gdt_set_tss(int i, const tss_t *t) {
+    uint64_t base = (uint64_t)(uintptr_t)t;
+    gdt_set(i, (uint32_t)base, sizeof(tss_t) - 1, 0x89, 0x00);
+    gdt[i + 1] = (gdt_entry_t){ 0 };
+    gdt[i + 1].limit_low = (uint16_t)(base >> 32);
+    gdt[i + 1].base_low  = (uint16_t)(base >> 48);
+}
+
+static void load_tss(uint32_t cpu) {
+    uint16_t sel = (uint16_t)((GDT_TSS_FIRST + 2 * cpu) * 8);
+    __asm__ volatile ("ltr %0" :: "r"(sel) : "memory");
+}
+
 void gdt_init(void) {
     gdt_ptr.limit = sizeof(gdt) - 1;
     gdt_ptr.base  = (uint64_t)&gdt;
@@ -40,6 +71,26 @@ void gdt_init(void) {
     gdt_set(0, 0, 0,      0x00, 0x00);  /* null */
     gdt_set(1, 0, 0xFFFFF, 0x9A, 0xA0); /* 64-bit code: execute/read, present */
     gdt_set(2, 0, 0xFFFFF, 0x92, 0xA0); /* 64-bit data: read/write,  present */
+    gdt_set(3, 0, 0xFFFFF, 0xF2, 0xA0); /* user data: as above, DPL 3 */
+    gdt_set(4, 0, 0xFFFFF, 0xFA, 0xA0); /* user code: as above, DPL 3 */
 
+    /* iomap_base past the limit: user code gets no I/O ports */
+    for (uint32_t i = 0; i < HAL_MAX_CPUS; i++) {
+        tss[i].iomap_base = sizeof(tss_t);
+        gdt_set_tss(GDT_TSS_FIRST + 2 * i, &tss[i]);
+    }
+
+    gdt_flush((uint64_t)&gdt_ptr);
+    load_tss(hal_cpu_id());
+}
+
+/* Secondary CPUs share the boot CPU's GDT; they only need to load it,
+ * and their own TSS */
+void gdt_init_ap(void) {
     gdt_flush((uint64_t)&gdt_ptr);
+    load_tss(hal_cpu_id());
+}
+
+void gdt_set_kernel_stack(uint64_t rsp0) {
+    tss[hal_cpu_id()].rsp[0] = rsp0;
 }
@@ -1,3 +1,16 @@
 #pragma once
+#include <stdint.h>
+
+/* Selectors.  SYSCALL/SYSRET (user_x86.c) need the user data segment
+ * right below the user code one, both 8 and 16 bytes past kernel data. */
+#define GDT_KCODE  0x08
+#define GDT_KDATA  0x10
+#define GDT_UDATA  0x1B             /* 0x18, RPL 3                      */
+#define GDT_UCODE  0x23             /* 0x20, RPL 3                      */
 
 void gdt_init(void);
+void gdt_init_ap(void);   /* load the GDT built by gdt_init() */
+
+/* Stack the CPU switches to when an interrupt or exception arrives in
+ * user mode (TSS.RSP0 of the calling CPU) */
+void gdt_set_kernel_stack(uint64_t rsp0);
@@ -9,8 +9,24 @@
 #include "keyboard_x86.h"
 #include "gdt.h"
 #include "idt.h"
-#include "pic.h"
+#include "intc_x86.h"
+#include "io.h"
 #include "cpuid.h"
+#include "e820.h"
+#include "acpi.h"
+#include "smp_x86.h"
+#include "lapic.h"
+#include "tsc.h"
+#include "dispatch_x86.h"
+#include "paging.h"
+#include "pmu_x86.h"
+#include "syscall_x86.h"
+#include "fpu_x86.h"
+#include "msr.h"
+#include "time/clock.h"
+#include "sched/sched.h"
+#include "sync/spinlock.h"
+#include "mm/pmm.h"
 
 /* ── Serial ──────────────────────────────────────────────────────── */
 void hal_serial_init(void)           { serial_init(); }
@@ -24,29 +40,503 @@ void hal_display_putchar(char c)      { vga_putchar(c); }
 void hal_display_print(const char *s) { vga_print(s); }
 void hal_display_set_color(uint8_t c) { vga_set_color(c); }
 
-/* ── Input (PS/2 keyboard via IRQ1) ─────────────────────────────── */
-void hal_input_init(void)  { keyboard_init(); }
-char hal_input_getchar(void) { return keyboard_getchar(); }
+/* ── Input (PS/2 keyboard via IRQ1, COM1 RX via IRQ4) ───────────── */
+static thread_t *volatile input_waiter;     /* the one blocked reader */
 
-/* ── Interrupt controller (8259 PIC) ────────────────────────────── */
-void hal_intc_init(void)             { pic_init(); }
-void hal_intc_unmask(uint32_t irq)   { pic_unmask((uint8_t)irq); }
-void hal_intc_send_eoi(uint32_t irq) { pic_send_eoi((uint8_t)irq); }
+static void input_notify(void) {
+    thread_t *t = input_waiter;
+    if (t)
+        thread_wake(t);
+}
+
+static int input_poll(char *c) {
+    return keyboard_trygetchar(c) || serial_trygetchar(c);
+}
+
+void hal_input_init(void) {
+    keyboard_init(input_notify);
+    serial_enable_irq(input_notify);
+}
+
+char hal_input_getchar(void) {
+    char c;
+    for (;;) {
+        if (input_poll(&c))
+            return c;
+        /* Publish, re-check, sleep: a key landing in between wakes us
+         * (thread_block() remembers early wakes) */
+        input_waiter = thread_current();
+        if (input_poll(&c)) {
+            input_waiter = 0;
+            return c;
+        }
+        thread_block();
+        input_waiter = 0;
+    }
+}
+
+/* ── Interrupt controller (IOAPIC or 8259, MSI: intc_x86.c) ─────── */
+void hal_intc_init(void)             { intc_x86_init(); }
+void hal_intc_unmask(uint32_t irq)   { intc_x86_unmask(irq); }
+void hal_intc_send_eoi(uint32_t irq) { intc_x86_eoi(irq); }
+int  hal_intc_set_affinity(uint32_t irq, uint32_t cpu) {
+    return intc_x86_set_affinity(irq, cpu);
+}
+
+int hal_msi_alloc(uint32_t cpu, hal_msi_write_t write, void *ctx) {
+    return intc_x86_msi_alloc(cpu, write, ctx);
+}
+void hal_msi_free(uint32_t irq)      { intc_x86_msi_free(irq); }
+
+/* ── Platform devices: none, everything is on PCI ───────────────── */
+int hal_platform_dev(const char *compat, uint32_t index,
+                     hal_platform_dev_t *out)
+{
+    (void)compat; (void)index; (void)out;
+    return -1;
+}
+
+/* ── PCI configuration space (mechanism #1) ─────────────────────── */
+#define PCI_CFG_ADDR  0xCF8
+#define PCI_CFG_DATA  0xCFC
+
+static spinlock_t pci_cfg_lock = SPINLOCK_INIT;  /* address, then data */
+
+static void pci_cfg_select(uint32_t bdf, uint32_t off)
+{
+    outl(PCI_CFG_ADDR, 0x80000000u | (bdf << 8) | (off & 0xFC));
+}
+
+uint32_t hal_pci_cfg_read(uint32_t bdf, uint32_t off, uint32_t size)
+{
+    uint16_t port = (uint16_t)(PCI_CFG_DATA + (off & 3));
+    uint64_t flags = spin_lock_irqsave(&pci_cfg_lock);
+    pci_cfg_select(bdf, off);
+    uint32_t v = size == 1 ? inb(port) : size == 2 ? inw(port) : inl(port);
+    spin_unlock_irqrestore(&pci_cfg_lock, flags);
+    return v;
+}
+
+void hal_pci_cfg_write(uint32_t bdf, uint32_t off, uint32_t size,
+                       uint32_t val)
+{
+    uint16_t port = (uint16_t)(PCI_CFG_DATA + (off & 3));
+    uint64_t flags = spin_lock_irqsave(&pci_cfg_lock);
+    pci_cfg_select(bdf, off);
+    if (size == 1)
+        outb(port, (uint8_t)val);
+    else if (size == 2)
+        outw(port, (uint16_t)val);
+    else
+        outl(port, val);
+    spin_unlock_irqrestore(&pci_cfg_lock, flags);
+}
+
+/* ── Device memory (uncached below 4 GB from boot, see paging.h) ── */
+void *hal_mmio_map(uint64_t pa, uint64_t size)
+{
+    if (pa + size > (4ULL << 30) &&
+        paging_map_mmio(pa, size, PAGING_UC) != 0)
+        return 0;
+    return phys_to_virt(pa);
+}
 
 /* ── CPU init (GDT + IDT) ───────────────────────────────────────── */
 void hal_cpu_init(void) {
     gdt_init();
     idt_init();
+    syscall_x86_cpu_init();
+    fpu_x86_cpu_init();
+    dispatch_x86_init();
+}
+
+/* ── CPU identity / interrupt state ─────────────────────────────── */
+void hal_percpu_set(hal_percpu_hdr_t *area)
+{
+    wrmsr(MSR_GS_BASE, (uint64_t)(uintptr_t)area);
+}
+
+hal_percpu_hdr_t *hal_percpu(void)
+{
+    hal_percpu_hdr_t *p;
+    __asm__ volatile ("mov %%gs:0, %0" : "=r"(p));
+    return p;
+}
+
+/* One load, so a migration can only make the answer stale, not torn */
+uint32_t hal_cpu_id(void)
+{
+    uint32_t id;
+    __asm__ volatile ("movl %%gs:%c1, %0"
+                      : "=r"(id) : "i"(offsetof(hal_percpu_hdr_t, cpu)));
+    return id;
+}
+
+uint64_t hal_irq_save(void)
+{
+    uint64_t flags;
+    __asm__ volatile ("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+void hal_irq_restore(uint64_t flags)
+{
+    if (flags & (1 << 9))   /* RFLAGS.IF */
+        __asm__ volatile ("sti" : : : "memory");
+}
+
+void hal_irq_enable(void)
+{
+    __asm__ volatile ("sti" : : : "memory");
+}
+
+void hal_irq_disable(void)
+{
+    __asm__ volatile ("cli" : : : "memory");
+}
+
+void hal_cpu_relax(void)
+{
+    __asm__ volatile ("pause");
+}
+
+/* ── Secondary CPUs (LAPIC INIT-SIPI, see smp_x86.c) ────────────── */
+int hal_cpu_start_secondary(uint32_t cpu, void *stack_top,
+                            hal_cpu_entry_t entry)
+{
+    return smp_x86_start_cpu(cpu, stack_top, entry);
+}
+
+void hal_cpu_idle(void)
+{
+    /* sti only takes effect after the next instruction, so no IRQ can
+     * slip in between and leave us halted with work pending */
+    __asm__ volatile ("sti; hlt" : : : "memory");
+}
+
+void hal_cpu_kick(uint32_t cpu)
+{
+    uint64_t flags = hal_irq_save();     /* ICR is written in two halves */
+    smp_x86_send_ipi(cpu, LAPIC_KICK_VECTOR);
+    hal_irq_restore(flags);
+}
+
+/* ── Thread context (entry.asm: context_switch, thread_trampoline) ─ */
+extern void context_switch(void **save_sp, void *new_sp);
+extern char thread_trampoline[];
+
+void *hal_context_init(void *stack_top, void (*entry)(void *), void *arg)
+{
+    /* Frame popped by context_switch: r15 r14 r13 r12 rbx rbp, ret */
+    uint64_t *sp = (uint64_t *)((uintptr_t)stack_top & ~(uintptr_t)15);
+    *--sp = 0;                                  /* alignment pad  */
+    *--sp = (uint64_t)(uintptr_t)thread_trampoline;
+    *--sp = 0;                                  /* rbp            */
+    *--sp = (uint64_t)(uintptr_t)entry;         /* rbx            */
+    *--sp = (uint64_t)(uintptr_t)arg;           /* r12            */
+    *--sp = 0;                                  /* r13            */
+    *--sp = 0;                                  /* r14            */
+    *--sp = 0;                                  /* r15            */
+    return sp;
+}
+
+void hal_context_switch(void **save_sp, void *new_sp)
+{
+    context_switch(save_sp, new_sp);
+}
+
+/* ── User mode (ring 3, SYSCALL/SYSRET) ─────────────────────────── */
+/* hal_uspace_t is the space's PML4 (paging.c) */
+void hal_user_range(uint64_t *base, uint64_t *end)
+{
+    *base = PAGING_USER_BASE;
+    *end  = PAGING_USER_END;
+}
+
+hal_uspace_t *hal_uspace_create(void)
+{
+    return (hal_uspace_t *)paging_user_create();
+}
+
+void hal_uspace_destroy(hal_uspace_t *as)
+{
+    paging_user_destroy((uint64_t *)as);
+}
+
+int hal_uspace_map(hal_uspace_t *as, uint64_t va, uint64_t pa,
+                   uint32_t flags)
+{
+    return paging_user_map((uint64_t *)as, va, pa, (flags & HAL_UMAP_W) != 0,
+                           (flags & HAL_UMAP_X) != 0);
+}
+
+uint64_t hal_uspace_lookup(hal_uspace_t *as, uint64_t va, int write)
+{
+    return paging_user_lookup((uint64_t *)as, va, write);
+}
+
+/* Interrupts from ring 3 land on TSS.RSP0, SYSCALL on the per-CPU copy */
+void hal_uspace_switch(hal_uspace_t *as, uint64_t kstack_top)
+{
+    gdt_set_kernel_stack(kstack_top);
+    hal_percpu()->kernel_sp = kstack_top;
+    paging_user_activate((uint64_t *)as);
+}
+
+void hal_user_enter(uint64_t entry, uint64_t sp, uint64_t arg0,
+                    uint64_t arg1)
+{
+    user_enter(entry, sp, arg0, arg1);
+}
+
+/* A system call's frame sits right below the top of the kernel stack
+ * hal_uspace_switch() gave the thread; IRQs masked so that is still
+ * this CPU's */
+_Static_assert(sizeof(syscall_frame_t) <= sizeof(hal_user_regs_t),
+               "hal_user_regs_t too small for a syscall frame");
+
+void hal_user_save(hal_user_regs_t *regs)
+{
+    uint64_t flags = hal_irq_save();
+    const syscall_frame_t *f =
+        (const syscall_frame_t *)(uintptr_t)hal_percpu()->kernel_sp - 1;
+    *(syscall_frame_t *)regs = *f;
+    hal_irq_restore(flags);
+}
+
+void hal_user_resume(const hal_user_regs_t *regs, uint64_t ret)
+{
+    user_resume((const syscall_frame_t *)regs, ret);
+}
+
+uint32_t hal_user_machine(void)
+{
+    return 62;                          /* EM_X86_64 */
+}
+
+void hal_user_clock(hal_user_clock_t *out)
+{
+    clock_conv_t c;
+    clock_ref_get(tsc_ref(), &out->base, &c);
+    out->mult    = c.mult;
+    out->shift   = c.shift;
+    out->counter = c.mult && syscall_x86_has_rdtscp() ? HAL_UCLOCK_TSC
+                                                      : HAL_UCLOCK_NONE;
+}
+
+/* ── FP/SIMD (fpu_x86.c) ────────────────────────────────────────── */
+uint32_t hal_fpu_state_size(void)
+{
+    return fpu_x86_state_size();
+}
+
+void hal_fpu_init_state(void *buf)
+{
+    fpu_x86_init_state(buf);
+}
+
+void hal_fpu_enable(void)
+{
+    fpu_x86_on();
+}
+
+void hal_fpu_disable(void)
+{
+    fpu_x86_off();
+}
+
+void hal_fpu_save(void *buf)
+{
+    fpu_x86_save(buf);
+}
+
+void hal_fpu_restore(const void *buf)
+{
+    fpu_x86_restore(buf);
+}
+
+/* ── Timer (TSC clock, LAPIC one-shot) ──────────────────────────── */
+static clock_conv_t s_ns_to_lapic;      /* count mode only */
+
+uint64_t hal_timer_now_ns(void)
+{
+    return tsc_to_ns(rdtsc());
+}
+
+void hal_timer_set_deadline(uint64_t ns)
+{
+    int deadline_mode = tsc_deadline_supported();
+
+    if (ns == HAL_TIMER_NEVER) {
+        if (deadline_mode)
+            lapic_timer_deadline(0);
+        else
+            lapic_timer_oneshot(0);
+        return;
+    }
+    if (deadline_mode) {
+        uint64_t tsc = tsc_from_ns(ns);
+        lapic_timer_deadline(tsc ? tsc : 1);    /* 0 would disarm */
+        return;
+    }
+
+    /* The 32-bit count caps the wait; firing early is harmless, the
+     * callback finds nothing due and sets the deadline again */
+    uint64_t now   = hal_timer_now_ns();
+    uint64_t count = ns > now ? clock_conv(s_ns_to_lapic, ns - now) : 0;
+    if (count == 0)
+        count = 1;
+    if (count > 0xFFFFFFFFu)
+        count = 0xFFFFFFFFu;
+    lapic_timer_oneshot((uint32_t)count);
+}
+
+int hal_timer_cpu_init(hal_timer_fn_t fn)
+{
+    if (!tsc_hz())
+        return -1;
+    return lapic_timer_init(tsc_deadline_supported(), fn);
+}
+
+/* ── Cycle counter (TSC) ────────────────────────────────────────── */
+uint64_t hal_cycles(void) { return rdtsc(); }
+
+/* ── Performance counters (architectural perfmon, see pmu_x86.c) ── */
+uint32_t hal_pmu_counters(void)           { return pmu_x86_counters(); }
+int      hal_pmu_has_event(uint32_t ev)   { return pmu_x86_has_event(ev); }
+void     hal_pmu_stop(void)               { pmu_x86_stop(); }
+
+int hal_pmu_count_start(const uint32_t *events, uint32_t n)
+{
+    return pmu_x86_count_start(events, n);
+}
+
+void hal_pmu_count_read(uint64_t *counts, uint32_t n)
+{
+    pmu_x86_count_read(counts, n);
+}
+
+int hal_pmu_sample_start(uint32_t event, uint64_t period,
+                         hal_pmu_sample_fn_t fn)
+{
+    return pmu_x86_sample_start(event, period, fn);
+}
+
+/* ── Boot timestamps (TSC, stage2 stamps in the kernel header) ──── */
+
+/* Offsets of the KH_TSC_* fields, see boot/kernel_hdr.inc */
+#define KH_TSC_START   40
+#define KH_TSC_LOADED  48
+#define KH_TSC_ENTRY   56
+
+/* Written by _start in entry.asm from the RSI value stage2 passes */
+extern volatile uint64_t g_boot_hdr_addr;
+
+uint64_t hal_boot_ticks(void)    { return rdtsc(); }
+uint64_t hal_boot_ticks_hz(void) { return tsc_hz(); }
+
+uint32_t hal_boot_early_marks(hal_boot_mark_t *out, uint32_t max)
+{
+    static const struct { const char *phase; uint32_t off; } stamps[] = {
+        { "stage2", KH_TSC_START  },    /* origin                      */
+        { "load",   KH_TSC_LOADED },    /* disk reads                  */
+        { "unpack", KH_TSC_ENTRY  },    /* long mode, LZ4, .bss        */
+    };
+    const uint8_t *hdr = (const uint8_t *)g_boot_hdr_addr;
+    if (!hdr || max < 3)
+        return 0;
+    for (uint32_t i = 0; i < 3; i++) {
+        out[i].phase = stamps[i].phase;
+        out[i].ticks = *(const volatile uint64_t *)(hdr + stamps[i].off);
+        if (out[i].ticks == 0)
+            return 0;               /* a loader without the stamps */
+    }
+    return 3;
+}
+
+/* ── DMA coherence (caches are snooped: ordering only) ──────────── */
+void hal_dma_sync_for_device(const void *p, size_t len)
+{
+    (void)p; (void)len;
+    __asm__ volatile ("mfence" ::: "memory");
+}
+
+void hal_dma_sync_for_cpu(void *p, size_t len)
+{
+    (void)p; (void)len;
+    __asm__ volatile ("mfence" ::: "memory");
 }
 
 /* ── Halt ────────────────────────────────────────────────────────── */
 void hal_halt(void) {
     __asm__ volatile ("cli");
+    serial_flush();             /* the TX interrupt will not come */
     for (;;)
         __asm__ volatile ("hlt");
 }
 
+/* ── Physical memory map (E820) ─────────────────────────────────── */
+
+/* Frames paging.c could not map (table pools exhausted) are not
+ * offered to the allocator. */
+#define LOW_MEM_END     0x100000ULL     /* BIOS, boot loader, page tables */
+
+extern char __kernel_end[];             /* linker.ld */
+
+uint32_t hal_mem_usable(hal_mem_region_t *out, uint32_t max)
+{
+    uint32_t n = e820_usable_regions(out, max);
+    uint32_t kept = 0;
+    uint64_t limit = paging_mapped_limit();
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t base = out[i].base;
+        uint64_t end  = base + out[i].size;
+        if (base >= limit)
+            continue;
+        if (end > limit)
+            end = limit;
+        out[kept].base = base;
+        out[kept].size = end - base;
+        kept++;
+    }
+    return kept;
+}
+
+uint32_t hal_mem_reserved(hal_mem_region_t *out, uint32_t max)
+{
+    if (max < 2)
+        return 0;
+
+    /* Real-mode area and the kernel image at 1 MB */
+    out[0].base = 0;
+    out[0].size = LOW_MEM_END;
+    out[1].base = LOW_MEM_END;
+    out[1].size = (uint64_t)(uintptr_t)__kernel_end - LOW_MEM_END;
+
+    return 2 + e820_reserved_regions(out + 2, max - 2);
+}
+
 /* ── Hardware detection ─────────────────────────────────────────── */
 void hal_hw_detect(void) {
     cpuid_detect(&g_hw_info);
+    pmu_x86_init();
+    paging_init();              /* before the first MMIO access */
+
+    lapic_init();
+    tsc_calibrate();
+    if (!tsc_deadline_supported()) {
+        lapic_timer_calibrate();
+        s_ns_to_lapic = clock_conv_make(NSEC_PER_SEC, lapic_timer_hz());
+    }
+
+    /* CPUID only describes the package we are running on; the MADT
+     * lists every CPU the firmware actually enabled. */
+    if (acpi_init() == 0) {
+        g_hw_info.cpu_cores = smp_x86_init();
+        cpuid_topology(&g_hw_info, smp_x86_apic_ids(), g_hw_info.cpu_cores);
+    } else {
+        uint32_t self = lapic_id();
+        cpuid_topology(&g_hw_info, &self, 1);
+    }
 }
@@ -1,7 +1,11 @@
 #include "idt.h"
-#include "pic.h"
 #include "vga.h"
-#include "keyboard_x86.h"
+#include "hal.h"
+#include "lapic.h"
+#include "pmu_x86.h"
+#include "log/klog.h"
+#include "user/user.h"
+#include "sched/fpu.h"
 #include <stdint.h>
 
 /* IDT gate descriptor (16 bytes) */
@@ -25,9 +29,8 @@ static idt_ptr_t   idt_ptr;
 
 extern void idt_load(uint64_t ptr);
 
-/* Declare all ISR/IRQ stubs from entry.asm */
+/* Declare all ISR stubs from entry.asm */
 #define DECL_ISR(n) extern void isr##n(void);
-#define DECL_IRQ(n) extern void irq##n(void);
 
 DECL_ISR(0)  DECL_ISR(1)  DECL_ISR(2)  DECL_ISR(3)  DECL_ISR(4)
 DECL_ISR(5)  DECL_ISR(6)  DECL_ISR(7)  DECL_ISR(8)  DECL_ISR(9)
@@ -37,10 +40,13 @@ DECL_ISR(20) DECL_ISR(21) DECL_ISR(22) DECL_ISR(23) DECL_ISR(24)
 DECL_ISR(25) DECL_ISR(26) DECL_ISR(27) DECL_ISR(28) DECL_ISR(29)
 DECL_ISR(30) DECL_ISR(31)
 
-DECL_IRQ(0)  DECL_IRQ(1)  DECL_IRQ(2)  DECL_IRQ(3)  DECL_IRQ(4)
-DECL_IRQ(5)  DECL_IRQ(6)  DECL_IRQ(7)  DECL_IRQ(8)  DECL_IRQ(9)
-DECL_IRQ(10) DECL_IRQ(11) DECL_IRQ(12) DECL_IRQ(13) DECL_IRQ(14)
-DECL_IRQ(15)
+/* entry.asm: irq0 .. irq191, in IRQ order */
+extern const uint64_t irq_stub_table[IDT_NR_IRQS];
+
+extern void isr_lapic_pmi(void);
+extern void isr_lapic_timer(void);
+extern void isr_lapic_kick(void);
+extern void isr_spurious(void);
 
 static void idt_set_gate(int n, uint64_t handler, uint8_t flags) {
     idt[n].offset_low  = handler & 0xFFFF;
@@ -90,24 +96,21 @@ void idt_init(void) {
     idt_set_gate(30, (uint64_t)isr30, 0x8E);
     idt_set_gate(31, (uint64_t)isr31, 0x8E);
 
-    /* Hardware IRQs (remapped to 32-47 by PIC) */
-    idt_set_gate(32, (uint64_t)irq0,  0x8E);
-    idt_set_gate(33, (uint64_t)irq1,  0x8E);
-    idt_set_gate(34, (uint64_t)irq2,  0x8E);
-    idt_set_gate(35, (uint64_t)irq3,  0x8E);
-    idt_set_gate(36, (uint64_t)irq4,  0x8E);
-    idt_set_gate(37, (uint64_t)irq5,  0x8E);
-    idt_set_gate(38, (uint64_t)irq6,  0x8E);
-    idt_set_gate(39, (uint64_t)irq7,  0x8E);
-    idt_set_gate(40, (uint64_t)irq8,  0x8E);
-    idt_set_gate(41, (uint64_t)irq9,  0x8E);
-    idt_set_gate(42, (uint64_t)irq10, 0x8E);
-    idt_set_gate(43, (uint64_t)irq11, 0x8E);
-    idt_set_gate(44, (uint64_t)irq12, 0x8E);
-    idt_set_gate(45, (uint64_t)irq13, 0x8E);
-    idt_set_gate(46, (uint64_t)irq14, 0x8E);
-    idt_set_gate(47, (uint64_t)irq15, 0x8E);
+    /* Device IRQs: 8259 lines, IOAPIC GSIs and MSI vectors */
+    for (int i = 0; i < IDT_NR_IRQS; i++)
+        idt_set_gate(IDT_IRQ_BASE + i, irq_stub_table[i], 0x8E);
+
+    /* Local APIC: PMI, timer, wake-up IPI, spurious (no EOI, just iretq) */
+    idt_set_gate(LAPIC_PMI_VECTOR,      (uint64_t)isr_lapic_pmi,   0x8E);
+    idt_set_gate(LAPIC_TIMER_VECTOR,    (uint64_t)isr_lapic_timer, 0x8E);
+    idt_set_gate(LAPIC_KICK_VECTOR,     (uint64_t)isr_lapic_kick,  0x8E);
+    idt_set_gate(LAPIC_SPURIOUS_VECTOR, (uint64_t)isr_spurious,    0x8E);
+
+    idt_load((uint64_t)&idt_ptr);
+}
 
+/* Secondary CPUs share the boot CPU's IDT */
+void idt_init_ap(void) {
     idt_load((uint64_t)&idt_ptr);
 }
 
@@ -122,19 +125,60 @@ static const char *exception_names[] = {
     "Reserved", "Reserved", "Security Exception", "Reserved"
 };
 
+/* #PF error code */
+#define PF_WRITE  (1u << 1)
+#define PF_RSVD   (1u << 3)
+#define PF_FETCH  (1u << 4)
+
+/* A user page fault goes to the demand pager, with IRQs on: it may wait
+ * for the disk, and the thread is on its own kernel stack as in a
+ * system call.  0 if the access can be retried. */
+static int user_page_in(const registers_t *regs, uint64_t addr) {
+    if (regs->err_code & PF_RSVD)
+        return -1;
+    uint32_t access = regs->err_code & PF_FETCH ? HAL_UMAP_X
+                    : regs->err_code & PF_WRITE ? HAL_UMAP_W : 0;
+    hal_irq_enable();
+    int r = user_page_fault(addr, access);
+    hal_irq_disable();
+    return r;
+}
+
 void isr_handler(registers_t *regs) {
+    const char *name = regs->int_no < 32 ? exception_names[regs->int_no]
+                                         : "unknown";
+    if (regs->cs & 3) {             /* user mode: only the thread dies */
+        uint64_t addr = 0;
+        if (regs->int_no == 7 && fpu_trap() == 0)
+            return;                 /* first FP use since a switch */
+        if (regs->int_no == 14) {
+            __asm__ volatile ("mov %%cr2, %0" : "=r"(addr));
+            if (user_page_in(regs, addr) == 0)
+                return;
+        }
+        user_fault(name, regs->rip, addr);
+    }
+    klog_panic("[panic] cpu %u: %s, error 0x%lx at rip 0x%lx",
+               hal_cpu_id(), name, (unsigned long)regs->err_code,
+               (unsigned long)regs->rip);
+
     vga_set_color(VGA_COLOR(VGA_WHITE, VGA_RED));
     vga_print("\n*** KERNEL EXCEPTION: ");
-    if (regs->int_no < 32)
-        vga_print(exception_names[regs->int_no]);
+    vga_print(name);
     vga_print(" ***\n");
-    /* halt */
-    __asm__ volatile ("cli; hlt");
+    hal_halt();
 }
 
 void irq_handler(registers_t *regs) {
-    if (regs->int_no == 33)
-        keyboard_irq_handler();
-
-    pic_send_eoi((uint8_t)(regs->int_no - 32));
+    if (regs->int_no == LAPIC_PMI_VECTOR) {
+        pmu_x86_irq(regs->rip);
+        return;
+    }
+    if (regs->int_no == LAPIC_TIMER_VECTOR ||
+        regs->int_no == LAPIC_KICK_VECTOR) {
+        lapic_timer_irq();
+        return;
+    }
+
+    hal_irq_dispatch(regs->int_no - IDT_IRQ_BASE);
 }
@@ -1,6 +1,12 @@
 #pragma once
 #include <stdint.h>
 
+/* Device IRQ n arrives on vector IDT_IRQ_BASE + n, whether it comes from
+ * the 8259, the IOAPIC or an MSI write.  The LAPIC's own vectors
+ * (lapic.h) sit above this range. */
+#define IDT_IRQ_BASE  32
+#define IDT_NR_IRQS   192           /* vectors 32-223; entry.asm IRQ_COUNT */
+
 /* Register state saved by ISR/IRQ stubs in entry.asm */
 typedef struct __attribute__((packed)) {
     uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
@@ -11,6 +17,7 @@ typedef struct __attribute__((packed)) {
 } registers_t;
 
 void idt_init(void);
+void idt_init_ap(void);   /* load the IDT built by idt_init() */
 
 /* Called from entry.asm */
 void isr_handler(registers_t *regs);
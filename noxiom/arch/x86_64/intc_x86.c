@@ -0,0 +1,210 @@
+/* arch/x86_64/intc_x86.c — IOAPIC / 8259 selection, routing and MSI
+ *
+ * With an IOAPIC in the MADT the 8259 is remapped and masked for good
+ * (when the MADT's PCAT_COMPAT flag says there is one to mask), and every
+ * device interrupt ends with a LAPIC EOI — one wrmsr in x2APIC mode
+ * instead of one or two port writes.  Without one the 8259 stays in
+ * charge of IRQs 0-15 and only ever interrupts the boot CPU.
+ *
+ * Like the GIC front end (arch/arm64/gic.c), an IOAPIC line nobody
+ * pinned is routed when it is first unmasked, to the next CPU in turn
+ * whose LAPIC is up, so device interrupts spread over the cores.  MSI
+ * IRQs are aimed at the CPU their driver asked for; moving one rewrites
+ * the message in the device through the callback it registered.
+ */
+#include "intc_x86.h"
+#include "acpi.h"
+#include "ioapic.h"
+#include "lapic.h"
+#include "pic.h"
+#include "smp_x86.h"
+#include "log/klog.h"
+#include "sync/spinlock.h"
+#include <stdint.h>
+
+#define MSI_ADDR_BASE   0xFEE00000u     /* physical destination mode     */
+#define MSI_ADDR_DEST(apic)  ((uint32_t)(apic) << 12)
+
+typedef struct {
+    hal_msi_write_t write;              /* 0 = free                      */
+    void           *ctx;
+} msi_slot_t;
+
+static int        s_ioapic;             /* IOAPIC mode, 8259 masked      */
+static uint32_t   s_gsis;               /* GSIs the IOAPICs cover        */
+static spinlock_t s_lock = SPINLOCK_INIT;
+static uint8_t    s_route[INTC_X86_GSI_MAX];    /* CPU + 1, 0 = not yet */
+static uint32_t   s_next_cpu;           /* round-robin cursor            */
+static msi_slot_t s_msi[INTC_X86_MSI_COUNT];
+
+void intc_x86_init(void)
+{
+    const acpi_info_t *acpi = acpi_get_info();
+    if (lapic_present() && acpi->ioapic_count)
+        s_gsis = ioapic_init(acpi);
+    if (!s_gsis) {
+        pic_init();
+        klog("[intc] 8259 PIC");
+        return;
+    }
+    if (acpi->pic_present)
+        pic_disable();
+    s_ioapic = 1;
+    klog("[intc] %u IOAPIC(s), %u GSIs, %s%s", acpi->ioapic_count, s_gsis,
+         lapic_x2apic() ? "x2APIC" : "xAPIC",
+         acpi->pic_present ? ", 8259 masked" : ", no 8259");
+}
+
+const char *intc_x86_name(void)
+{
+    return s_ioapic ? "IOAPIC" : "8259 PIC";
+}
+
+/* GSI and MPS flags of IOAPIC line `irq`; -1 if it has none */
+static int line_gsi(uint32_t irq, uint32_t *gsi, uint16_t *flags)
+{
+    const acpi_info_t *acpi = acpi_get_info();
+    if (irq < ACPI_ISA_IRQS) {
+        *gsi   = acpi->isa_gsi[irq];
+        *flags = acpi->isa_flags[irq];
+    } else {
+        /* A GSI an ISA IRQ was moved onto is that IRQ's, not its own */
+        for (uint32_t i = 0; i < ACPI_ISA_IRQS; i++)
+            if (acpi->isa_gsi[i] == irq)
+                return -1;
+        *gsi   = irq;
+        *flags = ACPI_INTI_ACTIVE_LOW | ACPI_INTI_LEVEL;
+    }
+    return *gsi < s_gsis ? 0 : -1;
+}
+
+/* IOAPIC and MSI destinations are 8-bit APIC IDs (no interrupt
+ * remapping), so CPUs with larger x2APIC IDs cannot take device IRQs */
+static int routable_apic(uint32_t cpu, uint32_t *apic)
+{
+    *apic = smp_x86_apic_id(cpu);
+    return *apic != SMP_X86_NO_APIC && *apic <= 0xFF;
+}
+
+/* s_lock held */
+static uint32_t next_cpu(void)
+{
+    uint32_t apic;
+    for (uint32_t i = 0; i < HAL_MAX_CPUS; i++) {
+        uint32_t cpu = (s_next_cpu + i) % HAL_MAX_CPUS;
+        if (routable_apic(cpu, &apic)) {
+            s_next_cpu = cpu + 1;
+            return cpu;
+        }
+    }
+    return 0;
+}
+
+void intc_x86_unmask(uint32_t irq)
+{
+    if (!s_ioapic) {
+        if (irq < ACPI_ISA_IRQS)
+            pic_unmask((uint8_t)irq);
+        return;
+    }
+
+    uint32_t gsi;
+    uint16_t inti;
+    if (irq >= INTC_X86_GSI_MAX || line_gsi(irq, &gsi, &inti) != 0)
+        return;                         /* MSI: the device masks those */
+
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    if (!s_route[irq]) {
+        uint32_t cpu = next_cpu(), apic = smp_x86_apic_id(cpu);
+        if (ioapic_route(gsi, (uint8_t)(IDT_IRQ_BASE + irq), apic, inti) == 0)
+            s_route[irq] = (uint8_t)(cpu + 1);
+    }
+    if (s_route[irq])
+        ioapic_mask(gsi, 0);
+    spin_unlock_irqrestore(&s_lock, flags);
+}
+
+void intc_x86_eoi(uint32_t irq)
+{
+    if (s_ioapic || irq >= INTC_X86_MSI_BASE)
+        lapic_eoi();
+    else
+        pic_send_eoi((uint8_t)irq);
+}
+
+static void msi_compose(uint32_t irq, uint32_t apic, hal_msi_msg_t *msg)
+{
+    msg->addr = MSI_ADDR_BASE | MSI_ADDR_DEST(apic);
+    msg->data = IDT_IRQ_BASE + irq;     /* fixed delivery, edge          */
+}
+
+int intc_x86_set_affinity(uint32_t irq, uint32_t cpu)
+{
+    uint32_t apic;
+    int rc = -1;
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    if (cpu >= HAL_MAX_CPUS || !routable_apic(cpu, &apic))
+        goto out;
+
+    if (irq < INTC_X86_GSI_MAX) {
+        uint32_t gsi;
+        uint16_t inti;
+        if (!s_ioapic) {
+            rc = irq < ACPI_ISA_IRQS && cpu == 0 ? 0 : -1;
+        } else if (line_gsi(irq, &gsi, &inti) == 0) {
+            rc = s_route[irq]
+               ? ioapic_set_dest(gsi, apic)
+               : ioapic_route(gsi, (uint8_t)(IDT_IRQ_BASE + irq), apic, inti);
+            if (rc == 0)
+                s_route[irq] = (uint8_t)(cpu + 1);
+        }
+    } else if (irq < INTC_X86_MSI_BASE + INTC_X86_MSI_COUNT) {
+        msi_slot_t *m = &s_msi[irq - INTC_X86_MSI_BASE];
+        if (m->write) {
+            hal_msi_msg_t msg;
+            msi_compose(irq, apic, &msg);
+            m->write(m->ctx, &msg);
+            rc = 0;
+        }
+    }
+out:
+    spin_unlock_irqrestore(&s_lock, flags);
+    return rc;
+}
+
+int intc_x86_msi_alloc(uint32_t cpu, hal_msi_write_t write, void *ctx)
+{
+    uint32_t apic;
+    if (!write || cpu >= HAL_MAX_CPUS)
+        return -1;
+
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    int irq = -1;
+    if (routable_apic(cpu, &apic)) {
+        for (uint32_t i = 0; i < INTC_X86_MSI_COUNT; i++) {
+            msi_slot_t *m = &s_msi[i];
+            if (m->write)
+                continue;
+            m->write = write;
+            m->ctx   = ctx;
+            irq = (int)(INTC_X86_MSI_BASE + i);
+
+            hal_msi_msg_t msg;
+            msi_compose((uint32_t)irq, apic, &msg);
+            write(ctx, &msg);
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&s_lock, flags);
+    return irq;
+}
+
+void intc_x86_msi_free(uint32_t irq)
+{
+    if (irq < INTC_X86_MSI_BASE ||
+        irq >= INTC_X86_MSI_BASE + INTC_X86_MSI_COUNT)
+        return;
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    s_msi[irq - INTC_X86_MSI_BASE].write = 0;
+    spin_unlock_irqrestore(&s_lock, flags);
+}
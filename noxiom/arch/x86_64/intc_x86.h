@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+#include "hal.h"
+#include "idt.h"
+
+/* x86 device interrupt routing — the hal_intc_* and hal_msi_* back end.
+ *
+ * IRQ numbers (vector = IDT_IRQ_BASE + irq):
+ *   0-15   ISA IRQs; through the IOAPIC they land on the GSI the MADT
+ *          overrides name, else on the 8259
+ *   16-63  other IOAPIC GSIs (PCI INTx: level, active low)
+ *   64-191 MSI / MSI-X, one vector each, handed out by hal_msi_alloc()
+ */
+#define INTC_X86_GSI_MAX    64
+#define INTC_X86_MSI_BASE   INTC_X86_GSI_MAX
+#define INTC_X86_MSI_COUNT  (IDT_NR_IRQS - INTC_X86_MSI_BASE)
+
+/* After acpi_init() and lapic_init() on the boot CPU */
+void        intc_x86_init(void);
+const char *intc_x86_name(void);
+
+void intc_x86_unmask(uint32_t irq);
+void intc_x86_eoi(uint32_t irq);
+int  intc_x86_set_affinity(uint32_t irq, uint32_t cpu);
+
+int  intc_x86_msi_alloc(uint32_t cpu, hal_msi_write_t write, void *ctx);
+void intc_x86_msi_free(uint32_t irq);
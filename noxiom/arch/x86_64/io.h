@@ -21,6 +21,16 @@ static inline uint16_t inw(uint16_t port) {
     return ret;
 }
 
+static inline void outl(uint16_t port, uint32_t val) {
+    __asm__ volatile ("outl %0, %1" : : "a"(val), "Nd"(port) : "memory");
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    __asm__ volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port) : "memory");
+    return ret;
+}
+
 static inline void io_wait(void) {
     outb(0x80, 0);
 }
@@ -0,0 +1,134 @@
+/* arch/x86_64/ioapic.c — I/O APIC driver
+ *
+ * Registers (indirect: write the index to IOREGSEL, then access IOWIN):
+ *   0x00 IOAPICID   0x01 IOAPICVER (bits 23:16 = last entry)
+ *   0x10 + 2n       redirection entry n, low half
+ *   0x11 + 2n       redirection entry n, high half (dest in bits 31:24)
+ * The MMIO window sits below 4 GB, in the uncached part of the identity
+ * map built by paging.c.
+ */
+#include "ioapic.h"
+#include "mm/pmm.h"
+#include "sync/spinlock.h"
+#include <stdint.h>
+
+#define IOREGSEL        0x00
+#define IOWIN           0x10
+
+#define IOAPIC_REG_VER  0x01
+#define IOAPIC_REG_RED  0x10
+
+#define RED_POLARITY_LOW  (1u << 13)
+#define RED_TRIGGER_LEVEL (1u << 15)
+#define RED_MASKED        (1u << 16)
+
+typedef struct {
+    volatile uint32_t *mmio;
+    uint32_t           gsi_base;
+    uint32_t           entries;
+} ioapic_t;
+
+static ioapic_t   s_ioapics[ACPI_MAX_IOAPICS];
+static uint32_t   s_count;
+static spinlock_t s_lock = SPINLOCK_INIT;
+
+/* s_lock held (or single-threaded init) */
+static uint32_t io_read(const ioapic_t *io, uint32_t reg)
+{
+    io->mmio[IOREGSEL / 4] = reg;
+    return io->mmio[IOWIN / 4];
+}
+
+static void io_write(const ioapic_t *io, uint32_t reg, uint32_t val)
+{
+    io->mmio[IOREGSEL / 4] = reg;
+    io->mmio[IOWIN / 4]    = val;
+}
+
+static ioapic_t *find(uint32_t gsi, uint32_t *pin)
+{
+    for (uint32_t i = 0; i < s_count; i++) {
+        ioapic_t *io = &s_ioapics[i];
+        if (gsi >= io->gsi_base && gsi < io->gsi_base + io->entries) {
+            *pin = gsi - io->gsi_base;
+            return io;
+        }
+    }
+    return 0;
+}
+
+uint32_t ioapic_init(const acpi_info_t *acpi)
+{
+    uint32_t limit = 0;
+    s_count = 0;
+    for (uint32_t i = 0; i < acpi->ioapic_count; i++) {
+        ioapic_t *io = &s_ioapics[s_count];
+        io->mmio     = phys_to_virt(acpi->ioapics[i].addr);
+        io->gsi_base = acpi->ioapics[i].gsi_base;
+
+        uint32_t ver = io_read(io, IOAPIC_REG_VER);
+        if (ver == 0xFFFFFFFF)
+            continue;                   /* nothing decodes that address */
+        io->entries = ((ver >> 16) & 0xFF) + 1;
+
+        for (uint32_t pin = 0; pin < io->entries; pin++) {
+            io_write(io, IOAPIC_REG_RED + 2 * pin + 1, 0);
+            io_write(io, IOAPIC_REG_RED + 2 * pin, RED_MASKED);
+        }
+        if (io->gsi_base + io->entries > limit)
+            limit = io->gsi_base + io->entries;
+        s_count++;
+    }
+    return limit;
+}
+
+int ioapic_route(uint32_t gsi, uint8_t vector, uint32_t apic_id,
+                 uint16_t inti_flags)
+{
+    uint32_t pin;
+    ioapic_t *io = find(gsi, &pin);
+    if (!io || apic_id > 0xFF)
+        return -1;
+
+    uint32_t lo = vector | RED_MASKED;      /* fixed, physical */
+    if ((inti_flags & ACPI_INTI_POLARITY_MASK) == ACPI_INTI_ACTIVE_LOW)
+        lo |= RED_POLARITY_LOW;
+    if ((inti_flags & ACPI_INTI_TRIGGER_MASK) == ACPI_INTI_LEVEL)
+        lo |= RED_TRIGGER_LEVEL;
+
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    io_write(io, IOAPIC_REG_RED + 2 * pin, RED_MASKED);
+    io_write(io, IOAPIC_REG_RED + 2 * pin + 1, apic_id << 24);
+    io_write(io, IOAPIC_REG_RED + 2 * pin, lo);
+    spin_unlock_irqrestore(&s_lock, flags);
+    return 0;
+}
+
+int ioapic_set_dest(uint32_t gsi, uint32_t apic_id)
+{
+    uint32_t pin;
+    ioapic_t *io = find(gsi, &pin);
+    if (!io || apic_id > 0xFF)
+        return -1;
+
+    /* The high half alone: an interrupt in flight still goes to the old
+     * CPU, which acknowledges it as usual */
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    io_write(io, IOAPIC_REG_RED + 2 * pin + 1, apic_id << 24);
+    spin_unlock_irqrestore(&s_lock, flags);
+    return 0;
+}
+
+void ioapic_mask(uint32_t gsi, int masked)
+{
+    uint32_t pin;
+    ioapic_t *io = find(gsi, &pin);
+    if (!io)
+        return;
+
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    uint32_t lo = io_read(io, IOAPIC_REG_RED + 2 * pin);
+    lo = masked ? lo | RED_MASKED : lo & ~RED_MASKED;
+    io_write(io, IOAPIC_REG_RED + 2 * pin, lo);
+    spin_unlock_irqrestore(&s_lock, flags);
+}
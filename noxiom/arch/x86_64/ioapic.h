@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include "acpi.h"
+
+/* I/O APIC — routes device interrupt lines (GSIs) to local APICs.
+ *
+ * Each IOAPIC serves GSIs gsi_base .. gsi_base + its entry count - 1;
+ * one redirection entry per GSI selects the vector, the destination
+ * APIC ID (physical mode, so IDs up to 255), polarity and trigger mode.
+ * All entries start masked.  Entries are written under one lock (every
+ * register access is an index write followed by a data access).
+ */
+
+/* Map every IOAPIC the MADT lists and mask all its entries.  Returns the
+ * number of GSIs covered (highest + 1), 0 if there is no IOAPIC. */
+uint32_t ioapic_init(const acpi_info_t *acpi);
+
+/* Program gsi to deliver `vector` to `apic_id`, polarity and trigger
+ * from MPS INTI flags (ACPI_INTI_*), leaving it masked.  Returns -1 if
+ * no IOAPIC serves gsi or apic_id does not fit. */
+int  ioapic_route(uint32_t gsi, uint8_t vector, uint32_t apic_id,
+                  uint16_t inti_flags);
+/* Move an already routed gsi to another APIC */
+int  ioapic_set_dest(uint32_t gsi, uint32_t apic_id);
+void ioapic_mask(uint32_t gsi, int masked);
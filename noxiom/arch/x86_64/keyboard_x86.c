@@ -1,6 +1,7 @@
 #include "keyboard_x86.h"
-#include "pic.h"
+#include "hal.h"
 #include "io.h"
+#include "ringbuf.h"
 #include <stdint.h>
 
 #define KB_DATA 0x60
@@ -40,26 +41,16 @@ static const char sc_table_shift[128] = {
 #define SC_RSHIFT_REL 0xB6
 
 static int shift_held = 0;
+static void (*kb_notify)(void);
 
-/* Ring buffer */
-#define KB_BUF_SIZE 256
-static volatile char kb_buf[KB_BUF_SIZE];
-static volatile int  kb_head = 0;
-static volatile int  kb_tail = 0;
+/* Filled by the IRQ, drained by keyboard_trygetchar(): one producer and
+ * one consumer, so the ring needs no lock */
+static uint8_t   kb_storage[256];
+static ringbuf_t kb_buf = RINGBUF_INIT(kb_storage);
 
-static void buf_push(char c) {
-    int next = (kb_head + 1) % KB_BUF_SIZE;
-    if (next != kb_tail) {
-        kb_buf[kb_head] = c;
-        kb_head = next;
-    }
-}
-
-void keyboard_init(void) {
-    pic_unmask(1);  /* unmask IRQ1 */
-}
-
-void keyboard_irq_handler(void) {
+static void keyboard_irq(uint32_t irq, void *ctx) {
+    (void)irq;
+    (void)ctx;
     uint8_t sc = inb(KB_DATA);
 
     if (sc == SC_LSHIFT || sc == SC_RSHIFT) {
@@ -76,15 +67,22 @@ void keyboard_irq_handler(void) {
         return;
 
     char c = shift_held ? sc_table_shift[sc] : sc_table[sc];
-    if (c)
-        buf_push(c);
+    if (c) {
+        ringbuf_put(&kb_buf, (uint8_t)c);     /* dropped when full */
+        if (kb_notify)
+            kb_notify();
+    }
 }
 
-char keyboard_getchar(void) {
-    while (kb_head == kb_tail)
-        __asm__ volatile ("hlt");   /* wait for IRQ to fire */
+void keyboard_init(void (*notify)(void)) {
+    kb_notify = notify;
+    hal_irq_register(1, keyboard_irq, 0);   /* IRQ1 */
+}
 
-    char c = kb_buf[kb_tail];
-    kb_tail = (kb_tail + 1) % KB_BUF_SIZE;
-    return c;
+int keyboard_trygetchar(char *c) {
+    uint8_t b;
+    if (!ringbuf_get(&kb_buf, &b))
+        return 0;
+    *c = (char)b;
+    return 1;
 }
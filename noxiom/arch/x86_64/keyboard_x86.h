@@ -1,5 +1,5 @@
 #pragma once
 
-void keyboard_init(void);
-void keyboard_irq_handler(void);
-char keyboard_getchar(void);    /* blocks until a key is available */
+/* notify (may be 0) runs in IRQ context after every buffered key */
+void keyboard_init(void (*notify)(void));
+int  keyboard_trygetchar(char *c);  /* 1 and a key if one is buffered */
@@ -0,0 +1,222 @@
+/* arch/x86_64/lapic.c — local APIC driver (x2APIC or xAPIC)
+ *
+ * x2APIC mode is used wherever CPUID reports it: every register is an
+ * MSR (0x800 + offset / 16), so an EOI or IPI is one wrmsr instead of an
+ * uncached MMIO write, the ICR is a single 64-bit write with no
+ * delivery-status polling, and APIC IDs are 32 bits.  Otherwise the
+ * xAPIC window is used; its base comes from IA32_APIC_BASE, which always
+ * reflects the current mapping even if firmware relocated it.
+ *
+ * Registers are 32 bits wide on 16-byte boundaries:
+ *   0x020 ID      0x0B0 EOI      0x0F0 Spurious Interrupt Vector
+ *   0x300 ICR low 0x310 ICR high (xAPIC: destination ID in bits 31:24)
+ *   0x320 LVT timer              0x340 LVT performance counter
+ *   0x380 initial count
+ *   0x390 current count          0x3E0 divide configuration
+ */
+#include "lapic.h"
+#include "msr.h"
+#include "pit.h"
+#include "cpuid.h"
+#include "mm/pmm.h"
+#include <stdint.h>
+
+#define LAPIC_REG_ID       0x020
+#define LAPIC_REG_EOI      0x0B0
+#define LAPIC_REG_SVR      0x0F0
+#define LAPIC_REG_ICR_LO   0x300
+#define LAPIC_REG_ICR_HI   0x310
+#define LAPIC_REG_LVT_TMR  0x320
+#define LAPIC_REG_LVT_PMC  0x340
+#define LAPIC_REG_TMR_INIT 0x380
+#define LAPIC_REG_TMR_CUR  0x390
+#define LAPIC_REG_TMR_DIV  0x3E0
+
+#define MSR_X2APIC_BASE    0x800    /* + register offset / 16          */
+
+#define APIC_BASE_EXTD    (1u << 10)    /* x2APIC mode                 */
+#define APIC_BASE_ENABLE  (1u << 11)
+#define SVR_ENABLE        (1u << 8)
+
+#define CPUID1_ECX_X2APIC (1u << 21)
+
+#define ICR_INIT          0x00000500
+#define ICR_STARTUP       0x00000600
+#define ICR_FIXED         0x00000000
+#define ICR_ASSERT        0x00004000
+#define ICR_PENDING       0x00001000
+
+#define LVT_MASKED        (1u << 16)
+#define LVT_TMR_DEADLINE  (2u << 17)
+#define TMR_DIV_16        0x3
+
+#define CALIBRATE_US      10000     /* PIT window for timer calibration */
+
+static volatile uint8_t *lapic = 0; /* xAPIC window                     */
+static int s_x2apic;                /* decided by the boot CPU          */
+static int s_present;
+
+static uint32_t timer_ticks_per_sec = 0;    /* at divide-by-16 */
+static void   (*timer_fn)(void) = 0;
+
+static inline void lapic_w32(uint32_t reg, uint32_t val) {
+    if (s_x2apic)
+        wrmsr(MSR_X2APIC_BASE + (reg >> 4), val);
+    else
+        *((volatile uint32_t *)(lapic + reg)) = val;
+}
+
+static inline uint32_t lapic_r32(uint32_t reg) {
+    if (s_x2apic)
+        return (uint32_t)rdmsr(MSR_X2APIC_BASE + (reg >> 4));
+    return *((volatile uint32_t *)(lapic + reg));
+}
+
+void lapic_init(void)
+{
+    uint64_t base = rdmsr(MSR_APIC_BASE);
+
+    /* The boot CPU decides; APs follow, so every CPU uses one ID space
+     * (firmware may already have switched to x2APIC, which cannot be
+     * undone without disabling the APIC) */
+    if (!s_present) {
+        uint32_t eax, ebx, ecx, edx;
+        do_cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+        s_x2apic = (ecx & CPUID1_ECX_X2APIC) || (base & APIC_BASE_EXTD);
+    }
+
+    /* xAPIC must be enabled before EXTD may be set */
+    if (!(base & APIC_BASE_ENABLE)) {
+        base |= APIC_BASE_ENABLE;
+        wrmsr(MSR_APIC_BASE, base);
+    }
+    if (s_x2apic && !(base & APIC_BASE_EXTD))
+        wrmsr(MSR_APIC_BASE, base | APIC_BASE_EXTD);
+    if (!s_x2apic && !lapic)
+        lapic = phys_to_virt(base & ~0xFFFULL);
+    s_present = 1;
+
+    /* Software-enable with the spurious vector (its IDT gate just irets) */
+    lapic_w32(LAPIC_REG_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+int lapic_present(void)
+{
+    return s_present;
+}
+
+int lapic_x2apic(void)
+{
+    return s_x2apic;
+}
+
+uint32_t lapic_id(void)
+{
+    if (!s_present)
+        return 0;
+    uint32_t id = lapic_r32(LAPIC_REG_ID);
+    return s_x2apic ? id : id >> 24;
+}
+
+void lapic_eoi(void)
+{
+    lapic_w32(LAPIC_REG_EOI, 0);
+}
+
+static void send_icr(uint32_t apic_id, uint32_t lo)
+{
+    if (s_x2apic) {
+        /* One write; the MSR form has no delivery-status bit.  wrmsr to
+         * the ICR is not serialising, so order earlier stores first. */
+        __asm__ volatile ("mfence" ::: "memory");
+        wrmsr(MSR_X2APIC_BASE + (LAPIC_REG_ICR_LO >> 4),
+              ((uint64_t)apic_id << 32) | lo);
+        return;
+    }
+    lapic_w32(LAPIC_REG_ICR_HI, apic_id << 24);
+    lapic_w32(LAPIC_REG_ICR_LO, lo);
+    while (lapic_r32(LAPIC_REG_ICR_LO) & ICR_PENDING)
+        __asm__ volatile ("pause");
+}
+
+void lapic_send_init(uint32_t apic_id)
+{
+    send_icr(apic_id, ICR_INIT | ICR_ASSERT);
+}
+
+void lapic_send_sipi(uint32_t apic_id, uint8_t vector_page)
+{
+    send_icr(apic_id, ICR_STARTUP | ICR_ASSERT | vector_page);
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector)
+{
+    send_icr(apic_id, ICR_FIXED | ICR_ASSERT | vector);
+}
+
+/* ── Timer ───────────────────────────────────────────────────────────── */
+
+void lapic_timer_calibrate(void)
+{
+    if (!s_present)
+        return;
+
+    lapic_w32(LAPIC_REG_TMR_DIV, TMR_DIV_16);
+    lapic_w32(LAPIC_REG_LVT_TMR, LVT_MASKED);
+    lapic_w32(LAPIC_REG_TMR_INIT, 0xFFFFFFFF);
+    pit_delay_us(CALIBRATE_US);
+    uint32_t elapsed = 0xFFFFFFFF - lapic_r32(LAPIC_REG_TMR_CUR);
+    lapic_w32(LAPIC_REG_TMR_INIT, 0);
+
+    timer_ticks_per_sec = elapsed * (1000000 / CALIBRATE_US);
+}
+
+uint32_t lapic_timer_hz(void)
+{
+    return timer_ticks_per_sec;
+}
+
+int lapic_timer_init(int tsc_deadline, void (*fn)(void))
+{
+    if (!s_present || (!tsc_deadline && !timer_ticks_per_sec))
+        return -1;
+
+    timer_fn = fn;
+    lapic_w32(LAPIC_REG_TMR_INIT, 0);
+    if (tsc_deadline) {
+        lapic_w32(LAPIC_REG_LVT_TMR, LVT_TMR_DEADLINE | LAPIC_TIMER_VECTOR);
+        /* SDM: the LVT write must be visible before the first
+         * IA32_TSC_DEADLINE write, and wrmsr does not order MMIO */
+        __asm__ volatile ("mfence" ::: "memory");
+    } else {
+        lapic_w32(LAPIC_REG_TMR_DIV, TMR_DIV_16);
+        lapic_w32(LAPIC_REG_LVT_TMR, LAPIC_TIMER_VECTOR);
+    }
+    return 0;
+}
+
+void lapic_timer_oneshot(uint32_t count)
+{
+    lapic_w32(LAPIC_REG_TMR_INIT, count);
+}
+
+void lapic_timer_deadline(uint64_t tsc)
+{
+    wrmsr(MSR_TSC_DEADLINE, tsc);
+}
+
+void lapic_timer_irq(void)
+{
+    lapic_eoi();
+    if (timer_fn)
+        timer_fn();
+}
+
+/* ── Performance monitoring interrupt ────────────────────────────────── */
+
+void lapic_pmi_enable(int on)
+{
+    if (s_present)
+        lapic_w32(LAPIC_REG_LVT_PMC,
+                  LAPIC_PMI_VECTOR | (on ? 0 : LVT_MASKED));
+}
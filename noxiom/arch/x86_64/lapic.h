@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+
+/* Local APIC — per-CPU interrupt controller, in x2APIC (MSR) mode where
+ * the CPU supports it, xAPIC (memory-mapped) otherwise.  Used for AP
+ * start-up (INIT/SIPI), inter-processor interrupts, the per-CPU timer
+ * and the EOI of every device interrupt delivered through the IOAPIC or
+ * MSI (intc_x86.c). */
+
+/* Vectors above the device IRQ range (idt.h); stubs in entry.asm */
+#define LAPIC_PMI_VECTOR      0xEE
+#define LAPIC_TIMER_VECTOR    0xEF
+#define LAPIC_KICK_VECTOR     0xF0
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+void     lapic_init(void);          /* map (first call) + enable, per CPU */
+int      lapic_present(void);
+int      lapic_x2apic(void);        /* 1 if in x2APIC mode              */
+uint32_t lapic_id(void);            /* x2APIC: full 32-bit ID           */
+void     lapic_eoi(void);
+void     lapic_send_init(uint32_t apic_id);
+void     lapic_send_sipi(uint32_t apic_id, uint8_t vector_page);
+void     lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+
+/* Measure the count-mode timer rate against the PIT.  Boot CPU, once,
+ * before any lapic_timer_init() (the PIT is shared, APs must not touch
+ * it).  Not needed in TSC-deadline mode. */
+void     lapic_timer_calibrate(void);
+uint32_t lapic_timer_hz(void);      /* count-mode ticks per second      */
+
+/* One-shot timer on the calling CPU: TSC-deadline mode if `tsc_deadline`
+ * (armed with lapic_timer_deadline()), else count mode (armed with
+ * lapic_timer_oneshot()).  fn() is called from lapic_timer_irq(). */
+int      lapic_timer_init(int tsc_deadline, void (*fn)(void));
+void     lapic_timer_oneshot(uint32_t count);   /* 0 stops the timer   */
+void     lapic_timer_deadline(uint64_t tsc);    /* 0 stops the timer   */
+/* LAPIC_TIMER_VECTOR and LAPIC_KICK_VECTOR: a kick makes the CPU look
+ * at its timers again (another CPU queued an earlier one) */
+void     lapic_timer_irq(void);
+
+/* Performance counter overflow → LAPIC_PMI_VECTOR on the calling CPU.
+ * The CPU masks the entry again on every PMI; the handler re-enables it. */
+void     lapic_pmi_enable(int on);
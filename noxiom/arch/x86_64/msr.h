@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+
+/* Model-specific register access */
+
+#define MSR_APIC_BASE    0x0000001B
+#define MSR_PMC0         0x000000C1     /* + n, architectural perfmon     */
+#define MSR_PERFEVTSEL0  0x00000186     /* + n                            */
+#define MSR_TSC_DEADLINE 0x000006E0
+#define MSR_PAT          0x00000277
+#define MSR_PERF_GLOBAL_STATUS   0x0000038E     /* perfmon v2+            */
+#define MSR_PERF_GLOBAL_CTRL     0x0000038F
+#define MSR_PERF_GLOBAL_OVF_CTRL 0x00000390
+#define MSR_EFER         0xC0000080
+#define MSR_STAR         0xC0000081     /* SYSCALL/SYSRET selectors       */
+#define MSR_LSTAR        0xC0000082     /* SYSCALL entry point            */
+#define MSR_FMASK        0xC0000084     /* RFLAGS bits SYSCALL clears     */
+#define MSR_GS_BASE      0xC0000101
+#define MSR_KERNEL_GS_BASE 0xC0000102   /* swapped in by SWAPGS           */
+#define MSR_TSC_AUX      0xC0000103     /* ECX of RDTSCP                  */
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)val),
+                      "d"((uint32_t)(val >> 32)) : "memory");
+}
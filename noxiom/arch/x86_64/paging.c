@@ -0,0 +1,479 @@
+/* arch/x86_64/paging.c — kernel page tables built from the E820 map
+ *
+ * Levels are numbered as in arm64/mmu.c: 0 = PML4 (512 GB per entry),
+ * 1 = PDPT (1 GB), 2 = PD (2 MB), 3 = PT (4 KB).  Each range is mapped
+ * with the largest page whose memory type is uniform across it; a range
+ * that mixes types is split into a next-level table.  RAM ends and PCI
+ * windows are normally 2 MB aligned, so only the first 2 MB (real-mode
+ * RAM, VGA, BIOS ROM, kernel image) needs 4 KB pages.
+ *
+ * Without pdpe1gb every present GB costs a PD.  When the PD pool runs
+ * out, mapping stops at that GB and paging_mapped_limit() says so.  When
+ * the PT pool runs out, a mixed 2 MB page is mapped uncached — slow for
+ * the RAM inside it, but never unsafe.
+ *
+ * PAT: entries 0-3 keep their power-on meaning (WB, WT, UC-, UC), so
+ * PCD|PWT still selects UC; entry 4 becomes WC and is reached through
+ * the PAT bit alone.
+ *
+ * User address spaces get a PML4 of their own, built from frames.  Its
+ * kernel entries are copies of the kernel PML4's, which never change
+ * after paging_init(): every identity slot gets its PDPT there, so a
+ * later MMIO mapping only edits tables that all spaces share.  User
+ * tables and pages are the only ones with PTE_U, and user leaves are
+ * not global.
+ */
+#include "paging.h"
+#include "cpuid.h"
+#include "e820.h"
+#include "msr.h"
+#include "mm/pmm.h"
+#include "sync/spinlock.h"
+#include <stdint.h>
+
+#define ENTRIES        512
+#define PDPT_POOL      4        /* 2 TB of physical address space        */
+#define PD_POOL        32
+#define PT_POOL        8
+
+#define PTE_P          (1ULL << 0)
+#define PTE_W          (1ULL << 1)
+#define PTE_U          (1ULL << 2)
+#define PTE_PWT        (1ULL << 3)
+#define PTE_PCD        (1ULL << 4)
+#define PTE_PS         (1ULL << 7)  /* level 1/2: large page             */
+#define PTE_PAT_4K     (1ULL << 7)  /* level 3                           */
+#define PTE_G          (1ULL << 8)
+#define PTE_PAT_LARGE  (1ULL << 12)
+#define PTE_NX         (1ULL << 63)
+#define PTE_ADDR_MASK  0x000FFFFFFFFFF000ULL
+
+#define PAT_VALUE      0x0007040100070406ULL    /* PA4 = WC, rest reset  */
+#define EFER_NXE       (1ULL << 11)
+#define CR4_PGE        (1ULL << 7)
+
+#define CPUID1_EDX_PAT      (1u << 16)
+#define CPUIDX_EDX_NX       (1u << 20)  /* leaf 0x80000001 */
+#define CPUIDX_EDX_PDPE1GB  (1u << 26)
+
+#define GB             (1ULL << 30)
+#define LOW_4G         (4 * GB)
+#define LOW_4K_END     0x200000ULL      /* first 2 MB: mapped with 4 KB  */
+#define VGA_START      0xA0000ULL
+#define VGA_END        0xC0000ULL
+
+#define USER_SLOT_FIRST  (ENTRIES / 4)  /* PML4 128-255, see paging.h    */
+#define USER_SLOT_END    (ENTRIES / 2)
+
+static uint64_t pml4[ENTRIES]             __attribute__((aligned(4096)));
+static uint64_t pdpt[PDPT_POOL][ENTRIES]  __attribute__((aligned(4096)));
+static uint64_t pd[PD_POOL][ENTRIES]      __attribute__((aligned(4096)));
+static uint64_t pt[PT_POOL][ENTRIES]      __attribute__((aligned(4096)));
+static uint32_t used[4];                /* tables taken, per level 0-3   */
+
+static hal_mem_region_t ram[E820_MAX_ENTRIES];
+static uint32_t ram_count;
+
+static uint64_t nx_bit;                 /* PTE_NX, or 0 without NX       */
+static int      gb_pages;
+static int      have_pat;
+static uint64_t mapped_limit = LOW_4G;
+static spinlock_t map_lock = SPINLOCK_INIT;
+
+extern char __kernel_end[];             /* linker.ld */
+
+/* ── Memory-type classification ──────────────────────────────────────── */
+
+#define KIND_NONE   0           /* not present                           */
+#define KIND_RAM    1           /* WB, NX                                */
+#define KIND_RAM_X  2           /* WB, executable: low RAM and the image */
+#define KIND_UC     3
+#define KIND_WC     4
+#define KIND_MIXED  5
+
+static uint64_t image_end(void)
+{
+    return ((uint64_t)(uintptr_t)__kernel_end + 0xFFF) & ~0xFFFULL;
+}
+
+/* KIND_RAM if [base, end) is all RAM, KIND_NONE if none of it, else
+ * KIND_MIXED.  The kernel image counts as RAM whatever E820 says. */
+static int ram_kind(uint64_t base, uint64_t end)
+{
+    uint64_t k1 = image_end();
+    if (base >= 0x100000 && end <= k1)
+        return KIND_RAM;
+    int touches = base < k1 && end > 0x100000;
+
+    for (uint32_t i = 0; i < ram_count; i++) {
+        uint64_t r0 = ram[i].base;
+        uint64_t r1 = r0 + ram[i].size;
+        if (base >= r0 && end <= r1)
+            return KIND_RAM;
+        if (base < r1 && end > r0)
+            touches = 1;
+    }
+    return touches ? KIND_MIXED : KIND_NONE;
+}
+
+/* A 4 KB page that is partly RAM (an E820 entry ending mid-page) is
+ * treated as RAM, so `leaf` never yields KIND_MIXED. */
+static int classify(uint64_t base, uint64_t size, int leaf)
+{
+    uint64_t end = base + size;
+    uint64_t kx  = image_end();
+    int r = ram_kind(base, end);
+
+    if (r == KIND_MIXED && !leaf)
+        return KIND_MIXED;
+    if (r != KIND_NONE) {
+        if (end <= kx || (leaf && base < kx))
+            return KIND_RAM_X;
+        return base >= kx ? KIND_RAM : KIND_MIXED;
+    }
+
+    if (base >= VGA_START && end <= VGA_END)
+        return KIND_WC;
+    if (base < VGA_END && end > VGA_START)
+        return KIND_MIXED;
+    if (base >= LOW_4G)
+        return KIND_NONE;
+    return end <= LOW_4G ? KIND_UC : KIND_MIXED;
+}
+
+/* ── Table construction ──────────────────────────────────────────────── */
+
+/* Tables are zeroed as they are taken, so a pool never depends on who
+ * cleared .bss; 0 when the level's pool is empty */
+static uint64_t *alloc_table(int level)
+{
+    static const uint32_t size[4] = { 1, PDPT_POOL, PD_POOL, PT_POOL };
+    if (used[level] >= size[level])
+        return 0;
+
+    uint64_t *t;
+    switch (level) {
+    case 0:  t = pml4;             break;
+    case 1:  t = pdpt[used[1]];    break;
+    case 2:  t = pd[used[2]];      break;
+    default: t = pt[used[3]];      break;
+    }
+    used[level]++;
+    for (uint32_t i = 0; i < ENTRIES; i++)
+        t[i] = 0;
+    return t;
+}
+
+static uint64_t table_entry(const uint64_t *next)
+{
+    return ((uint64_t)(uintptr_t)next & PTE_ADDR_MASK) | PTE_P | PTE_W;
+}
+
+static uint64_t leaf_entry(uint64_t addr, int level, int kind)
+{
+    uint64_t e = addr | PTE_P | PTE_W | PTE_G;
+    if (level < 3)
+        e |= PTE_PS;
+    if (kind == KIND_WC && !have_pat)
+        kind = KIND_UC;
+
+    switch (kind) {
+    case KIND_RAM_X:
+        break;
+    case KIND_RAM:
+        e |= nx_bit;
+        break;
+    case KIND_WC:
+        e |= (level == 3 ? PTE_PAT_4K : PTE_PAT_LARGE) | nx_bit;
+        break;
+    case KIND_UC:
+        e |= PTE_PCD | PTE_PWT | nx_bit;
+        break;
+    default:                    /* pool ran out on a mixed range */
+        e |= PTE_PCD | PTE_PWT;
+        if (addr >= image_end())
+            e |= nx_bit;
+        break;
+    }
+    return e;
+}
+
+/* Fill the first `count` entries of a level-`level` table covering
+ * [base, base + count * span).  Returns -1 if a range had to be left
+ * unmapped for want of a table; mapped_limit is then set to its start
+ * and the remaining entries stay not present. */
+static int map_level(uint64_t *table, int level, uint64_t base,
+                     uint32_t count)
+{
+    uint64_t span = 1ULL << (12 + 9 * (3 - level));
+    int leaf_ok = level >= 2 || (level == 1 && gb_pages);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t addr = base + i * span;
+        int kind = classify(addr, span, level == 3);
+
+        if (kind == KIND_NONE)
+            continue;
+        if (leaf_ok && kind != KIND_MIXED) {
+            table[i] = leaf_entry(addr, level, kind);
+            continue;
+        }
+
+        uint64_t *next = alloc_table(level + 1);
+        if (!next) {
+            if (!leaf_ok) {
+                mapped_limit = addr;
+                return -1;
+            }
+            table[i] = leaf_entry(addr, level, KIND_MIXED);
+            continue;
+        }
+        int rc = map_level(next, level + 1, addr, ENTRIES);
+        table[i] = table_entry(next);
+        if (rc < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static void detect_features(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    do_cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    have_pat = (edx & CPUID1_EDX_PAT) != 0;
+
+    do_cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000001)
+        return;
+    do_cpuid(0x80000001, 0, &eax, &ebx, &ecx, &edx);
+    nx_bit   = (edx & CPUIDX_EDX_NX) ? PTE_NX : 0;
+    gb_pages = (edx & CPUIDX_EDX_PDPE1GB) != 0;
+}
+
+static inline void write_cr4_pge(void)
+{
+    uint64_t cr4;
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    __asm__ volatile ("mov %0, %%cr4" :: "r"(cr4 | CR4_PGE) : "memory");
+}
+
+void paging_init(void)
+{
+    for (int l = 0; l < 4; l++)
+        used[l] = 0;
+    nx_bit = 0;
+    gb_pages = have_pat = 0;
+    detect_features();
+
+    ram_count = e820_ram_regions(ram, E820_MAX_ENTRIES);
+    uint64_t top = LOW_4G;
+    for (uint32_t i = 0; i < ram_count; i++)
+        if (ram[i].base + ram[i].size > top)
+            top = ram[i].base + ram[i].size;
+    top = (top + GB - 1) & ~(GB - 1);
+    if (top > PDPT_POOL * (ENTRIES * GB))
+        top = PDPT_POOL * (ENTRIES * GB);
+    mapped_limit = top;
+
+    /* One PML4 entry per 512 GB; the upper-half copies make the direct
+     * map, sharing every table below */
+    uint64_t *root = alloc_table(0);
+    uint32_t slots = (uint32_t)((top + ENTRIES * GB - 1) / (ENTRIES * GB));
+    for (uint32_t s = 0; s < slots; s++) {
+        uint64_t *l1 = alloc_table(1);
+        uint64_t base = (uint64_t)s * ENTRIES * GB;
+        uint32_t n = (uint32_t)((top - base) / GB);
+        int rc = map_level(l1, 1, base, n < ENTRIES ? n : ENTRIES);
+        root[s] = root[ENTRIES / 2 + s] = table_entry(l1);
+        if (rc < 0)
+            break;
+    }
+    /* The rest of the identity slots too, empty, for user spaces to copy
+     * (pd_for() then never has to add one) */
+    for (uint32_t s = 0; s < PDPT_POOL; s++)
+        if (!(root[s] & PTE_P))
+            root[s] = root[ENTRIES / 2 + s] = table_entry(alloc_table(1));
+
+    /* NXE before any NX entry is live, PAT before any WC one.  The CR3
+     * load flushes the stage2 mappings (never global); wbinvd drops
+     * lines cached under the old write-back attributes of MMIO. */
+    if (nx_bit)
+        wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+    if (have_pat)
+        wrmsr(MSR_PAT, PAT_VALUE);
+    __asm__ volatile ("mov %0, %%cr3" :: "r"((uint64_t)(uintptr_t)root)
+                      : "memory");
+    __asm__ volatile ("wbinvd" ::: "memory");
+    write_cr4_pge();
+}
+
+void paging_cpu_init(void)
+{
+    if (have_pat)
+        wrmsr(MSR_PAT, PAT_VALUE);
+    /* Reload CR3 so nothing cached under the reset PAT survives */
+    uint64_t cr3;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+    __asm__ volatile ("mov %0, %%cr3" :: "r"(cr3) : "memory");
+    write_cr4_pge();
+}
+
+uint64_t paging_mapped_limit(void)
+{
+    return mapped_limit;
+}
+
+uint64_t paging_efer_bits(void)
+{
+    return nx_bit ? EFER_NXE : 0;
+}
+
+/* ── MMIO mappings ───────────────────────────────────────────────────── */
+
+/* PD covering the GB at `pa`, splitting a 1 GB page or creating the PD
+ * (and PDPT) if needed; 0 when a pool is empty.  map_lock held. */
+static uint64_t *pd_for(uint64_t pa)
+{
+    uint32_t s  = (uint32_t)(pa >> 39) & (ENTRIES - 1);
+    uint32_t gi = (uint32_t)(pa >> 30) & (ENTRIES - 1);
+
+    if (!(pml4[s] & PTE_P)) {
+        uint64_t *l1 = alloc_table(1);
+        if (!l1)
+            return 0;
+        pml4[s] = pml4[ENTRIES / 2 + s] = table_entry(l1);
+    }
+    uint64_t *l1 = (uint64_t *)(uintptr_t)(pml4[s] & PTE_ADDR_MASK);
+    uint64_t e = l1[gi];
+    if ((e & PTE_P) && !(e & PTE_PS))
+        return (uint64_t *)(uintptr_t)(e & PTE_ADDR_MASK);
+
+    uint64_t *l2 = alloc_table(2);
+    if (!l2)
+        return 0;
+    if (e & PTE_P) {            /* split a 1 GB page into 2 MB ones */
+        uint64_t attr = e & ~PTE_ADDR_MASK;
+        for (uint32_t i = 0; i < ENTRIES; i++)
+            l2[i] = ((e & PTE_ADDR_MASK) + ((uint64_t)i << 21)) | attr;
+    }
+    l1[gi] = table_entry(l2);
+    return l2;
+}
+
+int paging_map_mmio(uint64_t pa, uint64_t size, int type)
+{
+    uint64_t start = pa & ~0x1FFFFFULL;
+    uint64_t end   = (pa + size + 0x1FFFFF) & ~0x1FFFFFULL;
+    int kind = type == PAGING_WC ? KIND_WC : KIND_UC;
+
+    if (size == 0 || start < LOW_4K_END || end <= start ||
+        end > PDPT_POOL * (ENTRIES * GB) ||
+        ram_kind(start, end) != KIND_NONE)
+        return -1;
+
+    uint64_t flags = spin_lock_irqsave(&map_lock);
+    int rc = 0;
+    for (uint64_t a = start; a < end; a += 0x200000) {
+        uint64_t *l2 = pd_for(a);
+        if (!l2) {
+            rc = -1;
+            break;
+        }
+        l2[(a >> 21) & (ENTRIES - 1)] = leaf_entry(a, 2, kind);
+        __asm__ volatile ("invlpg (%0)" :: "r"(a) : "memory");
+        __asm__ volatile ("invlpg (%0)" :: "r"(PAGING_DIRECT_BASE + a)
+                          : "memory");
+    }
+    spin_unlock_irqrestore(&map_lock, flags);
+    return rc;
+}
+
+/* ── User address spaces ─────────────────────────────────────────────── */
+
+static uint64_t *table_at(uint64_t e)
+{
+    return (uint64_t *)phys_to_virt(e & PTE_ADDR_MASK);
+}
+
+uint64_t *paging_user_create(void)
+{
+    uint64_t pa = pmm_alloc_page();
+    if (!pa)
+        return 0;
+    uint64_t *root = phys_to_virt(pa);
+    for (uint32_t i = 0; i < ENTRIES; i++)
+        root[i] = i >= USER_SLOT_FIRST && i < USER_SLOT_END ? 0 : pml4[i];
+    return root;
+}
+
+static void free_level(uint64_t *t, int level)
+{
+    if (level < 3)
+        for (uint32_t i = 0; i < ENTRIES; i++)
+            if (t[i] & PTE_P)
+                free_level(table_at(t[i]), level + 1);
+    pmm_free_page(virt_to_phys(t));
+}
+
+void paging_user_destroy(uint64_t *root)
+{
+    for (uint32_t i = USER_SLOT_FIRST; i < USER_SLOT_END; i++)
+        if (root[i] & PTE_P)
+            free_level(table_at(root[i]), 1);
+    pmm_free_page(virt_to_phys(root));
+}
+
+/* Level-3 entry for va, creating the tables on the way if `create`; 0
+ * if one is missing or out of memory */
+static uint64_t *user_pte(uint64_t *root, uint64_t va, int create)
+{
+    uint64_t *t = root;
+    for (int level = 0; level < 3; level++) {
+        uint64_t *e = &t[(va >> (39 - 9 * level)) & (ENTRIES - 1)];
+        if (!(*e & PTE_P)) {
+            uint64_t pa = create ? pmm_alloc_page() : 0;
+            if (!pa)
+                return 0;
+            uint64_t *next = phys_to_virt(pa);
+            for (uint32_t i = 0; i < ENTRIES; i++)
+                next[i] = 0;
+            *e = pa | PTE_P | PTE_W | PTE_U;
+        }
+        t = table_at(*e);
+    }
+    return &t[(va >> 12) & (ENTRIES - 1)];
+}
+
+int paging_user_map(uint64_t *root, uint64_t va, uint64_t pa,
+                    int write, int exec)
+{
+    if (va < PAGING_USER_BASE || va >= PAGING_USER_END || (va & 0xFFF))
+        return -1;
+    uint64_t *pte = user_pte(root, va, 1);
+    if (!pte)
+        return -1;
+    *pte = (pa & PTE_ADDR_MASK) | PTE_P | PTE_U |
+           (write ? PTE_W : 0) | (exec ? 0 : nx_bit);
+    __asm__ volatile ("invlpg (%0)" :: "r"(va) : "memory");
+    return 0;
+}
+
+uint64_t paging_user_lookup(uint64_t *root, uint64_t va, int write)
+{
+    if (va < PAGING_USER_BASE || va >= PAGING_USER_END)
+        return 0;
+    uint64_t *pte = user_pte(root, va, 0);
+    if (!pte || !(*pte & PTE_P) || (write && !(*pte & PTE_W)))
+        return 0;
+    return *pte & PTE_ADDR_MASK;
+}
+
+void paging_user_activate(uint64_t *root)
+{
+    uint64_t pa = root ? virt_to_phys(root) : (uint64_t)(uintptr_t)pml4;
+    uint64_t cr3;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+    if ((cr3 & PTE_ADDR_MASK) != pa)
+        __asm__ volatile ("mov %0, %%cr3" :: "r"(pa) : "memory");
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+
+/* x86_64 kernel page tables — replace the stage2 boot map.
+ *
+ * paging_init() runs once on the boot CPU, before anything touches MMIO
+ * or the frame allocator.  It builds a 4-level map from the E820 table:
+ *
+ *   RAM (usable, ACPI, NVS)   write-back, NX except the low 1 MB and the
+ *                             kernel image
+ *   holes below 4 GB          uncached (PCD|PWT), NX — LAPIC, IOAPIC,
+ *                             PCI windows, BIOS ROM
+ *   0xA0000-0xBFFFF (VGA)     write-combining through PAT entry 4, NX
+ *   holes above 4 GB          not present; see paging_map_mmio()
+ *
+ * Each range gets the largest page that is uniform: 1 GB where CPUID
+ * reports pdpe1gb, otherwise 2 MB, and 4 KB only at boundaries.  All
+ * kernel mappings are global (CR4.PGE), so CR3 reloads keep them.
+ *
+ * The same tables are reachable twice: identity at 0, and a direct map
+ * of all physical memory at PAGING_DIRECT_BASE (upper-half PML4 slots
+ * share the identity PDPTs, so it costs no memory).  Allocators may hand
+ * out direct-map addresses; phys_to_virt() still returns identity ones.
+ */
+
+#define PAGING_DIRECT_BASE  0xFFFF800000000000ULL
+
+/* User address spaces: 64 TB in PML4 slots 128-255.  The last page is
+ * left out, so a SYSCALL at the very top can never have SYSRET return to
+ * a non-canonical address (which would fault in ring 0). */
+#define PAGING_USER_BASE    0x0000400000000000ULL
+#define PAGING_USER_END     0x00007FFFFFFFF000ULL
+
+#define PAGING_UC  0                /* uncached                           */
+#define PAGING_WC  1                /* write-combining (frame buffers)    */
+
+void     paging_init(void);
+/* Per-CPU part for APs: PAT and CR4.PGE (EFER.NXE is set by ap_boot) */
+void     paging_cpu_init(void);
+/* Physical addresses below this are mapped (RAM beyond a full table pool
+ * is not, and must not be offered to the allocator) */
+uint64_t paging_mapped_limit(void);
+/* EFER bits the APs must set before enabling paging */
+uint64_t paging_efer_bits(void);
+
+/* Map device memory [pa, pa + size) in 2 MB steps as PAGING_UC or
+ * PAGING_WC, identity and direct.  Refuses (-1) ranges that overlap RAM
+ * or the 4 KB-mapped low 2 MB.  Call before other CPUs use the range:
+ * there is no TLB shootdown. */
+int      paging_map_mmio(uint64_t pa, uint64_t size, int type);
+
+static inline void *paging_direct(uint64_t pa)
+{
+    return (void *)(uintptr_t)(PAGING_DIRECT_BASE + pa);
+}
+
+/* User address spaces (hal_uspace_*): a PML4 holding the kernel's
+ * entries and none below PAGING_USER_BASE's slot.  user_map() maps one
+ * 4 KB frame, user read plus write / execute as asked, -1 outside the
+ * user range or out of memory; lookup() returns the frame, 0 if there is
+ * none (or it is read-only and `write`).  activate(0) goes back to the
+ * kernel tables.  Flushes only the calling CPU's TLB. */
+uint64_t *paging_user_create(void);
+void      paging_user_destroy(uint64_t *root);
+int       paging_user_map(uint64_t *root, uint64_t va, uint64_t pa,
+                          int write, int exec);
+uint64_t  paging_user_lookup(uint64_t *root, uint64_t va, int write);
+void      paging_user_activate(uint64_t *root);
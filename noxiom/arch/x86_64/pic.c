@@ -47,6 +47,13 @@ void pic_init(void) {
     outb(PIC2_DATA, mask2);
 }
 
+void pic_disable(void) {
+    /* Remapped first, so a spurious IRQ 7/15 cannot alias an exception */
+    pic_init();
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
 void pic_send_eoi(uint8_t irq) {
     if (irq >= 8)
         outb(PIC2_CMD, 0x20);
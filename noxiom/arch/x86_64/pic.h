@@ -2,6 +2,9 @@
 #include <stdint.h>
 
 void pic_init(void);
+/* Remapped out of the exception range and fully masked, for when the
+ * IOAPIC takes over */
+void pic_disable(void);
 void pic_send_eoi(uint8_t irq);
 void pic_mask(uint8_t irq);
 void pic_unmask(uint8_t irq);
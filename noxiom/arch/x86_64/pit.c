@@ -0,0 +1,38 @@
+/* arch/x86_64/pit.c — polled 8254 PIT delays
+ *
+ * Channel 2 is gated through port 0x61 and its output can be read back in
+ * bit 5 of the same port, so a delay is: load a count in mode 0 (interrupt
+ * on terminal count) and spin until OUT2 goes high.  The speaker stays
+ * disconnected (port 0x61 bit 1 cleared).
+ */
+#include "pit.h"
+#include "io.h"
+
+#define PIT_CH2      0x42
+#define PIT_CMD      0x43
+#define PIT_GATE     0x61
+
+#define PIT_MAX_CHUNK_US 50000      /* 65535 ticks ≈ 54.9 ms */
+
+void pit_delay_us(uint32_t us)
+{
+    while (us) {
+        uint32_t chunk = us > PIT_MAX_CHUNK_US ? PIT_MAX_CHUNK_US : us;
+        uint32_t ticks = (uint32_t)((uint64_t)chunk * PIT_HZ / 1000000u);
+        if (ticks == 0)
+            ticks = 1;
+
+        /* Gate on, speaker off */
+        outb(PIT_GATE, (uint8_t)((inb(PIT_GATE) & ~0x02) | 0x01));
+
+        /* Channel 2, lobyte/hibyte, mode 0, binary */
+        outb(PIT_CMD, 0xB0);
+        outb(PIT_CH2, (uint8_t)(ticks & 0xFF));
+        outb(PIT_CH2, (uint8_t)(ticks >> 8));
+
+        while (!(inb(PIT_GATE) & 0x20))
+            ;
+
+        us -= chunk;
+    }
+}
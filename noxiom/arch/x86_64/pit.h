@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+/* 8254 PIT channel 2, used as a polled reference clock for short
+ * busy-wait delays (AP start-up, timer calibration).  Does not use IRQ0. */
+
+#define PIT_HZ 1193182u
+
+void pit_delay_us(uint32_t us);
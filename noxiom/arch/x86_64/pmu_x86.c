@@ -0,0 +1,142 @@
+/* arch/x86_64/pmu_x86.c — architectural performance counters (Intel)
+ *
+ * CPUID leaf 0xA gives the number and width of the general-purpose
+ * counters and which of the architectural events are missing.  Counter
+ * n is IA32_PERFEVTSELn (event, unit mask, USR|OS|EN, INT to interrupt
+ * on overflow) plus IA32_PMCn.  From perfmon version 2 on,
+ * IA32_PERF_GLOBAL_CTRL gates all counters and GLOBAL_STATUS/OVF_CTRL
+ * report and clear overflows; version 1 only has the per-counter EN.
+ *
+ * Sampling runs on counter 0, preloaded with -period.  A write to
+ * IA32_PMCn sets the low 32 bits and sign-extends them, hence periods
+ * below 2^31.  The overflow raises LAPIC_PMI_VECTOR, and delivering it
+ * masks the LVT entry again; the handler reloads the counter and
+ * unmasks it.
+ *
+ * AMD has its own MSRs and no leaf 0xA, so it reports no counters.
+ */
+#include "pmu_x86.h"
+#include "cpuid.h"
+#include "lapic.h"
+#include "msr.h"
+
+#define EVTSEL_USR  (1u << 16)
+#define EVTSEL_OS   (1u << 17)
+#define EVTSEL_INT  (1u << 20)
+#define EVTSEL_EN   (1u << 22)
+
+/* Event select, unit mask and CPUID.0xA:EBX bit of each HAL_PMU_* */
+static const struct {
+    uint8_t event;
+    uint8_t umask;
+    uint8_t bit;
+} pmu_events[HAL_PMU_EVENTS] = {
+    [HAL_PMU_CYCLES]        = { 0x3C, 0x00, 0 },   /* unhalted core cycles */
+    [HAL_PMU_INSTRUCTIONS]  = { 0xC0, 0x00, 1 },   /* instructions retired */
+    [HAL_PMU_CACHE_MISSES]  = { 0x2E, 0x41, 4 },   /* LLC misses           */
+    [HAL_PMU_BRANCH_MISSES] = { 0xC5, 0x00, 6 },   /* branch mispredicts  */
+};
+
+static cpuid_perfmon_t     perfmon;
+static hal_pmu_sample_fn_t sample_fn;
+static uint64_t            sample_period;
+
+void pmu_x86_init(void)
+{
+    cpuid_perfmon(&perfmon);
+    if (perfmon.version == 0)
+        perfmon.counters = 0;
+}
+
+uint32_t pmu_x86_counters(void)
+{
+    return perfmon.counters;
+}
+
+int pmu_x86_has_event(uint32_t event)
+{
+    if (event >= HAL_PMU_EVENTS || perfmon.counters == 0)
+        return 0;
+    uint32_t bit = pmu_events[event].bit;
+    return bit < perfmon.events && !(perfmon.unavailable & (1u << bit));
+}
+
+static uint64_t evtsel(uint32_t event)
+{
+    return pmu_events[event].event |
+           (uint64_t)pmu_events[event].umask << 8 | EVTSEL_USR | EVTSEL_OS;
+}
+
+static void global_ctrl(uint64_t mask)
+{
+    if (perfmon.version >= 2)
+        wrmsr(MSR_PERF_GLOBAL_CTRL, mask);
+}
+
+void pmu_x86_stop(void)
+{
+    if (perfmon.counters == 0)
+        return;
+    global_ctrl(0);
+    for (uint32_t i = 0; i < perfmon.counters; i++)
+        wrmsr(MSR_PERFEVTSEL0 + i, 0);
+    lapic_pmi_enable(0);
+}
+
+int pmu_x86_count_start(const uint32_t *events, uint32_t n)
+{
+    if (n > perfmon.counters)
+        return -1;
+    for (uint32_t i = 0; i < n; i++)
+        if (!pmu_x86_has_event(events[i]))
+            return -1;
+
+    pmu_x86_stop();
+    for (uint32_t i = 0; i < n; i++) {
+        wrmsr(MSR_PMC0 + i, 0);
+        wrmsr(MSR_PERFEVTSEL0 + i, evtsel(events[i]) | EVTSEL_EN);
+    }
+    global_ctrl((1ULL << n) - 1);
+    return 0;
+}
+
+void pmu_x86_count_read(uint64_t *counts, uint32_t n)
+{
+    uint64_t mask = perfmon.width < 64 ? (1ULL << perfmon.width) - 1 : ~0ULL;
+    for (uint32_t i = 0; i < n && i < perfmon.counters; i++)
+        counts[i] = rdmsr(MSR_PMC0 + i) & mask;
+}
+
+int pmu_x86_sample_start(uint32_t event, uint64_t period,
+                         hal_pmu_sample_fn_t fn)
+{
+    if (!pmu_x86_has_event(event) || !lapic_present() ||
+        period == 0 || period >= (1ULL << 31))
+        return -1;
+
+    pmu_x86_stop();
+    sample_fn     = fn;
+    sample_period = period;
+    wrmsr(MSR_PMC0, -period);
+    wrmsr(MSR_PERFEVTSEL0, evtsel(event) | EVTSEL_INT | EVTSEL_EN);
+    lapic_pmi_enable(1);
+    global_ctrl(1);
+    return 0;
+}
+
+void pmu_x86_irq(uint64_t rip)
+{
+    int ours = 1;
+    if (perfmon.version >= 2) {
+        uint64_t status = rdmsr(MSR_PERF_GLOBAL_STATUS);
+        wrmsr(MSR_PERF_GLOBAL_OVF_CTRL, status);
+        ours = status & 1;
+    }
+    if (ours) {
+        if (sample_fn)
+            sample_fn(rip);
+        wrmsr(MSR_PMC0, -sample_period);
+    }
+    lapic_pmi_enable(1);
+    lapic_eoi();
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include "hal.h"
+
+/* Architectural performance monitoring (CPUID leaf 0xA) — the x86_64
+ * side of hal_pmu_*().  pmu_x86_init() reads the leaf once on the boot
+ * CPU; everything else programs the calling CPU. */
+
+void     pmu_x86_init(void);
+uint32_t pmu_x86_counters(void);
+int      pmu_x86_has_event(uint32_t event);
+int      pmu_x86_count_start(const uint32_t *events, uint32_t n);
+void     pmu_x86_count_read(uint64_t *counts, uint32_t n);
+int      pmu_x86_sample_start(uint32_t event, uint64_t period,
+                              hal_pmu_sample_fn_t fn);
+void     pmu_x86_stop(void);
+
+/* LAPIC_PMI_VECTOR handler (idt.c); rip = interrupted instruction */
+void     pmu_x86_irq(uint64_t rip);
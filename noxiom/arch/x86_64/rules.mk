@@ -5,8 +5,20 @@
 ASM  := nasm
 CC   := gcc
 LD   := ld
+NM   := nm
+OBJCOPY := objcopy
+LZ4  := lz4
 QEMU := qemu-system-x86_64
 
+# 1 = store the kernel LZ4-compressed; stage2 decompresses it in long
+# mode (needs the lz4 tool; run make clean after changing it)
+KERNEL_LZ4 ?= 0
+
+# 1 = run every benchmark (bench/bench.h) before the shell starts and
+# print the results to serial as CSV, for CI runs under QEMU (run make
+# clean after changing it)
+BENCH_AT_BOOT ?= 0
+
 BUILD := build/x86_64
 
 CFLAGS := -std=c11 -ffreestanding -fno-stack-protector \
@@ -15,13 +27,74 @@ CFLAGS := -std=c11 -ffreestanding -fno-stack-protector \
           -mcmodel=kernel -Wall -Wextra \
           -Ikernel/src -Iarch/x86_64
 
+ifeq ($(BENCH_AT_BOOT),1)
+CFLAGS += -DBENCH_AT_BOOT
+endif
+
 LDFLAGS := -T arch/x86_64/linker.ld -nostdlib -static -z max-page-size=0x1000
 
 # Portable kernel sources
 KERNEL_SRCS := \
     kernel/src/main.c           \
     kernel/src/hal_hw_detect.c  \
+    kernel/src/hal_irq.c        \
     kernel/src/string.c         \
+    kernel/src/mm/pmm.c         \
+    kernel/src/mm/kmalloc.c     \
+    kernel/src/mm/arena.c       \
+    kernel/src/smp/smp.c        \
+    kernel/src/smp/percpu.c     \
+    kernel/src/sync/rcu.c       \
+    kernel/src/sched/sched.c    \
+    kernel/src/sched/rr.c       \
+    kernel/src/sched/fair.c     \
+    kernel/src/sched/fpu.c      \
+    kernel/src/time/timer.c     \
+    kernel/src/time/bootstats.c \
+    kernel/src/log/klog.c       \
+    kernel/src/prof/ksyms.c     \
+    kernel/src/prof/perf.c      \
+    kernel/src/prof/perf_cmd.c  \
+    kernel/src/pci/pci.c        \
+    kernel/src/pci/pci_cmd.c    \
+    kernel/src/virtio/virtio.c  \
+    kernel/src/virtio/virtqueue.c\
+    kernel/src/virtio/virtio_pci.c\
+    kernel/src/virtio/virtio_mmio.c\
+    kernel/src/net/netbuf.c     \
+    kernel/src/net/netdev.c     \
+    kernel/src/net/virtio_net.c \
+    kernel/src/net/inet.c       \
+    kernel/src/net/netcore.c    \
+    kernel/src/net/iface.c      \
+    kernel/src/net/eth.c        \
+    kernel/src/net/neigh.c      \
+    kernel/src/net/ipv4.c       \
+    kernel/src/net/ipv6.c       \
+    kernel/src/net/icmp.c       \
+    kernel/src/net/udp.c        \
+    kernel/src/net/tcp.c        \
+    kernel/src/net/tcp_input.c  \
+    kernel/src/net/tcp_output.c \
+    kernel/src/net/net_cmd.c    \
+    kernel/src/blk/blkdev.c     \
+    kernel/src/blk/virtio_blk.c \
+    kernel/src/blk/ahci.c       \
+    kernel/src/blk/sdhci.c      \
+    kernel/src/blk/blk_cmd.c    \
+    kernel/src/fs/pcache.c      \
+    kernel/src/fs/vfs.c         \
+    kernel/src/fs/fat32.c       \
+    kernel/src/fs/ext2.c        \
+    kernel/src/fs/fs_cmd.c      \
+    kernel/src/user/user.c      \
+    kernel/src/user/vm.c        \
+    kernel/src/user/elf.c       \
+    kernel/src/user/syscall.c   \
+    kernel/src/user/user_cmd.c  \
+    kernel/src/bench/bench.c    \
+    kernel/src/bench/benchmarks.c\
+    kernel/src/bench/bench_cmd.c\
     kernel/src/shell/shell.c
 
 # x86_64-specific sources
@@ -33,7 +106,21 @@ ARCH_SRCS := \
     arch/x86_64/gdt.c           \
     arch/x86_64/idt.c           \
     arch/x86_64/pic.c           \
-    arch/x86_64/cpuid.c
+    arch/x86_64/ioapic.c        \
+    arch/x86_64/intc_x86.c      \
+    arch/x86_64/cpuid.c         \
+    arch/x86_64/e820.c          \
+    arch/x86_64/acpi.c          \
+    arch/x86_64/lapic.c         \
+    arch/x86_64/pit.c           \
+    arch/x86_64/tsc.c           \
+    arch/x86_64/string_x86.c    \
+    arch/x86_64/dispatch_x86.c  \
+    arch/x86_64/paging.c        \
+    arch/x86_64/pmu_x86.c       \
+    arch/x86_64/smp_x86.c       \
+    arch/x86_64/syscall_x86.c   \
+    arch/x86_64/fpu_x86.c
 
 C_SRCS := $(KERNEL_SRCS) $(ARCH_SRCS)
 C_OBJS := $(patsubst %.c, $(BUILD)/%.o, $(C_SRCS))
@@ -43,26 +130,83 @@ C_OBJS := $(patsubst %.c, $(BUILD)/%.o, $(C_SRCS))
 all: $(BUILD)/noxiom.img
 
 # ── Disk image ──────────────────────────────────────────────────────────────
-$(BUILD)/noxiom.img: $(BUILD)/stage1.bin $(BUILD)/stage2.bin $(BUILD)/kernel.bin
-	dd if=/dev/zero           of=$@                 bs=512 count=4096
-	dd if=$(BUILD)/stage1.bin of=$@ bs=512 seek=0  conv=notrunc
-	dd if=$(BUILD)/stage2.bin of=$@ bs=512 seek=1  conv=notrunc
-	dd if=$(BUILD)/kernel.bin of=$@ bs=512 seek=17 conv=notrunc
+# LBA 0 stage1, 1-16 stage2, 17 kernel header, 18+ kernel payload
+# (boot/kernel_hdr.inc); the image grows past 2 MB if the kernel does
+$(BUILD)/noxiom.img: $(BUILD)/stage1.bin $(BUILD)/stage2.bin \
+                     $(BUILD)/kernel_hdr.bin $(BUILD)/kernel.payload
+	dd if=/dev/zero               of=$@       bs=512 count=4096
+	dd if=$(BUILD)/stage1.bin     of=$@ bs=512 seek=0  conv=notrunc
+	dd if=$(BUILD)/stage2.bin     of=$@ bs=512 seek=1  conv=notrunc
+	dd if=$(BUILD)/kernel_hdr.bin of=$@ bs=512 seek=17 conv=notrunc
+	dd if=$(BUILD)/kernel.payload of=$@ bs=512 seek=18 conv=notrunc
 
 # ── Bootloader ─────────────────────────────────────────────────────────────
 $(BUILD)/stage1.bin: arch/x86_64/boot/stage1.asm | $(BUILD)
 	$(ASM) -f bin $< -o $@
 
-$(BUILD)/stage2.bin: arch/x86_64/boot/stage2.asm | $(BUILD)
-	$(ASM) -f bin $< -o $@
+$(BUILD)/stage2.bin: arch/x86_64/boot/stage2.asm \
+                     arch/x86_64/boot/kernel_hdr.inc | $(BUILD)
+	$(ASM) -f bin -i arch/x86_64/boot/ $< -o $@
+
+# ── Kernel header: sizes and entry point of the linked kernel ──────────────
+$(BUILD)/kernel_hdr.bin: arch/x86_64/boot/kernel_hdr.asm \
+                         arch/x86_64/boot/kernel_hdr.inc \
+                         $(BUILD)/kernel.elf $(BUILD)/kernel.payload
+	$(ASM) -f bin -i arch/x86_64/boot/ $< -o $@ \
+	    -DENTRY=0x$$($(NM) $(BUILD)/kernel.elf | awk '$$3 == "_start" { print $$1 }') \
+	    -DMEM_END=0x$$($(NM) $(BUILD)/kernel.elf | awk '$$3 == "__kernel_end" { print $$1 }') \
+	    -DIMAGE_SIZE=$$(stat -c %s $(BUILD)/kernel.bin) \
+	    -DPAYLOAD_SIZE=$$(stat -c %s $(BUILD)/kernel.payload) \
+	    -DFLAGS=$(if $(filter 1,$(KERNEL_LZ4)),1,0)
 
 # ── Kernel entry (must be first in link order so _start = 0x100000) ────────
 $(BUILD)/entry.o: arch/x86_64/entry.asm | $(BUILD)
 	$(ASM) -f elf64 $< -o $@
 
-# ── Kernel binary ──────────────────────────────────────────────────────────
-$(BUILD)/kernel.bin: $(BUILD)/entry.o $(C_OBJS)
-	$(LD) $(LDFLAGS) $^ -o $@
+# ── AP start-up trampoline (copied below 1 MB at runtime) ──────────────────
+$(BUILD)/ap_boot.o: arch/x86_64/ap_boot.asm | $(BUILD)
+	$(ASM) -f elf64 $< -o $@
+
+# ── Kernel symbol table (prof/ksyms.h) ─────────────────────────────────────
+# $(call gen_ksyms,<nm output command>,<out.c>): the .text symbols, sorted
+# by address, as ksym_table.  The kernel is linked once with an empty
+# table (ksyms0.o), then again with the real one last; since it holds no
+# code nothing in .text moves, which the second pass checks.
+KSYMS_AWK := '$$2 ~ /^[tTW]$$/ && $$3 !~ /^\$$/ { printf "    { 0x%s, \"%s\" },\n", $$1, $$3 }'
+
+define gen_ksyms
+{ echo '#include "prof/ksyms.h"';                             \
+  echo 'const ksym_t ksym_table[] = {';                       \
+  $(1) | awk $(KSYMS_AWK);                                    \
+  echo '    { ~0ULL, "" }';                                   \
+  echo '};'; } > $(2)
+endef
+
+$(BUILD)/ksyms0.o: | $(BUILD)
+	$(call gen_ksyms,true,$(BUILD)/ksyms0.c)
+	$(CC) $(CFLAGS) -c $(BUILD)/ksyms0.c -o $@
+
+# ── Kernel binary: link, strip ELF → flat image, optionally compress ───────
+$(BUILD)/kernel.elf: $(BUILD)/entry.o $(BUILD)/ap_boot.o $(C_OBJS) \
+                     $(BUILD)/ksyms0.o
+	$(LD) $(LDFLAGS) $(filter-out %/ksyms0.o, $^) $(BUILD)/ksyms0.o \
+	    -o $(BUILD)/kernel.1.elf
+	$(call gen_ksyms,$(NM) -n $(BUILD)/kernel.1.elf,$(BUILD)/ksyms.c)
+	$(CC) $(CFLAGS) -c $(BUILD)/ksyms.c -o $(BUILD)/ksyms.o
+	$(LD) $(LDFLAGS) $(filter-out %/ksyms0.o, $^) $(BUILD)/ksyms.o -o $@
+	$(call gen_ksyms,$(NM) -n $@,$(BUILD)/ksyms.check.c)
+	cmp -s $(BUILD)/ksyms.c $(BUILD)/ksyms.check.c || \
+	    { rm -f $@; echo "ksyms: .text moved in the second link" >&2; exit 1; }
+
+$(BUILD)/kernel.bin: $(BUILD)/kernel.elf
+	$(OBJCOPY) -O binary $< $@
+
+$(BUILD)/kernel.payload: $(BUILD)/kernel.bin
+ifeq ($(KERNEL_LZ4),1)
+	$(LZ4) -l -9 -f -q $< $@
+else
+	cp $< $@
+endif
 
 # ── C object files (preserves directory structure under BUILD) ─────────────
 $(BUILD)/%.o: %.c | $(BUILD)
@@ -1,7 +1,53 @@
+/* arch/x86_64/serial_x86.c — 16550 UART on COM1
+ *
+ * Polled until serial_enable_irq(), then interrupt driven on IRQ4:
+ *   TX — bytes go to a ring and the THR-empty interrupt refills the
+ *        transmitter a whole FIFO (16 bytes) at a time.  The 16550 only
+ *        says "completely empty", so a batch is written only then.
+ *   RX — "data available" and the character-timeout interrupt drain the
+ *        receiver into a ring and call the notify hook.
+ * A writer that finds the ring full (IRQs masked for a long time, e.g.
+ * early boot or a panic) drains it by polling, so output is never lost.
+ */
 #include "serial_x86.h"
 #include "io.h"
+#include "hal.h"
+#include "ringbuf.h"
+#include "sync/spinlock.h"
 
 #define COM1 0x3F8
+#define COM1_IRQ 4
+
+/* Register offsets (DLAB = 0) */
+#define UART_THR 0             /* TX holding (write) / RX buffer (read) */
+#define UART_IER 1             /* interrupt enable                      */
+#define UART_IIR 2             /* interrupt identification (read)       */
+#define UART_LSR 5             /* line status                           */
+#define UART_MSR 6             /* modem status                          */
+
+#define IER_RDA   0x01         /* received data available               */
+#define IER_THRE  0x02         /* transmitter holding register empty    */
+
+#define IIR_NONE  0x01         /* no interrupt pending                  */
+#define IIR_ID    0x0E
+#define IIR_MSR   0x00
+#define IIR_LSR   0x06
+
+#define LSR_DR    0x01         /* data ready                            */
+#define LSR_THRE  0x20         /* TX FIFO empty                         */
+
+#define FIFO_DEPTH   16
+#define TX_RING_SIZE 1024
+#define RX_RING_SIZE 256
+
+static uint8_t    tx_store[TX_RING_SIZE];
+static uint8_t    rx_store[RX_RING_SIZE];
+static ringbuf_t  tx_ring = RINGBUF_INIT(tx_store);
+static ringbuf_t  rx_ring = RINGBUF_INIT(rx_store);
+static spinlock_t tx_lock = SPINLOCK_INIT;  /* tx_ring writers, ier     */
+static uint8_t    ier;                      /* shadow of UART_IER       */
+static int        irq_mode;
+static void     (*rx_notify)(void);
 
 void serial_init(void) {
     outb(COM1 + 1, 0x00);  /* disable interrupts */
@@ -14,14 +60,131 @@ void serial_init(void) {
 }
 
 static int serial_empty(void) {
-    return inb(COM1 + 5) & 0x20;
+    return inb(COM1 + UART_LSR) & LSR_THRE;
+}
+
+/* ── Interrupt mode ──────────────────────────────────────────────── */
+
+/* tx_lock held: refill the transmitter if it has gone empty */
+static void tx_fill(void) {
+    if (!serial_empty())
+        return;
+    uint8_t c;
+    for (int n = 0; n < FIFO_DEPTH && ringbuf_get(&tx_ring, &c); n++)
+        outb(COM1 + UART_THR, c);
+}
+
+/* tx_lock held.  Enabling THRE while already empty raises it at once. */
+static void tx_irq_update(void) {
+    uint8_t want = ringbuf_empty(&tx_ring) ? ier & ~IER_THRE
+                                           : ier | IER_THRE;
+    if (want != ier) {
+        ier = want;
+        outb(COM1 + UART_IER, ier);
+    }
+}
+
+static void serial_irq(uint32_t irq, void *ctx) {
+    (void)irq;
+    (void)ctx;
+    int got = 0;
+
+    /* Service every pending cause; bounded in case the line is stuck */
+    for (int i = 0; i < 16; i++) {
+        uint8_t iir = inb(COM1 + UART_IIR);
+        if (iir & IIR_NONE)
+            break;
+        switch (iir & IIR_ID) {
+        case IIR_LSR:
+            (void)inb(COM1 + UART_LSR);
+            break;
+        case IIR_MSR:
+            (void)inb(COM1 + UART_MSR);
+            break;
+        default:
+            break;
+        }
+
+        /* On overflow the newest bytes are dropped */
+        while (inb(COM1 + UART_LSR) & LSR_DR) {
+            ringbuf_put(&rx_ring, inb(COM1 + UART_THR));
+            got = 1;
+        }
+
+        spin_lock(&tx_lock);
+        tx_fill();
+        tx_irq_update();
+        spin_unlock(&tx_lock);
+    }
+
+    if (got && rx_notify)
+        rx_notify();
+}
+
+int serial_enable_irq(void (*notify)(void)) {
+    uint64_t flags = spin_lock_irqsave(&tx_lock);
+    rx_notify = notify;
+    ier = IER_RDA;
+    irq_mode = 1;
+    spin_unlock_irqrestore(&tx_lock, flags);
+
+    if (hal_irq_register(COM1_IRQ, serial_irq, 0) != 0) {
+        flags = spin_lock_irqsave(&tx_lock);
+        irq_mode = 0;
+        ier = 0;
+        spin_unlock_irqrestore(&tx_lock, flags);
+        return -1;
+    }
+    outb(COM1 + UART_IER, ier);
+    return 0;
+}
+
+void serial_flush(void) {
+    if (!irq_mode)
+        return;
+
+    /* Best effort: used on the way to halt, where the lock holder may
+     * never release it */
+    int locked = 0;
+    for (int i = 0; i < 1000000 && !(locked = spin_trylock(&tx_lock)); i++)
+        ;
+    while (!ringbuf_empty(&tx_ring)) {
+        while (!serial_empty());
+        tx_fill();
+    }
+    if (locked)
+        spin_unlock(&tx_lock);
 }
 
+/* ── Character I/O ───────────────────────────────────────────────── */
+
 void serial_putchar(char c) {
-    while (!serial_empty());
-    outb(COM1, (uint8_t)c);
+    if (!irq_mode) {
+        while (!serial_empty());
+        outb(COM1, (uint8_t)c);
+        return;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&tx_lock);
+    while (!ringbuf_put(&tx_ring, (uint8_t)c)) {
+        while (!serial_empty());     /* ring full: drain by hand */
+        tx_fill();
+    }
+    tx_fill();
+    tx_irq_update();
+    spin_unlock_irqrestore(&tx_lock, flags);
 }
 
 void serial_print(const char *str) {
     while (*str) serial_putchar(*str++);
 }
+
+int serial_trygetchar(char *c) {
+    if (irq_mode)
+        return ringbuf_get(&rx_ring, (uint8_t *)c);
+
+    if (!(inb(COM1 + UART_LSR) & LSR_DR))
+        return 0;
+    *c = (char)inb(COM1 + UART_THR);
+    return 1;
+}
@@ -1,5 +1,14 @@
 #pragma once
 
+/* COM1 16550 — polled until serial_enable_irq(), then TX and RX go
+ * through ring buffers serviced by IRQ4. */
 void serial_init(void);
+/* notify (may be 0) runs in IRQ context whenever bytes arrive; needs the
+ * interrupt controller.  Returns -1 and stays polled on failure. */
+int  serial_enable_irq(void (*notify)(void));
 void serial_putchar(char c);
 void serial_print(const char *str);
+/* Returns 1 and stores a byte if one is available, 0 otherwise */
+int  serial_trygetchar(char *c);
+/* Push every queued TX byte out by polling (halt / panic paths) */
+void serial_flush(void);
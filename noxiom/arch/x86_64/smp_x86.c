@@ -0,0 +1,143 @@
+/* arch/x86_64/smp_x86.c — application processor start-up
+ *
+ * Start-up sequence for one AP (Intel SDM vol. 3, 8.4.4):
+ *   1. Copy the trampoline to AP_BOOT_ADDR and fill in its data slots
+ *   2. INIT IPI, wait 10 ms
+ *   3. STARTUP IPI (vector = AP_BOOT_ADDR >> 12), wait 200 us
+ *   4. Second STARTUP IPI if the AP has not checked in yet
+ *   5. Wait up to AP_TIMEOUT_MS for ap_main() to set ap_alive
+ * APs are started strictly one after the other, so the single trampoline
+ * copy and its slots are never shared.
+ */
+#include "smp_x86.h"
+#include "acpi.h"
+#include "lapic.h"
+#include "pit.h"
+#include "gdt.h"
+#include "syscall_x86.h"
+#include "fpu_x86.h"
+#include "idt.h"
+#include "paging.h"
+#include "string.h"
+#include "mm/pmm.h"
+#include "smp/percpu.h"
+#include <stdint.h>
+
+#define AP_BOOT_ADDR   0x8000   /* must match ap_boot.asm            */
+#define AP_TIMEOUT_MS  100
+
+/* ap_boot.asm */
+extern char ap_trampoline_start[], ap_trampoline_end[];
+extern char ap_slot_cr3[], ap_slot_stack[], ap_slot_cpu[], ap_slot_entry[];
+extern char ap_slot_efer[];
+
+static uint32_t cpu_apic_id[HAL_MAX_CPUS];
+static uint32_t cpu_count = 1;
+
+static volatile uint32_t cpu_up;        /* LAPIC enabled: takes IRQs */
+
+static volatile uint32_t ap_alive;
+static hal_cpu_entry_t   ap_kernel_entry;
+
+uint32_t smp_x86_init(void)
+{
+    cpu_apic_id[0] = lapic_id();
+    cpu_count = 1;
+    cpu_up = 1;
+
+    const acpi_info_t *acpi = acpi_get_info();
+    for (uint32_t i = 0; i < acpi->cpu_count && cpu_count < HAL_MAX_CPUS; i++) {
+        if (acpi->apic_ids[i] == cpu_apic_id[0])
+            continue;
+        cpu_apic_id[cpu_count++] = acpi->apic_ids[i];
+    }
+    return cpu_count;
+}
+
+const uint32_t *smp_x86_apic_ids(void)
+{
+    return cpu_apic_id;
+}
+
+uint32_t smp_x86_apic_id(uint32_t cpu)
+{
+    if (cpu >= cpu_count ||
+        !(__atomic_load_n(&cpu_up, __ATOMIC_ACQUIRE) & (1u << cpu)))
+        return SMP_X86_NO_APIC;
+    return cpu_apic_id[cpu];
+}
+
+void smp_x86_send_ipi(uint32_t cpu, uint8_t vector)
+{
+    if (cpu < cpu_count && lapic_present())
+        lapic_send_ipi(cpu_apic_id[cpu], vector);
+}
+
+/* ── AP side: first C code, running on the AP's own stack ────────────── */
+
+static void ap_main(uint32_t cpu)
+{
+    percpu_init(cpu);               /* hal_cpu_id() works from here on */
+    paging_cpu_init();
+    gdt_init_ap();
+    idt_init_ap();
+    syscall_x86_cpu_init();
+    fpu_x86_cpu_init();
+    lapic_init();
+    __atomic_or_fetch(&cpu_up, 1u << cpu, __ATOMIC_RELEASE);
+
+    hal_cpu_entry_t entry = ap_kernel_entry;
+    __atomic_store_n(&ap_alive, 1, __ATOMIC_RELEASE);
+
+    entry(cpu);
+    hal_halt();
+}
+
+/* ── BSP side ────────────────────────────────────────────────────────── */
+
+static void put_slot(char *slot, uint64_t val)
+{
+    uint64_t off = (uint64_t)(slot - ap_trampoline_start);
+    *(volatile uint64_t *)phys_to_virt(AP_BOOT_ADDR + off) = val;
+}
+
+static int wait_alive(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms * 10; i++) {
+        if (__atomic_load_n(&ap_alive, __ATOMIC_ACQUIRE))
+            return 1;
+        pit_delay_us(100);
+    }
+    return __atomic_load_n(&ap_alive, __ATOMIC_ACQUIRE);
+}
+
+int smp_x86_start_cpu(uint32_t cpu, void *stack_top, hal_cpu_entry_t entry)
+{
+    if (cpu == 0 || cpu >= cpu_count || !lapic_present())
+        return -1;
+
+    uint64_t cr3;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+
+    kmemcpy(phys_to_virt(AP_BOOT_ADDR), ap_trampoline_start,
+            (size_t)(ap_trampoline_end - ap_trampoline_start));
+    put_slot(ap_slot_cr3,   cr3);
+    put_slot(ap_slot_stack, (uint64_t)(uintptr_t)stack_top);
+    put_slot(ap_slot_cpu,   cpu);
+    put_slot(ap_slot_entry, (uint64_t)(uintptr_t)ap_main);
+    put_slot(ap_slot_efer,  paging_efer_bits());
+
+    ap_kernel_entry = entry;
+    ap_alive = 0;
+
+    uint32_t apic_id = cpu_apic_id[cpu];
+    lapic_send_init(apic_id);
+    pit_delay_us(10000);
+
+    lapic_send_sipi(apic_id, AP_BOOT_ADDR >> 12);
+    pit_delay_us(200);
+    if (!__atomic_load_n(&ap_alive, __ATOMIC_ACQUIRE))
+        lapic_send_sipi(apic_id, AP_BOOT_ADDR >> 12);
+
+    return wait_alive(AP_TIMEOUT_MS) ? 0 : -1;
+}
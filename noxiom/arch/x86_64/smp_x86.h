@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+#include "hal.h"
+
+/* x86 multiprocessor start-up.
+ *
+ * smp_x86_init() builds the CPU table from the ACPI MADT (index 0 is
+ * the boot CPU, its LAPIC already up) and returns the number found.
+ * Secondaries are woken one at a time with INIT-SIPI-SIPI through the
+ * real-mode trampoline in ap_boot.asm.
+ */
+
+#define SMP_X86_NO_APIC  0xFFFFFFFFu
+
+uint32_t smp_x86_init(void);
+/* The table smp_x86_init() built: CPU index → APIC ID, up or not */
+const uint32_t *smp_x86_apic_ids(void);
+/* APIC ID of a CPU whose LAPIC is up, SMP_X86_NO_APIC otherwise */
+uint32_t smp_x86_apic_id(uint32_t cpu);
+int      smp_x86_start_cpu(uint32_t cpu, void *stack_top,
+                           hal_cpu_entry_t entry);
+void     smp_x86_send_ipi(uint32_t cpu, uint8_t vector);
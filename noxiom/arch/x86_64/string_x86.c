@@ -0,0 +1,55 @@
+/* arch/x86_64/string_x86.c — kmemcpy() and kmemset() bodies for x86_64
+ *
+ * With ERMS (CPUID.7:EBX[9], "enhanced rep movsb/stosb") or FSRM
+ * (CPUID.7:EDX[4], "fast short rep movsb") the microcode string engine
+ * is the fastest copy at every size, so the whole length goes to one
+ * rep movsb / rep stosb.  Older CPUs get rep movsq / stosq for the bulk
+ * and a byte tail.  dispatch_x86.c picks one pair; the kernel runs with
+ * DF clear, as the ABI requires.
+ *
+ * The portable routines (kernel/src/string.c) cover everything else.
+ */
+#include "string_x86.h"
+
+void *string_x86_memcpy_movsq(void *dst, const void *src, size_t n)
+{
+    void *d = dst;
+    size_t q = n >> 3;
+
+    __asm__ volatile ("rep movsq"
+                      : "+D"(d), "+S"(src), "+c"(q) :: "memory");
+    n &= 7;
+    __asm__ volatile ("rep movsb"
+                      : "+D"(d), "+S"(src), "+c"(n) :: "memory");
+    return dst;
+}
+
+void *string_x86_memcpy_movsb(void *dst, const void *src, size_t n)
+{
+    void *d = dst;
+    __asm__ volatile ("rep movsb"
+                      : "+D"(d), "+S"(src), "+c"(n) :: "memory");
+    return dst;
+}
+
+void *string_x86_memset_stosq(void *dst, int val, size_t n)
+{
+    void *d = dst;
+    uint64_t pattern = (uint8_t)val * 0x0101010101010101ULL;
+    size_t q = n >> 3;
+
+    __asm__ volatile ("rep stosq"
+                      : "+D"(d), "+c"(q) : "a"(pattern) : "memory");
+    n &= 7;
+    __asm__ volatile ("rep stosb"
+                      : "+D"(d), "+c"(n) : "a"(val) : "memory");
+    return dst;
+}
+
+void *string_x86_memset_stosb(void *dst, int val, size_t n)
+{
+    void *d = dst;
+    __asm__ volatile ("rep stosb"
+                      : "+D"(d), "+c"(n) : "a"(val) : "memory");
+    return dst;
+}
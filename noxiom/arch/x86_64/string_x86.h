@@ -0,0 +1,11 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* The kmemcpy() / kmemset() variants dispatch_x86.c chooses between:
+ *   _movsq / _stosq  rep movsq / stosq for the bulk, a byte tail; any CPU
+ *   _movsb / _stosb  one rep movsb / stosb, for ERMS or FSRM */
+void *string_x86_memcpy_movsq(void *dst, const void *src, size_t n);
+void *string_x86_memcpy_movsb(void *dst, const void *src, size_t n);
+void *string_x86_memset_stosq(void *dst, int val, size_t n);
+void *string_x86_memset_stosb(void *dst, int val, size_t n);
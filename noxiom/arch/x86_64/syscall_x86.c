@@ -0,0 +1,48 @@
+/* arch/x86_64/syscall_x86.c — SYSCALL/SYSRET MSRs
+ *
+ * The boot loader only switches long mode on; the kernel programs the
+ * fast system call MSRs itself, on every CPU, since LSTAR must hold the
+ * address of syscall_entry in this image:
+ *
+ *   STAR   47:32 kernel CS (SS = CS + 8); 63:48 base for SYSRET, which
+ *          loads SS = base + 8 and CS = base + 16, both RPL 3 (gdt.h)
+ *   LSTAR  syscall_entry (entry.asm)
+ *   FMASK  IF, TF, DF, AC and NT are cleared on entry, so the entry code
+ *          runs with IRQs masked until it is on the kernel stack
+ *
+ * CPUID 0x80000001.EDX bit 11 (SYSCALL) is not checked: every x86_64
+ * CPU has it in long mode.  Bit 27 says whether RDTSCP exists.
+ */
+#include "syscall_x86.h"
+#include "cpuid.h"
+#include "gdt.h"
+#include "msr.h"
+#include "hal.h"
+
+#define EFER_SCE            (1ULL << 0)
+#define FMASK_VALUE         0x47700ULL  /* AC, NT, IOPL, DF, IF, TF      */
+#define CPUIDX_EDX_RDTSCP   (1u << 27)  /* leaf 0x80000001 */
+
+extern char syscall_entry[];            /* entry.asm */
+
+void syscall_x86_cpu_init(void)
+{
+    wrmsr(MSR_STAR, ((uint64_t)GDT_KDATA << 48) |
+                    ((uint64_t)GDT_KCODE << 32));
+    wrmsr(MSR_LSTAR, (uint64_t)(uintptr_t)syscall_entry);
+    wrmsr(MSR_FMASK, FMASK_VALUE);
+    wrmsr(MSR_KERNEL_GS_BASE, 0);       /* the user's GS base          */
+    wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_SCE);
+    if (syscall_x86_has_rdtscp())
+        wrmsr(MSR_TSC_AUX, hal_cpu_id());
+}
+
+int syscall_x86_has_rdtscp(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    do_cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000001)
+        return 0;
+    do_cpuid(0x80000001, 0, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUIDX_EDX_RDTSCP) != 0;
+}
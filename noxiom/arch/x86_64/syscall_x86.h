@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+/* SYSCALL/SYSRET set-up and the user-mode entry points in entry.asm.
+ * syscall_x86_cpu_init() programs the calling CPU: STAR, LSTAR, FMASK,
+ * EFER.SCE and TSC_AUX (its CPU index, for RDTSCP in user mode).  Every
+ * CPU, after its GDT is loaded. */
+void syscall_x86_cpu_init(void);
+/* RDTSCP present: user code can read the clock without a syscall */
+int  syscall_x86_has_rdtscp(void);
+
+/* What syscall_entry pushes on the kernel stack, just below its top: all
+ * the user registers but RAX (the result), RIP in RCX's place and RFLAGS
+ * in R11's, as SYSRET wants them.  hal_user_regs_t holds one. */
+typedef struct {
+    uint64_t r15, r14, r13, r12, rbp, rbx;
+    uint64_t r9, r8, r10, rdx, rsi, rdi;
+    uint64_t rip;               /* rcx */
+    uint64_t rflags;            /* r11 */
+    uint64_t rsp;
+} syscall_frame_t;
+
+/* entry.asm */
+void user_enter(uint64_t entry, uint64_t sp, uint64_t arg0, uint64_t arg1)
+    __attribute__((noreturn));
+void user_resume(const syscall_frame_t *frame, uint64_t ret)
+    __attribute__((noreturn));
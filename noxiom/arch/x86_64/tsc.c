@@ -0,0 +1,60 @@
+/* arch/x86_64/tsc.c — TSC calibration and ns conversion
+ *
+ * CPUID bits used:
+ *   1.EDX[4]   TSC present
+ *   1.ECX[24]  LAPIC timer supports TSC-deadline mode
+ * The rate is assumed constant (invariant TSC, CPUID 0x80000007.EDX[8],
+ * or a CPU that never changes frequency); nothing recalibrates it.
+ */
+#include "tsc.h"
+#include "cpuid.h"
+#include "pit.h"
+#include "time/clock.h"
+
+#define CALIBRATE_US  10000         /* PIT window, same as the LAPIC timer */
+
+static uint64_t     s_hz;
+static clock_ref_t  s_ref = CLOCK_REF_INIT;    /* 0 ns = calibration */
+static int          s_deadline;
+
+int tsc_calibrate(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    do_cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    if (!(edx & (1u << 4)))
+        return -1;
+    s_deadline = (ecx >> 24) & 1;
+
+    uint64_t t0 = rdtsc();
+    pit_delay_us(CALIBRATE_US);
+    uint64_t t1 = rdtsc();
+
+    s_hz      = (t1 - t0) * (1000000 / CALIBRATE_US);
+    clock_ref_set(&s_ref, t0, s_hz);
+    return 0;
+}
+
+uint64_t tsc_hz(void)
+{
+    return s_hz;
+}
+
+int tsc_deadline_supported(void)
+{
+    return s_hz && s_deadline;
+}
+
+uint64_t tsc_to_ns(uint64_t tsc)
+{
+    return clock_ref_to_ns(&s_ref, tsc);
+}
+
+uint64_t tsc_from_ns(uint64_t ns)
+{
+    return clock_ref_from_ns(&s_ref, ns);
+}
+
+const clock_ref_t *tsc_ref(void)
+{
+    return &s_ref;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+#include "time/clock.h"
+
+/* Time-stamp counter — the monotonic clock behind hal_timer_now_ns().
+ * Assumes the counters of all CPUs run in step, as they do with an
+ * invariant TSC (and in QEMU/KVM); nothing here tries to resync them. */
+
+/* Measure the TSC rate against the PIT.  Boot CPU, once, before the
+ * APs start (they share the PIT).  Returns -1 if the CPU has no TSC. */
+int      tsc_calibrate(void);
+
+uint64_t tsc_hz(void);              /* 0 until calibrated               */
+int      tsc_deadline_supported(void);  /* LAPIC TSC-deadline timer mode */
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Both directions are relative to the counter value at calibration */
+uint64_t tsc_to_ns(uint64_t tsc);
+uint64_t tsc_from_ns(uint64_t ns);
+const clock_ref_t *tsc_ref(void);
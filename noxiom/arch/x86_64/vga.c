@@ -1,12 +1,33 @@
+/* arch/x86_64/vga.c — VGA text console (80x25 at 0xB8000)
+ *
+ * All drawing goes to a shadow copy in normal RAM; each changed row is
+ * marked dirty, and vga_flush() copies only the dirty rows to the MMIO
+ * text buffer, eight bytes per store.  Scrolling is a memmove of the
+ * shadow.  The hardware cursor (four port writes) is reprogrammed once
+ * per vga_print()/vga_putchar() call, and only if it moved.
+ *
+ * Several CPUs print at once (background shell jobs, user sys_write),
+ * so every public entry point holds vga_lock, IRQs masked, across both
+ * the drawing and the flush: the cursor, the dirty mask and the shadow
+ * only ever change under it.
+ */
 #include "vga.h"
 #include "io.h"
+#include "string.h"
+#include "sync/spinlock.h"
 #include <stddef.h>
 
 #define VGA_ADDR  0xB8000
 #define VGA_CTRL  0x3D4
 #define VGA_DATA  0x3D5
 
-static volatile uint16_t *vga_buf = (volatile uint16_t *)VGA_ADDR;
+#define ALL_ROWS  ((1u << VGA_HEIGHT) - 1)
+
+static spinlock_t vga_lock = SPINLOCK_INIT;
+static volatile uint64_t *vga_mmio = (volatile uint64_t *)VGA_ADDR;
+static uint16_t shadow[VGA_HEIGHT * VGA_WIDTH] __attribute__((aligned(8)));
+static uint32_t dirty;                  /* bit per row changed since flush */
+static uint16_t hw_cursor = 0xFFFF;     /* position last sent to the CRTC  */
 static uint8_t cursor_x = 0;
 static uint8_t cursor_y = 0;
 static uint8_t cur_color = VGA_COLOR(VGA_LIGHT_GREY, VGA_BLACK);
@@ -17,37 +38,72 @@ static inline uint16_t vga_entry(char c, uint8_t attr) {
 
 static void update_cursor(void) {
     uint16_t pos = cursor_y * VGA_WIDTH + cursor_x;
+    if (pos == hw_cursor)
+        return;
+    hw_cursor = pos;
     outb(VGA_CTRL, 14);
     outb(VGA_DATA, (uint8_t)(pos >> 8));
     outb(VGA_CTRL, 15);
     outb(VGA_DATA, (uint8_t)(pos & 0xFF));
 }
 
+/* vga_lock held for everything below up to the public entry points */
+
+/* Copy dirty rows to the screen: one row is 160 bytes = 20 qwords */
+static void vga_flush(void) {
+    const uint64_t *src = (const uint64_t *)shadow;
+    while (dirty) {
+        int y = __builtin_ctz(dirty);
+        dirty &= dirty - 1;
+        size_t off = (size_t)y * (VGA_WIDTH * 2 / 8);
+        for (size_t i = 0; i < VGA_WIDTH * 2 / 8; i++)
+            vga_mmio[off + i] = src[off + i];
+    }
+    __asm__ volatile ("sfence" ::: "memory");   /* buffer is mapped WC */
+    update_cursor();
+}
+
+static inline void put_cell(uint8_t x, uint8_t y, uint16_t v) {
+    shadow[y * VGA_WIDTH + x] = v;
+    dirty |= 1u << y;
+}
+
 void vga_init(void) {
     cur_color = VGA_COLOR(VGA_LIGHT_GREY, VGA_BLACK);
     vga_clear();
 }
 
+static void clear_row(int y) {
+    uint16_t blank = vga_entry(' ', cur_color);
+    for (int x = 0; x < VGA_WIDTH; x++)
+        shadow[y * VGA_WIDTH + x] = blank;
+}
+
 void vga_clear(void) {
-    for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++)
-        vga_buf[i] = vga_entry(' ', cur_color);
+    uint64_t flags = spin_lock_irqsave(&vga_lock);
+    for (int y = 0; y < VGA_HEIGHT; y++)
+        clear_row(y);
+    dirty = ALL_ROWS;
     cursor_x = cursor_y = 0;
-    update_cursor();
+    vga_flush();
+    spin_unlock_irqrestore(&vga_lock, flags);
 }
 
 void vga_set_color(uint8_t color) {
+    uint64_t flags = spin_lock_irqsave(&vga_lock);
     cur_color = color;
+    spin_unlock_irqrestore(&vga_lock, flags);
 }
 
 static void scroll(void) {
-    for (int y = 0; y < VGA_HEIGHT - 1; y++)
-        for (int x = 0; x < VGA_WIDTH; x++)
-            vga_buf[y * VGA_WIDTH + x] = vga_buf[(y + 1) * VGA_WIDTH + x];
-    for (int x = 0; x < VGA_WIDTH; x++)
-        vga_buf[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = vga_entry(' ', cur_color);
+    kmemmove(shadow, shadow + VGA_WIDTH,
+             (VGA_HEIGHT - 1) * VGA_WIDTH * sizeof(shadow[0]));
+    clear_row(VGA_HEIGHT - 1);
+    dirty = ALL_ROWS;
 }
 
-void vga_putchar(char c) {
+/* Draw one character into the shadow; no MMIO, no port I/O */
+static void put(char c) {
     if (c == '\n') {
         cursor_x = 0;
         cursor_y++;
@@ -56,13 +112,13 @@ void vga_putchar(char c) {
     } else if (c == '\b') {
         if (cursor_x > 0) {
             cursor_x--;
-            vga_buf[cursor_y * VGA_WIDTH + cursor_x] = vga_entry(' ', cur_color);
+            put_cell(cursor_x, cursor_y, vga_entry(' ', cur_color));
         }
     } else if (c == '\t') {
         cursor_x = (uint8_t)((cursor_x + 8) & ~7);
         if (cursor_x >= VGA_WIDTH) { cursor_x = 0; cursor_y++; }
     } else {
-        vga_buf[cursor_y * VGA_WIDTH + cursor_x] = vga_entry(c, cur_color);
+        put_cell(cursor_x, cursor_y, vga_entry(c, cur_color));
         cursor_x++;
         if (cursor_x >= VGA_WIDTH) { cursor_x = 0; cursor_y++; }
     }
@@ -71,23 +127,37 @@ void vga_putchar(char c) {
         scroll();
         cursor_y = VGA_HEIGHT - 1;
     }
-    update_cursor();
+}
+
+void vga_putchar(char c) {
+    uint64_t flags = spin_lock_irqsave(&vga_lock);
+    put(c);
+    vga_flush();
+    spin_unlock_irqrestore(&vga_lock, flags);
 }
 
 void vga_print(const char *str) {
-    while (*str) vga_putchar(*str++);
+    uint64_t flags = spin_lock_irqsave(&vga_lock);
+    while (*str) put(*str++);
+    vga_flush();
+    spin_unlock_irqrestore(&vga_lock, flags);
 }
 
 void vga_print_at(const char *str, uint8_t x, uint8_t y, uint8_t color) {
-    uint8_t saved_color = cur_color;
-    cur_color = color;
-    for (int i = 0; str[i]; i++) {
-        vga_buf[y * VGA_WIDTH + x + i] = vga_entry(str[i], color);
+    uint64_t flags = spin_lock_irqsave(&vga_lock);
+    /* Runs past the end of the row continue on the next one, as before */
+    for (int pos = y * VGA_WIDTH + x;
+         *str && pos < VGA_WIDTH * VGA_HEIGHT; pos++, str++) {
+        shadow[pos] = vga_entry(*str, color);
+        dirty |= 1u << (pos / VGA_WIDTH);
     }
-    cur_color = saved_color;
+    vga_flush();
+    spin_unlock_irqrestore(&vga_lock, flags);
 }
 
 void vga_get_cursor(uint8_t *x, uint8_t *y) {
+    uint64_t flags = spin_lock_irqsave(&vga_lock);
     *x = cursor_x;
     *y = cursor_y;
+    spin_unlock_irqrestore(&vga_lock, flags);
 }
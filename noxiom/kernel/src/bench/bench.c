@@ -0,0 +1,186 @@
+/* kernel/src/bench/bench.c — the benchmark runner
+ *
+ * Each sample reads hal_cycles() and hal_timer_now_ns() before and after
+ * its batch.  Samples are kept per batch and only divided by the batch
+ * size when reported, so short operations keep their precision.
+ */
+#include "bench.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../mm/kmalloc.h"
+
+extern const bench_t __bench_start[];
+extern const bench_t __bench_end[];
+
+uint32_t bench_count(void)
+{
+    return (uint32_t)(__bench_end - __bench_start);
+}
+
+const bench_t *bench_get(uint32_t i)
+{
+    return i < bench_count() ? &__bench_start[i] : 0;
+}
+
+const bench_t *bench_find(const char *name)
+{
+    for (const bench_t *b = __bench_start; b < __bench_end; b++)
+        if (kstrcmp(b->name, name) == 0)
+            return b;
+    return 0;
+}
+
+/* ── Timing ───────────────────────────────────────────────────────────── */
+
+typedef struct {
+    uint64_t cycles;
+    uint64_t ns;
+} stamp_t;
+
+static inline void stamp(stamp_t *s)
+{
+    s->cycles = hal_cycles();
+    s->ns     = hal_timer_now_ns();
+}
+
+/* Smallest cost of an empty sample, over a few tries */
+static void overhead(stamp_t *out)
+{
+    out->cycles = out->ns = UINT64_MAX;
+    for (int i = 0; i < 64; i++) {
+        stamp_t a, b;
+        stamp(&a);
+        stamp(&b);
+        if (b.cycles - a.cycles < out->cycles) out->cycles = b.cycles - a.cycles;
+        if (b.ns - a.ns < out->ns)             out->ns     = b.ns - a.ns;
+    }
+}
+
+static uint64_t minus(uint64_t v, uint64_t over)
+{
+    return v > over ? v - over : 0;
+}
+
+/* Shell sort: a few thousand samples, no recursion */
+static void sort(uint64_t *v, uint32_t n)
+{
+    static const uint32_t gaps[] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+    for (uint32_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++) {
+        uint32_t gap = gaps[g];
+        for (uint32_t i = gap; i < n; i++) {
+            uint64_t x = v[i];
+            uint32_t j = i;
+            for (; j >= gap && v[j - gap] > x; j -= gap)
+                v[j] = v[j - gap];
+            v[j] = x;
+        }
+    }
+}
+
+static void summarize(uint64_t *v, uint32_t n, uint32_t batch,
+                      bench_stat_t *out)
+{
+    sort(v, n);
+    out->min    = v[0] / batch;
+    out->median = v[n / 2] / batch;
+    out->p99    = v[(uint64_t)n * 99 / 100] / batch;
+}
+
+/* ── Running ──────────────────────────────────────────────────────────── */
+
+int bench_run(const bench_t *b, bench_result_t *out)
+{
+    uint32_t iters = b->iters ? b->iters : BENCH_ITERS;
+    uint32_t batch = b->batch ? b->batch : 1;
+    if (iters > BENCH_MAX_ITERS)
+        iters = BENCH_MAX_ITERS;
+
+    uint64_t *cycles = kmalloc(iters * sizeof(uint64_t));
+    uint64_t *ns     = kmalloc(iters * sizeof(uint64_t));
+    if (!cycles || !ns || (b->setup && b->setup() != 0)) {
+        kfree(cycles);
+        kfree(ns);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < iters / 8 + 1; i++)
+        for (uint32_t k = 0; k < batch; k++)
+            b->run();
+
+    stamp_t over;
+    overhead(&over);
+    for (uint32_t i = 0; i < iters; i++) {
+        stamp_t t0, t1;
+        stamp(&t0);
+        for (uint32_t k = 0; k < batch; k++)
+            b->run();
+        stamp(&t1);
+        cycles[i] = minus(t1.cycles - t0.cycles, over.cycles);
+        ns[i]     = minus(t1.ns - t0.ns, over.ns);
+    }
+    if (b->teardown)
+        b->teardown();
+
+    out->bench = b;
+    out->iters = iters;
+    out->batch = batch;
+    summarize(cycles, iters, batch, &out->cycles);
+    summarize(ns, iters, batch, &out->ns);
+    kfree(cycles);
+    kfree(ns);
+    return 0;
+}
+
+/* ── CSV ──────────────────────────────────────────────────────────────── */
+
+static const char *const s_var_names[HAL_VAR_COUNT] = {
+    [HAL_VAR_MEMCPY]  = "memcpy",
+    [HAL_VAR_MEMZERO] = "memzero",
+    [HAL_VAR_SUM32]   = "sum32",
+    [HAL_VAR_SPIN]    = "spin",
+};
+
+const char *bench_variant_routine(uint32_t v)
+{
+    return v < HAL_VAR_COUNT ? s_var_names[v] : 0;
+}
+
+void bench_csv_header(void)
+{
+    char line[64];
+    hal_serial_print("bench,name,iters,batch,min_cycles,median_cycles,"
+                     "p99_cycles,min_ns,median_ns,p99_ns\n");
+    for (uint32_t v = 0; v < HAL_VAR_COUNT; v++) {
+        ksnprintf(line, sizeof(line), "variant,%s,%s\n", s_var_names[v],
+                  hal_variant((hal_var_t)v));
+        hal_serial_print(line);
+    }
+}
+
+void bench_csv(const bench_result_t *r)
+{
+    char line[160];
+    ksnprintf(line, sizeof(line),
+              "bench,%s,%u,%u,%lu,%lu,%lu,%lu,%lu,%lu\n",
+              r->bench->name, r->iters, r->batch,
+              (unsigned long)r->cycles.min, (unsigned long)r->cycles.median,
+              (unsigned long)r->cycles.p99, (unsigned long)r->ns.min,
+              (unsigned long)r->ns.median, (unsigned long)r->ns.p99);
+    hal_serial_print(line);
+}
+
+void bench_run_all(void)
+{
+    bench_result_t r;
+    char           line[96];
+
+    bench_csv_header();
+    for (const bench_t *b = __bench_start; b < __bench_end; b++) {
+        if (bench_run(b, &r) == 0) {
+            bench_csv(&r);
+        } else {
+            ksnprintf(line, sizeof(line), "bench,%s,skipped\n", b->name);
+            hal_serial_print(line);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+/* bench/bench.h — in-kernel microbenchmarks
+ *
+ * A benchmark is one operation, registered anywhere in the kernel with
+ * BENCH().  bench_run() times `iters` samples of `batch` back-to-back
+ * operations each, after a warm-up of about iters / 8 untimed samples, and
+ * reports the per-operation minimum, median and 99th percentile in both
+ * hal_cycles() and nanoseconds.  The cost of reading the two clocks is
+ * measured once and subtracted.
+ *
+ *   static void op(void) { ... }
+ *   BENCH(my_op, .run = op, .iters = 1000, .batch = 16);
+ *
+ * BENCH() puts the descriptor in the .bench section, which the linker
+ * script collects between __bench_start and __bench_end.
+ *
+ * Runs in thread context on whatever CPU the caller is on; other threads
+ * and interrupts show up in the upper percentiles.
+ */
+#include <stdint.h>
+
+#define BENCH_ITERS     1000            /* default samples              */
+#define BENCH_MAX_ITERS 10000
+
+typedef struct {
+    const char *name;
+    int       (*setup)(void);           /* optional; nonzero = skip it  */
+    void      (*run)(void);             /* one operation                */
+    void      (*teardown)(void);        /* optional, after a setup of 0 */
+    uint32_t    iters;                  /* 0 = BENCH_ITERS              */
+    uint32_t    batch;                  /* operations per sample, 0 = 1 */
+} bench_t;
+
+#define BENCH(id, ...)                                                    \
+    static const bench_t bench_##id                                       \
+        __attribute__((used, section(".bench"), aligned(8))) =            \
+        { .name = #id, __VA_ARGS__ }
+
+typedef struct {
+    uint64_t min;
+    uint64_t median;
+    uint64_t p99;
+} bench_stat_t;
+
+typedef struct {
+    const bench_t *bench;
+    uint32_t       iters;
+    uint32_t       batch;
+    bench_stat_t   cycles;              /* per operation                */
+    bench_stat_t   ns;
+} bench_result_t;
+
+uint32_t       bench_count(void);
+const bench_t *bench_get(uint32_t i);
+const bench_t *bench_find(const char *name);
+/* The routine a hal_var_t stands for ("memcpy", ...); 0 past the last */
+const char    *bench_variant_routine(uint32_t v);
+
+/* Returns 0, or -1 if setup failed or there is no memory for samples */
+int  bench_run(const bench_t *b, bench_result_t *out);
+
+/* CSV on serial, for CI:
+ *   bench,name,iters,batch,min_cycles,median_cycles,p99_cycles,
+ *   min_ns,median_ns,p99_ns
+ * The header is followed by one variant,routine,name row per
+ * CPU-specific variant in use (hal.h HAL_VAR_*), so results from
+ * different machines can be told apart. */
+void bench_csv_header(void);
+void bench_csv(const bench_result_t *r);
+/* Every benchmark, header first, results as CSV only */
+void bench_run_all(void);
@@ -0,0 +1,77 @@
+/* kernel/src/bench/bench_cmd.c — the `bench` shell command
+ *
+ * Without an argument it lists the registered benchmarks; with a name
+ * (or "all") it runs them and prints cycles and nanoseconds per
+ * operation, the same rows going to serial as CSV.  Either way it first
+ * says which CPU-specific variants (hal.h) the kernel picked.
+ */
+#include "bench.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../shell/shell.h"
+
+/* One result row; the CSV line goes to serial as well */
+static void bench_row(const bench_t *b) {
+    bench_result_t r;
+    hal_display_print("  ");
+    hal_display_print(b->name);
+    for (int pad = 16 - (int)kstrlen(b->name); pad > 0; pad--)
+        hal_display_putchar(' ');
+    if (bench_run(b, &r) != 0) {
+        hal_display_print("  skipped\n");
+        return;
+    }
+    shell_print_col(r.cycles.min, 9);
+    shell_print_col(r.cycles.median, 9);
+    shell_print_col(r.cycles.p99, 9);
+    shell_print_col(r.ns.median, 9);
+    shell_print_col(r.ns.p99, 9);
+    hal_display_print("\n");
+    bench_csv(&r);
+}
+
+static void print_variants(void) {
+    hal_display_print("Variants:");
+    const char *routine;
+    for (uint32_t v = 0; (routine = bench_variant_routine(v)); v++) {
+        hal_display_print(v ? ", " : " ");
+        hal_display_print(routine);
+        hal_display_putchar(' ');
+        hal_display_print(hal_variant((hal_var_t)v));
+    }
+    hal_display_print("\n");
+}
+
+static void cmd_bench(int argc, char **argv) {
+    uint32_t n = bench_count();
+    print_variants();
+    if (argc < 2) {
+        hal_display_print("Benchmarks:");
+        for (uint32_t i = 0; i < n; i++) {
+            hal_display_putchar(' ');
+            hal_display_print(bench_get(i)->name);
+        }
+        hal_display_print("\n");
+        return;
+    }
+    const bench_t *one = 0;
+    if (kstrcmp(argv[1], "all") != 0 && !(one = bench_find(argv[1]))) {
+        hal_display_print("bench: no such benchmark\n");
+        return;
+    }
+
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    hal_display_print("Per operation:\n");
+    hal_display_print("  benchmark         cyc min  cyc med  cyc p99   ns med   ns p99\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    bench_csv_header();
+    if (one) {
+        bench_row(one);
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++)
+        bench_row(bench_get(i));
+}
+
+SHELL_CMD(bench, .fn = cmd_bench, .args = "[name|all]", .exclusive = 1,
+          .help = "run microbenchmarks (no name: list them)");
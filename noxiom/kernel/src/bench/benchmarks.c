@@ -0,0 +1,184 @@
+/* kernel/src/bench/benchmarks.c — the portable benchmarks
+ *
+ *   kmemcpy_*, kmemset_*, kmemzero_4k   one call on a buffer of that
+ *                          size
+ *   simd_sum32_4k          hal_simd_sum32() over 4 KB, inside one
+ *                          kernel_fpu_begin() / end() section
+ *   kmalloc_*              a kmalloc() / kfree() pair
+ *   display_line, serial_line   64 characters to the display or the
+ *                          UART, carriage return included, so the line
+ *                          is overwritten instead of scrolling
+ *   irq_roundtrip          a wake-up kick sent to the running CPU,
+ *                          until its timer interrupt has been taken:
+ *                          IPI delivery, entry, handler and exit
+ *   thread_pingpong        thread_wake() of a partner thread and
+ *                          thread_block() until it wakes us back — two
+ *                          wake-ups and two context switches, or
+ *                          cross-CPU wake-ups if the scheduler placed
+ *                          the partner elsewhere
+ *
+ * Architecture code registers its own (arch/arm64: dtb_parse).
+ */
+#include "bench.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../mm/kmalloc.h"
+#include "../sched/sched.h"
+#include "../sched/fpu.h"
+#include "../time/timer.h"
+
+/* ── Memory ───────────────────────────────────────────────────────────── */
+
+#define BUF_SIZE  65536
+
+static uint8_t *s_src, *s_dst;
+
+static int bufs_alloc(void)
+{
+    s_src = kmalloc(BUF_SIZE);
+    s_dst = kmalloc(BUF_SIZE);
+    if (!s_src || !s_dst) {
+        kfree(s_src);
+        kfree(s_dst);
+        return -1;
+    }
+    kmemset(s_src, 0x5A, BUF_SIZE);
+    return 0;
+}
+
+static void bufs_free(void)
+{
+    kfree(s_src);
+    kfree(s_dst);
+}
+
+static void memcpy_64(void)  { kmemcpy(s_dst, s_src, 64); }
+static void memcpy_4k(void)  { kmemcpy(s_dst, s_src, 4096); }
+static void memcpy_64k(void) { kmemcpy(s_dst, s_src, BUF_SIZE); }
+static void memset_64(void)  { kmemset(s_dst, 0, 64); }
+static void memset_4k(void)  { kmemset(s_dst, 0, 4096); }
+static void memset_64k(void) { kmemset(s_dst, 0, BUF_SIZE); }
+static void memzero_4k(void) { kmemzero(s_dst, 4096); }
+
+static volatile uint64_t s_sum;
+
+static void sum32_4k(void)
+{
+    uint64_t flags = kernel_fpu_begin();
+    s_sum = hal_simd_sum32(s_src, 4096);
+    kernel_fpu_end(flags);
+}
+
+BENCH(kmemcpy_64,  .setup = bufs_alloc, .run = memcpy_64,
+      .teardown = bufs_free, .batch = 64);
+BENCH(kmemcpy_4k,  .setup = bufs_alloc, .run = memcpy_4k,
+      .teardown = bufs_free, .batch = 4);
+BENCH(kmemcpy_64k, .setup = bufs_alloc, .run = memcpy_64k,
+      .teardown = bufs_free, .iters = 200);
+BENCH(kmemset_64,  .setup = bufs_alloc, .run = memset_64,
+      .teardown = bufs_free, .batch = 64);
+BENCH(kmemset_4k,  .setup = bufs_alloc, .run = memset_4k,
+      .teardown = bufs_free, .batch = 4);
+BENCH(kmemset_64k, .setup = bufs_alloc, .run = memset_64k,
+      .teardown = bufs_free, .iters = 200);
+BENCH(kmemzero_4k, .setup = bufs_alloc, .run = memzero_4k,
+      .teardown = bufs_free, .batch = 4);
+BENCH(simd_sum32_4k, .setup = bufs_alloc, .run = sum32_4k,
+      .teardown = bufs_free, .batch = 4);
+
+/* ── Allocator ────────────────────────────────────────────────────────── */
+
+static void kmalloc_64(void) { kfree(kmalloc(64)); }
+static void kmalloc_4k(void) { kfree(kmalloc(4096)); }
+
+BENCH(kmalloc_64, .run = kmalloc_64, .batch = 16);
+BENCH(kmalloc_4k, .run = kmalloc_4k, .batch = 4);
+
+/* ── Console ──────────────────────────────────────────────────────────── */
+
+static const char s_line[] =
+    "--------------------------------------------------------------\r";
+
+static void display_line(void) { hal_display_print(s_line); }
+static void serial_line(void)  { hal_serial_print(s_line); }
+static void console_done(void)
+{
+    hal_display_print("\n");
+    hal_serial_print("\n");
+}
+
+/* A 115200 baud UART takes about 5.5 ms a line */
+BENCH(display_line, .run = display_line, .teardown = console_done,
+      .iters = 100);
+BENCH(serial_line,  .run = serial_line,  .teardown = console_done,
+      .iters = 100);
+
+/* ── Interrupts ───────────────────────────────────────────────────────── */
+
+static void irq_roundtrip(void)
+{
+    uint64_t flags = hal_irq_save();
+    uint32_t cpu   = hal_cpu_id();
+    uint64_t seen  = timer_irq_count(cpu);
+    hal_cpu_kick(cpu);
+    hal_irq_restore(flags);             /* taken about here */
+    while (timer_irq_count(cpu) == seen)
+        hal_cpu_relax();
+}
+
+static int irq_setup(void)
+{
+    return timer_cpu_active(hal_cpu_id()) ? 0 : -1;
+}
+
+BENCH(irq_roundtrip, .setup = irq_setup, .run = irq_roundtrip);
+
+/* ── Threads ──────────────────────────────────────────────────────────── */
+
+static thread_t *volatile s_bencher;
+static thread_t *volatile s_partner;
+static volatile uint32_t  s_ping, s_pong;
+static volatile int       s_stop;       /* 1 = partner exit, 2 = gone  */
+
+static void partner_main(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        while (s_ping == s_pong && !s_stop)
+            thread_block();
+        if (s_stop)
+            break;
+        s_pong = s_ping;
+        thread_wake(s_bencher);
+    }
+    s_stop = 2;
+    thread_exit();
+}
+
+static int pingpong_setup(void)
+{
+    s_ping = s_pong = 0;
+    s_stop = 0;
+    s_bencher = thread_current();
+    s_partner = thread_create("bench", partner_main, 0);
+    return s_partner ? 0 : -1;
+}
+
+static void pingpong(void)
+{
+    s_ping++;
+    thread_wake(s_partner);
+    while (s_pong != s_ping)
+        thread_block();
+}
+
+static void pingpong_teardown(void)
+{
+    s_stop = 1;
+    thread_wake(s_partner);
+    while (s_stop != 2)
+        thread_yield();
+}
+
+BENCH(thread_pingpong, .setup = pingpong_setup, .run = pingpong,
+      .teardown = pingpong_teardown);
@@ -0,0 +1,536 @@
+/* kernel/src/blk/ahci.c — AHCI SATA controller (PCI class 01/06/01)
+ *
+ * Every port with a SATA disk attached becomes one block device with one
+ * hardware queue: each request takes a command slot, its ios become the
+ * PRDT entries of the slot's command table, and commit() issues all the
+ * slots queue_rq() filled with one write of PxSACT / PxCI.
+ *
+ * Commands: with native command queuing (CAP.SNCQ and IDENTIFY word 76)
+ * reads and writes are READ/WRITE FPDMA QUEUED, and as many are in
+ * flight as the disk has tags and the HBA slots; otherwise READ/WRITE
+ * DMA EXT one at a time.  FLUSH CACHE EXT is not queued, so it waits for
+ * an idle port (queue_rq() says BLK_BUSY) and holds back everything else
+ * while it runs.
+ *
+ * Completion: one interrupt for the HBA (MSI, else INTx).  A slot is
+ * done once its bit is clear in both PxSACT and PxCI.  A task file or
+ * bus error fails whatever the disk had not finished and restarts the
+ * port — no READ LOG EXT recovery of the individual NCQ command.
+ *
+ * The HBA reads command lists and tables from RAM below 4 GB unless it
+ * has 64-bit addressing (CAP.S64A); buffers above that fail with EIO.
+ */
+#include "blkdev.h"
+#include "../pci/pci.h"
+#include "../mm/pmm.h"
+#include "../mm/kmalloc.h"
+#include "../string.h"
+#include "../log/klog.h"
+
+/* HBA registers */
+#define HBA_CAP             0x00
+#define HBA_GHC             0x04
+#define HBA_IS              0x08
+#define HBA_PI              0x0C
+#define HBA_PORT(n)         (0x100 + (n) * 0x80)
+
+#define CAP_NCS(c)          ((((c) >> 8) & 0x1F) + 1)
+#define CAP_SNCQ            (1u << 30)
+#define CAP_S64A            (1u << 31)
+
+#define GHC_IE              (1u << 1)
+#define GHC_AE              (1u << 31)
+
+/* Port registers */
+#define PX_CLB              0x00
+#define PX_CLBU             0x04
+#define PX_FB               0x08
+#define PX_FBU              0x0C
+#define PX_IS               0x10
+#define PX_IE               0x14
+#define PX_CMD              0x18
+#define PX_TFD              0x20
+#define PX_SIG              0x24
+#define PX_SSTS             0x28
+#define PX_SERR             0x30
+#define PX_SACT             0x34
+#define PX_CI               0x38
+
+#define PX_CMD_ST           (1u << 0)
+#define PX_CMD_FRE          (1u << 4)
+#define PX_CMD_FR           (1u << 14)
+#define PX_CMD_CR           (1u << 15)
+
+#define PX_IS_DHRS          (1u << 0)
+#define PX_IS_PSS           (1u << 1)
+#define PX_IS_DSS           (1u << 2)
+#define PX_IS_SDBS          (1u << 3)
+#define PX_IS_DPS           (1u << 5)
+#define PX_IS_IFS           (1u << 27)
+#define PX_IS_HBDS          (1u << 28)
+#define PX_IS_HBFS          (1u << 29)
+#define PX_IS_TFES          (1u << 30)
+#define PX_IS_ERR           (PX_IS_IFS | PX_IS_HBDS | PX_IS_HBFS | PX_IS_TFES)
+#define PX_IE_MASK          (PX_IS_DHRS | PX_IS_PSS | PX_IS_DSS | \
+                             PX_IS_SDBS | PX_IS_DPS | PX_IS_ERR)
+
+#define TFD_ERR             0x01
+#define TFD_DRQ             0x08
+#define TFD_BSY             0x80
+
+#define SSTS_DET_PRESENT    3
+#define SIG_ATA             0x00000101
+
+/* ATA commands */
+#define ATA_READ_DMA_EXT    0x25
+#define ATA_WRITE_DMA_EXT   0x35
+#define ATA_READ_FPDMA      0x60
+#define ATA_WRITE_FPDMA     0x61
+#define ATA_FLUSH_EXT       0xEA
+#define ATA_IDENTIFY        0xEC
+
+#define FIS_REG_H2D         0x27
+#define CMD_HDR_WRITE       (1u << 6)
+#define CMD_FIS_DWORDS      5
+
+#define AHCI_PRDS           56      /* command table = 1 KB             */
+#define AHCI_MAX_SECTORS    256     /* 128 KB per request               */
+#define AHCI_MAX_PORTS      32
+#define AHCI_TIMEOUT_NS     1000000000ULL
+
+typedef struct {
+    uint16_t          flags;        /* FIS length, W, ...               */
+    uint16_t          prdtl;
+    volatile uint32_t prdbc;
+    uint32_t          ctba, ctbau;
+    uint32_t          reserved[4];
+} ahci_cmd_hdr_t;
+
+typedef struct {
+    uint32_t dba, dbau;
+    uint32_t reserved;
+    uint32_t dbc;                   /* byte count - 1                   */
+} ahci_prd_t;
+
+typedef struct {
+    uint8_t    cfis[64];
+    uint8_t    acmd[16];
+    uint8_t    reserved[48];
+    ahci_prd_t prdt[AHCI_PRDS];
+} ahci_cmd_tbl_t;
+
+_Static_assert(sizeof(ahci_cmd_tbl_t) == 1024, "AHCI command table size");
+
+typedef struct ahci ahci_t;
+
+typedef struct {
+    blkdev_t           blkdev;
+    ahci_t            *hba;
+    uint32_t           index;
+    volatile uint8_t  *regs;
+    spinlock_t         lock;
+    ahci_cmd_hdr_t    *cl;          /* 32 headers, 1 KB                 */
+    ahci_cmd_tbl_t    *tbl;         /* one per slot                     */
+    uint32_t           ncq;
+    uint32_t           active;      /* slots the disk has               */
+    uint32_t           issue;       /* filled, for the next commit()    */
+    uint32_t           nonq;        /* slots holding a non-NCQ command  */
+    blk_req_t         *slot[32];
+} ahci_port_t;
+
+struct ahci {
+    const pci_dev_t   *pci;
+    volatile uint8_t  *abar;
+    uint32_t           cap;
+    uint32_t           nslots;
+    ahci_port_t       *ports[AHCI_MAX_PORTS];
+};
+
+static inline uint32_t rd(volatile uint8_t *b, uint32_t off)
+{
+    return *(volatile uint32_t *)(b + off);
+}
+
+static inline void wr(volatile uint8_t *b, uint32_t off, uint32_t v)
+{
+    *(volatile uint32_t *)(b + off) = v;
+}
+
+/* Spin until (reg & mask) == want; -1 on timeout */
+static int wait_reg(volatile uint8_t *b, uint32_t off, uint32_t mask,
+                    uint32_t want, uint64_t timeout_ns)
+{
+    uint64_t end = hal_timer_now_ns() + timeout_ns;
+    while ((rd(b, off) & mask) != want) {
+        if (hal_timer_now_ns() > end)
+            return -1;
+        hal_cpu_relax();
+    }
+    return 0;
+}
+
+/* ── Port control ────────────────────────────────────────────────────── */
+
+static int port_stop(ahci_port_t *p)
+{
+    wr(p->regs, PX_CMD, rd(p->regs, PX_CMD) & ~PX_CMD_ST);
+    if (wait_reg(p->regs, PX_CMD, PX_CMD_CR, 0, AHCI_TIMEOUT_NS / 2) != 0)
+        return -1;
+    wr(p->regs, PX_CMD, rd(p->regs, PX_CMD) & ~PX_CMD_FRE);
+    return wait_reg(p->regs, PX_CMD, PX_CMD_FR, 0, AHCI_TIMEOUT_NS / 2);
+}
+
+static void port_start(ahci_port_t *p)
+{
+    wr(p->regs, PX_SERR, 0xFFFFFFFFu);
+    wr(p->regs, PX_IS, 0xFFFFFFFFu);
+    wr(p->regs, PX_CMD, rd(p->regs, PX_CMD) | PX_CMD_FRE);
+    wait_reg(p->regs, PX_TFD, TFD_BSY | TFD_DRQ, 0, AHCI_TIMEOUT_NS);
+    wr(p->regs, PX_CMD, rd(p->regs, PX_CMD) | PX_CMD_ST);
+}
+
+/* ── Commands ────────────────────────────────────────────────────────── */
+
+static void fis_h2d(uint8_t *f, uint8_t cmd, uint64_t lba, uint32_t count,
+                    uint32_t tag, int ncq)
+{
+    kmemset(f, 0, 20);
+    f[0]  = FIS_REG_H2D;
+    f[1]  = 0x80;                   /* command, not control             */
+    f[2]  = cmd;
+    f[4]  = (uint8_t)lba;
+    f[5]  = (uint8_t)(lba >> 8);
+    f[6]  = (uint8_t)(lba >> 16);
+    f[7]  = 0x40;                   /* LBA mode                         */
+    f[8]  = (uint8_t)(lba >> 24);
+    f[9]  = (uint8_t)(lba >> 32);
+    f[10] = (uint8_t)(lba >> 40);
+    if (ncq) {                      /* count in FEATURES, tag in COUNT  */
+        f[3]  = (uint8_t)count;
+        f[11] = (uint8_t)(count >> 8);
+        f[12] = (uint8_t)(tag << 3);
+    } else {
+        f[12] = (uint8_t)count;
+        f[13] = (uint8_t)(count >> 8);
+    }
+}
+
+/* Fill slot s; -1 if a buffer is out of the HBA's reach */
+static int build_cmd(ahci_port_t *p, uint32_t s, blk_req_t *r)
+{
+    ahci_cmd_tbl_t *t = &p->tbl[s];
+    int ncq = p->ncq && r->op != BLK_FLUSH;
+    uint8_t cmd = r->op == BLK_FLUSH ? ATA_FLUSH_EXT
+                : r->op == BLK_READ  ? (ncq ? ATA_READ_FPDMA
+                                            : ATA_READ_DMA_EXT)
+                                     : (ncq ? ATA_WRITE_FPDMA
+                                            : ATA_WRITE_DMA_EXT);
+    fis_h2d(t->cfis, cmd, r->op == BLK_FLUSH ? 0 : r->sector,
+            r->op == BLK_FLUSH ? 0 : r->count, s, ncq);
+
+    int s64a = (p->hba->cap & CAP_S64A) != 0;
+    uint32_t n = 0;
+    for (blk_io_t *io = r->ios; io && r->op != BLK_FLUSH; io = io->next) {
+        uint64_t pa  = virt_to_phys(io->buf);
+        uint32_t len = io->count * BLK_SECTOR_SIZE;
+        if ((pa & 1) || (!s64a && pa + len > (1ULL << 32)))
+            return -1;
+        hal_dma_sync_for_device(io->buf, len);
+        t->prdt[n++] = (ahci_prd_t){ (uint32_t)pa, (uint32_t)(pa >> 32), 0,
+                                     len - 1 };
+    }
+
+    ahci_cmd_hdr_t *h = &p->cl[s];
+    h->flags = CMD_FIS_DWORDS | (r->op == BLK_WRITE ? CMD_HDR_WRITE : 0);
+    h->prdtl = (uint16_t)n;
+    h->prdbc = 0;
+    hal_dma_sync_for_device(t, sizeof(*t));
+    hal_dma_sync_for_device(h, sizeof(*h));
+    return 0;
+}
+
+static int ahci_queue_rq(blkdev_t *dev, uint32_t q, blk_req_t *r, int more)
+{
+    (void)q; (void)more;
+    ahci_port_t *p = dev->priv;
+    uint64_t flags = spin_lock_irqsave(&p->lock);
+    uint32_t busy = p->active | p->issue;
+    if (r->op == BLK_FLUSH ? busy != 0 : p->nonq != 0) {
+        spin_unlock_irqrestore(&p->lock, flags);
+        return BLK_BUSY;
+    }
+    uint32_t s = 0;
+    while (s < p->hba->nslots && (busy & (1u << s)))
+        s++;
+    if (s == p->hba->nslots) {
+        spin_unlock_irqrestore(&p->lock, flags);
+        return BLK_BUSY;
+    }
+    if (build_cmd(p, s, r) != 0) {
+        spin_unlock_irqrestore(&p->lock, flags);
+        return BLK_EIO;
+    }
+    r->tag = s;
+    p->slot[s] = r;
+    p->issue |= 1u << s;
+    if (r->op == BLK_FLUSH || !p->ncq)
+        p->nonq |= 1u << s;
+    spin_unlock_irqrestore(&p->lock, flags);
+    return BLK_OK;
+}
+
+static void ahci_commit(blkdev_t *dev, uint32_t q)
+{
+    (void)q;
+    ahci_port_t *p = dev->priv;
+    uint64_t flags = spin_lock_irqsave(&p->lock);
+    if (p->issue) {
+        if (p->issue & ~p->nonq)
+            wr(p->regs, PX_SACT, p->issue & ~p->nonq);
+        wr(p->regs, PX_CI, p->issue);
+        p->active |= p->issue;
+        p->issue = 0;
+    }
+    spin_unlock_irqrestore(&p->lock, flags);
+}
+
+static const blkdev_ops_t s_ahci_ops = {
+    .queue_rq = ahci_queue_rq,
+    .commit   = ahci_commit,
+};
+
+/* ── Interrupts ──────────────────────────────────────────────────────── */
+
+static void complete_slots(blk_req_t *list, int status)
+{
+    for (blk_req_t *r = list, *next; r; r = next) {
+        next = r->next;
+        if (r->op == BLK_READ)
+            for (blk_io_t *io = r->ios; io; io = io->next)
+                hal_dma_sync_for_cpu(io->buf, io->count * BLK_SECTOR_SIZE);
+        blk_complete(r, status);
+    }
+}
+
+static void port_irq(ahci_port_t *p)
+{
+    blk_req_t *done = 0, *failed = 0;
+    uint64_t flags = spin_lock_irqsave(&p->lock);
+    uint32_t is = rd(p->regs, PX_IS);
+    wr(p->regs, PX_IS, is);
+    uint32_t finished = p->active & ~(rd(p->regs, PX_SACT) |
+                                      rd(p->regs, PX_CI));
+    uint32_t lost = 0;
+    if (is & PX_IS_ERR) {
+        lost = p->active & ~finished;
+        klog("[ahci] port %u: error, is %08x tfd %08x, slots %08x failed",
+             p->index, is, rd(p->regs, PX_TFD), lost);
+        port_stop(p);
+        port_start(p);
+    }
+    for (uint32_t s = 0; s < p->hba->nslots; s++) {
+        uint32_t bit = 1u << s;
+        if (!((finished | lost) & bit))
+            continue;
+        blk_req_t *r = p->slot[s];
+        p->slot[s] = 0;
+        p->active &= ~bit;
+        p->nonq   &= ~bit;
+        if (finished & bit) {
+            r->next = done;
+            done = r;
+        } else {
+            r->next = failed;
+            failed = r;
+        }
+    }
+    spin_unlock_irqrestore(&p->lock, flags);
+    complete_slots(done, BLK_OK);
+    complete_slots(failed, BLK_EIO);
+}
+
+static void ahci_irq(uint32_t irq, void *ctx)
+{
+    (void)irq;
+    ahci_t *h = ctx;
+    uint32_t is = rd(h->abar, HBA_IS);
+    for (uint32_t i = 0; i < AHCI_MAX_PORTS; i++) {
+        if (!(is & (1u << i)))
+            continue;
+        if (h->ports[i])
+            port_irq(h->ports[i]);
+        else
+            wr(h->abar, HBA_PORT(i) + PX_IS, 0xFFFFFFFFu);
+    }
+    wr(h->abar, HBA_IS, is);
+}
+
+/* ── Probe ───────────────────────────────────────────────────────────── */
+
+/* IDENTIFY DEVICE in slot 0, polled (port interrupts still off) */
+static int identify(ahci_port_t *p, uint16_t *id)
+{
+    ahci_cmd_tbl_t *t = &p->tbl[0];
+    fis_h2d(t->cfis, ATA_IDENTIFY, 0, 0, 0, 0);
+    t->cfis[7] = 0;
+    uint64_t pa = virt_to_phys(id);
+    t->prdt[0] = (ahci_prd_t){ (uint32_t)pa, (uint32_t)(pa >> 32), 0, 511 };
+    p->cl[0].flags = CMD_FIS_DWORDS;
+    p->cl[0].prdtl = 1;
+    p->cl[0].prdbc = 0;
+    hal_dma_sync_for_device(id, 512);
+    hal_dma_sync_for_device(t, sizeof(*t));
+    hal_dma_sync_for_device(p->cl, sizeof(ahci_cmd_hdr_t));
+
+    wr(p->regs, PX_CI, 1);
+    uint64_t end = hal_timer_now_ns() + AHCI_TIMEOUT_NS;
+    while (rd(p->regs, PX_CI) & 1) {
+        if ((rd(p->regs, PX_IS) & PX_IS_TFES) || hal_timer_now_ns() > end)
+            return -1;
+        hal_cpu_relax();
+    }
+    wr(p->regs, PX_IS, 0xFFFFFFFFu);
+    hal_dma_sync_for_cpu(id, 512);
+    return (rd(p->regs, PX_TFD) & TFD_ERR) ? -1 : 0;
+}
+
+static ahci_port_t *port_probe(ahci_t *h, uint32_t i, uint16_t *id)
+{
+    volatile uint8_t *regs = h->abar + HBA_PORT(i);
+    uint32_t ssts = rd(regs, PX_SSTS);
+    if ((ssts & 0xF) != SSTS_DET_PRESENT || ((ssts >> 8) & 0xF) != 1 ||
+        rd(regs, PX_SIG) != SIG_ATA)
+        return 0;
+
+    /* Command list and received FISes in one page, tables behind it */
+    uint32_t order = 0;
+    while ((PAGE_SIZE << order) < h->nslots * sizeof(ahci_cmd_tbl_t))
+        order++;
+    ahci_port_t *p = kzalloc(sizeof(*p));
+    uint64_t cl_pa  = pmm_alloc_page();
+    uint64_t tbl_pa = pmm_alloc_pages(order);
+    if (!p || !cl_pa || !tbl_pa ||
+        (!(h->cap & CAP_S64A) &&
+         (cl_pa >= (1ULL << 32) || tbl_pa >= (1ULL << 32))))
+        goto fail;
+    p->hba   = h;
+    p->index = i;
+    p->regs  = regs;
+    p->lock  = (spinlock_t)SPINLOCK_INIT;
+    p->cl    = phys_to_virt(cl_pa);
+    p->tbl   = phys_to_virt(tbl_pa);
+    kmemset(p->cl, 0, PAGE_SIZE);
+    kmemset(p->tbl, 0, PAGE_SIZE << order);
+    for (uint32_t s = 0; s < h->nslots; s++) {
+        uint64_t pa = virt_to_phys(&p->tbl[s]);
+        p->cl[s].ctba  = (uint32_t)pa;
+        p->cl[s].ctbau = (uint32_t)(pa >> 32);
+    }
+
+    if (port_stop(p) != 0)
+        goto fail;
+    uint64_t fb_pa = cl_pa + 1024;
+    wr(regs, PX_CLB, (uint32_t)cl_pa);
+    wr(regs, PX_CLBU, (uint32_t)(cl_pa >> 32));
+    wr(regs, PX_FB, (uint32_t)fb_pa);
+    wr(regs, PX_FBU, (uint32_t)(fb_pa >> 32));
+    wr(regs, PX_IE, 0);
+    port_start(p);
+    if (identify(p, id) != 0)
+        goto fail;
+
+    uint64_t lba48 = (uint64_t)id[100] | (uint64_t)id[101] << 16 |
+                     (uint64_t)id[102] << 32 | (uint64_t)id[103] << 48;
+    uint32_t depth = 1;
+    if ((h->cap & CAP_SNCQ) && (id[76] & (1u << 8))) {
+        p->ncq = 1;
+        depth = (id[75] & 0x1F) + 1u;
+        if (depth > h->nslots)
+            depth = h->nslots;
+    }
+
+    blkdev_t *bd = &p->blkdev;
+    bd->driver      = "ahci";
+    bd->nsectors    = (id[83] & (1u << 10)) ? lba48
+                    : ((uint32_t)id[60] | (uint32_t)id[61] << 16);
+    bd->max_sectors = AHCI_MAX_SECTORS;
+    bd->max_segs    = AHCI_PRDS;
+    bd->depth       = depth;
+    bd->flags       = (id[85] & (1u << 5)) ? BLK_F_CACHE : 0;
+    bd->ops         = &s_ahci_ops;
+    bd->priv        = p;
+    return p;
+
+fail:
+    if (tbl_pa)
+        pmm_free_pages(tbl_pa, order);
+    if (cl_pa)
+        pmm_free_page(cl_pa);
+    kfree(p);
+    return 0;
+}
+
+static void hba_probe(const pci_dev_t *pd)
+{
+    pci_bar_t bar;
+    if (pci_bar(pd, 5, &bar) != 0 || bar.is_io)
+        return;
+    ahci_t *h = kzalloc(sizeof(*h));
+    uint16_t *id = kmalloc(512);
+    if (!h || !id || !(h->abar = hal_mmio_map(bar.base, bar.size))) {
+        kfree(id);
+        kfree(h);
+        return;
+    }
+    h->pci = pd;
+    pci_enable(pd, 1);
+    wr(h->abar, HBA_GHC, rd(h->abar, HBA_GHC) | GHC_AE);
+    wr(h->abar, HBA_GHC, rd(h->abar, HBA_GHC) & ~GHC_IE);
+    h->cap    = rd(h->abar, HBA_CAP);
+    h->nslots = CAP_NCS(h->cap);
+
+    uint32_t pi = rd(h->abar, HBA_PI), nports = 0;
+    for (uint32_t i = 0; i < AHCI_MAX_PORTS; i++)
+        if ((pi & (1u << i)) && (h->ports[i] = port_probe(h, i, id)) != 0)
+            nports++;
+    kfree(id);
+    if (!nports) {
+        kfree(h);
+        return;
+    }
+
+    int irq = pci_msi_enable(pd, 0);
+    if (irq < 0)
+        irq = (int)pci_intx_line(pd);
+    if (irq <= 0 || irq >= HAL_IRQ_MAX ||
+        hal_irq_register((uint32_t)irq, ahci_irq, h) != 0) {
+        klog("[ahci] pci %02x:%02x.%u: no usable interrupt",
+             (pd->bdf >> 8) & 0xFF, (pd->bdf >> 3) & 0x1F, pd->bdf & 7);
+        return;
+    }
+    wr(h->abar, HBA_IS, 0xFFFFFFFFu);
+    wr(h->abar, HBA_GHC, rd(h->abar, HBA_GHC) | GHC_IE);
+    klog("[ahci] pci %02x:%02x.%u: %u slots%s, irq %d",
+         (pd->bdf >> 8) & 0xFF, (pd->bdf >> 3) & 0x1F, pd->bdf & 7,
+         h->nslots, (h->cap & CAP_SNCQ) ? ", NCQ" : "", irq);
+
+    for (uint32_t i = 0; i < AHCI_MAX_PORTS; i++) {
+        ahci_port_t *p = h->ports[i];
+        if (!p)
+            continue;
+        wr(p->regs, PX_IS, 0xFFFFFFFFu);
+        wr(p->regs, PX_IE, PX_IE_MASK);
+        blk_register(&p->blkdev, 0);
+    }
+}
+
+void ahci_init(void)
+{
+    uint32_t n = pci_count();
+    for (uint32_t i = 0; i < n; i++) {
+        const pci_dev_t *pd = pci_get(i);
+        if (pd->class_code == 0x01 && pd->subclass == 0x06 &&
+            pd->prog_if == 0x01)
+            hba_probe(pd);
+    }
+}
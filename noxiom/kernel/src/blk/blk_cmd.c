@@ -0,0 +1,139 @@
+/* kernel/src/blk/blk_cmd.c — block device shell commands
+ *
+ *   lsblk       every block device: size, driver, queues and depth, then
+ *               its traffic: ios submitted, requests the device saw
+ *               (fewer than ios when merging pays off) and errors
+ *   blkread     sequential read of 4 KB ios, submitted in batches so the
+ *               block layer can merge them; prints the throughput and
+ *               how many ios merged
+ */
+#include "blkdev.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../sched/sched.h"
+#include "../mm/kmalloc.h"
+#include "../shell/shell.h"
+
+#define BLKREAD_IO_SECTORS  8               /* 4 KB                       */
+#define BLKREAD_BATCH       64
+
+static void show(blkdev_t *d) {
+    const blkdev_stats_t *s = &d->stats;
+    char line[160];
+    ksnprintf(line, sizeof(line),
+              "%s  %s  %lu MB  %u queue%s  depth %u  max %u KB%s%s\n",
+              d->name, d->driver, (unsigned long)(d->nsectors >> 11),
+              d->nqueues, d->nqueues == 1 ? "" : "s", d->depth,
+              d->max_sectors / 2, (d->flags & BLK_F_RO) ? "  ro" : "",
+              (d->flags & BLK_F_CACHE) ? "  write cache" : "");
+    hal_display_print(line);
+    ksnprintf(line, sizeof(line),
+              "    read  %lu ios %lu KB    write %lu ios %lu KB    "
+              "flush %lu\n",
+              (unsigned long)s->reads, (unsigned long)(s->read_sectors / 2),
+              (unsigned long)s->writes,
+              (unsigned long)(s->write_sectors / 2),
+              (unsigned long)s->flushes);
+    hal_display_print(line);
+    ksnprintf(line, sizeof(line),
+              "    requests %lu  merged %lu  errors %lu\n",
+              (unsigned long)s->requests, (unsigned long)s->merges,
+              (unsigned long)s->errors);
+    hal_display_print(line);
+}
+
+static void cmd_lsblk(int argc, char **argv) {
+    (void)argc; (void)argv;
+    uint32_t n = blk_count();
+    if (!n) {
+        hal_display_print("lsblk: no block devices\n");
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++)
+        show(blk_get(i));
+}
+
+SHELL_CMD(lsblk, .fn = cmd_lsblk, .help = "block devices, queues and traffic");
+
+typedef struct {
+    spinlock_t  lock;
+    thread_t   *waiter;
+    uint32_t    left;
+    uint32_t    errors;
+} blkread_t;
+
+static void blkread_done(blk_io_t *io) {
+    blkread_t *b = io->priv;
+    uint64_t flags = spin_lock_irqsave(&b->lock);
+    if (io->status != BLK_OK)
+        b->errors++;
+    if (--b->left == 0)
+        thread_wake(b->waiter);
+    spin_unlock_irqrestore(&b->lock, flags);
+}
+
+static void cmd_blkread(int argc, char **argv) {
+    blkdev_t *d = argc > 1 ? blk_find(argv[1]) : blk_get(0);
+    if (!d) {
+        hal_display_print("blkread: no such device\n");
+        return;
+    }
+    uint64_t mb = argc > 2 ? shell_parse_uint(argv[2], 16) : 16;
+    uint64_t total = mb << 11;
+    if (total > d->nsectors)
+        total = d->nsectors - d->nsectors % BLKREAD_IO_SECTORS;
+
+    uint32_t bytes = BLKREAD_BATCH * BLKREAD_IO_SECTORS * BLK_SECTOR_SIZE;
+    uint8_t *buf = kmalloc(bytes);
+    blk_io_t *io = kmalloc(BLKREAD_BATCH * sizeof(blk_io_t));
+    if (!buf || !io) {
+        hal_display_print("blkread: out of memory\n");
+        kfree(buf);
+        kfree(io);
+        return;
+    }
+
+    blkread_t b = { SPINLOCK_INIT, thread_current(), 0, 0 };
+    uint64_t requests = d->stats.requests;
+    uint64_t start = hal_timer_now_ns(), sector = 0;
+    while (sector < total && !b.errors) {
+        uint32_t n = 0;
+        for (; n < BLKREAD_BATCH && sector < total; n++) {
+            io[n] = (blk_io_t){
+                .op = BLK_READ, .sector = sector,
+                .count = BLKREAD_IO_SECTORS,
+                .buf = buf + n * BLKREAD_IO_SECTORS * BLK_SECTOR_SIZE,
+                .done = blkread_done, .priv = &b,
+            };
+            sector += BLKREAD_IO_SECTORS;
+        }
+        b.left = n;
+        for (uint32_t i = 0; i < n; i++)
+            blk_submit(d, &io[i], i + 1 < n);
+        for (;;) {
+            uint64_t flags = spin_lock_irqsave(&b.lock);
+            uint32_t left = b.left;
+            spin_unlock_irqrestore(&b.lock, flags);
+            if (!left)
+                break;
+            thread_block();
+        }
+    }
+    uint64_t ns = hal_timer_now_ns() - start;
+    kfree(io);
+    kfree(buf);
+
+    char line[128];
+    uint64_t kb = sector / 2;
+    ksnprintf(line, sizeof(line),
+              "%lu KB in %lu ms, %lu KB/s, %lu ios as %lu requests%s\n",
+              (unsigned long)kb, (unsigned long)(ns / 1000000),
+              (unsigned long)(ns ? kb * 1000000000ULL / ns : 0),
+              (unsigned long)(sector / BLKREAD_IO_SECTORS),
+              (unsigned long)(d->stats.requests - requests),
+              b.errors ? ", errors" : "");
+    hal_display_print(line);
+}
+
+SHELL_CMD(blkread, .fn = cmd_blkread, .args = "[dev] [MB]",
+          .help = "sequential 4 KB reads, batched and merged");
@@ -0,0 +1,438 @@
+/* kernel/src/blk/blkdev.c — device table, request merging and dispatch
+ *
+ * The device table only grows, and entries are published with a
+ * release store of the count, so lookups take no lock.
+ *
+ * Locking: a hardware queue's lock covers its pending lists and
+ * in-flight count, and is held across queue_rq() and commit(), so the
+ * order is queue lock, then driver lock.  Drivers call blk_complete()
+ * with their own locks dropped; it re-takes the queue lock to dispatch
+ * what was waiting.  Callbacks (done()) always run with no lock held.
+ *
+ * Requests come from kmalloc(), which is IRQ-safe, so joining two of
+ * them may free one from whatever context is submitting.
+ */
+#include "blkdev.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../sched/sched.h"
+#include "../mm/kmalloc.h"
+#include "../log/klog.h"
+
+#define BLK_RW_BATCH  16                /* ios blk_rw() has in flight     */
+
+static blkdev_t   *s_devs[BLKDEV_MAX];
+static uint32_t    s_ndevs;
+static spinlock_t  s_devs_lock = SPINLOCK_INIT;
+static blk_add_fn_t s_add_handler;
+
+static inline void stat_add(uint64_t *c, uint64_t n)
+{
+    __atomic_fetch_add(c, n, __ATOMIC_RELAXED);
+}
+
+/* ── Completion ──────────────────────────────────────────────────────── */
+
+static void io_finish(blkdev_t *dev, blk_io_t *io, int status)
+{
+    io->status = status;
+    if (status != BLK_OK)
+        stat_add(&dev->stats.errors, 1);
+    io->done(io);
+}
+
+static void req_finish(blk_req_t *r, int status)
+{
+    blkdev_t *dev = r->hwq->dev;
+    for (blk_io_t *io = r->ios, *next; io; io = next) {
+        next = io->next;
+        io_finish(dev, io, status);
+    }
+    kfree(r);
+}
+
+static void finish_failed(blk_req_t *failed)
+{
+    for (blk_req_t *r = failed, *next; r; r = next) {
+        next = r->next;
+        req_finish(r, BLK_EIO);
+    }
+}
+
+/* ── Elevator ────────────────────────────────────────────────────────── */
+
+/* b may follow a as one command */
+static int can_join(const blkdev_t *dev, const blk_req_t *a,
+                    const blk_req_t *b)
+{
+    return a->op == b->op && a->sector + a->count == b->sector &&
+           a->count + b->count <= dev->max_sectors &&
+           a->nsegs + b->nsegs <= dev->max_segs;
+}
+
+/* a takes over b's ios; b is unlinked (it follows a) and freed */
+static void join(blk_hwq_t *q, blk_req_t *a, blk_req_t *b)
+{
+    a->ios_tail->next = b->ios;
+    a->ios_tail = b->ios_tail;
+    a->count += b->count;
+    a->nsegs += b->nsegs;
+    a->next = b->next;
+    q->npending--;
+    kfree(b);
+}
+
+/* q->lock held.  Add io to a pending request it continues or precedes;
+ * 1 if it found one.  The list stays sorted: a front merge is only made
+ * where it does not move the request before its predecessor. */
+static int try_merge(blk_hwq_t *q, blk_io_t *io)
+{
+    blkdev_t *dev = q->dev;
+    uint64_t end = io->sector + io->count;
+    blk_req_t *prev = 0;
+    for (blk_req_t *r = q->pending; r && r->sector <= end;
+         prev = r, r = r->next) {
+        if (r->op != io->op || r->count + io->count > dev->max_sectors ||
+            r->nsegs == dev->max_segs)
+            continue;
+        if (r->sector + r->count == io->sector) {
+            io->next = 0;
+            r->ios_tail->next = io;
+            r->ios_tail = io;
+            r->count += io->count;
+            r->nsegs++;
+            if (r->next && can_join(dev, r, r->next))
+                join(q, r, r->next);
+            return 1;
+        }
+        if (end == r->sector && (!prev || prev->sector <= io->sector)) {
+            io->next = r->ios;
+            r->ios = io;
+            r->sector = io->sector;
+            r->count += io->count;
+            r->nsegs++;
+            if (prev && can_join(dev, prev, r))
+                join(q, prev, r);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* q->lock held */
+static void insert(blk_hwq_t *q, blk_req_t *r)
+{
+    blk_req_t **pp;
+    if (r->op == BLK_FLUSH) {
+        for (pp = &q->flushes; *pp; pp = &(*pp)->next)
+            ;
+    } else {
+        for (pp = &q->pending; *pp && (*pp)->sector <= r->sector;
+             pp = &(*pp)->next)
+            ;
+        q->npending++;
+    }
+    r->next = *pp;
+    *pp = r;
+}
+
+/* q->lock held.  Flushes first, then the first request at or after the
+ * head, wrapping to the lowest sector. */
+static blk_req_t *next_req(blk_hwq_t *q)
+{
+    blk_req_t *r = q->flushes;
+    if (r) {
+        q->flushes = r->next;
+        return r;
+    }
+    blk_req_t **pp = &q->pending;
+    while (*pp && (*pp)->sector < q->head)
+        pp = &(*pp)->next;
+    if (!*pp)
+        pp = &q->pending;
+    r = *pp;
+    if (r) {
+        *pp = r->next;
+        q->npending--;
+    }
+    return r;
+}
+
+/* q->lock held.  Start what the device has room for; requests it
+ * refused go on *failed for the caller to finish once unlocked. */
+static void dispatch(blk_hwq_t *q, blk_req_t **failed)
+{
+    blkdev_t *dev = q->dev;
+    uint32_t started = 0;
+    while (!q->plugged && q->inflight < dev->depth) {
+        blk_req_t *r = next_req(q);
+        if (!r)
+            break;
+        int more = q->inflight + 1 < dev->depth && (q->flushes || q->pending);
+        int rc = dev->ops->queue_rq(dev, q->index, r, more);
+        if (rc == BLK_BUSY) {
+            if (r->op == BLK_FLUSH) {
+                r->next = q->flushes;
+                q->flushes = r;
+            } else {
+                insert(q, r);
+            }
+            break;
+        }
+        if (rc != BLK_OK) {
+            r->next = *failed;
+            *failed = r;
+            continue;
+        }
+        q->inflight++;
+        started++;
+        if (r->op != BLK_FLUSH)
+            q->head = r->sector + r->count;
+    }
+    if (started) {
+        q->dispatched += started;
+        stat_add(&dev->stats.requests, started);
+        if (dev->ops->commit)
+            dev->ops->commit(dev, q->index);
+    }
+}
+
+static void unplug_queue(blk_hwq_t *q)
+{
+    blk_req_t *failed = 0;
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    q->plugged = 0;
+    dispatch(q, &failed);
+    spin_unlock_irqrestore(&q->lock, flags);
+    finish_failed(failed);
+}
+
+/* A batch whose last io never came */
+static void unplug_timer(void *arg)
+{
+    unplug_queue(arg);
+}
+
+/* ── Devices ─────────────────────────────────────────────────────────── */
+
+int blk_register(blkdev_t *dev, const uint32_t *queue_cpus)
+{
+    if (dev->nqueues == 0)
+        dev->nqueues = 1;
+    if (dev->nqueues > BLK_MAX_QUEUES)
+        dev->nqueues = BLK_MAX_QUEUES;
+    if (dev->depth == 0)
+        dev->depth = 1;
+    if (dev->max_segs == 0)
+        dev->max_segs = 1;
+    if (dev->max_sectors == 0)
+        dev->max_sectors = 8;
+
+    dev->hwq = kzalloc(dev->nqueues * sizeof(blk_hwq_t));
+    if (!dev->hwq)
+        return -1;
+    for (uint32_t i = 0; i < dev->nqueues; i++) {
+        blk_hwq_t *q = &dev->hwq[i];
+        q->dev   = dev;
+        q->index = i;
+        q->lock  = (spinlock_t)SPINLOCK_INIT;
+        uint32_t cpu = queue_cpus ? queue_cpus[i] : i;
+        timer_setup(&q->unplug, unplug_timer, q,
+                    timer_cpu_active(cpu) ? cpu : 0);
+    }
+
+    uint64_t flags = spin_lock_irqsave(&s_devs_lock);
+    uint32_t n = s_ndevs;
+    if (n == BLKDEV_MAX) {
+        spin_unlock_irqrestore(&s_devs_lock, flags);
+        kfree(dev->hwq);
+        dev->hwq = 0;
+        return -1;
+    }
+    ksnprintf(dev->name, sizeof(dev->name), "blk%u", n);
+    s_devs[n] = dev;
+    __atomic_store_n(&s_ndevs, n + 1, __ATOMIC_RELEASE);
+    blk_add_fn_t add = s_add_handler;
+    spin_unlock_irqrestore(&s_devs_lock, flags);
+
+    klog("[blk] %s: %s, %lu MB%s, %u queue%s of %u", dev->name, dev->driver,
+         (unsigned long)(dev->nsectors >> 11),
+         (dev->flags & BLK_F_RO) ? " read-only" : "", dev->nqueues,
+         dev->nqueues == 1 ? "" : "s", dev->depth);
+    if (add)
+        add(dev);
+    return 0;
+}
+
+uint32_t blk_count(void)
+{
+    return __atomic_load_n(&s_ndevs, __ATOMIC_ACQUIRE);
+}
+
+blkdev_t *blk_get(uint32_t index)
+{
+    return index < blk_count() ? s_devs[index] : 0;
+}
+
+blkdev_t *blk_find(const char *name)
+{
+    uint32_t n = blk_count();
+    for (uint32_t i = 0; i < n; i++)
+        if (kstrcmp(s_devs[i]->name, name) == 0)
+            return s_devs[i];
+    return 0;
+}
+
+/* Whoever registers after the handler is set calls it; the rest are the
+ * ones counted here */
+void blk_set_add_handler(blk_add_fn_t fn)
+{
+    uint64_t flags = spin_lock_irqsave(&s_devs_lock);
+    s_add_handler = fn;
+    uint32_t n = s_ndevs;
+    spin_unlock_irqrestore(&s_devs_lock, flags);
+    for (uint32_t i = 0; i < n; i++)
+        fn(s_devs[i]);
+}
+
+/* ── Submission ──────────────────────────────────────────────────────── */
+
+void blk_submit(blkdev_t *dev, blk_io_t *io, int more)
+{
+    if (io->op == BLK_FLUSH) {
+        stat_add(&dev->stats.flushes, 1);
+        if (!(dev->flags & BLK_F_CACHE)) {
+            io_finish(dev, io, BLK_OK);
+            return;
+        }
+        io->sector = 0;
+        io->count  = 0;
+    } else if (io->op > BLK_FLUSH || io->count == 0 ||
+               io->count > dev->max_sectors ||
+               io->sector + io->count > dev->nsectors ||
+               io->sector + io->count < io->sector ||
+               (io->op == BLK_WRITE && (dev->flags & BLK_F_RO))) {
+        io_finish(dev, io, BLK_EIO);
+        return;
+    } else if (io->op == BLK_READ) {
+        stat_add(&dev->stats.reads, 1);
+        stat_add(&dev->stats.read_sectors, io->count);
+    } else {
+        stat_add(&dev->stats.writes, 1);
+        stat_add(&dev->stats.write_sectors, io->count);
+    }
+
+    blk_hwq_t *q = &dev->hwq[hal_cpu_id() % dev->nqueues];
+    blk_req_t *failed = 0;
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    if (io->op != BLK_FLUSH && try_merge(q, io)) {
+        stat_add(&dev->stats.merges, 1);
+    } else {
+        blk_req_t *r = kzalloc(sizeof(*r));
+        if (!r) {
+            spin_unlock_irqrestore(&q->lock, flags);
+            io_finish(dev, io, BLK_EIO);
+            return;
+        }
+        io->next  = 0;
+        r->hwq    = q;
+        r->op     = io->op;
+        r->sector = io->sector;
+        r->count  = io->count;
+        r->nsegs  = 1;
+        r->ios    = r->ios_tail = io;
+        insert(q, r);
+    }
+    if (more) {
+        q->plugged = 1;
+        if (!timer_pending(&q->unplug))
+            timer_arm(&q->unplug, hal_timer_now_ns() + BLK_PLUG_NS);
+    } else {
+        q->plugged = 0;
+        dispatch(q, &failed);
+    }
+    spin_unlock_irqrestore(&q->lock, flags);
+    finish_failed(failed);
+}
+
+void blk_unplug(blkdev_t *dev)
+{
+    unplug_queue(&dev->hwq[hal_cpu_id() % dev->nqueues]);
+}
+
+void blk_complete(blk_req_t *r, int status)
+{
+    blk_hwq_t *q = r->hwq;
+    blk_req_t *failed = 0;
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    q->inflight--;
+    dispatch(q, &failed);
+    spin_unlock_irqrestore(&q->lock, flags);
+    req_finish(r, status);
+    finish_failed(failed);
+}
+
+/* ── Synchronous I/O ─────────────────────────────────────────────────── */
+
+/* The lock orders the last callback's wake-up before the waiter's
+ * return, after which the wait (on its stack) is gone */
+typedef struct {
+    spinlock_t  lock;
+    thread_t   *waiter;
+    uint32_t    left;
+    int         status;
+} blk_wait_t;
+
+static void rw_done(blk_io_t *io)
+{
+    blk_wait_t *w = io->priv;
+    uint64_t flags = spin_lock_irqsave(&w->lock);
+    if (io->status != BLK_OK)
+        w->status = io->status;
+    if (--w->left == 0)
+        thread_wake(w->waiter);
+    spin_unlock_irqrestore(&w->lock, flags);
+}
+
+int blk_rw(blkdev_t *dev, uint8_t op, uint64_t sector, uint32_t count,
+           void *buf)
+{
+    blk_io_t io[BLK_RW_BATCH];
+    blk_wait_t w = { SPINLOCK_INIT, thread_current(), 0, BLK_OK };
+    uint8_t *p = buf;
+    do {
+        /* One batch of up to BLK_RW_BATCH ios, merged as far as the
+         * device allows and waited for together */
+        uint32_t n = 0;
+        for (; n < BLK_RW_BATCH && (count || (op == BLK_FLUSH && !n)); n++) {
+            uint32_t c = count < dev->max_sectors ? count : dev->max_sectors;
+            io[n] = (blk_io_t){ .op = op, .sector = sector, .count = c,
+                                .buf = p, .done = rw_done, .priv = &w };
+            sector += c;
+            count  -= c;
+            p      += (uint64_t)c * BLK_SECTOR_SIZE;
+            if (op == BLK_FLUSH)
+                count = 0;
+        }
+        w.left = n;                 /* nothing in flight yet */
+        for (uint32_t i = 0; i < n; i++)
+            blk_submit(dev, &io[i], i + 1 < n);
+        for (;;) {
+            uint64_t flags = spin_lock_irqsave(&w.lock);
+            uint32_t left = w.left;
+            spin_unlock_irqrestore(&w.lock, flags);
+            if (!left)
+                break;
+            thread_block();
+        }
+    } while (count && w.status == BLK_OK);
+    return w.status;
+}
+
+/* ── Probe ───────────────────────────────────────────────────────────── */
+
+void blk_init(void)
+{
+    ahci_init();
+    sdhci_init();
+}
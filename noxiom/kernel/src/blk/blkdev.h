@@ -0,0 +1,174 @@
+#pragma once
+/* blk/blkdev.h — block devices: asynchronous I/O with request merging
+ *
+ * Drivers fill in a blkdev_t and blk_register() it; it is named blk0,
+ * blk1, ... in registration order.  Sizes are in 512-byte sectors
+ * whatever the device's own block size.
+ *
+ * Submission: blk_submit() queues one blk_io_t and returns at once; the
+ * io's done() callback runs when it has finished, from an interrupt
+ * handler or a driver thread (so it must not block), with io->status 0
+ * or BLK_EIO.  blk_rw() is the synchronous wrapper for threads.  The
+ * buffer must be kernel memory (identity-mapped, so physically
+ * contiguous) and stay put until done().
+ *
+ * Queues: each device has nqueues hardware queues — one per CPU when the
+ * device can complete on several (virtio-blk with per-queue vectors),
+ * else one — and a submitter uses queue hal_cpu_id() % nqueues.  Each
+ * queue keeps its not yet dispatched requests sorted by sector:
+ *
+ *   - merging: an io that continues a pending request of the same
+ *     direction (or ends right where one starts) joins it, so a run of
+ *     small sequential writes reaches the device as one command.  Each
+ *     io stays one segment of the request; once a merged request also
+ *     touches the next pending one, the two become one.
+ *   - plugging: more != 0 says another io follows, and dispatch waits
+ *     for the last one (or blk_unplug(), or BLK_PLUG_NS at most) so the
+ *     whole batch is merged before the device sees any of it.  As with
+ *     netdev batching, a batch must come from one CPU.
+ *   - dispatch: up to `depth` requests in flight per queue, taken in
+ *     ascending sector order from the last one dispatched and wrapping
+ *     to the lowest (C-LOOK).  Requests also merge while they wait for
+ *     a busy device, which is where most merging happens under load.
+ *
+ * BLK_FLUSH (write the device cache back) is never merged and is
+ * dispatched ahead of pending reads and writes: it covers the writes
+ * that have completed when it is submitted, so wait for those first.
+ */
+#include <stdint.h>
+#include "../sync/spinlock.h"
+#include "../time/timer.h"
+
+#define BLK_SECTOR_SIZE   512
+#define BLKDEV_NAME_LEN   8
+#define BLKDEV_MAX        8
+#define BLK_MAX_QUEUES    16            /* = HAL_MAX_CPUS                 */
+#define BLK_PLUG_NS       1000000ULL    /* longest a plugged queue waits  */
+
+/* blk_io_t.op */
+#define BLK_READ          0
+#define BLK_WRITE         1
+#define BLK_FLUSH         2
+
+/* Status codes */
+#define BLK_OK            0
+#define BLK_EIO           (-1)
+#define BLK_BUSY          1             /* queue_rq(): try again later    */
+
+/* blkdev_t.flags */
+#define BLK_F_RO          0x1
+#define BLK_F_CACHE       0x2           /* volatile write cache: flush it */
+
+typedef struct blk_io  blk_io_t;
+typedef struct blk_req blk_req_t;
+typedef struct blk_hwq blk_hwq_t;
+typedef struct blkdev  blkdev_t;
+
+typedef void (*blk_done_fn_t)(blk_io_t *io);
+
+struct blk_io {
+    blk_io_t      *next;            /* owned by the block layer         */
+    uint8_t        op;              /* BLK_READ, BLK_WRITE, BLK_FLUSH   */
+    uint64_t       sector;
+    uint32_t       count;           /* sectors; 0 for BLK_FLUSH         */
+    void          *buf;             /* count * 512 bytes                */
+    int            status;          /* set before done() runs           */
+    blk_done_fn_t  done;
+    void          *priv;            /* the submitter's                  */
+};
+
+/* One device command: one or more ios covering [sector, sector + count)
+ * in order, each io's buffer one segment */
+struct blk_req {
+    blk_req_t     *next;
+    blk_hwq_t     *hwq;
+    uint8_t        op;
+    uint64_t       sector;
+    uint32_t       count;
+    uint32_t       nsegs;
+    blk_io_t      *ios, *ios_tail;
+    uint32_t       tag;             /* the driver's                     */
+    uint64_t       pdu[4];          /* driver scratch, e.g. a header    */
+};
+
+struct blk_hwq {
+    blkdev_t      *dev;
+    uint32_t       index;
+    spinlock_t     lock;
+    blk_req_t     *pending;         /* sorted by sector                 */
+    blk_req_t     *flushes;         /* FIFO, dispatched first           */
+    uint32_t       npending;
+    uint32_t       inflight;
+    uint64_t       head;            /* end of the last dispatched one   */
+    uint8_t        plugged;
+    ktimer_t       unplug;
+    uint64_t       dispatched;      /* requests sent to the device      */
+};
+
+typedef struct {
+    /* Start r on queue q (the queue's lock held, IRQs masked).  Returns
+     * 0, BLK_BUSY if the device has no room for it now (it is queued
+     * again and retried after the next completion), or BLK_EIO.
+     * more != 0: another request follows, the doorbell may wait. */
+    int  (*queue_rq)(blkdev_t *dev, uint32_t q, blk_req_t *r, int more);
+    /* Ring the doorbell for whatever queue_rq() held back (may be 0) */
+    void (*commit)(blkdev_t *dev, uint32_t q);
+} blkdev_ops_t;
+
+typedef struct {
+    uint64_t reads, writes, flushes;        /* ios                      */
+    uint64_t read_sectors, write_sectors;
+    uint64_t merges;                /* ios that joined another's request */
+    uint64_t requests;              /* commands sent to the device      */
+    uint64_t errors;
+} blkdev_stats_t;
+
+struct blkdev {
+    char                name[BLKDEV_NAME_LEN];  /* set by blk_register */
+    const char         *driver;
+    uint64_t            nsectors;
+    uint32_t            max_sectors;    /* per request                  */
+    uint32_t            max_segs;       /* per request                  */
+    uint32_t            nqueues;        /* at most BLK_MAX_QUEUES       */
+    uint32_t            depth;          /* requests in flight per queue */
+    uint32_t            flags;          /* BLK_F_*                      */
+    const blkdev_ops_t *ops;
+    void               *priv;
+    blk_hwq_t          *hwq;            /* set by blk_register          */
+    blkdev_stats_t      stats;          /* updated with atomic adds     */
+};
+
+/* Allocates the hardware queues; -1 if out of memory or the table is
+ * full.  Queue i's unplug timer runs on queue_cpus[i] (0: CPU i). */
+int       blk_register(blkdev_t *dev, const uint32_t *queue_cpus);
+uint32_t  blk_count(void);
+blkdev_t *blk_get(uint32_t index);
+/* Name lookup ("blk0"), 0 if there is none */
+blkdev_t *blk_find(const char *name);
+
+/* fn(dev) once for every device, those registered so far and those to
+ * come.  It runs in the registering thread — possibly the driver's own
+ * I/O worker — so it must not wait for I/O on the device. */
+typedef void (*blk_add_fn_t)(blkdev_t *dev);
+void      blk_set_add_handler(blk_add_fn_t fn);
+
+/* Queue io.  An io past the end of the device, a write to a read-only
+ * one or a flush without BLK_F_CACHE completes at once (a flush with
+ * status 0, the others with BLK_EIO). */
+void blk_submit(blkdev_t *dev, blk_io_t *io, int more);
+/* Dispatch what a batch (more = 1) held back on this CPU's queue */
+void blk_unplug(blkdev_t *dev);
+/* From the driver, with none of its locks held: r has finished */
+void blk_complete(blk_req_t *r, int status);
+
+/* Submit and wait (thread context).  Returns 0 or BLK_EIO. */
+int  blk_rw(blkdev_t *dev, uint8_t op, uint64_t sector, uint32_t count,
+            void *buf);
+
+/* Probe the controllers the layer has drivers for (virtio-blk comes in
+ * through virtio_init()).  After pci_init() and sched_init(). */
+void blk_init(void);
+
+/* Drivers */
+void ahci_init(void);
+void sdhci_init(void);
@@ -0,0 +1,504 @@
+/* kernel/src/blk/sdhci.c — SD Host Controller (Raspberry Pi EMMC / EMMC2)
+ *
+ * Found by compatible string through hal_platform_dev():
+ * "brcm,bcm2711-emmc2" (Pi 4 SD slot) and "brcm,bcm2835-sdhci" (the
+ * Arasan controller of earlier Pis).  Both are SD Host Controller
+ * Specification register sets that only take 32-bit accesses, so 8- and
+ * 16-bit registers are read-modify-written, and TRANSFER_MODE and
+ * COMMAND go out as one 32-bit write (writing COMMAND starts it).
+ *
+ * One card, one request at a time, moved through the data port by the
+ * controller's worker thread (PIO: the Pis' DMA engines see RAM through
+ * a bus address window this driver does not translate).  The block
+ * layer keeps merging while a request runs, and each request is a
+ * single CMD18 / CMD25 of up to SDHCI_MAX_SECTORS with auto-CMD12; a
+ * multi-block write is preceded by ACMD23 so the card can pre-erase the
+ * whole range.  Few large writes instead of many small ones is what SD
+ * throughput — and the card's wear — depend on.
+ *
+ * Waits: with an interrupt the controller signals only what the worker
+ * is waiting for and the handler masks the signal again and wakes the
+ * worker; without one the worker polls, yielding between reads.
+ *
+ * Clock: the base clock comes from CAPABILITIES; when that reads 0 (the
+ * Pis leave it to firmware) it is taken as SDHCI_DEFAULT_BASE_HZ, the
+ * highest the Pi firmware sets, so dividers only ever err towards a
+ * slower card clock.  Cards run in default speed, 25 MHz, 4-bit bus.
+ *
+ * Card initialisation runs on the worker, so boot does not wait for it;
+ * the device registers once the card is up.
+ */
+#include "blkdev.h"
+#include "../hal.h"
+#include "../sched/sched.h"
+#include "../mm/kmalloc.h"
+#include "../string.h"
+#include "../log/klog.h"
+
+/* Registers */
+#define SD_BLKSIZE          0x04    /* BLKSIZE | BLKCOUNT << 16         */
+#define SD_ARG1             0x08
+#define SD_CMDTM            0x0C    /* TRANSFER_MODE | COMMAND << 16    */
+#define SD_RESP0            0x10
+#define SD_DATA             0x20
+#define SD_PRESENT          0x24
+#define SD_HOST_CTRL1       0x28
+#define SD_POWER_CTRL       0x29
+#define SD_CLOCK_CTRL       0x2C
+#define SD_TIMEOUT_CTRL     0x2E
+#define SD_SW_RESET         0x2F
+#define SD_INT_STATUS       0x30    /* normal | error << 16             */
+#define SD_INT_ENABLE       0x34
+#define SD_INT_SIGNAL       0x38
+#define SD_CAPS             0x40
+#define SD_HOST_VERSION     0xFE
+
+#define PRESENT_CMD_INHIBIT (1u << 0)
+#define PRESENT_DAT_INHIBIT (1u << 1)
+
+#define INT_CMD_DONE        (1u << 0)
+#define INT_DATA_DONE       (1u << 1)
+#define INT_WRITE_READY     (1u << 4)
+#define INT_READ_READY      (1u << 5)
+#define INT_ERROR           (1u << 15)
+#define INT_ERROR_MASK      0xFFFF0000u
+
+#define CLOCK_INT_EN        (1u << 0)
+#define CLOCK_INT_STABLE    (1u << 1)
+#define CLOCK_CARD_EN       (1u << 2)
+
+#define RESET_ALL           (1u << 0)
+#define RESET_CMD           (1u << 1)
+#define RESET_DAT           (1u << 2)
+
+#define HOST_CTRL1_4BIT     (1u << 1)
+#define POWER_3V3_ON        0x0F
+
+/* TRANSFER_MODE */
+#define TM_BLKCNT_EN        (1u << 1)
+#define TM_AUTO_CMD12       (1u << 2)
+#define TM_READ             (1u << 4)
+#define TM_MULTI            (1u << 5)
+
+/* COMMAND flags: response type, CRC and index checks, data */
+#define RSP_NONE            0x00
+#define RSP_136             0x09    /* R2                               */
+#define RSP_48              0x1A    /* R1, R6, R7                       */
+#define RSP_48_BUSY         0x1B    /* R1b                              */
+#define RSP_48_NOCRC        0x02    /* R3                               */
+#define CMD_DATA            0x20
+
+/* SD commands */
+#define SD_GO_IDLE          0
+#define SD_ALL_SEND_CID     2
+#define SD_SEND_RCA         3
+#define SD_SELECT           7
+#define SD_SEND_IF_COND     8
+#define SD_SEND_CSD         9
+#define SD_STOP             12
+#define SD_SET_BLOCKLEN     16
+#define SD_READ_SINGLE      17
+#define SD_READ_MULTI       18
+#define SD_WRITE_SINGLE     24
+#define SD_WRITE_MULTI      25
+#define SD_APP_CMD          55
+#define SD_ACMD_BUS_WIDTH   6
+#define SD_ACMD_PRE_ERASE   23
+#define SD_ACMD_OP_COND     41
+
+#define OCR_BUSY            (1u << 31)  /* set when power-up is done   */
+#define OCR_CCS             (1u << 30)  /* high capacity: block address */
+#define OCR_VOLTAGES        0x00FF8000u
+
+#define SDHCI_DEFAULT_BASE_HZ   250000000u
+#define SDHCI_INIT_HZ           400000u
+#define SDHCI_CARD_HZ           25000000u
+#define SDHCI_MAX_SECTORS       128     /* 64 KB per command            */
+#define SDHCI_TIMEOUT_NS        1000000000ULL
+#define SDHCI_MAX_CTRL          2
+
+typedef struct {
+    blkdev_t           blkdev;
+    volatile uint8_t  *regs;
+    uint32_t           irq;             /* 0: poll                     */
+    uint32_t           base_hz;
+    uint32_t           version;         /* spec version - 1            */
+    uint32_t           rca;
+    int                high_capacity;
+    spinlock_t         lock;
+    blk_req_t         *queue, *queue_tail;
+    thread_t          *worker;
+    char               where[24];
+} sdhci_t;
+
+static const char *const s_compat[] = {
+    "brcm,bcm2711-emmc2",
+    "brcm,bcm2835-sdhci",
+};
+
+/* ── Register access: 32 bits wide only ──────────────────────────────── */
+
+static inline uint32_t rd32(sdhci_t *h, uint32_t off)
+{
+    return *(volatile uint32_t *)(h->regs + off);
+}
+
+static inline void wr32(sdhci_t *h, uint32_t off, uint32_t v)
+{
+    *(volatile uint32_t *)(h->regs + off) = v;
+}
+
+static inline uint32_t rd16(sdhci_t *h, uint32_t off)
+{
+    return (rd32(h, off & ~3u) >> ((off & 3) * 8)) & 0xFFFF;
+}
+
+static void wr_sub(sdhci_t *h, uint32_t off, uint32_t v, uint32_t mask)
+{
+    uint32_t shift = (off & 3) * 8;
+    uint32_t old = rd32(h, off & ~3u);
+    wr32(h, off & ~3u, (old & ~(mask << shift)) | ((v & mask) << shift));
+}
+
+static inline void wr8(sdhci_t *h, uint32_t off, uint32_t v)
+{
+    wr_sub(h, off, v, 0xFF);
+}
+
+static inline void wr16(sdhci_t *h, uint32_t off, uint32_t v)
+{
+    wr_sub(h, off, v, 0xFFFF);
+}
+
+/* ── Waiting ─────────────────────────────────────────────────────────── */
+
+static void sdhci_irq(uint32_t irq, void *ctx)
+{
+    (void)irq;
+    sdhci_t *h = ctx;
+    wr32(h, SD_INT_SIGNAL, 0);
+    if (h->worker)
+        thread_wake(h->worker);
+}
+
+/* Until a status bit in mask (or an error) is set; returns the status,
+ * or 0 on timeout */
+static uint32_t wait_int(sdhci_t *h, uint32_t mask)
+{
+    uint64_t end = hal_timer_now_ns() + SDHCI_TIMEOUT_NS;
+    for (;;) {
+        uint32_t st = rd32(h, SD_INT_STATUS);
+        if (st & (mask | INT_ERROR))
+            return st;
+        if (hal_timer_now_ns() > end)
+            return 0;
+        if (!h->irq) {
+            thread_yield();
+            continue;
+        }
+        wr32(h, SD_INT_SIGNAL, mask | INT_ERROR_MASK);
+        if (rd32(h, SD_INT_STATUS) & (mask | INT_ERROR)) {
+            wr32(h, SD_INT_SIGNAL, 0);
+            continue;
+        }
+        thread_block_until(end);
+    }
+}
+
+static int wait_clear(sdhci_t *h, uint32_t off, uint32_t mask)
+{
+    uint64_t end = hal_timer_now_ns() + SDHCI_TIMEOUT_NS;
+    while (rd32(h, off) & mask) {
+        if (hal_timer_now_ns() > end)
+            return -1;
+        thread_yield();
+    }
+    return 0;
+}
+
+/* SW_RESET is the top byte of the CLOCK_CTRL word */
+static void reset_lines(sdhci_t *h, uint32_t which)
+{
+    wr8(h, SD_SW_RESET, which);
+    wait_clear(h, SD_CLOCK_CTRL, which << 24);
+}
+
+/* ── Commands ────────────────────────────────────────────────────────── */
+
+/* Issue one command and wait for its response (and the end of a busy
+ * signal).  mode: TRANSFER_MODE for a data command, 0 otherwise. */
+static int sd_cmd(sdhci_t *h, uint32_t idx, uint32_t flags, uint32_t arg,
+                  uint32_t mode)
+{
+    uint32_t inhibit = PRESENT_CMD_INHIBIT;
+    if (flags & CMD_DATA || flags == RSP_48_BUSY)
+        inhibit |= PRESENT_DAT_INHIBIT;
+    if (wait_clear(h, SD_PRESENT, inhibit) != 0)
+        return -1;
+    wr32(h, SD_INT_STATUS, 0xFFFFFFFFu);
+    wr32(h, SD_ARG1, arg);
+    wr32(h, SD_CMDTM, (idx << 8 | flags) << 16 | mode);
+
+    uint32_t st = wait_int(h, INT_CMD_DONE);
+    if (!(st & INT_CMD_DONE) || (st & INT_ERROR)) {
+        reset_lines(h, RESET_CMD);
+        return -1;
+    }
+    wr32(h, SD_INT_STATUS, INT_CMD_DONE);
+    if (flags == RSP_48_BUSY) {
+        st = wait_int(h, INT_DATA_DONE);
+        if (!(st & INT_DATA_DONE) || (st & INT_ERROR)) {
+            reset_lines(h, RESET_DAT);
+            return -1;
+        }
+        wr32(h, SD_INT_STATUS, INT_DATA_DONE);
+    }
+    return 0;
+}
+
+static int sd_acmd(sdhci_t *h, uint32_t idx, uint32_t flags, uint32_t arg)
+{
+    if (sd_cmd(h, SD_APP_CMD, RSP_48, h->rca << 16, 0) != 0)
+        return -1;
+    return sd_cmd(h, idx, flags, arg, 0);
+}
+
+static int set_clock(sdhci_t *h, uint32_t hz)
+{
+    wr16(h, SD_CLOCK_CTRL, 0);
+    uint32_t div = 0;                   /* base / (2 * div), 0 = base */
+    if (h->base_hz > hz) {
+        if (h->version >= 2) {          /* 10-bit divided clock        */
+            div = (h->base_hz + 2 * hz - 1) / (2 * hz);
+            if (div > 0x3FF)
+                div = 0x3FF;
+        } else {                        /* powers of two up to 256     */
+            div = 1;
+            while (div < 0x80 && h->base_hz / (2 * div) > hz)
+                div <<= 1;
+        }
+    }
+    uint32_t reg = (div & 0xFF) << 8 | ((div >> 8) & 3) << 6;
+    wr16(h, SD_CLOCK_CTRL, reg | CLOCK_INT_EN);
+    uint64_t end = hal_timer_now_ns() + SDHCI_TIMEOUT_NS;
+    while (!(rd16(h, SD_CLOCK_CTRL) & CLOCK_INT_STABLE)) {
+        if (hal_timer_now_ns() > end)
+            return -1;
+        thread_yield();
+    }
+    wr16(h, SD_CLOCK_CTRL, reg | CLOCK_INT_EN | CLOCK_CARD_EN);
+    thread_sleep_ns(2000000);           /* let the card see the clock */
+    return 0;
+}
+
+/* Power-up, identification and selection (SD Physical Layer 4.2) */
+static int card_init(sdhci_t *h)
+{
+    reset_lines(h, RESET_ALL);
+    uint32_t caps = rd32(h, SD_CAPS);
+    h->version = rd16(h, SD_HOST_VERSION) & 0xFF;
+    h->base_hz = ((caps >> 8) & (h->version >= 2 ? 0xFF : 0x3F)) * 1000000u;
+    if (!h->base_hz)
+        h->base_hz = SDHCI_DEFAULT_BASE_HZ;
+
+    wr8(h, SD_POWER_CTRL, POWER_3V3_ON);
+    wr8(h, SD_TIMEOUT_CTRL, 0x0E);
+    wr32(h, SD_INT_ENABLE, 0xFFFFFFFFu);
+    wr32(h, SD_INT_SIGNAL, 0);
+    if (set_clock(h, SDHCI_INIT_HZ) != 0)
+        return -1;
+
+    h->rca = 0;
+    sd_cmd(h, SD_GO_IDLE, RSP_NONE, 0, 0);
+    int v2 = sd_cmd(h, SD_SEND_IF_COND, RSP_48, 0x1AA, 0) == 0 &&
+             (rd32(h, SD_RESP0) & 0xFFF) == 0x1AA;
+
+    uint32_t ocr = 0;
+    uint64_t end = hal_timer_now_ns() + SDHCI_TIMEOUT_NS;
+    do {
+        if (hal_timer_now_ns() > end ||
+            sd_acmd(h, SD_ACMD_OP_COND, RSP_48_NOCRC,
+                    OCR_VOLTAGES | (v2 ? OCR_CCS : 0)) != 0)
+            return -1;
+        ocr = rd32(h, SD_RESP0);
+        if (!(ocr & OCR_BUSY))
+            thread_sleep_ns(10000000);
+    } while (!(ocr & OCR_BUSY));
+    h->high_capacity = (ocr & OCR_CCS) != 0;
+
+    if (sd_cmd(h, SD_ALL_SEND_CID, RSP_136, 0, 0) != 0 ||
+        sd_cmd(h, SD_SEND_RCA, RSP_48, 0, 0) != 0)
+        return -1;
+    h->rca = rd32(h, SD_RESP0) >> 16;
+
+    /* CSD: R2 arrives without its CRC byte, so CSD bit n is at
+     * response bit n - 8 */
+    if (sd_cmd(h, SD_SEND_CSD, RSP_136, h->rca << 16, 0) != 0)
+        return -1;
+    uint32_t r1 = rd32(h, SD_RESP0 + 4), r2 = rd32(h, SD_RESP0 + 8);
+    uint32_t r3 = rd32(h, SD_RESP0 + 12);
+    uint64_t sectors;
+    if (((r3 >> 22) & 3) == 1) {        /* CSD 2.0: (C_SIZE + 1) * 512 KB */
+        sectors = ((uint64_t)((r1 >> 8) & 0x3FFFFF) + 1) * 1024;
+    } else {                            /* CSD 1.0 */
+        uint32_t c_size = (r2 & 3) << 10 | r1 >> 22;
+        uint32_t mult   = (r1 >> 7) & 7;
+        uint32_t bl_len = (r2 >> 8) & 0xF;
+        sectors = ((uint64_t)(c_size + 1) << (mult + 2 + bl_len)) /
+                  BLK_SECTOR_SIZE;
+    }
+
+    if (sd_cmd(h, SD_SELECT, RSP_48_BUSY, h->rca << 16, 0) != 0 ||
+        sd_acmd(h, SD_ACMD_BUS_WIDTH, RSP_48, 2) != 0)
+        return -1;
+    wr8(h, SD_HOST_CTRL1, HOST_CTRL1_4BIT);
+    if (sd_cmd(h, SD_SET_BLOCKLEN, RSP_48, BLK_SECTOR_SIZE, 0) != 0 ||
+        set_clock(h, SDHCI_CARD_HZ) != 0)
+        return -1;
+    h->blkdev.nsectors = sectors;
+    return 0;
+}
+
+/* ── Transfers ───────────────────────────────────────────────────────── */
+
+static int transfer(sdhci_t *h, blk_req_t *r)
+{
+    int write = r->op == BLK_WRITE;
+    int multi = r->count > 1;
+    uint32_t addr = h->high_capacity ? (uint32_t)r->sector
+                                     : (uint32_t)r->sector * BLK_SECTOR_SIZE;
+    if (write && multi &&
+        sd_acmd(h, SD_ACMD_PRE_ERASE, RSP_48, r->count) != 0)
+        return -1;
+
+    wr32(h, SD_BLKSIZE, r->count << 16 | BLK_SECTOR_SIZE);
+    uint32_t mode = TM_BLKCNT_EN | (write ? 0 : TM_READ) |
+                    (multi ? TM_MULTI | TM_AUTO_CMD12 : 0);
+    uint32_t idx = write ? (multi ? SD_WRITE_MULTI : SD_WRITE_SINGLE)
+                         : (multi ? SD_READ_MULTI : SD_READ_SINGLE);
+    if (sd_cmd(h, idx, RSP_48 | CMD_DATA, addr, mode) != 0)
+        return -1;
+
+    uint32_t ready = write ? INT_WRITE_READY : INT_READ_READY;
+    for (blk_io_t *io = r->ios; io; io = io->next) {
+        uint8_t *p = io->buf;
+        for (uint32_t b = 0; b < io->count; b++) {
+            uint32_t st = wait_int(h, ready);
+            if (!(st & ready) || (st & INT_ERROR))
+                goto fail;
+            wr32(h, SD_INT_STATUS, ready);
+            for (uint32_t i = 0; i < BLK_SECTOR_SIZE; i += 4, p += 4) {
+                uint32_t w;
+                if (write) {
+                    kmemcpy(&w, p, 4);
+                    wr32(h, SD_DATA, w);
+                } else {
+                    w = rd32(h, SD_DATA);
+                    kmemcpy(p, &w, 4);
+                }
+            }
+        }
+    }
+    uint32_t st = wait_int(h, INT_DATA_DONE);
+    if (!(st & INT_DATA_DONE) || (st & INT_ERROR))
+        goto fail;
+    wr32(h, SD_INT_STATUS, INT_DATA_DONE);
+    return 0;
+
+fail:
+    reset_lines(h, RESET_CMD | RESET_DAT);
+    if (multi)
+        sd_cmd(h, SD_STOP, RSP_48_BUSY, 0, 0);
+    return -1;
+}
+
+static int sdhci_queue_rq(blkdev_t *dev, uint32_t q, blk_req_t *r, int more)
+{
+    (void)q; (void)more;
+    sdhci_t *h = dev->priv;
+    uint64_t flags = spin_lock_irqsave(&h->lock);
+    r->next = 0;
+    if (h->queue_tail)
+        h->queue_tail->next = r;
+    else
+        h->queue = r;
+    h->queue_tail = r;
+    spin_unlock_irqrestore(&h->lock, flags);
+    thread_wake(h->worker);
+    return BLK_OK;
+}
+
+static const blkdev_ops_t s_sdhci_ops = {
+    .queue_rq = sdhci_queue_rq,
+};
+
+static void sdhci_worker(void *arg)
+{
+    sdhci_t *h = arg;
+    if (card_init(h) != 0) {
+        klog("[sdhci] %s: no usable card", h->where);
+        return;
+    }
+    blk_register(&h->blkdev, 0);
+
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&h->lock);
+        blk_req_t *r = h->queue;
+        if (r && !(h->queue = r->next))
+            h->queue_tail = 0;
+        spin_unlock_irqrestore(&h->lock, flags);
+        if (!r) {
+            thread_block();
+            continue;
+        }
+        blk_complete(r, transfer(h, r) == 0 ? BLK_OK : BLK_EIO);
+    }
+}
+
+/* ── Probe ───────────────────────────────────────────────────────────── */
+
+static void ctrl_probe(const hal_platform_dev_t *pd)
+{
+    sdhci_t *h = kzalloc(sizeof(*h));
+    if (!h || !(h->regs = hal_mmio_map(pd->base, pd->size ? pd->size
+                                                          : 0x100))) {
+        kfree(h);
+        return;
+    }
+    h->lock = (spinlock_t)SPINLOCK_INIT;
+    ksnprintf(h->where, sizeof(h->where), "mmio %lx",
+              (unsigned long)pd->base);
+
+    blkdev_t *bd = &h->blkdev;
+    bd->driver      = "sdhci";
+    bd->max_sectors = SDHCI_MAX_SECTORS;
+    bd->max_segs    = SDHCI_MAX_SECTORS;
+    bd->depth       = 2;            /* the next one queued on the worker */
+    bd->ops         = &s_sdhci_ops; /* no BLK_F_CACHE: the layer itself
+                                       completes flushes */
+    bd->priv        = h;
+
+    wr32(h, SD_INT_SIGNAL, 0);
+    if (pd->irq && hal_irq_register(pd->irq, sdhci_irq, h) == 0)
+        h->irq = pd->irq;
+    h->worker = thread_create("sdhci", sdhci_worker, h);
+    if (!h->worker) {
+        klog("[sdhci] %s: cannot start the worker", h->where);
+        return;
+    }
+    klog("[sdhci] %s: %s", h->where,
+         h->irq ? "interrupt-driven PIO" : "polled PIO");
+}
+
+void sdhci_init(void)
+{
+    uint32_t n = 0;
+    for (uint32_t c = 0; c < sizeof(s_compat) / sizeof(s_compat[0]); c++) {
+        hal_platform_dev_t pd;
+        for (uint32_t i = 0; n < SDHCI_MAX_CTRL &&
+                             hal_platform_dev(s_compat[c], i, &pd) == 0; i++) {
+            ctrl_probe(&pd);
+            n++;
+        }
+    }
+}
@@ -0,0 +1,251 @@
+/* kernel/src/blk/virtio_blk.c — virtio block device
+ *
+ * Queues: with VIRTIO_BLK_F_MQ the device has num_queues request queues;
+ * one per online CPU is used (at most VBLK_MAX_QUEUES) when the
+ * transport gives each its own interrupt vector, aimed at that CPU, so a
+ * request completes on the core that submitted it.  With a single shared
+ * line (MMIO, PCI INTx) one queue is used.
+ *
+ * Requests: a chain is the 16-byte request header, one descriptor per
+ * segment (each merged io's buffer) and the status byte; header and
+ * status live in the request's pdu.  A queue takes as many requests as
+ * its ring has room for at the largest segment count, so the block
+ * layer's depth never makes virtqueue_add() fail.
+ *
+ * Completion runs in the interrupt handler: finished chains are taken
+ * off the ring under the queue lock and completed after it is dropped.
+ */
+#include "blkdev.h"
+#include "../virtio/virtio.h"
+#include "../virtio/virtqueue.h"
+#include "../smp/smp.h"
+#include "../mm/kmalloc.h"
+#include "../mm/pmm.h"
+#include "../string.h"
+#include "../log/klog.h"
+
+/* Feature bits */
+#define VIRTIO_BLK_F_SEG_MAX    2
+#define VIRTIO_BLK_F_RO         5
+#define VIRTIO_BLK_F_FLUSH      9
+#define VIRTIO_BLK_F_MQ         12
+
+/* Device configuration */
+#define VBLK_CFG_CAPACITY       0
+#define VBLK_CFG_SEG_MAX        12
+#define VBLK_CFG_NUM_QUEUES     34
+
+/* Request types */
+#define VIRTIO_BLK_T_IN         0
+#define VIRTIO_BLK_T_OUT        1
+#define VIRTIO_BLK_T_FLUSH      4
+
+#define VIRTIO_BLK_S_OK         0
+
+#define VBLK_MAX_QUEUES         8
+#define VBLK_MAX_SEGS           32
+#define VBLK_MAX_SECTORS        256 /* 128 KB per request             */
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} vblk_hdr_t;
+
+typedef struct {
+    vblk_hdr_t hdr;
+    uint8_t    status;
+} vblk_pdu_t;
+
+_Static_assert(sizeof(vblk_pdu_t) <= sizeof(((blk_req_t *)0)->pdu),
+               "virtio-blk header does not fit the request pdu");
+
+typedef struct vblk vblk_t;
+
+typedef struct {
+    vblk_t      *vb;
+    virtqueue_t  vq;
+    spinlock_t   lock;
+} vblk_queue_t;
+
+struct vblk {
+    blkdev_t      blkdev;
+    virtio_dev_t *vdev;
+    uint32_t      nqueues;
+    vblk_queue_t  q[VBLK_MAX_QUEUES];
+};
+
+/* ── Requests ────────────────────────────────────────────────────────── */
+
+static int vblk_queue_rq(blkdev_t *dev, uint32_t qi, blk_req_t *r, int more)
+{
+    vblk_t *vb = dev->priv;
+    vblk_queue_t *q = &vb->q[qi];
+    vblk_pdu_t *pdu = (vblk_pdu_t *)r->pdu;
+    pdu->hdr.type     = r->op == BLK_READ  ? VIRTIO_BLK_T_IN
+                      : r->op == BLK_WRITE ? VIRTIO_BLK_T_OUT
+                                           : VIRTIO_BLK_T_FLUSH;
+    pdu->hdr.reserved = 0;
+    pdu->hdr.sector   = r->op == BLK_FLUSH ? 0 : r->sector;
+    pdu->status       = 0xFF;
+
+    virtq_seg_t seg[VBLK_MAX_SEGS + 2];
+    uint32_t n = 0;
+    seg[n++] = (virtq_seg_t){ virt_to_phys(&pdu->hdr), sizeof(vblk_hdr_t) };
+    for (blk_io_t *io = r->ios; io && r->op != BLK_FLUSH; io = io->next)
+        seg[n++] = (virtq_seg_t){ virt_to_phys(io->buf),
+                                  io->count * BLK_SECTOR_SIZE };
+    seg[n++] = (virtq_seg_t){ virt_to_phys(&pdu->status), 1 };
+    uint32_t nout = r->op == BLK_WRITE ? n - 1 : 1;
+
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    int rc = virtqueue_add(&q->vq, seg, nout, n - nout, r);
+    if (!more || rc != 0)
+        virtqueue_kick(&q->vq);
+    spin_unlock_irqrestore(&q->lock, flags);
+    return rc == 0 ? BLK_OK : BLK_BUSY;
+}
+
+static void vblk_commit(blkdev_t *dev, uint32_t qi)
+{
+    vblk_queue_t *q = &((vblk_t *)dev->priv)->q[qi];
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    virtqueue_kick(&q->vq);
+    spin_unlock_irqrestore(&q->lock, flags);
+}
+
+static const blkdev_ops_t s_vblk_ops = {
+    .queue_rq = vblk_queue_rq,
+    .commit   = vblk_commit,
+};
+
+/* ── Interrupts ──────────────────────────────────────────────────────── */
+
+static void queue_complete(vblk_queue_t *q)
+{
+    blk_req_t *done = 0, **tail = &done;
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    for (blk_req_t *r; (r = virtqueue_get(&q->vq, 0)) != 0;) {
+        r->next = 0;
+        *tail = r;
+        tail = &r->next;
+    }
+    spin_unlock_irqrestore(&q->lock, flags);
+
+    for (blk_req_t *r = done, *next; r; r = next) {
+        next = r->next;
+        uint8_t status = __atomic_load_n(&((vblk_pdu_t *)r->pdu)->status,
+                                         __ATOMIC_ACQUIRE);
+        blk_complete(r, status == VIRTIO_BLK_S_OK ? BLK_OK : BLK_EIO);
+    }
+}
+
+/* Per-queue vector: nothing to acknowledge */
+static void vblk_vector_irq(uint32_t irq, void *ctx)
+{
+    (void)irq;
+    queue_complete(ctx);
+}
+
+/* Shared line: reading the ISR acknowledges it */
+static void vblk_shared_irq(uint32_t irq, void *ctx)
+{
+    (void)irq;
+    vblk_t *vb = ctx;
+    if (virtio_isr_ack(vb->vdev) & VIRTIO_ISR_QUEUE)
+        for (uint32_t i = 0; i < vb->nqueues; i++)
+            queue_complete(&vb->q[i]);
+}
+
+/* ── Probe ───────────────────────────────────────────────────────────── */
+
+/* Online CPUs, lowest first: queue i runs on cpus[i] */
+static uint32_t pick_cpus(uint32_t *cpus, uint32_t max)
+{
+    uint32_t n = 0;
+    for (uint32_t c = 0; c < HAL_MAX_CPUS && n < max; c++)
+        if (smp_cpu_online(c))
+            cpus[n++] = c;
+    return n ? n : (cpus[0] = 0, 1u);
+}
+
+int virtio_blk_probe(virtio_dev_t *d)
+{
+    uint64_t wanted = (1ULL << VIRTIO_BLK_F_SEG_MAX) |
+                      (1ULL << VIRTIO_BLK_F_RO) |
+                      (1ULL << VIRTIO_BLK_F_FLUSH) |
+                      (1ULL << VIRTIO_BLK_F_MQ);
+    if (virtio_negotiate(d, wanted) != 0)
+        return -1;
+
+    vblk_t *vb = kzalloc(sizeof(*vb));
+    if (!vb)
+        return -1;
+    vb->vdev = d;
+    d->driver = vb;
+
+    /* Queues: one per CPU if each can have its own vector */
+    uint32_t max_queues = 1;
+    if (virtio_has(d, VIRTIO_BLK_F_MQ))
+        max_queues = virtio_cfg_read(d, VBLK_CFG_NUM_QUEUES, 2);
+    if (max_queues == 0)
+        max_queues = 1;
+    uint32_t cpus[VBLK_MAX_QUEUES];
+    uint32_t want = pick_cpus(cpus, max_queues < VBLK_MAX_QUEUES
+                                    ? max_queues : VBLK_MAX_QUEUES);
+    if (virtio_irq_setup(d, want, cpus) == 0 && want > 1) {
+        want = 1;
+        virtio_irq_setup(d, 1, cpus);
+    }
+    vb->nqueues = want;
+
+    uint32_t ring = VIRTQ_MAX_SIZE;
+    for (uint32_t i = 0; i < vb->nqueues; i++) {
+        vblk_queue_t *q = &vb->q[i];
+        q->vb   = vb;
+        q->lock = (spinlock_t)SPINLOCK_INIT;
+        if (virtqueue_init(&q->vq, d, i, d->ops->queue_max(d, i)) != 0 ||
+            d->ops->queue_enable(d, &q->vq, i) != 0)
+            return -1;
+        if (q->vq.size < ring)
+            ring = q->vq.size;
+    }
+
+    /* Segments: what the device takes and the ring can hold twice */
+    uint32_t segs = VBLK_MAX_SEGS;
+    if (virtio_has(d, VIRTIO_BLK_F_SEG_MAX)) {
+        uint32_t seg_max = virtio_cfg_read(d, VBLK_CFG_SEG_MAX, 4);
+        if (seg_max && seg_max < segs)
+            segs = seg_max;
+    }
+    if (segs + 2 > ring / 2)
+        segs = ring / 2 > 3 ? ring / 2 - 2 : 1;
+
+    if (d->nvectors) {
+        for (uint32_t i = 0; i < vb->nqueues; i++)
+            if (hal_irq_register((uint32_t)d->vector_irq[i],
+                                 vblk_vector_irq, &vb->q[i]) != 0)
+                return -1;
+    } else if (d->irq == 0 || d->irq >= HAL_IRQ_MAX ||
+               hal_irq_register(d->irq, vblk_shared_irq, vb) != 0) {
+        return -1;
+    }
+    virtio_driver_ok(d);
+
+    blkdev_t *bd = &vb->blkdev;
+    bd->driver      = "virtio-blk";
+    bd->nsectors    = virtio_cfg_read(d, VBLK_CFG_CAPACITY, 4) |
+                      (uint64_t)virtio_cfg_read(d, VBLK_CFG_CAPACITY + 4, 4)
+                          << 32;
+    bd->max_sectors = VBLK_MAX_SECTORS;
+    bd->max_segs    = segs;
+    bd->nqueues     = vb->nqueues;
+    bd->depth       = ring / (segs + 2);
+    bd->flags       = (virtio_has(d, VIRTIO_BLK_F_RO) ? BLK_F_RO : 0) |
+                      (virtio_has(d, VIRTIO_BLK_F_FLUSH) ? BLK_F_CACHE : 0);
+    bd->ops         = &s_vblk_ops;
+    bd->priv        = vb;
+    klog("[virtio] %s: block, %s, %u segments per request", d->where,
+         d->nvectors ? "MSI-X per queue" : "shared IRQ", segs);
+    return blk_register(bd, cpus);
+}
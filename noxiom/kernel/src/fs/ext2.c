@@ -0,0 +1,388 @@
+/* kernel/src/fs/ext2.c — ext2 (and ext3/ext4 without a journal to
+ * replay), read-only
+ *
+ * Files are mapped through either the classic block map — 12 direct
+ * pointers, then single, double and triple indirect blocks — or, for
+ * inodes with EXT4_EXTENTS_FL, the extent tree, binary-searched a level
+ * at a time.  Uninitialised extents read as holes, as they must.
+ *
+ * Directories are scanned linearly.  That also covers htree-indexed
+ * ones: their index blocks look like a single empty entry to a linear
+ * reader, which is exactly how ext3 kept them readable by ext2.
+ *
+ * Any incompatible feature not in EXT2_INCOMPAT_OK refuses the mount;
+ * read-only-compatible ones (metadata checksums, huge files, ...) do not
+ * matter to a reader.  A filesystem that needs journal recovery mounts
+ * anyway: what it shows is the state before the unreplayed transactions.
+ */
+#include "vfs.h"
+#include "../string.h"
+#include "../mm/kmalloc.h"
+
+#define EXT2_SB_OFF           1024
+#define EXT2_MAGIC            0xEF53
+#define EXT2_ROOT_INO         2
+#define EXT2_NDIR_BLOCKS      12
+#define EXT4_EXTENTS_FL       0x80000
+#define EXT4_EXT_MAGIC        0xF30A
+#define EXT4_EXT_MAX_DEPTH    5
+
+#define EXT2_INCOMPAT_FILETYPE   0x0002
+#define EXT3_INCOMPAT_RECOVER    0x0004
+#define EXT4_INCOMPAT_EXTENTS    0x0040
+#define EXT4_INCOMPAT_64BIT      0x0080
+#define EXT4_INCOMPAT_MMP        0x0100
+#define EXT4_INCOMPAT_FLEX_BG    0x0200
+#define EXT4_INCOMPAT_CSUM_SEED  0x2000
+#define EXT4_INCOMPAT_LARGEDIR   0x4000
+#define EXT2_INCOMPAT_OK  (EXT2_INCOMPAT_FILETYPE | EXT3_INCOMPAT_RECOVER |   \
+                           EXT4_INCOMPAT_EXTENTS | EXT4_INCOMPAT_64BIT |      \
+                           EXT4_INCOMPAT_MMP | EXT4_INCOMPAT_FLEX_BG |        \
+                           EXT4_INCOMPAT_CSUM_SEED | EXT4_INCOMPAT_LARGEDIR)
+
+typedef struct {
+    uint32_t block_size;
+    uint32_t inodes_per_group;
+    uint32_t inodes_count;
+    uint32_t inode_size;
+    uint32_t desc_size;
+    uint32_t incompat;
+    uint64_t blocks_count;
+    uint64_t gdt_off;                   /* bytes into the filesystem      */
+} ext2_t;
+
+typedef struct {
+    uint32_t flags;
+    uint8_t  map[60];                   /* i_block: pointers or extents   */
+} ext2_inode_t;
+
+static inline uint16_t le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static inline uint32_t le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+/* ── Inodes ──────────────────────────────────────────────────────────── */
+
+/* A new node for inode ino, 0 on a read error or a bad number */
+static vfs_node_t *read_inode(vfs_fs_t *fs, uint32_t ino)
+{
+    ext2_t *e = fs->priv;
+    if (ino == 0 || ino > e->inodes_count)
+        return 0;
+    uint32_t group = (ino - 1) / e->inodes_per_group;
+    uint32_t index = (ino - 1) % e->inodes_per_group;
+
+    uint8_t gd[64];
+    uint32_t gd_len = e->desc_size < sizeof(gd) ? e->desc_size : sizeof(gd);
+    if (vfs_dev_read(fs, e->gdt_off + (uint64_t)group * e->desc_size, gd,
+                     gd_len) != 0)
+        return 0;
+    uint64_t table = le32(gd + 8);
+    if (gd_len >= 0x2C)
+        table |= (uint64_t)le32(gd + 0x28) << 32;
+
+    uint8_t in[128];
+    if (vfs_dev_read(fs, table * e->block_size +
+                         (uint64_t)index * e->inode_size, in,
+                     sizeof(in)) != 0)
+        return 0;
+
+    vfs_node_t *n = vfs_node_alloc(fs);
+    ext2_inode_t *ei = kzalloc(sizeof(*ei));
+    if (!n || !ei) {
+        kfree(n);
+        kfree(ei);
+        return 0;
+    }
+    uint16_t mode = le16(in);
+    ei->flags = le32(in + 32);
+    kmemcpy(ei->map, in + 40, sizeof(ei->map));
+    n->priv = ei;
+    n->ino = ino;
+    n->mode = mode & 0x0FFF;
+    n->mtime = le32(in + 16);
+    n->size = le32(in + 4) | (uint64_t)le32(in + 108) << 32;
+    switch (mode & 0xF000) {
+    case 0x8000: n->type = VFS_FILE; break;
+    case 0x4000: n->type = VFS_DIR;  break;
+    case 0xA000: n->type = VFS_LINK; break;
+    default:     n->type = VFS_OTHER; break;
+    }
+    return n;
+}
+
+static void ext2_release(vfs_node_t *node)
+{
+    kfree(node->priv);
+}
+
+/* ── Block maps ──────────────────────────────────────────────────────── */
+
+static int read_ptr(vfs_fs_t *fs, uint64_t block, uint32_t index,
+                    uint32_t *out)
+{
+    ext2_t *e = fs->priv;
+    uint8_t p[4];
+    if (block >= e->blocks_count ||
+        vfs_dev_read(fs, block * e->block_size + (uint64_t)index * 4, p,
+                     4) != 0)
+        return -1;
+    *out = le32(p);
+    return 0;
+}
+
+static int map_blocks(vfs_node_t *node, uint64_t blk, uint64_t *phys)
+{
+    vfs_fs_t *fs = node->fs;
+    ext2_t *e = fs->priv;
+    ext2_inode_t *ei = node->priv;
+    uint64_t per = e->block_size / 4;
+
+    if (blk < EXT2_NDIR_BLOCKS) {
+        *phys = le32(ei->map + blk * 4);
+        return 0;
+    }
+    /* Which indirect tree, and blk's index within it */
+    blk -= EXT2_NDIR_BLOCKS;
+    int levels = 1;
+    for (uint64_t span = per; blk >= span; span *= per) {
+        blk -= span;
+        if (++levels > 3)
+            return -1;
+    }
+    uint32_t ptr = le32(ei->map + (EXT2_NDIR_BLOCKS + levels - 1) * 4);
+    for (int l = levels - 1; l >= 0 && ptr; l--) {
+        uint64_t span = 1;
+        for (int i = 0; i < l; i++)
+            span *= per;
+        if (read_ptr(fs, ptr, (uint32_t)(blk / span), &ptr) != 0)
+            return -1;
+        blk %= span;
+    }
+    *phys = ptr;
+    return 0;
+}
+
+/* Last of the n 12-byte entries at `at` (after a header) whose first
+ * logical block is <= blk; -1 if there is none */
+static int64_t ext_search(vfs_fs_t *fs, uint64_t at, const uint8_t *local,
+                          uint32_t n, uint64_t blk)
+{
+    int64_t lo = 0, hi = (int64_t)n - 1, found = -1;
+    while (lo <= hi) {
+        int64_t mid = (lo + hi) / 2;
+        uint8_t ent[12];
+        if (local)
+            kmemcpy(ent, local + mid * 12, 4);
+        else if (vfs_dev_read(fs, at + (uint64_t)mid * 12, ent, 4) != 0)
+            return -2;
+        if (le32(ent) <= blk) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+static int map_extents(vfs_node_t *node, uint64_t blk, uint64_t *phys)
+{
+    vfs_fs_t *fs = node->fs;
+    ext2_t *e = fs->priv;
+    ext2_inode_t *ei = node->priv;
+
+    /* The root node lives in the inode; the rest are blocks */
+    const uint8_t *local = ei->map;
+    uint64_t at = 0;
+    uint8_t hdr[12], ent[12];
+    kmemcpy(hdr, ei->map, sizeof(hdr));
+    for (int level = 0; ; level++) {
+        uint16_t n = le16(hdr + 2), depth = le16(hdr + 6);
+        if (le16(hdr) != EXT4_EXT_MAGIC || level > EXT4_EXT_MAX_DEPTH ||
+            n > (local ? 4 : (e->block_size - 12) / 12))
+            return -1;
+        int64_t i = ext_search(fs, at + 12, local ? local + 12 : 0, n, blk);
+        if (i == -2)
+            return -1;
+        if (i < 0) {
+            *phys = 0;
+            return 0;
+        }
+        if (local)
+            kmemcpy(ent, local + 12 + i * 12, 12);
+        else if (vfs_dev_read(fs, at + 12 + (uint64_t)i * 12, ent, 12) != 0)
+            return -1;
+
+        if (depth == 0) {
+            uint32_t first = le32(ent);
+            uint32_t len = le16(ent + 4);
+            uint64_t start = le32(ent + 8) | (uint64_t)le16(ent + 6) << 32;
+            /* Over 32768: an uninitialised extent, which reads as zeroes */
+            *phys = len <= 32768 && blk - first < len ? start + blk - first
+                                                      : 0;
+            return 0;
+        }
+        uint64_t child = le32(ent + 4) | (uint64_t)le16(ent + 8) << 32;
+        if (child >= e->blocks_count)
+            return -1;
+        at = child * e->block_size;
+        local = 0;
+        if (vfs_dev_read(fs, at, hdr, sizeof(hdr)) != 0 ||
+            le16(hdr + 6) != depth - 1)
+            return -1;
+    }
+}
+
+static int ext2_bmap(vfs_node_t *node, uint64_t blk, uint64_t *off)
+{
+    ext2_t *e = node->fs->priv;
+    ext2_inode_t *ei = node->priv;
+    uint64_t phys;
+    int r = (ei->flags & EXT4_EXTENTS_FL) ? map_extents(node, blk, &phys)
+                                          : map_blocks(node, blk, &phys);
+    if (r)
+        return -1;
+    if (!phys)
+        return 1;
+    if (phys >= e->blocks_count)
+        return -1;
+    *off = phys * e->block_size;
+    return 0;
+}
+
+/* ── Directories ─────────────────────────────────────────────────────── */
+
+/* Entry at *cursor (a byte offset into the directory) with its inode.
+ * 1, 0 at the end, -1 on error. */
+static int read_entry(vfs_node_t *dir, uint64_t *cursor, vfs_dirent_t *out,
+                      vfs_node_t **node)
+{
+    vfs_fs_t *fs = dir->fs;
+    ext2_t *e = fs->priv;
+
+    while (*cursor < dir->size) {
+        uint64_t blk = *cursor / e->block_size, off;
+        uint32_t boff = (uint32_t)(*cursor % e->block_size);
+        int r = ext2_bmap(dir, blk, &off);
+        if (r < 0)
+            return -1;
+        if (r) {                        /* hole: skip the block */
+            *cursor = (blk + 1) * e->block_size;
+            continue;
+        }
+
+        uint8_t h[8];
+        if (vfs_dev_read(fs, off + boff, h, sizeof(h)) != 0)
+            return -1;
+        uint32_t ino = le32(h), rec_len = le16(h + 4), name_len = h[6];
+        if (rec_len < 8 + name_len || (rec_len & 3) ||
+            rec_len > e->block_size - boff)
+            return -1;
+        *cursor += rec_len;
+        if (!ino || !name_len)
+            continue;
+
+        if (vfs_dev_read(fs, off + boff + 8, out->name, name_len) != 0)
+            return -1;
+        out->name[name_len] = 0;
+        if ((name_len == 1 && out->name[0] == '.') ||
+            (name_len == 2 && out->name[0] == '.' && out->name[1] == '.'))
+            continue;
+
+        vfs_node_t *n = read_inode(fs, ino);
+        if (!n)
+            return -1;
+        out->ino = ino;
+        out->type = n->type;
+        out->size = n->size;
+        if (node)
+            *node = n;
+        else
+            vfs_node_put(n);
+        return 1;
+    }
+    return 0;
+}
+
+static int ext2_readdir(vfs_node_t *dir, uint64_t *cursor, vfs_dirent_t *out)
+{
+    return read_entry(dir, cursor, out, 0);
+}
+
+static vfs_node_t *ext2_lookup(vfs_node_t *dir, const char *name)
+{
+    vfs_dirent_t d;
+    vfs_node_t *n;
+    uint64_t cursor = 0;
+    while (read_entry(dir, &cursor, &d, &n) == 1) {
+        if (kstrcmp(d.name, name) == 0)
+            return n;
+        vfs_node_put(n);
+    }
+    return 0;
+}
+
+/* ── Mount ───────────────────────────────────────────────────────────── */
+
+static int ext2_mount(vfs_fs_t *fs)
+{
+    uint8_t sb[512];
+    if (fs->size < EXT2_SB_OFF + sizeof(sb) ||
+        vfs_dev_read(fs, EXT2_SB_OFF, sb, sizeof(sb)) != 0 ||
+        le16(sb + 56) != EXT2_MAGIC)
+        return -1;
+
+    ext2_t *e = kzalloc(sizeof(*e));
+    if (!e)
+        return -1;
+    uint32_t log = le32(sb + 24), first = le32(sb + 20);
+    uint32_t per_group = le32(sb + 32);
+    e->incompat = le32(sb + 96);
+    e->inodes_count = le32(sb);
+    e->inodes_per_group = le32(sb + 40);
+    e->inode_size = le32(sb + 76) ? le16(sb + 88) : 128;
+    e->desc_size = (e->incompat & EXT4_INCOMPAT_64BIT) ? le16(sb + 254) : 32;
+    e->blocks_count = le32(sb + 4);
+    if (e->incompat & EXT4_INCOMPAT_64BIT)
+        e->blocks_count |= (uint64_t)le32(sb + 0x150) << 32;
+
+    int ok = log <= 6 && per_group && e->inodes_per_group &&
+             e->inode_size >= 128 && !(e->inode_size & (e->inode_size - 1)) &&
+             e->desc_size >= 32 && !(e->incompat & ~EXT2_INCOMPAT_OK);
+    if (ok) {
+        e->block_size = 1024u << log;
+        e->gdt_off = (uint64_t)(first + 1) * e->block_size;
+        ok = e->inode_size <= e->block_size &&
+             e->blocks_count * e->block_size <= fs->size;
+    }
+    fs->priv = e;
+    if (ok) {
+        fs->block_size = e->block_size;
+        fs->root = read_inode(fs, EXT2_ROOT_INO);
+        ok = fs->root && fs->root->type == VFS_DIR;
+    }
+    if (!ok) {
+        vfs_node_put(fs->root);
+        fs->root = 0;
+        fs->priv = 0;
+        kfree(e);
+        return -1;
+    }
+    return 0;
+}
+
+const vfs_fs_ops_t ext2_ops = {
+    .name    = "ext2",
+    .mount   = ext2_mount,
+    .bmap    = ext2_bmap,
+    .lookup  = ext2_lookup,
+    .readdir = ext2_readdir,
+    .release = ext2_release,
+};
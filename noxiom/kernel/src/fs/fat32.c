@@ -0,0 +1,342 @@
+/* kernel/src/fs/fat32.c — FAT32, read-only
+ *
+ * Enough for the Raspberry Pi boot partition and USB sticks: long file
+ * names (checked against their 8.3 entry's checksum, non-ASCII shown as
+ * '?'), the 8.3 lowercase flags, and lookups that ignore case as FAT
+ * does.  FAT12/16 are not recognised: their fixed-size root directory
+ * has no cluster chain for bmap() to follow.
+ *
+ * bmap() follows the cluster chain from the file's first cluster.  Each
+ * node remembers the last (index, cluster) pair it reached, packed into
+ * one word, so sequential reads advance one FAT entry per cluster
+ * instead of walking the chain from the start every time.
+ */
+#include "vfs.h"
+#include "../string.h"
+#include "../mm/kmalloc.h"
+
+#define FAT_ATTR_VOLUME   0x08
+#define FAT_ATTR_DIR      0x10
+#define FAT_ATTR_LFN      0x0F
+#define FAT_ENTRY_SIZE    32
+#define FAT_MASK          0x0FFFFFFFu
+#define FAT_EOC           0x0FFFFFF8u   /* and above: end of chain        */
+#define FAT_LFN_CHARS     13            /* per long-name entry            */
+#define FAT_LFN_MAX       20            /* entries: 260 characters        */
+
+typedef struct {
+    uint32_t cluster_bytes;
+    uint32_t nclusters;                 /* data clusters, from 2          */
+    uint64_t fat_off;                   /* bytes into the filesystem      */
+    uint64_t data_off;                  /* cluster 2                      */
+} fat_t;
+
+typedef struct {
+    uint32_t first;                     /* cluster; 0 for an empty file   */
+    uint64_t cursor;                    /* index << 32 | cluster, or 0    */
+} fat_node_t;
+
+static inline uint16_t le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static inline uint32_t le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+static inline int valid_cluster(const fat_t *fat, uint32_t c)
+{
+    return c >= 2 && c - 2 < fat->nclusters;
+}
+
+/* ── Cluster chains ──────────────────────────────────────────────────── */
+
+/* Byte offset of the node's cluster `blk`: 0, 1 past the end of the
+ * chain, -1 on a broken chain or read error */
+static int chain_map(vfs_node_t *node, uint64_t blk, uint64_t *off)
+{
+    vfs_fs_t *fs = node->fs;
+    fat_t *fat = fs->priv;
+    fat_node_t *fn = node->priv;
+
+    uint64_t cur = __atomic_load_n(&fn->cursor, __ATOMIC_RELAXED);
+    uint64_t idx = 0;
+    uint32_t c = fn->first;
+    if (cur && (cur >> 32) <= blk) {
+        idx = cur >> 32;
+        c = (uint32_t)cur;
+    }
+    if (!c)
+        return 1;
+    for (; idx < blk; idx++) {
+        uint8_t e[4];
+        if (vfs_dev_read(fs, fat->fat_off + (uint64_t)c * 4, e, 4) != 0)
+            return -1;
+        uint32_t next = le32(e) & FAT_MASK;
+        if (next >= FAT_EOC)
+            return 1;
+        if (!valid_cluster(fat, next))
+            return -1;
+        c = next;
+    }
+    if (!valid_cluster(fat, c))
+        return -1;
+    __atomic_store_n(&fn->cursor, idx << 32 | c, __ATOMIC_RELAXED);
+    *off = fat->data_off + (uint64_t)(c - 2) * fat->cluster_bytes;
+    return 0;
+}
+
+static int fat_bmap(vfs_node_t *node, uint64_t blk, uint64_t *off)
+{
+    /* A file's chain is as long as its size: an early end is damage */
+    return chain_map(node, blk, off) == 0 ? 0 : -1;
+}
+
+/* ── Directories ─────────────────────────────────────────────────────── */
+
+typedef struct {
+    vfs_dirent_t d;
+    uint32_t     attr;
+    uint64_t     mtime;
+} fat_entry_t;
+
+static uint8_t lfn_checksum(const uint8_t *name)
+{
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++)
+        sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + name[i]);
+    return sum;
+}
+
+/* 8.3 name: "README  TXT" -> "README.TXT", or "readme.txt" if the
+ * lowercase flags say so */
+static void short_name(const uint8_t *e, char *out)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < 8 && e[i] != ' '; i++) {
+        char c = (char)(i == 0 && e[0] == 0x05 ? 0xE5 : e[i]);
+        if ((e[12] & 0x08) && c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        out[n++] = c;
+    }
+    if (e[8] != ' ') {
+        out[n++] = '.';
+        for (int i = 8; i < 11 && e[i] != ' '; i++) {
+            char c = (char)e[i];
+            if ((e[12] & 0x10) && c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+            out[n++] = c;
+        }
+    }
+    out[n] = 0;
+}
+
+/* FAT date and time (local time, taken as UTC) to seconds since 1970 */
+static uint64_t fat_time(uint16_t date, uint16_t time)
+{
+    int64_t y = 1980 + (date >> 9), m = (date >> 5) & 0xF, d = date & 0x1F;
+    if (m < 1 || m > 12 || d < 1)
+        return 0;
+    /* Days from 1970-01-01 to y-m-d, proleptic Gregorian */
+    y -= m <= 2;
+    int64_t era = y / 400, yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = era * 146097 + doe - 719468;
+    return (uint64_t)days * 86400 + (uint64_t)(time >> 11) * 3600 +
+           ((time >> 5) & 0x3F) * 60 + (time & 0x1F) * 2;
+}
+
+/* Entry at *cursor (a byte offset into the directory), long name
+ * included.  1, 0 at the end, -1 on error. */
+static int read_entry(vfs_node_t *dir, uint64_t *cursor, fat_entry_t *out)
+{
+    vfs_fs_t *fs = dir->fs;
+    fat_t *fat = fs->priv;
+    uint16_t lfn[FAT_LFN_MAX * FAT_LFN_CHARS + 1];
+    int lfn_seq = 0;                    /* next sequence number expected  */
+    uint8_t lfn_sum = 0;
+    uint32_t lfn_len = 0;
+
+    for (;; *cursor += FAT_ENTRY_SIZE) {
+        uint64_t off;
+        int r = chain_map(dir, *cursor / fat->cluster_bytes, &off);
+        if (r)
+            return r > 0 ? 0 : -1;
+        uint8_t e[FAT_ENTRY_SIZE];
+        if (vfs_dev_read(fs, off + *cursor % fat->cluster_bytes, e,
+                         FAT_ENTRY_SIZE) != 0)
+            return -1;
+        if (e[0] == 0)
+            return 0;
+        if (e[0] == 0xE5) {
+            lfn_seq = 0;
+            lfn_len = 0;
+            continue;
+        }
+
+        if (e[11] == FAT_ATTR_LFN) {
+            int seq = e[0] & 0x1F;
+            if (e[0] & 0x40) {
+                if (seq < 1 || seq > FAT_LFN_MAX) {
+                    lfn_seq = 0;
+                    lfn_len = 0;
+                    continue;
+                }
+                lfn_sum = e[13];
+                lfn_len = (uint32_t)seq * FAT_LFN_CHARS;
+                lfn[lfn_len] = 0;
+            } else if (!lfn_len || seq != lfn_seq || e[13] != lfn_sum) {
+                lfn_seq = 0;
+                lfn_len = 0;
+                continue;
+            }
+            static const uint8_t pos[FAT_LFN_CHARS] =
+                { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+            for (int i = 0; i < FAT_LFN_CHARS; i++)
+                lfn[(seq - 1) * FAT_LFN_CHARS + i] = le16(e + pos[i]);
+            lfn_seq = seq - 1;
+            continue;
+        }
+
+        int have_lfn = lfn_len && lfn_seq == 0 &&
+                       lfn_checksum(e) == lfn_sum;
+        if ((e[11] & FAT_ATTR_VOLUME) || e[0] == '.') {
+            lfn_len = 0;
+            continue;
+        }
+
+        if (have_lfn) {
+            uint32_t n = 0;
+            for (; n < lfn_len && lfn[n] && lfn[n] != 0xFFFF; n++)
+                out->d.name[n] = lfn[n] < 0x80 ? (char)lfn[n] : '?';
+            out->d.name[n] = 0;
+        } else {
+            short_name(e, out->d.name);
+        }
+        out->attr = e[11];
+        out->d.ino = (uint32_t)le16(e + 20) << 16 | le16(e + 26);
+        out->d.type = (e[11] & FAT_ATTR_DIR) ? VFS_DIR : VFS_FILE;
+        out->d.size = out->d.type == VFS_FILE ? le32(e + 28) : 0;
+        out->mtime = fat_time(le16(e + 24), le16(e + 22));
+        *cursor += FAT_ENTRY_SIZE;
+        return 1;
+    }
+}
+
+static int fat_readdir(vfs_node_t *dir, uint64_t *cursor, vfs_dirent_t *out)
+{
+    fat_entry_t e;
+    int r = read_entry(dir, cursor, &e);
+    if (r == 1)
+        *out = e.d;
+    return r;
+}
+
+static vfs_node_t *make_node(vfs_fs_t *fs, uint32_t first, uint32_t type,
+                             uint64_t size, uint64_t mtime)
+{
+    vfs_node_t *n = vfs_node_alloc(fs);
+    fat_node_t *fn = kzalloc(sizeof(*fn));
+    if (!n || !fn) {
+        kfree(n);
+        kfree(fn);
+        return 0;
+    }
+    fn->first = first;
+    n->priv = fn;
+    n->ino = first;
+    n->type = type;
+    n->size = size;
+    n->mtime = mtime;
+    return n;
+}
+
+static int name_eq(const char *a, const char *b)
+{
+    for (;; a++, b++) {
+        char x = *a, y = *b;
+        if (x >= 'A' && x <= 'Z')
+            x += 'a' - 'A';
+        if (y >= 'A' && y <= 'Z')
+            y += 'a' - 'A';
+        if (x != y)
+            return 0;
+        if (!x)
+            return 1;
+    }
+}
+
+static vfs_node_t *fat_lookup(vfs_node_t *dir, const char *name)
+{
+    fat_entry_t e;
+    uint64_t cursor = 0;
+    while (read_entry(dir, &cursor, &e) == 1)
+        if (name_eq(e.d.name, name))
+            return make_node(dir->fs, (uint32_t)e.d.ino, e.d.type,
+                             e.d.size, e.mtime);
+    return 0;
+}
+
+static void fat_release(vfs_node_t *node)
+{
+    kfree(node->priv);
+}
+
+/* ── Mount ───────────────────────────────────────────────────────────── */
+
+static int fat_mount(vfs_fs_t *fs)
+{
+    uint8_t b[512];
+    if (fs->size < sizeof(b) || vfs_dev_read(fs, 0, b, sizeof(b)) != 0)
+        return -1;
+    if (b[510] != 0x55 || b[511] != 0xAA)
+        return -1;
+
+    uint32_t bps = le16(b + 11), spc = b[13], reserved = le16(b + 14);
+    uint32_t nfats = b[16], total = le32(b + 32), fatsz = le32(b + 36);
+    uint32_t root = le32(b + 44);
+    /* A FAT32 BPB: no fixed root directory, no 16-bit FAT size */
+    if (bps < 512 || bps > 4096 || (bps & (bps - 1)) || !spc ||
+        (spc & (spc - 1)) || !reserved || !nfats || nfats > 4 ||
+        le16(b + 17) != 0 || le16(b + 22) != 0 || !fatsz || !total)
+        return -1;
+    uint64_t data = reserved + (uint64_t)nfats * fatsz;
+    if (data >= total || (uint64_t)total * bps > fs->size)
+        return -1;
+
+    fat_t *fat = kzalloc(sizeof(*fat));
+    if (!fat)
+        return -1;
+    fat->cluster_bytes = bps * spc;
+    fat->nclusters = (uint32_t)((total - data) / spc);
+    if (fat->nclusters > (uint64_t)fatsz * bps / 4 - 2)
+        fat->nclusters = (uint32_t)((uint64_t)fatsz * bps / 4 - 2);
+    fat->fat_off = (uint64_t)reserved * bps;
+    fat->data_off = data * bps;
+    if (!valid_cluster(fat, root)) {
+        kfree(fat);
+        return -1;
+    }
+
+    fs->priv = fat;
+    fs->block_size = fat->cluster_bytes;
+    if (!(fs->root = make_node(fs, root, VFS_DIR, 0, 0))) {
+        kfree(fat);
+        fs->priv = 0;
+        return -1;
+    }
+    return 0;
+}
+
+const vfs_fs_ops_t fat32_ops = {
+    .name    = "fat32",
+    .mount   = fat_mount,
+    .bmap    = fat_bmap,
+    .lookup  = fat_lookup,
+    .readdir = fat_readdir,
+    .release = fat_release,
+};
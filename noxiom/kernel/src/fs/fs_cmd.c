@@ -0,0 +1,166 @@
+/* kernel/src/fs/fs_cmd.c — filesystem shell commands
+ *
+ *   mount       mounted filesystems: source, mount point, type and size
+ *   ls          a directory (the mount points without an argument)
+ *   cat         a file, printed; stops at the first NUL byte
+ *   pcache      page cache size, hit rate and readahead accounting
+ *   fsread      sequential read of a whole file through vfs_map(), which
+ *               hands out page cache pages without copying; prints the
+ *               throughput and how much of it readahead had fetched
+ */
+#include "vfs.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../shell/shell.h"
+
+#define CAT_CHUNK  256
+
+static volatile uint64_t s_sink;         /* keeps fsread's loads */
+
+static void cmd_mount(int argc, char **argv) {
+    (void)argc; (void)argv;
+    uint32_t n = vfs_mount_count();
+    if (!n) {
+        hal_display_print("mount: nothing mounted\n");
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        const vfs_fs_t *fs = vfs_mount_get(i);
+        char line[128];
+        ksnprintf(line, sizeof(line), "%-8s on %-10s %-6s %lu MB\n",
+                  fs->source, fs->path, fs->ops->name,
+                  (unsigned long)(fs->size >> 20));
+        hal_display_print(line);
+    }
+}
+
+SHELL_CMD(mount, .fn = cmd_mount, .help = "mounted filesystems");
+
+static void cmd_ls(int argc, char **argv) {
+    if (argc < 2 || kstrcmp(argv[1], "/") == 0) {
+        for (uint32_t i = 0; i < vfs_mount_count(); i++) {
+            hal_display_print(vfs_mount_get(i)->path);
+            hal_display_print("/\n");
+        }
+        return;
+    }
+    vfs_node_t *dir = vfs_lookup(argv[1]);
+    if (!dir) {
+        hal_display_print("ls: no such file or directory\n");
+        return;
+    }
+    if (dir->type != VFS_DIR) {
+        char line[96];
+        ksnprintf(line, sizeof(line), "%10lu  %s\n",
+                  (unsigned long)dir->size, argv[1]);
+        hal_display_print(line);
+        vfs_node_put(dir);
+        return;
+    }
+
+    vfs_dirent_t d;
+    uint64_t cursor = 0;
+    int r;
+    while ((r = vfs_readdir(dir, &cursor, &d)) == 1) {
+        char line[VFS_NAME_LEN + 32];
+        if (d.type == VFS_DIR)
+            ksnprintf(line, sizeof(line), "%10s  %s/\n", "", d.name);
+        else
+            ksnprintf(line, sizeof(line), "%10lu  %s%s\n",
+                      (unsigned long)d.size, d.name,
+                      d.type == VFS_LINK ? "@" : "");
+        hal_display_print(line);
+    }
+    if (r < 0)
+        hal_display_print("ls: read error\n");
+    vfs_node_put(dir);
+}
+
+SHELL_CMD(ls, .fn = cmd_ls, .args = "[path]", .help = "list a directory");
+
+static void cmd_cat(int argc, char **argv) {
+    vfs_file_t f;
+    if (argc < 2 || vfs_open(&f, argv[1]) != 0) {
+        hal_display_print("cat: no such file\n");
+        return;
+    }
+    char buf[CAT_CHUNK + 1];
+    uint64_t off = 0;
+    for (;;) {
+        int64_t n = vfs_read(&f, off, buf, CAT_CHUNK);
+        if (n < 0)
+            hal_display_print("\ncat: read error\n");
+        if (n <= 0)
+            break;
+        buf[n] = 0;
+        hal_display_print(buf);
+        if (kstrlen(buf) < (uint64_t)n)
+            break;
+        off += (uint64_t)n;
+    }
+    vfs_close(&f);
+}
+
+SHELL_CMD(cat, .fn = cmd_cat, .args = "<path>", .help = "print a file");
+
+static void cmd_pcache(int argc, char **argv) {
+    (void)argc; (void)argv;
+    pcache_stats_t s;
+    pcache_stats(&s);
+    char line[128];
+    ksnprintf(line, sizeof(line), "%lu pages cached (%lu KB), %lu evicted\n",
+              (unsigned long)s.pages, (unsigned long)(s.pages * 4),
+              (unsigned long)s.evicted);
+    hal_display_print(line);
+    ksnprintf(line, sizeof(line), "hits %lu  misses %lu  hit rate",
+              (unsigned long)s.hits, (unsigned long)s.misses);
+    hal_display_print(line);
+    shell_print_rate(s.hits * 100, s.hits + s.misses, 7);
+    ksnprintf(line, sizeof(line),
+              "%%\nreadahead %lu pages, %lu used  read errors %lu\n",
+              (unsigned long)s.prefetched, (unsigned long)s.prefetch_hits,
+              (unsigned long)s.errors);
+    hal_display_print(line);
+}
+
+SHELL_CMD(pcache, .fn = cmd_pcache, .help = "page cache statistics");
+
+static void cmd_fsread(int argc, char **argv) {
+    vfs_file_t f;
+    if (argc < 2 || vfs_open(&f, argv[1]) != 0) {
+        hal_display_print("fsread: no such file\n");
+        return;
+    }
+    pcache_stats_t before, after;
+    pcache_stats(&before);
+
+    uint64_t start = hal_timer_now_ns(), off = 0, sum = 0;
+    int r;
+    vfs_view_t v;
+    while ((r = vfs_map(&f, off, &v)) > 0) {
+        /* Touch the data so the read is real */
+        for (uint32_t i = 0; i < v.len; i += 64)
+            sum += v.data[i];
+        vfs_unmap(&v);
+        off += (uint64_t)r;
+    }
+    uint64_t ns = hal_timer_now_ns() - start;
+    s_sink = sum;
+    vfs_close(&f);
+    pcache_stats(&after);
+
+    char line[160];
+    uint64_t kb = off / 1024;
+    ksnprintf(line, sizeof(line),
+              "%lu KB in %lu ms, %lu KB/s, %lu pages read ahead, "
+              "%lu misses%s\n",
+              (unsigned long)kb, (unsigned long)(ns / 1000000),
+              (unsigned long)(ns ? kb * 1000000000ULL / ns : 0),
+              (unsigned long)(after.prefetched - before.prefetched),
+              (unsigned long)(after.misses - before.misses),
+              r < 0 ? ", read error" : "");
+    hal_display_print(line);
+}
+
+SHELL_CMD(fsread, .fn = cmd_fsread, .args = "<path>",
+          .help = "sequential zero-copy read of a file");
@@ -0,0 +1,342 @@
+/* kernel/src/fs/pcache.c — page cache: lookup, reads, clock eviction
+ *
+ * One lock covers the hash chains, the clock ring, every page's refs,
+ * flags and waiter list, and the statistics.  It is never held across
+ * an allocation or a blk_submit() (which allocates a request): the
+ * frame allocator may call back into pcache_shrink() from either, and
+ * that takes the lock.  For the same reason eviction never kfree()s —
+ * the allocator may be calling from inside kmalloc() — and page
+ * descriptors of evicted pages go on a spare list for reuse instead.
+ *
+ * A thread waiting for a read links a pcache_wait_t on its own stack into
+ * the page; the completion sets `done` and wakes it.  A page whose read
+ * failed stays cached with PG_ERROR and the next pcache_get() reads it
+ * again.
+ */
+#include "pcache.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../sched/sched.h"
+#include "../mm/kmalloc.h"
+#include "../log/klog.h"
+
+#define PCACHE_HASH_SIZE  (1u << PCACHE_HASH_ORDER)
+
+struct pcache_wait {
+    pcache_wait_t *next;
+    thread_t      *thread;
+    int            done;
+};
+
+static spinlock_t      s_lock = SPINLOCK_INIT;
+static pcache_page_t  *s_hash[PCACHE_HASH_SIZE];
+static pcache_page_t  *s_hand;              /* clock hand; 0: cache empty  */
+static pcache_page_t  *s_spare;             /* descriptors, via hnext      */
+static pcache_stats_t  s_stats;
+
+static inline uint32_t hash(const blkdev_t *dev, uint64_t index)
+{
+    uint64_t h = (index ^ ((uintptr_t)dev >> 6)) * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(h >> (64 - PCACHE_HASH_ORDER));
+}
+
+static inline uint64_t dev_pages(const blkdev_t *dev)
+{
+    return (dev->nsectors + PCACHE_SECTORS - 1) / PCACHE_SECTORS;
+}
+
+/* ── Hash and clock ring (s_lock held) ───────────────────────────────── */
+
+static pcache_page_t *lookup(const blkdev_t *dev, uint64_t index)
+{
+    for (pcache_page_t *pg = s_hash[hash(dev, index)]; pg; pg = pg->hnext)
+        if (pg->dev == dev && pg->index == index)
+            return pg;
+    return 0;
+}
+
+/* Hashed in, and onto the ring just behind the hand: the last page the
+ * clock will look at */
+static void insert(pcache_page_t *pg, blkdev_t *dev, uint64_t index)
+{
+    uint32_t h = hash(dev, index);
+    pg->dev = dev;
+    pg->index = index;
+    pg->refs = 0;
+    pg->flags = 0;
+    pg->waiters = 0;
+    pg->hnext = s_hash[h];
+    s_hash[h] = pg;
+    if (!s_hand) {
+        pg->cnext = pg->cprev = pg;
+        s_hand = pg;
+    } else {
+        pg->cnext = s_hand;
+        pg->cprev = s_hand->cprev;
+        pg->cprev->cnext = pg;
+        s_hand->cprev = pg;
+    }
+    s_stats.pages++;
+}
+
+static void unlink(pcache_page_t *pg)
+{
+    pcache_page_t **pp = &s_hash[hash(pg->dev, pg->index)];
+    while (*pp != pg)
+        pp = &(*pp)->hnext;
+    *pp = pg->hnext;
+    if (pg->cnext == pg) {
+        s_hand = 0;
+    } else {
+        if (s_hand == pg)
+            s_hand = pg->cnext;
+        pg->cprev->cnext = pg->cnext;
+        pg->cnext->cprev = pg->cprev;
+    }
+    s_stats.pages--;
+}
+
+/* ── Allocation and eviction ─────────────────────────────────────────── */
+
+uint64_t pcache_shrink(uint64_t pages)
+{
+    pcache_page_t *victims = 0, *tail = 0;
+    uint64_t n = 0;
+
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    /* Two laps at most: the first may only clear PG_REFERENCED */
+    for (uint64_t steps = 2 * s_stats.pages; n < pages && s_hand && steps;
+         steps--) {
+        pcache_page_t *pg = s_hand;
+        s_hand = pg->cnext;
+        if (pg->refs || (pg->flags & PG_READING))
+            continue;
+        if (pg->flags & PG_REFERENCED) {
+            pg->flags &= ~PG_REFERENCED;
+            continue;
+        }
+        unlink(pg);
+        pg->hnext = victims;
+        victims = pg;
+        if (!tail)
+            tail = pg;
+        n++;
+    }
+    s_stats.evicted += n;
+    spin_unlock_irqrestore(&s_lock, flags);
+
+    if (!n)
+        return 0;
+    for (pcache_page_t *pg = victims; pg; pg = pg->hnext) {
+        pmm_free_page(virt_to_phys(pg->data));
+        pg->data = 0;
+    }
+    flags = spin_lock_irqsave(&s_lock);
+    tail->hnext = s_spare;
+    s_spare = victims;
+    spin_unlock_irqrestore(&s_lock, flags);
+    return n;
+}
+
+static uint64_t reclaim(uint64_t pages)
+{
+    return pcache_shrink(pages);
+}
+
+/* A descriptor with a frame, not yet in the cache.  Once free memory is
+ * low the cache makes room for itself rather than grow further. */
+static pcache_page_t *page_alloc(void)
+{
+    if (pmm_free_bytes() < pmm_total_bytes() / 1000 * PCACHE_LOW_PERMILLE)
+        pcache_shrink(PCACHE_SHRINK_BATCH);
+
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    pcache_page_t *pg = s_spare;
+    if (pg)
+        s_spare = pg->hnext;
+    spin_unlock_irqrestore(&s_lock, flags);
+    if (!pg && !(pg = kzalloc(sizeof(*pg))))
+        return 0;
+
+    uint64_t pa = pmm_alloc_page();
+    if (!pa) {
+        flags = spin_lock_irqsave(&s_lock);
+        pg->hnext = s_spare;
+        s_spare = pg;
+        spin_unlock_irqrestore(&s_lock, flags);
+        return 0;
+    }
+    pg->data = phys_to_virt(pa);
+    return pg;
+}
+
+/* Give back a page that lost the race to be inserted */
+static void page_release(pcache_page_t *pg)
+{
+    pmm_free_page(virt_to_phys(pg->data));
+    pg->data = 0;
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    pg->hnext = s_spare;
+    s_spare = pg;
+    spin_unlock_irqrestore(&s_lock, flags);
+}
+
+/* ── Reads ───────────────────────────────────────────────────────────── */
+
+static void read_done(blk_io_t *io)
+{
+    pcache_page_t *pg = io->priv;
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    pg->flags &= ~PG_READING;
+    if (io->status == BLK_OK) {
+        pg->flags |= PG_UPTODATE;
+    } else {
+        pg->flags |= PG_ERROR;
+        s_stats.errors++;
+    }
+    for (pcache_wait_t *w = pg->waiters, *next; w; w = next) {
+        next = w->next;
+        thread_t *t = w->thread;
+        /* w is on the waiter's stack: gone once it sees done */
+        __atomic_store_n(&w->done, 1, __ATOMIC_RELEASE);
+        thread_wake(t);
+    }
+    pg->waiters = 0;
+    spin_unlock_irqrestore(&s_lock, flags);
+}
+
+/* The last page of a device may be partial: the rest reads as zeroes */
+static void page_read(pcache_page_t *pg, int more)
+{
+    uint64_t first = pg->index * PCACHE_SECTORS;
+    uint64_t left = pg->dev->nsectors - first;
+    uint32_t count = left < PCACHE_SECTORS ? (uint32_t)left : PCACHE_SECTORS;
+    if (count < PCACHE_SECTORS)
+        kmemset(pg->data + count * BLK_SECTOR_SIZE, 0,
+                (PCACHE_SECTORS - count) * BLK_SECTOR_SIZE);
+    pg->io = (blk_io_t){
+        .op = BLK_READ, .sector = first, .count = count, .buf = pg->data,
+        .done = read_done, .priv = pg,
+    };
+    blk_submit(pg->dev, &pg->io, more);
+}
+
+pcache_page_t *pcache_get(blkdev_t *dev, uint64_t index)
+{
+    if (index >= dev_pages(dev))
+        return 0;
+
+    pcache_page_t *pg, *fresh = 0;
+    uint64_t flags;
+    for (;;) {
+        flags = spin_lock_irqsave(&s_lock);
+        if ((pg = lookup(dev, index)) || fresh)
+            break;
+        spin_unlock_irqrestore(&s_lock, flags);
+        if (!(fresh = page_alloc()))
+            return 0;
+    }
+
+    int submit = 0;
+    if (!pg) {
+        pg = fresh;
+        fresh = 0;
+        insert(pg, dev, index);
+        pg->flags = PG_READING;
+        submit = 1;
+        s_stats.misses++;
+    } else {
+        if (pg->flags & PG_READAHEAD) {
+            pg->flags &= ~PG_READAHEAD;
+            s_stats.prefetch_hits++;
+        }
+        if (!(pg->flags & (PG_UPTODATE | PG_READING))) {
+            /* An earlier read failed: try again */
+            pg->flags = (pg->flags & ~PG_ERROR) | PG_READING;
+            submit = 1;
+            s_stats.misses++;
+        } else {
+            s_stats.hits++;
+        }
+    }
+    pg->refs++;
+    pg->flags |= PG_REFERENCED;
+
+    pcache_wait_t w = { 0, thread_current(), 0 };
+    if (pg->flags & PG_READING) {
+        w.next = pg->waiters;
+        pg->waiters = &w;
+    } else {
+        w.done = 1;
+    }
+    spin_unlock_irqrestore(&s_lock, flags);
+
+    if (fresh)
+        page_release(fresh);
+    if (submit)
+        page_read(pg, 0);
+    while (!__atomic_load_n(&w.done, __ATOMIC_ACQUIRE))
+        thread_block();
+
+    if (!(__atomic_load_n(&pg->flags, __ATOMIC_RELAXED) & PG_UPTODATE)) {
+        pcache_put(pg);
+        return 0;
+    }
+    return pg;
+}
+
+void pcache_put(pcache_page_t *pg)
+{
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    pg->refs--;
+    spin_unlock_irqrestore(&s_lock, flags);
+}
+
+void pcache_hold(pcache_page_t *pg)
+{
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    pg->refs++;
+    spin_unlock_irqrestore(&s_lock, flags);
+}
+
+void pcache_prefetch(blkdev_t *dev, uint64_t index, int more)
+{
+    pcache_page_t *pg = 0;
+    if (index < dev_pages(dev)) {
+        uint64_t flags = spin_lock_irqsave(&s_lock);
+        int cached = lookup(dev, index) != 0;
+        spin_unlock_irqrestore(&s_lock, flags);
+
+        if (!cached && (pg = page_alloc())) {
+            flags = spin_lock_irqsave(&s_lock);
+            if (lookup(dev, index)) {
+                spin_unlock_irqrestore(&s_lock, flags);
+                page_release(pg);
+                pg = 0;
+            } else {
+                insert(pg, dev, index);
+                pg->flags = PG_READING | PG_READAHEAD;
+                s_stats.prefetched++;
+                spin_unlock_irqrestore(&s_lock, flags);
+            }
+        }
+    }
+    if (pg)
+        page_read(pg, more);
+    else if (!more)
+        blk_unplug(dev);
+}
+
+void pcache_stats(pcache_stats_t *out)
+{
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    *out = s_stats;
+    spin_unlock_irqrestore(&s_lock, flags);
+}
+
+void pcache_init(void)
+{
+    pmm_set_reclaim(reclaim);
+    klog("[pcache] %u hash chains, evicting below %u%% free",
+         PCACHE_HASH_SIZE, PCACHE_LOW_PERMILLE / 10);
+}
@@ -0,0 +1,82 @@
+#pragma once
+/* fs/pcache.h — page cache for block devices
+ *
+ * One cache for every device and filesystem: pages of PAGE_SIZE keyed
+ * by (device, page index on the device), so a block cached for one
+ * reader — file data, a FAT sector, an inode table — is cached for all.
+ * Filesystems map file offsets to device pages and hand readers
+ * pointers into them; nothing is copied on the way.
+ *
+ * pcache_get() returns a page with a reference, reading it first if it
+ * is not cached (other readers of the same page wait for that read);
+ * pcache_put() drops the reference, pcache_hold() takes another one on
+ * a page the caller already holds.  Pages are read-only: the cache has
+ * no write path yet.
+ *
+ * pcache_prefetch() starts reading a page without waiting or keeping a
+ * reference — readahead.  A run of them with more = 1 reaches the block
+ * layer as one batch, which merges it into few large requests.
+ *
+ * Eviction: a clock over all pages.  A page used since the hand last
+ * passed gets a second chance, pages with references or a read in
+ * flight are skipped.  The frame allocator calls the cache back when it
+ * runs out of frames (pmm_set_reclaim()), and the cache evicts on its
+ * own before growing once free memory is under PCACHE_LOW_PERMILLE of
+ * RAM, so it uses whatever memory nothing else wants.
+ */
+#include <stdint.h>
+#include "../blk/blkdev.h"
+#include "../mm/pmm.h"
+
+#define PCACHE_SECTORS       (PAGE_SIZE / BLK_SECTOR_SIZE)
+#define PCACHE_HASH_ORDER    12          /* 4096 hash chains              */
+#define PCACHE_LOW_PERMILLE  30          /* keep 3 % of RAM free          */
+#define PCACHE_SHRINK_BATCH  64          /* pages evicted per pass        */
+
+/* pcache_page_t.flags */
+#define PG_UPTODATE   0x01
+#define PG_ERROR      0x02
+#define PG_READING    0x04
+#define PG_REFERENCED 0x08              /* used since the clock hand pass */
+#define PG_READAHEAD  0x10              /* prefetched, not used yet       */
+
+typedef struct pcache_wait pcache_wait_t;
+
+typedef struct pcache_page {
+    struct pcache_page *hnext;
+    struct pcache_page *cnext, *cprev;  /* clock ring                     */
+    blkdev_t           *dev;
+    uint64_t            index;          /* device offset / PAGE_SIZE      */
+    uint8_t            *data;           /* PAGE_SIZE bytes                */
+    uint32_t            refs;
+    uint32_t            flags;
+    pcache_wait_t      *waiters;        /* threads waiting for the read   */
+    blk_io_t            io;
+} pcache_page_t;
+
+typedef struct {
+    uint64_t pages;                     /* cached now                     */
+    uint64_t hits, misses;
+    uint64_t prefetched;                /* pages read ahead               */
+    uint64_t prefetch_hits;             /* ... that were used later       */
+    uint64_t evicted;
+    uint64_t errors;
+} pcache_stats_t;
+
+/* Set up the hash table and register with the frame allocator */
+void pcache_init(void);
+
+/* Page `index` of dev, read if needed (thread context, may block).
+ * Returns a referenced page, or 0 on a read error or out of memory. */
+pcache_page_t *pcache_get(blkdev_t *dev, uint64_t index);
+void           pcache_put(pcache_page_t *pg);
+void           pcache_hold(pcache_page_t *pg);
+
+/* Start reading page `index` unless it is cached.  more != 0: another
+ * prefetch follows; end the run with more = 0 or blk_unplug(). */
+void pcache_prefetch(blkdev_t *dev, uint64_t index, int more);
+
+/* Evict up to `pages` unreferenced pages; returns how many went */
+uint64_t pcache_shrink(uint64_t pages);
+
+void pcache_stats(pcache_stats_t *out);
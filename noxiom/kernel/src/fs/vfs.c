@@ -0,0 +1,429 @@
+/* kernel/src/fs/vfs.c — mount table, path walk, mapping and readahead
+ *
+ * The mount table only grows, and entries are published with a release
+ * store of the count (as the block device table is), so path lookups
+ * take no lock.
+ *
+ * Automount: blk_set_add_handler() may call us from a driver's I/O
+ * thread, which cannot wait for its own disk, so the handler only queues
+ * the device and an "automount" thread does the reading.
+ */
+#include "vfs.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../sched/sched.h"
+#include "../mm/kmalloc.h"
+#include "../log/klog.h"
+
+#define MBR_SIG_OFF     510
+#define MBR_PART_OFF    446
+#define MBR_PARTS       4
+#define MBR_TYPE_GPT    0xEE
+
+static const vfs_fs_ops_t *const s_types[] = { &fat32_ops, &ext2_ops };
+
+static vfs_fs_t  *s_mounts[VFS_MAX_MOUNTS];
+static uint32_t   s_nmounts;
+static spinlock_t s_mounts_lock = SPINLOCK_INIT;
+
+/* What holes map to */
+static const uint8_t s_zero_page[PAGE_SIZE] __attribute__((aligned(4096)));
+
+/* ── Nodes and metadata ──────────────────────────────────────────────── */
+
+vfs_node_t *vfs_node_alloc(vfs_fs_t *fs)
+{
+    vfs_node_t *n = kzalloc(sizeof(*n));
+    if (n) {
+        n->fs = fs;
+        n->refs = 1;
+    }
+    return n;
+}
+
+void vfs_node_put(vfs_node_t *node)
+{
+    if (!node || __atomic_sub_fetch(&node->refs, 1, __ATOMIC_ACQ_REL))
+        return;
+    node->fs->ops->release(node);
+    kfree(node);
+}
+
+int vfs_dev_read(vfs_fs_t *fs, uint64_t off, void *buf, uint32_t len)
+{
+    if (off > fs->size || len > fs->size - off)
+        return -1;
+    uint8_t *out = buf;
+    uint64_t pos = fs->start + off;
+    while (len) {
+        uint32_t po = (uint32_t)(pos % PAGE_SIZE);
+        uint32_t n = (uint32_t)PAGE_SIZE - po;
+        if (n > len)
+            n = len;
+        pcache_page_t *pg = pcache_get(fs->dev, pos / PAGE_SIZE);
+        if (!pg)
+            return -1;
+        kmemcpy(out, pg->data + po, n);
+        pcache_put(pg);
+        out += n;
+        pos += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* ── Mount table ─────────────────────────────────────────────────────── */
+
+int vfs_mount(blkdev_t *dev, uint64_t start, uint64_t size,
+              const char *path, const char *source)
+{
+    vfs_fs_t *fs = kzalloc(sizeof(*fs));
+    if (!fs)
+        return -1;
+    fs->dev = dev;
+    fs->start = start;
+    fs->size = size;
+    kstrncpy(fs->path, path, VFS_PATH_LEN - 1);
+    kstrncpy(fs->source, source, VFS_PATH_LEN - 1);
+
+    for (uint32_t i = 0; i < sizeof(s_types) / sizeof(s_types[0]); i++) {
+        fs->ops = s_types[i];
+        if (fs->ops->mount(fs) != 0)
+            continue;
+
+        uint64_t flags = spin_lock_irqsave(&s_mounts_lock);
+        uint32_t n = s_nmounts;
+        if (n < VFS_MAX_MOUNTS) {
+            s_mounts[n] = fs;
+            __atomic_store_n(&s_nmounts, n + 1, __ATOMIC_RELEASE);
+        }
+        spin_unlock_irqrestore(&s_mounts_lock, flags);
+        if (n == VFS_MAX_MOUNTS) {
+            klog("[vfs] %s: mount table full", path);
+            break;
+        }
+        klog("[vfs] %s on %s: %s, %lu MB, %u-byte blocks", source, path,
+             fs->ops->name, (unsigned long)(size >> 20), fs->block_size);
+        return 0;
+    }
+    if (fs->root)
+        vfs_node_put(fs->root);
+    kfree(fs->priv);
+    kfree(fs);
+    return -1;
+}
+
+uint32_t vfs_mount_count(void)
+{
+    return __atomic_load_n(&s_nmounts, __ATOMIC_ACQUIRE);
+}
+
+const vfs_fs_t *vfs_mount_get(uint32_t index)
+{
+    return index < vfs_mount_count() ? s_mounts[index] : 0;
+}
+
+/* ── Path lookup ─────────────────────────────────────────────────────── */
+
+/* The mount point that is the longest prefix of path; *rest is set to
+ * what follows it */
+static vfs_fs_t *find_mount(const char *path, const char **rest)
+{
+    vfs_fs_t *best = 0;
+    uint32_t best_len = 0, n = vfs_mount_count();
+    for (uint32_t i = 0; i < n; i++) {
+        vfs_fs_t *fs = s_mounts[i];
+        uint32_t len = kstrlen(fs->path);
+        if (len == 1)                   /* "/" */
+            len = 0;
+        if (kstrncmp(path, fs->path, len) != 0 ||
+            (path[len] != '/' && path[len] != 0))
+            continue;
+        if (!best || len > best_len) {
+            best = fs;
+            best_len = len;
+        }
+    }
+    *rest = path + best_len;
+    return best;
+}
+
+vfs_node_t *vfs_lookup(const char *path)
+{
+    const char *p;
+    vfs_fs_t *fs = find_mount(path, &p);
+    if (!fs)
+        return 0;
+
+    vfs_node_t *node = fs->root;
+    __atomic_add_fetch(&node->refs, 1, __ATOMIC_RELAXED);
+    char name[VFS_NAME_LEN];
+    while (node) {
+        while (*p == '/')
+            p++;
+        if (!*p)
+            break;
+        uint32_t len = 0;
+        while (p[len] && p[len] != '/')
+            len++;
+        if (len >= VFS_NAME_LEN || node->type != VFS_DIR) {
+            vfs_node_put(node);
+            return 0;
+        }
+        kmemcpy(name, p, len);
+        name[len] = 0;
+        p += len;
+
+        vfs_node_t *next = fs->ops->lookup(node, name);
+        vfs_node_put(node);
+        node = next;
+    }
+    return node;
+}
+
+int vfs_readdir(vfs_node_t *dir, uint64_t *cursor, vfs_dirent_t *out)
+{
+    if (dir->type != VFS_DIR)
+        return -1;
+    return dir->fs->ops->readdir(dir, cursor, out);
+}
+
+/* ── Files and readahead ─────────────────────────────────────────────── */
+
+int vfs_open(vfs_file_t *f, const char *path)
+{
+    vfs_node_t *node = vfs_lookup(path);
+    if (node && node->type != VFS_FILE) {
+        vfs_node_put(node);
+        node = 0;
+    }
+    *f = (vfs_file_t){ .node = node, .ra_last = ~0ULL };
+    return node ? 0 : -1;
+}
+
+void vfs_close(vfs_file_t *f)
+{
+    vfs_node_put(f->node);
+    f->node = 0;
+}
+
+void vfs_dup(vfs_file_t *dst, const vfs_file_t *src)
+{
+    __atomic_add_fetch(&src->node->refs, 1, __ATOMIC_RELAXED);
+    *dst = (vfs_file_t){ .node = src->node, .ra_last = ~0ULL };
+}
+
+/* Prefetch the device pages behind file pages [first, end).  A device
+ * page shared by consecutive blocks is only asked for once. */
+static void prefetch(vfs_node_t *node, uint64_t first, uint64_t end)
+{
+    vfs_fs_t *fs = node->fs;
+    uint64_t from = first * PAGE_SIZE, to = end * PAGE_SIZE;
+    if (to > node->size)
+        to = node->size;
+    uint64_t last = ~0ULL;
+    int any = 0;
+
+    for (uint64_t pos = from; pos < to; ) {
+        uint64_t blk = pos / fs->block_size;
+        uint64_t boff = pos % fs->block_size;
+        uint64_t n = fs->block_size - boff, off;
+        if (n > to - pos)
+            n = to - pos;
+        if (fs->ops->bmap(node, blk, &off) == 0) {
+            uint64_t a = fs->start + off + boff;
+            for (uint64_t pg = a / PAGE_SIZE; pg <= (a + n - 1) / PAGE_SIZE;
+                 pg++) {
+                if (pg == last)
+                    continue;
+                pcache_prefetch(fs->dev, pg, 1);
+                last = pg;
+                any = 1;
+            }
+        }
+        pos += n;
+    }
+    if (any)
+        blk_unplug(fs->dev);
+}
+
+static void readahead(vfs_file_t *f, uint64_t page)
+{
+    if (page == f->ra_last)
+        return;
+    if (page == f->ra_last + 1) {
+        uint32_t w = f->ra_window ? f->ra_window * 2 : VFS_RA_MIN;
+        f->ra_window = w > VFS_RA_MAX ? VFS_RA_MAX : w;
+    } else {
+        f->ra_window = 0;
+        f->ra_end = page + 1;
+    }
+    f->ra_last = page;
+    if (!f->ra_window)
+        return;
+
+    uint64_t ahead = f->ra_end > page + 1 ? f->ra_end - (page + 1) : 0;
+    if (ahead >= f->ra_window / 2)
+        return;
+    uint64_t first = page + 1 + ahead, end = page + 1 + f->ra_window;
+    uint64_t last_page = (f->node->size + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (end > last_page)
+        end = last_page;
+    if (first < end)
+        prefetch(f->node, first, end);
+    f->ra_end = end;
+}
+
+int vfs_map(vfs_file_t *f, uint64_t off, vfs_view_t *v)
+{
+    vfs_node_t *node = f->node;
+    vfs_fs_t *fs = node->fs;
+    if (off >= node->size)
+        return 0;
+
+    uint64_t boff = off % fs->block_size, dev_off;
+    int r = fs->ops->bmap(node, off / fs->block_size, &dev_off);
+    if (r < 0)
+        return -1;
+    readahead(f, off / PAGE_SIZE);
+
+    uint64_t avail = fs->block_size - boff;
+    if (avail > node->size - off)
+        avail = node->size - off;
+    uint64_t pos = r ? off : fs->start + dev_off + boff;
+    uint32_t po = (uint32_t)(pos % PAGE_SIZE);
+    if (avail > PAGE_SIZE - po)
+        avail = PAGE_SIZE - po;
+
+    if (r) {
+        v->pg = 0;
+        v->data = s_zero_page + po;
+    } else {
+        if (!(v->pg = pcache_get(fs->dev, pos / PAGE_SIZE)))
+            return -1;
+        v->data = v->pg->data + po;
+    }
+    v->len = (uint32_t)avail;
+    return (int)avail;
+}
+
+void vfs_unmap(vfs_view_t *v)
+{
+    if (v->pg)
+        pcache_put(v->pg);
+    v->pg = 0;
+}
+
+int64_t vfs_read(vfs_file_t *f, uint64_t off, void *buf, uint64_t len)
+{
+    uint8_t *out = buf;
+    uint64_t done = 0;
+    while (done < len) {
+        vfs_view_t v;
+        int r = vfs_map(f, off + done, &v);
+        if (r < 0)
+            return done ? (int64_t)done : -1;
+        if (r == 0)
+            break;
+        uint64_t n = (uint64_t)r < len - done ? (uint64_t)r : len - done;
+        kmemcpy(out + done, v.data, n);
+        vfs_unmap(&v);
+        done += n;
+    }
+    return (int64_t)done;
+}
+
+/* ── Automount ───────────────────────────────────────────────────────── */
+
+static blkdev_t  *s_added[BLKDEV_MAX];
+static uint32_t   s_nadded, s_nmounted;
+static spinlock_t s_added_lock = SPINLOCK_INIT;
+static thread_t  *s_automount;
+
+static void scan_mbr(blkdev_t *dev)
+{
+    pcache_page_t *pg = pcache_get(dev, 0);
+    if (!pg)
+        return;
+    const uint8_t *s = pg->data;
+    if (s[MBR_SIG_OFF] != 0x55 || s[MBR_SIG_OFF + 1] != 0xAA) {
+        pcache_put(pg);
+        klog("[vfs] %s: no filesystem or partition table", dev->name);
+        return;
+    }
+
+    uint64_t start[MBR_PARTS] = { 0 }, count[MBR_PARTS] = { 0 };
+    int gpt = 0;
+    for (uint32_t i = 0; i < MBR_PARTS; i++) {
+        const uint8_t *e = s + MBR_PART_OFF + 16 * i;
+        if (e[4] == MBR_TYPE_GPT)
+            gpt = 1;
+        /* Empty, GPT-protective and extended entries are not mounted */
+        if (e[4] == 0 || e[4] == MBR_TYPE_GPT || e[4] == 0x05 ||
+            e[4] == 0x0F || e[4] == 0x85)
+            continue;
+        start[i] = (uint32_t)e[8] | (uint32_t)e[9] << 8 |
+                   (uint32_t)e[10] << 16 | (uint32_t)e[11] << 24;
+        count[i] = (uint32_t)e[12] | (uint32_t)e[13] << 8 |
+                   (uint32_t)e[14] << 16 | (uint32_t)e[15] << 24;
+    }
+    pcache_put(pg);
+    if (gpt)
+        klog("[vfs] %s: GPT partition table, not supported", dev->name);
+
+    for (uint32_t i = 0; i < MBR_PARTS; i++) {
+        if (!count[i] || start[i] + count[i] > dev->nsectors)
+            continue;
+        char name[VFS_PATH_LEN], path[VFS_PATH_LEN];
+        ksnprintf(name, sizeof(name), "%sp%u", dev->name, i + 1);
+        ksnprintf(path, sizeof(path), "/%s", name);
+        if (vfs_mount(dev, start[i] * BLK_SECTOR_SIZE,
+                      count[i] * BLK_SECTOR_SIZE, path, name) != 0)
+            klog("[vfs] %s: no filesystem recognised", name);
+    }
+}
+
+static void automount(blkdev_t *dev)
+{
+    char path[VFS_PATH_LEN];
+    ksnprintf(path, sizeof(path), "/%s", dev->name);
+    if (vfs_mount(dev, 0, dev->nsectors * BLK_SECTOR_SIZE, path,
+                  dev->name) != 0)
+        scan_mbr(dev);
+}
+
+static void automount_thread(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        blkdev_t *dev = 0;
+        uint64_t flags = spin_lock_irqsave(&s_added_lock);
+        if (s_nmounted < s_nadded)
+            dev = s_added[s_nmounted++];
+        spin_unlock_irqrestore(&s_added_lock, flags);
+        if (dev)
+            automount(dev);
+        else
+            thread_block();
+    }
+}
+
+static void blk_added(blkdev_t *dev)
+{
+    uint64_t flags = spin_lock_irqsave(&s_added_lock);
+    if (s_nadded < BLKDEV_MAX)
+        s_added[s_nadded++] = dev;
+    spin_unlock_irqrestore(&s_added_lock, flags);
+    thread_wake(s_automount);
+}
+
+void vfs_init(void)
+{
+    pcache_init();
+    s_automount = thread_create("automount", automount_thread, 0);
+    if (!s_automount) {
+        klog("[vfs] cannot start the automount thread");
+        return;
+    }
+    blk_set_add_handler(blk_added);
+}
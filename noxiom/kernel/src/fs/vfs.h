@@ -0,0 +1,143 @@
+#pragma once
+/* fs/vfs.h — mounted filesystems, path lookup and zero-copy file reads
+ *
+ * Block devices are mounted as they appear: the whole device at /blk0
+ * when it holds a filesystem, else each MBR partition at /blk0p1,
+ * /blk0p2, ...  Everything is read-only.
+ *
+ * Filesystem drivers only describe their on-disk layout: mount() reads
+ * the superblock, lookup() and readdir() walk directories, and bmap()
+ * says where a file's block `blk` lives on the device.  File data never
+ * goes through the driver — vfs_map() looks the block up with bmap()
+ * and returns a pointer straight into the page cache, so a reader sees
+ * the cached page itself, with no copy.  vfs_read() is the copying
+ * wrapper for callers that want one.
+ *
+ * Readahead is per open file (vfs_file_t).  Each access one page past
+ * the previous one doubles the file's window, from VFS_RA_MIN up to
+ * VFS_RA_MAX pages; any other access is taken as random and turns it off
+ * until reads are sequential again.  Once less than half a window has
+ * been requested ahead of the reader, the next window's blocks are
+ * mapped and prefetched as one batch, which the block layer merges into
+ * large requests wherever the file is contiguous on disk.
+ *
+ * Nodes are reference counted; each lookup returns a new one.  Lookups
+ * and reads are for threads (they wait for the disk).
+ */
+#include <stdint.h>
+#include "pcache.h"
+
+#define VFS_MAX_MOUNTS  8
+#define VFS_PATH_LEN    32              /* mount point, with the NUL      */
+#define VFS_NAME_LEN    256             /* a path component, with the NUL */
+#define VFS_RA_MIN      4               /* readahead window, pages        */
+#define VFS_RA_MAX      64
+
+/* vfs_node_t.type */
+#define VFS_FILE        1
+#define VFS_DIR         2
+#define VFS_LINK        3
+#define VFS_OTHER       4
+
+typedef struct vfs_fs   vfs_fs_t;
+typedef struct vfs_node vfs_node_t;
+
+struct vfs_node {
+    vfs_fs_t  *fs;
+    uint64_t   ino;                     /* the driver's, e.g. a cluster   */
+    uint32_t   type;                    /* VFS_*                          */
+    uint32_t   mode;                    /* permission bits, 0 if none     */
+    uint64_t   size;                    /* bytes                          */
+    uint64_t   mtime;                   /* seconds since 1970             */
+    uint32_t   refs;
+    void      *priv;                    /* the driver's                   */
+};
+
+typedef struct {
+    char       name[VFS_NAME_LEN];
+    uint64_t   ino;
+    uint32_t   type;
+    uint64_t   size;                    /* 0 if the driver does not know  */
+} vfs_dirent_t;
+
+typedef struct {
+    const char *name;
+    /* Recognise the filesystem on [fs->start, fs->start + fs->size) and
+     * set block_size, root and priv.  0, or -1 if it is not one. */
+    int  (*mount)(vfs_fs_t *fs);
+    /* Byte offset of file block `blk` from fs->start.  Returns 0, 1 for
+     * a hole (reads as zeroes) or -1 on a corrupt map or read error. */
+    int  (*bmap)(vfs_node_t *node, uint64_t blk, uint64_t *off);
+    /* Entry `name` of dir as a new node (refs 1), 0 if there is none */
+    vfs_node_t *(*lookup)(vfs_node_t *dir, const char *name);
+    /* Entry at *cursor (0 to start), advancing the cursor.  Returns 1,
+     * 0 at the end or -1 on error.  "." and ".." are left out. */
+    int  (*readdir)(vfs_node_t *dir, uint64_t *cursor, vfs_dirent_t *out);
+    /* Free node->priv (may be 0) */
+    void (*release)(vfs_node_t *node);
+} vfs_fs_ops_t;
+
+struct vfs_fs {
+    const vfs_fs_ops_t *ops;
+    blkdev_t           *dev;
+    uint64_t            start;          /* bytes into the device          */
+    uint64_t            size;           /* bytes                          */
+    uint32_t            block_size;     /* bmap() granularity, bytes      */
+    vfs_node_t         *root;
+    void               *priv;
+    char                path[VFS_PATH_LEN];
+    char                source[VFS_PATH_LEN];   /* "blk0p1"               */
+};
+
+typedef struct {
+    vfs_node_t *node;
+    uint64_t    ra_last;                /* file page read last            */
+    uint64_t    ra_end;                 /* prefetched up to here (pages)  */
+    uint32_t    ra_window;              /* pages, 0 while reads are random */
+} vfs_file_t;
+
+/* A piece of a file, mapped */
+typedef struct {
+    const uint8_t *data;
+    uint32_t       len;
+    pcache_page_t *pg;                  /* 0 for a hole                   */
+} vfs_view_t;
+
+/* Mount what is on [start, start + size) of dev at path; -1 if no driver
+ * recognises it or the table is full */
+int             vfs_mount(blkdev_t *dev, uint64_t start, uint64_t size,
+                          const char *path, const char *source);
+uint32_t        vfs_mount_count(void);
+const vfs_fs_t *vfs_mount_get(uint32_t index);
+
+/* Absolute path to a node (refs 1), 0 if it does not exist */
+vfs_node_t *vfs_lookup(const char *path);
+void        vfs_node_put(vfs_node_t *node);
+int         vfs_readdir(vfs_node_t *dir, uint64_t *cursor, vfs_dirent_t *out);
+
+/* 0, or -1 if path does not exist or is not a file */
+int     vfs_open(vfs_file_t *f, const char *path);
+void    vfs_close(vfs_file_t *f);
+/* Open src's file again, with readahead of its own */
+void    vfs_dup(vfs_file_t *dst, const vfs_file_t *src);
+/* Map the bytes from off up to the next page or block boundary.  Returns
+ * v->len (> 0), 0 at the end of the file or -1 on error.  The view stays
+ * valid until vfs_unmap(). */
+int     vfs_map(vfs_file_t *f, uint64_t off, vfs_view_t *v);
+void    vfs_unmap(vfs_view_t *v);
+/* Copy up to len bytes at off; bytes read, or -1 on error */
+int64_t vfs_read(vfs_file_t *f, uint64_t off, void *buf, uint64_t len);
+
+/* For drivers: copy len bytes at fs->start + off through the page cache.
+ * 0, or -1 on a read error or past the end of the filesystem. */
+int vfs_dev_read(vfs_fs_t *fs, uint64_t off, void *buf, uint32_t len);
+/* Node with the fields zeroed and refs 1, 0 if out of memory */
+vfs_node_t *vfs_node_alloc(vfs_fs_t *fs);
+
+/* Start the page cache and mount every block device, present and to come.
+ * After blk_init(). */
+void vfs_init(void);
+
+/* Filesystems */
+extern const vfs_fs_ops_t fat32_ops;
+extern const vfs_fs_ops_t ext2_ops;
@@ -54,24 +54,447 @@ void hal_input_init(void);
 char hal_input_getchar(void);               /* blocks until char available */
 
 /* ── Interrupt controller ─────────────────────────────────────────────── *
- * x86_64: 8259 PIC      arm64: ARM GIC                                   */
+ * x86_64: IOAPIC + LAPIC (x2APIC where supported), the 8259 PIC if the   *
+ *         MADT lists no IOAPIC      arm64: ARM GICv2 or GICv3            *
+ * hal_intc_set_affinity(): deliver irq to that CPU from now on, e.g. to  *
+ *   pin a NIC queue's interrupt next to the thread that drains it.       *
+ *   Returns -1 if irq cannot be routed (per-CPU or unknown) or the CPU   *
+ *   cannot take interrupts.  Unpinned shared IRQs are spread over the    *
+ *   CPUs as they are unmasked, where the controller can route them.     */
 void hal_intc_init(void);
 void hal_intc_unmask(uint32_t irq);
 void hal_intc_send_eoi(uint32_t irq);
+int  hal_intc_set_affinity(uint32_t irq, uint32_t cpu);
+
+/* ── IRQ dispatch (portable, kernel/src/hal_irq.c) ────────────────────── *
+ * IRQ numbers are the controller's: x86_64 ISA IRQs 0-15, other IOAPIC  *
+ * GSIs up to 63 and MSI from 64; arm64 GIC INTIDs (SPIs from 32).        *
+ * hal_irq_register(): route irq to handler(irq, ctx) and unmask it.      *
+ *   The handler runs in hard-IRQ context with IRQs masked, before the    *
+ *   EOI: quiet the device, move the data, hal_softirq_raise() the rest.  *
+ *   Returns -1 if irq is out of range or already has a handler.          *
+ * hal_irq_dispatch(): called by the arch IRQ entry for each device IRQ;  *
+ *   counts it, runs the handler, sends the EOI and, when the outermost   *
+ *   IRQ on this CPU finishes, runs pending softirqs with IRQs enabled.   *
+ * hal_softirq_register(): returns a softirq id, -1 if all are in use.    *
+ * hal_softirq_raise(): mark id pending on this CPU.  Meant for IRQ       *
+ *   handlers; raised from anywhere else it waits for the next device IRQ *
+ *   on this CPU.                                                         *
+ * hal_in_softirq(): 1 while this CPU runs softirqs (no preemption then)  *
+ * hal_irq_count(): interrupts taken on irq since boot, all CPUs;         *
+ *   hal_irq_count(HAL_IRQ_MAX) counts those that had no handler          */
+#define HAL_IRQ_MAX      256
+#define HAL_SOFTIRQ_MAX  16
+
+typedef void (*hal_irq_handler_t)(uint32_t irq, void *ctx);
+typedef void (*hal_softirq_fn_t)(void *ctx);
+
+int      hal_irq_register(uint32_t irq, hal_irq_handler_t handler, void *ctx);
+void     hal_irq_dispatch(uint32_t irq);
+int      hal_softirq_register(hal_softirq_fn_t fn, void *ctx);
+void     hal_softirq_raise(int id);
+int      hal_in_softirq(void);
+uint64_t hal_irq_count(uint32_t irq);
 
 /* ── CPU-level init ───────────────────────────────────────────────────── *
- * x86_64: loads GDT + IDT                                                 *
- * arm64:  sets VBAR_EL1 (done in entry.S before kmain, this is a no-op) */
+ * x86_64: loads GDT + IDT, programs the SYSCALL MSRs, sets up the FPU    *
+ * arm64:  VBAR_EL1 is set in entry.S before kmain; lets EL0 read the     *
+ *         counter and its CPU index (see User mode below), turns the     *
+ *         FP/SIMD unit off (see FP/SIMD below)                           */
 void hal_cpu_init(void);
 
+/* ── CPU identity and interrupt state ─────────────────────────────────── *
+ * hal_cpu_id():      index of the calling CPU, 0 = boot CPU, read from    *
+ *                    its per-CPU area (below)                             *
+ * hal_irq_save():    mask IRQs on this CPU, return the previous state     *
+ * hal_irq_restore(): put back a state returned by hal_irq_save()          *
+ * hal_irq_enable() / hal_irq_disable(): unmask / mask IRQs on this CPU    *
+ * hal_cpu_relax():   spin-wait hint (x86: pause, arm64: yield)            */
+#define HAL_MAX_CPUS 16
+
+uint32_t hal_cpu_id(void);
+uint64_t hal_irq_save(void);
+void     hal_irq_restore(uint64_t flags);
+void     hal_irq_enable(void);
+void     hal_irq_disable(void);
+void     hal_cpu_relax(void);
+
+/* ── Per-CPU area ─────────────────────────────────────────────────────── *
+ * Each CPU keeps a pointer to its own area in a register:                 *
+ *   x86_64: GS_BASE (nothing reloads GS after boot)                       *
+ *   arm64:  TPIDR_EL1                                                     *
+ * The area (smp/percpu.h) starts with a hal_percpu_hdr_t.                 *
+ * hal_percpu_set(): point the calling CPU at `area`; hdr->self and        *
+ *   hdr->cpu must be filled in.  The first thing every CPU does.          *
+ * hal_percpu():     the calling CPU's area.  Unless IRQs are masked the   *
+ *   thread may move to another CPU right after reading it.               */
+typedef struct {
+    void    *self;              /* the area itself (x86_64: %gs:0)       */
+    uint32_t cpu;               /* what hal_cpu_id() returns             */
+    uint64_t kernel_sp;         /* entries from user mode start here     */
+    uint64_t user_sp;           /* x86_64 SYSCALL entry: caller's stack  */
+} hal_percpu_hdr_t;
+
+void              hal_percpu_set(hal_percpu_hdr_t *area);
+hal_percpu_hdr_t *hal_percpu(void);
+
+/* ── Secondary CPUs ───────────────────────────────────────────────────── *
+ * g_hw_info.cpu_cores is the number of CPUs firmware reported, boot CPU  *
+ * included; CPU indices run 0 .. cpu_cores - 1.                          *
+ * hal_cpu_start_secondary(): start CPU `cpu` on `stack_top` (16-byte     *
+ *   aligned) in kernel mode, calling entry(cpu), which must not return.  *
+ *   x86_64: INIT-SIPI-SIPI    arm64: PSCI CPU_ON or spin-table release   *
+ *   Returns 0 once the CPU is running, -1 if it did not come up.         *
+ * hal_cpu_idle(): enable IRQs and sleep until one arrives (hlt / wfi)    */
+typedef void (*hal_cpu_entry_t)(uint32_t cpu);
+
+int  hal_cpu_start_secondary(uint32_t cpu, void *stack_top,
+                             hal_cpu_entry_t entry);
+void hal_cpu_idle(void);
+
+/* Wake `cpu` out of hal_cpu_idle() and run its hal_timer_cpu_init()       *
+ * callback (x86: LAPIC IPI, arm64: GIC SGI 0)                            */
+void hal_cpu_kick(uint32_t cpu);
+
+/* ── Kernel thread context ────────────────────────────────────────────── *
+ * hal_context_init():   lay out a fresh stack so that the first switch   *
+ *   to the returned sp calls entry(arg) with IRQs masked; entry must     *
+ *   never return                                                         *
+ * hal_context_switch(): push callee-saved registers, store sp in         *
+ *   *save_sp, then resume the context saved at new_sp                    */
+void *hal_context_init(void *stack_top, void (*entry)(void *), void *arg);
+void  hal_context_switch(void **save_sp, void *new_sp);
+
+/* ── User mode ────────────────────────────────────────────────────────── *
+ * An address space holds the kernel's mappings — out of user code's      *
+ * reach — plus 4 KB user pages in the range hal_user_range() returns:    *
+ *   x86_64: 0x4000'0000'0000 - 0x7FFF'FFFF'F000, ring 3                  *
+ *   arm64:  0x40'0000'0000 - 0x80'0000'0000, EL0, with its own ASID      *
+ * hal_uspace_create(): a new, empty space; 0 if out of memory (arm64:    *
+ *   also with the MMU off or all 255 ASIDs in use)                       *
+ * hal_uspace_destroy(): free its page tables, not the frames mapped in   *
+ *   it (those are the caller's).  It must not be current on any CPU.     *
+ * hal_uspace_map(): map frame pa at page-aligned va, readable by user    *
+ *   code, plus HAL_UMAP_W / HAL_UMAP_X, replacing any mapping there.     *
+ *   -1 outside the user range or out of memory.  For the space's own     *
+ *   thread, or before it first runs (flushes only the calling CPU's      *
+ *   TLB).  Fill a HAL_UMAP_X page before mapping it: arm64 syncs the     *
+ *   instruction cache here.                                              *
+ * hal_uspace_lookup(): frame mapped at page-aligned va, 0 if none or if  *
+ *   `write` and it is read-only — how the kernel checks user pointers.   *
+ * hal_uspace_switch(): make `as` (0 = kernel only) current on this CPU,  *
+ *   with kstack_top as the stack taken when user code enters the         *
+ *   kernel.  IRQs masked; the scheduler calls it for user threads.       *
+ * hal_user_enter(): drop to user mode at entry on stack sp, with arg0    *
+ *   and arg1 in the first two argument registers (x86_64 rdi, rsi;       *
+ *   arm64 x0, x1) and every other register zeroed.  Never returns: the   *
+ *   thread is back in the kernel only through syscall_dispatch(),        *
+ *   user_page_fault() and user_fault() (user/user.h), called by the      *
+ *   arch entry code.                                                     *
+ *   x86_64: SYSRET, SYSCALL in      arm64: ERET to EL0t, SVC in          *
+ * hal_user_save(): in a system call, the calling thread's user           *
+ *   registers as they will be when it returns, the result register       *
+ *   aside — for fork.  FP/SIMD registers are fpu_snapshot()'s.           *
+ * hal_user_resume(): enter user mode with regs from hal_user_save(), as  *
+ *   a return from that system call with result ret.  Never returns.      *
+ * hal_user_machine(): the ELF e_machine of the programs this CPU runs    *
+ *   (x86_64: 62, EM_X86_64; arm64: 183, EM_AARCH64)                      *
+ * hal_user_clock(): how user code can compute hal_timer_now_ns() on      *
+ *   its own: ns = (counter - base) * mult >> shift, 128-bit product,     *
+ *   for the vDSO page.  The CPU index is readable in user mode too:      *
+ *   HAL_UCLOCK_TSC     RDTSCP, which returns it in ECX (TSC_AUX)         *
+ *   HAL_UCLOCK_CNTVCT  MRS CNTVCT_EL0; the index is in TPIDRRO_EL0       *
+ *   HAL_UCLOCK_NONE    no usable counter: only the syscall               *
+ * hal_user_demo[]: a small position-independent user program, for        *
+ *   tests: entry(n, vdso) writes a line, makes n SYS_GETCPU calls, then  *
+ *   exits with the time as read through the vDSO page (user/abi.h).     */
+#define HAL_UMAP_W          (1u << 0)
+#define HAL_UMAP_X          (1u << 1)
+
+#define HAL_UCLOCK_NONE     0
+#define HAL_UCLOCK_TSC      1
+#define HAL_UCLOCK_CNTVCT   2
+
+#define HAL_USER_REGS       36      /* words; the arch uses what it needs */
+
+typedef struct hal_uspace hal_uspace_t;
+
+typedef struct {
+    uint64_t r[HAL_USER_REGS];
+} hal_user_regs_t;
+
+typedef struct {
+    uint32_t counter;           /* HAL_UCLOCK_*                          */
+    uint32_t shift;             /* 1-32                                  */
+    uint64_t base;              /* counter value at 0 ns                 */
+    uint64_t mult;
+} hal_user_clock_t;
+
+void          hal_user_range(uint64_t *base, uint64_t *end);
+hal_uspace_t *hal_uspace_create(void);
+void          hal_uspace_destroy(hal_uspace_t *as);
+int           hal_uspace_map(hal_uspace_t *as, uint64_t va, uint64_t pa,
+                             uint32_t flags);
+uint64_t      hal_uspace_lookup(hal_uspace_t *as, uint64_t va, int write);
+void          hal_uspace_switch(hal_uspace_t *as, uint64_t kstack_top);
+void          hal_user_enter(uint64_t entry, uint64_t sp, uint64_t arg0,
+                             uint64_t arg1) __attribute__((noreturn));
+void          hal_user_save(hal_user_regs_t *regs);
+void          hal_user_resume(const hal_user_regs_t *regs, uint64_t ret)
+    __attribute__((noreturn));
+uint32_t      hal_user_machine(void);
+void          hal_user_clock(hal_user_clock_t *out);
+
+extern const uint8_t hal_user_demo[], hal_user_demo_end[];
+
+/* ── FP/SIMD ──────────────────────────────────────────────────────────── *
+ * The unit is off on every CPU unless sched/fpu.c has turned it on: the  *
+ * first FP or SIMD instruction of a user thread traps to fpu_trap()      *
+ * (sched/fpu.h), and one run by the kernel outside a kernel_fpu_begin()  *
+ * section is a kernel fault.  The kernel itself is still built without   *
+ * FP registers; SIMD kernels live in the arch code, below.               *
+ *   x86_64: FXSR/SSE always, XSAVE (XSAVEOPT if present) for the state   *
+ *           CPUID leaf 0xD reports: x87, SSE, AVX, AVX-512; off = CR0.TS *
+ *           trapping #NM                                                 *
+ *   arm64:  q0-q31, FPSR, FPCR; off = CPACR_EL1.FPEN trapping EL0 and    *
+ *           EL1 (ESR class 0x07)                                         *
+ * hal_fpu_state_size(): bytes of a saved state, at most PAGE_SIZE; a     *
+ *   buffer is page-aligned                                               *
+ * hal_fpu_init_state(): fill buf with the state a new thread starts in   *
+ * hal_fpu_enable() / hal_fpu_disable(): turn the unit on / off on this   *
+ *   CPU.  IRQs masked, as for everything here.                           *
+ * hal_fpu_save() / hal_fpu_restore(): this CPU's registers to / from     *
+ *   buf, with the unit on                                                *
+ * hal_simd_sum32(): the sum of the native-order 32-bit words at p as a   *
+ *   64-bit value, n bytes, n a multiple of 64.  Inside a section.        */
+uint32_t hal_fpu_state_size(void);
+void     hal_fpu_init_state(void *buf);
+void     hal_fpu_enable(void);
+void     hal_fpu_disable(void);
+void     hal_fpu_save(void *buf);
+void     hal_fpu_restore(const void *buf);
+uint64_t hal_simd_sum32(const void *p, uint64_t n);
+
+/* ── CPU-specific variants ────────────────────────────────────────────── *
+ * A few hot routines have several implementations; the first CPU through *
+ * hal_cpu_init() picks one of each from CPUID / MIDR_EL1 and every CPU   *
+ * then calls through the same table.  Until then the baseline runs,      *
+ * which is correct on any CPU of the arch, MMU off included.             *
+ *   HAL_VAR_MEMCPY  kmemcpy(), and kmemset() on x86_64                   *
+ *   HAL_VAR_MEMZERO kmemzero()                                           *
+ *   HAL_VAR_SUM32   hal_simd_sum32()                                     *
+ *   HAL_VAR_SPIN    hal_spin_wait()                                      *
+ * hal_variant(): the active variant's name, e.g. "movsb"; "?" for an     *
+ *   unknown routine                                                      *
+ * hal_spin_wait(): return once *p == v (acquire), waiting as this CPU    *
+ *   does best: x86_64 pause or umwait, arm64 yield or wfe                */
+typedef enum {
+    HAL_VAR_MEMCPY,
+    HAL_VAR_MEMZERO,
+    HAL_VAR_SUM32,
+    HAL_VAR_SPIN,
+    HAL_VAR_COUNT
+} hal_var_t;
+
+const char *hal_variant(hal_var_t v);
+void        hal_spin_wait(const uint16_t *p, uint16_t v);
+
+/* ── Timer ────────────────────────────────────────────────────────────── *
+ * hal_timer_now_ns(): monotonic clock, ns since early boot, same on all  *
+ *   CPUs.  x86_64: TSC (calibrated against the PIT)                      *
+ *          arm64:  CNTVCT_EL0 scaled by CNTFRQ_EL0                       *
+ * hal_timer_set_deadline(): one-shot interrupt on the calling CPU at     *
+ *   absolute time `ns` (fires at once if it has passed); replaces any    *
+ *   earlier deadline.  HAL_TIMER_NEVER switches the timer off.           *
+ *   x86_64: LAPIC TSC-deadline mode, one-shot count mode without it      *
+ *   arm64:  generic virtual timer compare value, PPI 27 through the GIC  *
+ * hal_timer_cpu_init(): enable the timer interrupt on the calling CPU.   *
+ *   fn() runs in IRQ context after the EOI, both when the deadline       *
+ *   passes and when another CPU calls hal_cpu_kick() — so it may switch  *
+ *   threads.  Returns -1 if this CPU has no usable timer interrupt.      */
+#define HAL_TIMER_NEVER UINT64_MAX
+
+typedef void (*hal_timer_fn_t)(void);
+
+uint64_t hal_timer_now_ns(void);
+void     hal_timer_set_deadline(uint64_t ns);
+int      hal_timer_cpu_init(hal_timer_fn_t fn);
+
+/* ── Cycle counter ────────────────────────────────────────────────────── *
+ * hal_cycles(): free-running cycle count of the calling CPU, for         *
+ *   benchmarks.  Not synchronised between CPUs: take both readings on    *
+ *   one CPU with IRQs masked.                                            *
+ *   x86_64: TSC (constant-rate reference cycles)                         *
+ *   arm64:  PMCCNTR_EL0 (core cycles), CNTVCT_EL0 if there is no PMU     */
+uint64_t hal_cycles(void);
+
+/* ── Boot timestamps ──────────────────────────────────────────────────── *
+ * Boot-phase profile (time/bootstats.c).  One counter from the           *
+ * boot loader on: x86_64 the TSC (stage2 stamps), arm64 CNTVCT.          *
+ * hal_boot_ticks():    counter now, on the boot CPU                      *
+ * hal_boot_ticks_hz(): its rate, 0 until hal_hw_detect() has run         *
+ * hal_boot_early_marks(): phases that ended before kmain(), oldest       *
+ *   first, as (phase, ticks at its end); out[0] is only the origin       *
+ *   x86_64: stage2 entry, disk load, mode switch + unpack                *
+ *   arm64:  LZ4 stub (if any), _start, DTB parse, page tables           */
+typedef struct {
+    const char *phase;
+    uint64_t    ticks;
+} hal_boot_mark_t;
+
+uint64_t hal_boot_ticks(void);
+uint64_t hal_boot_ticks_hz(void);
+uint32_t hal_boot_early_marks(hal_boot_mark_t *out, uint32_t max);
+
+/* ── Performance counters ─────────────────────────────────────────────── *
+ * Hardware event counters of the calling CPU; every call programs this   *
+ * CPU only (prof/perf.c reaches the others through per-CPU timers).      *
+ * hal_pmu_counters():    general-purpose counters, 0 = no usable PMU     *
+ * hal_pmu_has_event():   the HAL_PMU_* event can be counted here         *
+ * hal_pmu_count_start(): count events[0..n) from zero; -1 if n exceeds   *
+ *   the counters or an event is missing                                  *
+ * hal_pmu_count_read():  the counts so far                               *
+ * hal_pmu_sample_start(): interrupt every `period` (< 2^31) events and   *
+ *   call fn(interrupted pc) in IRQ context; -1 without an overflow       *
+ *   interrupt.  Code running with IRQs masked is charged to the point    *
+ *   where it unmasks them.                                               *
+ * hal_pmu_stop():        stop counting or sampling                       *
+ *   x86_64: architectural perfmon (CPUID 0xA, Intel), PMI on a LAPIC     *
+ *           vector                                                       *
+ *   arm64:  PMUv3 event counters (32-bit), overflow PPI from the DTB    */
+#define HAL_PMU_CYCLES        0
+#define HAL_PMU_INSTRUCTIONS  1
+#define HAL_PMU_CACHE_MISSES  2     /* x86: LLC, arm64: L2D refills */
+#define HAL_PMU_BRANCH_MISSES 3
+#define HAL_PMU_EVENTS        4
+
+typedef void (*hal_pmu_sample_fn_t)(uint64_t pc);
+
+uint32_t hal_pmu_counters(void);
+int      hal_pmu_has_event(uint32_t event);
+int      hal_pmu_count_start(const uint32_t *events, uint32_t n);
+void     hal_pmu_count_read(uint64_t *counts, uint32_t n);
+int      hal_pmu_sample_start(uint32_t event, uint64_t period,
+                              hal_pmu_sample_fn_t fn);
+void     hal_pmu_stop(void);
+
+/* ── DMA coherence ────────────────────────────────────────────────────── *
+ * Buffers shared with a bus-master device, by kernel virtual address.    *
+ * hal_dma_sync_for_device(): before the device reads [p, p + len),       *
+ *   push the CPU's writes out (arm64: clean to the point of coherency)   *
+ * hal_dma_sync_for_cpu(): after the device wrote [p, p + len), drop      *
+ *   stale cached copies (arm64: invalidate; partial lines at the ends    *
+ *   are cleaned first).  x86_64 DMA snoops the caches: both are only     *
+ *   memory barriers there.                                               */
+void hal_dma_sync_for_device(const void *p, size_t len);
+void hal_dma_sync_for_cpu(void *p, size_t len);
+
+/* ── Device memory ────────────────────────────────────────────────────── *
+ * hal_mmio_map(): kernel pointer to device registers at [pa, pa + size), *
+ *   mapped uncached; 0 if the range cannot be mapped.  Ranges below 4 GB *
+ *   (x86_64) or inside the 39-bit identity map (arm64) are mapped from   *
+ *   boot; others are added on first use, before any other CPU uses them. */
+void *hal_mmio_map(uint64_t pa, uint64_t size);
+
+/* ── Platform devices ─────────────────────────────────────────────────── *
+ * hal_platform_dev(): the index-th device firmware describes as          *
+ *   compatible with `compat` (outside any bus scan), with its first      *
+ *   register region and interrupt.  Returns -1 if there is none.         *
+ *   x86_64: none, devices sit on PCI                                     *
+ *   arm64:  DTB nodes, e.g. "virtio,mmio"; irq 0 = not a GIC SPI/PPI     */
+typedef struct {
+    uint64_t base;
+    uint64_t size;
+    uint32_t irq;
+} hal_platform_dev_t;
+
+int hal_platform_dev(const char *compat, uint32_t index,
+                     hal_platform_dev_t *out);
+
+/* ── PCI configuration space ──────────────────────────────────────────── *
+ * bdf = bus << 8 | device << 3 | function; off is naturally aligned for  *
+ * size (1, 2 or 4 bytes).  Reads of absent functions return all ones.    *
+ *   x86_64: configuration mechanism #1 (ports 0xCF8 / 0xCFC)             *
+ *   arm64:  none yet, every function reads as absent                     */
+#define HAL_PCI_BDF(bus, dev, fn) \
+    (((uint32_t)(bus) << 8) | ((uint32_t)(dev) << 3) | (uint32_t)(fn))
+
+uint32_t hal_pci_cfg_read(uint32_t bdf, uint32_t off, uint32_t size);
+void     hal_pci_cfg_write(uint32_t bdf, uint32_t off, uint32_t size,
+                           uint32_t val);
+
+/* ── Message-signalled interrupts ─────────────────────────────────────── *
+ * hal_msi_alloc(): reserve an IRQ that a device raises by writing a      *
+ *   message, aimed at `cpu`.  write(ctx, msg) stores the message in the  *
+ *   device (an MSI capability or MSI-X table entry, see pci/pci.h); it   *
+ *   is called before hal_msi_alloc() returns and again whenever          *
+ *   hal_intc_set_affinity() moves the IRQ.  Returns the IRQ, or -1 if    *
+ *   none is left or the controller has no MSI support.                   *
+ *   x86_64: one vector per IRQ, addressed to the CPU's LAPIC             *
+ *   arm64:  not supported yet (no ITS / GICv2m)                          *
+ * hal_msi_free(): give it back; the device must no longer send it.       */
+typedef struct {
+    uint64_t addr;
+    uint32_t data;
+} hal_msi_msg_t;
+
+typedef void (*hal_msi_write_t)(void *ctx, const hal_msi_msg_t *msg);
+
+int  hal_msi_alloc(uint32_t cpu, hal_msi_write_t write, void *ctx);
+void hal_msi_free(uint32_t irq);
+
 /* ── Halt ─────────────────────────────────────────────────────────────── */
 void hal_halt(void) __attribute__((noreturn));
 
+/* ── Physical memory map ─────────────────────────────────────────────── *
+ * x86_64: BIOS E820 map saved by stage2                                   *
+ * arm64:  /memory reg ranges and reservations from the DTB                *
+ * hal_mem_usable():   RAM the kernel may hand out (may overlap reserved)  *
+ * hal_mem_reserved(): firmware, boot data and the kernel image itself     *
+ * Both return the number of regions written to out[].                     */
+#define HAL_MAX_MEM_REGIONS 64
+
+typedef struct {
+    uint64_t base;
+    uint64_t size;
+} hal_mem_region_t;
+
+uint32_t hal_mem_usable(hal_mem_region_t *out, uint32_t max);
+uint32_t hal_mem_reserved(hal_mem_region_t *out, uint32_t max);
+
 /* ── Hardware detection ───────────────────────────────────────────────── *
- * hal_hw_detect(): arch-specific; fills g_hw_info fields                  *
- * hal_hw_score():  portable;     reads g_hw_info, returns tier            */
+ * hal_hw_detect():     arch-specific; fills g_hw_info fields,             *
+ *                      topology and caches as far as the CPU says         *
+ * hal_hw_topo_fixup(): portable; numbers packages and LLCs densely and    *
+ *                      fills in what detection left 0 (hal_hw_info.h)     *
+ * hal_hw_score():      portable; reads g_hw_info, returns tier            */
 void      hal_hw_detect(void);
+void      hal_hw_topo_fixup(void);
 hw_tier_t hal_hw_score(void);
 
-/* Global hardware info — written once at boot, then read-only */
+/* ── Topology and cache queries (portable, on g_hw_info) ──────────────── *
+ * hal_hw_cache_size():  data / unified cache at `level` (0 = the last     *
+ *                       level), bytes per instance; 0 if none known       *
+ * hal_hw_cache_share(): the same divided by the CPUs sharing it           *
+ * hal_hw_cache_line():  L1 data line size, 64 if unknown                  *
+ * hal_hw_cpu_distance(): HW_DIST_* between two CPU indices                */
+#define HW_DIST_SELF     0
+#define HW_DIST_SMT      1          /* threads of one core               */
+#define HW_DIST_LLC      2          /* share the last-level cache        */
+#define HW_DIST_PACKAGE  3          /* same socket / cluster             */
+#define HW_DIST_REMOTE   4
+
+uint32_t hal_hw_cache_size(uint32_t level);
+uint32_t hal_hw_cache_share(uint32_t level);
+uint32_t hal_hw_cache_line(void);
+uint32_t hal_hw_cpu_distance(uint32_t a, uint32_t b);
+
+/* Global hardware info — written at boot between hal_hw_info_lock() and
+ * hal_hw_info_unlock() (a seqlock, hal_hw_detect.c).  Anything that may
+ * run while it is written, or on another CPU, takes a consistent copy
+ * with hal_hw_info_read() instead of reading fields one by one. */
 extern hw_info_t g_hw_info;
+
+void hal_hw_info_lock(void);
+void hal_hw_info_unlock(void);
+void hal_hw_info_read(hw_info_t *out);
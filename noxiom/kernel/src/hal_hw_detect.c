@@ -1,20 +1,206 @@
-/* kernel/src/hal_hw_detect.c — portable tier scoring
+/* kernel/src/hal_hw_detect.c — portable tier scoring and topology
  *
  * hal_hw_detect() is implemented in arch/<arch>/hal_impl.c.
- * This file defines g_hw_info and implements hal_hw_score().
+ * This file defines g_hw_info, the seqlock that guards it, and
+ * implements hal_hw_topo_fixup(), the topology / cache queries and
+ * hal_hw_score().
+ *
+ * The arch code writes raw ids into g_hw_info.cpu[] (x86: fields of the
+ * APIC ID, arm64: cpu-map positions and DTB cache nodes); the fixup
+ * renumbers packages and LLCs 0, 1, … from the boot CPU's on, and
+ * derives the SMT width and any cache sharing left 0.
  */
-#include "hal_hw_info.h"
+#include "hal.h"
+#include "string.h"
+#include "sync/seqlock.h"
+#include "log/klog.h"
+
+_Static_assert(HW_MAX_CPUS == HAL_MAX_CPUS, "hw_info_t.cpu[] is per CPU");
 
 /* Global hardware info — defined here, declared extern in hal.h */
 hw_info_t g_hw_info;
 
+static seqlock_t s_hw_info_lock = SEQLOCK_INIT;
+
+void hal_hw_info_lock(void)
+{
+    seq_write_lock(&s_hw_info_lock);
+}
+
+void hal_hw_info_unlock(void)
+{
+    seq_write_unlock(&s_hw_info_lock);
+}
+
+void hal_hw_info_read(hw_info_t *out)
+{
+    uint32_t s;
+    do {
+        s = seq_read_begin(&s_hw_info_lock);
+        kmemcpy(out, &g_hw_info, sizeof(*out));
+    } while (seq_read_retry(&s_hw_info_lock, s));
+}
+
+/* ── Topology ────────────────────────────────────────────────────────── */
+
+static uint32_t topo_cpus(void)
+{
+    uint32_t n = g_hw_info.cpu_cores;
+    return n == 0 ? 1 : n > HW_MAX_CPUS ? HW_MAX_CPUS : n;
+}
+
+/* Package (llc = 0) or LLC ids → 0, 1, … in order of first appearance;
+ * returns how many there are */
+static uint32_t renumber(hw_cpu_topo_t *cpu, uint32_t n, int llc)
+{
+    uint16_t old[HW_MAX_CPUS];
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint16_t *id = llc ? &cpu[i].llc : &cpu[i].package;
+        uint32_t  j  = 0;
+        while (j < k && old[j] != *id)
+            j++;
+        if (j == k)
+            old[k++] = *id;
+        *id = (uint16_t)j;
+    }
+    return k;
+}
+
+static const char *cache_kind(const hw_cache_t *c)
+{
+    return c->type == CACHE_DATA ? "d" : c->type == CACHE_INST ? "i" : "";
+}
+
+void hal_hw_topo_fixup(void)
+{
+    hw_info_t     *hw  = &g_hw_info;
+    hw_cpu_topo_t *cpu = hw->cpu;
+    uint32_t       n   = topo_cpus();
+
+    /* No two CPUs told apart: every CPU its own core, one package (the
+     * LLC ids may still say something) */
+    int flat = 1;
+    for (uint32_t i = 1; i < n; i++)
+        if (cpu[i].package != cpu[0].package || cpu[i].core != cpu[0].core ||
+            cpu[i].thread != cpu[0].thread)
+            flat = 0;
+    if (flat)
+        for (uint32_t i = 0; i < n; i++)
+            cpu[i] = (hw_cpu_topo_t){ .core = (uint16_t)i, .llc = cpu[i].llc,
+                                      .capacity = cpu[i].capacity };
+
+    hw->packages = renumber(cpu, n, 0);
+    uint32_t llcs = renumber(cpu, n, 1);
+
+    hw->smt = 1;
+    uint32_t llc_cpus = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t siblings = 0;
+        for (uint32_t j = 0; j < n; j++)
+            siblings += cpu[j].package == cpu[i].package &&
+                        cpu[j].core == cpu[i].core;
+        if (siblings > hw->smt)
+            hw->smt = siblings;
+        llc_cpus += cpu[i].llc == cpu[0].llc;
+        if (!cpu[i].capacity)
+            cpu[i].capacity = HW_CAPACITY_MAX;
+    }
+
+    /* Sharing detection could not see: the last level goes by the LLC
+     * ids, anything inside it is taken to be private */
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < hw->cache_count; i++)
+        if (hw->cache[i].level > last)
+            last = hw->cache[i].level;
+    for (uint32_t i = 0; i < hw->cache_count; i++)
+        if (!hw->cache[i].shared)
+            hw->cache[i].shared = hw->cache[i].level == last ? llc_cpus : 1;
+
+    klog("[cpu] %u cpus: %u packages, %u llc, %u threads/core", n,
+         hw->packages, llcs, hw->smt);
+    for (uint32_t i = 0; i < hw->cache_count; i++) {
+        const hw_cache_t *c = &hw->cache[i];
+        klog("[cpu] L%u%s %u KB, %u-way, %u B lines, %u cpus", c->level,
+             cache_kind(c), c->size >> 10, c->ways, c->line, c->shared);
+    }
+    char     buf[6 * HW_MAX_CPUS + 1];
+    uint32_t len = 0, mixed = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        mixed |= cpu[i].capacity != HW_CAPACITY_MAX;
+        len += ksnprintf(buf + len, sizeof(buf) - len, " %u", cpu[i].capacity);
+    }
+    if (mixed)
+        klog("[cpu] capacity:%s", buf);
+}
+
+/* Data or unified cache at `level`, or the outermost one for level 0 */
+static const hw_cache_t *find_cache(uint32_t level)
+{
+    const hw_cache_t *best = 0;
+    for (uint32_t i = 0; i < g_hw_info.cache_count; i++) {
+        const hw_cache_t *c = &g_hw_info.cache[i];
+        if (c->type == CACHE_INST)
+            continue;
+        if (level && c->level == level)
+            return c;
+        if (!level && (!best || c->level > best->level))
+            best = c;
+    }
+    return best;
+}
+
+uint32_t hal_hw_cache_size(uint32_t level)
+{
+    const hw_cache_t *c = find_cache(level);
+    return c ? c->size : 0;
+}
+
+uint32_t hal_hw_cache_share(uint32_t level)
+{
+    const hw_cache_t *c = find_cache(level);
+    return c ? c->size / (c->shared ? c->shared : 1) : 0;
+}
+
+uint32_t hal_hw_cache_line(void)
+{
+    const hw_cache_t *c = find_cache(1);
+    return c && c->line ? c->line : 64;
+}
+
+uint32_t hal_hw_cpu_distance(uint32_t a, uint32_t b)
+{
+    if (a == b)
+        return HW_DIST_SELF;
+    if (a >= HW_MAX_CPUS || b >= HW_MAX_CPUS)
+        return HW_DIST_REMOTE;
+    const hw_cpu_topo_t *x = &g_hw_info.cpu[a], *y = &g_hw_info.cpu[b];
+    if (x->package == y->package && x->core == y->core)
+        return HW_DIST_SMT;
+    if (x->llc == y->llc)
+        return HW_DIST_LLC;
+    if (x->package == y->package)
+        return HW_DIST_PACKAGE;
+    return HW_DIST_REMOTE;
+}
+
+/* ── Tier ────────────────────────────────────────────────────────────── */
+
 hw_tier_t hal_hw_score(void) {
-    uint32_t cores = g_hw_info.cpu_cores;
     uint64_t ram   = g_hw_info.ram_bytes;
 
-    if (cores == 0 || ram == 0)
+    if (g_hw_info.cpu_cores == 0 || ram == 0)
         return TIER_FALLBACK;
 
+    /* Cores by capacity, so a 2+6 big.LITTLE part is not an 8-core one */
+    uint64_t capacity = 0;
+    for (uint32_t i = 0; i < topo_cpus(); i++)
+        capacity += g_hw_info.cpu[i].capacity ? g_hw_info.cpu[i].capacity
+                                              : HW_CAPACITY_MAX;
+    uint32_t cores = (uint32_t)((capacity + HW_CAPACITY_MAX / 2) / HW_CAPACITY_MAX);
+    if (cores == 0)
+        cores = 1;
+
     if (cores >= 4 && ram >= (uint64_t)2 * 1024 * 1024 * 1024)
         return TIER_HIGH;
 
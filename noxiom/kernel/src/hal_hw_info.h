@@ -16,6 +16,40 @@ typedef enum {
     TIER_HIGH     = 3,  /* ≥4 cores AND ≥2 GB RAM                           */
 } hw_tier_t;
 
+/* ── Topology and caches ──────────────────────────────────────────────
+ * Filled by hal_hw_detect() where the hardware says; hal_hw_topo_fixup()
+ * then turns whatever is still 0 into a flat machine (one package, no
+ * SMT, one shared cache, every CPU at full capacity), so readers never
+ * need to check. */
+#define HW_MAX_CPUS      16         /* = HAL_MAX_CPUS                    */
+#define HW_MAX_CACHES    8
+#define HW_CAPACITY_MAX  1024       /* the fastest core                  */
+
+typedef enum {
+    CACHE_NONE    = 0,
+    CACHE_DATA    = 1,
+    CACHE_INST    = 2,
+    CACHE_UNIFIED = 3,
+} hw_cache_type_t;
+
+typedef struct {
+    uint8_t   level;                /* 1 = L1                            */
+    uint8_t   type;                 /* hw_cache_type_t                   */
+    uint16_t  line;                 /* line size, bytes                  */
+    uint32_t  size;                 /* bytes per instance                */
+    uint16_t  ways;                 /* 0 = fully associative / unknown   */
+    uint16_t  shared;               /* logical CPUs per instance         */
+} hw_cache_t;
+
+typedef struct {
+    uint16_t  package;              /* socket (x86) / cluster (arm64)    */
+    uint16_t  core;                 /* core within the package           */
+    uint16_t  thread;               /* SMT thread within the core        */
+    uint16_t  llc;                  /* last-level cache instance         */
+    uint32_t  capacity;             /* relative speed, HW_CAPACITY_MAX = */
+                                    /* the fastest core (big.LITTLE)     */
+} hw_cpu_topo_t;
+
 typedef struct {
     hw_arch_t  arch;
     uint32_t   cpu_cores;       /* logical/physical core count               */
@@ -28,5 +62,13 @@ typedef struct {
     uint64_t   intc_base;       /* GIC CPU interface (arm64: from DTB)       */
     uint64_t   intc_dist_base;  /* GIC distributor (arm64: from DTB)         */
 
+    /* Topology, indexed like CPUs (0 = boot CPU), and the boot CPU's
+     * caches, innermost first */
+    uint32_t      packages;         /* sockets / clusters                */
+    uint32_t      smt;              /* hardware threads per core         */
+    uint32_t      cache_count;
+    hw_cache_t    cache[HW_MAX_CACHES];
+    hw_cpu_topo_t cpu[HW_MAX_CPUS];
+
     hw_tier_t  tier;            /* set by hal_hw_score() after hal_hw_detect */
 } hw_info_t;
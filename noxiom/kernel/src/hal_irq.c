@@ -0,0 +1,151 @@
+/* kernel/src/hal_irq.c — portable IRQ dispatch table and softirqs
+ *
+ * The arch IRQ entry (idt.c irq_handler, arm64_irq_handler) acknowledges
+ * the controller and calls hal_irq_dispatch() with the IRQ number; this
+ * file owns everything after that.  The HAL timer and wake-up IPI are
+ * not device IRQs and keep their own fast paths.
+ *
+ * Table: one cache line per IRQ holding the handler, its context and
+ * the counter, so taking an interrupt touches exactly one line and two
+ * busy IRQs never share one.
+ *
+ * Softirqs: a fixed set of deferred handlers with a pending bit per CPU.
+ * They run at the end of the outermost device IRQ, with IRQs enabled,
+ * for at most SOFTIRQ_ROUNDS passes; work raised beyond that stays
+ * pending until the next interrupt, so a flood cannot pin the CPU in
+ * IRQ context forever.  The scheduler does not preempt a CPU inside
+ * softirqs (hal_in_softirq()), so they never migrate halfway through.
+ */
+#include "hal.h"
+#include "sync/spinlock.h"
+
+#define CACHE_LINE      64
+#define SOFTIRQ_ROUNDS  4
+
+typedef struct {
+    hal_irq_handler_t handler;
+    void             *ctx;
+    uint64_t          count;
+} __attribute__((aligned(CACHE_LINE))) irq_desc_t;
+
+typedef struct {
+    hal_softirq_fn_t fn;
+    void            *ctx;
+} softirq_t;
+
+typedef struct {
+    volatile uint32_t pending;      /* softirq bits, this CPU only      */
+    uint32_t          depth;        /* nested device IRQs               */
+    uint32_t          in_softirq;
+} __attribute__((aligned(CACHE_LINE))) irq_cpu_t;
+
+static irq_desc_t irq_table[HAL_IRQ_MAX];
+static irq_cpu_t  irq_cpu[HAL_MAX_CPUS];
+static softirq_t  softirqs[HAL_SOFTIRQ_MAX];
+static uint32_t   nr_softirqs;
+static uint64_t   unhandled;
+static spinlock_t register_lock = SPINLOCK_INIT;
+
+/* ── Registration ────────────────────────────────────────────────────── */
+
+int hal_irq_register(uint32_t irq, hal_irq_handler_t handler, void *ctx)
+{
+    if (irq >= HAL_IRQ_MAX || !handler)
+        return -1;
+
+    uint64_t flags = spin_lock_irqsave(&register_lock);
+    irq_desc_t *d = &irq_table[irq];
+    if (d->handler) {
+        spin_unlock_irqrestore(&register_lock, flags);
+        return -1;
+    }
+    d->ctx = ctx;
+    __atomic_store_n(&d->handler, handler, __ATOMIC_RELEASE);
+    spin_unlock_irqrestore(&register_lock, flags);
+
+    hal_intc_unmask(irq);
+    return 0;
+}
+
+int hal_softirq_register(hal_softirq_fn_t fn, void *ctx)
+{
+    uint64_t flags = spin_lock_irqsave(&register_lock);
+    int id = -1;
+    if (fn && nr_softirqs < HAL_SOFTIRQ_MAX) {
+        id = (int)nr_softirqs;
+        softirqs[id].fn  = fn;
+        softirqs[id].ctx = ctx;
+        __atomic_store_n(&nr_softirqs, nr_softirqs + 1, __ATOMIC_RELEASE);
+    }
+    spin_unlock_irqrestore(&register_lock, flags);
+    return id;
+}
+
+/* ── Dispatch ────────────────────────────────────────────────────────── */
+
+/* IRQs masked on entry and exit */
+static void run_softirqs(irq_cpu_t *c)
+{
+    c->in_softirq = 1;
+    for (int round = 0; round < SOFTIRQ_ROUNDS && c->pending; round++) {
+        uint32_t pending = c->pending;
+        c->pending = 0;
+
+        hal_irq_enable();
+        while (pending) {
+            int id = __builtin_ctz(pending);
+            pending &= pending - 1;
+            softirqs[id].fn(softirqs[id].ctx);
+        }
+        hal_irq_disable();
+    }
+    c->in_softirq = 0;
+}
+
+void hal_irq_dispatch(uint32_t irq)
+{
+    irq_cpu_t *c = &irq_cpu[hal_cpu_id()];
+    c->depth++;
+
+    irq_desc_t *d = irq < HAL_IRQ_MAX ? &irq_table[irq] : 0;
+    hal_irq_handler_t handler =
+        d ? __atomic_load_n(&d->handler, __ATOMIC_ACQUIRE) : 0;
+    if (handler) {
+        __atomic_fetch_add(&d->count, 1, __ATOMIC_RELAXED);
+        handler(irq, d->ctx);
+    } else {
+        __atomic_fetch_add(&unhandled, 1, __ATOMIC_RELAXED);
+    }
+    hal_intc_send_eoi(irq);
+
+    c->depth--;
+    if (c->depth == 0 && !c->in_softirq && c->pending)
+        run_softirqs(c);
+}
+
+void hal_softirq_raise(int id)
+{
+    if (id < 0 || (uint32_t)id >= __atomic_load_n(&nr_softirqs,
+                                                  __ATOMIC_ACQUIRE))
+        return;
+    uint64_t flags = hal_irq_save();
+    irq_cpu[hal_cpu_id()].pending |= 1u << id;
+    hal_irq_restore(flags);
+}
+
+int hal_in_softirq(void)
+{
+    uint64_t flags = hal_irq_save();
+    int in = irq_cpu[hal_cpu_id()].in_softirq != 0;
+    hal_irq_restore(flags);
+    return in;
+}
+
+uint64_t hal_irq_count(uint32_t irq)
+{
+    if (irq == HAL_IRQ_MAX)
+        return __atomic_load_n(&unhandled, __ATOMIC_RELAXED);
+    if (irq > HAL_IRQ_MAX)
+        return 0;
+    return __atomic_load_n(&irq_table[irq].count, __ATOMIC_RELAXED);
+}
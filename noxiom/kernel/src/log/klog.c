@@ -0,0 +1,251 @@
+/* kernel/src/log/klog.c — per-CPU log rings and the console drain
+ *
+ * A slot's seq is KLOG_BUSY while its CPU rewrites it; the writer then
+ * stores the record's real sequence number (release) and bumps the ring
+ * head.  Readers only look at sequences below head, check seq before and
+ * after copying a slot out, and skip a slot that fails either check:
+ * it has been (or is being) overwritten by a newer record.
+ *
+ * The console drain is an ordinary reader with its own cursor, under
+ * s_console_lock.  Whoever holds the lock drains until the rings are
+ * empty; a writer that cannot get the lock leaves its record to the
+ * holder, which checks again after dropping the lock so nothing is left
+ * behind.
+ */
+#include "klog.h"
+#include "../string.h"
+#include "../sched/sched.h"
+#include "../sync/spinlock.h"
+
+#define RING_MASK  (KLOG_RING - 1)
+#define KLOG_BUSY  UINT64_MAX
+
+typedef struct {
+    uint64_t      head;                 /* next sequence to write        */
+    klog_record_t rec[KLOG_RING];
+} klog_ring_t;
+
+static klog_ring_t s_rings[HAL_MAX_CPUS];
+
+static spinlock_t   s_console_lock = SPINLOCK_INIT;
+static klog_iter_t  s_console;          /* console cursor (zero = start) */
+static thread_t    *volatile s_klogd;
+
+/* ── Writing ──────────────────────────────────────────────────────────── */
+
+static volatile int s_panic;         /* console is synchronous again */
+
+static void console_kick(void);
+static void panic_drain(void);
+
+static void record(const char *fmt, va_list ap)
+{
+    char msg[KLOG_MSG_LEN];
+    int  len = kvsnprintf(msg, sizeof(msg), fmt, ap);
+    while (len > 0 && msg[len - 1] == '\n')
+        msg[--len] = '\0';
+
+    /* IRQs masked: nothing else on this CPU can write the ring, and the
+     * thread cannot migrate between hal_cpu_id() and the last store */
+    uint64_t       flags = hal_irq_save();
+    uint32_t       cpu   = hal_cpu_id();
+    klog_ring_t   *r     = &s_rings[cpu];
+    uint64_t       seq   = r->head;
+    klog_record_t *slot  = &r->rec[seq & RING_MASK];
+
+    __atomic_store_n(&slot->seq, KLOG_BUSY, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->ns  = hal_timer_now_ns();
+    slot->cpu = cpu;
+    kmemcpy(slot->msg, msg, (size_t)len + 1);
+    __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->head, seq + 1, __ATOMIC_RELEASE);
+    hal_irq_restore(flags);
+}
+
+void klog(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    record(fmt, ap);
+    va_end(ap);
+    console_kick();
+}
+
+void klog_panic(const char *fmt, ...)
+{
+    s_panic = 1;
+    va_list ap;
+    va_start(ap, fmt);
+    record(fmt, ap);
+    va_end(ap);
+    panic_drain();
+}
+
+/* ── Reading ──────────────────────────────────────────────────────────── */
+
+static uint64_t ring_head(uint32_t cpu)
+{
+    return __atomic_load_n(&s_rings[cpu].head, __ATOMIC_ACQUIRE);
+}
+
+/* Copy out record `seq` of `cpu`; 0 if it was overwritten meanwhile */
+static int read_slot(uint32_t cpu, uint64_t seq, klog_record_t *out)
+{
+    const klog_record_t *slot = &s_rings[cpu].rec[seq & RING_MASK];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq)
+        return 0;
+    kmemcpy(out, slot, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+        return 0;
+    out->seq = seq;
+    out->msg[KLOG_MSG_LEN - 1] = '\0';
+    return 1;
+}
+
+/* The next readable record of `cpu` for `it`, without consuming it */
+static int peek(klog_iter_t *it, uint32_t cpu, klog_record_t *out)
+{
+    for (;;) {
+        uint64_t head = ring_head(cpu);
+        if (it->next[cpu] >= head)
+            return 0;
+        if (head - it->next[cpu] > KLOG_RING) {
+            it->lost += head - KLOG_RING - it->next[cpu];
+            it->next[cpu] = head - KLOG_RING;
+        }
+        if (read_slot(cpu, it->next[cpu], out))
+            return 1;
+        it->lost++;
+        it->next[cpu]++;
+    }
+}
+
+void klog_iter_init(klog_iter_t *it)
+{
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++) {
+        uint64_t head = ring_head(cpu);
+        it->next[cpu] = head > KLOG_RING ? head - KLOG_RING : 0;
+    }
+    it->lost = 0;
+}
+
+int klog_iter_next(klog_iter_t *it, klog_record_t *out)
+{
+    klog_record_t rec;
+    int           best = -1;
+
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++) {
+        if (!peek(it, cpu, &rec))
+            continue;
+        if (best < 0 || rec.ns < out->ns) {
+            kmemcpy(out, &rec, sizeof(rec));
+            best = (int)cpu;
+        }
+    }
+    if (best < 0)
+        return 0;
+    it->next[best]++;
+    return 1;
+}
+
+uint32_t klog_format(const klog_record_t *r, char *buf, uint32_t size)
+{
+    return (uint32_t)ksnprintf(buf, size, "[%5lu.%06lu] %s",
+                               (unsigned long)(r->ns / 1000000000),
+                               (unsigned long)(r->ns / 1000 % 1000000),
+                               r->msg);
+}
+
+/* ── Console ──────────────────────────────────────────────────────────── */
+
+static int console_pending(void)
+{
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++)
+        if (ring_head(cpu) > s_console.next[cpu])
+            return 1;
+    return 0;
+}
+
+/* s_console_lock held */
+static void console_drain(void)
+{
+    klog_record_t rec;
+    char          line[KLOG_MSG_LEN + 16];
+
+    while (klog_iter_next(&s_console, &rec)) {
+        if (s_console.lost) {
+            ksnprintf(line, sizeof(line), "[klog] %lu records lost\n",
+                      (unsigned long)s_console.lost);
+            hal_serial_print(line);
+            s_console.lost = 0;
+        }
+        klog_format(&rec, line, sizeof(line));
+        hal_serial_print(line);
+        hal_serial_print("\n");
+    }
+}
+
+void klog_flush(void)
+{
+    do {
+        uint64_t flags = hal_irq_save();
+        if (!spin_trylock(&s_console_lock)) {
+            hal_irq_restore(flags);
+            return;                     /* the holder re-checks below */
+        }
+        console_drain();
+        spin_unlock(&s_console_lock);
+        hal_irq_restore(flags);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    } while (console_pending());
+}
+
+static void console_kick(void)
+{
+    if (s_panic) {
+        panic_drain();
+        return;
+    }
+    thread_t *t = s_klogd;
+    if (t) {
+        thread_wake(t);
+        return;
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    klog_flush();
+}
+
+static void panic_drain(void)
+{
+    /* Best effort, like the UART flushes: the lock holder may be the
+     * context that crashed */
+    int locked = 0;
+    for (int i = 0; i < 1000000 && !(locked = spin_trylock(&s_console_lock)); i++)
+        ;
+    console_drain();
+    if (locked)
+        spin_unlock(&s_console_lock);
+}
+
+/* ── klogd ────────────────────────────────────────────────────────────── */
+
+static void klogd_main(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        klog_flush();
+        thread_block();                 /* a wake in between is kept */
+    }
+}
+
+void klog_start(void)
+{
+    thread_t *t = thread_create("klogd", klogd_main, 0);
+    if (!t) {
+        klog("[klog] no klogd thread, console stays synchronous");
+        return;
+    }
+    s_klogd = t;
+}
@@ -0,0 +1,60 @@
+#pragma once
+/* log/klog.h — kernel log: per-CPU record rings, drained to the console
+ *
+ * klog() formats one line into the calling CPU's ring and returns; it
+ * never waits for the UART.  Each ring has a single writer (its CPU,
+ * with IRQs masked for the few stores of one record), so there is no
+ * lock on the logging side at all.  When a ring is full the oldest
+ * record is overwritten: logging never blocks and never fails.
+ *
+ * Readers walk all rings merged by timestamp.  A record is copied out
+ * and its sequence number checked again afterwards, so a reader racing
+ * with the writer lapping it drops the record instead of printing a torn
+ * one; records lost that way are counted.
+ *
+ * Until klog_start() the console is written inline, under the console
+ * lock, as hal_serial_print() always was.  After it a "klogd" thread does
+ * that whenever klog() wakes it, so the caller only pays for formatting.
+ * klog() may be called from IRQ handlers, but not with a scheduler run
+ * queue lock held (the wake-up takes it).  Fatal exception handlers use
+ * klog_panic() instead.
+ */
+#include <stdint.h>
+#include "../hal.h"
+
+#define KLOG_MSG_LEN    112             /* bytes per line, with the NUL   */
+#define KLOG_RING_ORDER 6
+#define KLOG_RING       (1u << KLOG_RING_ORDER)     /* records per CPU  */
+
+typedef struct {
+    uint64_t seq;                       /* position in its CPU's ring    */
+    uint64_t ns;                        /* hal_timer_now_ns() when logged */
+    uint32_t cpu;
+    char     msg[KLOG_MSG_LEN];
+} klog_record_t;
+
+/* Walk of every ring, oldest record first */
+typedef struct {
+    uint64_t next[HAL_MAX_CPUS];        /* per-CPU sequence to read next */
+    uint64_t lost;                      /* overwritten before being read */
+} klog_iter_t;
+
+void klog(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/* Hand console output to the klogd thread.  After sched_init(). */
+void klog_start(void);
+/* Write everything pending to the console now */
+void klog_flush(void);
+/* Fatal exception handlers, IRQs masked: log the message, then write
+ * everything pending to the console, as does every klog() after it.
+ * Wakes no thread and does not wait for a console lock the crashed
+ * context may hold; hal_halt() then drains the UART. */
+void klog_panic(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/* From the oldest record still retained */
+void klog_iter_init(klog_iter_t *it);
+/* Returns 0 once every ring is read up to its newest record */
+int  klog_iter_next(klog_iter_t *it, klog_record_t *out);
+
+/* "[    5.123456] msg" into buf; returns the length */
+uint32_t klog_format(const klog_record_t *r, char *buf, uint32_t size);
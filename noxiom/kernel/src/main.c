@@ -1,5 +1,21 @@
 #include "hal.h"
+#include "string.h"
+#include "mm/pmm.h"
+#include "mm/kmalloc.h"
+#include "smp/smp.h"
+#include "smp/percpu.h"
+#include "sched/sched.h"
 #include "shell/shell.h"
+#include "time/bootstats.h"
+#include "bench/bench.h"
+#include "log/klog.h"
+#include "sync/rcu.h"
+#include "pci/pci.h"
+#include "virtio/virtio.h"
+#include "net/net.h"
+#include "blk/blkdev.h"
+#include "fs/vfs.h"
+#include "user/user.h"
 
 static void print_hw_info(void) {
     hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
@@ -31,36 +47,105 @@ static void print_banner(void) {
     hal_display_print("\n\nType 'help' for a list of commands.\n\n");
 }
 
+static void shell_thread(void *arg) {
+    (void)arg;
+#ifdef BENCH_AT_BOOT
+    bench_run_all();
+#endif
+    shell_run();
+}
+
 void kmain(void) {
+    /* 0. This CPU's per-CPU area, before anything asks hal_cpu_id() */
+    percpu_init(0);
+
+    /* Boot phase timestamps (time/bootstats.h); each step ends with a
+     * boot_mark() */
+    boot_stats_start();
+
     /* 1. Serial first — always works, gives us early debug output */
     hal_serial_init();
-    hal_serial_print("[noxiom] kernel started\n");
+    klog("[noxiom] kernel started");
+    boot_mark("serial");
 
-    /* 2. Detect hardware properties and compute tier */
+    /* 2. Detect hardware properties, topology and caches, and compute
+     *    the tier */
+    hal_hw_info_lock();
     hal_hw_detect();
+    hal_hw_topo_fixup();
     g_hw_info.tier = hal_hw_score();
-    hal_serial_print("[noxiom] hw detected\n");
+    hal_hw_info_unlock();
+    klog("[noxiom] hw detected");
+    boot_mark("hw_detect");
 
-    /* 3. CPU descriptor tables (GDT+IDT on x86; VBAR_EL1 on arm64) */
+    /* 3. Physical page frame allocator (E820 on x86; DTB /memory on arm64)
+     *    and the kernel heap on top of it */
+    pmm_init();
+    kmalloc_init();
+    klog("[mm] ram %lu MB, allocator %lu MB, free %lu MB",
+         (unsigned long)(g_hw_info.ram_bytes >> 20),
+         (unsigned long)(pmm_total_bytes() >> 20),
+         (unsigned long)(pmm_free_bytes() >> 20));
+    boot_mark("mm");
+
+    /* 4. CPU descriptor tables (GDT+IDT on x86; VBAR_EL1 on arm64) */
     hal_cpu_init();
-    hal_serial_print("[noxiom] cpu ok\n");
+    klog("[noxiom] cpu ok");
+    boot_mark("cpu");
 
-    /* 4. Interrupt controller (PIC on x86; GIC on arm64) */
+    /* 5. Interrupt controller (IOAPIC or PIC on x86; GIC on arm64),
+     *    then the PCI functions behind it */
     hal_intc_init();
-    hal_serial_print("[noxiom] intc ok\n");
+    klog("[noxiom] intc ok");
+    pci_init();
+    boot_mark("intc");
+
+    /* 6. Scheduler, then secondary CPUs (INIT-SIPI on x86; PSCI /
+     *    spin-table on arm64), which go straight to their idle loops.
+     *    The vDSO page for user mode records how many came up. */
+    sched_init();
+    smp_init();
+    klog("[smp] %u of %u cpus online", smp_online_count(),
+         g_hw_info.cpu_cores);
+    user_init();
+    boot_mark("smp");
 
-    /* 5. Display */
+    /* 7. virtio devices on PCI and MMIO; drivers start per-CPU poll
+     *    threads, so after smp_init().  Then the TCP/IP stack on top of
+     *    the network devices they registered, the block controllers
+     *    virtio does not cover (AHCI, SD), and the filesystems on every
+     *    block device as it appears. */
+    virtio_init();
+    boot_mark("virtio");
+    net_init();
+    boot_mark("net");
+    blk_init();
+    boot_mark("blk");
+    vfs_init();
+    boot_mark("fs");
+
+    /* 8. Display */
     hal_display_init();
-    hal_serial_print("[noxiom] display ok\n");
+    klog("[noxiom] display ok");
+    boot_mark("display");
 
-    /* 6. Input */
+    /* 9. Input */
     hal_input_init();
-    hal_serial_print("[noxiom] input ok\n");
+    klog("[noxiom] input ok");
+    boot_mark("input");
 
     print_hw_info();
     print_banner();
-    hal_serial_print("[noxiom] entering shell\n");
+    boot_mark("banner");
+    boot_stats_report();
+    klog("[noxiom] entering shell");
 
-    shell_run();
-    hal_halt();
+    /* 10. From here on the console is written by the klogd thread.  The
+     *     shell is just the first other thread; this context becomes CPU
+     *     0's idle thread */
+    klog_start();
+    rcu_start();
+    if (!thread_create("shell", shell_thread, 0))
+        klog("[noxiom] cannot start shell thread");
+    sched_cpu_main(0);
 }
@@ -0,0 +1,114 @@
+/* kernel/src/mm/arena.c — bump arena over PMM chunks
+ *
+ * Chunks are single pages unless one allocation needs more, in which case
+ * the chunk is sized up to the next power-of-two page block.  Chunks form
+ * a singly linked list, newest first, so rolling back to a mark just pops
+ * chunks until the marked one is on top.
+ */
+#include "arena.h"
+#include "pmm.h"
+
+#define ARENA_ALIGN 16
+
+struct arena_chunk {
+    arena_chunk_t *prev;
+    uint32_t       order;
+    size_t         size;            /* usable bytes after the header     */
+    size_t         off;
+};
+
+#define CHUNK_HDR ((sizeof(arena_chunk_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static inline uint8_t *chunk_data(arena_chunk_t *c)
+{
+    return (uint8_t *)c + CHUNK_HDR;
+}
+
+static void chunk_free(arena_chunk_t *c)
+{
+    pmm_free_pages(virt_to_phys(c), c->order);
+}
+
+void arena_init(arena_t *a)
+{
+    a->head = 0;
+    a->used = 0;
+    a->peak = 0;
+}
+
+void *arena_alloc(arena_t *a, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size == 0)
+        return 0;
+
+    arena_chunk_t *c = a->head;
+    if (!c || c->off + size > c->size) {
+        uint32_t order = 0;
+        while ((PAGE_SIZE << order) < size + CHUNK_HDR)
+            order++;
+        if (order >= PMM_MAX_ORDER)
+            return 0;
+        uint64_t pa = pmm_alloc_pages(order);
+        if (!pa)
+            return 0;
+        c = phys_to_virt(pa);
+        c->prev  = a->head;
+        c->order = order;
+        c->size  = (PAGE_SIZE << order) - CHUNK_HDR;
+        c->off   = 0;
+        a->head  = c;
+    }
+
+    void *p = chunk_data(c) + c->off;
+    c->off  += size;
+    a->used += size;
+    if (a->used > a->peak)
+        a->peak = a->used;
+    return p;
+}
+
+arena_mark_t arena_mark(const arena_t *a)
+{
+    arena_mark_t m;
+    m.chunk = a->head;
+    m.off   = a->head ? a->head->off : 0;
+    m.used  = a->used;
+    return m;
+}
+
+void arena_reset(arena_t *a, arena_mark_t mark)
+{
+    while (a->head && a->head != mark.chunk) {
+        arena_chunk_t *prev = a->head->prev;
+        chunk_free(a->head);
+        a->head = prev;
+    }
+    if (a->head)
+        a->head->off = mark.off;
+    a->used = mark.used;
+}
+
+/* Like a reset to the very start, except that the first chunk stays
+ * allocated for whoever uses the arena next */
+void arena_clear(arena_t *a)
+{
+    while (a->head && a->head->prev) {
+        arena_chunk_t *prev = a->head->prev;
+        chunk_free(a->head);
+        a->head = prev;
+    }
+    if (a->head)
+        a->head->off = 0;
+    a->used = 0;
+}
+
+void arena_release(arena_t *a)
+{
+    while (a->head) {
+        arena_chunk_t *prev = a->head->prev;
+        chunk_free(a->head);
+        a->head = prev;
+    }
+    a->used = 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+/* mm/arena.h — bump allocator for short-lived data
+ *
+ * An arena hands out memory by bumping a pointer inside page chunks taken
+ * from the frame allocator and frees it all at once.  There is no per-
+ * object free and no per-object header, which makes it the right tool for
+ * scratch data with an obvious lifetime: one shell command, one parse
+ * pass, one boot phase.  An arena is not thread-safe; give each user its
+ * own.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct arena_chunk arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t *head;        /* newest chunk                          */
+    uint64_t       used;        /* bytes handed out since last reset     */
+    uint64_t       peak;        /* high-water mark of used               */
+} arena_t;
+
+/* Position to roll back to with arena_reset() */
+typedef struct {
+    arena_chunk_t *chunk;
+    size_t         off;
+    uint64_t       used;
+} arena_mark_t;
+
+#define ARENA_INIT { 0, 0, 0 }
+
+void         arena_init(arena_t *a);
+void        *arena_alloc(arena_t *a, size_t size);  /* 16-byte aligned, 0 on OOM */
+arena_mark_t arena_mark(const arena_t *a);
+void         arena_reset(arena_t *a, arena_mark_t mark);
+void         arena_clear(arena_t *a);               /* empty, keep oldest chunk  */
+void         arena_release(arena_t *a);             /* free every chunk          */
@@ -0,0 +1,446 @@
+/* kernel/src/mm/kmalloc.c — slab allocator with per-CPU magazines
+ *
+ * Layout:
+ *   size class  → kmem_class_t: a lock, a list of partially used slabs and
+ *                 one warm empty slab (further empty slabs go back to the
+ *                 page allocator straight away)
+ *   slab        → 4 KB (≤ 256 B objects) or 16 KB block from the PMM,
+ *                 64-byte header followed by equal-sized objects; every
+ *                 page of the slab is tagged in the PMM so kfree() can
+ *                 find the class from a bare pointer
+ *   per-CPU     → one magazine (stack of free object pointers) per class;
+ *                 kmalloc/kfree only touch the local magazine with IRQs
+ *                 masked and move half a magazine at a time to or from
+ *                 the class under its lock
+ *
+ * Magazine depth is set per class at init: all of a CPU's full magazines
+ * together take about half of its share of L2 (of the last level when
+ * there is no L2 figure), between MAG_MIN and MAG_MAX objects, so what
+ * kmalloc hands back is still in cache.  With no cache information every
+ * magazine holds MAG_MAX.
+ *
+ * Peak usage is sampled whenever a magazine is refilled or flushed, so
+ * it is exact to within one magazine per CPU.
+ */
+#include "kmalloc.h"
+#include "pmm.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../sync/spinlock.h"
+
+#define SLAB_HDR_SIZE   64
+#define MAG_MIN         4
+#define MAG_MAX         32
+
+/* PMM page tags (must stay below 0x80) */
+#define TAG_SLAB        0x20            /* | class index */
+#define TAG_LARGE       0x40            /* | page order  */
+
+typedef struct slab {
+    struct slab *next;
+    struct slab *prev;
+    void        *free;                  /* intrusive free-object list    */
+    uint32_t     inuse;
+    uint32_t     on_partial;
+} slab_t;
+
+typedef struct {
+    spinlock_t lock;
+    uint32_t   obj_size;
+    uint32_t   slab_order;
+    uint32_t   objs_per_slab;
+    slab_t    *partial;
+    slab_t    *empty;
+    uint64_t   slab_pages;
+    uint64_t   direct_allocs;           /* no magazine (early boot / unknown CPU) */
+    uint64_t   direct_frees;
+    uint64_t   peak_live;               /* objects */
+} kmem_class_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t cap;
+    uint64_t allocs;
+    uint64_t frees;
+    void    *objs[MAG_MAX];
+} kmem_mag_t;
+
+typedef struct {
+    kmem_mag_t mag[KMALLOC_CLASSES];
+} kmem_cpu_t;
+
+static kmem_class_t classes[KMALLOC_CLASSES];
+static kmem_cpu_t  *cpu_cache[HAL_MAX_CPUS];
+static int          classes_ready;
+
+static spinlock_t   large_lock = SPINLOCK_INIT;
+static uint64_t     large_live, large_freed, large_peak, large_pages;
+
+_Static_assert(sizeof(slab_t) <= SLAB_HDR_SIZE, "slab header too large");
+_Static_assert(sizeof(kmem_cpu_t) <= PAGE_SIZE, "per-CPU cache must fit a page");
+
+/* ── Class setup ────────────────────────────────────────────────────────── */
+
+static void classes_init(void)
+{
+    for (uint32_t i = 0; i < KMALLOC_CLASSES; i++) {
+        kmem_class_t *c = &classes[i];
+        c->obj_size      = 1u << (KMALLOC_MIN_SHIFT + i);
+        c->slab_order    = c->obj_size <= 256 ? 0 : 2;
+        c->objs_per_slab = (uint32_t)(((PAGE_SIZE << c->slab_order) - SLAB_HDR_SIZE)
+                                      / c->obj_size);
+    }
+    classes_ready = 1;
+}
+
+static inline uint32_t size_to_class(size_t size)
+{
+    uint32_t cls = 0;
+    size_t   s   = (size_t)1 << KMALLOC_MIN_SHIFT;
+    while (s < size) {
+        s <<= 1;
+        cls++;
+    }
+    return cls;
+}
+
+/* ── Slab layer (class lock held) ───────────────────────────────────────── */
+
+static void partial_add(kmem_class_t *c, slab_t *s)
+{
+    s->prev = 0;
+    s->next = c->partial;
+    if (s->next)
+        s->next->prev = s;
+    c->partial = s;
+    s->on_partial = 1;
+}
+
+static void partial_remove(kmem_class_t *c, slab_t *s)
+{
+    if (s->prev)
+        s->prev->next = s->next;
+    else
+        c->partial = s->next;
+    if (s->next)
+        s->next->prev = s->prev;
+    s->on_partial = 0;
+}
+
+static slab_t *slab_create(kmem_class_t *c, uint32_t cls)
+{
+    uint64_t pa = pmm_alloc_pages(c->slab_order);
+    if (!pa)
+        return 0;
+
+    uint32_t pages = 1u << c->slab_order;
+    for (uint32_t i = 0; i < pages; i++)
+        pmm_set_tag(pa + i * PAGE_SIZE, (uint8_t)(TAG_SLAB | cls));
+
+    slab_t  *s   = phys_to_virt(pa);
+    uint8_t *obj = (uint8_t *)s + SLAB_HDR_SIZE;
+    s->free  = 0;
+    s->inuse = 0;
+    for (uint32_t i = c->objs_per_slab; i-- > 0; ) {
+        void **o = (void **)(obj + (size_t)i * c->obj_size);
+        *o = s->free;
+        s->free = o;
+    }
+    c->slab_pages += pages;
+    return s;
+}
+
+static void slab_destroy(kmem_class_t *c, slab_t *s)
+{
+    uint64_t pa    = virt_to_phys(s);
+    uint32_t pages = 1u << c->slab_order;
+    for (uint32_t i = 0; i < pages; i++)
+        pmm_set_tag(pa + i * PAGE_SIZE, 0);
+    c->slab_pages -= pages;
+    pmm_free_pages(pa, c->slab_order);
+}
+
+static void *slab_alloc(kmem_class_t *c, uint32_t cls)
+{
+    slab_t *s = c->partial;
+    if (!s) {
+        s = c->empty;
+        if (s)
+            c->empty = 0;
+        else if (!(s = slab_create(c, cls)))
+            return 0;
+        partial_add(c, s);
+    }
+
+    void **o = s->free;
+    s->free = *o;
+    if (++s->inuse == c->objs_per_slab)
+        partial_remove(c, s);       /* full slabs are found again via kfree */
+    return o;
+}
+
+static void slab_free(kmem_class_t *c, void *ptr)
+{
+    uint64_t slab_bytes = PAGE_SIZE << c->slab_order;
+    slab_t  *s = (slab_t *)((uintptr_t)ptr & ~(uintptr_t)(slab_bytes - 1));
+
+    void **o = ptr;
+    *o = s->free;
+    s->free = o;
+    if (!s->on_partial)
+        partial_add(c, s);
+
+    if (--s->inuse == 0) {
+        partial_remove(c, s);
+        if (!c->empty)
+            c->empty = s;
+        else
+            slab_destroy(c, s);
+    }
+}
+
+/* ── Statistics helpers ─────────────────────────────────────────────────── */
+
+static uint64_t live_objects(uint32_t cls)
+{
+    kmem_class_t *c = &classes[cls];
+    uint64_t allocs = c->direct_allocs, frees = c->direct_frees;
+    for (uint32_t i = 0; i < HAL_MAX_CPUS; i++) {
+        if (cpu_cache[i]) {
+            allocs += cpu_cache[i]->mag[cls].allocs;
+            frees  += cpu_cache[i]->mag[cls].frees;
+        }
+    }
+    return allocs - frees;
+}
+
+static void sample_peak(kmem_class_t *c, uint32_t cls)
+{
+    uint64_t live = live_objects(cls);
+    if (live > c->peak_live)
+        c->peak_live = live;
+}
+
+/* ── Magazine layer (IRQs masked by caller) ─────────────────────────────── */
+
+static void mag_refill(uint32_t cls, kmem_mag_t *m)
+{
+    kmem_class_t *c = &classes[cls];
+    spin_lock(&c->lock);
+    sample_peak(c, cls);
+    uint32_t want = m->cap / 2 ? m->cap / 2 : 1;
+    while (m->count < want) {
+        void *o = slab_alloc(c, cls);
+        if (!o)
+            break;
+        m->objs[m->count++] = o;
+    }
+    spin_unlock(&c->lock);
+}
+
+static void mag_flush(uint32_t cls, kmem_mag_t *m)
+{
+    kmem_class_t *c = &classes[cls];
+    spin_lock(&c->lock);
+    sample_peak(c, cls);
+    uint32_t keep = m->cap / 2;
+    while (m->count > keep)
+        slab_free(c, m->objs[--m->count]);
+    spin_unlock(&c->lock);
+}
+
+static inline kmem_mag_t *local_mag(uint32_t cls)
+{
+    uint32_t    cpu = hal_cpu_id();
+    kmem_cpu_t *cc  = cpu < HAL_MAX_CPUS ? cpu_cache[cpu] : 0;
+    return cc ? &cc->mag[cls] : 0;
+}
+
+/* ── Large allocations (whole pages) ────────────────────────────────────── */
+
+static void *large_alloc(size_t size)
+{
+    uint32_t order = 0;
+    while ((PAGE_SIZE << order) < size)
+        order++;
+    if (order >= PMM_MAX_ORDER)
+        return 0;
+
+    uint64_t pa = pmm_alloc_pages(order);
+    if (!pa)
+        return 0;
+    pmm_set_tag(pa, (uint8_t)(TAG_LARGE | order));
+
+    uint64_t flags = spin_lock_irqsave(&large_lock);
+    large_live  += PAGE_SIZE << order;
+    large_pages += 1u << order;
+    if (large_live > large_peak)
+        large_peak = large_live;
+    spin_unlock_irqrestore(&large_lock, flags);
+    return phys_to_virt(pa);
+}
+
+static void large_free(uint64_t pa, uint32_t order)
+{
+    uint64_t flags = spin_lock_irqsave(&large_lock);
+    large_live  -= PAGE_SIZE << order;
+    large_freed += PAGE_SIZE << order;
+    large_pages -= 1u << order;
+    spin_unlock_irqrestore(&large_lock, flags);
+
+    pmm_set_tag(pa, 0);
+    pmm_free_pages(pa, order);
+}
+
+static uint32_t mag_cap(uint32_t obj_size)
+{
+    uint32_t share = hal_hw_cache_share(2);
+    if (!share)
+        share = hal_hw_cache_share(0);
+    if (!share)
+        return MAG_MAX;
+    uint32_t cap = share / 2 / KMALLOC_CLASSES / obj_size;
+    return cap < MAG_MIN ? MAG_MIN : cap > MAG_MAX ? MAG_MAX : cap;
+}
+
+/* ── Public API ─────────────────────────────────────────────────────────── */
+
+void kmalloc_init(void)
+{
+    if (!classes_ready)
+        classes_init();
+
+    /* Magazines only for CPUs that exist; RAM is not spent on the rest */
+    uint32_t ncpu = g_hw_info.cpu_cores ? g_hw_info.cpu_cores : 1;
+    if (ncpu > HAL_MAX_CPUS)
+        ncpu = HAL_MAX_CPUS;
+
+    for (uint32_t i = 0; i < ncpu; i++) {
+        if (cpu_cache[i])
+            continue;
+        uint64_t pa = pmm_alloc_page();
+        if (!pa)
+            break;
+        kmem_cpu_t *cc = phys_to_virt(pa);
+        kmemset(cc, 0, sizeof(*cc));
+        for (uint32_t c = 0; c < KMALLOC_CLASSES; c++)
+            cc->mag[c].cap = mag_cap(classes[c].obj_size);
+        cpu_cache[i] = cc;
+    }
+}
+
+void *kmalloc(size_t size)
+{
+    if (size == 0)
+        return 0;
+    if (size > ((size_t)1 << KMALLOC_MAX_SHIFT))
+        return large_alloc(size);
+    if (!classes_ready)
+        classes_init();
+
+    uint32_t cls   = size_to_class(size);
+    uint64_t flags = hal_irq_save();
+    kmem_mag_t *m  = local_mag(cls);
+    void *p = 0;
+
+    if (m) {
+        if (m->count == 0)
+            mag_refill(cls, m);
+        if (m->count) {
+            p = m->objs[--m->count];
+            m->allocs++;
+        }
+    } else {
+        kmem_class_t *c = &classes[cls];
+        spin_lock(&c->lock);
+        p = slab_alloc(c, cls);
+        if (p) {
+            c->direct_allocs++;
+            sample_peak(c, cls);
+        }
+        spin_unlock(&c->lock);
+    }
+
+    hal_irq_restore(flags);
+    return p;
+}
+
+void *kzalloc(size_t size)
+{
+    void *p = kmalloc(size);
+    if (p)
+        kmemzero(p, size);
+    return p;
+}
+
+void kfree(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    uint64_t pa  = virt_to_phys(ptr) & ~(PAGE_SIZE - 1);
+    uint8_t  tag = pmm_get_tag(pa);
+
+    if ((tag & 0x60) == TAG_LARGE) {
+        large_free(pa, tag & 0x1F);
+        return;
+    }
+    if ((tag & 0x60) != TAG_SLAB)
+        return;                     /* not a heap pointer — ignore */
+
+    uint32_t cls   = tag & 0x1F;
+    uint64_t flags = hal_irq_save();
+    kmem_mag_t *m  = local_mag(cls);
+
+    if (m) {
+        if (m->count == m->cap)
+            mag_flush(cls, m);
+        m->objs[m->count++] = ptr;
+        m->frees++;
+    } else {
+        kmem_class_t *c = &classes[cls];
+        spin_lock(&c->lock);
+        slab_free(c, ptr);
+        c->direct_frees++;
+        spin_unlock(&c->lock);
+    }
+
+    hal_irq_restore(flags);
+}
+
+uint32_t kmalloc_stats(kmalloc_stats_t *out, uint32_t max)
+{
+    uint32_t n = 0;
+    if (!classes_ready)
+        classes_init();
+
+    for (uint32_t cls = 0; cls < KMALLOC_CLASSES && n < max; cls++, n++) {
+        kmem_class_t *c = &classes[cls];
+        uint64_t flags = spin_lock_irqsave(&c->lock);
+        sample_peak(c, cls);
+
+        uint64_t frees = c->direct_frees;
+        for (uint32_t i = 0; i < HAL_MAX_CPUS; i++)
+            if (cpu_cache[i])
+                frees += cpu_cache[i]->mag[cls].frees;
+
+        out[n].obj_size    = c->obj_size;
+        out[n].live_bytes  = live_objects(cls) * c->obj_size;
+        out[n].freed_bytes = frees * c->obj_size;
+        out[n].peak_bytes  = c->peak_live * c->obj_size;
+        out[n].slab_bytes  = c->slab_pages * PAGE_SIZE;
+        spin_unlock_irqrestore(&c->lock, flags);
+    }
+
+    if (n < max) {
+        uint64_t flags = spin_lock_irqsave(&large_lock);
+        out[n].obj_size    = 0;
+        out[n].live_bytes  = large_live;
+        out[n].freed_bytes = large_freed;
+        out[n].peak_bytes  = large_peak;
+        out[n].slab_bytes  = large_pages * PAGE_SIZE;
+        spin_unlock_irqrestore(&large_lock, flags);
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,37 @@
+#pragma once
+/* mm/kmalloc.h — kernel heap
+ *
+ * Power-of-two slab caches from 16 B to 2 KB, fronted by per-CPU
+ * magazines so the common kmalloc()/kfree() path touches no shared lock
+ * and no shared cache line.  Larger requests go straight to the page
+ * frame allocator.  Every pointer is at least 16-byte aligned.
+ *
+ * kmalloc() works before kmalloc_init() (slow path only); the per-CPU
+ * magazines come online once kmalloc_init() has run.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#define KMALLOC_MIN_SHIFT   4                   /* 16 B                   */
+#define KMALLOC_MAX_SHIFT   11                  /* 2 KB                   */
+#define KMALLOC_CLASSES     (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+void  kmalloc_init(void);
+void *kmalloc(size_t size);
+void *kzalloc(size_t size);
+void  kfree(void *ptr);
+
+/* Per-class accounting.  obj_size == 0 is the large (page) class.
+ * Byte counts are in object-size units, i.e. what callers asked for after
+ * rounding up to the class; slab_bytes is the memory the class holds. */
+typedef struct {
+    uint32_t obj_size;
+    uint64_t live_bytes;        /* allocated and not yet freed            */
+    uint64_t freed_bytes;       /* cumulative bytes returned by kfree()   */
+    uint64_t peak_bytes;        /* high-water mark of live_bytes          */
+    uint64_t slab_bytes;        /* pages currently owned by the class     */
+} kmalloc_stats_t;
+
+/* Fill out[] with KMALLOC_CLASSES + 1 entries (last = large class).
+ * Returns the number of entries written. */
+uint32_t kmalloc_stats(kmalloc_stats_t *out, uint32_t max);
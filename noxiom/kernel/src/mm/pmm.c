@@ -0,0 +1,275 @@
+/* kernel/src/mm/pmm.c — buddy page frame allocator
+ *
+ * Bookkeeping is one byte per frame (0.025 % of RAM), placed in the first
+ * usable range that does not overlap a reserved one.  A free block's list
+ * links live inside the block itself, so free memory costs nothing extra.
+ *
+ * frame_info[i]:
+ *   FRAME_FREE | order  — first frame of a free block of 2^order pages
+ *   FRAME_USED          — allocated, reserved, a hole, or inside a block
+ *   0x01-0x7F           — allocated, tagged by its owner (pmm_set_tag)
+ */
+#include "pmm.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../sync/spinlock.h"
+
+#define FRAME_USED     0x00
+#define FRAME_FREE     0x80
+
+#define BLOCK_BYTES(o) (PAGE_SIZE << (o))
+#define ALIGN_UP(x, a)   (((x) + (a) - 1) & ~((uint64_t)(a) - 1))
+#define ALIGN_DOWN(x, a) ((x) & ~((uint64_t)(a) - 1))
+
+typedef struct pmm_block {
+    struct pmm_block *next;
+    struct pmm_block *prev;
+} pmm_block_t;
+
+static uint8_t     *frame_info;
+static uint64_t     base_pa;        /* physical address of frame 0         */
+static uint64_t     nframes;
+static pmm_block_t *free_list[PMM_MAX_ORDER];
+static uint64_t     total_pages;
+static uint64_t     free_pages;
+static spinlock_t   pmm_lock = SPINLOCK_INIT;
+static pmm_reclaim_fn_t reclaim_fn;
+
+static inline uint64_t frame_index(uint64_t pa) { return (pa - base_pa) >> PAGE_SHIFT; }
+static inline uint64_t frame_addr(uint64_t idx) { return base_pa + (idx << PAGE_SHIFT); }
+
+/* ── Free lists ─────────────────────────────────────────────────────────── */
+
+static void list_push(uint32_t order, uint64_t pa)
+{
+    pmm_block_t *b = phys_to_virt(pa);
+    b->prev = 0;
+    b->next = free_list[order];
+    if (b->next)
+        b->next->prev = b;
+    free_list[order] = b;
+    frame_info[frame_index(pa)] = (uint8_t)(FRAME_FREE | order);
+}
+
+static void list_remove(uint32_t order, uint64_t pa)
+{
+    pmm_block_t *b = phys_to_virt(pa);
+    if (b->prev)
+        b->prev->next = b->next;
+    else
+        free_list[order] = b->next;
+    if (b->next)
+        b->next->prev = b->prev;
+    frame_info[frame_index(pa)] = FRAME_USED;
+}
+
+/* ── Alloc / free ───────────────────────────────────────────────────────── */
+
+static uint64_t alloc_block(uint32_t order)
+{
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
+
+    uint32_t o = order;
+    while (o < PMM_MAX_ORDER && !free_list[o])
+        o++;
+    if (o == PMM_MAX_ORDER) {
+        spin_unlock_irqrestore(&pmm_lock, flags);
+        return 0;
+    }
+
+    uint64_t pa = virt_to_phys(free_list[o]);
+    list_remove(o, pa);
+
+    /* Split: hand the upper halves back until the block fits */
+    while (o > order) {
+        o--;
+        list_push(o, pa + BLOCK_BYTES(o));
+    }
+
+    free_pages -= (uint64_t)1 << order;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return pa;
+}
+
+uint64_t pmm_alloc_pages(uint32_t order)
+{
+    if (order >= PMM_MAX_ORDER)
+        return 0;
+    uint64_t pa = alloc_block(order);
+    if (pa)
+        return pa;
+
+    /* Ask for more than the block: freed frames need not be buddies */
+    pmm_reclaim_fn_t fn = __atomic_load_n(&reclaim_fn, __ATOMIC_ACQUIRE);
+    uint64_t want = (uint64_t)2 << order;
+    if (fn && fn(want < 32 ? 32 : want))
+        pa = alloc_block(order);
+    return pa;
+}
+
+void pmm_set_reclaim(pmm_reclaim_fn_t fn)
+{
+    __atomic_store_n(&reclaim_fn, fn, __ATOMIC_RELEASE);
+}
+
+/* Caller holds pmm_lock */
+static void free_locked(uint64_t idx, uint32_t order)
+{
+    free_pages += (uint64_t)1 << order;
+
+    /* Coalesce with the buddy while it is a free block of the same order */
+    while (order < PMM_MAX_ORDER - 1) {
+        uint64_t buddy = idx ^ ((uint64_t)1 << order);
+        if (buddy >= nframes || frame_info[buddy] != (FRAME_FREE | order))
+            break;
+        list_remove(order, frame_addr(buddy));
+        idx &= ~((uint64_t)1 << order);
+        order++;
+    }
+    list_push(order, frame_addr(idx));
+}
+
+void pmm_free_pages(uint64_t pa, uint32_t order)
+{
+    if (!pa || order >= PMM_MAX_ORDER || pa < base_pa)
+        return;
+
+    uint64_t idx = frame_index(pa);
+    if (idx >= nframes)
+        return;
+
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
+    free_locked(idx, order);
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+void pmm_set_tag(uint64_t pa, uint8_t tag)
+{
+    uint64_t idx = frame_index(pa);
+    if (pa >= base_pa && idx < nframes)
+        frame_info[idx] = tag & 0x7F;
+}
+
+uint8_t pmm_get_tag(uint64_t pa)
+{
+    uint64_t idx = frame_index(pa);
+    if (pa < base_pa || idx >= nframes || (frame_info[idx] & FRAME_FREE))
+        return 0;
+    return frame_info[idx];
+}
+
+uint64_t pmm_total_bytes(void) { return total_pages << PAGE_SHIFT; }
+uint64_t pmm_free_bytes(void)  { return free_pages  << PAGE_SHIFT; }
+
+/* ── Initialisation ─────────────────────────────────────────────────────── */
+
+/* Free [start, end) as the largest naturally aligned blocks that fit */
+static void free_span(uint64_t start, uint64_t end)
+{
+    while (start < end) {
+        uint64_t idx   = frame_index(start);
+        uint32_t order = PMM_MAX_ORDER - 1;
+        while (order > 0 &&
+               ((idx & (((uint64_t)1 << order) - 1)) != 0 ||
+                start + BLOCK_BYTES(order) > end))
+            order--;
+        total_pages += (uint64_t)1 << order;
+        free_locked(idx, order);
+        start += BLOCK_BYTES(order);
+    }
+}
+
+/* Lowest reserved range overlapping [start, end), or -1 */
+static int first_overlap(const hal_mem_region_t *rsv, uint32_t nrsv,
+                         uint64_t start, uint64_t end)
+{
+    int best = -1;
+    for (uint32_t i = 0; i < nrsv; i++) {
+        uint64_t rb = rsv[i].base, re = rsv[i].base + rsv[i].size;
+        if (rb < end && re > start && (best < 0 || rb < rsv[best].base))
+            best = (int)i;
+    }
+    return best;
+}
+
+/* Free a usable range, skipping every reserved range inside it */
+static void free_usable(uint64_t start, uint64_t end,
+                        const hal_mem_region_t *rsv, uint32_t nrsv)
+{
+    while (start < end) {
+        int r = first_overlap(rsv, nrsv, start, end);
+        if (r < 0) {
+            free_span(start, end);
+            return;
+        }
+        uint64_t rb = ALIGN_DOWN(rsv[r].base, PAGE_SIZE);
+        uint64_t re = ALIGN_UP(rsv[r].base + rsv[r].size, PAGE_SIZE);
+        if (rb > start)
+            free_span(start, rb);
+        start = re;
+    }
+}
+
+/* First page-aligned spot of `bytes` in usable RAM clear of reservations */
+static uint64_t find_space(const hal_mem_region_t *use, uint32_t nuse,
+                           const hal_mem_region_t *rsv, uint32_t nrsv,
+                           uint64_t bytes)
+{
+    for (uint32_t i = 0; i < nuse; i++) {
+        uint64_t start = use[i].base;
+        uint64_t end   = use[i].base + use[i].size;
+        while (start + bytes <= end) {
+            int r = first_overlap(rsv, nrsv, start, start + bytes);
+            if (r < 0)
+                return start;
+            start = ALIGN_UP(rsv[r].base + rsv[r].size, PAGE_SIZE);
+        }
+    }
+    return 0;
+}
+
+void pmm_init(void)
+{
+    hal_mem_region_t use[HAL_MAX_MEM_REGIONS];
+    hal_mem_region_t rsv[HAL_MAX_MEM_REGIONS + 1];   /* +1: frame_info */
+    uint32_t nuse = hal_mem_usable(use, HAL_MAX_MEM_REGIONS);
+    uint32_t nrsv = hal_mem_reserved(rsv, HAL_MAX_MEM_REGIONS);
+
+    /* Trim usable ranges to whole pages and find the span they cover */
+    uint64_t lo = ~(uint64_t)0, hi = 0;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < nuse; i++) {
+        uint64_t b = ALIGN_UP(use[i].base, PAGE_SIZE);
+        uint64_t e = ALIGN_DOWN(use[i].base + use[i].size, PAGE_SIZE);
+        if (e <= b)
+            continue;
+        use[n].base = b;
+        use[n].size = e - b;
+        n++;
+        if (b < lo) lo = b;
+        if (e > hi) hi = e;
+    }
+    nuse = n;
+    if (nuse == 0)
+        return;
+
+    /* Frame 0 sits on a max-order boundary so buddies stay aligned */
+    base_pa = ALIGN_DOWN(lo, BLOCK_BYTES(PMM_MAX_ORDER - 1));
+    nframes = (hi - base_pa) >> PAGE_SHIFT;
+
+    uint64_t meta_bytes = ALIGN_UP(nframes, PAGE_SIZE);
+    uint64_t meta = find_space(use, nuse, rsv, nrsv, meta_bytes);
+    if (!meta) {
+        nframes = 0;
+        return;
+    }
+    rsv[nrsv].base = meta;
+    rsv[nrsv].size = meta_bytes;
+    nrsv++;
+
+    frame_info = phys_to_virt(meta);
+    kmemset(frame_info, FRAME_USED, nframes);
+
+    for (uint32_t i = 0; i < nuse; i++)
+        free_usable(use[i].base, use[i].base + use[i].size, rsv, nrsv);
+}
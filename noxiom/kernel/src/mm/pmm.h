@@ -0,0 +1,56 @@
+#pragma once
+/* mm/pmm.h — physical page frame allocator
+ *
+ * Binary buddy allocator over the RAM reported by hal_mem_usable(), minus
+ * everything in hal_mem_reserved().  Blocks are 2^order pages; allocation
+ * and free are O(PMM_MAX_ORDER), i.e. constant time.
+ *
+ * Physical addresses are returned as uint64_t; 0 means "out of memory"
+ * (physical page 0 is always reserved on every supported architecture).
+ * All entry points are safe to call from any CPU and from IRQ context.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#define PAGE_SHIFT     12
+#define PAGE_SIZE      ((uint64_t)1 << PAGE_SHIFT)
+#define PMM_MAX_ORDER  11           /* largest block: 2^10 pages = 4 MB    */
+
+/* Physical ↔ kernel-virtual.  RAM is identity-mapped by the kernel page
+ * tables (x86_64 paging.c, arm64 mmu.c). */
+static inline void *phys_to_virt(uint64_t pa)
+{
+    return (void *)(uintptr_t)pa;
+}
+
+static inline uint64_t virt_to_phys(const void *va)
+{
+    return (uint64_t)(uintptr_t)va;
+}
+
+/* Build the free lists from the HAL memory map.  Call once, after
+ * hal_hw_detect(). */
+void     pmm_init(void);
+
+uint64_t pmm_alloc_pages(uint32_t order);
+void     pmm_free_pages(uint64_t pa, uint32_t order);
+
+/* Memory pressure: when an allocation finds the free lists empty, fn is
+ * asked to give back at least `pages` frames (the page cache dropping
+ * clean pages) and the allocation is retried once.  fn runs in the
+ * allocating context, IRQ included, and must not allocate itself.
+ * Returns the frames it freed. */
+typedef uint64_t (*pmm_reclaim_fn_t)(uint64_t pages);
+void     pmm_set_reclaim(pmm_reclaim_fn_t fn);
+
+static inline uint64_t pmm_alloc_page(void)       { return pmm_alloc_pages(0); }
+static inline void     pmm_free_page(uint64_t pa) { pmm_free_pages(pa, 0); }
+
+/* Owner tag for an allocated frame (0x00-0x7F).  Lets kfree() find out
+ * what kind of allocation a page belongs to without a separate table.
+ * Tags are only meaningful while the frame is allocated. */
+void     pmm_set_tag(uint64_t pa, uint8_t tag);
+uint8_t  pmm_get_tag(uint64_t pa);
+
+uint64_t pmm_total_bytes(void);     /* bytes handed to the allocator      */
+uint64_t pmm_free_bytes(void);      /* bytes currently free               */
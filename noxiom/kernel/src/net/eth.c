@@ -0,0 +1,48 @@
+/* kernel/src/net/eth.c — Ethernet framing
+ *
+ * Frames not addressed to the device's MAC, broadcast or a multicast
+ * group are dropped here (the device may be promiscuous); IPv6 needs
+ * the multicast ones for neighbour discovery.
+ */
+#include "inet.h"
+#include "../string.h"
+
+void eth_input(netdev_t *dev, netbuf_t *nb)
+{
+    if (!dev || nb->len < ETH_HLEN) {
+        netbuf_free(nb);
+        return;
+    }
+    const eth_hdr_t *eth = (const eth_hdr_t *)nb->data;
+    if (!(eth->dst[0] & 1) && kmemcmp(eth->dst, dev->mac, 6) != 0) {
+        netbuf_free(nb);
+        return;
+    }
+
+    nb->proto = ntohs(eth->proto);
+    netbuf_pull(nb, ETH_HLEN);
+    switch (nb->proto) {
+    case ETH_P_IP:   ipv4_input(dev, nb); break;
+    case ETH_P_IPV6: ipv6_input(dev, nb); break;
+    case ETH_P_ARP:  arp_input(dev, nb);  break;
+    default:         netbuf_free(nb);     break;
+    }
+}
+
+int eth_output(netdev_t *dev, netbuf_t *nb, const uint8_t dst[6],
+               uint16_t proto, int more)
+{
+    eth_hdr_t *eth = netbuf_push(nb, ETH_HLEN);
+    if (!eth) {
+        netbuf_free(nb);
+        return -1;
+    }
+    kmemcpy(eth->dst, dst, 6);
+    kmemcpy(eth->src, dev->mac, 6);
+    eth->proto = htons(proto);
+    if (netdev_xmit(dev, nb, more) != 0) {
+        netbuf_free(nb);
+        return -1;
+    }
+    return 0;
+}
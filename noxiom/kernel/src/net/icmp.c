@@ -0,0 +1,152 @@
+/* kernel/src/net/icmp.c — ICMP echo for both families and net_ping()
+ *
+ * Echo requests are answered in the request's own buffer: the ICMP
+ * header is rewritten, the data stays where the device put it, and a
+ * fresh IP header goes in front.  ICMPv6 requests arrive here through
+ * icmpv6_input() (ipv6.c), which also does neighbour discovery.
+ *
+ * net_ping() callers wait in a small table that replies are matched
+ * against by (address, id, seq).
+ */
+#include "inet.h"
+#include "../sched/sched.h"
+#include "../string.h"
+#include "../hal.h"
+
+#define PING_SLOTS    8
+#define PING_MAX_DATA 1024
+
+typedef struct {
+    ip_addr_t          dst;
+    uint16_t           id, seq;
+    thread_t          *waiter;
+    volatile uint32_t  done;
+    uint64_t           t_reply;
+} ping_wait_t;
+
+static ping_wait_t *s_pings[PING_SLOTS];
+static spinlock_t   s_ping_lock = SPINLOCK_INIT;
+static uint16_t     s_ping_id;
+
+/* v6 carries the pseudo-header in its checksum, v4 does not */
+void icmp_echo_reply(netbuf_t *nb, const ip_addr_t *src)
+{
+    net_route_t rt;
+    if (net_route(src, &rt) != 0) {
+        netbuf_free(nb);
+        return;
+    }
+    icmp_hdr_t *h = (icmp_hdr_t *)nb->data;
+    uint8_t proto;
+    uint32_t sum = 0;
+    if (src->family == NET_AF_INET6) {
+        h->type = ICMPV6_ECHO_REPLY;
+        proto   = IP_PROTO_ICMPV6;
+        sum     = inet_pseudo_sum(&rt.src, src, proto, nb->total);
+    } else {
+        h->type = ICMP_ECHO_REPLY;
+        proto   = IP_PROTO_ICMP;
+    }
+    h->code = 0;
+    h->csum = 0;
+    h->csum = inet_csum_fold(inet_csum_chain(sum, nb, 0, nb->total));
+    ip_output(&rt, src, nb, proto, 0);
+}
+
+void icmp_input(netdev_t *dev, netbuf_t *nb, const ipv4_hdr_t *ip)
+{
+    (void)dev;
+    const icmp_hdr_t *h = (const icmp_hdr_t *)nb->data;
+    if (nb->len < sizeof(*h) ||
+        inet_csum_fold(inet_csum_chain(0, nb, 0, nb->total)) != 0) {
+        netbuf_free(nb);
+        return;
+    }
+
+    ip_addr_t src;
+    ip_addr_set4(&src, ip->src);
+    if (h->type == ICMP_ECHO_REQUEST && h->code == 0) {
+        icmp_echo_reply(nb, &src);
+        return;
+    }
+    if (h->type == ICMP_ECHO_REPLY)
+        ping_input(&src, ntohs(h->id), ntohs(h->seq));
+    netbuf_free(nb);
+}
+
+void ping_input(const ip_addr_t *src, uint16_t id, uint16_t seq)
+{
+    uint64_t now = hal_timer_now_ns();
+    uint64_t flags = spin_lock_irqsave(&s_ping_lock);
+    for (uint32_t i = 0; i < PING_SLOTS; i++) {
+        ping_wait_t *w = s_pings[i];
+        if (w && !w->done && w->id == id && w->seq == seq &&
+            ip_addr_eq(&w->dst, src)) {
+            w->t_reply = now;
+            __atomic_store_n(&w->done, 1, __ATOMIC_RELEASE);
+            thread_wake(w->waiter);
+        }
+    }
+    spin_unlock_irqrestore(&s_ping_lock, flags);
+}
+
+int net_ping(const ip_addr_t *dst, uint16_t seq, uint32_t payload,
+             uint64_t timeout_ns, uint64_t *rtt_ns)
+{
+    net_route_t rt;
+    if (payload > PING_MAX_DATA || net_route(dst, &rt) != 0)
+        return -1;
+
+    ping_wait_t w = {
+        .dst    = *dst,
+        .id     = __atomic_add_fetch(&s_ping_id, 1, __ATOMIC_RELAXED),
+        .seq    = seq,
+        .waiter = thread_current(),
+    };
+    uint64_t flags = spin_lock_irqsave(&s_ping_lock);
+    int slot = -1;
+    for (uint32_t i = 0; i < PING_SLOTS && slot < 0; i++)
+        if (!s_pings[i])
+            slot = (int)i;
+    if (slot >= 0)
+        s_pings[slot] = &w;
+    spin_unlock_irqrestore(&s_ping_lock, flags);
+    if (slot < 0)
+        return -1;
+
+    int rc = -1;
+    netbuf_t *nb = netbuf_alloc();
+    if (nb) {
+        icmp_hdr_t *h = netbuf_put(nb, sizeof(*h) + payload);
+        uint8_t proto = dst->family == NET_AF_INET6 ? IP_PROTO_ICMPV6
+                                                    : IP_PROTO_ICMP;
+        h->type = proto == IP_PROTO_ICMPV6 ? ICMPV6_ECHO_REQUEST
+                                           : ICMP_ECHO_REQUEST;
+        h->code = 0;
+        h->csum = 0;
+        h->id   = htons(w.id);
+        h->seq  = htons(seq);
+        for (uint32_t i = 0; i < payload; i++)
+            ((uint8_t *)(h + 1))[i] = (uint8_t)i;
+        uint32_t sum = proto == IP_PROTO_ICMPV6
+                     ? inet_pseudo_sum(&rt.src, dst, proto, nb->total) : 0;
+        h->csum = inet_csum_fold(inet_csum_add(sum, h, nb->total));
+
+        uint64_t start = hal_timer_now_ns();
+        uint64_t deadline = start + timeout_ns;
+        if (ip_output(&rt, dst, nb, proto, 0) == 0) {
+            while (!__atomic_load_n(&w.done, __ATOMIC_ACQUIRE) &&
+                   hal_timer_now_ns() < deadline)
+                thread_block_until(deadline);
+        }
+        if (__atomic_load_n(&w.done, __ATOMIC_ACQUIRE)) {
+            *rtt_ns = w.t_reply - start;
+            rc = 0;
+        }
+    }
+
+    flags = spin_lock_irqsave(&s_ping_lock);
+    s_pings[slot] = 0;
+    spin_unlock_irqrestore(&s_ping_lock, flags);
+    return rc;
+}
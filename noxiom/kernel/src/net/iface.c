@@ -0,0 +1,190 @@
+/* kernel/src/net/iface.c — interface addresses and routing
+ *
+ * Each device's configuration is one net_if_cfg_t behind an RCU
+ * pointer: the packet path reads it without a lock, and
+ * net_if_set_addr() publishes a modified copy and frees the old one
+ * after a grace period.
+ *
+ * Routing is the minimum a host needs: a destination inside a
+ * configured prefix is reached directly on that interface, IPv6
+ * link-local destinations on the first interface, anything else via
+ * the first interface with a gateway of the right family.
+ */
+#include "inet.h"
+#include "../sync/rcu.h"
+#include "../mm/kmalloc.h"
+#include "../string.h"
+#include "../log/klog.h"
+
+static net_if_cfg_t *s_cfg[NETDEV_MAX];
+static spinlock_t    s_cfg_lock = SPINLOCK_INIT;   /* writers */
+
+static int dev_slot(const netdev_t *dev)
+{
+    for (uint32_t i = 0; i < netdev_count(); i++)
+        if (netdev_get(i) == dev)
+            return (int)i;
+    return -1;
+}
+
+const net_if_cfg_t *net_if_cfg(const netdev_t *dev)
+{
+    int i = dev_slot(dev);
+    return i < 0 ? 0 : rcu_dereference(s_cfg[i]);
+}
+
+void net_if_get(const netdev_t *dev, net_if_cfg_t *out)
+{
+    rcu_read_lock();
+    const net_if_cfg_t *c = net_if_cfg(dev);
+    if (c)
+        *out = *c;
+    else
+        kmemset(out, 0, sizeof(*out));
+    rcu_read_unlock();
+}
+
+void net_if_attach(netdev_t *dev)
+{
+    int i = dev_slot(dev);
+    net_if_cfg_t *c = kzalloc(sizeof(*c));
+    if (i < 0 || !c) {
+        kfree(c);
+        return;
+    }
+
+    /* fe80::/64 with the modified EUI-64 of the MAC */
+    uint8_t ll[16] = { 0xFE, 0x80 };
+    ll[8]  = dev->mac[0] ^ 0x02;
+    ll[9]  = dev->mac[1];
+    ll[10] = dev->mac[2];
+    ll[11] = 0xFF;
+    ll[12] = 0xFE;
+    ll[13] = dev->mac[3];
+    ll[14] = dev->mac[4];
+    ll[15] = dev->mac[5];
+    ip_addr_set6(&c->ll6, ll);
+    rcu_assign_pointer(s_cfg[i], c);
+}
+
+int net_if_set_addr(netdev_t *dev, const ip_addr_t *a, uint32_t prefix,
+                    const ip_addr_t *gw)
+{
+    int i = dev_slot(dev);
+    uint32_t max = a->family == NET_AF_INET6 ? 128 : 32;
+    if (i < 0 || prefix > max || (gw && gw->family != a->family))
+        return -1;
+    net_if_cfg_t *c = kmalloc(sizeof(*c));
+    if (!c)
+        return -1;
+
+    uint64_t flags = spin_lock_irqsave(&s_cfg_lock);
+    net_if_cfg_t *old = s_cfg[i];
+    if (!old) {
+        spin_unlock_irqrestore(&s_cfg_lock, flags);
+        kfree(c);
+        return -1;
+    }
+    *c = *old;
+    if (a->family == NET_AF_INET6) {
+        c->addr6   = *a;
+        c->prefix6 = (uint8_t)prefix;
+        if (gw)
+            c->gw6 = *gw;
+        else
+            kmemset(&c->gw6, 0, sizeof(c->gw6));
+    } else {
+        c->addr4   = *a;
+        c->prefix4 = (uint8_t)prefix;
+        if (gw)
+            c->gw4 = *gw;
+        else
+            kmemset(&c->gw4, 0, sizeof(c->gw4));
+    }
+    rcu_assign_pointer(s_cfg[i], c);
+    spin_unlock_irqrestore(&s_cfg_lock, flags);
+
+    synchronize_rcu();
+    kfree(old);
+
+    char buf[40];
+    ip_format(a, buf, sizeof(buf));
+    klog("[net] %s: %s/%u", dev->name, buf, prefix);
+    return 0;
+}
+
+int net_if_is_local(const netdev_t *dev, const ip_addr_t *a)
+{
+    const net_if_cfg_t *c = net_if_cfg(dev);
+    if (!c)
+        return 0;
+    if (a->family == NET_AF_INET)
+        return ip_addr_eq(a, &c->addr4);
+    return ip_addr_eq(a, &c->ll6) || ip_addr_eq(a, &c->addr6);
+}
+
+/* ── Routing ─────────────────────────────────────────────────────────── */
+
+static int prefix_match(const ip_addr_t *a, const ip_addr_t *b,
+                        uint32_t prefix)
+{
+    if (a->family != b->family)
+        return 0;
+    uint32_t bytes = prefix / 8, bits = prefix % 8;
+    if (kmemcmp(a->b, b->b, bytes) != 0)
+        return 0;
+    if (!bits)
+        return 1;
+    uint8_t mask = (uint8_t)(0xFF << (8 - bits));
+    return (a->b[bytes] & mask) == (b->b[bytes] & mask);
+}
+
+static int is_link_local6(const ip_addr_t *a)
+{
+    return a->family == NET_AF_INET6 && a->b[0] == 0xFE &&
+           (a->b[1] & 0xC0) == 0x80;
+}
+
+int net_route(const ip_addr_t *dst, net_route_t *rt)
+{
+    int found = 0;
+    rcu_read_lock();
+
+    /* Directly reachable first, then the first default route */
+    for (int pass = 0; pass < 2 && !found; pass++) {
+        for (uint32_t i = 0; i < netdev_count() && !found; i++) {
+            const net_if_cfg_t *c = rcu_dereference(s_cfg[i]);
+            if (!c)
+                continue;
+            const ip_addr_t *src = 0, *hop = 0;
+            if (dst->family == NET_AF_INET && c->addr4.family) {
+                src = &c->addr4;
+                if (pass == 0 && prefix_match(dst, &c->addr4, c->prefix4))
+                    hop = dst;
+                else if (pass == 1 && c->gw4.family)
+                    hop = &c->gw4;
+            } else if (dst->family == NET_AF_INET6) {
+                if (pass == 0 && is_link_local6(dst)) {
+                    src = &c->ll6;
+                    hop = dst;
+                } else if (c->addr6.family) {
+                    src = &c->addr6;
+                    if (pass == 0 &&
+                        prefix_match(dst, &c->addr6, c->prefix6))
+                        hop = dst;
+                    else if (pass == 1 && c->gw6.family)
+                        hop = &c->gw6;
+                }
+            }
+            if (hop) {
+                rt->dev     = netdev_get(i);
+                rt->src     = *src;
+                rt->nexthop = *hop;
+                found = 1;
+            }
+        }
+    }
+
+    rcu_read_unlock();
+    return found ? 0 : -1;
+}
@@ -0,0 +1,256 @@
+/* kernel/src/net/inet.c — checksums and address helpers
+ *
+ * inet_csum_add() sums 32 bits at a time into a 64-bit accumulator and
+ * folds once at the end, which is as fast as a portable C loop gets
+ * without checksum offload.  Runs of INET_CSUM_SIMD_MIN bytes or more
+ * go through hal_simd_sum32() a 64-byte block at a time instead, in a
+ * kernel FP section, which only pays for itself past a few cache lines.
+ */
+#include "inet.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../sched/fpu.h"
+
+#define INET_CSUM_SIMD_MIN  256
+
+/* ── Checksums ───────────────────────────────────────────────────────── */
+
+static uint32_t fold32(uint64_t s)
+{
+    s = (s & 0xFFFFFFFFu) + (s >> 32);
+    s = (s & 0xFFFFFFFFu) + (s >> 32);
+    uint32_t v = (uint32_t)s;
+    v = (v & 0xFFFF) + (v >> 16);
+    return (v & 0xFFFF) + (v >> 16);
+}
+
+uint32_t inet_csum_add(uint32_t sum, const void *data, uint32_t len)
+{
+    const uint8_t *p = data;
+    uint64_t s = 0;
+
+    /* Native-order words: the one's-complement sum is byte-order
+     * independent up to a final swap of the folded result */
+    if (len >= INET_CSUM_SIMD_MIN) {
+        uint32_t bulk = len & ~63u;
+        uint64_t flags = kernel_fpu_begin();
+        s += hal_simd_sum32(p, bulk);
+        kernel_fpu_end(flags);
+        p += bulk;
+        len -= bulk;
+    }
+    while (len >= 4) {
+        uint32_t w;
+        kmemcpy(&w, p, 4);
+        s += w;
+        p += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        uint16_t w;
+        kmemcpy(&w, p, 2);
+        s += w;
+        p += 2;
+        len -= 2;
+    }
+    if (len)
+        s += *p;                    /* low byte first: little-endian     */
+
+    uint32_t v = fold32(s);
+    v = __builtin_bswap16((uint16_t)v);    /* to big-endian word values  */
+    return sum + v;
+}
+
+uint32_t inet_csum_chain(uint32_t sum, const netbuf_t *nb, uint32_t off,
+                         uint32_t len)
+{
+    uint32_t pos = 0;               /* bytes summed so far               */
+    for (; nb && len; nb = nb->next) {
+        if (off >= nb->len) {
+            off -= nb->len;
+            continue;
+        }
+        uint32_t n = nb->len - off;
+        if (n > len)
+            n = len;
+        uint32_t part = inet_csum_add(0, nb->data + off, n);
+        if (pos & 1) {
+            part = fold32(part);
+            part = __builtin_bswap16((uint16_t)part);
+        }
+        sum += part;
+        pos += n;
+        len -= n;
+        off  = 0;
+    }
+    return sum;
+}
+
+uint32_t inet_pseudo_sum(const ip_addr_t *src, const ip_addr_t *dst,
+                         uint8_t proto, uint32_t len)
+{
+    uint32_t alen = ip_addr_len(src);
+    uint32_t sum = inet_csum_add(0, src->b, alen);
+    sum = inet_csum_add(sum, dst->b, alen);
+    return sum + proto + (len >> 16) + (len & 0xFFFF);
+}
+
+/* ── Addresses ───────────────────────────────────────────────────────── */
+
+int ip_addr_eq(const ip_addr_t *a, const ip_addr_t *b)
+{
+    if (a->family != b->family)
+        return 0;
+    if (a->family == NET_AF_INET)
+        return a->w[0] == b->w[0];
+    return a->w[0] == b->w[0] && a->w[1] == b->w[1] &&
+           a->w[2] == b->w[2] && a->w[3] == b->w[3];
+}
+
+void ip_addr_set4(ip_addr_t *a, const uint8_t v4[4])
+{
+    kmemset(a, 0, sizeof(*a));
+    a->family = NET_AF_INET;
+    kmemcpy(a->b, v4, 4);
+}
+
+void ip_addr_set6(ip_addr_t *a, const uint8_t v6[16])
+{
+    a->family = NET_AF_INET6;
+    kmemcpy(a->b, v6, 16);
+}
+
+static int hexval(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int parse4(const char *s, uint8_t out[4])
+{
+    for (int i = 0; i < 4; i++) {
+        uint32_t v = 0, digits = 0;
+        while (*s >= '0' && *s <= '9' && digits < 4) {
+            v = v * 10 + (uint32_t)(*s++ - '0');
+            digits++;
+        }
+        if (!digits || v > 255)
+            return -1;
+        out[i] = (uint8_t)v;
+        if (i < 3 && *s++ != '.')
+            return -1;
+    }
+    return *s ? -1 : 0;
+}
+
+static int parse6(const char *s, uint8_t out[16])
+{
+    uint16_t head[8], tail[8];
+    uint32_t nhead = 0, ntail = 0;
+    int gap = 0;
+
+    if (s[0] == ':' && s[1] == ':') {
+        gap = 1;
+        s += 2;
+    }
+    while (*s) {
+        uint32_t v = 0, digits = 0;
+        int h;
+        while ((h = hexval(*s)) >= 0 && digits < 4) {
+            v = v << 4 | (uint32_t)h;
+            s++;
+            digits++;
+        }
+        if (!digits || nhead + ntail == 8)
+            return -1;
+        if (gap)
+            tail[ntail++] = (uint16_t)v;
+        else
+            head[nhead++] = (uint16_t)v;
+        if (!*s)
+            break;
+        if (*s++ != ':')
+            return -1;
+        if (*s == ':') {
+            if (gap)
+                return -1;          /* a second "::"                     */
+            gap = 1;
+            s++;
+        } else if (!*s) {
+            return -1;              /* trailing single ':'               */
+        }
+    }
+    if (gap ? nhead + ntail > 7 : nhead != 8)
+        return -1;
+
+    kmemset(out, 0, 16);
+    for (uint32_t i = 0; i < nhead; i++) {
+        out[2 * i]     = (uint8_t)(head[i] >> 8);
+        out[2 * i + 1] = (uint8_t)head[i];
+    }
+    for (uint32_t i = 0; i < ntail; i++) {
+        uint32_t g = 8 - ntail + i;
+        out[2 * g]     = (uint8_t)(tail[i] >> 8);
+        out[2 * g + 1] = (uint8_t)tail[i];
+    }
+    return 0;
+}
+
+int ip_parse(const char *s, ip_addr_t *out)
+{
+    uint8_t b[16];
+    for (const char *p = s; *p; p++) {
+        if (*p == ':') {
+            if (parse6(s, b) != 0)
+                return -1;
+            ip_addr_set6(out, b);
+            return 0;
+        }
+    }
+    if (parse4(s, b) != 0)
+        return -1;
+    ip_addr_set4(out, b);
+    return 0;
+}
+
+void ip_format(const ip_addr_t *a, char *buf, uint32_t size)
+{
+    if (a->family == NET_AF_INET) {
+        ksnprintf(buf, size, "%u.%u.%u.%u", a->b[0], a->b[1], a->b[2],
+                  a->b[3]);
+        return;
+    }
+    if (a->family != NET_AF_INET6) {
+        ksnprintf(buf, size, "-");
+        return;
+    }
+
+    /* RFC 5952: the longest run of two or more zero groups becomes "::" */
+    uint16_t g[8];
+    for (int i = 0; i < 8; i++)
+        g[i] = (uint16_t)(a->b[2 * i] << 8 | a->b[2 * i + 1]);
+    int best = -1, best_len = 1;
+    for (int i = 0; i < 8; ) {
+        int j = i;
+        while (j < 8 && g[j] == 0)
+            j++;
+        if (j - i > best_len) {
+            best     = i;
+            best_len = j - i;
+        }
+        i = j > i ? j : i + 1;
+    }
+
+    uint32_t n = 0;
+    for (int i = 0; i < 8 && n < size; i++) {
+        if (i == best) {
+            n += (uint32_t)ksnprintf(buf + n, size - n, "::");
+            i += best_len - 1;
+            continue;
+        }
+        n += (uint32_t)ksnprintf(buf + n, size - n, "%s%x",
+                                 n && buf[n - 1] != ':' ? ":" : "", g[i]);
+    }
+}
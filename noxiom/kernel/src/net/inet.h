@@ -0,0 +1,233 @@
+#pragma once
+/* net/inet.h — wire formats, checksums and the interfaces between the
+ * layers of the TCP/IP stack
+ *
+ * Private to kernel/src/net: everything outside the stack goes through
+ * net.h.  Headers are declared exactly as they sit on the wire (packed,
+ * big-endian fields); only the code that reads or builds them converts.
+ *
+ * Checksums are RFC 1071 one's-complement sums kept unfolded in a
+ * uint32_t while they are being accumulated, in host order of the
+ * big-endian 16-bit words, so partial sums over separate pieces (pseudo
+ * header, header, payload fragments) simply add.  A piece that starts
+ * at an odd offset of the checksummed range has its sum byte-swapped,
+ * which inet_csum_chain() does for fragment boundaries that fall on odd
+ * offsets.
+ */
+#include <stdint.h>
+#include "net.h"
+
+/* ── Byte order (both arches are little-endian) ──────────────────────── */
+
+static inline uint16_t htons(uint16_t v) { return __builtin_bswap16(v); }
+static inline uint16_t ntohs(uint16_t v) { return __builtin_bswap16(v); }
+static inline uint32_t htonl(uint32_t v) { return __builtin_bswap32(v); }
+static inline uint32_t ntohl(uint32_t v) { return __builtin_bswap32(v); }
+
+/* ── Wire formats ────────────────────────────────────────────────────── */
+
+#define ETH_HLEN          14
+#define ETH_P_IP          0x0800
+#define ETH_P_ARP         0x0806
+#define ETH_P_IPV6        0x86DD
+
+#define IP_PROTO_ICMP     1
+#define IP_PROTO_TCP      6
+#define IP_PROTO_UDP      17
+#define IP_PROTO_ICMPV6   58
+
+typedef struct __attribute__((packed)) {
+    uint8_t  dst[6];
+    uint8_t  src[6];
+    uint16_t proto;
+} eth_hdr_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t htype, ptype;
+    uint8_t  hlen, plen;
+    uint16_t op;
+    uint8_t  sha[6], spa[4];
+    uint8_t  tha[6], tpa[4];
+} arp_hdr_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t  ver_ihl;
+    uint8_t  tos;
+    uint16_t len;
+    uint16_t id;
+    uint16_t frag;                  /* flags | fragment offset           */
+    uint8_t  ttl;
+    uint8_t  proto;
+    uint16_t csum;
+    uint8_t  src[4];
+    uint8_t  dst[4];
+} ipv4_hdr_t;
+
+#define IPV4_DF           0x4000
+#define IPV4_MF           0x2000
+#define IPV4_OFFSET       0x1FFF
+
+typedef struct __attribute__((packed)) {
+    uint32_t ver_tc_flow;
+    uint16_t len;                   /* payload, without this header      */
+    uint8_t  next;
+    uint8_t  hop_limit;
+    uint8_t  src[16];
+    uint8_t  dst[16];
+} ipv6_hdr_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t  type;
+    uint8_t  code;
+    uint16_t csum;
+    uint16_t id;                    /* echo only                         */
+    uint16_t seq;
+} icmp_hdr_t;
+
+#define ICMP_ECHO_REPLY     0
+#define ICMP_ECHO_REQUEST   8
+#define ICMPV6_ECHO_REQUEST 128
+#define ICMPV6_ECHO_REPLY   129
+#define ICMPV6_NS           135
+#define ICMPV6_NA           136
+
+typedef struct __attribute__((packed)) {
+    uint16_t sport, dport;
+    uint16_t len;
+    uint16_t csum;
+} udp_hdr_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t sport, dport;
+    uint32_t seq;
+    uint32_t ack;
+    uint8_t  off;                   /* data offset << 4                  */
+    uint8_t  flags;
+    uint16_t win;
+    uint16_t csum;
+    uint16_t urg;
+} tcp_hdr_t;
+
+#define TCP_FIN  0x01
+#define TCP_SYN  0x02
+#define TCP_RST  0x04
+#define TCP_PSH  0x08
+#define TCP_ACK  0x10
+
+/* Headers in front of a TCP or UDP payload at most, for headroom checks */
+#define INET_MAX_HDRS  (ETH_HLEN + (uint32_t)sizeof(ipv6_hdr_t) + 60)
+
+/* ── Checksums ───────────────────────────────────────────────────────── */
+
+uint32_t inet_csum_add(uint32_t sum, const void *data, uint32_t len);
+/* len bytes of the chain starting off bytes into it */
+uint32_t inet_csum_chain(uint32_t sum, const netbuf_t *nb, uint32_t off,
+                         uint32_t len);
+uint32_t inet_pseudo_sum(const ip_addr_t *src, const ip_addr_t *dst,
+                         uint8_t proto, uint32_t len);
+
+/* The value for the checksum field (network order) */
+static inline uint16_t inet_csum_fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return htons((uint16_t)~sum);
+}
+
+/* ── Addresses and routes ────────────────────────────────────────────── */
+
+static inline uint32_t ip_addr_len(const ip_addr_t *a)
+{
+    return a->family == NET_AF_INET6 ? 16 : 4;
+}
+
+int  ip_addr_eq(const ip_addr_t *a, const ip_addr_t *b);
+void ip_addr_set4(ip_addr_t *a, const uint8_t v4[4]);
+void ip_addr_set6(ip_addr_t *a, const uint8_t v6[16]);
+
+typedef struct {
+    netdev_t *dev;
+    ip_addr_t src;                  /* our address on dev                */
+    ip_addr_t nexthop;              /* dst itself or the gateway         */
+} net_route_t;
+
+/* Give dev its link-local address (net_init(), once per device) */
+void net_if_attach(netdev_t *dev);
+/* 0, or -1 if no configured interface reaches dst */
+int  net_route(const ip_addr_t *dst, net_route_t *rt);
+/* The RCU-protected configuration of dev; inside rcu_read_lock() */
+const net_if_cfg_t *net_if_cfg(const netdev_t *dev);
+/* 1 if a is one of dev's unicast addresses */
+int  net_if_is_local(const netdev_t *dev, const ip_addr_t *a);
+
+/* ── Layer entry points ──────────────────────────────────────────────── */
+
+/* Receive, on the flow's owner CPU; each takes ownership of nb, whose
+ * data starts at the layer's own header */
+void eth_input(netdev_t *dev, netbuf_t *nb);
+void arp_input(netdev_t *dev, netbuf_t *nb);
+void ipv4_input(netdev_t *dev, netbuf_t *nb);
+void ipv6_input(netdev_t *dev, netbuf_t *nb);
+void icmp_input(netdev_t *dev, netbuf_t *nb, const ipv4_hdr_t *ip);
+void icmpv6_input(netdev_t *dev, netbuf_t *nb, const ipv6_hdr_t *ip);
+void udp_input(netdev_t *dev, netbuf_t *nb, const ip_addr_t *src,
+               const ip_addr_t *dst);
+void tcp_input(netdev_t *dev, netbuf_t *nb, const ip_addr_t *src,
+               const ip_addr_t *dst);
+void ping_input(const ip_addr_t *src, uint16_t id, uint16_t seq);
+/* Turn the echo request in nb (data at the ICMP header) into the reply
+ * to src and send it */
+void icmp_echo_reply(netbuf_t *nb, const ip_addr_t *src);
+
+/* Send: nb holds the transport header and payload and has headroom for
+ * the rest.  Each consumes nb and returns 0, or -1 if it went nowhere.
+ * `more` as for netdev_xmit(). */
+int  ip_output(const net_route_t *rt, const ip_addr_t *dst, netbuf_t *nb,
+               uint8_t proto, int more);
+int  ipv4_output(const net_route_t *rt, const ip_addr_t *dst, netbuf_t *nb,
+                 uint8_t proto, int more);
+int  ipv6_output(const net_route_t *rt, const ip_addr_t *dst, netbuf_t *nb,
+                 uint8_t proto, uint8_t hop_limit, int more);
+int  eth_output(netdev_t *dev, netbuf_t *nb, const uint8_t dst[6],
+                uint16_t proto, int more);
+
+/* ── Neighbours (ARP and IPv6 ND share one cache) ────────────────────── */
+
+void neigh_init(uint32_t entries);
+/* Send nb to nexthop on dev, resolving its MAC first if need be: the
+ * last packet sent to an unresolved neighbour waits for the answer */
+int  neigh_output(netdev_t *dev, const ip_addr_t *nexthop, netbuf_t *nb,
+                  uint16_t proto, int more);
+/* Learn or refresh addr → mac.  create = 0: only update an existing
+ * entry (unsolicited traffic must not fill the cache). */
+void neigh_update(netdev_t *dev, const ip_addr_t *addr, const uint8_t mac[6],
+                  int create);
+void arp_solicit(netdev_t *dev, const ip_addr_t *target);
+void ndisc_solicit(netdev_t *dev, const ip_addr_t *target);
+
+/* ── Stack core (netcore.c) ──────────────────────────────────────────── */
+
+/* Hash of a flow's endpoints (local side first); net_flow_cpu() maps
+ * it to the CPU that owns the flow */
+uint32_t net_flow_hash(const ip_addr_t *laddr, const ip_addr_t *raddr,
+                       uint16_t lport, uint16_t rport);
+uint32_t net_flow_cpu(uint32_t hash);
+
+/* Deferred work, run on a CPU's worker thread.  Posting an item that is
+ * still queued does nothing (returns 0); the flag is cleared before fn
+ * runs, so a post from inside fn queues it again.  Any context. */
+typedef struct net_work {
+    struct net_work   *next;
+    void             (*fn)(struct net_work *w);
+    volatile uint32_t  queued;
+} net_work_t;
+
+int  net_work_post(net_work_t *w, uint32_t cpu);
+
+void tcp_init(const net_limits_t *lim);
+
+/* This CPU's counters.  Atomic adds: a preemptible thread may migrate
+ * between picking the slot and the add, so two CPUs can share one. */
+net_stats_t *net_stats_this(void);
+#define NET_STAT(f)  (__atomic_fetch_add(&net_stats_this()->f, 1, \
+                                         __ATOMIC_RELAXED))
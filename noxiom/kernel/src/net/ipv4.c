@@ -0,0 +1,100 @@
+/* kernel/src/net/ipv4.c — IPv4 input and output
+ *
+ * Fragments and IP options are not supported: fragments are dropped,
+ * options are skipped on input and never sent.  Everything goes out
+ * with DF set and ID 0 (RFC 6864), so no shared ID counter is needed;
+ * TCP's MSS and UDP's size check keep packets within the MTU.
+ */
+#include "inet.h"
+#include "../sync/rcu.h"
+#include "../string.h"
+
+#define IPV4_TTL  64
+
+static int accept_dst(const netdev_t *dev, const uint8_t dst[4])
+{
+    static const uint8_t bcast[4] = { 255, 255, 255, 255 };
+    if (kmemcmp(dst, bcast, 4) == 0)
+        return 1;
+
+    rcu_read_lock();
+    const net_if_cfg_t *c = net_if_cfg(dev);
+    int ok = 0;
+    if (c && c->addr4.family) {
+        uint32_t host = c->prefix4 >= 32 ? 0 : 0xFFFFFFFFu >> c->prefix4;
+        uint32_t a, ours;
+        kmemcpy(&a, dst, 4);
+        kmemcpy(&ours, c->addr4.b, 4);
+        a = ntohl(a);
+        ours = ntohl(ours);
+        ok = a == ours || (host && a == (ours | host));
+    }
+    rcu_read_unlock();
+    return ok;
+}
+
+void ipv4_input(netdev_t *dev, netbuf_t *nb)
+{
+    const ipv4_hdr_t *ip = (const ipv4_hdr_t *)nb->data;
+    uint32_t hlen;
+    if (nb->len < sizeof(*ip) || (ip->ver_ihl >> 4) != 4 ||
+        (hlen = (ip->ver_ihl & 0xF) * 4u) < sizeof(*ip) || hlen > nb->len ||
+        inet_csum_fold(inet_csum_add(0, ip, hlen)) != 0)
+        goto drop;
+
+    uint32_t total = ntohs(ip->len);
+    if (total < hlen || total > nb->total)
+        goto drop;
+    if (ntohs(ip->frag) & (IPV4_MF | IPV4_OFFSET))
+        goto drop;
+    if (!accept_dst(dev, ip->dst))
+        goto drop;
+    NET_STAT(rx_ip);
+
+    ip_addr_t src, dst;
+    ip_addr_set4(&src, ip->src);
+    ip_addr_set4(&dst, ip->dst);
+    netbuf_trim(nb, total);
+    netbuf_pull(nb, hlen);
+
+    switch (ip->proto) {
+    case IP_PROTO_ICMP: icmp_input(dev, nb, ip);            return;
+    case IP_PROTO_TCP:  tcp_input(dev, nb, &src, &dst);     return;
+    case IP_PROTO_UDP:  udp_input(dev, nb, &src, &dst);     return;
+    }
+drop:
+    NET_STAT(rx_drop);
+    netbuf_free(nb);
+}
+
+int ipv4_output(const net_route_t *rt, const ip_addr_t *dst, netbuf_t *nb,
+                uint8_t proto, int more)
+{
+    ipv4_hdr_t *ip = netbuf_push(nb, sizeof(*ip));
+    if (!ip) {
+        netbuf_free(nb);
+        return -1;
+    }
+    ip->ver_ihl = 0x45;
+    ip->tos     = 0;
+    ip->len     = htons((uint16_t)nb->total);
+    ip->id      = 0;
+    ip->frag    = htons(IPV4_DF);
+    ip->ttl     = IPV4_TTL;
+    ip->proto   = proto;
+    ip->csum    = 0;
+    kmemcpy(ip->src, rt->src.b, 4);
+    kmemcpy(ip->dst, dst->b, 4);
+    ip->csum    = inet_csum_fold(inet_csum_add(0, ip, sizeof(*ip)));
+
+    NET_STAT(tx_ip);
+    return neigh_output(rt->dev, &rt->nexthop, nb, ETH_P_IP, more);
+}
+
+int ip_output(const net_route_t *rt, const ip_addr_t *dst, netbuf_t *nb,
+              uint8_t proto, int more)
+{
+    if (dst->family == NET_AF_INET6)
+        return ipv6_output(rt, dst, nb, proto, 64, more);
+    return ipv4_output(rt, dst, nb, proto, more);
+}
@@ -0,0 +1,242 @@
+/* kernel/src/net/ipv6.c — IPv6 input and output, ICMPv6, neighbour
+ * discovery
+ *
+ * A host subset: no extension headers (packets carrying any are
+ * dropped), no router discovery or SLAAC (the global address and
+ * gateway are set with `ifconfig`), and no duplicate address detection.
+ * Neighbour solicitations for our addresses are answered and their
+ * source link-layer option learned; advertisements only update entries
+ * we asked for.
+ */
+#include "inet.h"
+#include "../sync/rcu.h"
+#include "../string.h"
+
+#define ND_HOP_LIMIT   255
+#define ND_OPT_SLLA    1
+#define ND_OPT_TLLA    2
+#define NA_SOLICITED   0x40
+#define NA_OVERRIDE    0x20
+
+typedef struct __attribute__((packed)) {
+    uint8_t  type, code;
+    uint16_t csum;
+    uint8_t  flags;                 /* NA only                           */
+    uint8_t  reserved[3];
+    uint8_t  target[16];
+} nd_msg_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t len;                    /* in units of 8 bytes               */
+    uint8_t mac[6];
+} nd_opt_lla_t;
+
+static const uint8_t s_all_nodes[16] = { 0xFF, 0x02, [15] = 0x01 };
+
+static void solicited_node(const uint8_t a[16], uint8_t out[16])
+{
+    static const uint8_t base[13] = { 0xFF, 0x02, [11] = 0x01, [12] = 0xFF };
+    kmemcpy(out, base, 13);
+    kmemcpy(out + 13, a + 13, 3);
+}
+
+static int accept_dst(const netdev_t *dev, const uint8_t dst[16])
+{
+    if (kmemcmp(dst, s_all_nodes, 16) == 0)
+        return 1;
+    ip_addr_t a;
+    ip_addr_set6(&a, dst);
+
+    rcu_read_lock();
+    const net_if_cfg_t *c = net_if_cfg(dev);
+    int ok = 0;
+    if (c) {
+        uint8_t sn[16];
+        ok = net_if_is_local(dev, &a);
+        for (int i = 0; i < 2 && !ok; i++) {
+            const ip_addr_t *ours = i ? &c->addr6 : &c->ll6;
+            if (ours->family != NET_AF_INET6)
+                continue;
+            solicited_node(ours->b, sn);
+            ok = kmemcmp(dst, sn, 16) == 0;
+        }
+    }
+    rcu_read_unlock();
+    return ok;
+}
+
+void ipv6_input(netdev_t *dev, netbuf_t *nb)
+{
+    const ipv6_hdr_t *ip = (const ipv6_hdr_t *)nb->data;
+    if (nb->len < sizeof(*ip) || (ntohl(ip->ver_tc_flow) >> 28) != 6)
+        goto drop;
+    uint32_t plen = ntohs(ip->len);
+    if (sizeof(*ip) + plen > nb->total || !accept_dst(dev, ip->dst))
+        goto drop;
+    NET_STAT(rx_ip);
+
+    ip_addr_t src, dst;
+    ip_addr_set6(&src, ip->src);
+    ip_addr_set6(&dst, ip->dst);
+    netbuf_trim(nb, sizeof(*ip) + plen);
+    netbuf_pull(nb, sizeof(*ip));
+
+    switch (ip->next) {
+    case IP_PROTO_ICMPV6: icmpv6_input(dev, nb, ip);        return;
+    case IP_PROTO_TCP:    tcp_input(dev, nb, &src, &dst);   return;
+    case IP_PROTO_UDP:    udp_input(dev, nb, &src, &dst);   return;
+    }
+drop:
+    NET_STAT(rx_drop);
+    netbuf_free(nb);
+}
+
+int ipv6_output(const net_route_t *rt, const ip_addr_t *dst, netbuf_t *nb,
+                uint8_t proto, uint8_t hop_limit, int more)
+{
+    uint32_t plen = nb->total;
+    ipv6_hdr_t *ip = netbuf_push(nb, sizeof(*ip));
+    if (!ip) {
+        netbuf_free(nb);
+        return -1;
+    }
+    ip->ver_tc_flow = htonl(6u << 28);
+    ip->len         = htons((uint16_t)plen);
+    ip->next        = proto;
+    ip->hop_limit   = hop_limit;
+    kmemcpy(ip->src, rt->src.b, 16);
+    kmemcpy(ip->dst, dst->b, 16);
+
+    NET_STAT(tx_ip);
+    return neigh_output(rt->dev, &rt->nexthop, nb, ETH_P_IPV6, more);
+}
+
+/* ── ICMPv6 and neighbour discovery ──────────────────────────────────── */
+
+/* The link-layer address option of type `type`, or 0 */
+static const uint8_t *nd_lla(const netbuf_t *nb, uint8_t type)
+{
+    const uint8_t *p = nb->data + sizeof(nd_msg_t);
+    uint32_t left = nb->len - (uint32_t)sizeof(nd_msg_t);
+    while (left >= 8) {
+        uint32_t len = p[1] * 8u;
+        if (!len || len > left)
+            return 0;
+        if (p[0] == type && len == sizeof(nd_opt_lla_t))
+            return ((const nd_opt_lla_t *)p)->mac;
+        p += len;
+        left -= len;
+    }
+    return 0;
+}
+
+static void nd_send(netdev_t *dev, uint8_t type, uint8_t flags,
+                    const ip_addr_t *src, const ip_addr_t *dst,
+                    const ip_addr_t *nexthop, const uint8_t target[16])
+{
+    netbuf_t *nb = netbuf_alloc();
+    if (!nb)
+        return;
+    nd_msg_t *m = netbuf_put(nb, sizeof(*m) + sizeof(nd_opt_lla_t));
+    kmemset(m, 0, sizeof(*m));
+    m->type  = type;
+    m->flags = flags;
+    kmemcpy(m->target, target, 16);
+    nd_opt_lla_t *o = (nd_opt_lla_t *)(m + 1);
+    o->type = type == ICMPV6_NS ? ND_OPT_SLLA : ND_OPT_TLLA;
+    o->len  = 1;
+    kmemcpy(o->mac, dev->mac, 6);
+    m->csum = inet_csum_fold(inet_csum_add(
+        inet_pseudo_sum(src, dst, IP_PROTO_ICMPV6, nb->total), m, nb->total));
+
+    net_route_t rt = { dev, *src, *nexthop };
+    ipv6_output(&rt, dst, nb, IP_PROTO_ICMPV6, ND_HOP_LIMIT, 0);
+}
+
+void ndisc_solicit(netdev_t *dev, const ip_addr_t *target)
+{
+    ip_addr_t src, dst;
+    rcu_read_lock();
+    const net_if_cfg_t *c = net_if_cfg(dev);
+    int ok = c != 0;
+    if (ok)
+        src = c->addr6.family && !(target->b[0] == 0xFE &&
+                                   (target->b[1] & 0xC0) == 0x80)
+            ? c->addr6 : c->ll6;
+    rcu_read_unlock();
+    if (!ok)
+        return;
+
+    uint8_t sn[16];
+    solicited_node(target->b, sn);
+    ip_addr_set6(&dst, sn);
+    nd_send(dev, ICMPV6_NS, 0, &src, &dst, &dst, target->b);
+}
+
+static void nd_input(netdev_t *dev, netbuf_t *nb, const ipv6_hdr_t *ip)
+{
+    const nd_msg_t *m = (const nd_msg_t *)nb->data;
+    if (ip->hop_limit != ND_HOP_LIMIT || m->code != 0 ||
+        nb->len < sizeof(*m))
+        return;
+
+    ip_addr_t target, src;
+    ip_addr_set6(&target, m->target);
+    ip_addr_set6(&src, ip->src);
+
+    if (m->type == ICMPV6_NA) {
+        const uint8_t *mac = nd_lla(nb, ND_OPT_TLLA);
+        if (mac)
+            neigh_update(dev, &target, mac, 0);
+        return;
+    }
+
+    /* Solicitation: for one of our addresses? */
+    rcu_read_lock();
+    int ours = net_if_is_local(dev, &target);
+    rcu_read_unlock();
+    if (!ours)
+        return;
+
+    static const uint8_t unspec[16];
+    const uint8_t *mac = nd_lla(nb, ND_OPT_SLLA);
+    if (kmemcmp(ip->src, unspec, 16) == 0) {
+        ip_addr_t all;
+        ip_addr_set6(&all, s_all_nodes);
+        nd_send(dev, ICMPV6_NA, NA_OVERRIDE, &target, &all, &all, m->target);
+        return;
+    }
+    if (mac)
+        neigh_update(dev, &src, mac, 1);
+    nd_send(dev, ICMPV6_NA, NA_SOLICITED | NA_OVERRIDE, &target, &src, &src,
+            m->target);
+}
+
+void icmpv6_input(netdev_t *dev, netbuf_t *nb, const ipv6_hdr_t *ip)
+{
+    ip_addr_t src, dst;
+    ip_addr_set6(&src, ip->src);
+    ip_addr_set6(&dst, ip->dst);
+    const icmp_hdr_t *h = (const icmp_hdr_t *)nb->data;
+    uint32_t sum = inet_pseudo_sum(&src, &dst, IP_PROTO_ICMPV6, nb->total);
+    if (nb->len < sizeof(*h) ||
+        inet_csum_fold(inet_csum_chain(sum, nb, 0, nb->total)) != 0) {
+        netbuf_free(nb);
+        return;
+    }
+
+    switch (h->type) {
+    case ICMPV6_ECHO_REQUEST:
+        icmp_echo_reply(nb, &src);
+        return;
+    case ICMPV6_ECHO_REPLY:
+        ping_input(&src, ntohs(h->id), ntohs(h->seq));
+        break;
+    case ICMPV6_NS:
+    case ICMPV6_NA:
+        nd_input(dev, nb, ip);
+        break;
+    }
+    netbuf_free(nb);
+}
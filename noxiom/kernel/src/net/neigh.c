@@ -0,0 +1,275 @@
+/* kernel/src/net/neigh.c — neighbour cache and ARP
+ *
+ * One table for both families: IPv4 entries are filled by ARP, IPv6
+ * ones by neighbour discovery (ipv6.c).  It is sized from the tier,
+ * open-addressed, and guarded by a seqlock, so the transmit path looks
+ * up a MAC without writing a shared cache line; only learning an
+ * address, resolving one and evicting take the write side.
+ *
+ * An entry that has not been confirmed for NEIGH_STALE_NS is still
+ * used, but the next packet to it sends a fresh request.  There is no
+ * timer: an unanswered request is repeated by the next packet that
+ * needs the entry, at most every NEIGH_RETRY_NS.
+ */
+#include "inet.h"
+#include "../sync/seqlock.h"
+#include "../sync/rcu.h"
+#include "../mm/kmalloc.h"
+#include "../string.h"
+#include "../hal.h"
+
+#define NEIGH_STALE_NS  (60ULL * 1000000000ULL)
+#define NEIGH_RETRY_NS  (1000ULL * 1000000ULL)
+
+enum { NEIGH_FREE = 0, NEIGH_INCOMPLETE, NEIGH_REACHABLE };
+
+typedef struct {
+    ip_addr_t addr;
+    netdev_t *dev;
+    uint8_t   mac[6];
+    uint8_t   state;
+    uint64_t  updated;              /* last confirmation, ns             */
+    uint64_t  solicited;            /* last request sent                 */
+    netbuf_t *pending;              /* waiting for the answer; write side */
+} neigh_t;
+
+static neigh_t  *s_tab;
+static uint32_t  s_size;            /* power of 2                        */
+static seqlock_t s_lock = SEQLOCK_INIT;
+
+static const uint8_t s_bcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+void neigh_init(uint32_t entries)
+{
+    uint32_t n = 1;
+    while (n < entries)
+        n <<= 1;
+    s_tab = kzalloc(n * sizeof(neigh_t));
+    s_size = s_tab ? n : 0;
+}
+
+static uint32_t slot_of(const ip_addr_t *a)
+{
+    uint32_t h = a->w[0] ^ a->w[1] ^ a->w[2] ^ a->w[3];
+    h *= 0x9E3779B1u;
+    return (h >> 16) & (s_size - 1);
+}
+
+/* Index of the entry for (dev, addr), or -1 */
+static int find(const netdev_t *dev, const ip_addr_t *addr)
+{
+    uint32_t i = slot_of(addr);
+    for (uint32_t n = 0; n < s_size; n++, i = (i + 1) & (s_size - 1)) {
+        const neigh_t *e = &s_tab[i];
+        if (e->state == NEIGH_FREE)
+            return -1;
+        if (e->dev == dev && ip_addr_eq(&e->addr, addr))
+            return (int)i;
+    }
+    return -1;
+}
+
+/* Write side: a slot for addr, evicting the least recently confirmed
+ * entry of a full table.  Linear probing has no tombstones, so an
+ * eviction keeps the victim's slot (chains stay unbroken). */
+static neigh_t *insert(netdev_t *dev, const ip_addr_t *addr,
+                       netbuf_t **evicted)
+{
+    uint32_t i = slot_of(addr), victim = i;
+    for (uint32_t n = 0; n < s_size; n++, i = (i + 1) & (s_size - 1)) {
+        if (s_tab[i].state == NEIGH_FREE) {
+            victim = i;
+            break;
+        }
+        if (s_tab[i].updated < s_tab[victim].updated)
+            victim = i;
+    }
+    neigh_t *e = &s_tab[victim];
+    *evicted = e->pending;
+    kmemset(e, 0, sizeof(*e));
+    e->addr  = *addr;
+    e->dev   = dev;
+    e->state = NEIGH_INCOMPLETE;
+    return e;
+}
+
+static void solicit(netdev_t *dev, const ip_addr_t *addr)
+{
+    if (addr->family == NET_AF_INET6)
+        ndisc_solicit(dev, addr);
+    else
+        arp_solicit(dev, addr);
+}
+
+static int multicast_mac(const ip_addr_t *a, uint8_t mac[6])
+{
+    if (a->family == NET_AF_INET6 && a->b[0] == 0xFF) {
+        mac[0] = 0x33;
+        mac[1] = 0x33;
+        kmemcpy(mac + 2, a->b + 12, 4);
+        return 1;
+    }
+    if (a->family == NET_AF_INET && a->w[0] == 0xFFFFFFFFu) {
+        kmemcpy(mac, s_bcast, 6);
+        return 1;
+    }
+    return 0;
+}
+
+int neigh_output(netdev_t *dev, const ip_addr_t *nexthop, netbuf_t *nb,
+                 uint16_t proto, int more)
+{
+    uint8_t mac[6];
+    if (multicast_mac(nexthop, mac))
+        return eth_output(dev, nb, mac, proto, more);
+    if (!s_size) {
+        netbuf_free(nb);
+        return -1;
+    }
+
+    uint64_t now = hal_timer_now_ns();
+    neigh_t copy;
+    uint32_t seq;
+    int idx;
+    do {
+        seq = seq_read_begin(&s_lock);
+        idx = find(dev, nexthop);
+        if (idx >= 0)
+            copy = s_tab[idx];
+    } while (seq_read_retry(&s_lock, seq));
+
+    if (idx >= 0 && copy.state == NEIGH_REACHABLE) {
+        int refresh = now - copy.updated > NEIGH_STALE_NS &&
+                      now - copy.solicited > NEIGH_RETRY_NS;
+        if (refresh) {
+            uint64_t flags = seq_write_lock_irqsave(&s_lock);
+            idx = find(dev, nexthop);
+            if (idx >= 0)
+                s_tab[idx].solicited = now;
+            seq_write_unlock_irqrestore(&s_lock, flags);
+        }
+        int rc = eth_output(dev, nb, copy.mac, proto, more);
+        if (refresh)
+            solicit(dev, nexthop);
+        return rc;
+    }
+
+    /* Unresolved: park nb (replacing an older packet) and ask */
+    netbuf_t *drop = 0;
+    nb->proto = proto;
+    uint64_t flags = seq_write_lock_irqsave(&s_lock);
+    idx = find(dev, nexthop);
+    neigh_t *e = idx >= 0 ? &s_tab[idx] : insert(dev, nexthop, &drop);
+    int ask = now - e->solicited > NEIGH_RETRY_NS;
+    if (ask)
+        e->solicited = now;
+    if (e->state == NEIGH_REACHABLE) {
+        kmemcpy(mac, e->mac, 6);      /* answered since the read above */
+    } else {
+        if (!drop)
+            drop = e->pending;
+        e->pending = nb;
+        nb = 0;
+    }
+    seq_write_unlock_irqrestore(&s_lock, flags);
+
+    netbuf_free(drop);
+    if (nb)
+        return eth_output(dev, nb, mac, proto, more);
+    if (ask)
+        solicit(dev, nexthop);
+    return 0;
+}
+
+void neigh_update(netdev_t *dev, const ip_addr_t *addr, const uint8_t mac[6],
+                  int create)
+{
+    if (!s_size)
+        return;
+    netbuf_t *pending = 0, *drop = 0;
+    uint64_t flags = seq_write_lock_irqsave(&s_lock);
+    int idx = find(dev, addr);
+    neigh_t *e = idx >= 0 ? &s_tab[idx] : create ? insert(dev, addr, &drop)
+                                                 : 0;
+    if (e) {
+        kmemcpy(e->mac, mac, 6);
+        e->state   = NEIGH_REACHABLE;
+        e->updated = hal_timer_now_ns();
+        pending    = e->pending;
+        e->pending = 0;
+    }
+    seq_write_unlock_irqrestore(&s_lock, flags);
+
+    netbuf_free(drop);
+    if (pending)
+        eth_output(dev, pending, mac, pending->proto, 0);
+}
+
+/* ── ARP ─────────────────────────────────────────────────────────────── */
+
+#define ARP_REQUEST  1
+#define ARP_REPLY    2
+
+static int our_addr4(const netdev_t *dev, uint8_t out[4])
+{
+    rcu_read_lock();
+    const net_if_cfg_t *c = net_if_cfg(dev);
+    int ok = c && c->addr4.family == NET_AF_INET;
+    if (ok)
+        kmemcpy(out, c->addr4.b, 4);
+    rcu_read_unlock();
+    return ok;
+}
+
+void arp_input(netdev_t *dev, netbuf_t *nb)
+{
+    arp_hdr_t *a = (arp_hdr_t *)nb->data;
+    uint8_t ours[4];
+    if (nb->len < sizeof(*a) || ntohs(a->htype) != 1 ||
+        ntohs(a->ptype) != ETH_P_IP || a->hlen != 6 || a->plen != 4 ||
+        !our_addr4(dev, ours)) {
+        netbuf_free(nb);
+        return;
+    }
+
+    ip_addr_t sender;
+    ip_addr_set4(&sender, a->spa);
+    int for_us = kmemcmp(a->tpa, ours, 4) == 0;
+    neigh_update(dev, &sender, a->sha, for_us);
+
+    if (!for_us || ntohs(a->op) != ARP_REQUEST) {
+        netbuf_free(nb);
+        return;
+    }
+
+    /* Answer in the request's own buffer */
+    a->op = htons(ARP_REPLY);
+    kmemcpy(a->tha, a->sha, 6);
+    kmemcpy(a->tpa, a->spa, 4);
+    kmemcpy(a->sha, dev->mac, 6);
+    kmemcpy(a->spa, ours, 4);
+    netbuf_trim(nb, sizeof(*a));
+    eth_output(dev, nb, a->tha, ETH_P_ARP, 0);
+}
+
+void arp_solicit(netdev_t *dev, const ip_addr_t *target)
+{
+    uint8_t ours[4];
+    if (!our_addr4(dev, ours))
+        return;
+    netbuf_t *nb = netbuf_alloc();
+    if (!nb)
+        return;
+
+    arp_hdr_t *a = netbuf_put(nb, sizeof(*a));
+    a->htype = htons(1);
+    a->ptype = htons(ETH_P_IP);
+    a->hlen  = 6;
+    a->plen  = 4;
+    a->op    = htons(ARP_REQUEST);
+    kmemcpy(a->sha, dev->mac, 6);
+    kmemcpy(a->spa, ours, 4);
+    kmemset(a->tha, 0, 6);
+    kmemcpy(a->tpa, target->b, 4);
+    eth_output(dev, nb, s_bcast, ETH_P_ARP, 0);
+}
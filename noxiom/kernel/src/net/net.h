@@ -0,0 +1,145 @@
+#pragma once
+/* net/net.h — the TCP/IP stack: interface addresses, sockets, limits
+ *
+ * IPv4 and IPv6 over Ethernet with ARP and neighbour discovery, ICMP
+ * echo, UDP and TCP.  Addresses are configured statically (`ifconfig`);
+ * every interface also gets an IPv6 link-local address from its MAC.
+ * Not supported: IP fragments, IPv6 extension headers, IP options,
+ * forwarding.
+ *
+ * Packets go from the driver to the socket without being copied: the
+ * received netbuf chain is trimmed to its payload and queued on the
+ * socket as is, and the only copy is the one into the reader's buffer
+ * (none with tcp_recv_netbuf()).  Sent data is copied once into netbufs
+ * (none with tcp_send_netbuf()) which TCP keeps for retransmission and
+ * references from every segment it sends.
+ *
+ * Flows are owned by CPUs.  A TCP or UDP packet's addresses and ports
+ * hash to one online CPU, and everything about that flow happens there:
+ * the receiving poll thread hands packets of flows it does not own to
+ * the owner's "net/N" worker, and each CPU has its own connection hash
+ * table and lock, so no lock is shared between CPUs on the packet path.
+ * A NIC with one queue per CPU whose interrupts follow the flow keeps
+ * the hand-over rare.
+ *
+ * Sizes (connections, socket buffers, table sizes) come from the
+ * hardware tier, with the per-CPU hash and backlog trimmed to the CPU
+ * count and cache; net_limits() shows them.  Calls below that can block
+ * are for thread context only.
+ */
+#include <stdint.h>
+#include "netdev.h"
+
+#define NET_AF_INET   4
+#define NET_AF_INET6  6
+
+typedef struct {
+    uint8_t family;                 /* NET_AF_INET / NET_AF_INET6, 0 = none */
+    union {
+        uint8_t  b[16];             /* IPv4: the first 4 bytes           */
+        uint32_t w[4];
+    };
+} ip_addr_t;
+
+/* "10.0.2.15", "fe80::1" → 0, or -1 if s is not an address */
+int  ip_parse(const char *s, ip_addr_t *out);
+/* Text form; buf should hold 40 bytes */
+void ip_format(const ip_addr_t *a, char *buf, uint32_t size);
+
+/* ── Limits ──────────────────────────────────────────────────────────── */
+
+typedef struct {
+    uint32_t max_tcp;               /* connections in any state          */
+    uint32_t tcp_buckets;           /* per-CPU hash buckets (power of 2) */
+    uint32_t sndbuf;                /* bytes queued per socket, each way */
+    uint32_t rcvbuf;
+    uint32_t neigh;                 /* neighbour cache entries           */
+    uint32_t backlog;               /* packets waiting per worker        */
+} net_limits_t;
+
+const net_limits_t *net_limits(void);
+
+/* Size the stack from the tier, start the per-CPU workers and take the
+ * receive path from every registered device.  After virtio_init(). */
+void net_init(void);
+
+/* ── Interfaces ──────────────────────────────────────────────────────── */
+
+typedef struct {
+    ip_addr_t addr4, gw4;           /* family 0 until configured         */
+    uint8_t   prefix4;
+    ip_addr_t ll6;                  /* fe80::/64 from the MAC (EUI-64)   */
+    ip_addr_t addr6, gw6;
+    uint8_t   prefix6;
+} net_if_cfg_t;
+
+/* Set dev's address of a's family; gw may be 0 (no default route) */
+int  net_if_set_addr(netdev_t *dev, const ip_addr_t *a, uint32_t prefix,
+                     const ip_addr_t *gw);
+void net_if_get(const netdev_t *dev, net_if_cfg_t *out);
+
+/* ── ICMP echo ───────────────────────────────────────────────────────── */
+
+/* Send one echo request, wait up to timeout_ns for the reply.  0 and the
+ * round trip in *rtt_ns, or -1 (no route, timeout). */
+int net_ping(const ip_addr_t *dst, uint16_t seq, uint32_t payload,
+             uint64_t timeout_ns, uint64_t *rtt_ns);
+
+/* ── UDP ─────────────────────────────────────────────────────────────── */
+
+typedef struct udp_sock udp_sock_t;
+
+/* port 0: an ephemeral port.  0 if the port is taken. */
+udp_sock_t *udp_bind(uint16_t port);
+int  udp_sendto(udp_sock_t *s, const ip_addr_t *dst, uint16_t port,
+                const void *buf, uint32_t len);
+/* Bytes of the next datagram copied (the rest is dropped), or -1 after
+ * timeout_ns (0 = wait forever) */
+int  udp_recvfrom(udp_sock_t *s, void *buf, uint32_t len, ip_addr_t *src,
+                  uint16_t *port, uint64_t timeout_ns);
+void udp_close(udp_sock_t *s);
+
+/* ── TCP ─────────────────────────────────────────────────────────────── */
+
+typedef struct tcp_sock tcp_sock_t;
+
+tcp_sock_t *tcp_listen(uint16_t port, uint32_t backlog);
+/* Next established connection, blocking; 0 once l is closed */
+tcp_sock_t *tcp_accept(tcp_sock_t *l);
+/* Blocks until established; 0 if refused, timed out or no route */
+tcp_sock_t *tcp_connect(const ip_addr_t *dst, uint16_t port);
+
+/* Queue len bytes, blocking while the send buffer is full.  Returns len,
+ * or -1 if the connection is gone. */
+int  tcp_send(tcp_sock_t *s, const void *buf, uint32_t len);
+/* Same without the copy: nb's fragments become part of the send queue */
+int  tcp_send_netbuf(tcp_sock_t *s, netbuf_t *nb);
+/* Up to len bytes, blocking until there are some.  0 once the peer has
+ * closed its side, -1 if the connection was reset. */
+int  tcp_recv(tcp_sock_t *s, void *buf, uint32_t len);
+/* The next received segment's payload as a chain the caller frees; 0 as
+ * for tcp_recv() returning 0 or -1 */
+netbuf_t *tcp_recv_netbuf(tcp_sock_t *s);
+/* Close our side (FIN after the queued data) and give up the handle */
+void tcp_close(tcp_sock_t *s);
+
+/* ── Introspection (shell) ───────────────────────────────────────────── */
+
+typedef struct {
+    ip_addr_t   laddr, raddr;
+    uint16_t    lport, rport;
+    uint32_t    cpu;                /* owner                             */
+    const char *state;
+    uint32_t    sndq, rcvq;         /* bytes queued                      */
+    uint32_t    cwnd, srtt_us;
+} tcp_info_t;
+
+typedef struct {
+    uint64_t rx_ip, tx_ip, rx_drop, steered;
+    uint64_t tcp_in, tcp_out, tcp_rtx, tcp_bad, tcp_acks_delayed;
+    uint64_t udp_in, udp_out, udp_drop;
+} net_stats_t;
+
+uint32_t tcp_list(tcp_info_t *out, uint32_t max);
+/* Counters summed over all CPUs */
+void     net_stats(net_stats_t *out);
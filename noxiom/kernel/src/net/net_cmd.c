@@ -0,0 +1,216 @@
+/* kernel/src/net/net_cmd.c — network shell commands
+ *
+ *   ifconfig    every network device: MAC, addresses, queues and
+ *               traffic, then per queue the CPU it polls on, interrupts
+ *               taken, poll rounds and how many of those used the whole
+ *               budget (polling mode under load)
+ *   ifconfig eth0 10.0.2.15/24 [gw 10.0.2.2]
+ *               set an address (either family) and default gateway
+ *   ping        ICMP or ICMPv6 echo, one request a second
+ *   netstat     connections with their owner CPU, then stack counters
+ *   echod       TCP echo server, one connection at a time (run it with &)
+ */
+#include "net.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../sched/sched.h"
+#include "../shell/shell.h"
+
+#define NETSTAT_MAX 64
+
+static void print_addr(const char *label, const ip_addr_t *a,
+                       uint32_t prefix) {
+    if (!a->family)
+        return;
+    char text[40], line[80];
+    ip_format(a, text, sizeof(text));
+    if (prefix)
+        ksnprintf(line, sizeof(line), "    %s %s/%u\n", label, text, prefix);
+    else
+        ksnprintf(line, sizeof(line), "    %s %s\n", label, text);
+    hal_display_print(line);
+}
+
+static void show(netdev_t *d) {
+    const netdev_stats_t *s = &d->stats;
+    char line[128];
+    ksnprintf(line, sizeof(line),
+              "%s  %s  %02x:%02x:%02x:%02x:%02x:%02x  mtu %u  "
+              "%u queue%s\n", d->name, d->driver,
+              d->mac[0], d->mac[1], d->mac[2], d->mac[3], d->mac[4],
+              d->mac[5], d->mtu, d->nqueues, d->nqueues == 1 ? "" : "s");
+    hal_display_print(line);
+
+    net_if_cfg_t c;
+    net_if_get(d, &c);
+    print_addr("inet ", &c.addr4, c.prefix4);
+    print_addr("gw   ", &c.gw4, 0);
+    print_addr("inet6", &c.ll6, 64);
+    print_addr("inet6", &c.addr6, c.prefix6);
+    print_addr("gw6  ", &c.gw6, 0);
+
+    ksnprintf(line, sizeof(line),
+              "    rx %lu packets %lu bytes %lu dropped\n"
+              "    tx %lu packets %lu bytes %lu dropped\n",
+              (unsigned long)s->rx_packets, (unsigned long)s->rx_bytes,
+              (unsigned long)s->rx_dropped, (unsigned long)s->tx_packets,
+              (unsigned long)s->tx_bytes, (unsigned long)s->tx_dropped);
+    hal_display_print(line);
+    for (uint32_t q = 0; d->napi && q < d->nqueues; q++) {
+        const napi_t *p = &d->napi[q];
+        ksnprintf(line, sizeof(line),
+                  "    queue %u  cpu %u  irqs %lu  polls %lu  busy %lu\n",
+                  q, p->cpu, (unsigned long)p->irqs,
+                  (unsigned long)p->rounds,
+                  (unsigned long)p->busy_rounds);
+        hal_display_print(line);
+    }
+}
+
+/* "ifconfig <dev> <addr>/<prefix> [gw <addr>]" */
+static void configure(int argc, char **argv) {
+    netdev_t *d = netdev_find(argv[1]);
+    if (!d) {
+        hal_display_print("ifconfig: no such device\n");
+        return;
+    }
+    char addr[48];
+    uint32_t i = 0;
+    for (; argv[2][i] && argv[2][i] != '/' && i < sizeof(addr) - 1; i++)
+        addr[i] = argv[2][i];
+    addr[i] = 0;
+
+    ip_addr_t a, gw;
+    if (ip_parse(addr, &a) != 0) {
+        hal_display_print("ifconfig: bad address\n");
+        return;
+    }
+    uint32_t prefix = a.family == NET_AF_INET6 ? 64 : 24;
+    if (argv[2][i] == '/')
+        prefix = (uint32_t)shell_parse_uint(argv[2] + i + 1, prefix);
+    int has_gw = argc >= 5 && kstrcmp(argv[3], "gw") == 0;
+    if (has_gw && (ip_parse(argv[4], &gw) != 0 || gw.family != a.family)) {
+        hal_display_print("ifconfig: bad gateway\n");
+        return;
+    }
+    if (net_if_set_addr(d, &a, prefix, has_gw ? &gw : 0) != 0)
+        hal_display_print("ifconfig: cannot set address\n");
+}
+
+static void cmd_ifconfig(int argc, char **argv) {
+    if (argc >= 3) {
+        configure(argc, argv);
+        return;
+    }
+    uint32_t n = netdev_count();
+    if (!n) {
+        hal_display_print("ifconfig: no network devices\n");
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++)
+        show(netdev_get(i));
+}
+
+SHELL_CMD(ifconfig, .fn = cmd_ifconfig, .args = "[dev addr/prefix [gw addr]]",
+          .help = "network devices, queues and addresses");
+
+static void cmd_ping(int argc, char **argv) {
+    ip_addr_t dst;
+    if (argc < 2 || ip_parse(argv[1], &dst) != 0) {
+        hal_display_print("usage: ping <addr> [count]\n");
+        return;
+    }
+    uint32_t count = argc > 2 ? (uint32_t)shell_parse_uint(argv[2], 4) : 4;
+    char text[40], line[96];
+    ip_format(&dst, text, sizeof(text));
+    uint32_t ok = 0;
+    for (uint32_t seq = 1; seq <= count; seq++) {
+        uint64_t start = hal_timer_now_ns(), rtt;
+        if (net_ping(&dst, (uint16_t)seq, 56, 1000000000ULL, &rtt) == 0) {
+            ok++;
+            ksnprintf(line, sizeof(line),
+                      "reply from %s: seq %u time %lu us\n", text, seq,
+                      (unsigned long)(rtt / 1000));
+        } else {
+            ksnprintf(line, sizeof(line), "no reply from %s: seq %u\n", text,
+                      seq);
+        }
+        hal_display_print(line);
+        uint64_t spent = hal_timer_now_ns() - start;
+        if (seq < count && spent < 1000000000ULL)
+            thread_sleep_ns(1000000000ULL - spent);
+    }
+    ksnprintf(line, sizeof(line), "%u sent, %u received\n", count, ok);
+    hal_display_print(line);
+}
+
+SHELL_CMD(ping, .fn = cmd_ping, .args = "<addr> [count]",
+          .help = "ICMP echo to an IPv4 or IPv6 address");
+
+static void cmd_netstat(int argc, char **argv) {
+    (void)argc; (void)argv;
+    static tcp_info_t conns[NETSTAT_MAX];
+    uint32_t n = tcp_list(conns, NETSTAT_MAX);
+    char line[160], l[40], r[40];
+    hal_display_print("local                  remote                 "
+                      "state        cpu  sndq  rcvq  cwnd  srtt us\n");
+    for (uint32_t i = 0; i < n; i++) {
+        const tcp_info_t *c = &conns[i];
+        if (c->laddr.family)
+            ip_format(&c->laddr, l, sizeof(l));
+        else
+            kstrcpy(l, "*");
+        if (c->raddr.family)
+            ip_format(&c->raddr, r, sizeof(r));
+        else
+            kstrcpy(r, "*");
+        char lp[48], rp[48];
+        ksnprintf(lp, sizeof(lp), "%s:%u", l, c->lport);
+        ksnprintf(rp, sizeof(rp), "%s:%u", r, c->rport);
+        ksnprintf(line, sizeof(line),
+                  "%-22s %-22s %-12s %3u %5u %5u %5u %8u\n", lp, rp,
+                  c->state, c->cpu, c->sndq, c->rcvq, c->cwnd, c->srtt_us);
+        hal_display_print(line);
+    }
+
+    net_stats_t s;
+    net_stats(&s);
+    ksnprintf(line, sizeof(line),
+              "ip   rx %lu  tx %lu  dropped %lu  steered %lu\n",
+              (unsigned long)s.rx_ip, (unsigned long)s.tx_ip,
+              (unsigned long)s.rx_drop, (unsigned long)s.steered);
+    hal_display_print(line);
+    ksnprintf(line, sizeof(line),
+              "tcp  in %lu  out %lu  retransmitted %lu  bad %lu  "
+              "delayed acks %lu\n",
+              (unsigned long)s.tcp_in, (unsigned long)s.tcp_out,
+              (unsigned long)s.tcp_rtx, (unsigned long)s.tcp_bad,
+              (unsigned long)s.tcp_acks_delayed);
+    hal_display_print(line);
+    ksnprintf(line, sizeof(line), "udp  in %lu  out %lu  dropped %lu\n",
+              (unsigned long)s.udp_in, (unsigned long)s.udp_out,
+              (unsigned long)s.udp_drop);
+    hal_display_print(line);
+}
+
+SHELL_CMD(netstat, .fn = cmd_netstat, .help = "TCP connections and counters");
+
+/* Echoes the zero-copy way: each received chain is sent back as is */
+static void cmd_echod(int argc, char **argv) {
+    uint16_t port = (uint16_t)(argc > 1 ? shell_parse_uint(argv[1], 7) : 7);
+    tcp_sock_t *l = tcp_listen(port, 0);
+    if (!l) {
+        hal_display_print("echod: port in use\n");
+        return;
+    }
+    for (tcp_sock_t *s; (s = tcp_accept(l)) != 0;) {
+        for (netbuf_t *nb; (nb = tcp_recv_netbuf(s)) != 0;)
+            if (tcp_send_netbuf(s, nb) < 0)
+                break;
+        tcp_close(s);
+    }
+    tcp_close(l);
+}
+
+SHELL_CMD(echod, .fn = cmd_echod, .args = "[port]",
+          .help = "TCP echo server (default port 7)");
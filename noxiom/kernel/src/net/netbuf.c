@@ -0,0 +1,201 @@
+/* kernel/src/net/netbuf.c — page pools and netbuf chains
+ *
+ * A pool keeps its free pages on a list threaded through the first word
+ * of each page, so it needs no memory of its own.  Pages beyond `max`
+ * go back to the frame allocator, which bounds what an idle pool pins.
+ * Wrapped fragments (netbuf_wrap(), netbuf_ref()) carry no page; their
+ * netbuf_t comes from kmalloc().
+ */
+#include "netbuf.h"
+#include "../mm/pmm.h"
+#include "../mm/kmalloc.h"
+#include "../string.h"
+
+#define TX_POOL_PAGES  256              /* 1 MB of send buffers cached     */
+
+static page_pool_t s_tx_pool = PAGE_POOL_INIT(TX_POOL_PAGES);
+
+/* ── Page pools ──────────────────────────────────────────────────────── */
+
+void page_pool_init(page_pool_t *p, uint32_t max)
+{
+    *p = (page_pool_t)PAGE_POOL_INIT(max);
+}
+
+void *page_pool_get(page_pool_t *p)
+{
+    uint64_t flags = spin_lock_irqsave(&p->lock);
+    void *page = p->free;
+    if (page) {
+        p->free = *(void **)page;
+        p->nfree--;
+        p->recycled++;
+    }
+    spin_unlock_irqrestore(&p->lock, flags);
+    if (page)
+        return page;
+
+    uint64_t pa = pmm_alloc_page();
+    if (!pa)
+        return 0;
+    __atomic_fetch_add(&p->allocs, 1, __ATOMIC_RELAXED);
+    return phys_to_virt(pa);
+}
+
+void page_pool_put(page_pool_t *p, void *page)
+{
+    uint64_t flags = spin_lock_irqsave(&p->lock);
+    if (p->nfree < p->max) {
+        *(void **)page = p->free;
+        p->free = page;
+        p->nfree++;
+        page = 0;
+    }
+    spin_unlock_irqrestore(&p->lock, flags);
+    if (page)
+        pmm_free_page(virt_to_phys(page));
+}
+
+/* ── Netbufs ─────────────────────────────────────────────────────────── */
+
+netbuf_t *netbuf_from_page(page_pool_t *pool, void *page, uint32_t off,
+                           uint32_t len)
+{
+    netbuf_t *nb = page;
+    nb->next    = 0;
+    nb->qnext   = 0;
+    nb->data    = (uint8_t *)page + NETBUF_HDR_SIZE + off;
+    nb->len     = len;
+    nb->total   = len;
+    nb->pool    = pool;
+    nb->release = 0;
+    nb->priv    = 0;
+    nb->refs    = 1;
+    nb->ifindex = 0;
+    nb->proto   = 0;
+    return nb;
+}
+
+netbuf_t *netbuf_alloc(void)
+{
+    void *page = page_pool_get(&s_tx_pool);
+    return page ? netbuf_from_page(&s_tx_pool, page, NETBUF_HEADROOM, 0) : 0;
+}
+
+netbuf_t *netbuf_wrap(void *data, uint32_t len, void (*release)(void *priv),
+                      void *priv)
+{
+    netbuf_t *nb = kzalloc(sizeof(*nb));
+    if (!nb)
+        return 0;
+    nb->data    = data;
+    nb->len     = len;
+    nb->total   = len;
+    nb->release = release;
+    nb->priv    = priv;
+    nb->refs    = 1;
+    return nb;
+}
+
+static void drop(netbuf_t *nb);
+
+/* Only src itself: its `next` belongs to whatever chain its owner has */
+static void ref_release(void *priv)
+{
+    drop(priv);
+}
+
+netbuf_t *netbuf_ref(netbuf_t *src, uint32_t off, uint32_t len)
+{
+    __atomic_fetch_add(&src->refs, 1, __ATOMIC_RELAXED);
+    netbuf_t *nb = netbuf_wrap(src->data + off, len, ref_release, src);
+    if (!nb)
+        __atomic_fetch_sub(&src->refs, 1, __ATOMIC_RELAXED);
+    return nb;
+}
+
+void netbuf_chain(netbuf_t *head, netbuf_t *frag)
+{
+    netbuf_t *tail = head;
+    while (tail->next)
+        tail = tail->next;
+    tail->next = frag;
+    for (; frag; frag = frag->next)
+        head->total += frag->len;
+}
+
+static void drop(netbuf_t *nb)
+{
+    if (__atomic_sub_fetch(&nb->refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+    if (nb->pool) {
+        page_pool_put(nb->pool, nb);
+    } else {
+        if (nb->release)
+            nb->release(nb->priv);
+        kfree(nb);
+    }
+}
+
+void netbuf_free(netbuf_t *nb)
+{
+    while (nb) {
+        netbuf_t *next = nb->next;
+        drop(nb);
+        nb = next;
+    }
+}
+
+void netbuf_trim(netbuf_t *head, uint32_t len)
+{
+    if (head->total <= len)
+        return;
+    head->total = len;
+    for (netbuf_t *nb = head; nb; nb = nb->next) {
+        if (nb->len >= len) {
+            nb->len = len;
+            netbuf_free(nb->next);
+            nb->next = 0;
+            return;
+        }
+        len -= nb->len;
+    }
+}
+
+netbuf_t *netbuf_consume(netbuf_t *head, uint32_t n)
+{
+    uint32_t total = head->total > n ? head->total - n : 0;
+    while (head && n >= head->len) {
+        netbuf_t *next = head->next;
+        n -= head->len;
+        head->next = 0;
+        drop(head);
+        head = next;
+    }
+    if (!head)
+        return 0;
+    head->data += n;
+    head->len  -= n;
+    head->total = total;
+    return head;
+}
+
+uint32_t netbuf_copy_out(const netbuf_t *nb, uint32_t off, void *dst,
+                         uint32_t len)
+{
+    uint8_t *d = dst;
+    uint32_t done = 0;
+    for (; nb && done < len; nb = nb->next) {
+        if (off >= nb->len) {
+            off -= nb->len;
+            continue;
+        }
+        uint32_t n = nb->len - off;
+        if (n > len - done)
+            n = len - done;
+        kmemcpy(d + done, nb->data + off, n);
+        done += n;
+        off   = 0;
+    }
+    return done;
+}
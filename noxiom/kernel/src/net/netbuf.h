@@ -0,0 +1,137 @@
+#pragma once
+/* net/netbuf.h — packet buffers and page pools
+ *
+ * A packet is a chain of netbufs linked through `next`, one per
+ * fragment.  A netbuf normally lives in the first NETBUF_HDR_SIZE bytes
+ * of the page its data is in, so a received page goes up the stack
+ * as is: the driver posts pages from a page pool, the device writes the
+ * frame into them, and whoever is done with the packet hands the pages
+ * back to that pool with netbuf_free().  Nothing on the receive path
+ * copies payload and, once the pool is warm, nothing allocates.
+ *
+ * Sends work the same way in reverse: netbuf_alloc() gives a page with
+ * NETBUF_HEADROOM in front of the data for the headers each layer
+ * prepends (netbuf_push()), and payload that already lives somewhere
+ * else is chained on with netbuf_wrap() instead of being copied.  The
+ * driver points one descriptor at each fragment.
+ *
+ * Netbufs are reference-counted.  netbuf_ref() makes a fragment that
+ * points into another netbuf's data and holds a reference on it, so
+ * the same bytes can sit in a socket queue and in a NIC ring at once
+ * (TCP keeps sent data for retransmission that way); the page is freed
+ * when the last user lets go.  netbuf_free() drops one reference on
+ * every fragment of a chain.
+ *
+ * Page pools are safe to use from any CPU and from IRQ context.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include "../sync/spinlock.h"
+#include "../mm/pmm.h"
+
+#define NETBUF_HDR_SIZE  64             /* netbuf_t at the start of the page */
+#define NETBUF_BUF_SIZE  ((uint32_t)PAGE_SIZE - NETBUF_HDR_SIZE)  /* per page */
+#define NETBUF_HEADROOM  128            /* netbuf_alloc(): room for headers  */
+
+/* Free pages kept for reuse; the rest go back to the frame allocator */
+typedef struct {
+    spinlock_t lock;
+    void      *free;                    /* list linked through the pages   */
+    uint32_t   nfree;
+    uint32_t   max;
+    uint64_t   allocs;                  /* pages taken from the pmm        */
+    uint64_t   recycled;                /* pages reused from the list      */
+} page_pool_t;
+
+#define PAGE_POOL_INIT(max) { SPINLOCK_INIT, 0, 0, (max), 0, 0 }
+
+void  page_pool_init(page_pool_t *p, uint32_t max);
+void *page_pool_get(page_pool_t *p);    /* one page, 0 on OOM              */
+void  page_pool_put(page_pool_t *p, void *page);
+
+typedef struct netbuf {
+    struct netbuf *next;                /* next fragment of this packet    */
+    struct netbuf *qnext;               /* for the current owner's queues  */
+    uint8_t       *data;
+    uint32_t       len;
+    uint32_t       total;               /* head only: sum of len over the
+                                           chain, kept by netbuf_chain()   */
+    page_pool_t   *pool;                /* where the page goes, 0 = wrapped */
+    void         (*release)(void *priv);    /* netbuf_wrap() only          */
+    void          *priv;
+    uint32_t       refs;
+    uint16_t       ifindex;             /* receiving device (netdev_rx)    */
+    uint16_t       proto;               /* EtherType once parsed           */
+} netbuf_t;
+
+_Static_assert(sizeof(netbuf_t) <= NETBUF_HDR_SIZE, "netbuf_t too large");
+
+/* Receive: the page was filled by the device, the frame is at
+ * page + NETBUF_HDR_SIZE + off for len bytes */
+netbuf_t *netbuf_from_page(page_pool_t *pool, void *page, uint32_t off,
+                           uint32_t len);
+/* Send: an empty buffer with NETBUF_HEADROOM before data, 0 on OOM */
+netbuf_t *netbuf_alloc(void);
+/* A fragment pointing at memory the caller owns.  release(priv) (may be
+ * 0) runs once the device is done with it.  0 on OOM. */
+netbuf_t *netbuf_wrap(void *data, uint32_t len, void (*release)(void *priv),
+                      void *priv);
+/* A new fragment for [off, off + len) of src's data, holding a
+ * reference on src until it is freed.  0 on OOM. */
+netbuf_t *netbuf_ref(netbuf_t *src, uint32_t off, uint32_t len);
+/* Append frag (and its chain) to the packet headed by head */
+void      netbuf_chain(netbuf_t *head, netbuf_t *frag);
+/* Drop a reference on every fragment of the chain */
+void      netbuf_free(netbuf_t *nb);
+/* Cut the packet to its first len bytes (link-layer padding, a TCP
+ * segment beyond the window), freeing fragments left empty */
+void      netbuf_trim(netbuf_t *head, uint32_t len);
+/* Drop n bytes from the front, across fragments; returns the new head,
+ * 0 once nothing is left */
+netbuf_t *netbuf_consume(netbuf_t *head, uint32_t n);
+/* Copy len bytes starting off bytes into the chain; returns the count */
+uint32_t  netbuf_copy_out(const netbuf_t *nb, uint32_t off, void *dst,
+                          uint32_t len);
+
+/* Head fragment editing; 0 if there is no room */
+static inline uint32_t netbuf_headroom(const netbuf_t *nb)
+{
+    return nb->pool ? (uint32_t)(nb->data - ((uint8_t *)nb + NETBUF_HDR_SIZE))
+                    : 0;
+}
+
+static inline uint32_t netbuf_tailroom(const netbuf_t *nb)
+{
+    return nb->pool ? NETBUF_BUF_SIZE - netbuf_headroom(nb) - nb->len : 0;
+}
+
+static inline void *netbuf_push(netbuf_t *nb, uint32_t n)
+{
+    if (netbuf_headroom(nb) < n)
+        return 0;
+    nb->data  -= n;
+    nb->len   += n;
+    nb->total += n;
+    return nb->data;
+}
+
+static inline void *netbuf_pull(netbuf_t *nb, uint32_t n)
+{
+    if (nb->len < n)
+        return 0;
+    nb->data  += n;
+    nb->len   -= n;
+    nb->total -= n;
+    return nb->data;
+}
+
+/* Extend the data at its tail; returns where the new bytes go */
+static inline void *netbuf_put(netbuf_t *nb, uint32_t n)
+{
+    if (netbuf_tailroom(nb) < n)
+        return 0;
+    uint8_t *p = nb->data + nb->len;
+    nb->len   += n;
+    nb->total += n;
+    return p;
+}
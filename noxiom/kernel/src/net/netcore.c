@@ -0,0 +1,300 @@
+/* kernel/src/net/netcore.c — stack start-up, limits, flow steering and
+ * the per-CPU workers
+ *
+ * Every online CPU gets a "net/N" worker pinned to it, with a backlog of
+ * packets handed over by other CPUs and a list of deferred work items
+ * (TCP timers, closes).  The device receive handler runs in the NAPI
+ * poll thread of the queue that got the packet: it peeks at the IP
+ * addresses and ports, and a packet whose flow this CPU owns goes up the
+ * stack right there, anything else onto the owner's backlog.  ARP, ND
+ * and ICMP have no owner and are handled wherever they arrive.
+ *
+ * The backlog lock is shared by one producer CPU at a time and the
+ * owner; a full backlog drops (the sender retransmits).
+ */
+#include "inet.h"
+#include "../hal.h"
+#include "../smp/smp.h"
+#include "../sched/sched.h"
+#include "../string.h"
+#include "../log/klog.h"
+
+/* Tier → sizes.  TIER_LOW is the design point: 128 MB boards with one or
+ * two cores, where the whole stack should stay well under 1% of RAM.
+ * The hash and backlog figures are upper bounds, see fit_limits(). */
+static const net_limits_t s_tier_limits[] = {
+    [TIER_FALLBACK] = {   16,   16,  16384,  16384,  16,  128 },
+    [TIER_LOW]      = {   64,   64,  32768,  32768,  32,  256 },
+    [TIER_MID]      = {  256,  256,  65536,  65536,  64,  512 },
+    [TIER_HIGH]     = { 1024, 1024, 262144, 262144, 128, 1024 },
+};
+
+typedef struct {
+    spinlock_t  lock;
+    netbuf_t   *rx_head, *rx_tail;  /* linked through qnext             */
+    uint32_t    rx_count;
+    net_work_t *work_head, *work_tail;
+    thread_t   *thread;
+} __attribute__((aligned(64))) net_worker_t;
+
+typedef struct {
+    net_stats_t s;
+} __attribute__((aligned(64))) net_cpu_stats_t;
+
+static net_limits_t    s_limits;
+static net_worker_t    s_workers[HAL_MAX_CPUS];
+static net_cpu_stats_t s_stats[HAL_MAX_CPUS];
+static uint32_t        s_cpus[HAL_MAX_CPUS];   /* CPUs that own flows     */
+static uint32_t        s_ncpus = 1;            /* CPU 0 until net_init()  */
+static uint32_t        s_seed;
+
+const net_limits_t *net_limits(void)
+{
+    return &s_limits;
+}
+
+net_stats_t *net_stats_this(void)
+{
+    return &s_stats[hal_cpu_id()].s;
+}
+
+void net_stats(net_stats_t *out)
+{
+    kmemset(out, 0, sizeof(*out));
+    uint64_t *dst = (uint64_t *)out;
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++) {
+        const uint64_t *src = (const uint64_t *)&s_stats[cpu].s;
+        for (uint32_t i = 0; i < sizeof(*out) / sizeof(uint64_t); i++)
+            dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+}
+
+/* ── Flow steering ───────────────────────────────────────────────────── */
+
+static inline uint32_t mix(uint32_t h, uint32_t v)
+{
+    h ^= v;
+    h *= 0x9E3779B1u;
+    return h ^ (h >> 15);
+}
+
+uint32_t net_flow_hash(const ip_addr_t *laddr, const ip_addr_t *raddr,
+                       uint16_t lport, uint16_t rport)
+{
+    uint32_t h = s_seed;
+    uint32_t words = laddr->family == NET_AF_INET6 ? 4 : 1;
+    for (uint32_t i = 0; i < words; i++) {
+        h = mix(h, laddr->w[i]);
+        h = mix(h, raddr->w[i]);
+    }
+    return mix(h, (uint32_t)lport << 16 | rport);
+}
+
+uint32_t net_flow_cpu(uint32_t hash)
+{
+    return s_cpus[hash % s_ncpus];
+}
+
+/* The owner of a TCP or UDP packet, or -1 if it has none */
+static int packet_owner(const netbuf_t *nb)
+{
+    if (nb->len < ETH_HLEN)
+        return -1;
+    const eth_hdr_t *eth = (const eth_hdr_t *)nb->data;
+    const uint8_t *p = nb->data + ETH_HLEN;
+    uint32_t room = nb->len - ETH_HLEN;
+    ip_addr_t src, dst;
+    uint32_t hlen;
+    uint8_t proto;
+
+    switch (ntohs(eth->proto)) {
+    case ETH_P_IP: {
+        const ipv4_hdr_t *ip = (const ipv4_hdr_t *)p;
+        if (room < sizeof(*ip))
+            return -1;
+        hlen  = (ip->ver_ihl & 0xF) * 4u;
+        proto = ip->proto;
+        if (ntohs(ip->frag) & (IPV4_MF | IPV4_OFFSET))
+            return -1;
+        ip_addr_set4(&src, ip->src);
+        ip_addr_set4(&dst, ip->dst);
+        break;
+    }
+    case ETH_P_IPV6: {
+        const ipv6_hdr_t *ip = (const ipv6_hdr_t *)p;
+        if (room < sizeof(*ip))
+            return -1;
+        hlen  = sizeof(*ip);
+        proto = ip->next;
+        ip_addr_set6(&src, ip->src);
+        ip_addr_set6(&dst, ip->dst);
+        break;
+    }
+    default:
+        return -1;
+    }
+    if ((proto != IP_PROTO_TCP && proto != IP_PROTO_UDP) || room < hlen + 4)
+        return -1;
+
+    const uint16_t *ports = (const uint16_t *)(p + hlen);
+    return (int)net_flow_cpu(net_flow_hash(&dst, &src, ntohs(ports[1]),
+                                           ntohs(ports[0])));
+}
+
+/* ── Workers ─────────────────────────────────────────────────────────── */
+
+static uint32_t dev_index(const netdev_t *dev)
+{
+    for (uint32_t i = 0; i < netdev_count(); i++)
+        if (netdev_get(i) == dev)
+            return i;
+    return 0;
+}
+
+/* Device receive handler, in the receiving queue's NAPI thread */
+static void net_rx(netdev_t *dev, netbuf_t *nb)
+{
+    nb->ifindex = (uint16_t)dev_index(dev);
+    int owner = packet_owner(nb);
+    if (owner < 0 || (uint32_t)owner == hal_cpu_id()) {
+        eth_input(dev, nb);
+        return;
+    }
+
+    net_worker_t *w = &s_workers[owner];
+    uint64_t flags = spin_lock_irqsave(&w->lock);
+    int queued = w->rx_count < s_limits.backlog;
+    if (queued) {
+        nb->qnext = 0;
+        if (w->rx_tail)
+            w->rx_tail->qnext = nb;
+        else
+            w->rx_head = nb;
+        w->rx_tail = nb;
+        w->rx_count++;
+    }
+    spin_unlock_irqrestore(&w->lock, flags);
+
+    if (queued) {
+        NET_STAT(steered);
+        thread_wake(w->thread);
+    } else {
+        NET_STAT(rx_drop);
+        netbuf_free(nb);
+    }
+}
+
+int net_work_post(net_work_t *w, uint32_t cpu)
+{
+    if (__atomic_exchange_n(&w->queued, 1, __ATOMIC_ACQ_REL))
+        return 0;
+    net_worker_t *wk = &s_workers[cpu];
+    uint64_t flags = spin_lock_irqsave(&wk->lock);
+    w->next = 0;
+    if (wk->work_tail)
+        wk->work_tail->next = w;
+    else
+        wk->work_head = w;
+    wk->work_tail = w;
+    spin_unlock_irqrestore(&wk->lock, flags);
+    thread_wake(wk->thread);
+    return 1;
+}
+
+static void worker_thread(void *arg)
+{
+    net_worker_t *w = arg;
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&w->lock);
+        netbuf_t   *nb   = w->rx_head;
+        net_work_t *work = w->work_head;
+        w->rx_head   = w->rx_tail   = 0;
+        w->work_head = w->work_tail = 0;
+        w->rx_count  = 0;
+        spin_unlock_irqrestore(&w->lock, flags);
+
+        if (!nb && !work) {
+            thread_block();
+            continue;
+        }
+        while (nb) {
+            netbuf_t *next = nb->qnext;
+            nb->qnext = 0;
+            eth_input(netdev_get(nb->ifindex), nb);
+            nb = next;
+        }
+        while (work) {
+            net_work_t *next = work->next;
+            __atomic_store_n(&work->queued, 0, __ATOMIC_RELEASE);
+            work->fn(work);
+            work = next;
+        }
+    }
+}
+
+/* ── Start-up ────────────────────────────────────────────────────────── */
+
+static uint32_t pow2_floor(uint32_t v)
+{
+    uint32_t p = 1;
+    while (p * 2 <= v)
+        p *= 2;
+    return p;
+}
+
+/* Fit the per-CPU tables to the machine: each of the n flow CPUs hashes
+ * only its own share of max_tcp, and a worker's backlog holds no more
+ * packets (one page each) than fit in that CPU's share of the last-level
+ * cache, so a burst handed over is still cached when the owner gets to
+ * it.  Neither goes above the tier's figure or below 16. */
+static void fit_limits(uint32_t n)
+{
+    uint32_t want = pow2_floor((s_limits.max_tcp + n - 1) / n * 2 - 1);
+    if (want < s_limits.tcp_buckets)
+        s_limits.tcp_buckets = want < 16 ? 16 : want;
+
+    uint32_t share = hal_hw_cache_share(0);
+    if (share) {
+        want = pow2_floor(share / PAGE_SIZE);
+        if (want < s_limits.backlog)
+            s_limits.backlog = want < 16 ? 16 : want;
+    }
+}
+
+void net_init(void)
+{
+    uint32_t tier = g_hw_info.tier;
+    if (tier > TIER_HIGH)
+        tier = TIER_FALLBACK;
+    s_limits = s_tier_limits[tier];
+    s_seed   = (uint32_t)hal_timer_now_ns() * 0x85EBCA6Bu;
+
+    uint32_t n = 0;
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++) {
+        if (!smp_cpu_online(cpu))
+            continue;
+        char name[THREAD_NAME_LEN];
+        ksnprintf(name, sizeof(name), "net/%u", cpu);
+        s_workers[cpu].lock   = (spinlock_t)SPINLOCK_INIT;
+        s_workers[cpu].thread = thread_create_on(name, worker_thread,
+                                                 &s_workers[cpu], cpu);
+        if (s_workers[cpu].thread)
+            s_cpus[n++] = cpu;
+    }
+    if (!n) {
+        klog("[net] no worker threads, stack disabled");
+        return;
+    }
+    s_ncpus = n;
+    fit_limits(n);
+
+    neigh_init(s_limits.neigh);
+    tcp_init(&s_limits);
+    for (uint32_t i = 0; i < netdev_count(); i++)
+        net_if_attach(netdev_get(i));
+    netdev_set_rx_handler(net_rx);
+
+    klog("[net] %u flow-owning CPU%s, %u connections, %u KB socket buffers, "
+         "%u-packet backlogs", n, n == 1 ? "" : "s", s_limits.max_tcp,
+         s_limits.sndbuf / 1024, s_limits.backlog);
+}
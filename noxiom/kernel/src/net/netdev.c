@@ -0,0 +1,136 @@
+/* kernel/src/net/netdev.c — device table, rx/tx entry points, NAPI
+ *
+ * The device table only grows, and entries are published with a
+ * release store of the count, so lookups take no lock.
+ *
+ * A NAPI thread sleeps in thread_block() until napi_schedule() sets
+ * `scheduled` and wakes it.  It clears the flag before each poll round:
+ * an interrupt that arrives during the round sets it again and the
+ * thread goes round once more instead of sleeping, and one that arrives
+ * after the last check finds the thread blocked and wakes it (a wake-up
+ * before thread_block() is remembered, see sched.h).
+ */
+#include "netdev.h"
+#include "../string.h"
+#include "../sched/sched.h"
+#include "../log/klog.h"
+
+static netdev_t       *s_devs[NETDEV_MAX];
+static uint32_t        s_ndevs;
+static spinlock_t      s_devs_lock = SPINLOCK_INIT;
+static netdev_rx_fn_t  s_rx_handler;
+
+/* ── Devices ─────────────────────────────────────────────────────────── */
+
+int netdev_register(netdev_t *dev)
+{
+    uint64_t flags = spin_lock_irqsave(&s_devs_lock);
+    uint32_t n = s_ndevs;
+    if (n == NETDEV_MAX) {
+        spin_unlock_irqrestore(&s_devs_lock, flags);
+        return -1;
+    }
+    ksnprintf(dev->name, sizeof(dev->name), "eth%u", n);
+    s_devs[n] = dev;
+    __atomic_store_n(&s_ndevs, n + 1, __ATOMIC_RELEASE);
+    spin_unlock_irqrestore(&s_devs_lock, flags);
+
+    klog("[net] %s: %s, %02x:%02x:%02x:%02x:%02x:%02x, %u queue%s",
+         dev->name, dev->driver, dev->mac[0], dev->mac[1], dev->mac[2],
+         dev->mac[3], dev->mac[4], dev->mac[5], dev->nqueues,
+         dev->nqueues == 1 ? "" : "s");
+    return 0;
+}
+
+uint32_t netdev_count(void)
+{
+    return __atomic_load_n(&s_ndevs, __ATOMIC_ACQUIRE);
+}
+
+netdev_t *netdev_get(uint32_t index)
+{
+    return index < netdev_count() ? s_devs[index] : 0;
+}
+
+netdev_t *netdev_find(const char *name)
+{
+    uint32_t n = netdev_count();
+    for (uint32_t i = 0; i < n; i++)
+        if (kstrcmp(s_devs[i]->name, name) == 0)
+            return s_devs[i];
+    return 0;
+}
+
+void netdev_set_rx_handler(netdev_rx_fn_t fn)
+{
+    __atomic_store_n(&s_rx_handler, fn, __ATOMIC_RELEASE);
+}
+
+void netdev_rx(netdev_t *dev, netbuf_t *nb)
+{
+    __atomic_fetch_add(&dev->stats.rx_packets, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dev->stats.rx_bytes, nb->total, __ATOMIC_RELAXED);
+
+    netdev_rx_fn_t fn = __atomic_load_n(&s_rx_handler, __ATOMIC_ACQUIRE);
+    if (fn) {
+        fn(dev, nb);
+    } else {
+        __atomic_fetch_add(&dev->stats.rx_dropped, 1, __ATOMIC_RELAXED);
+        netbuf_free(nb);
+    }
+}
+
+int netdev_xmit(netdev_t *dev, netbuf_t *nb, int more)
+{
+    uint32_t bytes = nb->total;
+    if (dev->ops->xmit(dev, nb, more) != 0) {
+        __atomic_fetch_add(&dev->stats.tx_dropped, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    __atomic_fetch_add(&dev->stats.tx_packets, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dev->stats.tx_bytes, bytes, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void netdev_flush(netdev_t *dev)
+{
+    dev->ops->flush(dev);
+}
+
+/* ── NAPI ────────────────────────────────────────────────────────────── */
+
+static void napi_thread(void *arg)
+{
+    napi_t *n = arg;
+    for (;;) {
+        if (!__atomic_exchange_n(&n->scheduled, 0, __ATOMIC_ACQUIRE)) {
+            thread_block();
+            continue;
+        }
+        for (;;) {
+            n->rounds++;
+            if (n->poll(n->ctx, NAPI_BUDGET) < NAPI_BUDGET)
+                break;              /* interrupt is back on */
+            n->busy_rounds++;
+            thread_yield();         /* still busy: keep polling */
+        }
+    }
+}
+
+int napi_start(napi_t *n, const char *name, uint32_t cpu,
+               napi_poll_fn_t poll, void *ctx)
+{
+    n->poll      = poll;
+    n->ctx       = ctx;
+    n->cpu       = cpu;
+    n->scheduled = 0;
+    n->thread    = thread_create_on(name, napi_thread, n, cpu);
+    return n->thread ? 0 : -1;
+}
+
+void napi_schedule(napi_t *n)
+{
+    __atomic_fetch_add(&n->irqs, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&n->scheduled, 1, __ATOMIC_RELEASE);
+    thread_wake(n->thread);
+}
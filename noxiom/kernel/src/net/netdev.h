@@ -0,0 +1,99 @@
+#pragma once
+/* net/netdev.h — network devices and NAPI-style receive polling
+ *
+ * Drivers fill in a netdev_t and netdev_register() it; it is named
+ * eth0, eth1, ... in registration order.  Received packets go up with
+ * netdev_rx(), which hands them to the protocol handler installed with
+ * netdev_set_rx_handler() (dropped until there is one).  netdev_xmit()
+ * passes a packet down; the driver owns it from then on and frees it
+ * once the device has sent it.
+ *
+ * Batching: a sender with several packets passes more = 1 for all but
+ * the last, or ends with netdev_flush(), and the driver notifies the
+ * device once for the lot.  The whole batch must come from one CPU
+ * (IRQs masked, or a pinned thread), since drivers pick queues by CPU.
+ *
+ * NAPI: each receive queue has a napi_t with its own poll thread, pinned
+ * to the CPU that queue's interrupt is routed to.  The IRQ handler only
+ * turns the queue's interrupt off and calls napi_schedule().  The thread
+ * then calls poll(ctx, NAPI_BUDGET) until a round finds less than a full
+ * budget of work; only then does the driver turn the interrupt back on
+ * and the thread sleep.  At low rates that is one interrupt per packet;
+ * under load the queue is drained by polling with interrupts off,
+ * yielding to other threads between rounds.
+ *
+ * poll() contract: return how many packets were processed (at most
+ * budget).  Return less than budget only after the queue's interrupt is
+ * on again *and* a re-check found it empty — a packet that arrives in
+ * between raises the interrupt, and napi_schedule() from then on is not
+ * lost.
+ */
+#include <stdint.h>
+#include "netbuf.h"
+
+#define NETDEV_NAME_LEN   8
+#define NETDEV_MAX        8
+#define NAPI_BUDGET       64
+
+typedef int (*napi_poll_fn_t)(void *ctx, int budget);
+
+typedef struct {
+    napi_poll_fn_t    poll;
+    void             *ctx;
+    struct thread    *thread;
+    volatile uint32_t scheduled;    /* set by napi_schedule()           */
+    uint32_t          cpu;
+    uint64_t          irqs;         /* napi_schedule() calls            */
+    uint64_t          rounds;       /* poll() calls                     */
+    uint64_t          busy_rounds;  /* ... that used the whole budget   */
+} napi_t;
+
+typedef struct netdev netdev_t;
+
+typedef struct {
+    /* Queue nb for sending on a queue of the driver's choice.  Returns 0,
+     * or -1 if it cannot be queued (nb is then still the caller's).
+     * more != 0: another packet follows, the doorbell may wait for it. */
+    int  (*xmit)(netdev_t *dev, netbuf_t *nb, int more);
+    /* Ring the doorbell for whatever xmit() held back on this CPU */
+    void (*flush)(netdev_t *dev);
+} netdev_ops_t;
+
+typedef struct {
+    uint64_t rx_packets, rx_bytes, rx_dropped;
+    uint64_t tx_packets, tx_bytes, tx_dropped;
+} netdev_stats_t;
+
+struct netdev {
+    char                name[NETDEV_NAME_LEN];  /* set by netdev_register */
+    uint8_t             mac[6];
+    uint16_t            mtu;
+    uint32_t            nqueues;    /* queue pairs in use              */
+    const char         *driver;
+    const netdev_ops_t *ops;
+    void               *priv;
+    napi_t             *napi;       /* nqueues receive pollers, or 0   */
+    netdev_stats_t      stats;      /* updated with atomic adds        */
+};
+
+typedef void (*netdev_rx_fn_t)(netdev_t *dev, netbuf_t *nb);
+
+int       netdev_register(netdev_t *dev);   /* -1: table full          */
+uint32_t  netdev_count(void);
+netdev_t *netdev_get(uint32_t index);
+/* Name lookup ("eth0"), 0 if there is none */
+netdev_t *netdev_find(const char *name);
+
+void netdev_set_rx_handler(netdev_rx_fn_t fn);
+/* From a driver's poll(): one received packet (chain) */
+void netdev_rx(netdev_t *dev, netbuf_t *nb);
+int  netdev_xmit(netdev_t *dev, netbuf_t *nb, int more);
+void netdev_flush(netdev_t *dev);
+
+/* ── NAPI ────────────────────────────────────────────────────────────── */
+
+/* Start n's poll thread on `cpu`.  Returns -1 if it cannot be created. */
+int  napi_start(napi_t *n, const char *name, uint32_t cpu,
+                napi_poll_fn_t poll, void *ctx);
+/* From the IRQ handler, with the queue's interrupt already off */
+void napi_schedule(napi_t *n);
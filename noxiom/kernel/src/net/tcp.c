@@ -0,0 +1,714 @@
+/* kernel/src/net/tcp.c — TCP connection tables, timers and the socket
+ * calls
+ *
+ * Each CPU has its own table of the connections it owns, hashed by
+ * 4-tuple, with its own lock: the receive path only ever takes the lock
+ * of the CPU it runs on, and a socket call on another CPU only when it
+ * creates a connection (tcp_connect() picks the local port, which picks
+ * the owner).  Listeners are few and looked up on every SYN, so they
+ * are in a single RCU hash that the receive path reads without a lock.
+ *
+ * Tear-down always happens on the owner's worker (TEV_DONE): there the
+ * timers can be cancelled for good, since their callbacks run on the
+ * same CPU in IRQ context and cannot be half-way through.
+ */
+#include "tcp.h"
+#include "../sync/rcu.h"
+#include "../sched/sched.h"
+#include "../smp/smp.h"
+#include "../mm/kmalloc.h"
+#include "../string.h"
+#include "../hal.h"
+
+#define LISTEN_HASH      32
+#define TCP_EPHEMERAL    49152
+
+typedef struct {
+    spinlock_t   lock;
+    tcp_sock_t **bucket;
+    uint32_t     mask;
+    uint32_t     count;
+} __attribute__((aligned(64))) tcp_table_t;
+
+static tcp_table_t s_tables[HAL_MAX_CPUS];
+static tcp_sock_t *s_listen[LISTEN_HASH];
+static spinlock_t  s_listen_lock = SPINLOCK_INIT;
+static uint32_t    s_conns;                 /* all states, atomic        */
+static uint32_t    s_max_conns;
+static uint32_t    s_next_port;             /* ephemeral port cursor     */
+
+static const char *const s_state_names[] = {
+    "CLOSED", "LISTEN", "SYN_SENT", "SYN_RCVD", "ESTABLISHED", "FIN_WAIT1",
+    "FIN_WAIT2", "CLOSING", "TIME_WAIT", "CLOSE_WAIT", "LAST_ACK",
+};
+
+const char *tcp_state_name(uint8_t state)
+{
+    return state < sizeof(s_state_names) / sizeof(s_state_names[0])
+         ? s_state_names[state] : "?";
+}
+
+void tcp_init(const net_limits_t *lim)
+{
+    s_max_conns = lim->max_tcp;
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++) {
+        tcp_table_t *t = &s_tables[cpu];
+        t->lock = (spinlock_t)SPINLOCK_INIT;
+        if (!smp_cpu_online(cpu))
+            continue;
+        t->bucket = kzalloc(lim->tcp_buckets * sizeof(tcp_sock_t *));
+        t->mask   = t->bucket ? lim->tcp_buckets - 1 : 0;
+    }
+}
+
+/* ── References and tear-down ────────────────────────────────────────── */
+
+void tcp_get(tcp_sock_t *s)
+{
+    __atomic_fetch_add(&s->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void free_queues(tcp_sock_t *s)
+{
+    for (netbuf_t *nb = s->sndq, *next; nb; nb = next) {
+        next = nb->qnext;
+        netbuf_free(nb);
+    }
+    for (netbuf_t *nb = s->rcvq, *next; nb; nb = next) {
+        next = nb->qnext;
+        netbuf_free(nb);
+    }
+    for (tcp_seg_t *g = s->ofo, *next; g; g = next) {
+        next = g->next;
+        netbuf_free(g->nb);
+        kfree(g);
+    }
+    s->sndq = s->sndq_tail = s->rcvq = s->rcvq_tail = 0;
+    s->ofo = 0;
+    s->sndq_bytes = s->rcvq_bytes = s->ofo_bytes = 0;
+}
+
+void tcp_put(tcp_sock_t *s)
+{
+    if (__atomic_sub_fetch(&s->refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+    free_queues(s);
+    if (s->flags & TF_COUNTED)
+        __atomic_fetch_sub(&s_conns, 1, __ATOMIC_RELAXED);
+    kfree(s);
+}
+
+void tcp_wake(tcp_sock_t *s, uint32_t which)
+{
+    if ((which & TCP_WAKE_RX) && s->rx_waiter)
+        thread_wake(s->rx_waiter);
+    if ((which & TCP_WAKE_TX) && s->tx_waiter)
+        thread_wake(s->tx_waiter);
+}
+
+static void post(tcp_sock_t *s, uint32_t ev)
+{
+    __atomic_or_fetch(&s->events, ev, __ATOMIC_RELEASE);
+    tcp_get(s);
+    if (!net_work_post(&s->work, s->cpu))
+        tcp_put(s);                 /* already queued, with its ref      */
+}
+
+void tcp_done(tcp_sock_t *s, int err)
+{
+    if (s->state == TCP_CLOSED)
+        return;
+    s->state = TCP_CLOSED;
+    if (err) {
+        s->err = err;
+        s->flags |= TF_RESET;
+    }
+    if (s->parent && !(s->flags & TF_ACCEPTED)) {
+        tcp_sock_t *l = s->parent;
+        uint64_t flags = spin_lock_irqsave(&l->lock);
+        l->pending--;
+        spin_unlock_irqrestore(&l->lock, flags);
+    }
+    tcp_wake(s, TCP_WAKE_ALL);
+    post(s, TEV_DONE);
+}
+
+/* On the owner's worker; s->lock not held */
+static void destroy(tcp_sock_t *s)
+{
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    int first = !(s->flags & TF_DESTROYED);
+    s->flags |= TF_DESTROYED;
+    timer_cancel(&s->rtx_timer);
+    timer_cancel(&s->delack_timer);
+    tcp_sock_t *parent = s->parent;
+    s->parent = 0;
+    spin_unlock_irqrestore(&s->lock, flags);
+    if (!first)
+        return;
+
+    tcp_table_t *t = &s_tables[s->cpu];
+    flags = spin_lock_irqsave(&t->lock);
+    tcp_sock_t **pp = &t->bucket[(s->hash >> 8) & t->mask];
+    while (*pp && *pp != s)
+        pp = &(*pp)->hnext;
+    if (*pp) {
+        *pp = s->hnext;
+        t->count--;
+    }
+    spin_unlock_irqrestore(&t->lock, flags);
+
+    if (parent)
+        tcp_put(parent);
+    tcp_put(s);                     /* the table's reference             */
+}
+
+static void run_work(net_work_t *w)
+{
+    tcp_sock_t *s = (tcp_sock_t *)((uint8_t *)w - __builtin_offsetof(
+                                       tcp_sock_t, work));
+    uint32_t ev = __atomic_exchange_n(&s->events, 0, __ATOMIC_ACQ_REL);
+
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    int dead = s->state == TCP_CLOSED;
+    if (!dead) {
+        if (ev & TEV_RTX)
+            tcp_rtx_timeout(s);
+        if ((ev & TEV_DELACK) && s->ack_pending && s->state != TCP_CLOSED) {
+            NET_STAT(tcp_acks_delayed);
+            tcp_send_ack(s);
+        }
+        dead = s->state == TCP_CLOSED;
+    }
+    spin_unlock_irqrestore(&s->lock, flags);
+
+    if (dead)
+        destroy(s);
+    tcp_put(s);                     /* the work item's reference         */
+}
+
+static void rtx_expired(void *arg)
+{
+    post(arg, TEV_RTX);
+}
+
+static void delack_expired(void *arg)
+{
+    post(arg, TEV_DELACK);
+}
+
+/* s->lock held; no timer survives tcp_done() */
+void tcp_arm_timer(tcp_sock_t *s, ktimer_t *t, uint64_t ns)
+{
+    if (s->state != TCP_CLOSED)
+        timer_arm(t, hal_timer_now_ns() + ns);
+}
+
+uint32_t tcp_rcv_space(const tcp_sock_t *s)
+{
+    uint32_t used = s->rcvq_bytes + s->ofo_bytes;
+    uint32_t max = net_limits()->rcvbuf;
+    return used < max ? max - used : 0;
+}
+
+/* ── Tables ──────────────────────────────────────────────────────────── */
+
+static tcp_sock_t *alloc_sock(void)
+{
+    if (__atomic_add_fetch(&s_conns, 1, __ATOMIC_RELAXED) > s_max_conns) {
+        __atomic_fetch_sub(&s_conns, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    tcp_sock_t *s = kzalloc(sizeof(*s));
+    if (!s) {
+        __atomic_fetch_sub(&s_conns, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    s->refs    = 1;
+    s->flags   = TF_COUNTED;
+    s->rto_ms  = TCP_RTO_INIT_MS;
+    s->mss     = TCP_DEFAULT_MSS;
+    s->work.fn = run_work;
+    return s;
+}
+
+/* Set the endpoints, owner and timers of a new connection */
+static void bind_flow(tcp_sock_t *s, const ip_addr_t *laddr,
+                      const ip_addr_t *raddr, uint16_t lport, uint16_t rport)
+{
+    s->laddr = *laddr;
+    s->raddr = *raddr;
+    s->lport = lport;
+    s->rport = rport;
+    s->hash  = net_flow_hash(laddr, raddr, lport, rport);
+    s->cpu   = net_flow_cpu(s->hash);
+    timer_setup(&s->rtx_timer, rtx_expired, s, s->cpu);
+    timer_setup(&s->delack_timer, delack_expired, s, s->cpu);
+
+    /* RFC 6528-style ISN: a 4 µs clock plus a per-flow offset */
+    s->iss = (uint32_t)(hal_timer_now_ns() >> 12) + s->hash;
+    s->snd_una = s->snd_nxt = s->snd_max = s->sndq_seq = s->iss;
+}
+
+static tcp_sock_t *find_locked(tcp_table_t *t, uint32_t hash,
+                               const ip_addr_t *laddr, const ip_addr_t *raddr,
+                               uint16_t lport, uint16_t rport)
+{
+    for (tcp_sock_t *s = t->bucket[(hash >> 8) & t->mask]; s; s = s->hnext)
+        if (s->lport == lport && s->rport == rport &&
+            ip_addr_eq(&s->raddr, raddr) && ip_addr_eq(&s->laddr, laddr))
+            return s;
+    return 0;
+}
+
+/* 0, or -1 if the 4-tuple is taken (s->cpu and hash set) */
+static int insert(tcp_sock_t *s)
+{
+    tcp_table_t *t = &s_tables[s->cpu];
+    if (!t->bucket)
+        return -1;
+    uint64_t flags = spin_lock_irqsave(&t->lock);
+    int taken = find_locked(t, s->hash, &s->laddr, &s->raddr, s->lport,
+                            s->rport) != 0;
+    if (!taken) {
+        tcp_sock_t **b = &t->bucket[(s->hash >> 8) & t->mask];
+        s->hnext = *b;
+        *b = s;
+        t->count++;
+    }
+    spin_unlock_irqrestore(&t->lock, flags);
+    return taken ? -1 : 0;
+}
+
+tcp_sock_t *tcp_lookup(const ip_addr_t *laddr, const ip_addr_t *raddr,
+                       uint16_t lport, uint16_t rport)
+{
+    uint32_t hash = net_flow_hash(laddr, raddr, lport, rport);
+    tcp_table_t *t = &s_tables[net_flow_cpu(hash)];
+    if (!t->bucket)
+        return 0;
+    uint64_t flags = spin_lock_irqsave(&t->lock);
+    tcp_sock_t *s = find_locked(t, hash, laddr, raddr, lport, rport);
+    if (s)
+        tcp_get(s);
+    spin_unlock_irqrestore(&t->lock, flags);
+    return s;
+}
+
+tcp_sock_t *tcp_lookup_listener(uint16_t port)
+{
+    rcu_read_lock();
+    tcp_sock_t *l = rcu_dereference(s_listen[port % LISTEN_HASH]);
+    for (; l; l = rcu_dereference(l->hnext))
+        if (l->lport == port)
+            break;
+    if (l)
+        tcp_get(l);
+    rcu_read_unlock();
+    return l;
+}
+
+tcp_sock_t *tcp_new_child(tcp_sock_t *l, const ip_addr_t *laddr,
+                          const ip_addr_t *raddr, uint16_t lport,
+                          uint16_t rport)
+{
+    uint64_t flags = spin_lock_irqsave(&l->lock);
+    int room = l->state == TCP_LISTEN && l->aq_len + l->pending < l->backlog;
+    if (room)
+        l->pending++;
+    spin_unlock_irqrestore(&l->lock, flags);
+    if (!room)
+        return 0;
+
+    tcp_sock_t *s = alloc_sock();
+    if (s) {
+        bind_flow(s, laddr, raddr, lport, rport);
+        s->state  = TCP_SYN_RCVD;
+        s->parent = l;
+        tcp_get(l);
+        if (insert(s) == 0) {
+            tcp_get(s);
+            return s;
+        }
+        s->parent = 0;
+        tcp_put(l);
+        tcp_put(s);
+    }
+    flags = spin_lock_irqsave(&l->lock);
+    l->pending--;
+    spin_unlock_irqrestore(&l->lock, flags);
+    return 0;
+}
+
+/* s->lock held */
+void tcp_child_ready(tcp_sock_t *s)
+{
+    tcp_sock_t *l = s->parent;
+    uint64_t flags = spin_lock_irqsave(&l->lock);
+    l->pending--;
+    int open = l->state == TCP_LISTEN;
+    if (open) {
+        tcp_get(s);                 /* becomes the user's reference      */
+        s->aq_next = 0;
+        if (l->aq_tail)
+            l->aq_tail->aq_next = s;
+        else
+            l->aq_head = s;
+        l->aq_tail = s;
+        l->aq_len++;
+        tcp_wake(l, TCP_WAKE_RX);
+    }
+    spin_unlock_irqrestore(&l->lock, flags);
+
+    s->flags |= TF_ACCEPTED;
+    if (!open) {
+        tcp_send_ctl(s, TCP_RST | TCP_ACK);
+        tcp_done(s, -1);
+    }
+}
+
+/* ── Socket calls ────────────────────────────────────────────────────── */
+
+/* Block until cond(s) holds; s->lock held on entry and on return.
+ * `side` is rx_waiter or tx_waiter, so a reader and a writer on the same
+ * socket each keep their own slot. */
+#define WAIT_LOCKED(s, flags, side, cond)                                 \
+    while (!(cond)) {                                                     \
+        (s)->side = thread_current();                                     \
+        spin_unlock_irqrestore(&(s)->lock, flags);                        \
+        thread_block();                                                   \
+        flags = spin_lock_irqsave(&(s)->lock);                            \
+        (s)->side = 0;                                                    \
+    }
+
+tcp_sock_t *tcp_listen(uint16_t port, uint32_t backlog)
+{
+    if (!port)
+        return 0;
+    tcp_sock_t *l = kzalloc(sizeof(*l));
+    if (!l)
+        return 0;
+    l->refs    = 1;
+    l->state   = TCP_LISTEN;
+    l->lport   = port;
+    l->backlog = backlog ? backlog : 8;
+    l->cpu     = hal_cpu_id();
+
+    uint64_t flags = spin_lock_irqsave(&s_listen_lock);
+    tcp_sock_t *x = s_listen[port % LISTEN_HASH];
+    while (x && x->lport != port)
+        x = x->hnext;
+    if (!x) {
+        l->hnext = s_listen[port % LISTEN_HASH];
+        rcu_assign_pointer(s_listen[port % LISTEN_HASH], l);
+    }
+    spin_unlock_irqrestore(&s_listen_lock, flags);
+    if (x) {
+        kfree(l);
+        return 0;
+    }
+    return l;
+}
+
+tcp_sock_t *tcp_accept(tcp_sock_t *l)
+{
+    uint64_t flags = spin_lock_irqsave(&l->lock);
+    WAIT_LOCKED(l, flags, rx_waiter, l->aq_head || l->state != TCP_LISTEN);
+    tcp_sock_t *s = l->aq_head;
+    if (s) {
+        l->aq_head = s->aq_next;
+        if (!l->aq_head)
+            l->aq_tail = 0;
+        l->aq_len--;
+    }
+    spin_unlock_irqrestore(&l->lock, flags);
+    return s;
+}
+
+static void close_listener(tcp_sock_t *l)
+{
+    uint64_t flags = spin_lock_irqsave(&s_listen_lock);
+    tcp_sock_t **pp = &s_listen[l->lport % LISTEN_HASH];
+    while (*pp != l)
+        pp = &(*pp)->hnext;
+    rcu_assign_pointer(*pp, l->hnext);
+    spin_unlock_irqrestore(&s_listen_lock, flags);
+    synchronize_rcu();
+
+    flags = spin_lock_irqsave(&l->lock);
+    l->state = TCP_CLOSED;
+    tcp_sock_t *q = l->aq_head;
+    l->aq_head = l->aq_tail = 0;
+    l->aq_len = 0;
+    tcp_wake(l, TCP_WAKE_ALL);
+    spin_unlock_irqrestore(&l->lock, flags);
+
+    /* Established but never accepted: reset them */
+    while (q) {
+        tcp_sock_t *next = q->aq_next;
+        flags = spin_lock_irqsave(&q->lock);
+        tcp_send_ctl(q, TCP_RST | TCP_ACK);
+        tcp_done(q, -1);
+        spin_unlock_irqrestore(&q->lock, flags);
+        tcp_put(q);
+        q = next;
+    }
+    tcp_put(l);
+}
+
+tcp_sock_t *tcp_connect(const ip_addr_t *dst, uint16_t port)
+{
+    net_route_t rt;
+    if (net_route(dst, &rt) != 0)
+        return 0;
+    tcp_sock_t *s = alloc_sock();
+    if (!s)
+        return 0;
+
+    /* The local port decides the owner; try ports until the 4-tuple is
+     * free in that owner's table */
+    int ok = 0;
+    for (uint32_t i = 0; i < 65536 - TCP_EPHEMERAL && !ok; i++) {
+        uint32_t c = __atomic_fetch_add(&s_next_port, 1, __ATOMIC_RELAXED);
+        uint16_t p = (uint16_t)(TCP_EPHEMERAL + c % (65536 - TCP_EPHEMERAL));
+        bind_flow(s, &rt.src, dst, p, port);
+        ok = insert(s) == 0;
+    }
+    if (!ok) {
+        tcp_put(s);
+        return 0;
+    }
+
+    tcp_get(s);                     /* the caller's handle               */
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    s->state = TCP_SYN_SENT;
+    tcp_send_ctl(s, TCP_SYN);
+    WAIT_LOCKED(s, flags, tx_waiter, s->state != TCP_SYN_SENT);
+    int up = s->state == TCP_ESTABLISHED || s->state == TCP_CLOSE_WAIT;
+    spin_unlock_irqrestore(&s->lock, flags);
+    if (up)
+        return s;
+    tcp_put(s);
+    return 0;
+}
+
+static int can_send(const tcp_sock_t *s)
+{
+    return (s->state == TCP_ESTABLISHED || s->state == TCP_CLOSE_WAIT) &&
+           !(s->flags & TF_FIN_QUEUED);
+}
+
+/* Append one standalone netbuf to sndq; lock held */
+static void sndq_append(tcp_sock_t *s, netbuf_t *nb)
+{
+    nb->qnext = 0;
+    if (s->sndq_tail)
+        s->sndq_tail->qnext = nb;
+    else
+        s->sndq = nb;
+    s->sndq_tail = nb;
+    s->sndq_bytes += nb->len;
+}
+
+int tcp_send(tcp_sock_t *s, const void *buf, uint32_t len)
+{
+    const uint8_t *p = buf;
+    uint32_t done = 0;
+    uint32_t max = net_limits()->sndbuf;
+
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    while (done < len) {
+        WAIT_LOCKED(s, flags, tx_waiter, !can_send(s) || s->sndq_bytes < max);
+        if (!can_send(s))
+            break;
+
+        /* Fill the tail buffer first, then fresh pages; at most a few
+         * pages per pass so IRQs are not off for long */
+        uint32_t room = max - s->sndq_bytes;
+        for (int pages = 0; pages < 4 && room && done < len; pages++) {
+            netbuf_t *nb = s->sndq_tail;
+            uint32_t n = nb ? netbuf_tailroom(nb) : 0;
+            if (!n) {
+                nb = netbuf_alloc();
+                if (!nb)
+                    break;
+                n = netbuf_tailroom(nb);
+                sndq_append(s, nb);
+            }
+            if (n > room)
+                n = room;
+            if (n > len - done)
+                n = len - done;
+            kmemcpy(netbuf_put(nb, n), p + done, n);
+            s->sndq_bytes += n;
+            done += n;
+            room -= n;
+        }
+        tcp_output(s);
+    }
+    spin_unlock_irqrestore(&s->lock, flags);
+    return done == len ? (int)len : done ? (int)done : -1;
+}
+
+int tcp_send_netbuf(tcp_sock_t *s, netbuf_t *nb)
+{
+    uint32_t max = net_limits()->sndbuf;
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    WAIT_LOCKED(s, flags, tx_waiter, !can_send(s) || s->sndq_bytes < max);
+    int ok = can_send(s);
+    uint32_t total = nb->total;
+    if (ok) {
+        /* Each fragment becomes its own sndq entry */
+        while (nb) {
+            netbuf_t *next = nb->next;
+            nb->next  = 0;
+            nb->total = nb->len;
+            if (nb->len)
+                sndq_append(s, nb);
+            else
+                netbuf_free(nb);
+            nb = next;
+        }
+        tcp_output(s);
+    }
+    spin_unlock_irqrestore(&s->lock, flags);
+    if (!ok) {
+        netbuf_free(nb);
+        return -1;
+    }
+    return (int)total;
+}
+
+static int can_recv(const tcp_sock_t *s)
+{
+    return s->rcvq || (s->flags & (TF_FIN_RCVD | TF_RESET)) ||
+           s->state == TCP_CLOSED;
+}
+
+/* Lock held, after the reader freed space: reopen a window that had
+ * shrunk by two segments or more */
+static void window_update(tcp_sock_t *s)
+{
+    uint32_t adv = s->rcv_adv - s->rcv_nxt;
+    if (tcp_rcv_space(s) >= adv + 2 * s->mss && s->state != TCP_CLOSED)
+        tcp_send_ack(s);
+}
+
+int tcp_recv(tcp_sock_t *s, void *buf, uint32_t len)
+{
+    uint8_t *p = buf;
+    uint32_t done = 0;
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    WAIT_LOCKED(s, flags, rx_waiter, can_recv(s));
+    while (s->rcvq && done < len) {
+        netbuf_t *nb = s->rcvq;
+        uint32_t n = netbuf_copy_out(nb, 0, p + done, len - done);
+        done += n;
+        s->rcvq_bytes -= n;
+        netbuf_t *next = nb->qnext;
+        nb = netbuf_consume(nb, n);
+        if (nb) {
+            nb->qnext = next;
+        } else {
+            if (!next)
+                s->rcvq_tail = 0;
+            nb = next;
+        }
+        s->rcvq = nb;
+    }
+    if (done)
+        window_update(s);
+    int rc = done ? (int)done : (s->flags & TF_RESET) ? -1 : 0;
+    spin_unlock_irqrestore(&s->lock, flags);
+    return rc;
+}
+
+netbuf_t *tcp_recv_netbuf(tcp_sock_t *s)
+{
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    WAIT_LOCKED(s, flags, rx_waiter, can_recv(s));
+    netbuf_t *nb = s->rcvq;
+    if (nb) {
+        s->rcvq = nb->qnext;
+        if (!s->rcvq)
+            s->rcvq_tail = 0;
+        nb->qnext = 0;
+        s->rcvq_bytes -= nb->total;
+        window_update(s);
+    }
+    spin_unlock_irqrestore(&s->lock, flags);
+    return nb;
+}
+
+void tcp_close(tcp_sock_t *s)
+{
+    if (s->state == TCP_LISTEN) {
+        close_listener(s);
+        return;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    if (s->rcvq_bytes || s->ofo_bytes) {
+        /* Unread data is lost: tell the peer (RFC 2525 §2.17) */
+        if (s->state != TCP_CLOSED && s->state != TCP_TIME_WAIT)
+            tcp_send_ctl(s, TCP_RST | TCP_ACK);
+        tcp_done(s, -1);
+    }
+    switch (s->state) {
+    case TCP_SYN_SENT:
+        tcp_done(s, 0);
+        break;
+    case TCP_SYN_RCVD:
+    case TCP_ESTABLISHED:
+        s->flags |= TF_FIN_QUEUED;
+        s->state  = TCP_FIN_WAIT1;
+        tcp_output(s);
+        break;
+    case TCP_CLOSE_WAIT:
+        s->flags |= TF_FIN_QUEUED;
+        s->state  = TCP_LAST_ACK;
+        tcp_output(s);
+        break;
+    }
+    spin_unlock_irqrestore(&s->lock, flags);
+    tcp_put(s);
+}
+
+/* ── Introspection ───────────────────────────────────────────────────── */
+
+static void fill_info(const tcp_sock_t *s, tcp_info_t *o)
+{
+    o->laddr   = s->laddr;
+    o->raddr   = s->raddr;
+    o->lport   = s->lport;
+    o->rport   = s->rport;
+    o->cpu     = s->cpu;
+    o->state   = tcp_state_name(s->state);
+    o->sndq    = s->sndq_bytes;
+    o->rcvq    = s->rcvq_bytes;
+    o->cwnd    = s->cwnd;
+    o->srtt_us = s->srtt_us;
+}
+
+uint32_t tcp_list(tcp_info_t *out, uint32_t max)
+{
+    uint32_t n = 0;
+    rcu_read_lock();
+    for (uint32_t i = 0; i < LISTEN_HASH; i++)
+        for (tcp_sock_t *l = rcu_dereference(s_listen[i]); l && n < max;
+             l = rcu_dereference(l->hnext))
+            fill_info(l, &out[n++]);
+    rcu_read_unlock();
+
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++) {
+        tcp_table_t *t = &s_tables[cpu];
+        if (!t->bucket)
+            continue;
+        uint64_t flags = spin_lock_irqsave(&t->lock);
+        for (uint32_t b = 0; b <= t->mask; b++)
+            for (tcp_sock_t *s = t->bucket[b]; s && n < max; s = s->hnext)
+                fill_info(s, &out[n++]);
+        spin_unlock_irqrestore(&t->lock, flags);
+    }
+    return n;
+}
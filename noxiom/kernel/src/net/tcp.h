@@ -0,0 +1,196 @@
+#pragma once
+/* net/tcp.h — TCP connection state, shared by tcp.c, tcp_input.c and
+ * tcp_output.c
+ *
+ * Ownership and locking:
+ *   - A connection belongs to the CPU its 4-tuple hashes to (s->cpu).
+ *     Its segments are processed there, its timers run there, and it
+ *     sits in that CPU's hash table.  Listeners are in one RCU table.
+ *   - Everything in a tcp_sock_t is guarded by s->lock (IRQs masked), so
+ *     socket calls on other CPUs may send and queue directly; only the
+ *     owner ever tears a connection down (tcp_done() asks it to).
+ *   - Timer callbacks run in IRQ context and only post work to the
+ *     owner's worker; the worker does the retransmission or ACK.
+ *   - refs: one for the hash table, one for the user's handle (or the
+ *     accept queue holding it for the user), one per queued work item.
+ *
+ * Sequence space arithmetic is modulo 2^32: compare with SEQ_LT() etc.
+ */
+#include <stdint.h>
+#include "inet.h"
+#include "../time/timer.h"
+#include "../sched/sched.h"
+
+#define SEQ_LT(a, b)   ((int32_t)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b)  ((int32_t)((a) - (b)) <= 0)
+#define SEQ_GT(a, b)   ((int32_t)((a) - (b)) > 0)
+#define SEQ_GEQ(a, b)  ((int32_t)((a) - (b)) >= 0)
+
+#define TCP_INIT_CWND      10           /* segments, RFC 6928            */
+#define TCP_DEFAULT_MSS    536
+#define TCP_RTO_INIT_MS    1000
+#define TCP_RTO_MIN_MS     200
+#define TCP_RTO_MAX_MS     60000
+#define TCP_SYN_RETRIES    5
+#define TCP_MAX_RETRIES    10
+#define TCP_DELACK_NS      (40ULL * 1000000ULL)
+#define TCP_TIME_WAIT_NS   (5ULL * 1000000000ULL)   /* not 2 MSL: a small
+                                           host cannot hold connections
+                                           for minutes                   */
+#define TCP_FIN_WAIT2_NS   (60ULL * 1000000000ULL)
+#define TCP_SACK_BLOCKS    4            /* sender scoreboard             */
+#define TCP_SACK_SEND      3            /* blocks we report              */
+
+typedef enum {
+    TCP_CLOSED = 0,
+    TCP_LISTEN,
+    TCP_SYN_SENT,
+    TCP_SYN_RCVD,
+    TCP_ESTABLISHED,
+    TCP_FIN_WAIT1,
+    TCP_FIN_WAIT2,
+    TCP_CLOSING,
+    TCP_TIME_WAIT,
+    TCP_CLOSE_WAIT,
+    TCP_LAST_ACK,
+} tcp_state_t;
+
+/* s->flags */
+#define TF_SACK_OK     0x0001           /* both sides sent SACK-permitted */
+#define TF_WSCALE      0x0002           /* both sides sent window scale  */
+#define TF_FIN_QUEUED  0x0004           /* user closed: FIN after sndq   */
+#define TF_FIN_SENT    0x0008
+#define TF_FIN_RCVD    0x0010
+#define TF_ACK_NOW     0x0020
+#define TF_PROBE       0x0040           /* zero-window probe due         */
+#define TF_RESET       0x0080           /* reset by the peer or aborted  */
+#define TF_DESTROYED   0x0100           /* unhashed, timers off          */
+#define TF_ACCEPTED    0x0200           /* child handed to accept queue  */
+#define TF_COUNTED     0x0400           /* counts against max_tcp        */
+
+/* Work bits (s->events), set from timer callbacks */
+#define TEV_RTX        0x1
+#define TEV_DELACK     0x2
+#define TEV_DONE       0x4
+
+/* Out-of-order receive queue entry */
+typedef struct tcp_seg {
+    struct tcp_seg *next;
+    uint32_t        seq, len;
+    netbuf_t       *nb;             /* payload                           */
+} tcp_seg_t;
+
+typedef struct {
+    uint32_t start, end;
+} tcp_sack_t;
+
+struct tcp_sock {
+    struct tcp_sock  *hnext;        /* owner's hash chain / listen chain */
+    spinlock_t        lock;
+    uint32_t          refs;
+    uint8_t           state;
+    uint8_t           snd_wscale, rcv_wscale;
+    uint16_t          flags;
+    uint16_t          lport, rport;
+    ip_addr_t         laddr, raddr;
+    uint32_t          hash;
+    uint32_t          cpu;          /* owner                             */
+    int               err;          /* -1 after a reset or timeout       */
+
+    /* Listener side */
+    struct tcp_sock  *parent;       /* SYN_RCVD child: its listener      */
+    struct tcp_sock  *aq_next;
+    struct tcp_sock  *aq_head, *aq_tail;    /* listener: accept queue    */
+    uint32_t          aq_len, pending, backlog;
+
+    /* Send side.  sndq holds every data byte not yet acknowledged plus
+     * whatever is unsent (netbufs linked through qnext).  Its first byte
+     * has sequence number sndq_seq, which trails snd_una by whatever
+     * part of the first buffer is already acknowledged; a FIN takes the
+     * sequence number after the last byte. */
+    uint32_t          iss, snd_una, snd_nxt, snd_max;
+    uint32_t          snd_wnd, snd_wl1, snd_wl2;
+    uint32_t          mss;
+    netbuf_t         *sndq, *sndq_tail;
+    uint32_t          sndq_seq;
+    uint32_t          sndq_bytes;   /* from sndq_seq on                  */
+    uint32_t          cwnd, ssthresh;
+    uint32_t          dupacks;
+    uint32_t          recover;      /* snd_max when recovery started     */
+    uint32_t          rtx_hint;     /* next hole candidate in recovery   */
+    uint8_t           in_recovery;
+    uint8_t           nsacked;
+    uint8_t           retries;
+    tcp_sack_t        sacked[TCP_SACK_BLOCKS];
+
+    /* RTT, RFC 6298 */
+    uint32_t          srtt_us, rttvar_us, rto_ms;
+    uint32_t          rtt_seq;
+    uint64_t          rtt_start;
+    uint8_t           rtt_timing;
+
+    /* Receive side */
+    uint32_t          irs, rcv_nxt, rcv_adv;    /* rcv_adv: right edge of
+                                                   the advertised window */
+    netbuf_t         *rcvq, *rcvq_tail;
+    uint32_t          rcvq_bytes;
+    tcp_seg_t        *ofo;          /* sorted by seq, not overlapping    */
+    uint32_t          ofo_bytes;
+    tcp_sack_t        last_ofo;     /* reported first (RFC 2018)         */
+    uint32_t          ack_pending;  /* segments not yet acknowledged     */
+
+    ktimer_t          rtx_timer;    /* RTO, persist and TIME_WAIT        */
+    ktimer_t          delack_timer;
+    uint32_t          events;
+    net_work_t        work;
+    thread_t         *rx_waiter;    /* blocked in recv / accept          */
+    thread_t         *tx_waiter;    /* blocked in send / connect         */
+};
+
+/* tcp_wake(): which side's waiter */
+#define TCP_WAKE_RX   1u            /* data, FIN, a connection to accept */
+#define TCP_WAKE_TX   2u            /* send queue room, handshake done   */
+#define TCP_WAKE_ALL  (TCP_WAKE_RX | TCP_WAKE_TX)
+
+/* ── tcp.c ───────────────────────────────────────────────────────────── */
+
+void tcp_get(tcp_sock_t *s);
+void tcp_put(tcp_sock_t *s);
+/* Connection over (s->lock held): wake the user, let the owner unhash */
+void tcp_done(tcp_sock_t *s, int err);
+void tcp_wake(tcp_sock_t *s, uint32_t which);
+/* Owner table lookup, with a reference; 0 if none */
+tcp_sock_t *tcp_lookup(const ip_addr_t *laddr, const ip_addr_t *raddr,
+                       uint16_t lport, uint16_t rport);
+tcp_sock_t *tcp_lookup_listener(uint16_t port);
+/* A SYN_RCVD child of l for the SYN described, inserted in the owner's
+ * table and returned with a reference for the caller; 0 if the table or
+ * the listener's backlog is full */
+tcp_sock_t *tcp_new_child(tcp_sock_t *l, const ip_addr_t *laddr,
+                          const ip_addr_t *raddr, uint16_t lport,
+                          uint16_t rport);
+/* SYN_RCVD → ESTABLISHED: queue the child for tcp_accept() */
+void tcp_child_ready(tcp_sock_t *s);
+void tcp_arm_timer(tcp_sock_t *s, ktimer_t *t, uint64_t ns);
+uint32_t tcp_rcv_space(const tcp_sock_t *s);
+const char *tcp_state_name(uint8_t state);
+
+/* ── tcp_output.c ────────────────────────────────────────────────────── */
+
+/* Send what the windows allow, then anything owed (ACK, FIN).  Lock
+ * held; one doorbell for the whole batch. */
+void tcp_output(tcp_sock_t *s);
+/* A segment with no data: SYN, SYN-ACK, ACK or RST */
+void tcp_send_ctl(tcp_sock_t *s, uint8_t flags);
+void tcp_send_ack(tcp_sock_t *s);
+/* Retransmit one segment from seq */
+void tcp_retransmit(tcp_sock_t *s, uint32_t seq);
+/* RST in answer to a segment that matches no connection */
+void tcp_send_reset(const ip_addr_t *src, const ip_addr_t *dst,
+                    const tcp_hdr_t *th, uint32_t payload);
+void tcp_rtx_timeout(tcp_sock_t *s);
+void tcp_rtt_sample(tcp_sock_t *s, uint64_t rtt_us);
+/* Our MSS option, from the MTU of the route to the peer */
+uint32_t tcp_our_mss(const tcp_sock_t *s);
+/* The shift that fits the receive buffer in the 16-bit window field */
+uint8_t  tcp_rcv_wscale(void);
@@ -0,0 +1,608 @@
+/* kernel/src/net/tcp_input.c — segment arrival (RFC 9293 §3.10.7)
+ *
+ * Runs on the connection's owner CPU, called from the IP layer with the
+ * segment's netbuf chain.  In-order payload is queued on rcvq as that
+ * chain, trimmed to the bytes that are new; segments beyond rcv_nxt wait
+ * in the out-of-order queue and are reported back with SACK.
+ *
+ * Congestion control is NewReno (RFC 5681, RFC 6582) with SACK-guided
+ * retransmission during recovery: the scoreboard keeps the lowest few
+ * ranges the peer reported and, after the first fast retransmit, each
+ * further duplicate ACK resends the next hole below the highest one.
+ */
+#include "tcp.h"
+#include "../mm/kmalloc.h"
+#include "../hal.h"
+
+#define OPT_EOL     0
+#define OPT_NOP     1
+#define OPT_MSS     2
+#define OPT_WSCALE  3
+#define OPT_SACK_OK 4
+#define OPT_SACK    5
+
+#define WSCALE_NONE 0xFF
+
+/* A parsed segment */
+typedef struct {
+    uint32_t   seq, ack, len;       /* len: payload bytes                */
+    uint32_t   wnd;                 /* as sent, not yet scaled           */
+    uint8_t    flags;
+    uint8_t    wscale;              /* WSCALE_NONE if absent             */
+    uint8_t    sack_ok;
+    uint8_t    nsack;
+    uint16_t   mss;                 /* 0 if absent                       */
+    tcp_sack_t sack[4];
+} seg_t;
+
+static uint32_t min32(uint32_t a, uint32_t b) { return a < b ? a : b; }
+static uint32_t max32(uint32_t a, uint32_t b) { return a > b ? a : b; }
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+           p[3];
+}
+
+static void parse_options(const uint8_t *p, uint32_t len, seg_t *g)
+{
+    while (len) {
+        uint8_t kind = p[0];
+        if (kind == OPT_EOL)
+            return;
+        if (kind == OPT_NOP) {
+            p++;
+            len--;
+            continue;
+        }
+        if (len < 2 || p[1] < 2 || p[1] > len)
+            return;
+        uint8_t olen = p[1];
+        switch (kind) {
+        case OPT_MSS:
+            if (olen == 4 && (g->flags & TCP_SYN))
+                g->mss = (uint16_t)(p[2] << 8 | p[3]);
+            break;
+        case OPT_WSCALE:
+            if (olen == 3 && (g->flags & TCP_SYN))
+                g->wscale = p[2] > 14 ? 14 : p[2];
+            break;
+        case OPT_SACK_OK:
+            if (olen == 2 && (g->flags & TCP_SYN))
+                g->sack_ok = 1;
+            break;
+        case OPT_SACK:
+            for (uint32_t o = 2; o + 8 <= olen && g->nsack < 4; o += 8) {
+                g->sack[g->nsack].start = get32(p + o);
+                g->sack[g->nsack].end   = get32(p + o + 4);
+                g->nsack++;
+            }
+            break;
+        }
+        p   += olen;
+        len -= olen;
+    }
+}
+
+/* The SYN's options decide MSS, SACK and window scaling for good */
+static void syn_options(tcp_sock_t *s, const seg_t *g)
+{
+    uint32_t mss = g->mss ? g->mss : TCP_DEFAULT_MSS;
+    s->mss = min32(mss, tcp_our_mss(s));
+    if (g->sack_ok)
+        s->flags |= TF_SACK_OK;
+    else
+        s->flags &= (uint16_t)~TF_SACK_OK;
+    if (g->wscale != WSCALE_NONE) {
+        s->flags     |= TF_WSCALE;
+        s->snd_wscale = g->wscale;
+        if (s->state == TCP_SYN_RCVD)
+            s->rcv_wscale = tcp_rcv_wscale();
+    } else {
+        s->flags     &= (uint16_t)~TF_WSCALE;
+        s->snd_wscale = s->rcv_wscale = 0;
+    }
+    s->cwnd     = TCP_INIT_CWND * s->mss;
+    s->ssthresh = 0xFFFFFFFFu;
+    s->irs      = g->seq;
+    s->rcv_nxt  = s->rcv_adv = g->seq + 1;
+    s->snd_wnd  = g->wnd;           /* never scaled in a SYN             */
+    s->snd_wl1  = g->seq;
+}
+
+/* ── Send side ───────────────────────────────────────────────────────── */
+
+/* Merge the peer's SACK blocks into the scoreboard, dropping anything at
+ * or below snd_una and keeping the lowest TCP_SACK_BLOCKS ranges */
+static void sack_update(tcp_sock_t *s, const seg_t *g)
+{
+    tcp_sack_t b[TCP_SACK_BLOCKS + 4];
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < s->nsacked; i++)
+        b[n++] = s->sacked[i];
+    if (s->flags & TF_SACK_OK)
+        for (uint32_t i = 0; i < g->nsack; i++)
+            if (SEQ_LT(g->sack[i].start, g->sack[i].end) &&
+                SEQ_LEQ(g->sack[i].end, s->snd_max))
+                b[n++] = g->sack[i];
+
+    /* Insertion sort by start, then merge */
+    for (uint32_t i = 1; i < n; i++)
+        for (uint32_t j = i; j && SEQ_LT(b[j].start, b[j - 1].start); j--) {
+            tcp_sack_t t = b[j];
+            b[j] = b[j - 1];
+            b[j - 1] = t;
+        }
+    s->nsacked = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (SEQ_LEQ(b[i].end, s->snd_una))
+            continue;
+        if (SEQ_LT(b[i].start, s->snd_una))
+            b[i].start = s->snd_una;
+        tcp_sack_t *last = s->nsacked ? &s->sacked[s->nsacked - 1] : 0;
+        if (last && SEQ_LEQ(b[i].start, last->end)) {
+            if (SEQ_GT(b[i].end, last->end))
+                last->end = b[i].end;
+        } else if (s->nsacked < TCP_SACK_BLOCKS) {
+            s->sacked[s->nsacked++] = b[i];
+        }
+    }
+}
+
+/* The first unSACKed sequence at or after from that lies below the
+ * highest SACKed byte, or snd_max if there is none */
+static uint32_t next_hole(const tcp_sock_t *s, uint32_t from)
+{
+    if (!s->nsacked)
+        return s->snd_max;
+    uint32_t seq = SEQ_LT(from, s->snd_una) ? s->snd_una : from;
+    for (uint32_t i = 0; i < s->nsacked; i++)
+        if (SEQ_GEQ(seq, s->sacked[i].start) && SEQ_LT(seq, s->sacked[i].end))
+            seq = s->sacked[i].end;
+    return SEQ_LT(seq, s->sacked[s->nsacked - 1].end) ? seq : s->snd_max;
+}
+
+static void retransmit_hole(tcp_sock_t *s, uint32_t seq)
+{
+    tcp_retransmit(s, seq);
+    s->rtx_hint = seq + s->mss;
+}
+
+/* Free acknowledged buffers from the front of sndq */
+static void sndq_release(tcp_sock_t *s)
+{
+    uint32_t acked = s->snd_una - s->sndq_seq;
+    if (acked > s->sndq_bytes)      /* the FIN's sequence number         */
+        acked = s->sndq_bytes;
+    while (s->sndq && acked >= s->sndq->len) {
+        netbuf_t *b = s->sndq;
+        s->sndq        = b->qnext;
+        s->sndq_seq   += b->len;
+        s->sndq_bytes -= b->len;
+        acked         -= b->len;
+        b->qnext = 0;
+        netbuf_free(b);
+    }
+    if (!s->sndq)
+        s->sndq_tail = 0;
+}
+
+static void ack_new(tcp_sock_t *s, const seg_t *g)
+{
+    uint32_t acked = g->ack - s->snd_una;
+    if (s->rtt_timing && SEQ_GEQ(g->ack, s->rtt_seq)) {
+        tcp_rtt_sample(s, (hal_timer_now_ns() - s->rtt_start) / 1000);
+        s->rtt_timing = 0;
+    }
+    s->snd_una = g->ack;
+    if (SEQ_LT(s->snd_nxt, s->snd_una))
+        s->snd_nxt = s->snd_una;
+    sndq_release(s);
+    s->retries = 0;
+
+    if (s->in_recovery) {
+        if (SEQ_GEQ(g->ack, s->recover)) {
+            s->in_recovery = 0;
+            s->dupacks     = 0;
+            s->cwnd        = min32(s->ssthresh,
+                                   max32(s->snd_max - s->snd_una, s->mss) +
+                                   s->mss);
+        } else {
+            /* Partial ACK: the next hole is lost too (RFC 6582 §3.2) */
+            s->cwnd = s->cwnd > acked ? s->cwnd - acked + s->mss : s->mss;
+            retransmit_hole(s, s->snd_una);
+        }
+    } else {
+        s->dupacks = 0;
+        if (s->cwnd < s->ssthresh)
+            s->cwnd += min32(acked, s->mss);
+        else
+            s->cwnd += max32(s->mss * s->mss / s->cwnd, 1);
+        if (s->cwnd > (1u << 30))
+            s->cwnd = 1u << 30;
+    }
+
+    if (s->snd_una == s->snd_max)
+        timer_cancel(&s->rtx_timer);
+    else
+        tcp_arm_timer(s, &s->rtx_timer, (uint64_t)s->rto_ms * 1000000ULL);
+    tcp_wake(s, TCP_WAKE_TX);       /* sndq has room again               */
+}
+
+static void ack_dup(tcp_sock_t *s)
+{
+    if (++s->dupacks == 3 && !s->in_recovery) {
+        uint32_t flight = s->snd_max - s->snd_una;
+        s->ssthresh    = max32(flight / 2, 2 * s->mss);
+        s->recover     = s->snd_max;
+        s->in_recovery = 1;
+        retransmit_hole(s, s->snd_una);
+        s->cwnd = s->ssthresh + 3 * s->mss;
+    } else if (s->in_recovery) {
+        s->cwnd += s->mss;
+        uint32_t h = next_hole(s, s->rtx_hint);
+        if (SEQ_LT(h, s->snd_max))
+            retransmit_hole(s, h);
+    }
+}
+
+/* ── Receive side ────────────────────────────────────────────────────── */
+
+static void rcvq_append(tcp_sock_t *s, netbuf_t *nb, uint32_t len)
+{
+    nb->qnext = 0;
+    if (s->rcvq_tail)
+        s->rcvq_tail->qnext = nb;
+    else
+        s->rcvq = nb;
+    s->rcvq_tail   = nb;
+    s->rcvq_bytes += len;
+    s->rcv_nxt    += len;
+}
+
+/* Move out-of-order segments that are now in order onto rcvq */
+static void ofo_drain(tcp_sock_t *s)
+{
+    while (s->ofo && SEQ_LEQ(s->ofo->seq, s->rcv_nxt)) {
+        tcp_seg_t *g = s->ofo;
+        s->ofo        = g->next;
+        s->ofo_bytes -= g->len;
+        uint32_t old = s->rcv_nxt - g->seq;
+        netbuf_t *nb = g->nb;
+        if (old < g->len && (nb = netbuf_consume(nb, old)) != 0)
+            rcvq_append(s, nb, g->len - old);
+        else if (nb)
+            netbuf_free(nb);
+        kfree(g);
+    }
+}
+
+/* Queue [seq, seq + len) beyond rcv_nxt; returns nb if it was not kept */
+static netbuf_t *ofo_insert(tcp_sock_t *s, uint32_t seq, uint32_t len,
+                            netbuf_t *nb)
+{
+    tcp_seg_t **pp = &s->ofo;
+    while (*pp && SEQ_LEQ((*pp)->seq + (*pp)->len, seq))
+        pp = &(*pp)->next;
+    if (*pp && SEQ_LEQ((*pp)->seq, seq)) {
+        uint32_t d = (*pp)->seq + (*pp)->len - seq;
+        if (d >= len)
+            return nb;              /* all of it is queued already       */
+        nb   = netbuf_consume(nb, d);
+        seq += d;
+        len -= d;
+        pp   = &(*pp)->next;
+    }
+    if (*pp && SEQ_LT((*pp)->seq, seq + len)) {
+        len = (*pp)->seq - seq;
+        if (!len)
+            return nb;
+        netbuf_trim(nb, len);
+    }
+
+    tcp_seg_t *g = kmalloc(sizeof(*g));
+    if (!g)
+        return nb;
+    g->seq  = seq;
+    g->len  = len;
+    g->nb   = nb;
+    g->next = *pp;
+    *pp = g;
+    s->ofo_bytes += len;
+    s->last_ofo.start = seq;
+    s->last_ofo.end   = seq + len;
+    return 0;
+}
+
+/* Payload of an acceptable segment; returns what was not kept */
+static netbuf_t *data_in(tcp_sock_t *s, uint32_t seq, netbuf_t *nb)
+{
+    uint32_t len = nb->total;
+    if (SEQ_LT(seq, s->rcv_nxt)) {
+        uint32_t d = s->rcv_nxt - seq;
+        if (d >= len) {
+            s->flags |= TF_ACK_NOW; /* a duplicate: the ACK was lost     */
+            return nb;
+        }
+        nb   = netbuf_consume(nb, d);
+        seq += d;
+        len -= d;
+    }
+
+    /* Keep only what fits the buffer */
+    uint32_t space = tcp_rcv_space(s);
+    uint32_t off = seq - s->rcv_nxt;
+    if (off >= space) {
+        s->flags |= TF_ACK_NOW;
+        return nb;
+    }
+    if (len > space - off) {
+        len = space - off;
+        netbuf_trim(nb, len);
+    }
+
+    if (off) {
+        s->flags |= TF_ACK_NOW;     /* dupack at once: fast retransmit   */
+        return ofo_insert(s, seq, len, nb);
+    }
+
+    int had_ofo = s->ofo != 0;
+    rcvq_append(s, nb, len);
+    ofo_drain(s);
+    if (had_ofo || ++s->ack_pending >= 2)
+        s->flags |= TF_ACK_NOW;
+    else if (!timer_pending(&s->delack_timer))
+        tcp_arm_timer(s, &s->delack_timer, TCP_DELACK_NS);
+    tcp_wake(s, TCP_WAKE_RX);
+    return 0;
+}
+
+static void enter_time_wait(tcp_sock_t *s)
+{
+    s->state = TCP_TIME_WAIT;
+    timer_cancel(&s->rtx_timer);
+    timer_cancel(&s->delack_timer);
+    tcp_arm_timer(s, &s->rtx_timer, TCP_TIME_WAIT_NS);
+}
+
+static void fin_in(tcp_sock_t *s)
+{
+    s->rcv_nxt++;
+    s->flags |= TF_FIN_RCVD | TF_ACK_NOW;
+    switch (s->state) {
+    case TCP_ESTABLISHED:
+        s->state = TCP_CLOSE_WAIT;
+        break;
+    case TCP_FIN_WAIT1:
+        s->state = TCP_CLOSING;     /* our FIN not acknowledged yet      */
+        break;
+    case TCP_FIN_WAIT2:
+        enter_time_wait(s);
+        break;
+    }
+    tcp_wake(s, TCP_WAKE_ALL);
+}
+
+/* ── Segment processing ──────────────────────────────────────────────── */
+
+static int acceptable(const tcp_sock_t *s, const seg_t *g)
+{
+    uint32_t wnd = s->rcv_adv - s->rcv_nxt;
+    if (!g->len)
+        return wnd ? SEQ_GEQ(g->seq, s->rcv_nxt) &&
+                     SEQ_LT(g->seq, s->rcv_nxt + wnd)
+                   : g->seq == s->rcv_nxt;
+    if (!wnd)
+        return 0;
+    uint32_t last = g->seq + g->len - 1;
+    return (SEQ_GEQ(g->seq, s->rcv_nxt) &&
+            SEQ_LT(g->seq, s->rcv_nxt + wnd)) ||
+           (SEQ_GEQ(last, s->rcv_nxt) && SEQ_LT(last, s->rcv_nxt + wnd));
+}
+
+static netbuf_t *syn_sent(tcp_sock_t *s, const seg_t *g, netbuf_t *nb)
+{
+    if ((g->flags & TCP_ACK) &&
+        (SEQ_LEQ(g->ack, s->iss) || SEQ_GT(g->ack, s->snd_max)))
+        return nb;                  /* tcp_input() resets it             */
+    if (g->flags & TCP_RST) {
+        if (g->flags & TCP_ACK)
+            tcp_done(s, -1);        /* refused                           */
+        return nb;
+    }
+    if (!(g->flags & TCP_SYN) || !(g->flags & TCP_ACK))
+        return nb;                  /* no simultaneous open              */
+
+    syn_options(s, g);
+    s->snd_wl2 = g->ack;
+    s->snd_una = g->ack;
+    s->retries = 0;
+    if (s->rtt_timing) {
+        tcp_rtt_sample(s, (hal_timer_now_ns() - s->rtt_start) / 1000);
+        s->rtt_timing = 0;
+    } else {
+        s->rto_ms = TCP_RTO_INIT_MS;
+    }
+    timer_cancel(&s->rtx_timer);
+    s->state = TCP_ESTABLISHED;
+    tcp_send_ack(s);
+    tcp_wake(s, TCP_WAKE_ALL);
+    return nb;
+}
+
+/* Everything after the handshake started; lock held */
+static netbuf_t *segment(tcp_sock_t *s, const seg_t *g, netbuf_t *nb)
+{
+    if (s->state == TCP_SYN_SENT)
+        return syn_sent(s, g, nb);
+
+    if (!acceptable(s, g)) {
+        if (!(g->flags & TCP_RST))
+            tcp_send_ack(s);
+        return nb;
+    }
+    if (g->flags & TCP_RST) {
+        /* RFC 5961 §3: only an exact match resets, others are challenged */
+        if (g->seq == s->rcv_nxt)
+            tcp_done(s, -1);
+        else
+            tcp_send_ack(s);
+        return nb;
+    }
+    if (g->flags & TCP_SYN) {
+        if (s->state == TCP_SYN_RCVD && g->seq == s->irs)
+            tcp_send_ctl(s, TCP_SYN | TCP_ACK);     /* our SYN-ACK was lost */
+        else
+            tcp_send_ack(s);        /* RFC 5961 §4 challenge ACK         */
+        return nb;
+    }
+    if (!(g->flags & TCP_ACK))
+        return nb;
+
+    if (s->state == TCP_SYN_RCVD) {
+        if (SEQ_LEQ(g->ack, s->snd_una) || SEQ_GT(g->ack, s->snd_max))
+            return nb;
+        s->state   = TCP_ESTABLISHED;
+        s->snd_wnd = g->wnd << s->snd_wscale;
+        s->snd_wl1 = g->seq;
+        s->snd_wl2 = g->ack;
+        tcp_child_ready(s);
+        if (s->state == TCP_CLOSED)
+            return nb;
+    }
+
+    if (SEQ_GT(g->ack, s->snd_max)) {
+        tcp_send_ack(s);            /* acks what we never sent           */
+        return nb;
+    }
+    uint32_t wnd = g->wnd << s->snd_wscale;
+    if (SEQ_GT(g->ack, s->snd_una)) {
+        ack_new(s, g);
+        sack_update(s, g);
+    } else {
+        sack_update(s, g);
+        if (g->ack == s->snd_una && !g->len && !(g->flags & TCP_FIN) &&
+            wnd == s->snd_wnd && s->snd_una != s->snd_max)
+            ack_dup(s);
+    }
+    if (SEQ_LT(s->snd_wl1, g->seq) ||
+        (s->snd_wl1 == g->seq && SEQ_LEQ(s->snd_wl2, g->ack))) {
+        s->snd_wnd = wnd;
+        s->snd_wl1 = g->seq;
+        s->snd_wl2 = g->ack;
+    }
+
+    /* Our FIN acknowledged? */
+    if ((s->flags & TF_FIN_SENT) && s->snd_una == s->snd_max) {
+        switch (s->state) {
+        case TCP_FIN_WAIT1:
+            s->state = TCP_FIN_WAIT2;
+            tcp_arm_timer(s, &s->rtx_timer, TCP_FIN_WAIT2_NS);
+            break;
+        case TCP_CLOSING:
+            enter_time_wait(s);
+            break;
+        case TCP_LAST_ACK:
+            tcp_done(s, 0);
+            return nb;
+        }
+    }
+
+    if (g->len) {
+        if (s->state == TCP_ESTABLISHED || s->state == TCP_FIN_WAIT1 ||
+            s->state == TCP_FIN_WAIT2)
+            nb = data_in(s, g->seq, nb);
+        else
+            s->flags |= TF_ACK_NOW; /* after their FIN: ignored          */
+    }
+    if (g->flags & TCP_FIN) {
+        if (s->state == TCP_TIME_WAIT) {
+            s->flags |= TF_ACK_NOW; /* our last ACK was lost             */
+            tcp_arm_timer(s, &s->rtx_timer, TCP_TIME_WAIT_NS);
+        } else if (!(s->flags & TF_FIN_RCVD) &&
+                   g->seq + g->len == s->rcv_nxt) {
+            fin_in(s);
+        }
+    }
+
+    if (s->state == TCP_TIME_WAIT) {
+        if (s->flags & TF_ACK_NOW)
+            tcp_send_ack(s);
+    } else {
+        tcp_output(s);
+    }
+    return nb;
+}
+
+void tcp_input(netdev_t *dev, netbuf_t *nb, const ip_addr_t *src,
+               const ip_addr_t *dst)
+{
+    (void)dev;
+    const tcp_hdr_t *th = (const tcp_hdr_t *)nb->data;
+    uint32_t hlen;
+    if (nb->len < sizeof(*th) || (hlen = (th->off >> 4) * 4u) <
+        sizeof(*th) || hlen > nb->len)
+        goto bad;
+    if (inet_csum_fold(inet_csum_chain(
+            inet_pseudo_sum(src, dst, IP_PROTO_TCP, nb->total), nb, 0,
+            nb->total)) != 0)
+        goto bad;
+    NET_STAT(tcp_in);
+
+    seg_t g = {
+        .seq    = ntohl(th->seq),
+        .ack    = ntohl(th->ack),
+        .len    = nb->total - hlen,
+        .wnd    = ntohs(th->win),
+        .flags  = th->flags,
+        .wscale = WSCALE_NONE,
+    };
+    parse_options((const uint8_t *)(th + 1), hlen - (uint32_t)sizeof(*th), &g);
+    uint16_t sport = ntohs(th->sport), dport = ntohs(th->dport);
+    netbuf_pull(nb, hlen);          /* th stays valid: same page         */
+
+    tcp_sock_t *s = tcp_lookup(dst, src, dport, sport);
+    if (s) {
+        uint64_t flags = spin_lock_irqsave(&s->lock);
+        int reset = s->state == TCP_SYN_SENT && (g.flags & TCP_ACK) &&
+                    !(g.flags & TCP_RST) &&
+                    (SEQ_LEQ(g.ack, s->iss) || SEQ_GT(g.ack, s->snd_max));
+        if (s->state != TCP_CLOSED)
+            nb = segment(s, &g, nb);
+        spin_unlock_irqrestore(&s->lock, flags);
+        tcp_put(s);
+        if (reset)
+            tcp_send_reset(src, dst, th, g.len);
+        if (nb)
+            netbuf_free(nb);
+        return;
+    }
+
+    if ((g.flags & (TCP_SYN | TCP_ACK | TCP_RST)) == TCP_SYN) {
+        tcp_sock_t *l = tcp_lookup_listener(dport);
+        tcp_sock_t *c = l ? tcp_new_child(l, dst, src, dport, sport) : 0;
+        if (l)
+            tcp_put(l);
+        if (c) {
+            uint64_t flags = spin_lock_irqsave(&c->lock);
+            syn_options(c, &g);
+            tcp_send_ctl(c, TCP_SYN | TCP_ACK);
+            spin_unlock_irqrestore(&c->lock, flags);
+            tcp_put(c);
+            netbuf_free(nb);
+            return;
+        }
+        if (l) {
+            netbuf_free(nb);        /* backlog full: the peer retries    */
+            return;
+        }
+    }
+    if (!(g.flags & TCP_RST))
+        tcp_send_reset(src, dst, th, g.len);
+    netbuf_free(nb);
+    return;
+
+bad:
+    NET_STAT(tcp_bad);
+    netbuf_free(nb);
+}
@@ -0,0 +1,446 @@
+/* kernel/src/net/tcp_output.c — building and sending TCP segments,
+ * retransmission and the RTO
+ *
+ * Sent data is never copied.  A segment is a fresh netbuf for the
+ * headers with netbuf_ref() fragments of the send queue chained behind
+ * it, so the bytes sit in sndq and in the NIC ring at once; acknowledged
+ * buffers are freed by tcp_input.c and the page goes away when the
+ * device lets go of its last fragment.
+ *
+ * tcp_output() sends everything the windows allow with `more` set and
+ * rings the doorbell once at the end.  Retransmission starts at
+ * snd_nxt = snd_una after a timeout (go-back-N, skipping what the peer
+ * has SACKed) or is one segment at a hole during fast recovery.
+ */
+#include "tcp.h"
+#include "../hal.h"
+
+#define OPT_EOL     0
+#define OPT_NOP     1
+#define OPT_MSS     2
+#define OPT_WSCALE  3
+#define OPT_SACK_OK 4
+#define OPT_SACK    5
+
+static uint32_t min32(uint32_t a, uint32_t b) { return a < b ? a : b; }
+static uint32_t max32(uint32_t a, uint32_t b) { return a > b ? a : b; }
+
+static uint32_t iphdr_len(const ip_addr_t *a)
+{
+    return a->family == NET_AF_INET6 ? sizeof(ipv6_hdr_t) : sizeof(ipv4_hdr_t);
+}
+
+uint32_t tcp_our_mss(const tcp_sock_t *s)
+{
+    net_route_t rt;
+    if (net_route(&s->raddr, &rt) != 0)
+        return TCP_DEFAULT_MSS;
+    return rt.dev->mtu - iphdr_len(&s->raddr) - (uint32_t)sizeof(tcp_hdr_t);
+}
+
+uint8_t tcp_rcv_wscale(void)
+{
+    uint32_t buf = net_limits()->rcvbuf;
+    uint8_t shift = 0;
+    while (shift < 14 && (buf >> shift) > 0xFFFF)
+        shift++;
+    return shift;
+}
+
+/* ── SACK ────────────────────────────────────────────────────────────── */
+
+/* If seq is inside a block the peer SACKed, the end of that block */
+static uint32_t skip_sacked(const tcp_sock_t *s, uint32_t seq)
+{
+    for (uint32_t i = 0; i < s->nsacked; i++)
+        if (SEQ_GEQ(seq, s->sacked[i].start) && SEQ_LT(seq, s->sacked[i].end))
+            seq = s->sacked[i].end;
+    return seq;
+}
+
+/* Bytes from seq up to the next SACKed block (or len if none is nearer) */
+static uint32_t until_sacked(const tcp_sock_t *s, uint32_t seq, uint32_t len)
+{
+    for (uint32_t i = 0; i < s->nsacked; i++)
+        if (SEQ_GT(s->sacked[i].start, seq) &&
+            SEQ_LT(s->sacked[i].start, seq + len))
+            len = s->sacked[i].start - seq;
+    return len;
+}
+
+/* Our out-of-order data as SACK blocks, contiguous segments merged, the
+ * block holding the most recent arrival first */
+static uint32_t ofo_blocks(const tcp_sock_t *s, tcp_sack_t *out)
+{
+    tcp_sack_t all[TCP_SACK_SEND + 1];
+    uint32_t n = 0, first = 0;
+    for (const tcp_seg_t *g = s->ofo; g; g = g->next) {
+        if (n && all[n - 1].end == g->seq) {
+            all[n - 1].end = g->seq + g->len;
+        } else {
+            if (n == TCP_SACK_SEND + 1)
+                break;
+            all[n].start = g->seq;
+            all[n].end   = g->seq + g->len;
+            n++;
+        }
+        if (g->seq == s->last_ofo.start)
+            first = n - 1;
+    }
+
+    uint32_t k = 0;
+    if (n)
+        out[k++] = all[first];
+    for (uint32_t i = 0; i < n && k < TCP_SACK_SEND; i++)
+        if (i != first)
+            out[k++] = all[i];
+    return k;
+}
+
+/* ── Segments ────────────────────────────────────────────────────────── */
+
+static uint32_t put_options(const tcp_sock_t *s, uint8_t *p, uint8_t flags)
+{
+    uint32_t n = 0;
+    if (flags & TCP_SYN) {
+        int passive = flags & TCP_ACK;
+        uint16_t mss = (uint16_t)tcp_our_mss(s);
+        p[n++] = OPT_MSS;
+        p[n++] = 4;
+        p[n++] = (uint8_t)(mss >> 8);
+        p[n++] = (uint8_t)mss;
+        /* A SYN-ACK only offers what the SYN did */
+        if (!passive || (s->flags & TF_WSCALE)) {
+            p[n++] = OPT_NOP;
+            p[n++] = OPT_WSCALE;
+            p[n++] = 3;
+            p[n++] = s->rcv_wscale;
+        }
+        if (!passive || (s->flags & TF_SACK_OK)) {
+            p[n++] = OPT_NOP;
+            p[n++] = OPT_NOP;
+            p[n++] = OPT_SACK_OK;
+            p[n++] = 2;
+        }
+        return n;
+    }
+
+    if ((s->flags & TF_SACK_OK) && s->ofo) {
+        tcp_sack_t b[TCP_SACK_SEND];
+        uint32_t k = ofo_blocks(s, b);
+        p[n++] = OPT_NOP;
+        p[n++] = OPT_NOP;
+        p[n++] = OPT_SACK;
+        p[n++] = (uint8_t)(2 + 8 * k);
+        for (uint32_t i = 0; i < k; i++) {
+            uint32_t e[2] = { htonl(b[i].start), htonl(b[i].end) };
+            for (uint32_t j = 0; j < 8; j++)
+                p[n++] = ((const uint8_t *)e)[j];
+        }
+    }
+    return n;
+}
+
+/* The window to advertise, never pulling in the right edge already
+ * offered (RFC 7323 §2.4 / RFC 1122 4.2.2.16) */
+static uint16_t advertise(tcp_sock_t *s, uint8_t flags)
+{
+    uint32_t wnd = tcp_rcv_space(s);
+    if (SEQ_LT(s->rcv_nxt + wnd, s->rcv_adv))
+        wnd = s->rcv_adv - s->rcv_nxt;
+    uint8_t shift = (flags & TCP_SYN) ? 0 : s->rcv_wscale;
+    if ((wnd >> shift) > 0xFFFF)
+        wnd = 0xFFFFu << shift;
+    wnd &= ~((1u << shift) - 1);    /* what the peer will actually see   */
+    if (SEQ_GT(s->rcv_nxt + wnd, s->rcv_adv))
+        s->rcv_adv = s->rcv_nxt + wnd;
+    return (uint16_t)(wnd >> shift);
+}
+
+/* One segment: [seq, seq + len) of the send queue (len may be 0) with
+ * flags.  Lock held; 0, or -1 if nothing went out. */
+static int xmit(tcp_sock_t *s, const net_route_t *rt, uint32_t seq,
+                uint32_t len, uint8_t flags, int more)
+{
+    netbuf_t *nb = netbuf_alloc();
+    if (!nb)
+        return -1;
+
+    uint8_t opts[40];
+    uint32_t olen = put_options(s, opts, flags);
+    while (olen & 3)
+        opts[olen++] = OPT_EOL;
+    tcp_hdr_t *th = netbuf_put(nb, sizeof(*th) + olen);
+    th->sport = htons(s->lport);
+    th->dport = htons(s->rport);
+    th->seq   = htonl(seq);
+    th->ack   = (flags & TCP_ACK) ? htonl(s->rcv_nxt) : 0;
+    th->off   = (uint8_t)(((sizeof(*th) + olen) / 4) << 4);
+    th->flags = flags;
+    th->win   = htons(advertise(s, flags));
+    th->csum  = 0;
+    th->urg   = 0;
+    for (uint32_t i = 0; i < olen; i++)
+        ((uint8_t *)(th + 1))[i] = opts[i];
+
+    /* The payload: references into sndq, no copy */
+    uint32_t off = seq - s->sndq_seq;
+    for (netbuf_t *b = s->sndq; b && len; b = b->qnext) {
+        if (off >= b->len) {
+            off -= b->len;
+            continue;
+        }
+        uint32_t n = min32(b->len - off, len);
+        netbuf_t *frag = netbuf_ref(b, off, n);
+        if (!frag) {
+            netbuf_free(nb);
+            return -1;
+        }
+        netbuf_chain(nb, frag);
+        len -= n;
+        off  = 0;
+    }
+
+    th->csum = inet_csum_fold(inet_csum_chain(
+        inet_pseudo_sum(&rt->src, &s->raddr, IP_PROTO_TCP, nb->total), nb, 0,
+        nb->total));
+
+    if (flags & TCP_ACK) {
+        s->ack_pending = 0;
+        s->flags &= (uint16_t)~TF_ACK_NOW;
+        timer_cancel(&s->delack_timer);
+    }
+    NET_STAT(tcp_out);
+    return ip_output(rt, &s->raddr, nb, IP_PROTO_TCP, more);
+}
+
+static void arm_rto(tcp_sock_t *s)
+{
+    tcp_arm_timer(s, &s->rtx_timer, (uint64_t)s->rto_ms * 1000000ULL);
+}
+
+void tcp_output(tcp_sock_t *s)
+{
+    if (s->state == TCP_CLOSED || s->state == TCP_LISTEN ||
+        s->state == TCP_SYN_SENT || s->state == TCP_SYN_RCVD)
+        return;
+    net_route_t rt;
+    if (net_route(&s->raddr, &rt) != 0)
+        return;
+
+    uint32_t end = s->sndq_seq + s->sndq_bytes;     /* past the last byte */
+    uint32_t sent = 0;
+    for (;;) {
+        if (SEQ_LT(s->snd_nxt, s->snd_max))
+            s->snd_nxt = skip_sacked(s, s->snd_nxt);
+
+        uint32_t wnd = min32(s->snd_wnd, s->cwnd);
+        if (!wnd && (s->flags & TF_PROBE))
+            wnd = 1;
+        uint32_t limit = s->snd_una + wnd;
+        uint32_t usable = SEQ_LT(s->snd_nxt, limit) ? limit - s->snd_nxt : 0;
+        uint32_t avail = SEQ_LT(s->snd_nxt, end) ? end - s->snd_nxt : 0;
+        uint32_t len = min32(min32(s->mss, avail), usable);
+        if (len && SEQ_LT(s->snd_nxt, s->snd_max))
+            len = until_sacked(s, s->snd_nxt, len);
+
+        int fin = (s->flags & TF_FIN_QUEUED) && s->snd_nxt + len == end;
+        if (!len && !fin)
+            break;
+        /* Nagle: hold a small segment while data is in flight */
+        if (len < s->mss && !fin && len == avail && s->snd_una != s->snd_max &&
+            SEQ_GEQ(s->snd_nxt, s->snd_max))
+            break;
+
+        uint8_t flags = TCP_ACK;
+        if (len && s->snd_nxt + len == end)
+            flags |= TCP_PSH;
+        if (fin)
+            flags |= TCP_FIN;
+        if (xmit(s, &rt, s->snd_nxt, len, flags, 1) != 0)
+            break;
+        sent++;
+
+        if (SEQ_LT(s->snd_nxt, s->snd_max)) {
+            NET_STAT(tcp_rtx);
+        } else if (len && !s->rtt_timing) {
+            s->rtt_timing = 1;
+            s->rtt_seq    = s->snd_nxt + len;
+            s->rtt_start  = hal_timer_now_ns();
+        }
+        s->snd_nxt += len + (fin ? 1 : 0);
+        if (fin)
+            s->flags |= TF_FIN_SENT;
+        if (SEQ_GT(s->snd_nxt, s->snd_max))
+            s->snd_max = s->snd_nxt;
+        s->flags &= (uint16_t)~TF_PROBE;
+        if (!timer_pending(&s->rtx_timer))
+            arm_rto(s);
+    }
+
+    if (!sent && (s->flags & TF_ACK_NOW) && xmit(s, &rt, s->snd_nxt, 0,
+                                                 TCP_ACK, 1) == 0)
+        sent++;
+    if (sent)
+        netdev_flush(rt.dev);
+
+    /* Window closed with nothing in flight: the persist timer probes it */
+    if (s->snd_una == s->snd_max && SEQ_LT(s->snd_nxt, end) &&
+        !timer_pending(&s->rtx_timer))
+        arm_rto(s);
+}
+
+void tcp_send_ctl(tcp_sock_t *s, uint8_t flags)
+{
+    net_route_t rt;
+    if (net_route(&s->raddr, &rt) != 0)
+        return;
+    uint32_t seq = s->snd_nxt;
+    if (flags & TCP_SYN) {
+        seq = s->iss;
+        if (s->snd_max == s->iss) {
+            s->snd_nxt = s->snd_max = s->sndq_seq = s->iss + 1;
+            if (!(flags & TCP_ACK))
+                s->rcv_wscale = tcp_rcv_wscale();
+        }
+        if (!s->retries) {
+            s->rtt_timing = 1;
+            s->rtt_seq    = s->iss + 1;
+            s->rtt_start  = hal_timer_now_ns();
+        }
+        arm_rto(s);
+    }
+    xmit(s, &rt, seq, 0, flags, 0);
+}
+
+void tcp_send_ack(tcp_sock_t *s)
+{
+    tcp_send_ctl(s, TCP_ACK);
+}
+
+void tcp_retransmit(tcp_sock_t *s, uint32_t seq)
+{
+    net_route_t rt;
+    if (net_route(&s->raddr, &rt) != 0)
+        return;
+    uint32_t end = s->sndq_seq + s->sndq_bytes;
+    uint32_t len = SEQ_LT(seq, end) ? until_sacked(s, seq,
+                                                   min32(s->mss, end - seq))
+                                    : 0;
+    int fin = (s->flags & TF_FIN_SENT) && seq + len == end;
+    if (!len && !fin)
+        return;
+    uint8_t flags = TCP_ACK | (fin ? TCP_FIN : 0);
+    if (xmit(s, &rt, seq, len, flags, 0) != 0)
+        return;
+    NET_STAT(tcp_rtx);
+    s->rtt_timing = 0;              /* Karn: no sample across a resend   */
+    arm_rto(s);
+}
+
+void tcp_send_reset(const ip_addr_t *src, const ip_addr_t *dst,
+                    const tcp_hdr_t *th, uint32_t payload)
+{
+    net_route_t rt;
+    if (net_route(src, &rt) != 0)
+        return;
+    rt.src = *dst;                  /* answer from the address hit       */
+    netbuf_t *nb = netbuf_alloc();
+    if (!nb)
+        return;
+
+    tcp_hdr_t *r = netbuf_put(nb, sizeof(*r));
+    r->sport = th->dport;
+    r->dport = th->sport;
+    if (th->flags & TCP_ACK) {
+        r->seq   = th->ack;
+        r->ack   = 0;
+        r->flags = TCP_RST;
+    } else {
+        uint32_t len = payload + ((th->flags & TCP_SYN) ? 1 : 0) +
+                       ((th->flags & TCP_FIN) ? 1 : 0);
+        r->seq   = 0;
+        r->ack   = htonl(ntohl(th->seq) + len);
+        r->flags = TCP_RST | TCP_ACK;
+    }
+    r->off  = (uint8_t)((sizeof(*r) / 4) << 4);
+    r->win  = 0;
+    r->csum = 0;
+    r->urg  = 0;
+    r->csum = inet_csum_fold(inet_csum_add(
+        inet_pseudo_sum(dst, src, IP_PROTO_TCP, nb->total), r, nb->total));
+    NET_STAT(tcp_out);
+    ip_output(&rt, src, nb, IP_PROTO_TCP, 0);
+}
+
+/* ── Timers ──────────────────────────────────────────────────────────── */
+
+void tcp_rtt_sample(tcp_sock_t *s, uint64_t rtt_us)
+{
+    uint32_t r = rtt_us > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)rtt_us;
+    if (!r)
+        r = 1;
+    if (!s->srtt_us) {
+        s->srtt_us   = r;
+        s->rttvar_us = r / 2;
+    } else {
+        uint32_t d = s->srtt_us > r ? s->srtt_us - r : r - s->srtt_us;
+        s->rttvar_us = s->rttvar_us - s->rttvar_us / 4 + d / 4;
+        s->srtt_us   = s->srtt_us - s->srtt_us / 8 + r / 8;
+    }
+    uint32_t rto = (s->srtt_us + max32(4 * s->rttvar_us, 1000)) / 1000;
+    s->rto_ms = min32(max32(rto, TCP_RTO_MIN_MS), TCP_RTO_MAX_MS);
+}
+
+static void backoff(tcp_sock_t *s)
+{
+    s->rto_ms = min32(s->rto_ms * 2, TCP_RTO_MAX_MS);
+}
+
+void tcp_rtx_timeout(tcp_sock_t *s)
+{
+    switch (s->state) {
+    case TCP_TIME_WAIT:
+    case TCP_FIN_WAIT2:             /* the peer never closed its side    */
+        tcp_done(s, 0);
+        return;
+    case TCP_SYN_SENT:
+    case TCP_SYN_RCVD:
+        if (++s->retries > TCP_SYN_RETRIES) {
+            tcp_done(s, -1);
+            return;
+        }
+        backoff(s);
+        s->rtt_timing = 0;
+        tcp_send_ctl(s, s->state == TCP_SYN_SENT ? TCP_SYN
+                                                 : TCP_SYN | TCP_ACK);
+        return;
+    }
+
+    if (s->snd_una == s->snd_max) {
+        /* Persist: probe a zero window, backing off like an RTO */
+        if (SEQ_LT(s->snd_nxt, s->sndq_seq + s->sndq_bytes)) {
+            backoff(s);
+            s->flags |= TF_PROBE;
+            tcp_output(s);
+        }
+        return;
+    }
+
+    if (++s->retries > TCP_MAX_RETRIES) {
+        tcp_send_ctl(s, TCP_RST | TCP_ACK);
+        tcp_done(s, -1);
+        return;
+    }
+    /* RFC 5681 §3.1 after a loss the timer caught, RFC 6298 §5.5 */
+    uint32_t flight = s->snd_max - s->snd_una;
+    s->ssthresh    = max32(flight / 2, 2 * s->mss);
+    s->cwnd        = s->mss;
+    s->in_recovery = 0;
+    s->dupacks     = 0;
+    s->nsacked     = 0;             /* the peer may renege (RFC 2018)    */
+    s->rtt_timing  = 0;
+    backoff(s);
+    s->snd_nxt = s->snd_una;
+    tcp_output(s);
+}
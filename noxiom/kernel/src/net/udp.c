@@ -0,0 +1,223 @@
+/* kernel/src/net/udp.c — UDP sockets
+ *
+ * Sockets are bound to a local port only (any address, any peer) and
+ * live in a small RCU hash, so the receive path finds one without a
+ * lock; binding and closing serialise on s_bind_lock.  A received
+ * datagram is queued on the socket as the netbuf chain the driver
+ * filled, trimmed to its payload, until udp_recvfrom() copies it out.
+ *
+ * The socket's queue lock is the one place two CPUs can meet on the
+ * receive path: datagrams of different peers hash to different owners
+ * but land on the same socket.
+ */
+#include "inet.h"
+#include "../sync/rcu.h"
+#include "../sched/sched.h"
+#include "../mm/kmalloc.h"
+#include "../string.h"
+#include "../hal.h"
+
+#define UDP_HASH         64
+#define UDP_EPHEMERAL    49152
+
+typedef struct udp_dgram {
+    struct udp_dgram *next;
+    netbuf_t         *nb;           /* payload                           */
+    ip_addr_t         src;
+    uint16_t          sport;
+} udp_dgram_t;
+
+struct udp_sock {
+    struct udp_sock *next;          /* hash chain, RCU                   */
+    uint16_t         port;
+    spinlock_t       lock;
+    udp_dgram_t     *head, *tail;
+    uint32_t         queued;        /* payload bytes                     */
+    thread_t        *waiter;
+};
+
+static udp_sock_t *s_udp[UDP_HASH];
+static spinlock_t  s_bind_lock = SPINLOCK_INIT;
+static uint16_t    s_next_port = UDP_EPHEMERAL;
+
+static inline uint32_t port_slot(uint16_t port)
+{
+    return port % UDP_HASH;
+}
+
+/* Inside rcu_read_lock() or with s_bind_lock held */
+static udp_sock_t *lookup(uint16_t port)
+{
+    for (udp_sock_t *s = rcu_dereference(s_udp[port_slot(port)]); s;
+         s = rcu_dereference(s->next))
+        if (s->port == port)
+            return s;
+    return 0;
+}
+
+udp_sock_t *udp_bind(uint16_t port)
+{
+    udp_sock_t *s = kzalloc(sizeof(*s));
+    if (!s)
+        return 0;
+
+    uint64_t flags = spin_lock_irqsave(&s_bind_lock);
+    if (!port) {
+        for (uint32_t i = 0; i < 65536 - UDP_EPHEMERAL && !port; i++) {
+            uint16_t p = s_next_port;
+            s_next_port = p == 65535 ? UDP_EPHEMERAL : (uint16_t)(p + 1);
+            if (!lookup(p))
+                port = p;
+        }
+    } else if (lookup(port)) {
+        port = 0;
+    }
+    if (port) {
+        s->port = port;
+        s->next = s_udp[port_slot(port)];
+        rcu_assign_pointer(s_udp[port_slot(port)], s);
+    }
+    spin_unlock_irqrestore(&s_bind_lock, flags);
+
+    if (!port) {
+        kfree(s);
+        return 0;
+    }
+    return s;
+}
+
+void udp_close(udp_sock_t *s)
+{
+    uint64_t flags = spin_lock_irqsave(&s_bind_lock);
+    udp_sock_t **pp = &s_udp[port_slot(s->port)];
+    while (*pp != s)
+        pp = &(*pp)->next;
+    rcu_assign_pointer(*pp, s->next);
+    spin_unlock_irqrestore(&s_bind_lock, flags);
+
+    synchronize_rcu();              /* udp_input() may still hold s */
+    for (udp_dgram_t *d = s->head, *next; d; d = next) {
+        next = d->next;
+        netbuf_free(d->nb);
+        kfree(d);
+    }
+    kfree(s);
+}
+
+void udp_input(netdev_t *dev, netbuf_t *nb, const ip_addr_t *src,
+               const ip_addr_t *dst)
+{
+    (void)dev;
+    const udp_hdr_t *h = (const udp_hdr_t *)nb->data;
+    uint32_t ulen;
+    if (nb->len < sizeof(*h) || (ulen = ntohs(h->len)) < sizeof(*h) ||
+        ulen > nb->total)
+        goto drop;
+    netbuf_trim(nb, ulen);
+    if ((h->csum || src->family == NET_AF_INET6) &&
+        inet_csum_fold(inet_csum_chain(
+            inet_pseudo_sum(src, dst, IP_PROTO_UDP, ulen), nb, 0, ulen)) != 0)
+        goto drop;
+    NET_STAT(udp_in);
+
+    udp_dgram_t *d = kmalloc(sizeof(*d));
+    if (!d)
+        goto drop;
+    d->next  = 0;
+    d->src   = *src;
+    d->sport = ntohs(h->sport);
+    uint16_t dport = ntohs(h->dport);
+    netbuf_pull(nb, sizeof(*h));
+    d->nb = nb;
+
+    int queued = 0;
+    rcu_read_lock();
+    udp_sock_t *s = lookup(dport);
+    if (s) {
+        uint64_t flags = spin_lock_irqsave(&s->lock);
+        if (s->queued + nb->total <= net_limits()->rcvbuf) {
+            if (s->tail)
+                s->tail->next = d;
+            else
+                s->head = d;
+            s->tail = d;
+            s->queued += nb->total;
+            queued = 1;
+            if (s->waiter)
+                thread_wake(s->waiter);
+        }
+        spin_unlock_irqrestore(&s->lock, flags);
+    }
+    rcu_read_unlock();
+    if (queued)
+        return;
+    kfree(d);
+drop:
+    NET_STAT(udp_drop);
+    netbuf_free(nb);
+}
+
+int udp_sendto(udp_sock_t *s, const ip_addr_t *dst, uint16_t port,
+               const void *buf, uint32_t len)
+{
+    net_route_t rt;
+    if (net_route(dst, &rt) != 0)
+        return -1;
+    uint32_t iphdr = dst->family == NET_AF_INET6 ? sizeof(ipv6_hdr_t)
+                                                 : sizeof(ipv4_hdr_t);
+    if (len + sizeof(udp_hdr_t) + iphdr > rt.dev->mtu)
+        return -1;                  /* no fragmentation                  */
+    netbuf_t *nb = netbuf_alloc();
+    if (!nb)
+        return -1;
+
+    udp_hdr_t *h = netbuf_put(nb, sizeof(*h) + len);
+    kmemcpy(h + 1, buf, len);
+    h->sport = htons(s->port);
+    h->dport = htons(port);
+    h->len   = htons((uint16_t)nb->total);
+    h->csum  = 0;
+    uint16_t c = inet_csum_fold(inet_csum_add(
+        inet_pseudo_sum(&rt.src, dst, IP_PROTO_UDP, nb->total), h,
+        nb->total));
+    h->csum  = c ? c : 0xFFFF;      /* 0 means "none" on the wire       */
+
+    NET_STAT(udp_out);
+    return ip_output(&rt, dst, nb, IP_PROTO_UDP, 0) == 0 ? (int)len : -1;
+}
+
+int udp_recvfrom(udp_sock_t *s, void *buf, uint32_t len, ip_addr_t *src,
+                 uint16_t *port, uint64_t timeout_ns)
+{
+    uint64_t deadline = timeout_ns ? hal_timer_now_ns() + timeout_ns : 0;
+    int expired = 0;
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&s->lock);
+        udp_dgram_t *d = s->head;
+        if (d) {
+            s->head = d->next;
+            if (!s->head)
+                s->tail = 0;
+            s->queued -= d->nb->total;
+        }
+        s->waiter = d || expired ? 0 : thread_current();
+        spin_unlock_irqrestore(&s->lock, flags);
+
+        if (d) {
+            int n = (int)netbuf_copy_out(d->nb, 0, buf, len);
+            if (src)
+                *src = d->src;
+            if (port)
+                *port = d->sport;
+            netbuf_free(d->nb);
+            kfree(d);
+            return n;
+        }
+        if (expired)
+            return -1;
+        if (!deadline)
+            thread_block();
+        else
+            expired = thread_block_until(deadline);
+    }
+}
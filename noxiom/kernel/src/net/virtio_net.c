@@ -0,0 +1,425 @@
+/* kernel/src/net/virtio_net.c — virtio network device
+ *
+ * Queues: receive queue 2i and transmit queue 2i + 1 form pair i; with
+ * VIRTIO_NET_F_MQ the device has up to max_virtqueue_pairs of them and
+ * a control queue after the last.  One pair per online CPU is used (at
+ * most VNET_MAX_PAIRS) when the transport gives each pair an interrupt
+ * vector of its own: pair i's vector is aimed at CPU i, and so is its
+ * NAPI thread, so a flow stays on one core from interrupt to protocol
+ * handler.  With a single shared line (MMIO, PCI INTx) one pair is used.
+ *
+ * Receive: every buffer is one page from the pair's page pool, posted
+ * as a single device-writable descriptor.  With mergeable receive
+ * buffers (VIRTIO_NET_F_MRG_RXBUF) a large packet spans several of them
+ * and the header's num_buffers says how many; each becomes a netbuf
+ * fragment, so nothing is copied.  The pages go back to the pool when
+ * the stack frees the packet.
+ *
+ * Transmit: descriptor 0 of every chain is a zeroed header (no offloads
+ * negotiated) shared by the whole queue, then one descriptor per netbuf
+ * fragment.  Finished chains are reclaimed by the pair's poll thread and
+ * by netdev_xmit() when the ring is full.  A batch (more = 1) is
+ * published with one doorbell write at its end.
+ *
+ * Interrupts: the handler masks both queues of its pair and schedules
+ * the pair's NAPI; poll() unmasks them once a round comes up short.
+ */
+#include "netdev.h"
+#include "../virtio/virtio.h"
+#include "../virtio/virtqueue.h"
+#include "../smp/smp.h"
+#include "../sched/sched.h"
+#include "../mm/kmalloc.h"
+#include "../string.h"
+#include "../log/klog.h"
+
+/* Feature bits */
+#define VIRTIO_NET_F_MAC        5
+#define VIRTIO_NET_F_MRG_RXBUF  15
+#define VIRTIO_NET_F_CTRL_VQ    17
+#define VIRTIO_NET_F_MQ         22
+#define VIRTIO_F_ANY_LAYOUT     27
+
+/* Device configuration */
+#define VNET_CFG_MAC            0
+#define VNET_CFG_MAX_PAIRS      8
+
+/* Control queue */
+#define VNET_CTRL_MQ            4
+#define VNET_CTRL_MQ_PAIRS_SET  0
+#define VNET_CTRL_OK            0
+#define VNET_CTRL_TIMEOUT_NS    100000000ULL    /* 100 ms per command */
+
+#define VNET_MAX_PAIRS          8
+#define VNET_TX_MAX_SEGS        18  /* header + 17 fragments           */
+#define VNET_RX_POOL_PAGES      512 /* per pair, above the posted ring  */
+
+typedef struct {
+    uint8_t  flags;
+    uint8_t  gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+    uint16_t num_buffers;           /* MRG_RXBUF / VERSION_1 only       */
+} __attribute__((packed)) vnet_hdr_t;
+
+typedef struct vnet vnet_t;
+
+typedef struct {
+    vnet_t      *vn;
+    uint32_t     index;
+    virtqueue_t  rx;
+    virtqueue_t  tx;
+    spinlock_t   tx_lock;
+    vnet_hdr_t  *tx_hdr;            /* zeroed, read by the device       */
+    page_pool_t  pool;
+    netbuf_t    *partial;           /* merged packet still coming in    */
+    uint32_t     partial_left;      /* its buffers not yet seen         */
+} vnet_queue_t;
+
+struct vnet {
+    netdev_t      netdev;
+    virtio_dev_t *vdev;
+    uint32_t      hdr_len;          /* 12, or 10 for legacy without MRG */
+    uint32_t      npairs;
+    vnet_queue_t  q[VNET_MAX_PAIRS];
+    napi_t        napi[VNET_MAX_PAIRS];
+    virtqueue_t   ctrl;
+    int           has_ctrl;
+};
+
+/* ── Receive ─────────────────────────────────────────────────────────── */
+
+static void rx_refill(vnet_queue_t *q)
+{
+    while (virtqueue_free(&q->rx) > 0) {
+        void *page = page_pool_get(&q->pool);
+        if (!page)
+            break;                  /* retried on the next poll round */
+        virtq_seg_t seg = {
+            virt_to_phys(page) + NETBUF_HDR_SIZE, NETBUF_BUF_SIZE
+        };
+        if (virtqueue_add(&q->rx, &seg, 0, 1, page) != 0) {
+            page_pool_put(&q->pool, page);
+            break;
+        }
+    }
+    virtqueue_kick(&q->rx);
+}
+
+/* One buffer the device filled; returns 1 when it completed a packet */
+static int rx_buffer(vnet_queue_t *q, void *page, uint32_t len)
+{
+    vnet_t *vn = q->vn;
+
+    if (q->partial) {
+        if (len > NETBUF_BUF_SIZE)
+            len = NETBUF_BUF_SIZE;
+        netbuf_chain(q->partial, netbuf_from_page(&q->pool, page, 0, len));
+        if (--q->partial_left)
+            return 0;
+        netbuf_t *nb = q->partial;
+        q->partial = 0;
+        netdev_rx(&vn->netdev, nb);
+        return 1;
+    }
+
+    if (len < vn->hdr_len || len > NETBUF_BUF_SIZE) {
+        __atomic_fetch_add(&vn->netdev.stats.rx_dropped, 1, __ATOMIC_RELAXED);
+        page_pool_put(&q->pool, page);
+        return 0;
+    }
+    const vnet_hdr_t *h = (const vnet_hdr_t *)((uint8_t *)page +
+                                               NETBUF_HDR_SIZE);
+    uint32_t nbufs = virtio_has(vn->vdev, VIRTIO_NET_F_MRG_RXBUF)
+                   ? h->num_buffers : 1;
+    netbuf_t *nb = netbuf_from_page(&q->pool, page, vn->hdr_len,
+                                    len - vn->hdr_len);
+    if (nbufs > 1) {
+        q->partial      = nb;
+        q->partial_left = nbufs - 1;
+        return 0;
+    }
+    netdev_rx(&vn->netdev, nb);
+    return 1;
+}
+
+static int rx_drain(vnet_queue_t *q, int budget)
+{
+    int done = 0;
+    while (done < budget) {
+        uint32_t len;
+        void *page = virtqueue_get(&q->rx, &len);
+        if (!page)
+            break;
+        done += rx_buffer(q, page, len);
+    }
+    return done;
+}
+
+/* ── Transmit ────────────────────────────────────────────────────────── */
+
+/* q->tx_lock held */
+static void tx_reclaim(vnet_queue_t *q)
+{
+    netbuf_t *nb;
+    while ((nb = virtqueue_get(&q->tx, 0)) != 0)
+        netbuf_free(nb);
+}
+
+static inline vnet_queue_t *tx_queue(vnet_t *vn)
+{
+    return &vn->q[hal_cpu_id() % vn->npairs];
+}
+
+static int vnet_xmit(netdev_t *dev, netbuf_t *nb, int more)
+{
+    vnet_t *vn = dev->priv;
+    vnet_queue_t *q = tx_queue(vn);
+
+    virtq_seg_t seg[VNET_TX_MAX_SEGS];
+    uint32_t n = 0;
+    seg[n++] = (virtq_seg_t){ virt_to_phys(q->tx_hdr), vn->hdr_len };
+    for (netbuf_t *f = nb; f; f = f->next) {
+        if (n == VNET_TX_MAX_SEGS)
+            return -1;
+        if (f->len)
+            seg[n++] = (virtq_seg_t){ virt_to_phys(f->data), f->len };
+    }
+
+    uint64_t flags = spin_lock_irqsave(&q->tx_lock);
+    if (virtqueue_free(&q->tx) < n)
+        tx_reclaim(q);
+    int rc = virtqueue_add(&q->tx, seg, n, 0, nb);
+    if (!more || rc != 0)
+        virtqueue_kick(&q->tx);
+    spin_unlock_irqrestore(&q->tx_lock, flags);
+    return rc;
+}
+
+static void vnet_flush(netdev_t *dev)
+{
+    vnet_queue_t *q = tx_queue(dev->priv);
+    uint64_t flags = spin_lock_irqsave(&q->tx_lock);
+    virtqueue_kick(&q->tx);
+    spin_unlock_irqrestore(&q->tx_lock, flags);
+}
+
+static const netdev_ops_t s_vnet_ops = {
+    .xmit  = vnet_xmit,
+    .flush = vnet_flush,
+};
+
+/* ── NAPI and interrupts ─────────────────────────────────────────────── */
+
+static int vnet_poll(void *ctx, int budget)
+{
+    vnet_queue_t *q = ctx;
+    int done = 0;
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&q->tx_lock);
+        tx_reclaim(q);
+        spin_unlock_irqrestore(&q->tx_lock, flags);
+
+        done += rx_drain(q, budget - done);
+        rx_refill(q);
+        if (done >= budget)
+            return budget;          /* stay in polling mode */
+
+        flags = spin_lock_irqsave(&q->tx_lock);
+        int idle = virtqueue_enable_irq(&q->tx);
+        spin_unlock_irqrestore(&q->tx_lock, flags);
+        if (virtqueue_enable_irq(&q->rx) && idle)
+            return done;
+        virtqueue_disable_irq(&q->rx);  /* raced with the device: again */
+        virtqueue_disable_irq(&q->tx);
+    }
+}
+
+static void pair_irq(vnet_queue_t *q)
+{
+    virtqueue_disable_irq(&q->rx);
+    virtqueue_disable_irq(&q->tx);
+    napi_schedule(&q->vn->napi[q->index]);
+}
+
+/* Per-pair vector: nothing to acknowledge */
+static void vnet_vector_irq(uint32_t irq, void *ctx)
+{
+    (void)irq;
+    pair_irq(ctx);
+}
+
+/* Shared line: reading the ISR acknowledges it */
+static void vnet_shared_irq(uint32_t irq, void *ctx)
+{
+    (void)irq;
+    vnet_t *vn = ctx;
+    if (virtio_isr_ack(vn->vdev) & VIRTIO_ISR_QUEUE)
+        for (uint32_t i = 0; i < vn->npairs; i++)
+            pair_irq(&vn->q[i]);
+}
+
+/* ── Control queue ───────────────────────────────────────────────────── */
+
+/* One command, polled to completion or VNET_CTRL_TIMEOUT_NS (boot time
+ * only).  On a timeout the device still owns the buffer, so it is left
+ * allocated rather than freed under it */
+static int ctrl_cmd(vnet_t *vn, uint8_t cls, uint8_t cmd, const void *data,
+                    uint32_t len)
+{
+    uint8_t *buf = kzalloc(4 + len);
+    if (!buf)
+        return -1;
+    buf[0] = cls;
+    buf[1] = cmd;
+    kmemcpy(buf + 2, data, len);
+    uint8_t *ack = buf + 2 + len;
+    *ack = 0xFF;
+
+    uint64_t pa = virt_to_phys(buf);
+    virtq_seg_t seg[3] = { { pa, 2 }, { pa + 2, len }, { pa + 2 + len, 1 } };
+    int rc = -1;
+    if (virtqueue_add(&vn->ctrl, seg, 2, 1, buf) == 0) {
+        virtqueue_kick(&vn->ctrl);
+        uint64_t deadline = hal_timer_now_ns() + VNET_CTRL_TIMEOUT_NS;
+        while (!virtqueue_get(&vn->ctrl, 0)) {
+            if (hal_timer_now_ns() >= deadline) {
+                klog("[virtio] %s: control command %u/%u timed out",
+                     vn->vdev->where, cls, cmd);
+                return -1;
+            }
+            hal_cpu_relax();
+        }
+        rc = __atomic_load_n(ack, __ATOMIC_ACQUIRE) == VNET_CTRL_OK ? 0 : -1;
+    }
+    kfree(buf);
+    return rc;
+}
+
+/* ── Probe ───────────────────────────────────────────────────────────── */
+
+static int queue_setup(vnet_t *vn, virtqueue_t *vq, uint32_t index,
+                       uint32_t vector)
+{
+    virtio_dev_t *d = vn->vdev;
+    if (virtqueue_init(vq, d, index, d->ops->queue_max(d, index)) != 0)
+        return -1;
+    return d->ops->queue_enable(d, vq, vector);
+}
+
+/* Online CPUs, lowest first: pair i runs on cpus[i] */
+static uint32_t pick_cpus(uint32_t *cpus, uint32_t max)
+{
+    uint32_t n = 0;
+    for (uint32_t c = 0; c < HAL_MAX_CPUS && n < max; c++)
+        if (smp_cpu_online(c))
+            cpus[n++] = c;
+    return n ? n : (cpus[0] = 0, 1u);
+}
+
+int virtio_net_probe(virtio_dev_t *d)
+{
+    uint64_t wanted = (1ULL << VIRTIO_NET_F_MAC) |
+                      (1ULL << VIRTIO_NET_F_MRG_RXBUF) |
+                      (1ULL << VIRTIO_NET_F_CTRL_VQ) |
+                      (1ULL << VIRTIO_NET_F_MQ) |
+                      (1ULL << VIRTIO_F_ANY_LAYOUT);
+    if (virtio_negotiate(d, wanted) != 0)
+        return -1;
+
+    vnet_t *vn = kzalloc(sizeof(*vn));
+    if (!vn)
+        return -1;
+    vn->vdev = d;
+    d->driver = vn;
+    vn->hdr_len = !d->legacy || virtio_has(d, VIRTIO_NET_F_MRG_RXBUF)
+                ? sizeof(vnet_hdr_t) : sizeof(vnet_hdr_t) - 2;
+
+    /* Pairs: one per CPU if each can have its own vector */
+    uint32_t max_pairs = 1;
+    int mq = virtio_has(d, VIRTIO_NET_F_MQ) &&
+             virtio_has(d, VIRTIO_NET_F_CTRL_VQ);
+    if (mq)
+        max_pairs = virtio_cfg_read(d, VNET_CFG_MAX_PAIRS, 2);
+    if (max_pairs == 0)
+        max_pairs = 1;
+    uint32_t cpus[VNET_MAX_PAIRS];
+    uint32_t want = pick_cpus(cpus, max_pairs < VNET_MAX_PAIRS
+                                    ? max_pairs : VNET_MAX_PAIRS);
+    if (virtio_irq_setup(d, want, cpus) == 0 && want > 1) {
+        want = 1;
+        virtio_irq_setup(d, 1, cpus);
+    }
+    vn->npairs = want;
+
+    for (uint32_t i = 0; i < vn->npairs; i++) {
+        vnet_queue_t *q = &vn->q[i];
+        q->vn      = vn;
+        q->index   = i;
+        q->tx_lock = (spinlock_t)SPINLOCK_INIT;
+        q->tx_hdr  = kzalloc(sizeof(vnet_hdr_t));
+        page_pool_init(&q->pool, VNET_RX_POOL_PAGES);
+        if (!q->tx_hdr ||
+            queue_setup(vn, &q->rx, 2 * i, i) != 0 ||
+            queue_setup(vn, &q->tx, 2 * i + 1, i) != 0)
+            return -1;
+    }
+    if (virtio_has(d, VIRTIO_NET_F_CTRL_VQ)) {
+        if (queue_setup(vn, &vn->ctrl, 2 * max_pairs, VIRTIO_NO_VECTOR) != 0)
+            return -1;
+        vn->has_ctrl = 1;
+    }
+
+    /* Poll threads before interrupts, interrupts before DRIVER_OK */
+    for (uint32_t i = 0; i < vn->npairs; i++) {
+        char name[THREAD_NAME_LEN];
+        ksnprintf(name, sizeof(name), "napi/%u", i);
+        if (napi_start(&vn->napi[i], name, cpus[i], vnet_poll,
+                       &vn->q[i]) != 0)
+            return -1;
+    }
+    if (d->nvectors) {
+        for (uint32_t i = 0; i < vn->npairs; i++)
+            if (hal_irq_register((uint32_t)d->vector_irq[i],
+                                 vnet_vector_irq, &vn->q[i]) != 0)
+                return -1;
+    } else if (d->irq == 0 || d->irq >= HAL_IRQ_MAX ||
+               hal_irq_register(d->irq, vnet_shared_irq, vn) != 0) {
+        return -1;
+    }
+
+    virtio_driver_ok(d);
+    for (uint32_t i = 0; i < vn->npairs; i++)
+        rx_refill(&vn->q[i]);
+
+    if (mq && vn->npairs > 1) {
+        uint16_t pairs = (uint16_t)vn->npairs;
+        if (ctrl_cmd(vn, VNET_CTRL_MQ, VNET_CTRL_MQ_PAIRS_SET,
+                     &pairs, sizeof(pairs)) != 0)
+            vn->npairs = 1;         /* the device keeps using pair 0 */
+    }
+
+    netdev_t *nd = &vn->netdev;
+    nd->mtu     = 1500;
+    nd->nqueues = vn->npairs;
+    nd->driver  = "virtio-net";
+    nd->ops     = &s_vnet_ops;
+    nd->priv    = vn;
+    nd->napi    = vn->napi;
+    if (virtio_has(d, VIRTIO_NET_F_MAC)) {
+        for (uint32_t i = 0; i < 6; i++)
+            nd->mac[i] = (uint8_t)virtio_cfg_read(d, VNET_CFG_MAC + i, 1);
+    } else {
+        /* Locally administered, 02:00:00:00:00:<n>, unique per machine */
+        kmemset(nd->mac, 0, 6);
+        nd->mac[0] = 0x02;
+        nd->mac[5] = (uint8_t)(netdev_count() + 1);
+    }
+    klog("[virtio] %s: net, %s%s", d->where,
+         d->nvectors ? "MSI-X per queue pair" : "shared IRQ",
+         virtio_has(d, VIRTIO_NET_F_MRG_RXBUF) ? ", mergeable rx buffers"
+                                               : "");
+    return netdev_register(nd);
+}
@@ -0,0 +1,373 @@
+/* kernel/src/pci/pci.c — bus scan, BARs, capabilities, MSI / MSI-X
+ *
+ * The scan is depth-first from bus 0: every device's function 0, its
+ * other functions if the header says multi-function, and the secondary
+ * bus of every PCI-to-PCI bridge.  Each bus is visited once, so a
+ * firmware that programs overlapping bus numbers cannot make it loop.
+ *
+ * MSI vectors: hal_msi_alloc() hands back a message to store in the
+ * device, now and whenever the IRQ is moved to another CPU.  Each vector
+ * here keeps where its message lives (MSI capability or MSI-X table
+ * entry) in a slot that lives as long as the vector; pci_msi_disable()
+ * gives both the slots and the IRQs back.  An MSI-X entry is
+ * masked while its message is rewritten, so the device never sends half
+ * an old and half a new message.
+ */
+#include "pci.h"
+#include "../log/klog.h"
+#include "../sync/spinlock.h"
+
+#define PCI_MAX_BUS        256
+#define PCI_MAX_VECTORS    128
+
+/* MSI capability */
+#define MSI_CTRL           0x02
+#define MSI_ADDR_LO        0x04
+#define MSI_ADDR_HI        0x08
+#define MSI_CTRL_ENABLE    (1u << 0)
+#define MSI_CTRL_MME_MASK  (7u << 4)    /* multiple message enable       */
+#define MSI_CTRL_64BIT     (1u << 7)
+
+/* MSI-X capability and table */
+#define MSIX_CTRL          0x02
+#define MSIX_TABLE         0x04         /* BIR in bits 2:0               */
+#define MSIX_CTRL_ENABLE   (1u << 15)
+#define MSIX_CTRL_MASKALL  (1u << 14)
+#define MSIX_CTRL_SIZE     0x7FF
+#define MSIX_ENTRY_SIZE    16
+#define MSIX_VEC_CTRL_MASK (1u << 0)
+
+typedef struct {
+    uint32_t           bdf;
+    uint32_t           cap;             /* MSI capability offset         */
+    volatile uint32_t *entry;           /* MSI-X entry, 0 for MSI        */
+    int                irq;             /* -1 until hal_msi_alloc()      */
+    int                used;
+} pci_vector_t;
+
+static pci_dev_t    s_funcs[PCI_MAX_FUNCS];
+static uint32_t     s_nfuncs;
+static int          s_scanned;
+static uint8_t      s_bus_seen[PCI_MAX_BUS / 8];
+
+static pci_vector_t s_vectors[PCI_MAX_VECTORS];
+static spinlock_t   s_vec_lock = SPINLOCK_INIT;
+
+/* ── Scan ────────────────────────────────────────────────────────────── */
+
+static void scan_bus(uint32_t bus);
+
+static void scan_func(uint32_t bus, uint32_t dev, uint32_t fn)
+{
+    uint32_t bdf = HAL_PCI_BDF(bus, dev, fn);
+    uint32_t id  = hal_pci_cfg_read(bdf, PCI_VENDOR_ID, 4);
+    if ((id & 0xFFFF) == 0xFFFF)
+        return;
+
+    uint32_t cls = hal_pci_cfg_read(bdf, PCI_CLASS_REV, 4);
+    if (s_nfuncs < PCI_MAX_FUNCS) {
+        pci_dev_t *d = &s_funcs[s_nfuncs++];
+        d->bdf        = bdf;
+        d->vendor     = (uint16_t)id;
+        d->device     = (uint16_t)(id >> 16);
+        d->revision   = (uint8_t)cls;
+        d->prog_if    = (uint8_t)(cls >> 8);
+        d->subclass   = (uint8_t)(cls >> 16);
+        d->class_code = (uint8_t)(cls >> 24);
+    }
+
+    /* PCI-to-PCI bridge: class 06/04, header type 1 */
+    uint32_t hdr = hal_pci_cfg_read(bdf, PCI_HEADER_TYPE, 1) & 0x7F;
+    if (hdr == 1 && (cls >> 16) == 0x0604) {
+        uint32_t secondary = hal_pci_cfg_read(bdf, 0x19, 1);
+        if (secondary)
+            scan_bus(secondary);
+    }
+}
+
+static void scan_bus(uint32_t bus)
+{
+    if (s_bus_seen[bus / 8] & (1u << (bus % 8)))
+        return;
+    s_bus_seen[bus / 8] |= (uint8_t)(1u << (bus % 8));
+
+    for (uint32_t dev = 0; dev < 32; dev++) {
+        uint32_t bdf = HAL_PCI_BDF(bus, dev, 0);
+        if ((hal_pci_cfg_read(bdf, PCI_VENDOR_ID, 2) & 0xFFFF) == 0xFFFF)
+            continue;
+        uint32_t nfn = hal_pci_cfg_read(bdf, PCI_HEADER_TYPE, 1) & 0x80 ? 8 : 1;
+        for (uint32_t fn = 0; fn < nfn; fn++)
+            scan_func(bus, dev, fn);
+    }
+}
+
+void pci_init(void)
+{
+    if (s_scanned)
+        return;
+    s_scanned = 1;
+    scan_bus(0);
+    if (s_nfuncs)
+        klog("[pci] %u functions", s_nfuncs);
+}
+
+uint32_t pci_count(void)
+{
+    return s_nfuncs;
+}
+
+const pci_dev_t *pci_get(uint32_t index)
+{
+    return index < s_nfuncs ? &s_funcs[index] : 0;
+}
+
+const pci_dev_t *pci_find(uint16_t vendor, uint16_t device, uint32_t index)
+{
+    for (uint32_t i = 0; i < s_nfuncs; i++) {
+        const pci_dev_t *d = &s_funcs[i];
+        if ((vendor == PCI_ANY_ID || d->vendor == vendor) &&
+            (device == PCI_ANY_ID || d->device == device) &&
+            index-- == 0)
+            return d;
+    }
+    return 0;
+}
+
+/* ── Configuration helpers ───────────────────────────────────────────── */
+
+uint32_t pci_find_cap(const pci_dev_t *d, uint8_t id, uint32_t after)
+{
+    if (!(pci_read(d, PCI_STATUS, 2) & PCI_STATUS_CAPS))
+        return 0;
+
+    uint32_t off = after ? pci_read(d, after + 1, 1) : pci_read(d, PCI_CAP_PTR, 1);
+    for (int guard = 0; off >= 0x40 && guard < 48; guard++) {
+        off &= 0xFC;
+        if (pci_read(d, off, 1) == id)
+            return off;
+        off = pci_read(d, off + 1, 1);
+    }
+    return 0;
+}
+
+int pci_bar(const pci_dev_t *d, uint32_t n, pci_bar_t *out)
+{
+    if (n > 5)
+        return -1;
+    uint32_t off = PCI_BAR0 + n * 4;
+    uint32_t lo  = pci_read(d, off, 4);
+    int is_io    = lo & 1;
+    int is_64    = !is_io && ((lo >> 1) & 3) == 2 && n < 5;
+
+    uint32_t cmd = pci_read(d, PCI_COMMAND, 2);
+    pci_write(d, PCI_COMMAND, 2, cmd & ~(PCI_CMD_IO | PCI_CMD_MEMORY));
+
+    pci_write(d, off, 4, 0xFFFFFFFF);
+    uint64_t mask = pci_read(d, off, 4);
+    pci_write(d, off, 4, lo);
+    uint32_t hi = 0;
+    if (is_64) {
+        hi = pci_read(d, off + 4, 4);
+        pci_write(d, off + 4, 4, 0xFFFFFFFF);
+        mask |= (uint64_t)pci_read(d, off + 4, 4) << 32;
+        pci_write(d, off + 4, 4, hi);
+    } else {
+        mask |= 0xFFFFFFFF00000000ULL;
+    }
+    pci_write(d, PCI_COMMAND, 2, cmd);
+
+    mask &= is_io ? ~0x3ULL : ~0xFULL;
+    if (is_io)
+        mask |= 0xFFFFFFFFFFFF0000ULL;      /* 16-bit port space */
+    if ((uint32_t)mask == 0 && !is_64)
+        return -1;                          /* reads back 0: unimplemented */
+
+    out->is_io = is_io;
+    out->base  = ((uint64_t)hi << 32) | (lo & (is_io ? ~0x3u : ~0xFu));
+    out->size  = ~mask + 1;
+    return out->size ? 0 : -1;
+}
+
+void pci_enable(const pci_dev_t *d, int master)
+{
+    uint32_t cmd = pci_read(d, PCI_COMMAND, 2);
+    cmd |= PCI_CMD_IO | PCI_CMD_MEMORY;
+    if (master)
+        cmd |= PCI_CMD_MASTER;
+    pci_write(d, PCI_COMMAND, 2, cmd);
+}
+
+uint32_t pci_intx_line(const pci_dev_t *d)
+{
+    return pci_read(d, PCI_INTR_LINE, 1);
+}
+
+/* ── MSI / MSI-X ─────────────────────────────────────────────────────── */
+
+static pci_vector_t *vector_slot(void)
+{
+    pci_vector_t *v = 0;
+    uint64_t flags = spin_lock_irqsave(&s_vec_lock);
+    for (uint32_t i = 0; i < PCI_MAX_VECTORS; i++) {
+        if (!s_vectors[i].used) {
+            v = &s_vectors[i];
+            v->used = 1;
+            v->irq  = -1;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&s_vec_lock, flags);
+    return v;
+}
+
+/* The IRQ back to the HAL, then the slot; the device must be quiet */
+static void vector_put(pci_vector_t *v)
+{
+    if (!v)
+        return;
+    if (v->irq >= 0)
+        hal_msi_free((uint32_t)v->irq);
+    uint64_t flags = spin_lock_irqsave(&s_vec_lock);
+    v->used = 0;
+    spin_unlock_irqrestore(&s_vec_lock, flags);
+}
+
+/* The slot of irq, or with irq < 0 the first one of function bdf */
+static pci_vector_t *vector_find(uint32_t bdf, int irq)
+{
+    pci_vector_t *v = 0;
+    uint64_t flags = spin_lock_irqsave(&s_vec_lock);
+    for (uint32_t i = 0; i < PCI_MAX_VECTORS && !v; i++) {
+        pci_vector_t *c = &s_vectors[i];
+        if (c->used && (irq >= 0 ? c->irq == irq : c->bdf == bdf))
+            v = c;
+    }
+    spin_unlock_irqrestore(&s_vec_lock, flags);
+    return v;
+}
+
+static void msi_write(void *ctx, const hal_msi_msg_t *msg)
+{
+    pci_vector_t *v = ctx;
+    uint32_t ctrl = hal_pci_cfg_read(v->bdf, v->cap + MSI_CTRL, 2);
+    hal_pci_cfg_write(v->bdf, v->cap + MSI_ADDR_LO, 4, (uint32_t)msg->addr);
+    if (ctrl & MSI_CTRL_64BIT) {
+        hal_pci_cfg_write(v->bdf, v->cap + MSI_ADDR_HI, 4,
+                          (uint32_t)(msg->addr >> 32));
+        hal_pci_cfg_write(v->bdf, v->cap + 0x0C, 2, msg->data);
+    } else {
+        hal_pci_cfg_write(v->bdf, v->cap + 0x08, 2, msg->data);
+    }
+}
+
+static void msix_write(void *ctx, const hal_msi_msg_t *msg)
+{
+    pci_vector_t *v = ctx;
+    volatile uint32_t *e = v->entry;
+    uint32_t vctrl = e[3];
+    e[3] = vctrl | MSIX_VEC_CTRL_MASK;
+    e[0] = (uint32_t)msg->addr;
+    e[1] = (uint32_t)(msg->addr >> 32);
+    e[2] = msg->data;
+    e[3] = vctrl & ~MSIX_VEC_CTRL_MASK;
+}
+
+static void intx_off(const pci_dev_t *d)
+{
+    pci_write(d, PCI_COMMAND, 2,
+              pci_read(d, PCI_COMMAND, 2) | PCI_CMD_INTX_OFF);
+}
+
+uint32_t pci_msix_count(const pci_dev_t *d)
+{
+    uint32_t cap = pci_find_cap(d, PCI_CAP_MSIX, 0);
+    return cap ? (pci_read(d, cap + MSIX_CTRL, 2) & MSIX_CTRL_SIZE) + 1 : 0;
+}
+
+int pci_msix_enable(const pci_dev_t *d, uint32_t n, const uint32_t *cpus,
+                    int *irqs)
+{
+    uint32_t cap = pci_find_cap(d, PCI_CAP_MSIX, 0);
+    if (!cap || n == 0 || n > pci_msix_count(d))
+        return -1;
+
+    uint32_t tbl = pci_read(d, cap + MSIX_TABLE, 4);
+    pci_bar_t bar;
+    if (pci_bar(d, tbl & 7, &bar) != 0 || bar.is_io)
+        return -1;
+    uint64_t pa = bar.base + (tbl & ~7u);
+    volatile uint32_t *table = hal_mmio_map(pa, (uint64_t)n * MSIX_ENTRY_SIZE);
+    if (!table)
+        return -1;
+
+    /* Function-masked while the entries are filled in */
+    uint32_t ctrl = pci_read(d, cap + MSIX_CTRL, 2);
+    pci_write(d, cap + MSIX_CTRL, 2,
+              ctrl | MSIX_CTRL_ENABLE | MSIX_CTRL_MASKALL);
+
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        pci_vector_t *v = vector_slot();
+        if (!v)
+            break;
+        v->bdf   = d->bdf;
+        v->cap   = cap;
+        v->entry = table + i * (MSIX_ENTRY_SIZE / 4);
+        v->entry[3] |= MSIX_VEC_CTRL_MASK;
+        irqs[i] = v->irq = hal_msi_alloc(cpus ? cpus[i] : 0, msix_write, v);
+        if (irqs[i] < 0) {
+            vector_put(v);
+            break;
+        }
+    }
+    if (i < n) {
+        pci_write(d, cap + MSIX_CTRL, 2, ctrl & ~MSIX_CTRL_ENABLE);
+        while (i--)
+            vector_put(vector_find(d->bdf, irqs[i]));
+        return -1;
+    }
+
+    intx_off(d);
+    pci_write(d, cap + MSIX_CTRL, 2, (ctrl | MSIX_CTRL_ENABLE) &
+                                     ~MSIX_CTRL_MASKALL);
+    return (int)n;
+}
+
+int pci_msi_enable(const pci_dev_t *d, uint32_t cpu)
+{
+    uint32_t cap = pci_find_cap(d, PCI_CAP_MSI, 0);
+    if (!cap)
+        return -1;
+    pci_vector_t *v = vector_slot();
+    if (!v)
+        return -1;
+    v->bdf   = d->bdf;
+    v->cap   = cap;
+    v->entry = 0;
+
+    int irq = v->irq = hal_msi_alloc(cpu, msi_write, v);
+    if (irq < 0) {
+        vector_put(v);
+        return -1;
+    }
+
+    uint32_t ctrl = pci_read(d, cap + MSI_CTRL, 2) & ~MSI_CTRL_MME_MASK;
+    intx_off(d);
+    pci_write(d, cap + MSI_CTRL, 2, ctrl | MSI_CTRL_ENABLE);
+    return irq;
+}
+
+void pci_msi_disable(const pci_dev_t *d)
+{
+    uint32_t cap;
+    if ((cap = pci_find_cap(d, PCI_CAP_MSIX, 0)))
+        pci_write(d, cap + MSIX_CTRL, 2,
+                  pci_read(d, cap + MSIX_CTRL, 2) & ~MSIX_CTRL_ENABLE);
+    if ((cap = pci_find_cap(d, PCI_CAP_MSI, 0)))
+        pci_write(d, cap + MSI_CTRL, 2,
+                  pci_read(d, cap + MSI_CTRL, 2) & ~MSI_CTRL_ENABLE);
+
+    pci_vector_t *v;
+    while ((v = vector_find(d->bdf, -1)))
+        vector_put(v);
+}
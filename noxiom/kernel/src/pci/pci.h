@@ -0,0 +1,102 @@
+#pragma once
+/* pci/pci.h — PCI function table, BARs, capabilities and MSI / MSI-X
+ *
+ * pci_init() walks the buses behind the host bridge once, following
+ * PCI-to-PCI bridges, and keeps a small table of the functions found;
+ * drivers look theirs up with pci_find().  Configuration space goes
+ * through hal_pci_cfg_read()/hal_pci_cfg_write().
+ *
+ * Interrupts: pci_msix_enable() gives each queue of a device its own IRQ,
+ * aimed at the CPU the driver names, so a queue's interrupt lands where
+ * its work is done; hal_intc_set_affinity() moves one later.
+ * pci_msi_enable() is the single-vector fallback.  Both turn the legacy
+ * INTx line off.  Without MSI support in the HAL they return -1 and the
+ * driver keeps using the wired line (pci_intx_line()).
+ */
+#include <stdint.h>
+#include "../hal.h"
+
+#define PCI_MAX_FUNCS     64
+#define PCI_ANY_ID        0xFFFF
+
+/* Configuration header offsets */
+#define PCI_VENDOR_ID     0x00
+#define PCI_DEVICE_ID     0x02
+#define PCI_COMMAND       0x04
+#define PCI_STATUS        0x06
+#define PCI_CLASS_REV     0x08
+#define PCI_HEADER_TYPE   0x0E
+#define PCI_BAR0          0x10
+#define PCI_SUBSYS_ID     0x2E
+#define PCI_CAP_PTR       0x34
+#define PCI_INTR_LINE     0x3C
+
+#define PCI_CMD_IO        (1u << 0)
+#define PCI_CMD_MEMORY    (1u << 1)
+#define PCI_CMD_MASTER    (1u << 2)
+#define PCI_CMD_INTX_OFF  (1u << 10)
+
+#define PCI_STATUS_CAPS   (1u << 4)
+
+/* Capability IDs */
+#define PCI_CAP_MSI       0x05
+#define PCI_CAP_VENDOR    0x09
+#define PCI_CAP_MSIX      0x11
+
+typedef struct {
+    uint32_t bdf;                   /* HAL_PCI_BDF()                      */
+    uint16_t vendor;
+    uint16_t device;
+    uint8_t  class_code;
+    uint8_t  subclass;
+    uint8_t  prog_if;
+    uint8_t  revision;
+} pci_dev_t;
+
+typedef struct {
+    uint64_t base;                  /* physical address or I/O port       */
+    uint64_t size;
+    int      is_io;
+} pci_bar_t;
+
+/* Scan the buses.  After hal_intc_init(); calling it again is a no-op. */
+void             pci_init(void);
+uint32_t         pci_count(void);
+const pci_dev_t *pci_get(uint32_t index);
+/* index-th function matching vendor/device (either may be PCI_ANY_ID) */
+const pci_dev_t *pci_find(uint16_t vendor, uint16_t device, uint32_t index);
+
+static inline uint32_t pci_read(const pci_dev_t *d, uint32_t off,
+                                uint32_t size)
+{
+    return hal_pci_cfg_read(d->bdf, off, size);
+}
+
+static inline void pci_write(const pci_dev_t *d, uint32_t off,
+                             uint32_t size, uint32_t val)
+{
+    hal_pci_cfg_write(d->bdf, off, size, val);
+}
+
+/* Offset of the first capability `id` after offset `after` (0 = from the
+ * start), 0 if there is none; walk vendor capabilities with it */
+uint32_t pci_find_cap(const pci_dev_t *d, uint8_t id, uint32_t after);
+
+/* Decode BAR n (a 64-bit BAR takes n and n + 1).  Returns -1 if it is
+ * unimplemented.  Sizing briefly turns decoding off. */
+int  pci_bar(const pci_dev_t *d, uint32_t n, pci_bar_t *out);
+/* Memory and I/O decoding on, and bus mastering if `master` */
+void pci_enable(const pci_dev_t *d, int master);
+/* Legacy INTx as the firmware routed it (x86_64: ISA IRQ / GSI) */
+uint32_t pci_intx_line(const pci_dev_t *d);
+
+/* Table size of the MSI-X capability, 0 without one */
+uint32_t pci_msix_count(const pci_dev_t *d);
+/* Vectors 0 .. n-1 to IRQs irqs[i] aimed at cpus[i] (cpus may be 0: all
+ * on CPU 0).  Returns n, or -1 with nothing enabled. */
+int pci_msix_enable(const pci_dev_t *d, uint32_t n, const uint32_t *cpus,
+                    int *irqs);
+/* One MSI vector aimed at cpu; returns the IRQ or -1 */
+int pci_msi_enable(const pci_dev_t *d, uint32_t cpu);
+/* MSI and MSI-X off; every IRQ either gave out goes back to the HAL */
+void pci_msi_disable(const pci_dev_t *d);
@@ -0,0 +1,37 @@
+/* kernel/src/pci/pci_cmd.c — the `lspci` shell command
+ *
+ *   lspci    one line per PCI function found at boot: bus:dev.fn,
+ *            vendor:device, class, and MSI / MSI-X support
+ */
+#include "pci.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../shell/shell.h"
+
+static void cmd_lspci(int argc, char **argv) {
+    (void)argc; (void)argv;
+    uint32_t n = pci_count();
+    if (!n) {
+        hal_display_print("lspci: no PCI functions\n");
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        const pci_dev_t *d = pci_get(i);
+        char line[96];
+        uint32_t msix = pci_msix_count(d);
+        int len = ksnprintf(line, sizeof(line),
+                            "%02x:%02x.%u  %04x:%04x  class %02x%02x%02x",
+                            (d->bdf >> 8) & 0xFF, (d->bdf >> 3) & 0x1F,
+                            d->bdf & 7, d->vendor, d->device,
+                            d->class_code, d->subclass, d->prog_if);
+        if (msix)
+            len += ksnprintf(line + len, sizeof(line) - len,
+                             "  msi-x %u", msix);
+        else if (pci_find_cap(d, PCI_CAP_MSI, 0))
+            len += ksnprintf(line + len, sizeof(line) - len, "  msi");
+        ksnprintf(line + len, sizeof(line) - len, "\n");
+        hal_display_print(line);
+    }
+}
+
+SHELL_CMD(lspci, .fn = cmd_lspci, .help = "list PCI functions");
@@ -0,0 +1,41 @@
+/* kernel/src/prof/ksyms.c — address to symbol lookup
+ *
+ * A symbol is taken to extend up to the next one; past the last, up to
+ * __text_end from the linker script.
+ */
+#include "ksyms.h"
+
+extern const char __text_end[];
+
+static uint32_t s_count = UINT32_MAX;
+
+uint32_t ksym_count(void)
+{
+    if (s_count == UINT32_MAX) {
+        uint32_t n = 0;
+        while (ksym_table[n].addr != ~0ULL)
+            n++;
+        s_count = n;
+    }
+    return s_count;
+}
+
+const ksym_t *ksym_lookup(uint64_t pc, uint64_t *off)
+{
+    uint32_t n = ksym_count();
+    if (n == 0 || pc < ksym_table[0].addr || pc >= (uint64_t)__text_end)
+        return 0;
+
+    /* Last entry with addr <= pc */
+    uint32_t lo = 0, hi = n;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ksym_table[mid].addr <= pc)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    if (off)
+        *off = pc - ksym_table[lo].addr;
+    return &ksym_table[lo];
+}
@@ -0,0 +1,22 @@
+#pragma once
+/* prof/ksyms.h — kernel function symbols, for turning PCs into names
+ *
+ * ksym_table is generated at link time (rules.mk): the kernel is linked
+ * once with an empty table, its .text symbols are written out sorted by
+ * address as ksyms.c, and the kernel is linked again with that object
+ * last, so no code moves.  The table ends with a { ~0, "" } entry.
+ */
+#include <stdint.h>
+
+typedef struct {
+    uint64_t    addr;
+    const char *name;
+} ksym_t;
+
+extern const ksym_t ksym_table[];
+
+/* Entries before the terminator */
+uint32_t      ksym_count(void);
+/* The function containing pc, 0 if pc is outside the kernel's .text;
+ * *off (may be 0) gets pc's offset into it */
+const ksym_t *ksym_lookup(uint64_t pc, uint64_t *off);
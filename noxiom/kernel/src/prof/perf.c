@@ -0,0 +1,227 @@
+/* kernel/src/prof/perf.c — PMU sessions across all CPUs
+ *
+ * Each CPU's start and stop run in its own timer callback, IRQs masked,
+ * and report back through `done`; the caller polls that with short
+ * sleeps.  Sample buffers are allocated on the first perf_sample() and
+ * kept: perf_top() reads the last session's samples.
+ */
+#include "perf.h"
+#include "ksyms.h"
+#include "../string.h"
+#include "../mm/kmalloc.h"
+#include "../sched/sched.h"
+#include "../smp/smp.h"
+#include "../time/timer.h"
+
+#define POLL_NS  1000000ULL             /* while waiting for the CPUs     */
+
+typedef struct {
+    ktimer_t          timer;
+    volatile int      done;
+    int               ok;               /* the PMU started here           */
+    uint64_t          counts[HAL_PMU_EVENTS];
+    uint64_t         *pcs;
+    volatile uint32_t npcs;
+    volatile uint64_t dropped;
+} perf_cpu_t;
+
+static perf_cpu_t s_cpu[HAL_MAX_CPUS];
+static volatile int s_busy;
+
+/* The session being started */
+static uint32_t s_events[HAL_PMU_EVENTS];
+static uint32_t s_nevents;
+static uint32_t s_event;
+static uint64_t s_period;
+
+/* ── Running on every CPU ─────────────────────────────────────────────── */
+
+static int reachable(uint32_t cpu)
+{
+    return smp_cpu_online(cpu) && timer_cpu_active(cpu);
+}
+
+/* Run fn(&s_cpu[cpu]) on every reachable CPU and wait for all of them */
+static void on_each_cpu(timer_fn_t fn)
+{
+    uint64_t now = hal_timer_now_ns();
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++) {
+        if (!reachable(cpu))
+            continue;
+        s_cpu[cpu].done = 0;
+        timer_setup(&s_cpu[cpu].timer, fn, &s_cpu[cpu], cpu);
+        timer_arm(&s_cpu[cpu].timer, now);
+    }
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++)
+        while (reachable(cpu) && !__atomic_load_n(&s_cpu[cpu].done,
+                                                   __ATOMIC_ACQUIRE))
+            thread_sleep_ns(POLL_NS);
+}
+
+static void finish(perf_cpu_t *c)
+{
+    __atomic_store_n(&c->done, 1, __ATOMIC_RELEASE);
+}
+
+static void count_start(void *arg)
+{
+    perf_cpu_t *c = arg;
+    c->ok = hal_pmu_count_start(s_events, s_nevents) == 0;
+    finish(c);
+}
+
+static void count_stop(void *arg)
+{
+    perf_cpu_t *c = arg;
+    if (c->ok)
+        hal_pmu_count_read(c->counts, s_nevents);
+    hal_pmu_stop();
+    finish(c);
+}
+
+/* hal_pmu_sample_fn_t: IRQ context on the sampled CPU */
+static void record_pc(uint64_t pc)
+{
+    perf_cpu_t *c = &s_cpu[hal_cpu_id()];
+    if (c->npcs < PERF_SAMPLES_PER_CPU)
+        c->pcs[c->npcs++] = pc;
+    else
+        c->dropped++;
+}
+
+static void sample_start(void *arg)
+{
+    perf_cpu_t *c = arg;
+    c->npcs    = 0;
+    c->dropped = 0;
+    c->ok = c->pcs && hal_pmu_sample_start(s_event, s_period,
+                                           record_pc) == 0;
+    finish(c);
+}
+
+static void sample_stop(void *arg)
+{
+    hal_pmu_stop();
+    finish(arg);
+}
+
+static int session_begin(void)
+{
+    if (hal_pmu_counters() == 0)
+        return 0;
+    return !__atomic_exchange_n(&s_busy, 1, __ATOMIC_ACQUIRE);
+}
+
+static void session_end(void)
+{
+    __atomic_store_n(&s_busy, 0, __ATOMIC_RELEASE);
+}
+
+static int cpus_ok(void)
+{
+    int n = 0;
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++)
+        if (reachable(cpu) && s_cpu[cpu].ok)
+            n++;
+    return n;
+}
+
+/* ── Counting ─────────────────────────────────────────────────────────── */
+
+int perf_count(const uint32_t *events, uint32_t n, uint64_t ns,
+               uint64_t *totals)
+{
+    if (n == 0 || n > HAL_PMU_EVENTS || !session_begin())
+        return -1;
+
+    kmemcpy(s_events, events, n * sizeof(*events));
+    s_nevents = n;
+    on_each_cpu(count_start);
+    thread_sleep_ns(ns);
+    on_each_cpu(count_stop);
+
+    kmemset(totals, 0, n * sizeof(*totals));
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++) {
+        if (!reachable(cpu) || !s_cpu[cpu].ok)
+            continue;
+        for (uint32_t i = 0; i < n; i++)
+            totals[i] += s_cpu[cpu].counts[i];
+    }
+    int cpus = cpus_ok();
+    session_end();
+    return cpus ? cpus : -1;
+}
+
+/* ── Sampling ─────────────────────────────────────────────────────────── */
+
+int perf_sample(uint32_t event, uint64_t period, uint64_t ns)
+{
+    if (!session_begin())
+        return -1;
+
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++)
+        if (reachable(cpu) && !s_cpu[cpu].pcs)
+            s_cpu[cpu].pcs = kmalloc(PERF_SAMPLES_PER_CPU * sizeof(uint64_t));
+
+    s_event  = event;
+    s_period = period;
+    on_each_cpu(sample_start);
+    thread_sleep_ns(ns);
+    on_each_cpu(sample_stop);
+
+    int cpus = cpus_ok();
+    session_end();
+    return cpus ? cpus : -1;
+}
+
+/* Insert (name, samples) into out[0..*n), kept sorted, at most max */
+static void top_insert(perf_hit_t *out, uint32_t *n, uint32_t max,
+                       const char *name, uint32_t samples)
+{
+    uint32_t i = *n < max ? (*n)++ : max;
+    while (i > 0 && out[i - 1].samples < samples) {
+        if (i < max)
+            out[i] = out[i - 1];
+        i--;
+    }
+    if (i < max) {
+        out[i].name    = name;
+        out[i].samples = samples;
+    }
+}
+
+uint32_t perf_top(perf_hit_t *out, uint32_t max,
+                  uint64_t *total, uint64_t *dropped)
+{
+    uint32_t  nsyms = ksym_count();
+    uint32_t *hist  = kzalloc((nsyms + 1) * sizeof(uint32_t));
+    uint64_t  all = 0, lost = 0;
+    if (!hist)
+        return 0;
+
+    /* hist[nsyms] collects PCs outside the table */
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++) {
+        perf_cpu_t *c = &s_cpu[cpu];
+        if (!c->pcs)
+            continue;
+        for (uint32_t i = 0; i < c->npcs; i++) {
+            const ksym_t *s = ksym_lookup(c->pcs[i], 0);
+            hist[s ? (uint32_t)(s - ksym_table) : nsyms]++;
+        }
+        all  += c->npcs;
+        lost += c->dropped;
+    }
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i <= nsyms; i++)
+        if (hist[i])
+            top_insert(out, &n, max,
+                       i < nsyms ? ksym_table[i].name : "[unknown]", hist[i]);
+    kfree(hist);
+
+    if (total)
+        *total = all;
+    if (dropped)
+        *dropped = lost;
+    return n;
+}
@@ -0,0 +1,37 @@
+#pragma once
+/* prof/perf.h — system-wide event counting and PC sampling
+ *
+ * Both run the HAL PMU on every online CPU for a while: a kernel timer
+ * bound to each CPU starts the counters there (the HAL only programs the
+ * calling CPU), the caller sleeps, and a second round of timers stops
+ * them again.  One session at a time; a call made while another runs,
+ * or without a PMU, fails with -1.
+ *
+ * Sampling records the interrupted PC into a per-CPU buffer; once a
+ * buffer is full further samples are only counted as dropped.
+ * perf_top() then folds the PCs into functions through ksym_table.
+ * Sleeps: thread context only.
+ */
+#include <stdint.h>
+#include "../hal.h"
+
+#define PERF_SAMPLES_PER_CPU  4096
+
+typedef struct {
+    const char *name;           /* "[unknown]" outside the kernel's .text */
+    uint32_t    samples;
+} perf_hit_t;
+
+/* Count events[0..n) on every CPU for `ns`; totals[] gets the sums.
+ * Returns the number of CPUs that counted, -1 on failure. */
+int      perf_count(const uint32_t *events, uint32_t n, uint64_t ns,
+                    uint64_t *totals);
+/* Sample the PC every `period` occurrences of `event` for `ns`.
+ * Returns the number of CPUs that sampled, -1 on failure. */
+int      perf_sample(uint32_t event, uint64_t period, uint64_t ns);
+
+/* Functions of the last perf_sample(), most samples first: fills up to
+ * max and returns how many; *total and *dropped (may be 0) get the
+ * samples recorded and those that did not fit */
+uint32_t perf_top(perf_hit_t *out, uint32_t max,
+                  uint64_t *total, uint64_t *dropped);
@@ -0,0 +1,116 @@
+/* kernel/src/prof/perf_cmd.c — the `perf` shell command
+ *
+ *   perf stat [s]   count cycles, instructions and misses on every CPU
+ *                   for s seconds (default 1), then print the totals
+ *   perf top [s]    sample the cycle counter for s seconds (default 2)
+ *                   and list the kernel functions hit most often
+ */
+#include "perf.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../shell/shell.h"
+
+#define PERF_MAX_SECONDS  60
+#define PERF_TOP_PERIOD   1000000       /* cycles between samples      */
+#define PERF_TOP_LINES    15
+
+static void perf_stat(uint64_t seconds) {
+    static const uint32_t wanted[] = {
+        HAL_PMU_CYCLES, HAL_PMU_INSTRUCTIONS,
+        HAL_PMU_CACHE_MISSES, HAL_PMU_BRANCH_MISSES
+    };
+    static const char *const names[HAL_PMU_EVENTS] = {
+        [HAL_PMU_CYCLES]        = "cycles",
+        [HAL_PMU_INSTRUCTIONS]  = "instructions",
+        [HAL_PMU_CACHE_MISSES]  = "cache-misses",
+        [HAL_PMU_BRANCH_MISSES] = "branch-misses",
+    };
+    uint32_t events[HAL_PMU_EVENTS];
+    uint64_t totals[HAL_PMU_EVENTS];
+    uint64_t cycles = 0, insns = 0;
+    uint32_t n = 0;
+
+    /* Whatever this PMU has, in as many counters as it has */
+    for (uint32_t i = 0; i < HAL_PMU_EVENTS && n < hal_pmu_counters(); i++)
+        if (hal_pmu_has_event(wanted[i]))
+            events[n++] = wanted[i];
+
+    int cpus = n ? perf_count(events, n, seconds * 1000000000ULL, totals) : -1;
+    if (cpus < 0) {
+        hal_display_print("perf: no performance counters (or busy)\n");
+        return;
+    }
+
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    shell_print_col(seconds, 0);
+    hal_display_print(" s on ");
+    shell_print_col((uint64_t)cpus, 0);
+    hal_display_print(" CPU(s):\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    for (uint32_t i = 0; i < n; i++) {
+        shell_print_col(totals[i], 16);
+        hal_display_print("  ");
+        hal_display_print(names[events[i]]);
+        hal_display_print("\n");
+        if (events[i] == HAL_PMU_CYCLES)       cycles = totals[i];
+        if (events[i] == HAL_PMU_INSTRUCTIONS) insns  = totals[i];
+    }
+    if (cycles && insns) {
+        shell_print_rate(insns, cycles, 16);
+        hal_display_print("  insns per cycle\n");
+    }
+}
+
+static void perf_top_cmd(uint64_t seconds) {
+    if (perf_sample(HAL_PMU_CYCLES, PERF_TOP_PERIOD,
+                    seconds * 1000000000ULL) < 0) {
+        hal_display_print("perf: no sampling interrupt (or busy)\n");
+        return;
+    }
+
+    perf_hit_t hits[PERF_TOP_LINES];
+    uint64_t   total, dropped;
+    uint32_t   n = perf_top(hits, PERF_TOP_LINES, &total, &dropped);
+
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    shell_print_col(total, 0);
+    hal_display_print(" samples");
+    if (dropped) {
+        hal_display_print(", ");
+        shell_print_col(dropped, 0);
+        hal_display_print(" dropped");
+    }
+    hal_display_print(":\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    for (uint32_t i = 0; i < n; i++) {
+        char pct[16];
+        uint64_t permille = (uint64_t)hits[i].samples * 1000 / total;
+        ksnprintf(pct, sizeof(pct), "%3lu.%lu%%  ",
+                  (unsigned long)(permille / 10),
+                  (unsigned long)(permille % 10));
+        shell_print_col(hits[i].samples, 8);
+        hal_display_print("  ");
+        hal_display_print(pct);
+        hal_display_print(hits[i].name);
+        hal_display_print("\n");
+    }
+}
+
+static void cmd_perf(int argc, char **argv) {
+    const char *sub = argc > 1 ? argv[1] : "";
+    int top = kstrcmp(sub, "top") == 0;
+    if (!top && kstrcmp(sub, "stat") != 0) {
+        hal_display_print("usage: perf stat|top [seconds]\n");
+        return;
+    }
+    uint64_t seconds = shell_parse_uint(argc > 2 ? argv[2] : 0, top ? 2 : 1);
+    if (seconds == 0 || seconds > PERF_MAX_SECONDS) {
+        hal_display_print("perf: seconds must be 1 .. 60\n");
+        return;
+    }
+    if (top) perf_top_cmd(seconds);
+    else     perf_stat(seconds);
+}
+
+SHELL_CMD(perf, .fn = cmd_perf, .args = "stat|top [s]", .exclusive = 1,
+          .help = "count events on all CPUs, or sample the busiest functions");
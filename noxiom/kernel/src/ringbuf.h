@@ -0,0 +1,60 @@
+#pragma once
+/* ringbuf.h — fixed-size byte FIFO for driver buffers
+ *
+ * The capacity must be a power of two; head and tail are free-running
+ * counters, so count = head - tail even after they wrap.  One producer
+ * and one consumer may use a ring concurrently without a lock (an IRQ
+ * handler filling it while a thread drains it): the data store is
+ * published by the head store and the slot is released by the tail
+ * store.  Anything beyond that — several writers — needs the caller's
+ * lock.
+ */
+#include <stdint.h>
+
+typedef struct {
+    uint8_t  *buf;
+    uint32_t  mask;                 /* capacity - 1                       */
+    uint32_t  head;                 /* next slot to write  (producer)     */
+    uint32_t  tail;                 /* next slot to read   (consumer)     */
+} ringbuf_t;
+
+/* Static initialiser over a uint8_t array of power-of-two size */
+#define RINGBUF_INIT(storage) { (storage), sizeof(storage) - 1, 0, 0 }
+
+static inline uint32_t ringbuf_count(const ringbuf_t *r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+static inline int ringbuf_empty(const ringbuf_t *r)
+{
+    return ringbuf_count(r) == 0;
+}
+
+static inline int ringbuf_full(const ringbuf_t *r)
+{
+    return ringbuf_count(r) > r->mask;
+}
+
+/* Returns 0 if the ring is full (the byte is dropped) */
+static inline int ringbuf_put(ringbuf_t *r, uint8_t c)
+{
+    uint32_t head = r->head;
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) > r->mask)
+        return 0;
+    r->buf[head & r->mask] = c;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Returns 0 if the ring is empty */
+static inline int ringbuf_get(ringbuf_t *r, uint8_t *c)
+{
+    uint32_t tail = r->tail;
+    if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail)
+        return 0;
+    *c = r->buf[tail & r->mask];
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
@@ -0,0 +1,69 @@
+/* kernel/src/sched/fair.c — fair policy (TIER_MID and above)
+ *
+ * Each thread accumulates virtual runtime while it runs; the run queue is
+ * kept sorted by it and the head (least served thread) runs next.  The
+ * running thread is preempted once it is FAIR_GRAN_NS ahead of the
+ * head, and since the head's vruntime does not move while it waits, the
+ * slice timer can be set for exactly that moment.  A thread that
+ * (re)joins a queue is lifted to the queue's min_vruntime so that it
+ * cannot monopolise the CPU to "catch up".
+ *
+ * There are no priorities yet, so virtual runtime is simply ns run.
+ * Insertion is O(queued threads), which is fine for the handful of
+ * kernel threads per CPU we have; a tree can replace the list later
+ * without touching sched.c.
+ */
+#include "runqueue.h"
+
+#define FAIR_GRAN_NS  20000000ULL       /* 20 ms */
+
+static void update_min_vruntime(runqueue_t *rq, const thread_t *curr)
+{
+    uint64_t v = curr ? curr->vruntime : rq->min_vruntime;
+    if (rq->head && (!curr || rq->head->vruntime < v))
+        v = rq->head->vruntime;
+    if (v > rq->min_vruntime)
+        rq->min_vruntime = v;
+}
+
+static void fair_enqueue(runqueue_t *rq, thread_t *t)
+{
+    if (t->vruntime < rq->min_vruntime)
+        t->vruntime = rq->min_vruntime;
+
+    /* Behind every thread with the same vruntime: equal threads take turns */
+    thread_t *pos = rq->head;
+    while (pos && pos->vruntime <= t->vruntime)
+        pos = pos->next;
+    rq_insert(rq, pos, t);
+}
+
+static void fair_account(runqueue_t *rq, thread_t *curr, uint64_t delta_ns)
+{
+    curr->vruntime += delta_ns;
+    update_min_vruntime(rq, curr);
+}
+
+static uint64_t fair_slice(runqueue_t *rq, thread_t *curr)
+{
+    if (!rq->head)
+        return SCHED_NO_SLICE;
+    uint64_t limit = rq->head->vruntime + FAIR_GRAN_NS;
+    return curr->vruntime < limit ? limit - curr->vruntime : 0;
+}
+
+/* Keep the thread's lead or lag relative to its old queue */
+static void fair_migrate(runqueue_t *from, runqueue_t *to, thread_t *t)
+{
+    uint64_t lag = t->vruntime > from->min_vruntime
+                 ? t->vruntime - from->min_vruntime : 0;
+    t->vruntime = to->min_vruntime + lag;
+}
+
+const sched_policy_t sched_policy_fair = {
+    .name    = "fair",
+    .enqueue = fair_enqueue,
+    .account = fair_account,
+    .slice   = fair_slice,
+    .migrate = fair_migrate,
+};
@@ -0,0 +1,105 @@
+/* kernel/src/sched/fpu.c — lazy FP/SIMD switching, kernel sections
+ *
+ * s_owner[cpu] is the thread whose registers are live in that CPU's
+ * unit.  It is set exactly while the unit is on outside a section, so
+ * the unit being off means nobody's state is in it: the trap restores
+ * without saving, a switch saves only its owner, and a section saves the
+ * owner and hands the unit back empty.  It is only read and written by
+ * its own CPU with IRQs masked.
+ *
+ * A thread's state is a page (hal_fpu_state_size() is at most one),
+ * written only by the hardware save while the thread is the owner.
+ */
+#include "fpu.h"
+#include "runqueue.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../mm/pmm.h"
+
+static thread_t *s_owner[HAL_MAX_CPUS];
+
+static void *state_alloc(void)
+{
+    uint64_t pa = pmm_alloc_page();
+    return pa ? phys_to_virt(pa) : 0;
+}
+
+void fpu_free(void *state)
+{
+    if (state)
+        pmm_free_page(virt_to_phys(state));
+}
+
+int fpu_trap(void)
+{
+    thread_t *self = thread_current();
+    if (!self->fpu) {
+        if (!(self->fpu = state_alloc()))
+            return -1;
+        hal_fpu_init_state(self->fpu);
+    }
+    hal_fpu_enable();
+    hal_fpu_restore(self->fpu);
+    s_owner[hal_cpu_id()] = self;
+    return 0;
+}
+
+void fpu_switch(thread_t *prev)
+{
+    uint32_t cpu = hal_cpu_id();
+    if (s_owner[cpu] != prev)
+        return;
+    if (prev->state != THREAD_DEAD)
+        hal_fpu_save(prev->fpu);
+    s_owner[cpu] = 0;
+    hal_fpu_disable();
+}
+
+void fpu_release(thread_t *t)
+{
+    fpu_free(t->fpu);
+    t->fpu = 0;
+}
+
+uint64_t kernel_fpu_begin(void)
+{
+    uint64_t flags = hal_irq_save();
+    uint32_t cpu = hal_cpu_id();
+    thread_t *owner = s_owner[cpu];
+    if (owner) {
+        hal_fpu_save(owner->fpu);
+        s_owner[cpu] = 0;
+    } else {
+        hal_fpu_enable();
+    }
+    return flags;
+}
+
+void kernel_fpu_end(uint64_t flags)
+{
+    hal_fpu_disable();
+    hal_irq_restore(flags);
+}
+
+void *fpu_snapshot(void)
+{
+    thread_t *self = thread_current();
+    if (!self->fpu)
+        return 0;
+    void *copy = state_alloc();
+    if (!copy)
+        return 0;
+
+    /* Saved while still the owner; the registers stay live as well */
+    uint64_t flags = hal_irq_save();
+    if (s_owner[hal_cpu_id()] == self)
+        hal_fpu_save(self->fpu);
+    hal_irq_restore(flags);
+    kmemcpy(copy, self->fpu, hal_fpu_state_size());
+    return copy;
+}
+
+void fpu_adopt(void *state)
+{
+    thread_current()->fpu = state;
+}
@@ -0,0 +1,37 @@
+#pragma once
+/* sched/fpu.h — lazy FP/SIMD state, and FP/SIMD sections in the kernel
+ *
+ * A thread has no FP state until its first FP or SIMD instruction traps
+ * (hal.h, "FP/SIMD"); fpu_trap() then gives it a page, and from there
+ * on the unit stays on while the thread runs.  It is turned off again,
+ * and the registers saved, only when that thread is switched out, so a
+ * thread that never touches the FPU costs nothing at a switch and one
+ * that does costs a save and, at its next use, a trap and a restore.
+ *
+ * Kernel code brackets SIMD work with kernel_fpu_begin() / end(): IRQs
+ * stay masked in between, so sections are short and do not nest or
+ * sleep.  The registers of whichever thread had the unit are saved
+ * first; that thread takes the trap again when it next uses FP.
+ */
+#include <stdint.h>
+#include "sched.h"
+
+/* The arch first-use trap: FP from user mode with the unit off.  IRQs
+ * masked.  0 if the instruction can be retried; -1 if there is no
+ * memory for the state, and the trap goes on to user_fault(). */
+int      fpu_trap(void);
+
+/* sched.c: prev is being switched out (IRQs masked); t is being freed */
+void     fpu_switch(thread_t *prev);
+void     fpu_release(thread_t *t);
+
+/* A section: returns the IRQ state for kernel_fpu_end() */
+uint64_t kernel_fpu_begin(void);
+void     kernel_fpu_end(uint64_t flags);
+
+/* For fork: a copy of the calling thread's state (0 if it has none or
+ * out of memory, and the child starts from the initial one), handed to
+ * the child thread with fpu_adopt() or dropped with fpu_free() */
+void    *fpu_snapshot(void);
+void     fpu_adopt(void *state);
+void     fpu_free(void *state);
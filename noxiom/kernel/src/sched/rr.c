@@ -0,0 +1,45 @@
+/* kernel/src/sched/rr.c — round-robin policy (TIER_LOW and below)
+ *
+ * FIFO run queue with a fixed slice.  Cheapest possible bookkeeping: one
+ * subtraction per accounting step, O(1) enqueue, no per-thread history.
+ * Good enough for one or two slow cores where fairness matters less than
+ * overhead.
+ */
+#include "runqueue.h"
+
+#define RR_SLICE_NS  50000000ULL        /* 50 ms */
+
+static void rr_enqueue(runqueue_t *rq, thread_t *t)
+{
+    t->slice_ns = RR_SLICE_NS;
+    rq_insert(rq, 0, t);
+}
+
+static void rr_account(runqueue_t *rq, thread_t *curr, uint64_t delta_ns)
+{
+    curr->slice_ns = delta_ns < curr->slice_ns ? curr->slice_ns - delta_ns
+                                               : 0;
+    /* Nobody waiting: start a new slice instead of switching to itself */
+    if (curr->slice_ns == 0 && !rq->head)
+        curr->slice_ns = RR_SLICE_NS;
+}
+
+static uint64_t rr_slice(runqueue_t *rq, thread_t *curr)
+{
+    return rq->head ? curr->slice_ns : SCHED_NO_SLICE;
+}
+
+static void rr_migrate(runqueue_t *from, runqueue_t *to, thread_t *t)
+{
+    (void)from;
+    (void)to;
+    (void)t;
+}
+
+const sched_policy_t sched_policy_rr = {
+    .name    = "round-robin",
+    .enqueue = rr_enqueue,
+    .account = rr_account,
+    .slice   = rr_slice,
+    .migrate = rr_migrate,
+};
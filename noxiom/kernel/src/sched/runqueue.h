@@ -0,0 +1,75 @@
+#pragma once
+/* sched/runqueue.h — scheduler internals shared by sched.c and the
+ * policies.  Not for use outside kernel/src/sched/.
+ */
+#include "sched.h"
+#include "../sync/spinlock.h"
+#include "../time/timer.h"
+
+struct thread {
+    void             *sp;           /* saved by hal_context_switch()     */
+    thread_t         *next;         /* run queue, head runs next         */
+    thread_t         *prev;
+    thread_t         *all_next;     /* every live thread (sched.c)       */
+    uint64_t          stack_pa;     /* 0 for idle threads                */
+    uint64_t          vruntime;     /* fair: virtual runtime, ns         */
+    uint64_t          runtime_ns;
+    uint64_t          slice_ns;     /* rr: left in this slice            */
+    uint32_t          tid;
+    volatile uint32_t cpu;
+    uint32_t          pinned;       /* thread_create_on(): CPU + 1, else 0 */
+    volatile uint32_t on_cpu;       /* 1 until its context is saved      */
+    volatile thread_state_t state;
+    spinlock_t        wait_lock;    /* BLOCKED <-> RUNNABLE, wake_pending */
+    uint32_t          wake_pending; /* thread_wake() while not blocked   */
+    thread_fn_t       fn;
+    void             *arg;
+    struct hal_uspace *uspace;      /* user address space, 0 = none      */
+    void             *user;         /* thread_set_uspace() owner         */
+    void             *fpu;          /* FP/SIMD state page, 0 until used  */
+    char              name[THREAD_NAME_LEN];
+};
+
+typedef struct runqueue {
+    spinlock_t lock;
+    thread_t  *head;                /* queued threads (curr not included) */
+    thread_t  *tail;
+    uint32_t   nr_queued;
+    uint64_t   min_vruntime;        /* fair: never moves backwards       */
+    thread_t  *curr;
+    thread_t  *idle;                /* set once this CPU is scheduling   */
+    thread_t  *last;                /* handed from schedule() to the next
+                                       thread's finish_switch()          */
+    ktimer_t   slice_timer;         /* armed only while curr can be
+                                       preempted for a queued thread     */
+    uint64_t   exec_start;          /* ns, curr's runtime accounted up to */
+    uint32_t   need_resched;        /* switch on the way out of the IRQ  */
+    uint64_t   idle_ns;
+    uint64_t   switches;
+    uint64_t   steals;
+} runqueue_t;
+
+#define SCHED_NO_SLICE  UINT64_MAX
+
+/* Policy hooks.  IRQs are always masked; all but migrate run with
+ * rq->lock held.  curr is never the idle thread. */
+typedef struct {
+    const char *name;
+    /* Queue t (new, preempted, yielding or woken) */
+    void (*enqueue)(runqueue_t *rq, thread_t *t);
+    /* curr has run for another delta_ns */
+    void (*account)(runqueue_t *rq, thread_t *curr, uint64_t delta_ns);
+    /* How much longer curr may run before it should give way to the
+     * head of the queue: 0 = now, SCHED_NO_SLICE = nobody is waiting */
+    uint64_t (*slice)(runqueue_t *rq, thread_t *curr);
+    /* t was stolen from `from` and is about to be queued on `to`.  No
+     * lock held: `from` is only read for a hint. */
+    void (*migrate)(runqueue_t *from, runqueue_t *to, thread_t *t);
+} sched_policy_t;
+
+extern const sched_policy_t sched_policy_rr;
+extern const sched_policy_t sched_policy_fair;
+
+/* Link t in front of pos (pos == 0: at the tail) */
+void rq_insert(runqueue_t *rq, thread_t *pos, thread_t *t);
+void rq_remove(runqueue_t *rq, thread_t *t);
@@ -0,0 +1,625 @@
+/* kernel/src/sched/sched.c — threads, run queues, switching, stealing
+ *
+ * Switch protocol (IRQs masked throughout):
+ *   1. schedule() requeues the current thread if it is still runnable,
+ *      takes the head of the local queue (or the idle thread), and drops
+ *      the queue lock
+ *   2. waits for next->on_cpu to clear — a thread that was just stolen or
+ *      requeued may still be saving its registers on another CPU
+ *   3. fpu_switch() saves prev's FP/SIMD registers if they are live,
+ *      hal_uspace_switch() if either thread runs user code, then
+ *      hal_context_switch(); the thread that resumes calls
+ *      finish_switch(), which clears on_cpu of the thread it replaced and
+ *      frees it if it had exited
+ * A queued thread with on_cpu set is skipped by work stealing, so a thief
+ * never waits on a switch in progress; pinned threads are never stolen.
+ *
+ * Preemption: runtime is accounted in ns whenever the queue is touched,
+ * and rq->slice_timer is armed for the moment the policy wants curr to
+ * give way — only while something is queued behind it.  Its callback
+ * sets need_resched; sched_irq_exit() switches once the timer code is
+ * done with the interrupt.
+ *
+ * Blocking: t->wait_lock orders thread_block() against thread_wake(), so
+ * a wake-up is either seen before the thread marks itself BLOCKED
+ * (wake_pending) or finds it BLOCKED and queues it.  The waker may queue
+ * it before its CPU has switched away; the on_cpu wait covers that.
+ *
+ * Locks: each run queue has its own lock and no code path holds two of
+ * them; a stolen thread is unlinked under the victim's lock and queued
+ * under the thief's afterwards.  A wheel lock may be taken inside
+ * rq->lock (arming the slice timer).  threads_lock only guards
+ * all_threads.
+ */
+#include "runqueue.h"
+#include "fpu.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../mm/pmm.h"
+#include "../mm/kmalloc.h"
+#include "../sync/rcu.h"
+#include "../smp/smp.h"
+
+#define SCHED_MIN_SLICE_NS  1000000ULL  /* 1 ms, about one timer unit */
+
+static runqueue_t            rqs[HAL_MAX_CPUS];
+static thread_t              idle_threads[HAL_MAX_CPUS];
+static const sched_policy_t *policy = &sched_policy_rr;
+static uint32_t              nr_cpus = 1;
+
+/* Built by sched_init() from the topology: the CPUs each one steals from,
+ * nearest first, the index in it where CPUs past its LLC start, and the
+ * capacity (hw_cpu_topo_t) pick_cpu() breaks ties with */
+static uint8_t               steal_order[HAL_MAX_CPUS][HAL_MAX_CPUS - 1];
+static uint8_t               steal_near[HAL_MAX_CPUS];
+static uint16_t              cpu_capacity[HAL_MAX_CPUS];
+
+static spinlock_t threads_lock = SPINLOCK_INIT;
+static thread_t  *all_threads;
+static uint32_t   next_tid = 1;
+
+static inline runqueue_t *this_rq(void)
+{
+    return &rqs[hal_cpu_id()];
+}
+
+/* ── Run queue list ──────────────────────────────────────────────────── */
+
+void rq_insert(runqueue_t *rq, thread_t *pos, thread_t *t)
+{
+    t->next = pos;
+    t->prev = pos ? pos->prev : rq->tail;
+    if (t->prev)
+        t->prev->next = t;
+    else
+        rq->head = t;
+    if (pos)
+        pos->prev = t;
+    else
+        rq->tail = t;
+    rq->nr_queued++;
+}
+
+void rq_remove(runqueue_t *rq, thread_t *t)
+{
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        rq->head = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+    else
+        rq->tail = t->prev;
+    t->next = t->prev = 0;
+    rq->nr_queued--;
+}
+
+/* ── Switching ───────────────────────────────────────────────────────── */
+
+static void reap(thread_t *t)
+{
+    uint64_t flags = spin_lock_irqsave(&threads_lock);
+    thread_t **pp = &all_threads;
+    while (*pp && *pp != t)
+        pp = &(*pp)->all_next;
+    if (*pp)
+        *pp = t->all_next;
+    spin_unlock_irqrestore(&threads_lock, flags);
+
+    fpu_release(t);
+    pmm_free_pages(t->stack_pa, THREAD_STACK_ORDER);
+    kfree(t);
+}
+
+/* Top of t's stack: where user mode enters the kernel */
+static uint64_t kstack_top(const thread_t *t)
+{
+    if (!t->stack_pa)
+        return 0;
+    return (uint64_t)(uintptr_t)phys_to_virt(t->stack_pa) +
+           (PAGE_SIZE << THREAD_STACK_ORDER);
+}
+
+/* First thing every thread does after being switched to */
+static void finish_switch(void)
+{
+    runqueue_t *rq = this_rq();
+    thread_t *last = rq->last;
+    rq->last = 0;
+
+    if (last->state == THREAD_DEAD)
+        reap(last);
+    else
+        __atomic_store_n(&last->on_cpu, 0, __ATOMIC_RELEASE);
+}
+
+/* Charge the time since exec_start to curr (or to idle) */
+static void update_curr(runqueue_t *rq, uint64_t now)
+{
+    uint64_t delta = now > rq->exec_start ? now - rq->exec_start : 0;
+    rq->exec_start = now;
+
+    thread_t *curr = rq->curr;
+    if (curr == rq->idle) {
+        rq->idle_ns += delta;
+    } else {
+        curr->runtime_ns += delta;
+        policy->account(rq, curr, delta);
+    }
+}
+
+/* rq->lock held.  Called whenever curr or the queue behind it changes. */
+static void update_slice(runqueue_t *rq, uint64_t now)
+{
+    uint64_t left = rq->curr == rq->idle ? SCHED_NO_SLICE
+                                         : policy->slice(rq, rq->curr);
+    if (left == SCHED_NO_SLICE) {
+        if (timer_pending(&rq->slice_timer))
+            timer_cancel(&rq->slice_timer);
+        return;
+    }
+    if (left < SCHED_MIN_SLICE_NS)
+        left = SCHED_MIN_SLICE_NS;
+    timer_arm(&rq->slice_timer, now + left);
+}
+
+static void schedule(void)
+{
+    uint64_t flags = hal_irq_save();
+    uint32_t cpu = hal_cpu_id();
+    runqueue_t *rq = &rqs[cpu];
+    uint64_t now = hal_timer_now_ns();
+
+    if (this_cpu()->rcu_nest == 0)
+        rcu_note_qs();
+
+    spin_lock(&rq->lock);
+    update_curr(rq, now);
+    thread_t *prev = rq->curr;
+    if (prev != rq->idle && prev->state == THREAD_RUNNING) {
+        prev->state = THREAD_RUNNABLE;
+        policy->enqueue(rq, prev);
+    }
+
+    thread_t *next = rq->head;
+    if (next)
+        rq_remove(rq, next);
+    else
+        next = rq->idle;
+    next->state = THREAD_RUNNING;
+    next->cpu   = cpu;
+    rq->curr    = next;
+    rq->need_resched = 0;
+    update_slice(rq, now);
+    spin_unlock(&rq->lock);
+
+    if (next != prev) {
+        while (__atomic_load_n(&next->on_cpu, __ATOMIC_ACQUIRE))
+            hal_cpu_relax();
+        next->on_cpu = 1;
+        rq->last = prev;
+        rq->switches++;
+
+        fpu_switch(prev);
+        if (prev->uspace || next->uspace)
+            hal_uspace_switch(next->uspace, kstack_top(next));
+        hal_context_switch(&prev->sp, next->sp);
+        finish_switch();
+    }
+    hal_irq_restore(flags);
+}
+
+static void thread_bootstrap(void *arg)
+{
+    thread_t *t = arg;
+    finish_switch();
+    hal_irq_enable();
+    t->fn(t->arg);
+    thread_exit();
+}
+
+/* rq->slice_timer, on rq's CPU in IRQ context */
+static void slice_expired(void *arg)
+{
+    runqueue_t *rq = arg;
+    uint64_t now = hal_timer_now_ns();
+
+    spin_lock(&rq->lock);
+    update_curr(rq, now);
+    if (rq->curr != rq->idle && policy->slice(rq, rq->curr) == 0)
+        rq->need_resched = 1;
+    else
+        update_slice(rq, now);      /* the queue changed under the timer */
+    spin_unlock(&rq->lock);
+}
+
+/* After every timer interrupt or kick, IRQs masked.  Outside an RCU
+ * read section this is a quiescent state.  A timer that lands inside
+ * softirqs or a read section must not switch (the softirqs would finish
+ * on whatever CPU the thread runs on next; the section must stay on its
+ * CPU), so the slice timer tries again shortly. */
+static void sched_irq_exit(void)
+{
+    runqueue_t *rq = this_rq();
+    int in_rcu = this_cpu()->rcu_nest != 0;
+    if (!in_rcu)
+        rcu_note_qs();
+    if (!rq->need_resched)
+        return;
+    if (hal_in_softirq() || in_rcu) {
+        timer_arm(&rq->slice_timer, hal_timer_now_ns() + SCHED_MIN_SLICE_NS);
+        return;
+    }
+    schedule();
+}
+
+/* ── Work stealing ───────────────────────────────────────────────────── */
+
+/* Take one queued thread from another CPU: SMT siblings first, then the
+ * rest of the LLC, the package and the machine, each level starting with
+ * the next CPU up so that thieves spread over their victims.  A thread
+ * from past the LLC arrives with a cold cache, so those victims only
+ * give one up when it would otherwise wait behind another.  The victim's
+ * tail is the thread it would run last, which is also the least
+ * cache-hot. */
+static thread_t *steal(uint32_t self)
+{
+    for (uint32_t i = 0; i + 1 < nr_cpus; i++) {
+        runqueue_t *victim = &rqs[steal_order[self][i]];
+        uint32_t min = i < steal_near[self] ? 1 : 2;
+        if (!victim->idle || victim->nr_queued < min)
+            continue;
+        if (!spin_trylock(&victim->lock))
+            continue;
+
+        thread_t *t = victim->tail;
+        while (t && (t->pinned ||
+                     __atomic_load_n(&t->on_cpu, __ATOMIC_ACQUIRE)))
+            t = t->prev;
+        if (t)
+            rq_remove(victim, t);
+        spin_unlock(&victim->lock);
+
+        if (t) {
+            policy->migrate(victim, &rqs[self], t);
+            return t;
+        }
+    }
+    return 0;
+}
+
+/* ── Public API ──────────────────────────────────────────────────────── */
+
+void sched_init(void)
+{
+    policy = g_hw_info.tier >= TIER_MID ? &sched_policy_fair
+                                        : &sched_policy_rr;
+
+    nr_cpus = g_hw_info.cpu_cores;
+    if (nr_cpus == 0)
+        nr_cpus = 1;
+    if (nr_cpus > HAL_MAX_CPUS)
+        nr_cpus = HAL_MAX_CPUS;
+
+    for (uint32_t self = 0; self < nr_cpus; self++) {
+        uint32_t n = 0;
+        for (uint32_t d = HW_DIST_SMT; d <= HW_DIST_REMOTE; d++) {
+            if (d == HW_DIST_PACKAGE)
+                steal_near[self] = (uint8_t)n;
+            for (uint32_t i = 1; i < nr_cpus; i++) {
+                uint32_t cpu = (self + i) % nr_cpus;
+                if (hal_hw_cpu_distance(self, cpu) == d)
+                    steal_order[self][n++] = (uint8_t)cpu;
+            }
+        }
+        cpu_capacity[self] = (uint16_t)g_hw_info.cpu[self].capacity;
+    }
+
+    for (uint32_t i = 0; i < HAL_MAX_CPUS; i++) {
+        rqs[i].lock = (spinlock_t)SPINLOCK_INIT;
+        timer_setup(&rqs[i].slice_timer, slice_expired, &rqs[i], i);
+    }
+}
+
+void sched_cpu_main(uint32_t cpu)
+{
+    runqueue_t *rq   = &rqs[cpu];
+    thread_t   *idle = &idle_threads[cpu];
+
+    hal_irq_disable();
+    kstrncpy(idle->name, "idle", THREAD_NAME_LEN - 1);
+    idle->state  = THREAD_RUNNING;
+    idle->cpu    = cpu;
+    idle->on_cpu = 1;
+    rq->curr     = idle;
+    rq->exec_start = hal_timer_now_ns();
+    __atomic_store_n(&rq->idle, idle, __ATOMIC_RELEASE);
+
+    timer_cpu_init(sched_irq_exit);         /* cooperative if it fails */
+
+    for (;;) {
+        hal_irq_disable();
+        if (rq->nr_queued == 0) {
+            thread_t *t = steal(cpu);
+            if (t) {
+                spin_lock(&rq->lock);
+                policy->enqueue(rq, t);
+                rq->steals++;
+                spin_unlock(&rq->lock);
+            }
+        }
+        if (rq->nr_queued) {
+            schedule();
+            continue;
+        }
+        rcu_note_qs();
+        hal_cpu_idle();     /* IRQs on; an enqueue on this CPU kicks us,
+                               and no timer is set unless one is due */
+    }
+}
+
+/* Least loaded CPU that is scheduling; a CPU sitting in its idle thread
+ * counts as lighter than one running a thread, and between two equally
+ * loaded the bigger core wins. */
+static uint32_t pick_cpu(void)
+{
+    uint32_t self = hal_cpu_id();
+    uint32_t best = self, best_load = ~0u, best_cap = 0;
+
+    for (uint32_t i = 0; i < nr_cpus; i++) {
+        uint32_t cpu = (self + i) % nr_cpus;
+        runqueue_t *rq = &rqs[cpu];
+        if (!__atomic_load_n(&rq->idle, __ATOMIC_ACQUIRE))
+            continue;
+        uint32_t load = rq->nr_queued * 2 + (rq->curr != rq->idle);
+        if (load < best_load ||
+            (load == best_load && cpu_capacity[cpu] > best_cap)) {
+            best = cpu;
+            best_load = load;
+            best_cap = cpu_capacity[cpu];
+        }
+    }
+    return best;
+}
+
+/* Where a woken thread goes: its own CPU if pinned, back to its last
+ * CPU if that one has nothing to do (its cache may still be warm), else
+ * the least loaded */
+static uint32_t select_cpu(const thread_t *t)
+{
+    if (t->pinned)
+        return t->pinned - 1;
+    uint32_t prev = t->cpu;
+    runqueue_t *rq = &rqs[prev];
+    if (prev < nr_cpus && rq->idle && rq->curr == rq->idle &&
+        rq->nr_queued == 0)
+        return prev;
+    return pick_cpu();
+}
+
+/* Queue a runnable thread on `cpu`.  IRQs masked. */
+static void enqueue_on(uint32_t cpu, thread_t *t)
+{
+    runqueue_t *rq = &rqs[cpu];
+
+    spin_lock(&rq->lock);
+    t->cpu = cpu;
+    policy->enqueue(rq, t);
+    int idle = rq->curr == rq->idle;
+    if (!idle) {
+        uint64_t now = hal_timer_now_ns();
+        update_curr(rq, now);
+        update_slice(rq, now);      /* a remote wheel kicks its CPU itself */
+    }
+    spin_unlock(&rq->lock);
+
+    if (idle && cpu != hal_cpu_id())
+        hal_cpu_kick(cpu);
+}
+
+static thread_t *create(const char *name, thread_fn_t fn, void *arg,
+                        uint32_t pinned)
+{
+    thread_t *t = kzalloc(sizeof(*t));
+    if (!t)
+        return 0;
+    t->stack_pa = pmm_alloc_pages(THREAD_STACK_ORDER);
+    if (!t->stack_pa) {
+        kfree(t);
+        return 0;
+    }
+
+    kstrncpy(t->name, name, THREAD_NAME_LEN - 1);
+    t->fn    = fn;
+    t->arg   = arg;
+    t->state = THREAD_RUNNABLE;
+    t->pinned = pinned;
+    t->wait_lock = (spinlock_t)SPINLOCK_INIT;
+    t->sp    = hal_context_init((uint8_t *)phys_to_virt(t->stack_pa)
+                                + (PAGE_SIZE << THREAD_STACK_ORDER),
+                                thread_bootstrap, t);
+
+    uint64_t flags = spin_lock_irqsave(&threads_lock);
+    t->tid       = next_tid++;
+    t->all_next  = all_threads;
+    all_threads  = t;
+    spin_unlock_irqrestore(&threads_lock, flags);
+
+    flags = hal_irq_save();
+    enqueue_on(pinned ? pinned - 1 : pick_cpu(), t);
+    hal_irq_restore(flags);
+
+    return t;
+}
+
+thread_t *thread_create(const char *name, thread_fn_t fn, void *arg)
+{
+    return create(name, fn, arg, 0);
+}
+
+thread_t *thread_create_on(const char *name, thread_fn_t fn, void *arg,
+                           uint32_t cpu)
+{
+    int ok = cpu < nr_cpus && smp_cpu_online(cpu);
+    return create(name, fn, arg, ok ? cpu + 1 : 0);
+}
+
+void thread_yield(void)
+{
+    schedule();
+}
+
+void thread_exit(void)
+{
+    hal_irq_disable();
+    this_rq()->curr->state = THREAD_DEAD;
+    schedule();
+    for (;;)            /* never resumed: finish_switch() frees us */
+        hal_cpu_relax();
+}
+
+void thread_set_uspace(struct hal_uspace *as, void *owner)
+{
+    uint64_t flags = hal_irq_save();
+    thread_t *self = this_rq()->curr;
+    self->uspace = as;
+    self->user   = owner;
+    hal_uspace_switch(as, kstack_top(self));
+    hal_irq_restore(flags);
+}
+
+void *thread_user(thread_t *t)
+{
+    return t->user;
+}
+
+thread_t *thread_current(void)
+{
+    uint64_t flags = hal_irq_save();
+    thread_t *t = this_rq()->curr;
+    hal_irq_restore(flags);
+    return t;
+}
+
+void thread_block(void)
+{
+    uint64_t flags = hal_irq_save();
+    thread_t *self = this_rq()->curr;
+
+    spin_lock(&self->wait_lock);
+    if (self->wake_pending) {
+        self->wake_pending = 0;
+        spin_unlock(&self->wait_lock);
+        hal_irq_restore(flags);
+        return;
+    }
+    self->state = THREAD_BLOCKED;   /* schedule() will not requeue it */
+    spin_unlock(&self->wait_lock);
+
+    schedule();
+    hal_irq_restore(flags);
+}
+
+void thread_wake(thread_t *t)
+{
+    uint64_t flags = spin_lock_irqsave(&t->wait_lock);
+    if (t->state != THREAD_BLOCKED) {
+        t->wake_pending = 1;
+        spin_unlock_irqrestore(&t->wait_lock, flags);
+        return;
+    }
+    t->state = THREAD_RUNNABLE;
+    spin_unlock(&t->wait_lock);
+
+    enqueue_on(select_cpu(t), t);
+    hal_irq_restore(flags);
+}
+
+static void sleep_expired(void *arg)
+{
+    thread_wake(arg);
+}
+
+void thread_sleep_ns(uint64_t ns)
+{
+    uint64_t deadline = hal_timer_now_ns() + ns;
+    uint64_t flags = hal_irq_save();
+    uint32_t cpu = hal_cpu_id();
+    thread_t *self = rqs[cpu].curr;
+    hal_irq_restore(flags);
+
+    if (!timer_cpu_active(cpu)) {
+        /* No timer interrupt on this CPU: let the others run meanwhile */
+        while (hal_timer_now_ns() < deadline)
+            thread_yield();
+        return;
+    }
+
+    ktimer_t t;
+    timer_setup(&t, sleep_expired, self, cpu);
+    timer_arm(&t, deadline);
+    while (timer_pending(&t))
+        thread_block();
+}
+
+int thread_block_until(uint64_t deadline_ns)
+{
+    uint64_t flags = hal_irq_save();
+    uint32_t cpu = hal_cpu_id();
+    thread_t *self = rqs[cpu].curr;
+    hal_irq_restore(flags);
+
+    if (!timer_cpu_active(cpu)) {
+        thread_yield();
+        return hal_timer_now_ns() >= deadline_ns;
+    }
+
+    ktimer_t t;
+    timer_setup(&t, sleep_expired, self, cpu);
+    timer_arm(&t, deadline_ns);
+    thread_block();
+    return !timer_cancel(&t);
+}
+
+const char *sched_policy_name(void)
+{
+    return policy->name;
+}
+
+uint32_t sched_thread_list(thread_info_t *out, uint32_t max)
+{
+    uint32_t n = 0;
+    uint64_t flags = spin_lock_irqsave(&threads_lock);
+    for (thread_t *t = all_threads; t && n < max; t = t->all_next, n++) {
+        out[n].tid   = t->tid;
+        out[n].cpu   = t->cpu;
+        out[n].state = t->state;
+        out[n].runtime_ns = t->runtime_ns;
+        kstrncpy(out[n].name, t->name, THREAD_NAME_LEN - 1);
+        out[n].name[THREAD_NAME_LEN - 1] = '\0';
+    }
+    spin_unlock_irqrestore(&threads_lock, flags);
+    return n;
+}
+
+void sched_cpu_stats(uint32_t cpu, sched_cpu_stats_t *out)
+{
+    kmemset(out, 0, sizeof(*out));
+    if (cpu >= nr_cpus)
+        return;
+
+    runqueue_t *rq = &rqs[cpu];
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+    out->online     = rq->idle != 0;
+    out->queued     = rq->nr_queued;
+    out->timer_irqs = timer_irq_count(cpu);
+    out->idle_ns    = rq->idle_ns;
+    if (rq->idle && rq->curr == rq->idle) {     /* still idle: unaccounted */
+        uint64_t now = hal_timer_now_ns();
+        if (now > rq->exec_start)
+            out->idle_ns += now - rq->exec_start;
+    }
+    out->switches   = rq->switches;
+    out->steals     = rq->steals;
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
@@ -0,0 +1,93 @@
+#pragma once
+/* sched/sched.h — kernel threads and the preemptive scheduler
+ *
+ * Every CPU has its own run queue and an idle thread (the context it was
+ * booted on).  New threads go to the least loaded CPU; a CPU whose queue
+ * runs dry steals queued threads from the others before going idle,
+ * nearest in the cache topology first.
+ * There is no periodic tick: while other threads are waiting, a one-shot
+ * slice timer preempts the running thread when the policy says its time
+ * is up.  A CPU with nothing queued sets no timer, and an idle CPU sleeps
+ * until an interrupt or a wake-up kick.
+ *
+ * The policy is picked once at boot from the hardware tier:
+ *   TIER_FALLBACK / TIER_LOW  → round-robin, fixed time slice
+ *   TIER_MID / TIER_HIGH      → fair: run the thread with the least
+ *                               virtual runtime
+ *
+ * Kernel code that shares data with another thread must take its locks
+ * with spin_lock_irqsave(): preemption only happens from timer IRQs, so
+ * IRQ-masked sections are never switched out.
+ */
+#include <stdint.h>
+
+#define THREAD_STACK_ORDER  2           /* 2^2 pages = 16 KB per thread */
+#define THREAD_NAME_LEN     16
+
+typedef struct thread thread_t;
+struct hal_uspace;                      /* hal.h hal_uspace_t */
+typedef void (*thread_fn_t)(void *arg);
+
+typedef enum {
+    THREAD_RUNNABLE = 0,        /* on a run queue                        */
+    THREAD_RUNNING,             /* some CPU's current thread             */
+    THREAD_BLOCKED,             /* in thread_block(), waiting for a wake */
+    THREAD_DEAD,                /* exited, stack freed by the next switch */
+} thread_state_t;
+
+/* Pick the policy and set up the run queues.  Boot CPU, before smp_init(). */
+void sched_init(void);
+
+/* Turn the calling context into this CPU's idle thread and start
+ * scheduling.  kmain and every secondary CPU end up here. */
+void sched_cpu_main(uint32_t cpu) __attribute__((noreturn));
+
+/* Returns 0 if no memory is left for the thread or its stack */
+thread_t *thread_create(const char *name, thread_fn_t fn, void *arg);
+/* Same, but the thread only ever runs on `cpu` (not stolen, woken there):
+ * per-CPU workers such as a NIC queue's poll thread.  A CPU that is not
+ * online gives an ordinary, unpinned thread. */
+thread_t *thread_create_on(const char *name, thread_fn_t fn, void *arg,
+                           uint32_t cpu);
+void      thread_yield(void);
+void      thread_exit(void) __attribute__((noreturn));
+thread_t *thread_current(void);
+
+/* Sleep until thread_wake(t).  A wake-up that arrives while the thread
+ * is still running is remembered, so it is never lost — but a return
+ * does not prove the caller's condition is true: always re-check it. */
+void      thread_block(void);
+void      thread_wake(thread_t *t);
+/* Block for at least ns (one timer unit late at most) */
+void      thread_sleep_ns(uint64_t ns);
+/* thread_block() that also returns once hal_timer_now_ns() reaches
+ * deadline_ns; 1 if it was the deadline.  Same re-check rule. */
+int       thread_block_until(uint64_t deadline_ns);
+
+/* User mode (user/user.h): the calling thread runs in address space `as`
+ * (0 = kernel only) from now on, switched to whenever it is scheduled.
+ * `owner` is the user layer's, read back with thread_user(). */
+void      thread_set_uspace(struct hal_uspace *as, void *owner);
+void     *thread_user(thread_t *t);
+
+/* ── Introspection (shell) ────────────────────────────────────────────── */
+typedef struct {
+    uint32_t       tid;
+    uint32_t       cpu;
+    thread_state_t state;
+    uint64_t       runtime_ns;  /* time spent running                    */
+    char           name[THREAD_NAME_LEN];
+} thread_info_t;
+
+typedef struct {
+    uint32_t online;            /* scheduler running on this CPU         */
+    uint32_t queued;            /* runnable threads waiting              */
+    uint64_t timer_irqs;        /* timer interrupts and kicks taken      */
+    uint64_t idle_ns;           /* time spent in the idle thread         */
+    uint64_t switches;          /* context switches                      */
+    uint64_t steals;            /* threads taken from other CPUs         */
+} sched_cpu_stats_t;
+
+const char *sched_policy_name(void);
+uint32_t    sched_thread_list(thread_info_t *out, uint32_t max);
+void        sched_cpu_stats(uint32_t cpu, sched_cpu_stats_t *out);
@@ -1,6 +1,13 @@
 #include "shell.h"
 #include "../hal.h"
 #include "../string.h"
+#include "../mm/arena.h"
+#include "../mm/kmalloc.h"
+#include "../mm/pmm.h"
+#include "../sched/sched.h"
+#include "../sync/spinlock.h"
+#include "../time/bootstats.h"
+#include "../log/klog.h"
 
 #define CMD_BUF  256
 #define MAX_ARGS 16
@@ -8,6 +15,9 @@
 static char line[CMD_BUF];
 static int  line_len;
 
+/* Line parsing scratch (argv), rolled back after every command */
+static arena_t scratch = ARENA_INIT;
+
 static void prompt(void) {
     hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREEN, HAL_COLOR_BLACK));
     hal_display_print("noxiom");
@@ -30,20 +40,39 @@ static int parse(char *buf, char **argv) {
     return argc;
 }
 
-/* ─── Built-in commands ──────────────────────────────────────────── */
+/* ─── Output helpers (shell.h) ───────────────────────────────────── */
 
-static void cmd_help(void) {
-    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
-    hal_display_print("Noxiom OS built-in commands:\n");
-    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
-    hal_display_print("  help      - show this message\n");
-    hal_display_print("  clear     - clear the screen\n");
-    hal_display_print("  echo ...  - print arguments\n");
-    hal_display_print("  version   - show OS version\n");
-    hal_display_print("  halt      - halt the system\n");
+void shell_print_col(uint64_t v, int width) {
+    char buf[24];
+    kutoa(v, buf, 10);
+    for (int pad = width - (int)kstrlen(buf); pad > 0; pad--)
+        hal_display_putchar(' ');
+    hal_display_print(buf);
+}
+
+void shell_print_rate(uint64_t num, uint64_t den, int width) {
+    uint64_t v = den ? num * 100 / den : 0;
+    char frac[3] = { (char)('0' + v / 10 % 10), (char)('0' + v % 10), 0 };
+    shell_print_col(v / 100, width - 3);
+    hal_display_putchar('.');
+    hal_display_print(frac);
+}
+
+uint64_t shell_parse_uint(const char *s, uint64_t def) {
+    uint64_t v = 0;
+    if (!s || !*s) return def;
+    for (; *s; s++) {
+        if (*s < '0' || *s > '9') return def;
+        v = v * 10 + (uint64_t)(*s - '0');
+    }
+    return v;
 }
 
-static void cmd_clear(void) {
+/* ─── Built-in commands ──────────────────────────────────────────── */
+
+static void cmd_clear(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
     hal_display_clear();
 }
 
@@ -55,45 +84,518 @@ static void cmd_echo(int argc, char **argv) {
     hal_display_putchar('\n');
 }
 
-static void cmd_version(void) {
+static void cmd_version(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
     hal_display_set_color(HAL_COLOR(HAL_COLOR_CYAN, HAL_COLOR_BLACK));
     hal_display_print("Noxiom OS v0.1.0\n");
     hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
     hal_display_print("Lightweight server OS - built from scratch\n");
 }
 
-static void cmd_halt(void) {
+static void cmd_meminfo(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    hw_info_t hw;
+    hal_hw_info_read(&hw);
+
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    hal_display_print("Physical memory (KB):\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    hal_display_print("  installed");
+    shell_print_col(hw.ram_bytes >> 10, 12);
+    hal_display_print("\n  managed  ");
+    shell_print_col(pmm_total_bytes() >> 10, 12);
+    hal_display_print("\n  free     ");
+    shell_print_col(pmm_free_bytes() >> 10, 12);
+    hal_display_print("\n");
+
+    kmalloc_stats_t st[KMALLOC_CLASSES + 1];
+    uint32_t n = kmalloc_stats(st, KMALLOC_CLASSES + 1);
+
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    hal_display_print("Heap (bytes):\n");
+    hal_display_print("   class        live       freed        peak       pages\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    for (uint32_t i = 0; i < n; i++) {
+        if (st[i].obj_size)
+            shell_print_col(st[i].obj_size, 8);
+        else
+            hal_display_print("   large");
+        shell_print_col(st[i].live_bytes,  12);
+        shell_print_col(st[i].freed_bytes, 12);
+        shell_print_col(st[i].peak_bytes,  12);
+        shell_print_col(st[i].slab_bytes,  12);
+        hal_display_print("\n");
+    }
+}
+
+static void cmd_cpuinfo(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    hw_info_t hw;
+    hal_hw_info_read(&hw);
+    static const char *const kind[] = { "     ?", "  data", "  inst", "  unif" };
+
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    hal_display_print("     cpu package    core  thread     llc capacity\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    for (uint32_t i = 0; i < hw.cpu_cores && i < HW_MAX_CPUS; i++) {
+        shell_print_col(i, 8);
+        shell_print_col(hw.cpu[i].package, 8);
+        shell_print_col(hw.cpu[i].core, 8);
+        shell_print_col(hw.cpu[i].thread, 8);
+        shell_print_col(hw.cpu[i].llc, 8);
+        shell_print_col(hw.cpu[i].capacity, 9);
+        hal_display_print("\n");
+    }
+
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    hal_display_print(" level  type    size KB  line  ways  shared\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    for (uint32_t i = 0; i < hw.cache_count && i < HW_MAX_CACHES; i++) {
+        const hw_cache_t *c = &hw.cache[i];
+        shell_print_col(c->level, 6);
+        hal_display_print(kind[c->type & 3]);
+        shell_print_col(c->size >> 10, 11);
+        shell_print_col(c->line, 6);
+        shell_print_col(c->ways, 6);
+        shell_print_col(c->shared, 8);
+        hal_display_print("\n");
+    }
+}
+
+#define PS_MAX_THREADS 64
+
+static void cmd_ps(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    static const char *state_names[] = { "ready", "run", "sleep", "dead" };
+
+    thread_info_t *ti = kmalloc(PS_MAX_THREADS * sizeof(*ti));
+    if (!ti) {
+        hal_display_print("ps: out of memory\n");
+        return;
+    }
+    uint32_t n = sched_thread_list(ti, PS_MAX_THREADS);
+
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    hal_display_print("Threads (policy: ");
+    hal_display_print(sched_policy_name());
+    hal_display_print("):\n");
+    hal_display_print("     tid  cpu  state     time ms  name\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    for (uint32_t i = 0; i < n; i++) {
+        shell_print_col(ti[i].tid, 8);
+        shell_print_col(ti[i].cpu, 5);
+        hal_display_print("  ");
+        hal_display_print(state_names[ti[i].state]);
+        for (int pad = 6 - (int)kstrlen(state_names[ti[i].state]); pad > 0; pad--)
+            hal_display_putchar(' ');
+        shell_print_col(ti[i].runtime_ns / 1000000, 10);
+        hal_display_print("  ");
+        hal_display_print(ti[i].name);
+        hal_display_print("\n");
+    }
+
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    hal_display_print("CPUs:\n");
+    hal_display_print("     cpu  queued  timer irqs     idle ms    switches  steals\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++) {
+        sched_cpu_stats_t st;
+        sched_cpu_stats(cpu, &st);
+        if (!st.online)
+            continue;
+        shell_print_col(cpu, 8);
+        shell_print_col(st.queued, 8);
+        shell_print_col(st.timer_irqs, 12);
+        shell_print_col(st.idle_ns / 1000000, 12);
+        shell_print_col(st.switches, 12);
+        shell_print_col(st.steals, 8);
+        hal_display_print("\n");
+    }
+    kfree(ti);
+}
+
+static void cmd_irqs(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    hal_display_print("Device IRQs since boot:\n");
+    hal_display_print("     irq       count\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    for (uint32_t irq = 0; irq < HAL_IRQ_MAX; irq++) {
+        uint64_t n = hal_irq_count(irq);
+        if (!n)
+            continue;
+        shell_print_col(irq, 8);
+        shell_print_col(n, 12);
+        hal_display_print("\n");
+    }
+    hal_display_print("   no handler");
+    shell_print_col(hal_irq_count(HAL_IRQ_MAX), 9);
+    hal_display_print("\n");
+}
+
+/* Each size is run for MEMBENCH_BYTES in total with IRQs masked, so the
+ * thread stays on one CPU and the cycle counter is consistent */
+#define MEMBENCH_MAX   (1u << 20)
+#define MEMBENCH_BYTES (4u << 20)
+
+static uint64_t membench_run(int fill, uint8_t *dst, const uint8_t *src,
+                             size_t size) {
+    uint32_t iters = MEMBENCH_BYTES / size;
+    uint64_t flags = hal_irq_save();
+    uint64_t t0 = hal_cycles();
+    for (uint32_t i = 0; i < iters; i++) {
+        if (fill)
+            kmemset(dst, (int)i, size);
+        else
+            kmemcpy(dst, src, size);
+    }
+    uint64_t t1 = hal_cycles();
+    hal_irq_restore(flags);
+    return t1 - t0;
+}
+
+static void cmd_membench(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    uint8_t *src = kmalloc(MEMBENCH_MAX);
+    uint8_t *dst = kmalloc(MEMBENCH_MAX);
+    if (!src || !dst) {
+        hal_display_print("membench: out of memory\n");
+        kfree(src);
+        kfree(dst);
+        return;
+    }
+    kmemset(src, 0x5A, MEMBENCH_MAX);
+
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    hal_display_print("Bytes per cycle:\n");
+    hal_display_print("      size   kmemcpy   kmemset\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    static const uint32_t sizes[] = {
+        8, 64, 512, 4096, 32768, 262144, MEMBENCH_MAX
+    };
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t size = sizes[i];
+        uint64_t bytes = (uint64_t)(MEMBENCH_BYTES / size) * size;
+        shell_print_col(size, 10);
+        shell_print_rate(bytes, membench_run(0, dst, src, size), 10);
+        shell_print_rate(bytes, membench_run(1, dst, src, size), 10);
+        hal_display_print("\n");
+    }
+    kfree(src);
+    kfree(dst);
+}
+
+static void cmd_bootstats(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    boot_phase_t ph[BOOT_MARKS_MAX];
+    uint32_t n = boot_stats_phases(ph, BOOT_MARKS_MAX);
+    if (n == 0) {
+        hal_display_print("bootstats: no timestamps\n");
+        return;
+    }
+
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    hal_display_print("Boot phases (us):\n");
+    hal_display_print("  phase            took     ended\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    for (uint32_t i = 0; i < n; i++) {
+        hal_display_print("  ");
+        hal_display_print(ph[i].phase);
+        for (int pad = 10 - (int)kstrlen(ph[i].phase); pad > 0; pad--)
+            hal_display_putchar(' ');
+        shell_print_col(ph[i].us, 10);
+        shell_print_col(ph[i].end_us, 10);
+        hal_display_print("\n");
+    }
+}
+
+static void cmd_dmesg(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    klog_iter_t   it;
+    klog_record_t rec;
+    char          line[KLOG_MSG_LEN + 16];
+
+    klog_iter_init(&it);
+    while (klog_iter_next(&it, &rec)) {
+        klog_format(&rec, line, sizeof(line));
+        hal_display_print(line);
+        hal_display_print("\n");
+    }
+    if (it.lost) {
+        shell_print_col(it.lost, 0);
+        hal_display_print(" records overwritten while reading\n");
+    }
+}
+
+static void cmd_halt(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
     hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_RED, HAL_COLOR_BLACK));
     hal_display_print("System halted.\n");
     hal_halt();
 }
 
+/* ─── Command registry ───────────────────────────────────────────── */
+
+/* Open-addressed table of index + 1 into the section (0 = empty), and
+ * the same indices sorted by name for help */
+#define SHELL_MAX_CMDS  64
+#define SHELL_HASH_SIZE 128                     /* power of two, >= 2x  */
+
+extern const shell_cmd_t __shell_cmds_start[], __shell_cmds_end[];
+
+static uint8_t  cmd_hash[SHELL_HASH_SIZE];
+static uint8_t  cmd_sorted[SHELL_MAX_CMDS];
+static uint32_t cmd_count;
+static uint8_t  cmd_busy[SHELL_MAX_CMDS];      /* .exclusive ones only */
+
+static uint32_t name_hash(const char *s) {
+    uint32_t h = 2166136261u;                   /* FNV-1a */
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void registry_build(void) {
+    uint32_t n = (uint32_t)(__shell_cmds_end - __shell_cmds_start);
+    if (n > SHELL_MAX_CMDS) {
+        klog("[shell] %u commands registered, only %u usable",
+             n, SHELL_MAX_CMDS);
+        n = SHELL_MAX_CMDS;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        const char *name = __shell_cmds_start[i].name;
+        uint32_t h = name_hash(name) & (SHELL_HASH_SIZE - 1);
+        while (cmd_hash[h])
+            h = (h + 1) & (SHELL_HASH_SIZE - 1);
+        cmd_hash[h] = (uint8_t)(i + 1);
+
+        /* Insertion sort: the list is short and built once */
+        uint32_t j = i;
+        for (; j > 0 && kstrcmp(__shell_cmds_start[cmd_sorted[j - 1]].name,
+                                name) > 0; j--)
+            cmd_sorted[j] = cmd_sorted[j - 1];
+        cmd_sorted[j] = (uint8_t)i;
+    }
+    cmd_count = n;
+}
+
+static const shell_cmd_t *cmd_lookup(const char *name) {
+    uint32_t h = name_hash(name) & (SHELL_HASH_SIZE - 1);
+    for (; cmd_hash[h]; h = (h + 1) & (SHELL_HASH_SIZE - 1)) {
+        const shell_cmd_t *c = &__shell_cmds_start[cmd_hash[h] - 1];
+        if (kstrcmp(c->name, name) == 0)
+            return c;
+    }
+    return 0;
+}
+
+static void cmd_help(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_YELLOW, HAL_COLOR_BLACK));
+    hal_display_print("Noxiom OS commands (end a line with & to run it in the background):\n");
+    hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+    for (uint32_t i = 0; i < cmd_count; i++) {
+        const shell_cmd_t *c = &__shell_cmds_start[cmd_sorted[i]];
+        int len = (int)kstrlen(c->name);
+        hal_display_print("  ");
+        hal_display_print(c->name);
+        if (c->args) {
+            hal_display_putchar(' ');
+            hal_display_print(c->args);
+            len += 1 + (int)kstrlen(c->args);
+        }
+        for (int pad = 10 - len; pad > 0; pad--)
+            hal_display_putchar(' ');
+        hal_display_print(" - ");
+        hal_display_print(c->help ? c->help : "");
+        hal_display_print("\n");
+    }
+}
+
+SHELL_CMD(help,      .fn = cmd_help,      .help = "show this message");
+SHELL_CMD(clear,     .fn = cmd_clear,     .help = "clear the screen");
+SHELL_CMD(echo,      .fn = cmd_echo,      .args = "...",
+          .help = "print arguments");
+SHELL_CMD(version,   .fn = cmd_version,   .help = "show OS version");
+SHELL_CMD(meminfo,   .fn = cmd_meminfo,   .help = "show memory and heap usage");
+SHELL_CMD(cpuinfo,   .fn = cmd_cpuinfo,   .help = "show CPU topology and caches");
+SHELL_CMD(ps,        .fn = cmd_ps,
+          .help = "list threads and per-CPU scheduler stats");
+SHELL_CMD(irqs,      .fn = cmd_irqs,      .help = "show interrupt counts per IRQ");
+SHELL_CMD(membench,  .fn = cmd_membench,
+          .help = "kmemcpy/kmemset bytes per cycle, 8 B .. 1 MB");
+SHELL_CMD(bootstats, .fn = cmd_bootstats, .help = "time spent in each boot phase");
+SHELL_CMD(dmesg,     .fn = cmd_dmesg,     .help = "show the kernel log");
+SHELL_CMD(halt,      .fn = cmd_halt,      .help = "halt the system");
+
 /* ─── Command dispatch ───────────────────────────────────────────── */
 
+/* One command run: its own arena holds the job, argv and a copy of the
+ * line, so a background command outlives the shell's line buffer */
+typedef struct {
+    arena_t            arena;
+    const shell_cmd_t *cmd;
+    int                argc;
+    char             **argv;
+    thread_t *volatile waiter;          /* 0 = background              */
+    volatile int       done;
+} shell_job_t;
+
+/* Claim an .exclusive command for one run; 0 if one is already going */
+static int cmd_claim(const shell_cmd_t *cmd) {
+    if (!cmd->exclusive)
+        return 1;
+    return !__atomic_exchange_n(&cmd_busy[cmd - __shell_cmds_start], 1,
+                                __ATOMIC_ACQUIRE);
+}
+
+static void cmd_unclaim(const shell_cmd_t *cmd) {
+    if (cmd->exclusive)
+        __atomic_store_n(&cmd_busy[cmd - __shell_cmds_start], 0,
+                         __ATOMIC_RELEASE);
+}
+
+/* One job arena kept cleared between commands, so a command does not
+ * cost a page allocation and free; a second concurrent job makes its own */
+static arena_t    job_spare = ARENA_INIT;
+static spinlock_t job_lock  = SPINLOCK_INIT;
+
+static arena_t job_arena_get(void) {
+    uint64_t flags = spin_lock_irqsave(&job_lock);
+    arena_t a = job_spare;
+    arena_init(&job_spare);
+    spin_unlock_irqrestore(&job_lock, flags);
+    return a;
+}
+
+static void job_arena_put(arena_t *a) {
+    arena_clear(a);
+    uint64_t flags = spin_lock_irqsave(&job_lock);
+    if (!job_spare.head) {
+        job_spare = *a;
+        arena_init(a);
+    }
+    spin_unlock_irqrestore(&job_lock, flags);
+    arena_release(a);                   /* no-op once stashed          */
+}
+
+static void job_free(shell_job_t *job) {
+    arena_t a = job->arena;             /* the job lives in its arena  */
+    job_arena_put(&a);
+}
+
+static void job_main(void *arg) {
+    shell_job_t *job = arg;
+    job->cmd->fn(job->argc, job->argv);
+    cmd_unclaim(job->cmd);
+
+    thread_t *waiter = job->waiter;
+    if (!waiter) {
+        job_free(job);
+        return;
+    }
+    /* The shell frees the job as soon as it sees done */
+    __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+    thread_wake(waiter);
+}
+
 static void dispatch(char *buf) {
-    if (!buf[0]) return;
-
-    char *argv[MAX_ARGS];
-    int   argc = parse(buf, argv);
-    if (argc == 0) return;
-
-    if      (kstrcmp(argv[0], "help")    == 0) cmd_help();
-    else if (kstrcmp(argv[0], "clear")   == 0) cmd_clear();
-    else if (kstrcmp(argv[0], "echo")    == 0) cmd_echo(argc, argv);
-    else if (kstrcmp(argv[0], "version") == 0) cmd_version();
-    else if (kstrcmp(argv[0], "halt")    == 0) cmd_halt();
-    else {
+    arena_mark_t mark = arena_mark(&scratch);
+    char **argv = arena_alloc(&scratch, MAX_ARGS * sizeof(char *));
+    if (!argv) {
+        hal_display_print("shell: out of memory\n");
+        return;
+    }
+
+    int argc = parse(buf, argv);
+    int background = 0;
+    if (argc > 0 && kstrcmp(argv[argc - 1], "&") == 0) {
+        background = 1;
+        argc--;
+    }
+    if (argc == 0) {
+        arena_reset(&scratch, mark);
+        return;
+    }
+
+    const shell_cmd_t *cmd = cmd_lookup(argv[0]);
+    if (!cmd) {
         hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_RED, HAL_COLOR_BLACK));
         hal_display_print("Unknown command: ");
         hal_display_print(argv[0]);
         hal_display_print("\n");
         hal_display_set_color(HAL_COLOR(HAL_COLOR_LIGHT_GREY, HAL_COLOR_BLACK));
+        arena_reset(&scratch, mark);
+        return;
+    }
+    if (!cmd_claim(cmd)) {
+        hal_display_print(cmd->name);
+        hal_display_print(": busy, already running\n");
+        arena_reset(&scratch, mark);
+        return;
+    }
+
+    size_t chars = 0;
+    for (int i = 0; i < argc; i++)
+        chars += kstrlen(argv[i]) + 1;
+
+    arena_t      a   = job_arena_get();
+    shell_job_t *job = arena_alloc(&a, sizeof(*job));
+    char       **jav = arena_alloc(&a, (size_t)(argc + 1) * sizeof(char *));
+    char        *str = arena_alloc(&a, chars);
+    if (!job || !jav || !str) {
+        job_arena_put(&a);
+        cmd_unclaim(cmd);
+        hal_display_print("shell: out of memory\n");
+        arena_reset(&scratch, mark);
+        return;
+    }
+    for (int i = 0; i < argc; i++) {
+        size_t len = kstrlen(argv[i]) + 1;
+        kmemcpy(str, argv[i], len);
+        jav[i] = str;
+        str   += len;
+    }
+    jav[argc]   = 0;
+    job->cmd    = cmd;
+    job->argc   = argc;
+    job->argv   = jav;
+    job->waiter = background ? 0 : thread_current();
+    job->done   = 0;
+    job->arena  = a;                    /* after the last allocation */
+    arena_reset(&scratch, mark);
+
+    if (!thread_create(cmd->name, job_main, job)) {
+        /* No thread to spare: run it here, as the shell always did */
+        cmd->fn(job->argc, job->argv);
+        cmd_unclaim(cmd);
+        job_free(job);
+        return;
     }
+    if (background)
+        return;
+    while (!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE))
+        thread_block();
+    job_free(job);
 }
 
 /* ─── Shell main loop ────────────────────────────────────────────── */
 
 void shell_run(void) {
+    registry_build();
     line_len = 0;
     prompt();
 
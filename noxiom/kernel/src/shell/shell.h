@@ -1,3 +1,46 @@
 #pragma once
+/* shell/shell.h — the interactive shell and its command registry
+ *
+ * Commands are registered anywhere in the kernel with SHELL_CMD(), which
+ * puts a descriptor in the .shell_cmds section; the linker script
+ * collects them between __shell_cmds_start and __shell_cmds_end.  The
+ * shell hashes their names once when it starts, and `help` lists them
+ * in name order.
+ *
+ *   static void cmd_uptime(int argc, char **argv) { ... }
+ *   SHELL_CMD(uptime, .fn = cmd_uptime, .help = "time since boot");
+ *
+ * Every command runs in a kernel thread of its own, named after it.
+ * The shell waits for it to finish, unless the line ends in "&": then
+ * the prompt comes back at once and the command runs in the
+ * background.  argv stays valid until the command returns.  A command
+ * that keeps file-static state sets .exclusive: a second run while one
+ * is still going is refused with a busy message.
+ */
+#include <stdint.h>
+
+typedef void (*shell_fn_t)(int argc, char **argv);
+
+typedef struct {
+    const char *name;
+    shell_fn_t  fn;
+    const char *args;           /* argument synopsis for help, may be 0 */
+    const char *help;           /* one line                             */
+    int         exclusive;      /* at most one run at a time            */
+} shell_cmd_t;
+
+#define SHELL_CMD(id, ...)                                                \
+    static const shell_cmd_t shell_cmd_##id                               \
+        __attribute__((used, section(".shell_cmds"), aligned(8))) =       \
+        { .name = #id, __VA_ARGS__ }
 
 void shell_run(void);
+
+/* ── Helpers for command output ──────────────────────────────────────── */
+
+/* v right-aligned in a field of `width` characters */
+void     shell_print_col(uint64_t v, int width);
+/* num / den with two decimals, right-aligned in `width` */
+void     shell_print_rate(uint64_t num, uint64_t den, int width);
+/* Decimal argument, or def if absent (0) or not a number */
+uint64_t shell_parse_uint(const char *s, uint64_t def);
@@ -0,0 +1,22 @@
+/* kernel/src/smp/percpu.c — per-CPU data areas
+ *
+ * The areas are a static array in .bss: g_percpu[0] is usable from the
+ * first instruction of kmain(), with no allocator, and cpu 0's header
+ * reads as zero until percpu_init(0) fills it in.
+ */
+#include "percpu.h"
+
+percpu_t g_percpu[HAL_MAX_CPUS];
+
+percpu_t *percpu_area(uint32_t cpu)
+{
+    percpu_t *p = &g_percpu[cpu];       /* cpu < HAL_MAX_CPUS */
+    p->hdr.self = p;
+    p->hdr.cpu  = cpu;
+    return p;
+}
+
+void percpu_init(uint32_t cpu)
+{
+    hal_percpu_set(&percpu_area(cpu)->hdr);
+}
@@ -0,0 +1,35 @@
+#pragma once
+/* smp/percpu.h — per-CPU data areas
+ *
+ * Every CPU owns one cache-line-aligned percpu_t and finds it through the
+ * HAL's per-CPU register (GS_BASE / TPIDR_EL1), so this_cpu() is a single
+ * register read and no CPU ever writes another's line on a hot path.
+ *
+ * Fields are only touched by their own CPU unless noted.  A thread that
+ * can be preempted may migrate between this_cpu() and a later access, so
+ * read-modify-write of a field needs IRQs masked (see sync/rcu.h).
+ */
+#include <stdint.h>
+#include "../hal.h"
+
+typedef struct percpu {
+    hal_percpu_hdr_t hdr;           /* must stay first                    */
+    uint32_t         rcu_nest;      /* rcu_read_lock() depth              */
+    uint64_t         rcu_qs;        /* last grace period this CPU passed;
+                                       read by synchronize_rcu()          */
+} __attribute__((aligned(64))) percpu_t;
+
+extern percpu_t g_percpu[HAL_MAX_CPUS];
+
+/* CPU `cpu`'s area with its header filled in, for handing to a CPU that
+ * is about to start */
+percpu_t *percpu_area(uint32_t cpu);
+
+/* Point the calling CPU at its area.  The first thing kmain() does on
+ * the boot CPU and each secondary does before any other C code. */
+void percpu_init(uint32_t cpu);
+
+static inline percpu_t *this_cpu(void)
+{
+    return (percpu_t *)hal_percpu();
+}
@@ -0,0 +1,55 @@
+/* kernel/src/smp/smp.c — secondary CPU bring-up
+ *
+ * The boot CPU allocates a stack per secondary from the page allocator and
+ * asks the HAL to start it.  hal_cpu_start_secondary() only returns once
+ * the CPU is running C code (or has timed out), so CPUs are brought up
+ * strictly one after another and each marks only its own online slot —
+ * plain release stores, no read-modify-write, so this works before the
+ * arm64 MMU (and with it exclusive access to normal memory) is enabled.
+ */
+#include "smp.h"
+#include "../hal.h"
+#include "../mm/pmm.h"
+#include "../sched/sched.h"
+
+static volatile uint8_t cpu_online[HAL_MAX_CPUS] = { 1 };  /* boot CPU */
+
+static void smp_secondary_main(uint32_t cpu)
+{
+    __atomic_store_n(&cpu_online[cpu], 1, __ATOMIC_RELEASE);
+    sched_cpu_main(cpu);
+}
+
+void smp_init(void)
+{
+    uint32_t n = g_hw_info.cpu_cores;
+    if (n > HAL_MAX_CPUS)
+        n = HAL_MAX_CPUS;
+
+    for (uint32_t cpu = 1; cpu < n; cpu++) {
+        uint64_t pa = pmm_alloc_pages(SMP_STACK_ORDER);
+        if (!pa)
+            break;
+
+        uint8_t *stack_top = (uint8_t *)phys_to_virt(pa)
+                           + (PAGE_SIZE << SMP_STACK_ORDER);
+        /* A CPU that timed out may still wake up later and run on this
+         * stack, so it is never handed back to the allocator. */
+        hal_cpu_start_secondary(cpu, stack_top, smp_secondary_main);
+    }
+}
+
+uint32_t smp_online_count(void)
+{
+    uint32_t n = 0;
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++)
+        n += __atomic_load_n(&cpu_online[cpu], __ATOMIC_ACQUIRE);
+    return n;
+}
+
+int smp_cpu_online(uint32_t cpu)
+{
+    if (cpu >= HAL_MAX_CPUS)
+        return 0;
+    return __atomic_load_n(&cpu_online[cpu], __ATOMIC_ACQUIRE);
+}
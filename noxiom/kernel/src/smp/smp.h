@@ -0,0 +1,18 @@
+#pragma once
+/* smp/smp.h — secondary CPU bring-up
+ *
+ * smp_init() starts every CPU the HAL reported beyond the boot CPU, one
+ * at a time, each on its own kernel stack.  A CPU that fails to come up
+ * is skipped; the rest of the kernel only ever looks at the online mask.
+ * Online secondaries go straight into the scheduler's idle loop.
+ */
+#include <stdint.h>
+
+#define SMP_STACK_ORDER  2          /* 2^2 pages = 16 KB per CPU */
+
+/* Start secondary CPUs.  Call once, after pmm_init(), hal_cpu_init(),
+ * hal_intc_init() and sched_init(). */
+void     smp_init(void);
+
+uint32_t smp_online_count(void);
+int      smp_cpu_online(uint32_t cpu);
@@ -1,9 +1,30 @@
+/* kernel/src/string.c — portable string and memory helpers
+ *
+ * kmemcpy(), kmemset() and kmemzero() are per-arch, through the table in
+ * arch/<arch>/dispatch_*.c; the rest is plain C.  kstrlen() reads a word
+ * at a time once aligned: an aligned 8-byte load never crosses a page,
+ * so reading past the NUL inside that word is harmless.
+ */
 #include "string.h"
 
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+typedef uint64_t __attribute__((may_alias)) word_t;
+
 size_t kstrlen(const char *s) {
-    size_t n = 0;
-    while (s[n]) n++;
-    return n;
+    const char *p = s;
+    while ((uintptr_t)p & 7) {
+        if (!*p) return (size_t)(p - s);
+        p++;
+    }
+    /* (w - 0x01..) & ~w & 0x80.. is non-zero iff some byte of w is 0 */
+    const word_t *w = (const word_t *)p;
+    while (!((*w - ONES) & ~*w & HIGHS))
+        w++;
+    p = (const char *)w;
+    while (*p) p++;
+    return (size_t)(p - s);
 }
 
 int kstrcmp(const char *a, const char *b) {
@@ -30,16 +51,21 @@ char *kstrncpy(char *dst, const char *src, size_t n) {
     return dst;
 }
 
-void *kmemset(void *dst, int val, size_t n) {
-    uint8_t *d = (uint8_t *)dst;
-    while (n--) *d++ = (uint8_t)val;
-    return dst;
+int kmemcmp(const void *a, const void *b, size_t n) {
+    const uint8_t *x = (const uint8_t *)a, *y = (const uint8_t *)b;
+    for (; n; n--, x++, y++)
+        if (*x != *y) return *x - *y;
+    return 0;
 }
 
-void *kmemcpy(void *dst, const void *src, size_t n) {
+void *kmemmove(void *dst, const void *src, size_t n) {
     uint8_t *d = (uint8_t *)dst;
     const uint8_t *s = (const uint8_t *)src;
-    while (n--) *d++ = *s++;
+    if (d <= s || d >= s + n)
+        return kmemcpy(dst, src, n);
+    d += n;
+    s += n;
+    while (n--) *--d = *--s;
     return dst;
 }
 
@@ -66,3 +92,116 @@ void kitoa(int64_t val, char *buf, int base) {
         kutoa((uint64_t)val, buf, base);
     }
 }
+
+/* ── kvsnprintf ──────────────────────────────────────────────────────── */
+
+typedef struct {
+    char   *buf;
+    size_t  size;
+    size_t  len;
+} fmt_out_t;
+
+static void fmt_putc(fmt_out_t *o, char c) {
+    if (o->len + 1 < o->size)
+        o->buf[o->len++] = c;
+}
+
+/* `s` padded to `width`: left-justified, or right with `pad` */
+static void fmt_field(fmt_out_t *o, const char *s, int width, int left,
+                      char pad) {
+    int n = (int)kstrlen(s);
+    if (!left)
+        for (; width > n; width--) fmt_putc(o, pad);
+    while (*s) fmt_putc(o, *s++);
+    for (; width > n; width--) fmt_putc(o, ' ');
+}
+
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list ap) {
+    fmt_out_t o = { buf, size, 0 };
+    char num[24];
+
+    for (; *fmt; fmt++) {
+        if (*fmt != '%') {
+            fmt_putc(&o, *fmt);
+            continue;
+        }
+        fmt++;
+        int left = 0;
+        char pad = ' ';
+        for (;; fmt++) {
+            if (*fmt == '-')      left = 1;
+            else if (*fmt == '0') pad = '0';
+            else break;
+        }
+        int width = 0;
+        while (*fmt >= '0' && *fmt <= '9')
+            width = width * 10 + (*fmt++ - '0');
+        int lng = 0;
+        while (*fmt == 'l' || *fmt == 'z') {
+            lng++;
+            fmt++;
+        }
+        if (left) pad = ' ';
+
+        switch (*fmt) {
+        case 'd':
+        case 'i': {
+            int64_t v = lng ? va_arg(ap, int64_t) : va_arg(ap, int);
+            kitoa(v, num, 10);
+            fmt_field(&o, num, width, left, pad);
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'p': {
+            uint64_t v;
+            if (*fmt == 'p')
+                v = (uint64_t)(uintptr_t)va_arg(ap, void *);
+            else
+                v = lng ? va_arg(ap, uint64_t) : va_arg(ap, unsigned int);
+            kutoa(v, num, *fmt == 'u' ? 10 : 16);
+            if (*fmt == 'x' || *fmt == 'p')
+                for (char *c = num; *c; c++)
+                    if (*c >= 'A') *c = (char)(*c - 'A' + 'a');
+            if (*fmt == 'p') {
+                fmt_putc(&o, '0');
+                fmt_putc(&o, 'x');
+            }
+            fmt_field(&o, num, width, left, pad);
+            break;
+        }
+        case 'c':
+            num[0] = (char)va_arg(ap, int);
+            num[1] = '\0';
+            fmt_field(&o, num, width, left, ' ');
+            break;
+        case 's': {
+            const char *s = va_arg(ap, const char *);
+            fmt_field(&o, s ? s : "(null)", width, left, ' ');
+            break;
+        }
+        case '%':
+            fmt_putc(&o, '%');
+            break;
+        case '\0':
+            fmt--;                  /* lone '%' at the end */
+            break;
+        default:
+            fmt_putc(&o, '%');
+            fmt_putc(&o, *fmt);
+            break;
+        }
+    }
+    if (size)
+        buf[o.len] = '\0';
+    return (int)o.len;
+}
+
+int ksnprintf(char *buf, size_t size, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = kvsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return n;
+}
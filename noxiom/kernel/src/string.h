@@ -1,13 +1,25 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include <stdarg.h>
 
 size_t   kstrlen(const char *s);
 int      kstrcmp(const char *a, const char *b);
 int      kstrncmp(const char *a, const char *b, size_t n);
 char    *kstrcpy(char *dst, const char *src);
 char    *kstrncpy(char *dst, const char *src, size_t n);
+/* Per-arch, the variant picked at boot (hal.h HAL_VAR_*): rep movs/stos
+ * (x86_64), ldp/stp loops and DC ZVA (arm64) */
 void    *kmemset(void *dst, int val, size_t n);
 void    *kmemcpy(void *dst, const void *src, size_t n);
+void    *kmemzero(void *dst, size_t n);    /* whole pages: the fast path */
+void    *kmemmove(void *dst, const void *src, size_t n);   /* may overlap */
+int      kmemcmp(const void *a, const void *b, size_t n);
 void     kitoa(int64_t val, char *buf, int base);
 void     kutoa(uint64_t val, char *buf, int base);
+/* printf subset: %d %i %u %x %X %p %c %s %%, flags '0' '-', a width,
+ * and the l / ll / z length modifiers.  Always NUL-terminates (size >
+ * 0) and returns the length written, not the length wanted. */
+int      kvsnprintf(char *buf, size_t size, const char *fmt, va_list ap);
+int      ksnprintf(char *buf, size_t size, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
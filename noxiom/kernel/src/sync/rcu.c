@@ -0,0 +1,105 @@
+/* kernel/src/sync/rcu.c — quiescent-state based RCU
+ *
+ * s_gp counts grace periods.  synchronize_rcu() starts one by bumping it
+ * and waits until every online CPU has recorded a g_percpu[].rcu_qs at
+ * least that large.  A CPU records the current s_gp from the scheduler
+ * (rcu_note_qs) only when it is outside every read section, so reaching
+ * the target proves that all sections it had open when the writer
+ * published have closed.
+ *
+ * Ordering: the writer's pointer store comes before its s_gp increment
+ * (both seq_cst), and a CPU loads s_gp with acquire before it can start
+ * a new section, so a reader that began after the note sees the new
+ * pointer.  The full fence in rcu_note_qs() keeps the last section's
+ * loads ahead of the note.
+ *
+ * Busy CPUs note a quiescent state on their next timer tick; idle ones
+ * are kicked so the wait does not last until they wake on their own.
+ */
+#include "rcu.h"
+#include "../smp/smp.h"
+#include "../sched/sched.h"
+
+#define RCU_POLL_NS  1000000ULL         /* 1 ms between checks          */
+
+static volatile uint64_t s_gp;          /* latest grace period started  */
+
+static rcu_head_t *volatile s_pending;  /* rcu_call() stack, newest first */
+static thread_t  *volatile  s_rcud;
+
+void rcu_note_qs(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    __atomic_store_n(&this_cpu()->rcu_qs,
+                     __atomic_load_n(&s_gp, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELEASE);
+}
+
+static int cpus_behind(uint64_t target, int kick)
+{
+    int behind = 0;
+    for (uint32_t cpu = 0; cpu < HAL_MAX_CPUS; cpu++) {
+        if (!smp_cpu_online(cpu))
+            continue;
+        if (__atomic_load_n(&g_percpu[cpu].rcu_qs, __ATOMIC_ACQUIRE) >= target)
+            continue;
+        behind = 1;
+        if (kick)
+            hal_cpu_kick(cpu);
+    }
+    return behind;
+}
+
+void synchronize_rcu(void)
+{
+    uint64_t target = __atomic_add_fetch(&s_gp, 1, __ATOMIC_SEQ_CST);
+
+    /* This thread is not in a read section, so its own CPU is done */
+    uint64_t flags = hal_irq_save();
+    rcu_note_qs();
+    hal_irq_restore(flags);
+
+    if (!cpus_behind(target, 1))
+        return;
+    while (cpus_behind(target, 0))
+        thread_sleep_ns(RCU_POLL_NS);
+}
+
+void rcu_call(rcu_head_t *head, void (*fn)(rcu_head_t *head))
+{
+    head->fn = fn;
+    rcu_head_t *old = __atomic_load_n(&s_pending, __ATOMIC_RELAXED);
+    do {
+        head->next = old;
+    } while (!__atomic_compare_exchange_n(&s_pending, &old, head, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    thread_t *t = s_rcud;
+    if (t)
+        thread_wake(t);
+}
+
+/* One grace period covers every callback queued before it started */
+static void rcud_main(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        rcu_head_t *list = __atomic_exchange_n(&s_pending, 0,
+                                               __ATOMIC_ACQUIRE);
+        if (!list) {
+            thread_block();             /* a wake in between is kept */
+            continue;
+        }
+        synchronize_rcu();
+        while (list) {
+            rcu_head_t *next = list->next;
+            list->fn(list);
+            list = next;
+        }
+    }
+}
+
+void rcu_start(void)
+{
+    s_rcud = thread_create("rcu", rcud_main, 0);
+}
@@ -0,0 +1,68 @@
+#pragma once
+/* sync/rcu.h — read-copy-update for read-mostly shared structures
+ *
+ * Readers pay two per-CPU stores and never touch a shared cache line:
+ *
+ *   rcu_read_lock();
+ *   cfg_t *c = rcu_dereference(g_cfg);
+ *   ... use *c ...
+ *   rcu_read_unlock();
+ *
+ * A writer builds a new copy, publishes it with rcu_assign_pointer(),
+ * and frees the old one only after every CPU has passed a quiescent
+ * state — switched threads, gone idle or taken a scheduler interrupt
+ * outside any read section — so no reader can still hold it:
+ *
+ *   old = g_cfg;
+ *   rcu_assign_pointer(g_cfg, new);
+ *   synchronize_rcu();              (or rcu_call() from atomic context)
+ *   kfree(old);
+ *
+ * Read sections nest, may be entered from IRQ handlers, and keep the
+ * thread on its CPU (the scheduler does not preempt inside one), but
+ * must not block or sleep.  Writers still serialise among themselves
+ * with a lock of their own.
+ */
+#include <stdint.h>
+#include "../smp/percpu.h"
+
+typedef struct rcu_head {
+    struct rcu_head *next;
+    void           (*fn)(struct rcu_head *head);
+} rcu_head_t;
+
+/* IRQs masked so the thread cannot migrate between finding its area and
+ * the increment; inside the section it can no longer move */
+static inline void rcu_read_lock(void)
+{
+    uint64_t flags = hal_irq_save();
+    this_cpu()->rcu_nest++;
+    hal_irq_restore(flags);
+    __asm__ volatile ("" ::: "memory");
+}
+
+static inline void rcu_read_unlock(void)
+{
+    __asm__ volatile ("" ::: "memory");
+    this_cpu()->rcu_nest--;
+}
+
+#define rcu_dereference(p)        __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define rcu_assign_pointer(p, v)  __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+/* Wait until every reader that might see the old version is done.
+ * Thread context only; sleeps. */
+void synchronize_rcu(void);
+
+/* Run fn(head) after a grace period, on the "rcu" thread.  Never blocks;
+ * usable with IRQs masked or locks held.  `head` is usually embedded in
+ * the object being retired. */
+void rcu_call(rcu_head_t *head, void (*fn)(rcu_head_t *head));
+
+/* Start the "rcu" thread.  After sched_init(); until then rcu_call()
+ * callbacks just queue up. */
+void rcu_start(void);
+
+/* Scheduler hooks, IRQs masked: the calling CPU is outside any read
+ * section (rcu_nest == 0) */
+void rcu_note_qs(void);
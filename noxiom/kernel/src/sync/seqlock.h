@@ -0,0 +1,69 @@
+#pragma once
+/* sync/seqlock.h — sequence lock for small, read-mostly data
+ *
+ * Writers serialise on a spinlock and bump `seq` to odd before and to
+ * even after their stores.  Readers take no lock and write nothing: they
+ * copy the data out between seq_read_begin() and seq_read_retry(), and
+ * start over if a writer was active meanwhile.
+ *
+ *   uint32_t s;
+ *   do {
+ *       s = seq_read_begin(&lock);
+ *       copy = data;
+ *   } while (seq_read_retry(&lock, s));
+ *
+ * A copy inside the loop may be torn, so it must only be used once the
+ * loop has exited (no pointers followed out of it).  Data that an IRQ
+ * handler reads must be written with the _irqsave variant, or the
+ * handler could spin on a writer it interrupted.
+ */
+#include <stdint.h>
+#include "spinlock.h"
+
+typedef struct {
+    volatile uint32_t seq;          /* odd while a write is in progress   */
+    spinlock_t        lock;         /* writers only                       */
+} seqlock_t;
+
+#define SEQLOCK_INIT { 0, SPINLOCK_INIT }
+
+static inline uint32_t seq_read_begin(const seqlock_t *s)
+{
+    uint32_t v;
+    while ((v = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE)) & 1)
+        hal_cpu_relax();
+    return v;
+}
+
+/* 1 if the data read since seq_read_begin() returned v may be torn */
+static inline int seq_read_retry(const seqlock_t *s, uint32_t v)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) != v;
+}
+
+static inline void seq_write_lock(seqlock_t *s)
+{
+    spin_lock(&s->lock);
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);    /* odd before the data */
+}
+
+static inline void seq_write_unlock(seqlock_t *s)
+{
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+    spin_unlock(&s->lock);
+}
+
+static inline uint64_t seq_write_lock_irqsave(seqlock_t *s)
+{
+    uint64_t flags = hal_irq_save();
+    seq_write_lock(s);
+    return flags;
+}
+
+static inline void seq_write_unlock_irqrestore(seqlock_t *s, uint64_t flags)
+{
+    seq_write_unlock(s);
+    hal_irq_restore(flags);
+}
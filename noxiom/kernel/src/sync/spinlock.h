@@ -0,0 +1,72 @@
+#pragma once
+/* sync/spinlock.h — ticket spinlock
+ *
+ * Short critical sections only.  The _irqsave variants also mask IRQs on
+ * the local CPU, which is required whenever the same lock can be taken
+ * from an interrupt handler.
+ *
+ * Each locker takes a ticket (one atomic add on `next`) and waits for
+ * `owner` to reach it, so the lock is handed out in arrival order: no
+ * CPU can be starved by others that happen to win the cache line more
+ * often.  Waiters only read, so the line is written once per hand-over
+ * instead of once per spin, and they wait in hal_spin_wait(): on CPUs
+ * that can sleep until a cache line is written (wfe, umwait) that is
+ * what it does.
+ */
+#include <stdint.h>
+#include "../hal.h"
+
+typedef union {
+    uint32_t word;
+    struct {
+        uint16_t owner;             /* ticket being served                */
+        uint16_t next;              /* next ticket to hand out            */
+    } t;                            /* little-endian on both arches       */
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+#define SPIN_TICKET   (1u << 16)    /* one ticket, as added to word       */
+
+static inline void spin_lock(spinlock_t *l)
+{
+    uint16_t me = (uint16_t)(__atomic_fetch_add(&l->word, SPIN_TICKET,
+                                                __ATOMIC_ACQUIRE) >> 16);
+    if (__atomic_load_n(&l->t.owner, __ATOMIC_ACQUIRE) != me)
+        hal_spin_wait(&l->t.owner, me);
+}
+
+/* One attempt; returns 1 if the lock was taken */
+static inline int spin_trylock(spinlock_t *l)
+{
+    uint32_t w = __atomic_load_n(&l->word, __ATOMIC_RELAXED);
+    if ((uint16_t)w != (uint16_t)(w >> 16))
+        return 0;                   /* held, or others are queued         */
+    return __atomic_compare_exchange_n(&l->word, &w, w + SPIN_TICKET, 0,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void spin_unlock(spinlock_t *l)
+{
+    /* Only the holder writes owner */
+    __atomic_store_n(&l->t.owner, (uint16_t)(l->t.owner + 1),
+                     __ATOMIC_RELEASE);
+}
+
+static inline int spin_is_locked(spinlock_t *l)
+{
+    uint32_t w = __atomic_load_n(&l->word, __ATOMIC_RELAXED);
+    return (uint16_t)w != (uint16_t)(w >> 16);
+}
+
+static inline uint64_t spin_lock_irqsave(spinlock_t *l)
+{
+    uint64_t flags = hal_irq_save();
+    spin_lock(l);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *l, uint64_t flags)
+{
+    spin_unlock(l);
+    hal_irq_restore(flags);
+}
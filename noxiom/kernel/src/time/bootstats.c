@@ -0,0 +1,72 @@
+/* kernel/src/time/bootstats.c — boot phase timestamps
+ *
+ * The stamp table is filled in order and never cleared.  Once it is full
+ * further marks are dropped, so the last phases go missing rather than
+ * the early ones being overwritten.
+ */
+#include "bootstats.h"
+#include "../hal.h"
+#include "../string.h"
+
+static hal_boot_mark_t s_marks[BOOT_MARKS_MAX];
+static uint32_t        s_count;
+
+void boot_stats_start(void)
+{
+    s_count = hal_boot_early_marks(s_marks, BOOT_MARKS_MAX);
+    boot_mark("entry");
+}
+
+void boot_mark(const char *phase)
+{
+    if (s_count >= BOOT_MARKS_MAX)
+        return;
+    s_marks[s_count].phase = phase;
+    s_marks[s_count].ticks = hal_boot_ticks();
+    s_count++;
+}
+
+/* Tick differences stay far below 2^64 / 10^6 (hours of boot), so a
+ * plain multiply-divide cannot overflow */
+static uint64_t ticks_to_us(uint64_t ticks, uint64_t hz)
+{
+    return ticks * 1000000 / hz;
+}
+
+uint32_t boot_stats_phases(boot_phase_t *out, uint32_t max)
+{
+    uint64_t hz = hal_boot_ticks_hz();
+    if (hz == 0 || s_count < 2)
+        return 0;
+
+    uint64_t origin = s_marks[0].ticks;
+    uint32_t n = 0;
+    for (uint32_t i = 1; i < s_count && n < max; i++, n++) {
+        uint64_t t = s_marks[i].ticks;
+        out[n].phase  = s_marks[i].phase;
+        out[n].us     = ticks_to_us(t - s_marks[i - 1].ticks, hz);
+        out[n].end_us = ticks_to_us(t - origin, hz);
+    }
+    return n;
+}
+
+void boot_stats_report(void)
+{
+    boot_phase_t ph[BOOT_MARKS_MAX];
+    uint32_t     n = boot_stats_phases(ph, BOOT_MARKS_MAX);
+    char         buf[24];
+    if (n == 0)
+        return;
+
+    hal_serial_print("[bootstats] total_us=");
+    kutoa(ph[n - 1].end_us, buf, 10);
+    hal_serial_print(buf);
+    for (uint32_t i = 0; i < n; i++) {
+        hal_serial_putchar(' ');
+        hal_serial_print(ph[i].phase);
+        hal_serial_putchar('=');
+        kutoa(ph[i].us, buf, 10);
+        hal_serial_print(buf);
+    }
+    hal_serial_print("\n");
+}
@@ -0,0 +1,31 @@
+#pragma once
+/* time/bootstats.h — where the boot time goes
+ *
+ * kmain() stamps the end of each init phase with boot_mark(); the stamps
+ * before it (boot loader, entry code) come from hal_boot_early_marks().
+ * A phase lasts from the previous stamp to its own, and the first stamp
+ * is only the origin.  Stamps are raw counter ticks, converted when read,
+ * so phases may be marked before hal_hw_detect() knows the counter rate.
+ *
+ * Boot CPU only, and only before the shell starts: there is no lock.
+ */
+#include <stdint.h>
+
+#define BOOT_MARKS_MAX  24
+
+typedef struct {
+    const char *phase;
+    uint64_t    us;             /* duration                           */
+    uint64_t    end_us;         /* since the origin                   */
+} boot_phase_t;
+
+/* First thing in kmain(): take the HAL's early stamps, stamp "entry" */
+void     boot_stats_start(void);
+/* Stamp the end of `phase` (only the pointer is kept: use a literal) */
+void     boot_mark(const char *phase);
+
+/* Phases so far, oldest first; returns the count (0 if the counter rate
+ * is unknown) */
+uint32_t boot_stats_phases(boot_phase_t *out, uint32_t max);
+/* One serial line: "[bootstats] total_us=T <phase>=<us> ..." */
+void     boot_stats_report(void);
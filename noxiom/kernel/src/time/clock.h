@@ -0,0 +1,104 @@
+#pragma once
+/* time/clock.h — fixed-point conversion between counter ticks and ns
+ *
+ * A counter running at `from_hz` is converted to a `to_hz` time base as
+ *     out = (in * mult) >> shift
+ * with a 64x64→128-bit multiply, so there is no division on the hot path
+ * and no overflow for any realistic uptime.  Used by the HAL clocks (TSC,
+ * LAPIC timer, generic timer) in both directions.
+ *
+ * A clock_ref_t ties a counter to the ns time line: the counter value
+ * that is 0 ns plus both conversions.  They are read on every timestamp
+ * and written once at calibration, so a seqlock guards them and readers
+ * never write a shared line.
+ */
+#include <stdint.h>
+#include "../sync/seqlock.h"
+
+typedef struct {
+    uint64_t mult;
+    uint32_t shift;
+} clock_conv_t;
+
+#define NSEC_PER_SEC  1000000000ULL
+
+/* Largest shift (≤ 32) for which to_hz << shift still fits in 64 bits */
+static inline clock_conv_t clock_conv_make(uint64_t from_hz, uint64_t to_hz)
+{
+    clock_conv_t c = { 0, 32 };
+    if (from_hz == 0)
+        return c;
+    while (c.shift > 0 && (to_hz >> (64 - c.shift)) != 0)
+        c.shift--;
+    c.mult = (to_hz << c.shift) / from_hz;
+    return c;
+}
+
+static inline uint64_t clock_conv(clock_conv_t c, uint64_t v)
+{
+    return (uint64_t)(((unsigned __int128)v * c.mult) >> c.shift);
+}
+
+typedef struct {
+    seqlock_t    lock;
+    uint64_t     base;              /* counter value at 0 ns              */
+    clock_conv_t to_ns;
+    clock_conv_t from_ns;
+} clock_ref_t;
+
+#define CLOCK_REF_INIT { SEQLOCK_INIT, 0, { 0, 0 }, { 0, 0 } }
+
+static inline void clock_ref_set(clock_ref_t *r, uint64_t base, uint64_t hz)
+{
+    uint64_t flags = seq_write_lock_irqsave(&r->lock);
+    r->base    = base;
+    r->to_ns   = clock_conv_make(hz, NSEC_PER_SEC);
+    r->from_ns = clock_conv_make(NSEC_PER_SEC, hz);
+    seq_write_unlock_irqrestore(&r->lock, flags);
+}
+
+/* 0 before the reference point (or before clock_ref_set()) */
+static inline uint64_t clock_ref_to_ns(const clock_ref_t *r, uint64_t count)
+{
+    uint64_t base;
+    clock_conv_t c;
+    uint32_t s;
+    do {
+        s    = seq_read_begin(&r->lock);
+        base = r->base;
+        c    = r->to_ns;
+    } while (seq_read_retry(&r->lock, s));
+    return count > base ? clock_conv(c, count - base) : 0;
+}
+
+static inline uint64_t clock_ref_from_ns(const clock_ref_t *r, uint64_t ns)
+{
+    uint64_t base;
+    clock_conv_t c;
+    uint32_t s;
+    do {
+        s    = seq_read_begin(&r->lock);
+        base = r->base;
+        c    = r->from_ns;
+    } while (seq_read_retry(&r->lock, s));
+    return base + clock_conv(c, ns);
+}
+
+/* The counter-to-ns half, for code that converts by itself (the vDSO
+ * page of user mode) */
+static inline void clock_ref_get(const clock_ref_t *r, uint64_t *base,
+                                 clock_conv_t *to_ns)
+{
+    uint32_t s;
+    do {
+        s      = seq_read_begin(&r->lock);
+        *base  = r->base;
+        *to_ns = r->to_ns;
+    } while (seq_read_retry(&r->lock, s));
+}
+
+/* Non-zero once clock_ref_set() has run with a non-zero rate */
+static inline int clock_ref_valid(const clock_ref_t *r)
+{
+    return __atomic_load_n(&r->to_ns.mult, __ATOMIC_ACQUIRE) != 0;
+}
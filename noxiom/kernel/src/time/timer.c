@@ -0,0 +1,277 @@
+/* kernel/src/time/timer.c — per-CPU hierarchical timer wheels
+ *
+ * Placement: a timer due in unit e, seen from the wheel clock clk (the
+ * next unit to run), goes to the lowest level L with e - clk < 64^(L+1),
+ * slot (e >> 6L) & 63.  Level 0 therefore holds the next 64 units
+ * exactly; a level-L slot is cascaded into the levels below when clk
+ * reaches the start of its 64^L-unit block.
+ *
+ * Catching up after a long idle period does not walk every unit or
+ * every 64-unit boundary: clk jumps straight to the next unit with work,
+ * an occupied level-0 slot or the start of an occupied slot higher up
+ * (its cascade), and boundaries whose slots are empty are skipped.
+ *
+ * Locking: one lock per wheel, taken with IRQs masked.  Callbacks run
+ * with it dropped, so they may arm timers and take other locks (the
+ * scheduler takes rq->lock inside its slice callback and arms its timer
+ * with rq->lock held — rq->lock, then wheel lock, never the reverse).
+ */
+#include "timer.h"
+#include "../hal.h"
+#include "../sync/spinlock.h"
+
+#define SLOT_MASK    (TIMER_SLOTS - 1)
+#define LVL_SHIFT(l) ((l) * TIMER_LEVEL_BITS)
+#define UNIT_NS      (1ULL << TIMER_UNIT_SHIFT)
+
+typedef struct {
+    spinlock_t lock;
+    uint64_t   clk;                         /* next unit to run          */
+    uint64_t   programmed;                  /* hardware deadline, ns     */
+    uint64_t   occupied[TIMER_LEVELS];      /* bit per non-empty slot    */
+    ktimer_t  *slots[TIMER_LEVELS][TIMER_SLOTS];
+    uint64_t   irqs;
+    int        active;                      /* hardware timer running    */
+    void     (*irq_exit)(void);
+} timer_base_t;
+
+static timer_base_t bases[HAL_MAX_CPUS];
+
+/* ── Wheel ───────────────────────────────────────────────────────────── */
+
+static void enqueue(timer_base_t *b, ktimer_t *t)
+{
+    uint64_t e = (t->expires + UNIT_NS - 1) >> TIMER_UNIT_SHIFT;
+    if (e < b->clk)
+        e = b->clk;
+
+    uint64_t delta = e - b->clk;
+    uint32_t lvl = 0;
+    while (lvl < TIMER_LEVELS - 1 &&
+           delta >= (1ULL << LVL_SHIFT(lvl + 1)))
+        lvl++;
+    /* Beyond the top level: park in its last reachable slot; run_timers()
+     * sees the deadline has not passed and queues it again */
+    if (delta >= (1ULL << LVL_SHIFT(TIMER_LEVELS)))
+        e = b->clk + (1ULL << LVL_SHIFT(TIMER_LEVELS)) - 1;
+
+    uint32_t slot = (uint32_t)(e >> LVL_SHIFT(lvl)) & SLOT_MASK;
+    ktimer_t **head = &b->slots[lvl][slot];
+
+    t->level = (uint8_t)lvl;
+    t->slot  = (uint8_t)slot;
+    t->prev  = 0;
+    t->next  = *head;
+    if (*head)
+        (*head)->prev = t;
+    *head = t;
+    b->occupied[lvl] |= 1ULL << slot;
+}
+
+static void dequeue(timer_base_t *b, ktimer_t *t)
+{
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        b->slots[t->level][t->slot] = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+    if (!b->slots[t->level][t->slot])
+        b->occupied[t->level] &= ~(1ULL << t->slot);
+    t->next = t->prev = 0;
+}
+
+/* clk has just reached a 64-unit boundary: push down the slot each level
+ * has entered, stopping at the first level that did not wrap */
+static void cascade(timer_base_t *b)
+{
+    for (uint32_t lvl = 1; lvl < TIMER_LEVELS; lvl++) {
+        uint32_t slot = (uint32_t)(b->clk >> LVL_SHIFT(lvl)) & SLOT_MASK;
+        ktimer_t *t;
+        while ((t = b->slots[lvl][slot]) != 0) {
+            dequeue(b, t);
+            enqueue(b, t);
+        }
+        if (slot != 0)
+            break;
+    }
+}
+
+/* First unit at or after clk with work: the earliest occupied slot,
+ * UINT64_MAX if none.  For levels above 0 that is when the slot
+ * cascades, which is never later than its first timer. */
+static uint64_t next_unit(const timer_base_t *b)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (uint32_t lvl = 0; lvl < TIMER_LEVELS; lvl++) {
+        uint64_t map = b->occupied[lvl];
+        if (!map)
+            continue;
+
+        uint64_t cur  = b->clk >> LVL_SHIFT(lvl);
+        uint32_t slot = (uint32_t)cur & SLOT_MASK;
+        uint64_t base = cur & ~(uint64_t)SLOT_MASK;
+        /* The slot clk is on counts too unless it has been cascaded,
+         * i.e. clk has moved past the start of its block (never true
+         * on level 0); it then only holds the next rotation */
+        int due = (b->clk & ((1ULL << LVL_SHIFT(lvl)) - 1)) == 0;
+        uint64_t later = due ? map & ~((1ULL << slot) - 1)
+                       : slot == SLOT_MASK ? 0
+                       : map & ~((2ULL << slot) - 1);
+        uint64_t unit = later ? base + __builtin_ctzll(later)
+                              : base + TIMER_SLOTS + __builtin_ctzll(map);
+        unit <<= LVL_SHIFT(lvl);
+        if (unit < best)
+            best = unit;
+    }
+    return best;
+}
+
+static void run_timers(timer_base_t *b, uint64_t now)
+{
+    uint64_t target = now >> TIMER_UNIT_SHIFT;
+
+    while (b->clk <= target) {
+        if ((b->clk & SLOT_MASK) == 0)
+            cascade(b);
+
+        /* Anything queued here while the lock is dropped is due in this
+         * very unit, so draining the slot until it is empty is correct */
+        uint32_t slot = (uint32_t)b->clk & SLOT_MASK;
+        ktimer_t *t;
+        while ((t = b->slots[0][slot]) != 0) {
+            dequeue(b, t);
+            if (t->expires > now) {         /* parked beyond the top level */
+                enqueue(b, t);
+                continue;
+            }
+            timer_fn_t fn = t->fn;
+            void *arg = t->arg;
+            __atomic_store_n(&t->pending, 0, __ATOMIC_RELEASE);
+
+            spin_unlock(&b->lock);
+            fn(arg);
+            spin_lock(&b->lock);
+        }
+
+        /* Units and cascades with nothing in them are skipped; a jump
+         * that stops at target + 1 leaves any cascade due there to the
+         * next run */
+        b->clk++;
+        uint64_t next = next_unit(b);
+        b->clk = next <= target ? next : target + 1;
+    }
+}
+
+static uint64_t next_deadline(const timer_base_t *b)
+{
+    uint64_t unit = next_unit(b);
+    return unit >> (64 - TIMER_UNIT_SHIFT) ? HAL_TIMER_NEVER
+                                          : unit << TIMER_UNIT_SHIFT;
+}
+
+static void program(timer_base_t *b)
+{
+    b->programmed = next_deadline(b);
+    hal_timer_set_deadline(b->programmed);
+}
+
+/* HAL timer callback: deadline reached or kicked by another CPU */
+static void timer_interrupt(void)
+{
+    timer_base_t *b = &bases[hal_cpu_id()];
+
+    spin_lock(&b->lock);
+    b->irqs++;
+    run_timers(b, hal_timer_now_ns());
+    program(b);
+    spin_unlock(&b->lock);
+
+    if (b->irq_exit)
+        b->irq_exit();
+}
+
+/* ── Public API ──────────────────────────────────────────────────────── */
+
+int timer_cpu_init(void (*irq_exit)(void))
+{
+    uint32_t cpu = hal_cpu_id();
+    timer_base_t *b = &bases[cpu];
+
+    uint64_t flags = spin_lock_irqsave(&b->lock);
+    b->irq_exit = irq_exit;
+    int rc = hal_timer_cpu_init(timer_interrupt);
+    if (rc == 0) {
+        /* Timers armed before now are simply overdue */
+        b->active = 1;
+        program(b);
+    }
+    spin_unlock_irqrestore(&b->lock, flags);
+    return rc;
+}
+
+int timer_cpu_active(uint32_t cpu)
+{
+    return cpu < HAL_MAX_CPUS && bases[cpu].active;
+}
+
+void timer_setup(ktimer_t *t, timer_fn_t fn, void *arg, uint32_t cpu)
+{
+    t->next    = t->prev = 0;
+    t->expires = 0;
+    t->fn      = fn;
+    t->arg     = arg;
+    t->cpu     = cpu < HAL_MAX_CPUS ? cpu : 0;
+    t->pending = 0;
+}
+
+void timer_arm(ktimer_t *t, uint64_t expires_ns)
+{
+    timer_base_t *b = &bases[t->cpu];
+
+    uint64_t flags = spin_lock_irqsave(&b->lock);
+    if (t->pending)
+        dequeue(b, t);
+    t->expires = expires_ns;
+    t->pending = 1;
+    enqueue(b, t);
+
+    int kick = 0;
+    if (b->active) {
+        uint64_t when = next_deadline(b);
+        if (when < b->programmed) {
+            if (t->cpu == hal_cpu_id())
+                program(b);
+            else {
+                b->programmed = when;   /* its interrupt reprograms */
+                kick = 1;
+            }
+        }
+    }
+    spin_unlock_irqrestore(&b->lock, flags);
+
+    if (kick)
+        hal_cpu_kick(t->cpu);
+}
+
+int timer_cancel(ktimer_t *t)
+{
+    timer_base_t *b = &bases[t->cpu];
+
+    /* The hardware deadline is left alone: firing with nothing due just
+     * reprograms it */
+    uint64_t flags = spin_lock_irqsave(&b->lock);
+    int was = t->pending;
+    if (was) {
+        dequeue(b, t);
+        __atomic_store_n(&t->pending, 0, __ATOMIC_RELEASE);
+    }
+    spin_unlock_irqrestore(&b->lock, flags);
+    return was;
+}
+
+uint64_t timer_irq_count(uint32_t cpu)
+{
+    return cpu < HAL_MAX_CPUS ? bases[cpu].irqs : 0;
+}
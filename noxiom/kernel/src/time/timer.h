@@ -0,0 +1,60 @@
+#pragma once
+/* time/timer.h — one-shot kernel timers on per-CPU hierarchical wheels
+ *
+ * Every CPU owns a wheel of TIMER_LEVELS levels with 64 slots each.  A
+ * level-0 slot spans one wheel unit (2^TIMER_UNIT_SHIFT ns ≈ 1 ms); each
+ * level above is 64 times coarser, and its slots are pushed down
+ * ("cascaded") when the wheel reaches them.  Arm and cancel are O(1).
+ *
+ * The wheel only wakes up when something is due: after each run the
+ * hardware deadline is set to the earliest pending slot, or switched off
+ * if nothing is pending, so an idle CPU takes no timer interrupts at all.
+ * Timers fire in the first unit at or after their deadline, i.e. never
+ * early and at most one unit late.
+ *
+ * Callbacks run on the timer's CPU in IRQ context (IRQs masked, no wheel
+ * lock held) and may re-arm the timer or any other one.
+ */
+#include <stdint.h>
+
+#define TIMER_UNIT_SHIFT  20            /* 1 unit = 1.048576 ms           */
+#define TIMER_LEVEL_BITS  6
+#define TIMER_SLOTS       (1u << TIMER_LEVEL_BITS)
+#define TIMER_LEVELS      5             /* 64^5 units ≈ 13 days; later
+                                           deadlines are re-queued        */
+
+typedef void (*timer_fn_t)(void *arg);
+
+typedef struct ktimer {
+    struct ktimer    *next;
+    struct ktimer    *prev;
+    uint64_t          expires;      /* ns, hal_timer_now_ns() time base  */
+    timer_fn_t        fn;
+    void             *arg;
+    uint32_t          cpu;          /* wheel it is queued on             */
+    volatile uint8_t  pending;
+    uint8_t           level;
+    uint8_t           slot;
+} ktimer_t;
+
+/* Start this CPU's wheel on the HAL one-shot timer.  irq_exit (may be 0)
+ * runs after every timer interrupt or kick, once the expired timers are
+ * done — the scheduler's preemption point.  Returns -1 if the CPU has no
+ * timer interrupt; its timers then never fire. */
+int  timer_cpu_init(void (*irq_exit)(void));
+int  timer_cpu_active(uint32_t cpu);
+
+/* Bind t to `cpu`'s wheel.  The timer must not be pending. */
+void timer_setup(ktimer_t *t, timer_fn_t fn, void *arg, uint32_t cpu);
+/* (Re)arm for absolute time expires_ns; any CPU may arm any timer */
+void timer_arm(ktimer_t *t, uint64_t expires_ns);
+/* Returns 1 if t was pending.  Does not wait for a running callback. */
+int  timer_cancel(ktimer_t *t);
+
+static inline int timer_pending(const ktimer_t *t)
+{
+    return __atomic_load_n(&t->pending, __ATOMIC_ACQUIRE);
+}
+
+/* Timer interrupts taken by `cpu` (shell statistics) */
+uint64_t timer_irq_count(uint32_t cpu);
@@ -0,0 +1,68 @@
+#pragma once
+/* user/abi.h — what user programs see of the kernel
+ *
+ * System calls:
+ *   x86_64  SYSCALL; number in rax, arguments in rdi rsi rdx r10 r8 r9,
+ *           result in rax.  rcx and r11 are clobbered, as the
+ *           instruction demands; everything else is preserved.
+ *   arm64   SVC #0; number in x8, arguments in x0-x5, result in x0.
+ *           Everything else is preserved.
+ * Results are >= 0, or a negative USER_E* code.
+ *
+ * A program starts at its entry point with its first argument register
+ * holding the value it was started with and the second the address of
+ * the vDSO page: a read-only vdso_data_t, the same in every process,
+ * from which the monotonic clock (SYS_CLOCK's ns) can be computed
+ * without entering the kernel:
+ *
+ *   do {
+ *       seq = v->seq;                       (odd: being updated, retry)
+ *       c   = counter now;
+ *       ns  = (c - v->base) * v->mult >> v->shift;   (128-bit product)
+ *   } while (seq is odd || v->seq != seq);
+ *
+ *   VDSO_COUNTER_TSC     c = RDTSCP, which also returns the CPU's index
+ *                        in ECX — SYS_GETCPU without the syscall
+ *   VDSO_COUNTER_CNTVCT  c = CNTVCT_EL0 (after an ISB); the CPU index
+ *                        is in TPIDRRO_EL0
+ *   VDSO_COUNTER_NONE    no counter user code may read: use SYS_CLOCK
+ *
+ * After SYS_FORK the caller and its new child both return from it, the
+ * child with 0, a copy of every register and a copy-on-write copy of
+ * its memory.  Programs are loaded as ELF files (user/elf.h) and paged
+ * in from the file as they touch it.
+ *
+ * hal_user_demo (entry.asm / exceptions.S) uses these numbers and
+ * offsets in assembly; keep them in step.
+ */
+#include <stdint.h>
+
+#define SYS_EXIT        0       /* (code): does not return              */
+#define SYS_WRITE       1       /* (fd, buf, len): console, fd 1 or 2    */
+#define SYS_YIELD       2       /* ()                                    */
+#define SYS_GETCPU      3       /* (): the CPU it ran on                 */
+#define SYS_CLOCK       4       /* (): monotonic ns since boot           */
+#define SYS_SLEEP       5       /* (ns)                                  */
+#define SYS_FORK        6       /* (): the child's id; 0 in the child    */
+#define SYS_WAIT        7       /* (id): that child's exit code          */
+#define SYS_COUNT       8
+
+#define USER_EBADF      (-9)
+#define USER_ECHILD     (-10)
+#define USER_ENOMEM     (-12)
+#define USER_EFAULT     (-14)
+#define USER_EINVAL     (-22)
+#define USER_ENOSYS     (-38)
+
+#define VDSO_COUNTER_NONE    0      /* = HAL_UCLOCK_* */
+#define VDSO_COUNTER_TSC     1
+#define VDSO_COUNTER_CNTVCT  2
+
+typedef struct {
+    uint32_t seq;               /* even while the fields are consistent  */
+    uint32_t counter;           /* VDSO_COUNTER_*                        */
+    uint32_t shift;             /* 1-32                                  */
+    uint32_t ncpus;             /* CPUs online when the page was set up  */
+    uint64_t base;              /* counter value at 0 ns                 */
+    uint64_t mult;
+} vdso_data_t;
@@ -0,0 +1,102 @@
+/* kernel/src/user/elf.c — ELF64 loading
+ *
+ * Only the ELF header and the program headers are read here, through
+ * the page cache like any file read.  Segment contents are left to the
+ * fault handler.
+ */
+#include "elf.h"
+#include "user.h"
+#include "../string.h"
+#include "../mm/pmm.h"
+
+static int check_header(const elf64_ehdr_t *eh)
+{
+    if (eh->ident[0] != 0x7F || eh->ident[1] != 'E' ||
+        eh->ident[2] != 'L' || eh->ident[3] != 'F' ||
+        eh->ident[4] != ELF_CLASS64 || eh->ident[5] != ELF_DATA2LSB)
+        return -1;
+    if (eh->type != ELF_ET_EXEC && eh->type != ELF_ET_DYN)
+        return -1;
+    if (eh->machine != hal_user_machine() ||
+        eh->phentsize != sizeof(elf64_phdr_t) ||
+        eh->phnum == 0 || eh->phnum > ELF_MAX_PHDRS)
+        return -1;
+    return 0;
+}
+
+/* One PT_LOAD segment as a region, bias added to its addresses */
+static int map_segment(uvm_t *vm, vfs_file_t *f, const elf64_phdr_t *ph,
+                       uint64_t bias)
+{
+    uint64_t mask = PAGE_SIZE - 1;
+    if (ph->filesz > ph->memsz || ((ph->vaddr - ph->offset) & mask) ||
+        ph->vaddr + ph->memsz < ph->vaddr)
+        return -1;
+    uint64_t start = (bias + ph->vaddr) & ~mask;
+    uint64_t end   = (bias + ph->vaddr + ph->memsz + mask) & ~mask;
+    uint64_t lead  = ph->vaddr & mask;
+
+    uint32_t prot = 0;
+    if (ph->flags & ELF_PF_W)
+        prot |= HAL_UMAP_W;
+    if (ph->flags & ELF_PF_X)
+        prot |= HAL_UMAP_X;
+    return uvm_map(vm, start, end - start, prot, f, ph->offset & ~mask,
+                   ph->filesz ? lead + ph->filesz : 0);
+}
+
+int elf_load(uvm_t *vm, const char *path, uint64_t *entry)
+{
+    vfs_file_t f;
+    if (vfs_open(&f, path) != 0)
+        return -1;
+
+    elf64_ehdr_t eh;
+    int rc = -1;
+    if (vfs_read(&f, 0, &eh, sizeof(eh)) != sizeof(eh) ||
+        check_header(&eh) != 0)
+        goto out;
+
+    /* A position-independent image goes where the lowest segment
+     * lands at USER_ELF_BASE */
+    uint64_t bias = 0;
+    if (eh.type == ELF_ET_DYN) {
+        uint64_t low = ~0ULL;
+        for (uint32_t i = 0; i < eh.phnum; i++) {
+            elf64_phdr_t ph;
+            if (vfs_read(&f, eh.phoff + i * sizeof(ph), &ph, sizeof(ph))
+                != sizeof(ph))
+                goto out;
+            if (ph.type == ELF_PT_LOAD && ph.vaddr < low)
+                low = ph.vaddr;
+        }
+        bias = vm->base + USER_ELF_BASE - (low & ~(PAGE_SIZE - 1));
+    }
+
+    /* The entry point must be in an executable segment: it is where
+     * the first return to user mode jumps, and a non-canonical one
+     * would fault in the kernel instead (SYSRET on x86_64) */
+    uint64_t start = eh.entry + bias;
+    int any = 0, entry_ok = 0;
+    for (uint32_t i = 0; i < eh.phnum; i++) {
+        elf64_phdr_t ph;
+        if (vfs_read(&f, eh.phoff + i * sizeof(ph), &ph, sizeof(ph))
+            != sizeof(ph))
+            goto out;
+        if (ph.type != ELF_PT_LOAD || ph.memsz == 0)
+            continue;
+        if (map_segment(vm, &f, &ph, bias) != 0)
+            goto out;
+        any = 1;
+        if ((ph.flags & ELF_PF_X) && start >= bias + ph.vaddr &&
+            start - (bias + ph.vaddr) < ph.memsz)
+            entry_ok = 1;
+    }
+    if (any && entry_ok && start >= vm->base && start < vm->end) {
+        *entry = start;
+        rc = 0;
+    }
+out:
+    vfs_close(&f);
+    return rc;
+}
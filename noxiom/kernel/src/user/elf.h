@@ -0,0 +1,60 @@
+#pragma once
+/* user/elf.h — ELF64 executables
+ *
+ * elf_load() checks the header (ELF64, little-endian, the machine
+ * hal_user_machine() names, ET_EXEC or ET_DYN) and adds a region for
+ * each PT_LOAD segment, backed by the file: beyond the headers nothing
+ * of the image is read until the program touches it (user/vm.h).  A
+ * segment is mapped from the page holding its first byte, so p_vaddr
+ * and p_offset must agree modulo the page size, as linkers make them;
+ * the bytes before it on that page come from the file as well.
+ *
+ * An ET_DYN image is placed USER_ELF_BASE into the user range, an
+ * ET_EXEC one must lie inside it as linked.  There is no interpreter
+ * and no relocation: a position-independent program must be static and
+ * relocate itself, as static-pie start code does.
+ */
+#include <stdint.h>
+#include "vm.h"
+
+#define ELF_CLASS64   2
+#define ELF_DATA2LSB  1
+#define ELF_ET_EXEC   2
+#define ELF_ET_DYN    3
+#define ELF_PT_LOAD   1
+#define ELF_PF_X      1
+#define ELF_PF_W      2
+#define ELF_MAX_PHDRS 64
+
+typedef struct {
+    uint8_t  ident[16];         /* "\x7f" "ELF", class, data, version    */
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint64_t entry;
+    uint64_t phoff;
+    uint64_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} elf64_ehdr_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t filesz;
+    uint64_t memsz;
+    uint64_t align;
+} elf64_phdr_t;
+
+/* Map the executable at path into vm and set *entry.  0, or -1 if it
+ * cannot be read, is not an executable this CPU runs, its segments do
+ * not fit (uvm_map()), or the entry point is not in an executable one. */
+int elf_load(uvm_t *vm, const char *path, uint64_t *entry);
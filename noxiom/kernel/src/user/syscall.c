@@ -0,0 +1,108 @@
+/* kernel/src/user/syscall.c — system call table
+ *
+ * The arch entry code saves the user registers and calls
+ * syscall_dispatch() on the thread's kernel stack with IRQs enabled, so a
+ * handler may block or be preempted like any kernel code.  Handlers take
+ * all six argument registers and ignore what they do not use; the table
+ * is indexed by number, so the fast path is one bounds check and an
+ * indirect call.
+ */
+#include "user.h"
+#include "abi.h"
+#include "../hal.h"
+#include "../sched/sched.h"
+
+#define WRITE_CHUNK  128
+
+typedef int64_t (*syscall_fn_t)(uint64_t a0, uint64_t a1, uint64_t a2,
+                                uint64_t a3, uint64_t a4, uint64_t a5);
+
+#define SYSCALL_ARGS  uint64_t a0, uint64_t a1, uint64_t a2, \
+                      uint64_t a3, uint64_t a4, uint64_t a5
+#define UNUSED_ARGS   (void)a0; (void)a1; (void)a2; \
+                      (void)a3; (void)a4; (void)a5
+
+static int64_t sys_exit(SYSCALL_ARGS)
+{
+    (void)a1; (void)a2; (void)a3; (void)a4; (void)a5;
+    user_exit((int64_t)a0);
+}
+
+/* Console output, a chunk at a time: user memory is only read through
+ * user_copy_in(), which checks every page */
+static int64_t sys_write(SYSCALL_ARGS)
+{
+    (void)a3; (void)a4; (void)a5;
+    if (a0 != 1 && a0 != 2)
+        return USER_EBADF;
+    user_proc_t *p = user_current();
+    char buf[WRITE_CHUNK + 1];
+    for (uint64_t done = 0; done < a2; ) {
+        uint64_t n = a2 - done < WRITE_CHUNK ? a2 - done : WRITE_CHUNK;
+        if (user_copy_in(p, buf, a1 + done, n) != 0)
+            return done ? (int64_t)done : USER_EFAULT;
+        buf[n] = 0;
+        hal_display_print(buf);
+        done += n;
+    }
+    return (int64_t)a2;
+}
+
+static int64_t sys_yield(SYSCALL_ARGS)
+{
+    UNUSED_ARGS;
+    thread_yield();
+    return 0;
+}
+
+static int64_t sys_getcpu(SYSCALL_ARGS)
+{
+    UNUSED_ARGS;
+    return hal_cpu_id();
+}
+
+static int64_t sys_clock(SYSCALL_ARGS)
+{
+    UNUSED_ARGS;
+    return (int64_t)hal_timer_now_ns();
+}
+
+static int64_t sys_sleep(SYSCALL_ARGS)
+{
+    (void)a1; (void)a2; (void)a3; (void)a4; (void)a5;
+    thread_sleep_ns(a0);
+    return 0;
+}
+
+static int64_t sys_fork(SYSCALL_ARGS)
+{
+    UNUSED_ARGS;
+    return user_fork();
+}
+
+static int64_t sys_wait(SYSCALL_ARGS)
+{
+    (void)a1; (void)a2; (void)a3; (void)a4; (void)a5;
+    if (a0 > UINT32_MAX)
+        return USER_ECHILD;
+    return user_wait_child((uint32_t)a0);
+}
+
+static const syscall_fn_t s_table[SYS_COUNT] = {
+    [SYS_EXIT]   = sys_exit,
+    [SYS_WRITE]  = sys_write,
+    [SYS_YIELD]  = sys_yield,
+    [SYS_GETCPU] = sys_getcpu,
+    [SYS_CLOCK]  = sys_clock,
+    [SYS_SLEEP]  = sys_sleep,
+    [SYS_FORK]   = sys_fork,
+    [SYS_WAIT]   = sys_wait,
+};
+
+int64_t syscall_dispatch(uint64_t nr, uint64_t a0, uint64_t a1, uint64_t a2,
+                         uint64_t a3, uint64_t a4, uint64_t a5)
+{
+    if (nr >= SYS_COUNT)
+        return USER_ENOSYS;
+    return s_table[nr](a0, a1, a2, a3, a4, a5);
+}
@@ -0,0 +1,288 @@
+/* kernel/src/user/user.c — user programs: start, fork, exit, wait
+ *
+ * A program's memory is its uvm_t: regions that are paged in as they
+ * are touched, so starting one costs page tables and a few headers
+ * whatever the size of its image.  The vDSO frame is shared by all
+ * programs and never freed.
+ *
+ * The address space is built by the starting thread before the new one
+ * first runs; a forked child copies its parent's registers, FP/SIMD
+ * ones included, at the system call and returns from it with 0.
+ * Teardown happens on the exiting thread itself, after it has switched
+ * back to the kernel-only tables, so the space is current nowhere when
+ * it goes.
+ *
+ * Parents and children are linked under one lock along with the exit
+ * state: forks are rare next to everything else a program does.
+ */
+#include "user.h"
+#include "abi.h"
+#include "elf.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../mm/pmm.h"
+#include "../mm/kmalloc.h"
+#include "../sched/sched.h"
+#include "../sched/fpu.h"
+#include "../smp/smp.h"
+#include "../sync/spinlock.h"
+#include "../log/klog.h"
+
+struct user_proc {
+    uvm_t            vm;
+    uint64_t         entry, sp, arg;
+    hal_user_regs_t  regs;          /* a forked child's, at SYS_FORK     */
+    void            *fpu;           /* and its FP/SIMD state (fpu.h)     */
+    int              forked;
+    uint32_t         id;
+    user_proc_t     *children;      /* forked, not yet waited for        */
+    user_proc_t     *sibling;
+    int              orphan;        /* its parent exited first           */
+    int              done;
+    int64_t          code;
+    thread_t        *waiter;
+    char             name[THREAD_NAME_LEN];
+};
+
+static uint64_t   s_vdso_pa;
+static uint32_t   s_next_id = 1;
+static spinlock_t s_lock = SPINLOCK_INIT;   /* family links, exit state */
+
+void user_init(void)
+{
+    s_vdso_pa = pmm_alloc_page();
+    if (!s_vdso_pa)
+        return;
+    vdso_data_t *v = phys_to_virt(s_vdso_pa);
+    kmemset(v, 0, PAGE_SIZE);
+
+    hal_user_clock_t c;
+    hal_user_clock(&c);
+    v->counter = c.counter;
+    v->shift   = c.shift;
+    v->base    = c.base;
+    v->mult    = c.mult;
+    v->ncpus   = smp_online_count();
+}
+
+static user_proc_t *proc_new(const char *name)
+{
+    if (!s_vdso_pa)
+        return 0;
+    user_proc_t *p = kzalloc(sizeof(*p));
+    if (!p)
+        return 0;
+    if (uvm_create(&p->vm, USER_VDSO, s_vdso_pa) != 0) {
+        kfree(p);
+        return 0;
+    }
+    p->id = __atomic_fetch_add(&s_next_id, 1, __ATOMIC_RELAXED);
+    kstrncpy(p->name, name, THREAD_NAME_LEN - 1);
+    return p;
+}
+
+static void user_thread(void *arg)
+{
+    user_proc_t *p = arg;
+    thread_set_uspace(p->vm.as, p);
+    if (p->forked) {
+        fpu_adopt(p->fpu);
+        p->fpu = 0;
+        hal_user_resume(&p->regs, 0);
+    }
+    hal_user_enter(p->entry, p->sp, p->arg, p->vm.base + USER_VDSO);
+}
+
+/* Add the stack and start p's thread; frees p on failure */
+static user_proc_t *proc_start(user_proc_t *p, uint64_t arg)
+{
+    uint64_t top = p->vm.base + USER_STACK_TOP;
+    p->sp  = top;
+    p->arg = arg;
+    if (uvm_map(&p->vm, top - USER_STACK_SIZE, USER_STACK_SIZE, HAL_UMAP_W,
+                0, 0, 0) == 0 && thread_create(p->name, user_thread, p))
+        return p;
+    uvm_destroy(&p->vm);
+    kfree(p);
+    return 0;
+}
+
+user_proc_t *user_spawn(const char *name, const void *code, uint32_t len,
+                        uint64_t arg)
+{
+    if (len == 0 || len > USER_TEXT_MAX)
+        return 0;
+    user_proc_t *p = proc_new(name);
+    if (!p)
+        return 0;
+    p->entry = p->vm.base + USER_TEXT;
+    uint64_t size = (len + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (uvm_map(&p->vm, p->entry, size, HAL_UMAP_X, 0, 0, 0) != 0 ||
+        uvm_write(&p->vm, p->entry, code, len) != 0) {
+        uvm_destroy(&p->vm);
+        kfree(p);
+        return 0;
+    }
+    return proc_start(p, arg);
+}
+
+user_proc_t *user_exec(const char *path, uint64_t arg)
+{
+    const char *name = path;
+    for (const char *s = path; *s; s++)
+        if (*s == '/' && s[1])
+            name = s + 1;
+    user_proc_t *p = proc_new(name);
+    if (!p)
+        return 0;
+    if (elf_load(&p->vm, path, &p->entry) != 0) {
+        uvm_destroy(&p->vm);
+        kfree(p);
+        return 0;
+    }
+    return proc_start(p, arg);
+}
+
+/* Block until p has exited, then free it */
+static int64_t reap(user_proc_t *p, uvm_stats_t *stats)
+{
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    p->waiter = thread_current();
+    while (!p->done) {
+        spin_unlock_irqrestore(&s_lock, flags);
+        thread_block();
+        flags = spin_lock_irqsave(&s_lock);
+    }
+    spin_unlock_irqrestore(&s_lock, flags);
+
+    int64_t code = p->code;
+    if (stats)
+        *stats = p->vm.stats;
+    kfree(p);
+    return code;
+}
+
+int64_t user_wait(user_proc_t *p, uvm_stats_t *stats)
+{
+    return reap(p, stats);
+}
+
+int64_t user_wait_child(uint32_t id)
+{
+    user_proc_t *self = user_current(), **link, *c;
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    for (link = &self->children; (c = *link); link = &c->sibling)
+        if (c->id == id) {
+            *link = c->sibling;
+            break;
+        }
+    spin_unlock_irqrestore(&s_lock, flags);
+    return c ? reap(c, 0) : USER_ECHILD;
+}
+
+int64_t user_fork(void)
+{
+    user_proc_t *p = user_current();
+    user_proc_t *c = kzalloc(sizeof(*c));
+    if (!c)
+        return USER_ENOMEM;
+    if (uvm_fork(&c->vm, &p->vm) != 0) {
+        kfree(c);
+        return USER_ENOMEM;
+    }
+    hal_user_save(&c->regs);
+    c->fpu = fpu_snapshot();
+    c->forked = 1;
+    c->id = __atomic_fetch_add(&s_next_id, 1, __ATOMIC_RELAXED);
+    kstrncpy(c->name, p->name, THREAD_NAME_LEN - 1);
+
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    c->sibling = p->children;
+    p->children = c;
+    spin_unlock_irqrestore(&s_lock, flags);
+    if (thread_create(c->name, user_thread, c))
+        return c->id;
+
+    flags = spin_lock_irqsave(&s_lock);
+    p->children = c->sibling;
+    spin_unlock_irqrestore(&s_lock, flags);
+    fpu_free(c->fpu);
+    uvm_destroy(&c->vm);
+    kfree(c);
+    return USER_ENOMEM;
+}
+
+user_proc_t *user_current(void)
+{
+    return thread_user(thread_current());
+}
+
+void user_exit(int64_t code)
+{
+    user_proc_t *p = user_current();
+    thread_set_uspace(0, 0);
+    uvm_destroy(&p->vm);
+
+    /* Children that have exited go now, the others when they do */
+    user_proc_t *dead = 0, *c, *next;
+    uint64_t flags = spin_lock_irqsave(&s_lock);
+    for (c = p->children; c; c = next) {
+        next = c->sibling;
+        c->orphan = 1;
+        if (c->done) {
+            c->sibling = dead;
+            dead = c;
+        }
+    }
+    p->children = 0;
+    p->code = code;
+    p->done = 1;
+    int orphan = p->orphan;
+    thread_t *waiter = p->waiter;
+    spin_unlock_irqrestore(&s_lock, flags);
+
+    for (; dead; dead = next) {
+        next = dead->sibling;
+        kfree(dead);
+    }
+    if (orphan)
+        kfree(p);
+    else if (waiter)
+        thread_wake(waiter);
+    thread_exit();
+}
+
+int user_page_fault(uint64_t addr, uint32_t access)
+{
+    user_proc_t *p = user_current();
+    return p ? uvm_fault(&p->vm, addr, access) : -1;
+}
+
+void user_fault(const char *what, uint64_t pc, uint64_t addr)
+{
+    user_proc_t *p = user_current();
+    klog("[user] %s: %s at pc 0x%lx, address 0x%lx; killed",
+         p ? p->name : "?", what, (unsigned long)pc, (unsigned long)addr);
+    if (!p) {
+        klog_panic("[panic] user-mode fault in a thread with no program");
+        hal_halt();
+    }
+    user_exit(USER_FAULT_CODE);
+}
+
+int user_copy_in(user_proc_t *p, void *dst, uint64_t src, uint64_t len)
+{
+    uint8_t *out = dst;
+    while (len) {
+        uint64_t off = src & (PAGE_SIZE - 1);
+        uint64_t n = PAGE_SIZE - off < len ? PAGE_SIZE - off : len;
+        uint64_t pa = uvm_lookup(&p->vm, src - off, 0);
+        if (!pa || src + n < src)
+            return -1;
+        kmemcpy(out, (const uint8_t *)phys_to_virt(pa) + off, n);
+        out += n;
+        src += n;
+        len -= n;
+    }
+    return 0;
+}
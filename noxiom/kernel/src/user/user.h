@@ -0,0 +1,87 @@
+#pragma once
+/* user/user.h — user-mode programs
+ *
+ * A user program is one thread in an address space of its own (hal.h,
+ * "User mode"; user/vm.h), laid out as offsets from the start of the
+ * HAL's user range:
+ *
+ *   USER_VDSO          the shared read-only vDSO page (abi.h)
+ *   USER_TEXT          user_spawn()'s code, copied in
+ *   USER_ELF_BASE      user_exec()'s position-independent images, mapped
+ *                      from the file and paged in on demand
+ *   USER_STACK_TOP     top of USER_STACK_SIZE of stack, zero-filled on
+ *                      demand
+ *
+ * The kernel only ever reaches user memory a page at a time through the
+ * program's regions (uvm_lookup()), so a bad pointer is an error code,
+ * never a fault.
+ *
+ * The thread leaves user mode through the arch entry code only: for a
+ * system call (syscall_dispatch()), a page fault (user_page_fault()) or
+ * another exception (user_fault()).  The first two run with IRQs enabled
+ * on the thread's kernel stack.  SYS_EXIT and faults that cannot be
+ * resolved tear the address space down and end the thread; the exit code
+ * is kept for whoever waits.
+ *
+ * SYS_FORK starts a copy of the caller (copy-on-write, uvm_fork()) as
+ * its child, which the caller may SYS_WAIT for.  A child outliving its
+ * parent is freed when it exits; one that exits first waits, as a few
+ * bytes, for its parent's SYS_WAIT or exit.
+ */
+#include <stdint.h>
+#include "vm.h"
+
+#define USER_VDSO          0x0000ULL        /* offsets into the range    */
+#define USER_TEXT          0x10000ULL
+#define USER_TEXT_MAX      (64 * 1024)      /* bytes of code             */
+#define USER_ELF_BASE      0x100000ULL
+#define USER_STACK_TOP     0x40000000ULL
+#define USER_STACK_SIZE    (1024 * 1024)
+
+/* Exit code of a thread killed by a fault */
+#define USER_FAULT_CODE    (-1)
+
+typedef struct user_proc user_proc_t;
+
+/* Set up the vDSO page.  After the timers are calibrated. */
+void user_init(void);
+
+/* Start `code` (position independent, len bytes) as a user program in a
+ * thread called name, entered with arg.  0 if out of memory, len is too
+ * large or the HAL offers no user mode. */
+user_proc_t *user_spawn(const char *name, const void *code, uint32_t len,
+                        uint64_t arg);
+/* Start the ELF executable at path (elf.h) with arg, in a thread named
+ * after the file.  0 if it cannot be loaded or out of memory.  Thread
+ * context: reads the headers. */
+user_proc_t *user_exec(const char *path, uint64_t arg);
+/* Wait for a program the kernel started to exit; returns its exit code,
+ * copies its paging counts to stats unless 0, and frees p.  Exactly one
+ * user_wait() per user_spawn() or user_exec(). */
+int64_t      user_wait(user_proc_t *p, uvm_stats_t *stats);
+
+/* Called by the arch entry code (x86_64 syscall_entry, arm64 el0_sync) */
+int64_t syscall_dispatch(uint64_t nr, uint64_t a0, uint64_t a1, uint64_t a2,
+                         uint64_t a3, uint64_t a4, uint64_t a5);
+/* The arch page fault handler, for a fault from user mode at addr:
+ * access is HAL_UMAP_W for a write, HAL_UMAP_X for an instruction fetch
+ * and 0 for a read.  0 if the page is now mapped and the access can be
+ * retried; otherwise the handler goes on to user_fault(). */
+int     user_page_fault(uint64_t addr, uint32_t access);
+/* The arch exception handler, for an exception from user mode: report it
+ * with the faulting pc and address (0 if there is none) and kill the
+ * thread */
+void    user_fault(const char *what, uint64_t pc, uint64_t addr)
+    __attribute__((noreturn));
+
+/* For syscall.c: the calling thread's program, its exit, its children
+ * and its memory.  user_fork() returns the child's id, user_wait_child()
+ * that child's exit code, both negative USER_E* codes on failure.
+ * user_copy_in() copies len bytes from user address src, 0 or -1 if any
+ * of it is not readable. */
+user_proc_t *user_current(void);
+void         user_exit(int64_t code) __attribute__((noreturn));
+int64_t      user_fork(void);
+int64_t      user_wait_child(uint32_t id);
+int          user_copy_in(user_proc_t *p, void *dst, uint64_t src,
+                          uint64_t len);
@@ -0,0 +1,98 @@
+/* kernel/src/user/user_cmd.c — user-mode shell commands
+ *
+ *   usertest [n]     run hal_user_demo as a user program: it prints a
+ *                    line, makes n null system calls (SYS_GETCPU, default
+ *                    100000) and exits with the time read from the vDSO
+ *                    page, which is checked against the kernel's clock;
+ *                    prints the cost of one system call round trip
+ *   exec <path> [n]  run an ELF executable from a mounted filesystem with
+ *                    argument n (default 0); prints its exit code and how
+ *                    its pages were faulted in: how many came straight
+ *                    from the page cache, out of how many in the file
+ */
+#include "user.h"
+#include "../fs/vfs.h"
+#include "../hal.h"
+#include "../string.h"
+#include "../shell/shell.h"
+
+#define USERTEST_DEFAULT  100000
+
+static void cmd_usertest(int argc, char **argv) {
+    uint64_t n = shell_parse_uint(argc > 1 ? argv[1] : 0, USERTEST_DEFAULT);
+    uint32_t len = (uint32_t)(hal_user_demo_end - hal_user_demo);
+
+    uint64_t start = hal_timer_now_ns();
+    user_proc_t *p = user_spawn("usertest", hal_user_demo, len, n);
+    if (!p) {
+        hal_display_print("usertest: no user mode (out of memory?)\n");
+        return;
+    }
+    int64_t vdso_ns = user_wait(p, 0);
+    uint64_t end = hal_timer_now_ns();
+
+    char line[160];
+    if (vdso_ns < 0) {
+        hal_display_print("usertest: the program was killed\n");
+        return;
+    }
+    ksnprintf(line, sizeof(line),
+              "%lu syscalls in %lu us, %lu ns each (spawn and exit "
+              "included)\n",
+              (unsigned long)n, (unsigned long)((end - start) / 1000),
+              (unsigned long)(n ? (end - start) / n : 0));
+    hal_display_print(line);
+    int ok = (uint64_t)vdso_ns >= start && (uint64_t)vdso_ns <= end;
+    ksnprintf(line, sizeof(line),
+              "vDSO clock at exit %lu ns, kernel %lu-%lu ns: %s\n",
+              (unsigned long)vdso_ns, (unsigned long)start,
+              (unsigned long)end, ok ? "ok" : "MISMATCH");
+    hal_display_print(line);
+}
+
+SHELL_CMD(usertest, .fn = cmd_usertest, .args = "[n]",
+          .help = "run a user-mode program, time its syscalls");
+
+static void cmd_exec(int argc, char **argv) {
+    if (argc < 2) {
+        hal_display_print("exec: <path> [n]\n");
+        return;
+    }
+    uint64_t arg = shell_parse_uint(argc > 2 ? argv[2] : 0, 0);
+    uint64_t start = hal_timer_now_ns();
+    user_proc_t *p = user_exec(argv[1], arg);
+    if (!p) {
+        hal_display_print("exec: not an executable (or no user mode)\n");
+        return;
+    }
+    uvm_stats_t s;
+    int64_t code = user_wait(p, &s);
+    uint64_t ns = hal_timer_now_ns() - start;
+
+    uint64_t file_pages = 0;
+    vfs_node_t *node = vfs_lookup(argv[1]);
+    if (node) {
+        file_pages = (node->size + PAGE_SIZE - 1) / PAGE_SIZE;
+        vfs_node_put(node);
+    }
+    char line[160];
+    ksnprintf(line, sizeof(line), "exit code %ld after %lu us\n",
+              (long)code, (unsigned long)(ns / 1000));
+    hal_display_print(line);
+    ksnprintf(line, sizeof(line),
+              "%lu faults: %lu file pages from the cache, %lu copied, "
+              "%lu zeroed; the file has %lu\n",
+              (unsigned long)s.faults, (unsigned long)s.cache_mapped,
+              (unsigned long)s.copied, (unsigned long)s.zeroed,
+              (unsigned long)file_pages);
+    hal_display_print(line);
+    if (s.cow_copied || s.cow_reused) {
+        ksnprintf(line, sizeof(line),
+                  "copy-on-write: %lu copied, %lu reused\n",
+                  (unsigned long)s.cow_copied, (unsigned long)s.cow_reused);
+        hal_display_print(line);
+    }
+}
+
+SHELL_CMD(exec, .fn = cmd_exec, .args = "<path> [n]",
+          .help = "run an ELF program, show its demand paging");
@@ -0,0 +1,297 @@
+/* kernel/src/user/vm.c — user regions, demand paging, copy-on-write
+ *
+ * Each region keeps an array with an entry per page saying what backs
+ * it, so teardown and fork never walk the page tables: the HAL only
+ * ever maps, and hal_uspace_destroy() frees the tables at the end.  A
+ * page is remapped in place when its backing changes (cache page to
+ * private copy, shared frame to a copy of its own); hal_uspace_map()
+ * replaces the old entry.
+ *
+ * Stats are the owning thread's and are updated without a lock.
+ */
+#include "vm.h"
+#include "../string.h"
+#include "../mm/pmm.h"
+#include "../mm/kmalloc.h"
+
+struct uvm_frame {
+    uint64_t pa;
+    uint32_t refs;              /* spaces mapping it, atomic             */
+};
+
+static uvm_frame_t *frame_alloc(void)
+{
+    uvm_frame_t *f = kmalloc(sizeof(*f));
+    if (!f)
+        return 0;
+    if (!(f->pa = pmm_alloc_page())) {
+        kfree(f);
+        return 0;
+    }
+    f->refs = 1;
+    return f;
+}
+
+static void frame_put(uvm_frame_t *f)
+{
+    if (__atomic_sub_fetch(&f->refs, 1, __ATOMIC_ACQ_REL))
+        return;
+    pmm_free_page(f->pa);
+    kfree(f);
+}
+
+static int frame_shared(uvm_frame_t *f)
+{
+    return __atomic_load_n(&f->refs, __ATOMIC_ACQUIRE) > 1;
+}
+
+int uvm_create(uvm_t *vm, uint64_t shared_va, uint64_t shared_pa)
+{
+    kmemset(vm, 0, sizeof(*vm));
+    hal_user_range(&vm->base, &vm->end);
+    vm->shared_va = vm->base + shared_va;
+    vm->shared_pa = shared_pa;
+    if (!(vm->as = hal_uspace_create()))
+        return -1;
+    if (hal_uspace_map(vm->as, vm->shared_va, shared_pa, 0) != 0) {
+        uvm_destroy(vm);
+        return -1;
+    }
+    return 0;
+}
+
+void uvm_destroy(uvm_t *vm)
+{
+    if (vm->as)
+        hal_uspace_destroy(vm->as);
+    vm->as = 0;
+    for (uint32_t i = 0; i < vm->nregions; i++) {
+        uvm_region_t *r = &vm->regions[i];
+        uint64_t n = (r->end - r->start) / PAGE_SIZE;
+        for (uint64_t j = 0; j < n; j++) {
+            if (r->pages[j].cache)
+                pcache_put(r->pages[j].cache);
+            if (r->pages[j].frame)
+                frame_put(r->pages[j].frame);
+        }
+        kfree(r->pages);
+        if (r->file.node)
+            vfs_close(&r->file);
+    }
+    vm->nregions = 0;
+}
+
+int uvm_map(uvm_t *vm, uint64_t va, uint64_t len, uint32_t prot,
+            const vfs_file_t *file, uint64_t file_off, uint64_t file_len)
+{
+    uint64_t end = va + len;
+    if ((va | len | file_off) & (PAGE_SIZE - 1) || !len ||
+        len > UVM_REGION_MAX || va < vm->base || end > vm->end ||
+        vm->nregions == UVM_MAX_REGIONS)
+        return -1;
+    if (vm->shared_va >= va && vm->shared_va < end)
+        return -1;
+    for (uint32_t i = 0; i < vm->nregions; i++)
+        if (va < vm->regions[i].end && vm->regions[i].start < end)
+            return -1;
+
+    uvm_region_t *r = &vm->regions[vm->nregions];
+    *r = (uvm_region_t){ .start = va, .end = end, .prot = prot };
+    if (!(r->pages = kzalloc(len / PAGE_SIZE * sizeof(uvm_page_t))))
+        return -1;
+    if (file && file_len) {
+        vfs_dup(&r->file, file);
+        r->file_off = file_off;
+        r->file_len = file_len < len ? file_len : len;
+    }
+    vm->nregions++;
+    return 0;
+}
+
+static uvm_region_t *find(uvm_t *vm, uint64_t va)
+{
+    for (uint32_t i = 0; i < vm->nregions; i++)
+        if (va >= vm->regions[i].start && va < vm->regions[i].end)
+            return &vm->regions[i];
+    return 0;
+}
+
+/* The whole of file page `off` (from the region start) as a cache page,
+ * referenced; 0 if it is not one page of the cache (a small block, an
+ * unaligned partition or a hole) */
+static pcache_page_t *cache_page(uvm_region_t *r, uint64_t off)
+{
+    vfs_view_t v;
+    if (vfs_map(&r->file, r->file_off + off, &v) <= 0)
+        return 0;
+    if (v.pg && v.len == PAGE_SIZE && v.data == v.pg->data)
+        return v.pg;
+    vfs_unmap(&v);
+    return 0;
+}
+
+/* A private frame holding file page `off`, zero past the file part */
+static uvm_frame_t *file_copy(uvm_region_t *r, uint64_t off)
+{
+    uvm_frame_t *f = frame_alloc();
+    if (!f)
+        return 0;
+    uint8_t *page = phys_to_virt(f->pa);
+    uint64_t n = r->file_len - off < PAGE_SIZE ? r->file_len - off
+                                               : PAGE_SIZE;
+    int64_t got = vfs_read(&r->file, r->file_off + off, page, n);
+    if (got < 0) {
+        frame_put(f);
+        return 0;
+    }
+    kmemset(page + got, 0, PAGE_SIZE - (uint64_t)got);
+    return f;
+}
+
+static uvm_frame_t *frame_copy(const void *src)
+{
+    uvm_frame_t *f = frame_alloc();
+    if (f)
+        kmemcpy(phys_to_virt(f->pa), src, PAGE_SIZE);
+    return f;
+}
+
+/* Enter page pg at va as it stands: writable only for a frame of its
+ * own in a writable region */
+static int map_page(uvm_t *vm, uvm_region_t *r, uvm_page_t *pg, uint64_t va)
+{
+    uint32_t flags = r->prot & HAL_UMAP_X;
+    uint64_t pa;
+    if (pg->cache) {
+        pa = virt_to_phys(pg->cache->data);
+    } else {
+        pa = pg->frame->pa;
+        if ((r->prot & HAL_UMAP_W) && !frame_shared(pg->frame))
+            flags |= HAL_UMAP_W;
+    }
+    return hal_uspace_map(vm->as, va, pa, flags);
+}
+
+/* Back page va of r, with a private frame if `write`, and map it */
+static int fault_page(uvm_t *vm, uvm_region_t *r, uint64_t va, int write)
+{
+    uint64_t off = va - r->start;
+    uvm_page_t *pg = &r->pages[off / PAGE_SIZE];
+    vm->stats.faults++;
+
+    if (!pg->cache && !pg->frame) {
+        if (off >= r->file_len) {
+            if (!(pg->frame = frame_alloc()))
+                return -1;
+            kmemzero(phys_to_virt(pg->frame->pa), PAGE_SIZE);
+            vm->stats.zeroed++;
+        } else if (!write && r->file_len - off >= PAGE_SIZE &&
+                   (pg->cache = cache_page(r, off))) {
+            vm->stats.cache_mapped++;
+        } else {
+            if (!(pg->frame = file_copy(r, off)))
+                return -1;
+            vm->stats.copied++;
+        }
+    } else if (write && pg->cache) {
+        uvm_frame_t *f = frame_copy(pg->cache->data);
+        if (!f)
+            return -1;
+        pcache_put(pg->cache);
+        pg->cache = 0;
+        pg->frame = f;
+        vm->stats.copied++;
+    } else if (write && frame_shared(pg->frame)) {
+        uvm_frame_t *f = frame_copy(phys_to_virt(pg->frame->pa));
+        if (!f)
+            return -1;
+        frame_put(pg->frame);
+        pg->frame = f;
+        vm->stats.cow_copied++;
+    } else if (write) {
+        vm->stats.cow_reused++;
+    }
+    return map_page(vm, r, pg, va);
+}
+
+int uvm_fault(uvm_t *vm, uint64_t addr, uint32_t access)
+{
+    uint64_t va = addr & ~(PAGE_SIZE - 1);
+    uvm_region_t *r = find(vm, va);
+    if (!r || (access & ~r->prot))
+        return -1;
+    return fault_page(vm, r, va, (access & HAL_UMAP_W) != 0);
+}
+
+uint64_t uvm_lookup(uvm_t *vm, uint64_t va, int write)
+{
+    uint64_t pa = hal_uspace_lookup(vm->as, va, write);
+    if (pa || va == vm->shared_va)
+        return pa;
+    if (uvm_fault(vm, va, write ? HAL_UMAP_W : 0) != 0)
+        return 0;
+    return hal_uspace_lookup(vm->as, va, write);
+}
+
+int uvm_write(uvm_t *vm, uint64_t va, const void *src, uint64_t len)
+{
+    const uint8_t *in = src;
+    while (len) {
+        uint64_t page = va & ~(PAGE_SIZE - 1), off = va - page;
+        uint64_t n = PAGE_SIZE - off < len ? PAGE_SIZE - off : len;
+        uvm_region_t *r = find(vm, page);
+        if (!r || fault_page(vm, r, page, 1) != 0)
+            return -1;
+        uvm_page_t *pg = &r->pages[(page - r->start) / PAGE_SIZE];
+        kmemcpy((uint8_t *)phys_to_virt(pg->frame->pa) + off, in, n);
+        /* Mapped again now that it is filled: arm64 syncs the I-cache
+         * of executable pages when they are mapped */
+        if ((r->prot & HAL_UMAP_X) && map_page(vm, r, pg, page) != 0)
+            return -1;
+        va += n;
+        in += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int uvm_fork(uvm_t *child, uvm_t *parent)
+{
+    if (uvm_create(child, parent->shared_va - parent->base,
+                   parent->shared_pa) != 0)
+        return -1;
+
+    for (uint32_t i = 0; i < parent->nregions; i++) {
+        uvm_region_t *r = &parent->regions[i];
+        if (uvm_map(child, r->start, r->end - r->start, r->prot,
+                    r->file.node ? &r->file : 0, r->file_off,
+                    r->file_len) != 0)
+            goto fail;
+        uvm_region_t *c = &child->regions[child->nregions - 1];
+
+        for (uint64_t va = r->start; va < r->end; va += PAGE_SIZE) {
+            uvm_page_t *pp = &r->pages[(va - r->start) / PAGE_SIZE];
+            uvm_page_t *cp = &c->pages[(va - r->start) / PAGE_SIZE];
+            if (pp->cache) {
+                pcache_hold(pp->cache);
+                cp->cache = pp->cache;
+            } else if (pp->frame) {
+                __atomic_add_fetch(&pp->frame->refs, 1, __ATOMIC_RELAXED);
+                cp->frame = pp->frame;
+                /* Shared now: the parent's next write copies too */
+                if ((r->prot & HAL_UMAP_W) &&
+                    map_page(parent, r, pp, va) != 0)
+                    goto fail;
+            } else {
+                continue;
+            }
+            if (map_page(child, c, cp, va) != 0)
+                goto fail;
+        }
+    }
+    return 0;
+
+fail:
+    uvm_destroy(child);
+    return -1;
+}
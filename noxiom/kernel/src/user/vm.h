@@ -0,0 +1,105 @@
+#pragma once
+/* user/vm.h — user memory: regions, demand paging, copy-on-write
+ *
+ * A program's memory is a list of regions, page-aligned ranges with one
+ * protection each, either anonymous (zero-filled) or backed by part of
+ * a file.  Making a region maps nothing; the first touch of each page
+ * faults and uvm_fault() maps it:
+ *
+ *   file page, read       the page cache page itself, read-only: text
+ *                         is never copied and is shared by everything
+ *                         running the file
+ *   file page, written    a private copy — also for the page where the
+ *                         file part ends, whose tail must read as zeroes
+ *   anonymous             a zeroed frame of the program's own
+ *
+ * File pages are faulted in through the region's own open file, so its
+ * readahead sees the faults: a program working through its text reads
+ * it in large batches, not a page per fault.
+ *
+ * uvm_fork() copies a space without copying memory.  The child maps the
+ * same cache pages and the same private frames, and both map those of
+ * writable regions read-only.  Private frames are reference counted: a
+ * write fault on a shared one copies it, on one no longer shared just
+ * maps it writable again.
+ *
+ * A space belongs to one thread, the only one that faults, forks or
+ * destroys it; between spaces only the frame counts are shared.  Faults
+ * run in thread context with IRQs enabled and may wait for the disk.
+ */
+#include <stdint.h>
+#include "../hal.h"
+#include "../fs/vfs.h"
+
+#define UVM_MAX_REGIONS  16
+#define UVM_REGION_MAX   (256ULL << 20)     /* bytes in one region       */
+
+typedef struct uvm_frame uvm_frame_t;
+
+/* At most one of the two is set; neither until the page is touched */
+typedef struct {
+    pcache_page_t *cache;       /* file page, mapped from the cache      */
+    uvm_frame_t   *frame;       /* private frame, maybe shared by forks  */
+} uvm_page_t;
+
+typedef struct {
+    uint64_t    start, end;     /* page aligned                          */
+    uint32_t    prot;           /* HAL_UMAP_W | HAL_UMAP_X               */
+    vfs_file_t  file;           /* .node 0 for anonymous memory          */
+    uint64_t    file_off;       /* file offset of start, page aligned    */
+    uint64_t    file_len;       /* bytes from start the file backs       */
+    uvm_page_t *pages;
+} uvm_region_t;
+
+typedef struct {
+    uint64_t faults;
+    uint64_t cache_mapped;      /* file pages mapped without a copy      */
+    uint64_t copied;            /* file pages copied: written or partial */
+    uint64_t zeroed;            /* anonymous pages                       */
+    uint64_t cow_copied;        /* shared frames copied on a write       */
+    uint64_t cow_reused;        /* ... no longer shared, made writable   */
+} uvm_stats_t;
+
+typedef struct {
+    hal_uspace_t *as;
+    uint64_t      base, end;    /* the HAL's user range                  */
+    uint64_t      shared_va;    /* one frame mapped read-only but not    */
+    uint64_t      shared_pa;    /* owned: the vDSO page                  */
+    uvm_region_t  regions[UVM_MAX_REGIONS];
+    uint32_t      nregions;
+    uvm_stats_t   stats;
+} uvm_t;
+
+/* An empty space, with frame shared_pa mapped read-only at shared_va (an
+ * offset into the user range).  0, or -1 if out of memory or the HAL
+ * has no user mode. */
+int  uvm_create(uvm_t *vm, uint64_t shared_va, uint64_t shared_pa);
+/* Free the page tables, frames and page references; the space must not
+ * be current on any CPU */
+void uvm_destroy(uvm_t *vm);
+
+/* Add region [va, va + len), page aligned, with prot.  file (0 for none)
+ * backs its first file_len bytes, from page-aligned file_off on; the
+ * region opens the file again for itself.  -1 if the range leaves the
+ * user range, overlaps another region or is over UVM_REGION_MAX, or out
+ * of memory or regions. */
+int  uvm_map(uvm_t *vm, uint64_t va, uint64_t len, uint32_t prot,
+             const vfs_file_t *file, uint64_t file_off, uint64_t file_len);
+/* Copy len bytes into the space at va whatever the protection, for a
+ * loader; -1 for an address outside the regions, out of memory or a
+ * read error */
+int  uvm_write(uvm_t *vm, uint64_t va, const void *src, uint64_t len);
+
+/* Page fault at addr: access is HAL_UMAP_W for a write, HAL_UMAP_X for
+ * an instruction fetch, 0 for a read.  0 once the page is mapped so the
+ * access can be retried; -1 if the region does not allow it, or out of
+ * memory or a read error. */
+int      uvm_fault(uvm_t *vm, uint64_t addr, uint32_t access);
+/* Frame behind page-aligned va for the kernel to read (or write), the
+ * page faulted in first if need be; 0 if the program could not access
+ * it that way either */
+uint64_t uvm_lookup(uvm_t *vm, uint64_t va, int write);
+
+/* Make child a copy-on-write copy of parent, the calling thread's space.
+ * -1 if out of memory; child is then empty and destroyed. */
+int  uvm_fork(uvm_t *child, uvm_t *parent);
@@ -0,0 +1,83 @@
+/* kernel/src/virtio/virtio.c — device status handshake and driver table
+ *
+ * Initialisation order (spec 3.1.1): reset, ACKNOWLEDGE, DRIVER, read
+ * and write features, FEATURES_OK and check it stuck, set up the queues,
+ * DRIVER_OK.  Legacy devices have no FEATURES_OK step.
+ */
+#include "virtio.h"
+#include "../log/klog.h"
+
+typedef struct {
+    uint32_t    device_id;
+    int       (*probe)(virtio_dev_t *d);
+} virtio_driver_t;
+
+static const virtio_driver_t s_drivers[] = {
+    { VIRTIO_ID_NET,   virtio_net_probe },
+    { VIRTIO_ID_BLOCK, virtio_blk_probe },
+};
+
+void virtio_init(void)
+{
+    virtio_pci_scan();
+    virtio_mmio_scan();
+}
+
+void virtio_probe(virtio_dev_t *d)
+{
+    for (uint32_t i = 0; i < sizeof(s_drivers) / sizeof(s_drivers[0]); i++) {
+        if (s_drivers[i].device_id != d->device_id)
+            continue;
+        if (s_drivers[i].probe(d) != 0) {
+            klog("[virtio] %s: device type %u failed to start",
+                 d->where, d->device_id);
+            virtio_fail(d);
+        }
+        return;
+    }
+}
+
+int virtio_negotiate(virtio_dev_t *d, uint64_t wanted)
+{
+    d->ops->set_status(d, 0);
+    while (d->ops->get_status(d) != 0)
+        hal_cpu_relax();
+    d->ops->set_status(d, VIRTIO_STATUS_ACK);
+    d->ops->set_status(d, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+
+    if (!d->legacy)
+        wanted |= 1ULL << VIRTIO_F_VERSION_1;
+    d->features = d->ops->get_features(d) & wanted;
+    d->ops->set_features(d, d->features);
+    if (d->legacy)
+        return 0;
+
+    uint8_t s = VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER |
+                VIRTIO_STATUS_FEATURES_OK;
+    d->ops->set_status(d, s);
+    if (!(d->ops->get_status(d) & VIRTIO_STATUS_FEATURES_OK) ||
+        !virtio_has(d, VIRTIO_F_VERSION_1))
+        return -1;
+    return 0;
+}
+
+void virtio_driver_ok(virtio_dev_t *d)
+{
+    d->ops->set_status(d, d->ops->get_status(d) | VIRTIO_STATUS_DRIVER_OK);
+}
+
+void virtio_fail(virtio_dev_t *d)
+{
+    d->ops->set_status(d, d->ops->get_status(d) | VIRTIO_STATUS_FAILED);
+}
+
+uint32_t virtio_irq_setup(virtio_dev_t *d, uint32_t n, const uint32_t *cpus)
+{
+    d->nvectors = 0;
+    if (n == 0 || n > VIRTIO_MAX_VECTORS || !d->ops->irq_vectors)
+        return 0;
+    if (d->ops->irq_vectors(d, n, cpus, d->vector_irq) != (int)n)
+        return 0;
+    d->nvectors = n;
+    return n;
+}
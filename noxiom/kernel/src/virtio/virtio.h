@@ -0,0 +1,118 @@
+#pragma once
+/* virtio/virtio.h — virtio devices over PCI and MMIO
+ *
+ * virtio_init() finds virtio devices on both transports — PCI functions
+ * with vendor 0x1AF4 that have the virtio 1.0 capabilities, and the
+ * memory-mapped "virtio,mmio" slots firmware describes (version 2, and
+ * the legacy version 1 QEMU's arm64 machines default to) — and hands
+ * each to the driver for its device type.  Drivers see one interface:
+ * virtio_dev_t with its transport's ops, and split virtqueues
+ * (virtqueue.c).
+ *
+ * Interrupts: on PCI with MSI-X, virtio_irq_setup() gives every queue
+ * (or queue pair) a vector of its own aimed at a chosen CPU, and nothing
+ * needs to be acknowledged.  Otherwise the device has one shared line and
+ * the handler must call virtio_isr_ack() to find out why it fired.
+ */
+#include <stdint.h>
+#include "../hal.h"
+
+/* Device status (spec 2.1) */
+#define VIRTIO_STATUS_ACK           0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FEATURES_OK   0x08
+#define VIRTIO_STATUS_FAILED        0x80
+
+/* Transport-independent feature bits */
+#define VIRTIO_F_VERSION_1          32
+
+#define VIRTIO_ISR_QUEUE            0x1
+#define VIRTIO_ISR_CONFIG           0x2
+
+/* Device types */
+#define VIRTIO_ID_NET               1
+#define VIRTIO_ID_BLOCK             2
+
+#define VIRTIO_MAX_VECTORS          17    /* 8 queue pairs + control      */
+#define VIRTIO_NO_VECTOR            0xFFFF
+
+typedef struct virtio_dev virtio_dev_t;
+typedef struct virtqueue  virtqueue_t;
+
+typedef struct {
+    const char *name;                     /* "pci", "mmio"                */
+    uint8_t  (*get_status)(virtio_dev_t *d);
+    void     (*set_status)(virtio_dev_t *d, uint8_t status);
+    uint64_t (*get_features)(virtio_dev_t *d);
+    void     (*set_features)(virtio_dev_t *d, uint64_t features);
+    /* Device-specific configuration, byte offset off */
+    uint32_t (*cfg_read)(virtio_dev_t *d, uint32_t off, uint32_t size);
+    /* Largest ring the device allows for queue q, 0 = no such queue */
+    uint32_t (*queue_max)(virtio_dev_t *d, uint32_t q);
+    /* Tell the device where vq's rings are and enable it; vector is an
+     * index into the vectors of virtio_irq_setup() (PCI only) */
+    int      (*queue_enable)(virtio_dev_t *d, virtqueue_t *vq,
+                             uint32_t vector);
+    void     (*notify)(virtqueue_t *vq);
+    /* Read and acknowledge the interrupt status (shared line) */
+    uint32_t (*isr_ack)(virtio_dev_t *d);
+    /* Per-queue vectors: n IRQs aimed at cpus[] into irqs[]; returns n,
+     * or -1 if the device only has its shared line */
+    int      (*irq_vectors)(virtio_dev_t *d, uint32_t n,
+                            const uint32_t *cpus, int *irqs);
+} virtio_ops_t;
+
+struct virtio_dev {
+    const virtio_ops_t *ops;
+    uint32_t            device_id;        /* VIRTIO_ID_*                   */
+    uint32_t            legacy;           /* MMIO version 1                */
+    uint64_t            features;         /* negotiated                    */
+    uint32_t            irq;              /* shared line                   */
+    uint32_t            nvectors;         /* per-queue vectors, 0 = none   */
+    int                 vector_irq[VIRTIO_MAX_VECTORS];
+    const char         *where;            /* for log lines                 */
+    void               *transport;        /* transport state               */
+    void               *driver;           /* driver state                  */
+};
+
+/* Scan both transports and probe drivers.  After pci_init(), smp_init()
+ * and sched_init() (drivers start per-CPU threads). */
+void virtio_init(void);
+
+/* Called by the transports for each device found */
+void virtio_probe(virtio_dev_t *d);
+
+/* Reset, acknowledge and offer `wanted`; the device keeps what it
+ * supports in d->features.  Returns -1 if it refuses FEATURES_OK. */
+int  virtio_negotiate(virtio_dev_t *d, uint64_t wanted);
+void virtio_driver_ok(virtio_dev_t *d);
+void virtio_fail(virtio_dev_t *d);
+
+static inline int virtio_has(const virtio_dev_t *d, uint32_t bit)
+{
+    return (d->features >> bit) & 1;
+}
+
+static inline uint32_t virtio_cfg_read(virtio_dev_t *d, uint32_t off,
+                                       uint32_t size)
+{
+    return d->ops->cfg_read(d, off, size);
+}
+
+/* Up to n per-queue interrupt vectors, cpus[i] for vector i; sets
+ * d->nvectors and d->vector_irq[].  0 = use the shared line d->irq. */
+uint32_t virtio_irq_setup(virtio_dev_t *d, uint32_t n, const uint32_t *cpus);
+
+static inline uint32_t virtio_isr_ack(virtio_dev_t *d)
+{
+    return d->ops->isr_ack(d);
+}
+
+/* Transports */
+void virtio_pci_scan(void);
+void virtio_mmio_scan(void);
+
+/* Drivers */
+int  virtio_net_probe(virtio_dev_t *d);
+int  virtio_blk_probe(virtio_dev_t *d);
@@ -0,0 +1,194 @@
+/* kernel/src/virtio/virtio_mmio.c — virtio MMIO transport
+ *
+ * Register blocks are found with hal_platform_dev("virtio,mmio"); QEMU's
+ * arm64 "virt" machine has 32 of them, most with device ID 0 (nothing
+ * plugged in).  Both register layouts are driven:
+ *   version 2  modern: 64-bit features, separate ring addresses,
+ *              QueueReady
+ *   version 1  legacy: 32-bit features, one page frame number for a
+ *              ring laid out with 4 KB alignment (what virtqueue.c
+ *              allocates anyway)
+ * There is a single interrupt per device; InterruptStatus says why.
+ */
+#include "virtio.h"
+#include "virtqueue.h"
+#include "../mm/pmm.h"
+#include "../string.h"
+
+#define MMIO_MAGIC           0x000
+#define MMIO_VERSION         0x004
+#define MMIO_DEVICE_ID       0x008
+#define MMIO_DEV_FEATURES    0x010
+#define MMIO_DEV_FEAT_SEL    0x014
+#define MMIO_DRV_FEATURES    0x020
+#define MMIO_DRV_FEAT_SEL    0x024
+#define MMIO_GUEST_PAGE_SIZE 0x028      /* v1 */
+#define MMIO_QUEUE_SEL       0x030
+#define MMIO_QUEUE_NUM_MAX   0x034
+#define MMIO_QUEUE_NUM       0x038
+#define MMIO_QUEUE_ALIGN     0x03C      /* v1 */
+#define MMIO_QUEUE_PFN       0x040      /* v1 */
+#define MMIO_QUEUE_READY     0x044      /* v2 */
+#define MMIO_QUEUE_NOTIFY    0x050
+#define MMIO_IRQ_STATUS      0x060
+#define MMIO_IRQ_ACK         0x064
+#define MMIO_STATUS          0x070
+#define MMIO_QUEUE_DESC      0x080      /* v2, low then high */
+#define MMIO_QUEUE_AVAIL     0x090
+#define MMIO_QUEUE_USED      0x0A0
+#define MMIO_CONFIG          0x100
+
+#define VIRTIO_MMIO_MAGIC    0x74726976 /* "virt" */
+#define VIRTIO_MMIO_SLOTS    64
+#define VIRTIO_MMIO_MAX_DEVS 8
+
+typedef struct {
+    virtio_dev_t       dev;
+    volatile uint8_t  *regs;
+    char               where[24];
+} virtio_mmio_t;
+
+static virtio_mmio_t s_devs[VIRTIO_MMIO_MAX_DEVS];
+static uint32_t      s_ndevs;
+
+static inline volatile uint8_t *regs(virtio_dev_t *d)
+{
+    return ((virtio_mmio_t *)d->transport)->regs;
+}
+
+static inline uint32_t rd(virtio_dev_t *d, uint32_t off)
+{
+    return *(volatile uint32_t *)(regs(d) + off);
+}
+
+static inline void wr(virtio_dev_t *d, uint32_t off, uint32_t v)
+{
+    *(volatile uint32_t *)(regs(d) + off) = v;
+}
+
+/* ── Ops ─────────────────────────────────────────────────────────────── */
+
+static uint8_t mmio_get_status(virtio_dev_t *d)
+{
+    return (uint8_t)rd(d, MMIO_STATUS);
+}
+
+static void mmio_set_status(virtio_dev_t *d, uint8_t s)
+{
+    wr(d, MMIO_STATUS, s);
+}
+
+static uint64_t mmio_get_features(virtio_dev_t *d)
+{
+    wr(d, MMIO_DEV_FEAT_SEL, 0);
+    uint64_t f = rd(d, MMIO_DEV_FEATURES);
+    if (!d->legacy) {
+        wr(d, MMIO_DEV_FEAT_SEL, 1);
+        f |= (uint64_t)rd(d, MMIO_DEV_FEATURES) << 32;
+    }
+    return f;
+}
+
+static void mmio_set_features(virtio_dev_t *d, uint64_t f)
+{
+    wr(d, MMIO_DRV_FEAT_SEL, 0);
+    wr(d, MMIO_DRV_FEATURES, (uint32_t)f);
+    if (!d->legacy) {
+        wr(d, MMIO_DRV_FEAT_SEL, 1);
+        wr(d, MMIO_DRV_FEATURES, (uint32_t)(f >> 32));
+    }
+}
+
+static uint32_t mmio_cfg_read(virtio_dev_t *d, uint32_t off, uint32_t size)
+{
+    volatile uint8_t *b = regs(d) + MMIO_CONFIG + off;
+    return size == 1 ? *b : size == 2 ? *(volatile uint16_t *)b
+                                      : *(volatile uint32_t *)b;
+}
+
+static uint32_t mmio_queue_max(virtio_dev_t *d, uint32_t q)
+{
+    wr(d, MMIO_QUEUE_SEL, q);
+    return rd(d, MMIO_QUEUE_NUM_MAX);
+}
+
+static int mmio_queue_enable(virtio_dev_t *d, virtqueue_t *vq,
+                             uint32_t vector)
+{
+    (void)vector;
+    wr(d, MMIO_QUEUE_SEL, vq->index);
+    wr(d, MMIO_QUEUE_NUM, vq->size);
+    if (d->legacy) {
+        wr(d, MMIO_GUEST_PAGE_SIZE, (uint32_t)PAGE_SIZE);
+        wr(d, MMIO_QUEUE_ALIGN, (uint32_t)PAGE_SIZE);
+        wr(d, MMIO_QUEUE_PFN, (uint32_t)(vq->desc_pa >> PAGE_SHIFT));
+    } else {
+        wr(d, MMIO_QUEUE_DESC,      (uint32_t)vq->desc_pa);
+        wr(d, MMIO_QUEUE_DESC + 4,  (uint32_t)(vq->desc_pa >> 32));
+        wr(d, MMIO_QUEUE_AVAIL,     (uint32_t)vq->avail_pa);
+        wr(d, MMIO_QUEUE_AVAIL + 4, (uint32_t)(vq->avail_pa >> 32));
+        wr(d, MMIO_QUEUE_USED,      (uint32_t)vq->used_pa);
+        wr(d, MMIO_QUEUE_USED + 4,  (uint32_t)(vq->used_pa >> 32));
+        wr(d, MMIO_QUEUE_READY, 1);
+    }
+    vq->notify_addr = regs(d) + MMIO_QUEUE_NOTIFY;
+    return 0;
+}
+
+static void mmio_notify(virtqueue_t *vq)
+{
+    *(volatile uint32_t *)vq->notify_addr = vq->index;
+}
+
+static uint32_t mmio_isr_ack(virtio_dev_t *d)
+{
+    uint32_t s = rd(d, MMIO_IRQ_STATUS);
+    if (s)
+        wr(d, MMIO_IRQ_ACK, s);
+    return s;
+}
+
+static const virtio_ops_t s_mmio_ops = {
+    .name         = "mmio",
+    .get_status   = mmio_get_status,
+    .set_status   = mmio_set_status,
+    .get_features = mmio_get_features,
+    .set_features = mmio_set_features,
+    .cfg_read     = mmio_cfg_read,
+    .queue_max    = mmio_queue_max,
+    .queue_enable = mmio_queue_enable,
+    .notify       = mmio_notify,
+    .isr_ack      = mmio_isr_ack,
+    .irq_vectors  = 0,
+};
+
+/* ── Discovery ───────────────────────────────────────────────────────── */
+
+void virtio_mmio_scan(void)
+{
+    hal_platform_dev_t pd;
+    for (uint32_t i = 0; i < VIRTIO_MMIO_SLOTS &&
+                         hal_platform_dev("virtio,mmio", i, &pd) == 0; i++) {
+        volatile uint8_t *r = hal_mmio_map(pd.base, pd.size ? pd.size : 0x200);
+        if (!r || s_ndevs == VIRTIO_MMIO_MAX_DEVS || !pd.irq)
+            continue;
+        uint32_t version = *(volatile uint32_t *)(r + MMIO_VERSION);
+        uint32_t id      = *(volatile uint32_t *)(r + MMIO_DEVICE_ID);
+        if (*(volatile uint32_t *)(r + MMIO_MAGIC) != VIRTIO_MMIO_MAGIC ||
+            (version != 1 && version != 2) || id == 0)
+            continue;
+
+        virtio_mmio_t *m = &s_devs[s_ndevs++];
+        kmemset(m, 0, sizeof(*m));
+        m->regs = r;
+        ksnprintf(m->where, sizeof(m->where), "mmio %lx",
+                  (unsigned long)pd.base);
+        m->dev.ops       = &s_mmio_ops;
+        m->dev.device_id = id;
+        m->dev.legacy    = version == 1;
+        m->dev.irq       = pd.irq;
+        m->dev.where     = m->where;
+        m->dev.transport = m;
+        virtio_probe(&m->dev);
+    }
+}
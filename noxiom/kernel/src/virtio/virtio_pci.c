@@ -0,0 +1,260 @@
+/* kernel/src/virtio/virtio_pci.c — virtio 1.x PCI transport
+ *
+ * A modern virtio function (device 0x1040 + type, or a transitional
+ * 0x1000-0x103F one) describes its register blocks with vendor-specific
+ * capabilities, each naming a BAR, an offset and a length:
+ *   1  common configuration   features, status, queue set-up
+ *   2  notifications          queue doorbells, notify_off_multiplier
+ *   3  ISR status             read-to-clear, shared-line interrupts only
+ *   4  device configuration   e.g. virtio-net MAC and queue pairs
+ * Functions without them are legacy-only and are ignored.
+ */
+#include "virtio.h"
+#include "virtqueue.h"
+#include "../pci/pci.h"
+#include "../mm/kmalloc.h"
+#include "../string.h"
+#include "../log/klog.h"
+
+#define VIRTIO_PCI_VENDOR        0x1AF4
+
+#define VIRTIO_PCI_CAP_COMMON    1
+#define VIRTIO_PCI_CAP_NOTIFY    2
+#define VIRTIO_PCI_CAP_ISR       3
+#define VIRTIO_PCI_CAP_DEVICE    4
+
+/* Common configuration */
+#define COMMON_DFSELECT          0x00
+#define COMMON_DF                0x04
+#define COMMON_GFSELECT          0x08
+#define COMMON_GF                0x0C
+#define COMMON_MSIX              0x10
+#define COMMON_NUMQ              0x12
+#define COMMON_STATUS            0x14
+#define COMMON_Q_SELECT          0x16
+#define COMMON_Q_SIZE            0x18
+#define COMMON_Q_MSIX            0x1A
+#define COMMON_Q_ENABLE          0x1C
+#define COMMON_Q_NOFF            0x1E
+#define COMMON_Q_DESC            0x20
+#define COMMON_Q_AVAIL           0x28
+#define COMMON_Q_USED            0x30
+
+#define VIRTIO_PCI_MAX_DEVS      8
+
+typedef struct {
+    virtio_dev_t       dev;
+    const pci_dev_t   *pci;
+    volatile uint8_t  *common;
+    volatile uint8_t  *notify;
+    volatile uint8_t  *isr;
+    volatile uint8_t  *device;
+    uint32_t           notify_mult;
+    char               where[16];
+} virtio_pci_t;
+
+static virtio_pci_t s_devs[VIRTIO_PCI_MAX_DEVS];
+static uint32_t     s_ndevs;
+
+static inline virtio_pci_t *vp(virtio_dev_t *d)
+{
+    return d->transport;
+}
+
+static inline void w8(volatile uint8_t *b, uint32_t off, uint8_t v)
+{
+    *(volatile uint8_t *)(b + off) = v;
+}
+static inline void w16(volatile uint8_t *b, uint32_t off, uint16_t v)
+{
+    *(volatile uint16_t *)(b + off) = v;
+}
+static inline void w32(volatile uint8_t *b, uint32_t off, uint32_t v)
+{
+    *(volatile uint32_t *)(b + off) = v;
+}
+static inline uint8_t r8(volatile uint8_t *b, uint32_t off)
+{
+    return *(volatile uint8_t *)(b + off);
+}
+static inline uint16_t r16(volatile uint8_t *b, uint32_t off)
+{
+    return *(volatile uint16_t *)(b + off);
+}
+static inline uint32_t r32(volatile uint8_t *b, uint32_t off)
+{
+    return *(volatile uint32_t *)(b + off);
+}
+/* 64-bit fields as two halves: not every device takes 8-byte accesses */
+static inline void w64(volatile uint8_t *b, uint32_t off, uint64_t v)
+{
+    w32(b, off, (uint32_t)v);
+    w32(b, off + 4, (uint32_t)(v >> 32));
+}
+
+/* ── Ops ─────────────────────────────────────────────────────────────── */
+
+static uint8_t pci_get_status(virtio_dev_t *d)
+{
+    return r8(vp(d)->common, COMMON_STATUS);
+}
+
+static void pci_set_status(virtio_dev_t *d, uint8_t s)
+{
+    w8(vp(d)->common, COMMON_STATUS, s);
+}
+
+static uint64_t pci_get_features(virtio_dev_t *d)
+{
+    volatile uint8_t *c = vp(d)->common;
+    w32(c, COMMON_DFSELECT, 0);
+    uint64_t lo = r32(c, COMMON_DF);
+    w32(c, COMMON_DFSELECT, 1);
+    return lo | (uint64_t)r32(c, COMMON_DF) << 32;
+}
+
+static void pci_set_features(virtio_dev_t *d, uint64_t f)
+{
+    volatile uint8_t *c = vp(d)->common;
+    w32(c, COMMON_GFSELECT, 0);
+    w32(c, COMMON_GF, (uint32_t)f);
+    w32(c, COMMON_GFSELECT, 1);
+    w32(c, COMMON_GF, (uint32_t)(f >> 32));
+}
+
+static uint32_t pci_cfg_read(virtio_dev_t *d, uint32_t off, uint32_t size)
+{
+    volatile uint8_t *b = vp(d)->device;
+    if (!b)
+        return 0;
+    return size == 1 ? r8(b, off) : size == 2 ? r16(b, off) : r32(b, off);
+}
+
+static uint32_t pci_queue_max(virtio_dev_t *d, uint32_t q)
+{
+    volatile uint8_t *c = vp(d)->common;
+    if (q >= r16(c, COMMON_NUMQ))
+        return 0;
+    w16(c, COMMON_Q_SELECT, (uint16_t)q);
+    return r16(c, COMMON_Q_SIZE);
+}
+
+static int pci_queue_enable(virtio_dev_t *d, virtqueue_t *vq, uint32_t vector)
+{
+    virtio_pci_t *p = vp(d);
+    volatile uint8_t *c = p->common;
+    w16(c, COMMON_Q_SELECT, vq->index);
+    w16(c, COMMON_Q_SIZE, vq->size);
+    if (d->nvectors) {
+        uint16_t v = vector < d->nvectors ? (uint16_t)vector
+                                          : VIRTIO_NO_VECTOR;
+        w16(c, COMMON_Q_MSIX, v);
+        if (r16(c, COMMON_Q_MSIX) != v)
+            return -1;              /* device could not take the vector */
+    }
+    w64(c, COMMON_Q_DESC, vq->desc_pa);
+    w64(c, COMMON_Q_AVAIL, vq->avail_pa);
+    w64(c, COMMON_Q_USED, vq->used_pa);
+    vq->notify_addr = p->notify +
+                      (uint32_t)r16(c, COMMON_Q_NOFF) * p->notify_mult;
+    w16(c, COMMON_Q_ENABLE, 1);
+    return 0;
+}
+
+static void pci_notify(virtqueue_t *vq)
+{
+    *(volatile uint16_t *)vq->notify_addr = vq->index;
+}
+
+static uint32_t pci_isr_ack(virtio_dev_t *d)
+{
+    return r8(vp(d)->isr, 0);
+}
+
+static int pci_irq_vectors(virtio_dev_t *d, uint32_t n, const uint32_t *cpus,
+                           int *irqs)
+{
+    virtio_pci_t *p = vp(d);
+    if (pci_msix_count(p->pci) < n ||
+        pci_msix_enable(p->pci, n, cpus, irqs) != (int)n)
+        return -1;
+    w16(p->common, COMMON_MSIX, VIRTIO_NO_VECTOR);  /* no config IRQ */
+    return (int)n;
+}
+
+static const virtio_ops_t s_pci_ops = {
+    .name         = "pci",
+    .get_status   = pci_get_status,
+    .set_status   = pci_set_status,
+    .get_features = pci_get_features,
+    .set_features = pci_set_features,
+    .cfg_read     = pci_cfg_read,
+    .queue_max    = pci_queue_max,
+    .queue_enable = pci_queue_enable,
+    .notify       = pci_notify,
+    .isr_ack      = pci_isr_ack,
+    .irq_vectors  = pci_irq_vectors,
+};
+
+/* ── Discovery ───────────────────────────────────────────────────────── */
+
+/* Map the region a virtio capability at `cap` describes */
+static volatile uint8_t *map_cap(const pci_dev_t *pd, uint32_t cap)
+{
+    uint32_t bar_no = pci_read(pd, cap + 4, 1);
+    uint32_t off    = pci_read(pd, cap + 8, 4);
+    uint32_t len    = pci_read(pd, cap + 12, 4);
+    pci_bar_t bar;
+    if (pci_bar(pd, bar_no, &bar) != 0 || bar.is_io || off + len > bar.size)
+        return 0;
+    return hal_mmio_map(bar.base + off, len);
+}
+
+static void probe_function(const pci_dev_t *pd)
+{
+    if (s_ndevs == VIRTIO_PCI_MAX_DEVS)
+        return;
+    virtio_pci_t *p = &s_devs[s_ndevs];
+    kmemset(p, 0, sizeof(*p));
+
+    for (uint32_t cap = pci_find_cap(pd, PCI_CAP_VENDOR, 0); cap;
+         cap = pci_find_cap(pd, PCI_CAP_VENDOR, cap)) {
+        uint32_t type = pci_read(pd, cap + 3, 1);
+        volatile uint8_t **slot =
+            type == VIRTIO_PCI_CAP_COMMON ? &p->common :
+            type == VIRTIO_PCI_CAP_NOTIFY ? &p->notify :
+            type == VIRTIO_PCI_CAP_ISR    ? &p->isr    :
+            type == VIRTIO_PCI_CAP_DEVICE ? &p->device : 0;
+        if (!slot || *slot)
+            continue;               /* unknown, or a later duplicate */
+        *slot = map_cap(pd, cap);
+        if (type == VIRTIO_PCI_CAP_NOTIFY)
+            p->notify_mult = pci_read(pd, cap + 16, 4);
+    }
+    if (!p->common || !p->notify || !p->isr)
+        return;                     /* legacy-only device */
+
+    s_ndevs++;
+    pci_enable(pd, 1);
+    p->pci = pd;
+    ksnprintf(p->where, sizeof(p->where), "pci %02x:%02x.%u",
+              (pd->bdf >> 8) & 0xFF, (pd->bdf >> 3) & 0x1F, pd->bdf & 7);
+    p->dev.ops       = &s_pci_ops;
+    p->dev.device_id = pd->device >= 0x1040 ? pd->device - 0x1040u
+                                            : pci_read(pd, PCI_SUBSYS_ID, 2);
+    p->dev.irq       = pci_intx_line(pd);
+    p->dev.where     = p->where;
+    p->dev.transport = p;
+    virtio_probe(&p->dev);
+}
+
+void virtio_pci_scan(void)
+{
+    for (uint32_t i = 0;; i++) {
+        const pci_dev_t *pd = pci_find(VIRTIO_PCI_VENDOR, PCI_ANY_ID, i);
+        if (!pd)
+            break;
+        if (pd->device >= 0x1000 && pd->device <= 0x107F)
+            probe_function(pd);
+    }
+}
@@ -0,0 +1,151 @@
+/* kernel/src/virtio/virtqueue.c — split ring bookkeeping
+ *
+ * Layout in one block of pages:
+ *   desc   16 * size       descriptor table
+ *   avail  6 + 2 * size    flags, idx, ring[size], used_event
+ *   used   6 + 8 * size    at the next page boundary
+ * Free descriptors are chained through their `next` fields; a finished
+ * chain is put back at the head of that list in one step.
+ *
+ * Barriers follow virtio's weak-barrier rules: release before the
+ * driver publishes avail->idx, acquire after it reads used->idx, and a
+ * full barrier between publishing avail->idx and reading the device's
+ * used->flags (or re-reading used->idx after re-enabling interrupts),
+ * which are a store followed by a load of another location.
+ */
+#include "virtqueue.h"
+#include "../mm/pmm.h"
+#include "../mm/kmalloc.h"
+#include "../string.h"
+
+static uint32_t ring_bytes(uint32_t size)
+{
+    uint32_t avail_end = 16 * size + 6 + 2 * size;
+    uint32_t used_off  = (avail_end + (uint32_t)PAGE_SIZE - 1) &
+                         ~((uint32_t)PAGE_SIZE - 1);
+    return used_off + 6 + 8 * size;
+}
+
+int virtqueue_init(virtqueue_t *vq, virtio_dev_t *d, uint32_t index,
+                   uint32_t max)
+{
+    if (max > VIRTQ_MAX_SIZE)
+        max = VIRTQ_MAX_SIZE;
+    if (max == 0)
+        return -1;
+    uint32_t size = 1u << (31 - __builtin_clz(max));
+
+    uint32_t order = 0;
+    while ((PAGE_SIZE << order) < ring_bytes(size))
+        order++;
+    uint64_t pa = pmm_alloc_pages(order);
+    if (!pa)
+        return -1;
+    void **cookie = kzalloc(size * sizeof(void *));
+    if (!cookie) {
+        pmm_free_pages(pa, order);
+        return -1;
+    }
+    uint8_t *ring = phys_to_virt(pa);
+    kmemset(ring, 0, PAGE_SIZE << order);
+
+    uint32_t used_off = ring_bytes(size) - (6 + 8 * size);
+    vq->dev        = d;
+    vq->index      = (uint16_t)index;
+    vq->size       = (uint16_t)size;
+    vq->desc       = (vring_desc_t *)ring;
+    vq->avail      = (vring_avail_t *)(ring + 16 * size);
+    vq->used       = (volatile vring_used_t *)(ring + used_off);
+    vq->desc_pa    = pa;
+    vq->avail_pa   = pa + 16 * size;
+    vq->used_pa    = pa + used_off;
+    vq->ring_order = order;
+    vq->cookie     = cookie;
+    vq->last_used  = 0;
+    vq->kicked     = 0;
+    vq->notify_addr = 0;
+
+    for (uint32_t i = 0; i < size; i++)
+        vq->desc[i].next = (uint16_t)(i + 1);
+    vq->free_head = 0;
+    vq->nfree     = (uint16_t)size;
+    return 0;
+}
+
+int virtqueue_add(virtqueue_t *vq, const virtq_seg_t *seg, uint32_t nout,
+                  uint32_t nin, void *cookie)
+{
+    uint32_t n = nout + nin;
+    if (n == 0 || n > vq->nfree)
+        return -1;
+
+    uint16_t head = vq->free_head, i = head;
+    for (uint32_t k = 0; k < n; k++) {
+        vring_desc_t *dsc = &vq->desc[i];
+        dsc->addr  = seg[k].addr;
+        dsc->len   = seg[k].len;
+        dsc->flags = (uint16_t)((k < nout ? 0 : VRING_DESC_F_WRITE) |
+                                (k + 1 < n ? VRING_DESC_F_NEXT : 0));
+        i = dsc->next;
+    }
+    vq->free_head = i;
+    vq->nfree    -= (uint16_t)n;
+    vq->cookie[head] = cookie;
+
+    uint16_t idx = vq->avail->idx;
+    vq->avail->ring[idx & (vq->size - 1)] = head;
+    /* Descriptors and ring entry before the index that publishes them */
+    __atomic_store_n(&vq->avail->idx, (uint16_t)(idx + 1), __ATOMIC_RELEASE);
+    return 0;
+}
+
+void virtqueue_kick(virtqueue_t *vq)
+{
+    if (vq->avail->idx == vq->kicked)
+        return;
+    vq->kicked = vq->avail->idx;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!(vq->used->flags & VRING_USED_F_NO_NOTIFY))
+        vq->dev->ops->notify(vq);
+}
+
+void *virtqueue_get(virtqueue_t *vq, uint32_t *len)
+{
+    uint16_t used_idx = __atomic_load_n(&vq->used->idx, __ATOMIC_ACQUIRE);
+    if (used_idx == vq->last_used)
+        return 0;
+
+    volatile vring_used_elem_t *e =
+        &vq->used->ring[vq->last_used & (vq->size - 1)];
+    uint16_t head = (uint16_t)e->id;
+    if (len)
+        *len = e->len;
+    vq->last_used++;
+
+    /* Chain back onto the free list */
+    uint16_t tail = head;
+    uint16_t n = 1;
+    while (vq->desc[tail].flags & VRING_DESC_F_NEXT) {
+        tail = vq->desc[tail].next;
+        n++;
+    }
+    vq->desc[tail].next = vq->free_head;
+    vq->free_head = head;
+    vq->nfree    += n;
+
+    void *cookie = vq->cookie[head];
+    vq->cookie[head] = 0;
+    return cookie;
+}
+
+void virtqueue_disable_irq(virtqueue_t *vq)
+{
+    vq->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+}
+
+int virtqueue_enable_irq(virtqueue_t *vq)
+{
+    vq->avail->flags &= (uint16_t)~VRING_AVAIL_F_NO_INTERRUPT;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&vq->used->idx, __ATOMIC_ACQUIRE) == vq->last_used;
+}
@@ -0,0 +1,95 @@
+#pragma once
+/* virtio/virtqueue.h — split virtqueues (virtio 1.x, 2.7)
+ *
+ * The driver posts buffer chains with virtqueue_add(), publishes them
+ * with one virtqueue_kick() per batch, and collects finished chains with
+ * virtqueue_get(), which returns the cookie given to virtqueue_add().
+ * A queue is not locked internally: each has one owner at a time.
+ *
+ * The rings use the legacy layout (used ring on its own page), which
+ * every transport accepts, so one allocation serves MMIO version 1 and
+ * the modern transports alike.  Devices without VIRTIO_F_ACCESS_PLATFORM
+ * are cache-coherent by definition, so the rings and buffers need memory
+ * barriers only, no cache maintenance.
+ */
+#include <stdint.h>
+#include "virtio.h"
+
+#define VIRTQ_MAX_SIZE        256
+
+#define VRING_DESC_F_NEXT     1
+#define VRING_DESC_F_WRITE    2
+
+#define VRING_AVAIL_F_NO_INTERRUPT  1
+#define VRING_USED_F_NO_NOTIFY      1
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} vring_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} vring_avail_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t len;
+} vring_used_elem_t;
+
+typedef struct {
+    uint16_t          flags;
+    uint16_t          idx;
+    vring_used_elem_t ring[];
+} vring_used_t;
+
+struct virtqueue {
+    virtio_dev_t           *dev;
+    uint16_t                index;
+    uint16_t                size;
+    vring_desc_t           *desc;
+    vring_avail_t          *avail;
+    volatile vring_used_t  *used;
+    uint64_t                desc_pa, avail_pa, used_pa;
+    uint32_t                ring_order;
+    uint16_t                free_head;
+    uint16_t                nfree;
+    uint16_t                last_used;      /* next used entry to collect */
+    uint16_t                kicked;         /* avail->idx at the last kick */
+    void                  **cookie;         /* per head descriptor        */
+    volatile void          *notify_addr;    /* set by the transport       */
+};
+
+/* One buffer, by physical address */
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+} virtq_seg_t;
+
+/* Allocate rings for up to max entries (rounded down to a power of two,
+ * at most VIRTQ_MAX_SIZE).  Returns -1 on OOM or max == 0. */
+int   virtqueue_init(virtqueue_t *vq, virtio_dev_t *d, uint32_t index,
+                     uint32_t max);
+/* nout device-readable segments, then nin device-writable ones.
+ * Returns -1 if there are not enough free descriptors. */
+int   virtqueue_add(virtqueue_t *vq, const virtq_seg_t *seg, uint32_t nout,
+                    uint32_t nin, void *cookie);
+/* Notify the device of what was added since the last kick, unless it
+ * asked not to be */
+void  virtqueue_kick(virtqueue_t *vq);
+/* Next finished chain's cookie and the bytes the device wrote, 0 if none */
+void *virtqueue_get(virtqueue_t *vq, uint32_t *len);
+
+/* Interrupt suppression.  virtqueue_enable_irq() returns 0 if finished
+ * chains were already waiting (so the caller should poll again), else 1. */
+void  virtqueue_disable_irq(virtqueue_t *vq);
+int   virtqueue_enable_irq(virtqueue_t *vq);
+
+static inline uint32_t virtqueue_free(const virtqueue_t *vq)
+{
+    return vq->nfree;
+}